@@ -0,0 +1,38 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "Benchmark.h"
+
+#include <atomic>
+
+#include "../src/utils/ThreadPool.h"
+
+namespace cura
+{
+
+/*!
+ * The allocation pattern of processing layers on all threads: each layer builds many small paths and frees them again.
+ * Compare the results of builds with different ALLOCATOR settings, with --threads to see how the allocator scales.
+ */
+static BenchmarkRegistration path_churn_benchmark("Allocator::pathChurn", [](const BenchmarkWorkload& workload) -> BenchmarkKernel
+    {
+        return [&workload]()
+        {
+            constexpr int layer_count = 64;
+            std::atomic<uint64_t> point_count(0);
+            ThreadPool::getInstance()->parallelFor(0, layer_count, [&workload, &point_count](int)
+                {
+                    Polygons copies; // like the insets and skin of a layer, built path by path
+                    for (unsigned int poly_idx = 0; poly_idx < workload.outline.size(); poly_idx++)
+                    {
+                        PolygonRef copy = copies.newPoly();
+                        for (const Point& point : workload.outline[poly_idx])
+                        {
+                            copy.add(point);
+                        }
+                    }
+                    point_count += countPoints(copies);
+                });
+            return point_count.load();
+        };
+    });
+
+}//namespace cura
@@ -0,0 +1,44 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "Benchmark.h"
+
+#include "../src/slicer.h"
+
+namespace cura
+{
+
+BenchmarkWorkload::BenchmarkWorkload(std::string name, Mesh&& mesh, int layer_thickness)
+: name(name)
+, mesh(std::move(mesh))
+, layer_thickness(layer_thickness)
+{
+    const Point3 min = this->mesh.min();
+    const Point3 max = this->mesh.max();
+    layer_count = std::max(1, (max.z - min.z) / layer_thickness);
+    const int layer_nr = layer_count / 2;
+    outline_z = min.z + layer_thickness / 2 + layer_nr * layer_thickness;
+    Slicer slicer(&this->mesh, outline_z, layer_thickness, 1, false, false);
+    outline = slicer.layers[0].polygons.unionPolygons(); // like the layer parts, with holes oriented the other way than outlines
+}
+
+BenchmarkWorkload::BenchmarkWorkload(std::string name, Polygons&& outline, int64_t outline_z, SettingsBaseVirtual* settings)
+: name(name)
+, mesh(settings)
+, layer_thickness(0)
+, layer_count(0)
+, outline(std::move(outline))
+, outline_z(outline_z)
+{
+}
+
+BenchmarkRegistry& BenchmarkRegistry::getInstance()
+{
+    static BenchmarkRegistry instance;
+    return instance;
+}
+
+void BenchmarkRegistry::add(std::string name, BenchmarkSetup setup)
+{
+    entries.push_back(Entry{name, setup});
+}
+
+}//namespace cura
@@ -0,0 +1,110 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef BENCHMARKS_BENCHMARK_H
+#define BENCHMARKS_BENCHMARK_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "../src/mesh.h"
+#include "../src/utils/polygon.h"
+
+namespace cura
+{
+
+/*!
+ * The input of the benchmarks: a mesh and one of its layers, or only a layer.
+ */
+class BenchmarkWorkload
+{
+public:
+    std::string name; //!< The name under which the results on this workload are reported
+    Mesh mesh; //!< The mesh, for the benchmarks of slicing; without faces for a workload of only a layer
+    int layer_thickness; //!< The layer thickness with which the mesh is sliced
+    int layer_count; //!< The number of layers of the mesh
+    Polygons outline; //!< The sliced outline of the layer halfway up the mesh, for the benchmarks of the layer processing
+    int64_t outline_z; //!< The height of BenchmarkWorkload::outline
+
+    /*!
+     * Slice the middle layer of a mesh.
+     *
+     * \param name The name of the workload
+     * \param mesh The mesh, which should be finished
+     * \param layer_thickness The layer thickness with which to slice the mesh
+     */
+    BenchmarkWorkload(std::string name, Mesh&& mesh, int layer_thickness);
+
+    /*!
+     * A workload of only a layer, such as one captured with CuraEngine slice --slow-layers.
+     *
+     * \param name The name of the workload
+     * \param outline The outline of the layer
+     * \param outline_z The height of the layer
+     * \param settings The settings of the empty mesh
+     */
+    BenchmarkWorkload(std::string name, Polygons&& outline, int64_t outline_z, SettingsBaseVirtual* settings);
+};
+
+/*!
+ * The work of which a benchmark measures the time. Returns some number depending on the result, such as its size, so that the work can't be optimized away.
+ */
+typedef std::function<uint64_t()> BenchmarkKernel;
+
+/*!
+ * Prepares the data of a benchmark for a workload, which isn't part of the measured time.
+ * Returns an empty BenchmarkKernel if the benchmark doesn't apply to the workload.
+ */
+typedef std::function<BenchmarkKernel(const BenchmarkWorkload&)> BenchmarkSetup;
+
+/*!
+ * The total number of points of some polygons, which benchmarks can return as a result depending on all the polygons.
+ */
+inline uint64_t countPoints(const Polygons& polygons)
+{
+    uint64_t point_count = 0;
+    for (unsigned int poly_idx = 0; poly_idx < polygons.size(); poly_idx++)
+    {
+        point_count += polygons[poly_idx].size();
+    }
+    return point_count;
+}
+
+/*!
+ * All benchmarks of the benchmark executable, by name.
+ */
+class BenchmarkRegistry
+{
+public:
+    struct Entry
+    {
+        std::string name; //!< The name of the benchmark, e.g. the function it measures
+        BenchmarkSetup setup; //!< Prepares the benchmark for a workload
+    };
+
+    static BenchmarkRegistry& getInstance();
+
+    void add(std::string name, BenchmarkSetup setup);
+
+    const std::vector<Entry>& getEntries() const
+    {
+        return entries;
+    }
+
+private:
+    std::vector<Entry> entries; //!< The benchmarks in the order in which they were registered
+};
+
+/*!
+ * Registers a benchmark when constructed, for use as a static variable in the file which defines the benchmark.
+ */
+class BenchmarkRegistration
+{
+public:
+    BenchmarkRegistration(std::string name, BenchmarkSetup setup)
+    {
+        BenchmarkRegistry::getInstance().add(name, setup);
+    }
+};
+
+}//namespace cura
+#endif//BENCHMARKS_BENCHMARK_H
@@ -0,0 +1,78 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "Benchmark.h"
+
+#include <memory>
+
+#include "../src/MeshGroup.h"
+#include "../src/pathPlanning/Comb.h"
+#include "../src/sliceDataStorage.h"
+
+namespace cura
+{
+
+/*!
+ * The data of combing within a layer. Without avoiding other parts combing doesn't look at the storage, so it's empty.
+ */
+struct CombBenchmarkData
+{
+    SettingsBase settings;
+    std::unique_ptr<MeshGroup> meshgroup;
+    std::unique_ptr<SliceDataStorage> storage;
+    std::shared_ptr<CombBoundaryInside> boundary_inside;
+    std::vector<std::pair<Point, Point>> travels; //!< The start and end of each travel move to comb
+
+    CombBenchmarkData(const Polygons& outline)
+    : boundary_inside(std::make_shared<CombBoundaryInside>(outline.offset(-MM2INT(0.6)), std::vector<unsigned int>()))
+    {
+        settings.setSetting("machine_extruder_count", "1");
+        meshgroup.reset(new MeshGroup(&settings));
+        meshgroup->createExtruderTrain(0);
+        storage.reset(new SliceDataStorage(meshgroup.get()));
+    }
+};
+
+static BenchmarkRegistration comb_benchmark("Comb::calc", [](const BenchmarkWorkload& workload) -> BenchmarkKernel
+    {
+        std::shared_ptr<CombBenchmarkData> data = std::make_shared<CombBenchmarkData>(workload.outline);
+        // travel between points spread over the inside of the layer, as between the insets of different parts
+        Polygons inside = workload.outline.offset(-MM2INT(1));
+        std::vector<Point> points;
+        for (unsigned int poly_idx = 0; poly_idx < inside.size(); poly_idx++)
+        {
+            for (unsigned int point_idx = 0; point_idx < inside[poly_idx].size(); point_idx += 7)
+            {
+                points.push_back(inside[poly_idx][point_idx]);
+            }
+        }
+        if (points.size() < 2)
+        {
+            return BenchmarkKernel();
+        }
+        unsigned int random = 12345;
+        for (unsigned int travel_idx = 0; travel_idx < 200; travel_idx++)
+        {
+            random = random * 1103515245 + 12345;
+            const Point start = points[(random >> 8) % points.size()];
+            random = random * 1103515245 + 12345;
+            const Point end = points[(random >> 8) % points.size()];
+            data->travels.emplace_back(start, end);
+        }
+        return [data]()
+        {
+            // a new comb for each layer, like the LayerPlan
+            Comb comb(*data->storage, 0, data->boundary_inside, MM2INT(0.6), false, MM2INT(0.6));
+            uint64_t point_count = 0;
+            for (const std::pair<Point, Point>& travel : data->travels)
+            {
+                CombPaths comb_paths;
+                comb.calc(travel.first, travel.second, comb_paths, true, true, MM2INT(1.5), false, false);
+                for (const CombPath& comb_path : comb_paths)
+                {
+                    point_count += comb_path.size();
+                }
+            }
+            return point_count;
+        };
+    });
+
+}//namespace cura
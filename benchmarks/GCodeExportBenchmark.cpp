@@ -0,0 +1,66 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "Benchmark.h"
+
+#include <memory>
+#include <sstream>
+
+#include "../src/gcodeExport.h"
+#include "../src/infill.h"
+
+namespace cura
+{
+
+/*!
+ * Write the outline as a wall and the lines of sparse infill in the given flavor.
+ * 
+ * \param buffered Whether to format the moves in parallel afterwards, as when writing a layer with several threads
+ */
+static BenchmarkKernel writeMoveKernel(const BenchmarkWorkload& workload, EGCodeFlavor flavor, bool buffered = false)
+{
+    std::shared_ptr<Polygons> paths = std::make_shared<Polygons>(workload.outline.offset(-MM2INT(0.2)));
+    Polygons infill_polygons;
+    Infill infill(EFillMethod::LINES, workload.outline, -MM2INT(0.8), MM2INT(0.4), MM2INT(2), 0, 45, workload.outline_z, 0);
+    infill.generate(infill_polygons, *paths);
+    const int z = workload.outline_z;
+    return [paths, z, flavor, buffered]()
+    {
+        std::ostringstream output;
+        GCodeExport gcode;
+        gcode.setOutputStream(&output);
+        gcode.setFlavor(flavor);
+        gcode.setFilamentDiameter(0, MM2INT(2.85));
+        if (buffered)
+        {
+            gcode.startBufferingMoves();
+        }
+        const double extrusion_mm3_per_mm = 0.4 * 0.1; // line width times layer height
+        for (unsigned int path_idx = 0; path_idx < paths->size(); path_idx++)
+        {
+            const PolygonRef path = (*paths)[path_idx];
+            gcode.writeMove(Point3(path[0].X, path[0].Y, z), 150, 0.0);
+            for (unsigned int point_idx = 1; point_idx < path.size(); point_idx++)
+            {
+                gcode.writeMove(Point3(path[point_idx].X, path[point_idx].Y, z), 50, extrusion_mm3_per_mm);
+            }
+        }
+        gcode.writeBufferedMoves();
+        return static_cast<uint64_t>(output.tellp());
+    };
+}
+
+static BenchmarkRegistration write_move_benchmark("GCodeExport::writeMove", [](const BenchmarkWorkload& workload) -> BenchmarkKernel
+    {
+        return writeMoveKernel(workload, EGCodeFlavor::REPRAP);
+    });
+
+static BenchmarkRegistration write_move_ultigcode_benchmark("GCodeExport::writeMove(UltiGCode)", [](const BenchmarkWorkload& workload) -> BenchmarkKernel
+    {
+        return writeMoveKernel(workload, EGCodeFlavor::ULTIGCODE);
+    });
+
+static BenchmarkRegistration write_move_buffered_benchmark("GCodeExport::writeMove(buffered)", [](const BenchmarkWorkload& workload) -> BenchmarkKernel
+    {
+        return writeMoveKernel(workload, EGCodeFlavor::REPRAP, true);
+    });
+
+}//namespace cura
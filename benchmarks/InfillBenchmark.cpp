@@ -0,0 +1,35 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "Benchmark.h"
+
+#include "../src/infill.h"
+
+namespace cura
+{
+
+/*!
+ * Prepare the infill of a workload with a fill pattern, with the same line distance for each pattern.
+ */
+static BenchmarkSetup infillSetup(EFillMethod pattern)
+{
+    return [pattern](const BenchmarkWorkload& workload) -> BenchmarkKernel
+    {
+        return [&workload, pattern]()
+        {
+            Infill infill(pattern, workload.outline, -MM2INT(0.8), MM2INT(0.4), MM2INT(2), 0, 45, workload.outline_z, 0);
+            Polygons polygons;
+            Polygons lines;
+            infill.generate(polygons, lines);
+            return countPoints(polygons) + countPoints(lines);
+        };
+    };
+}
+
+static BenchmarkRegistration lines_benchmark("Infill::generate(lines)", infillSetup(EFillMethod::LINES));
+static BenchmarkRegistration grid_benchmark("Infill::generate(grid)", infillSetup(EFillMethod::GRID));
+static BenchmarkRegistration cubic_benchmark("Infill::generate(cubic)", infillSetup(EFillMethod::CUBIC));
+static BenchmarkRegistration tetrahedral_benchmark("Infill::generate(tetrahedral)", infillSetup(EFillMethod::TETRAHEDRAL));
+static BenchmarkRegistration triangles_benchmark("Infill::generate(triangles)", infillSetup(EFillMethod::TRIANGLES));
+static BenchmarkRegistration concentric_benchmark("Infill::generate(concentric)", infillSetup(EFillMethod::CONCENTRIC));
+static BenchmarkRegistration zig_zag_benchmark("Infill::generate(zigzag)", infillSetup(EFillMethod::ZIG_ZAG));
+
+}//namespace cura
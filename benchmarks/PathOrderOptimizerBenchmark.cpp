@@ -0,0 +1,45 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "Benchmark.h"
+
+#include <memory>
+
+#include "../src/infill.h"
+#include "../src/pathOrderOptimizer.h"
+
+namespace cura
+{
+
+static BenchmarkRegistration path_order_benchmark("PathOrderOptimizer::optimize", [](const BenchmarkWorkload& workload) -> BenchmarkKernel
+    {
+        // the insets of a layer with many walls
+        std::shared_ptr<Polygons> insets = std::make_shared<Polygons>();
+        for (int inset_idx = 0; inset_idx < 5; inset_idx++)
+        {
+            insets->add(workload.outline.offset(-MM2INT(0.2) - inset_idx * MM2INT(0.4)));
+        }
+        return [insets]()
+        {
+            PathOrderOptimizer optimizer(Point(0, 0));
+            optimizer.addPolygons(*insets);
+            optimizer.optimize();
+            return optimizer.polyOrder.size();
+        };
+    });
+
+static BenchmarkRegistration line_order_benchmark("LineOrderOptimizer::optimize", [](const BenchmarkWorkload& workload) -> BenchmarkKernel
+    {
+        // the lines of sparse infill
+        std::shared_ptr<Polygons> lines = std::make_shared<Polygons>();
+        Polygons polygons;
+        Infill infill(EFillMethod::LINES, workload.outline, -MM2INT(0.8), MM2INT(0.4), MM2INT(2), 0, 45, workload.outline_z, 0);
+        infill.generate(polygons, *lines);
+        return [lines]()
+        {
+            LineOrderOptimizer optimizer(Point(0, 0));
+            optimizer.addPolygons(*lines);
+            optimizer.optimize();
+            return optimizer.polyOrder.size();
+        };
+    });
+
+}//namespace cura
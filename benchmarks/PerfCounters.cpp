@@ -0,0 +1,178 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "PerfCounters.h"
+
+#ifdef __linux__
+#include <cstdint>
+#include <cstdlib> // atoi
+#include <cstring> // memset
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace cura
+{
+
+#ifdef __linux__
+namespace
+{
+
+/*!
+ * The thread ids of all threads of this process.
+ */
+std::vector<pid_t> getThreadIds()
+{
+    std::vector<pid_t> thread_ids;
+    DIR* tasks = opendir("/proc/self/task");
+    if (!tasks)
+    {
+        return thread_ids;
+    }
+    while (dirent* task = readdir(tasks))
+    {
+        const pid_t thread_id = atoi(task->d_name);
+        if (thread_id > 0)
+        {
+            thread_ids.push_back(thread_id);
+        }
+    }
+    closedir(tasks);
+    return thread_ids;
+}
+
+int openCounter(uint32_t type, uint64_t config, pid_t thread_id)
+{
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(__NR_perf_event_open, &attr, thread_id, -1, -1, 0);
+}
+
+constexpr uint64_t cacheReadMisses(uint64_t cache)
+{
+    return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+}
+
+PerfCounters::PerfCounters()
+{
+    struct CounterType
+    {
+        const char* name;
+        uint32_t type;
+        uint64_t config;
+    };
+    const CounterType counter_types[] = {
+        { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { "l1d_misses", PERF_TYPE_HW_CACHE, cacheReadMisses(PERF_COUNT_HW_CACHE_L1D) },
+        { "llc_misses", PERF_TYPE_HW_CACHE, cacheReadMisses(PERF_COUNT_HW_CACHE_LL) },
+        { "dtlb_misses", PERF_TYPE_HW_CACHE, cacheReadMisses(PERF_COUNT_HW_CACHE_DTLB) },
+        { "branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    };
+    const std::vector<pid_t> thread_ids = getThreadIds();
+    for (const CounterType& counter_type : counter_types)
+    {
+        Counter counter;
+        counter.name = counter_type.name;
+        for (pid_t thread_id : thread_ids)
+        {
+            const int file_descriptor = openCounter(counter_type.type, counter_type.config, thread_id);
+            if (file_descriptor < 0)
+            { // a counter is only useful if it counts all threads
+                break;
+            }
+            counter.file_descriptors.push_back(file_descriptor);
+        }
+        if (counter.file_descriptors.size() < thread_ids.size() || thread_ids.empty())
+        {
+            for (int file_descriptor : counter.file_descriptors)
+            {
+                close(file_descriptor);
+            }
+            continue;
+        }
+        counters.push_back(counter);
+    }
+}
+
+PerfCounters::~PerfCounters()
+{
+    for (const Counter& counter : counters)
+    {
+        for (int file_descriptor : counter.file_descriptors)
+        {
+            close(file_descriptor);
+        }
+    }
+}
+
+void PerfCounters::start()
+{
+    for (const Counter& counter : counters)
+    {
+        for (int file_descriptor : counter.file_descriptors)
+        {
+            ioctl(file_descriptor, PERF_EVENT_IOC_RESET, 0);
+            ioctl(file_descriptor, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+std::vector<PerfCounters::Count> PerfCounters::stop()
+{
+    for (const Counter& counter : counters)
+    {
+        for (int file_descriptor : counter.file_descriptors)
+        {
+            ioctl(file_descriptor, PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+    std::vector<Count> counts;
+    for (const Counter& counter : counters)
+    {
+        double total = 0.0;
+        for (int file_descriptor : counter.file_descriptors)
+        {
+            uint64_t values[3]; // the count, the time enabled and the time running
+            if (read(file_descriptor, values, sizeof(values)) == sizeof(values) && values[2] > 0)
+            { // scaled up to the whole time if the counter had to share the hardware
+                total += static_cast<double>(values[0]) * values[1] / values[2];
+            }
+        }
+        counts.push_back(Count{counter.name, total});
+    }
+    return counts;
+}
+
+#else
+
+PerfCounters::PerfCounters()
+{
+}
+
+PerfCounters::~PerfCounters()
+{
+}
+
+void PerfCounters::start()
+{
+}
+
+std::vector<PerfCounters::Count> PerfCounters::stop()
+{
+    return std::vector<Count>();
+}
+
+#endif
+
+}//namespace cura
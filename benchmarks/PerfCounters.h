@@ -0,0 +1,73 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef BENCHMARKS_PERF_COUNTERS_H
+#define BENCHMARKS_PERF_COUNTERS_H
+
+#include <string>
+#include <vector>
+
+#include "../src/utils/NoCopy.h"
+
+namespace cura
+{
+
+/*!
+ * The hardware performance counters of all threads of the benchmark process, read with perf_event_open on Linux.
+ *
+ * Counts the processor cycles, instructions, L1 data cache read misses, last level cache read misses, data TLB read misses and branch misses in user space.
+ * Counters which the processor or the kernel doesn't provide are left out, and on other systems there are none at all.
+ * When more counters are opened than the processor has, the kernel takes turns and the counts are scaled up to the whole time.
+ */
+class PerfCounters : NoCopy
+{
+public:
+    /*!
+     * The count of a single counter over a measurement.
+     */
+    struct Count
+    {
+        std::string name; //!< The name of the counter, e.g. cycles
+        double value; //!< The number of events counted
+    };
+
+    /*!
+     * Open the counters for all threads the process has, so it should be constructed after the thread pool has been started.
+     */
+    PerfCounters();
+
+    ~PerfCounters();
+
+    /*!
+     * Whether any counter could be opened.
+     */
+    bool isAvailable() const
+    {
+        return !counters.empty();
+    }
+
+    /*!
+     * Reset the counters and start counting.
+     */
+    void start();
+
+    /*!
+     * Stop counting.
+     *
+     * \return The counts since start of each counter, summed over all threads
+     */
+    std::vector<Count> stop();
+
+private:
+    /*!
+     * A counter, opened once for every thread.
+     */
+    struct Counter
+    {
+        std::string name; //!< The name of the counter, e.g. cycles
+        std::vector<int> file_descriptors; //!< For each thread the file descriptor of its counter
+    };
+
+    std::vector<Counter> counters; //!< The counters which could be opened
+};
+
+}//namespace cura
+#endif//BENCHMARKS_PERF_COUNTERS_H
@@ -0,0 +1,67 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "Benchmark.h"
+
+#include <memory>
+
+namespace cura
+{
+
+static BenchmarkRegistration offset_benchmark("Polygons::offset", [](const BenchmarkWorkload& workload) -> BenchmarkKernel
+    {
+        return [&workload]()
+        {
+            return countPoints(workload.outline.offset(-MM2INT(0.4)));
+        };
+    });
+
+static BenchmarkRegistration offset_round_benchmark("Polygons::offset(jtRound)", [](const BenchmarkWorkload& workload) -> BenchmarkKernel
+    {
+        return [&workload]()
+        {
+            return countPoints(workload.outline.offset(MM2INT(1), ClipperLib::jtRound));
+        };
+    });
+
+static BenchmarkRegistration difference_benchmark("Polygons::difference", [](const BenchmarkWorkload& workload) -> BenchmarkKernel
+    {
+        // the area of the outer wall, as when generating insets
+        std::shared_ptr<Polygons> inner = std::make_shared<Polygons>(workload.outline.offset(-MM2INT(0.4)));
+        return [&workload, inner]()
+        {
+            return countPoints(workload.outline.difference(*inner));
+        };
+    });
+
+#ifndef ASSERT_CLIPPER_LOW_RANGE
+/*!
+ * The same outline moved just beyond clipper_low_range, so that Clipper computes with 128 bit integers.
+ * Compared to the benchmarks of the outline itself, these show what keeping coordinates in the low range saves.
+ */
+static std::shared_ptr<Polygons> moveToFullRange(const Polygons& polygons)
+{
+    std::shared_ptr<Polygons> moved = std::make_shared<Polygons>(polygons);
+    moved->translate(Point(clipper_low_range, 0));
+    return moved;
+}
+
+static BenchmarkRegistration offset_full_range_benchmark("Polygons::offset(full range)", [](const BenchmarkWorkload& workload) -> BenchmarkKernel
+    {
+        std::shared_ptr<Polygons> outline = moveToFullRange(workload.outline);
+        return [outline]()
+        {
+            return countPoints(outline->offset(-MM2INT(0.4)));
+        };
+    });
+
+static BenchmarkRegistration difference_full_range_benchmark("Polygons::difference(full range)", [](const BenchmarkWorkload& workload) -> BenchmarkKernel
+    {
+        std::shared_ptr<Polygons> outline = moveToFullRange(workload.outline);
+        std::shared_ptr<Polygons> inner = moveToFullRange(workload.outline.offset(-MM2INT(0.4)));
+        return [outline, inner]()
+        {
+            return countPoints(outline->difference(*inner));
+        };
+    });
+#endif // ASSERT_CLIPPER_LOW_RANGE
+
+}//namespace cura
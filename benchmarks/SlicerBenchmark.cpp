@@ -0,0 +1,27 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "Benchmark.h"
+
+#include "../src/slicer.h"
+
+namespace cura
+{
+
+static BenchmarkRegistration slicer_benchmark("Slicer", [](const BenchmarkWorkload& workload) -> BenchmarkKernel
+    {
+        if (workload.mesh.faces.empty())
+        { // a workload of only a layer
+            return BenchmarkKernel();
+        }
+        return [&workload]()
+        {
+            Slicer slicer(&workload.mesh, workload.layer_thickness / 2, workload.layer_thickness, workload.layer_count, false, false);
+            uint64_t polygon_count = 0;
+            for (const SlicerLayer& layer : slicer.layers)
+            {
+                polygon_count += layer.polygons.size();
+            }
+            return polygon_count;
+        };
+    });
+
+}//namespace cura
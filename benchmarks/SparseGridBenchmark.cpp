@@ -0,0 +1,66 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "Benchmark.h"
+
+#include <memory>
+
+#include "../src/utils/polygonUtils.h"
+
+namespace cura
+{
+
+static constexpr int grid_cell_size = MM2INT(2); //!< About the cell size used for combing and for moving points inside
+
+static BenchmarkRegistration grid_construction_benchmark("PolygonUtils::createLocToLineGrid", [](const BenchmarkWorkload& workload) -> BenchmarkKernel
+    {
+        return [&workload]()
+        {
+            std::unique_ptr<SparseGrid<PolygonsPointIndex>> grid(PolygonUtils::createLocToLineGrid(workload.outline, grid_cell_size));
+            return workload.outline.size();
+        };
+    });
+
+/*!
+ * Points near the outline of a workload, at which to query a grid of the outline.
+ */
+static std::shared_ptr<Polygons> getQueryPoints(const BenchmarkWorkload& workload)
+{
+    return std::make_shared<Polygons>(workload.outline.offset(-MM2INT(0.5)));
+}
+
+static BenchmarkRegistration get_nearby_benchmark("SparseGrid::getNearby", [](const BenchmarkWorkload& workload) -> BenchmarkKernel
+    {
+        std::shared_ptr<SparseGrid<PolygonsPointIndex>> grid(PolygonUtils::createLocToLineGrid(workload.outline, grid_cell_size));
+        std::shared_ptr<Polygons> query_points = getQueryPoints(workload);
+        return [grid, query_points]()
+        {
+            uint64_t nearby_count = 0;
+            for (unsigned int poly_idx = 0; poly_idx < query_points->size(); poly_idx++)
+            {
+                for (const Point& query_point : (*query_points)[poly_idx])
+                {
+                    nearby_count += grid->getNearbyVals(query_point, grid_cell_size).size();
+                }
+            }
+            return nearby_count;
+        };
+    });
+
+static BenchmarkRegistration find_close_benchmark("PolygonUtils::findClose", [](const BenchmarkWorkload& workload) -> BenchmarkKernel
+    {
+        std::shared_ptr<SparseGrid<PolygonsPointIndex>> grid(PolygonUtils::createLocToLineGrid(workload.outline, grid_cell_size));
+        std::shared_ptr<Polygons> query_points = getQueryPoints(workload);
+        return [&workload, grid, query_points]()
+        {
+            uint64_t found_count = 0;
+            for (unsigned int poly_idx = 0; poly_idx < query_points->size(); poly_idx++)
+            {
+                for (const Point& query_point : (*query_points)[poly_idx])
+                {
+                    found_count += PolygonUtils::findClose(query_point, workload.outline, *grid) ? 1 : 0;
+                }
+            }
+            return found_count;
+        };
+    });
+
+}//namespace cura
@@ -0,0 +1,290 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "SyntheticMeshes.h"
+
+#include <algorithm> // max
+#include <cmath>
+#include <cstring> // memcpy
+#include <fstream>
+#include <vector>
+
+namespace cura
+{
+
+namespace
+{
+
+/*!
+ * Add the two triangles of a quadrilateral of which the corners are given counter-clockwise as seen from outside the mesh.
+ */
+void addQuad(std::vector<Point3>& triangles, Point3 a, Point3 b, Point3 c, Point3 d)
+{
+    triangles.insert(triangles.end(), { a, b, c });
+    triangles.insert(triangles.end(), { a, c, d });
+}
+
+/*!
+ * Add the faces of an upright frustum with a square cross section, which is a box if the bottom and the top are equally wide.
+ */
+void addSquareFrustum(std::vector<Point3>& triangles, Point3 bottom_center, int height, int bottom_half_width, int top_half_width)
+{
+    const Point3 corners[4] = { Point3(-1, -1, 0), Point3(1, -1, 0), Point3(1, 1, 0), Point3(-1, 1, 0) }; // counter-clockwise as seen from above
+    Point3 bottom[4];
+    Point3 top[4];
+    for (unsigned int corner_idx = 0; corner_idx < 4; corner_idx++)
+    {
+        bottom[corner_idx] = bottom_center + corners[corner_idx] * bottom_half_width;
+        top[corner_idx] = bottom_center + Point3(0, 0, height) + corners[corner_idx] * top_half_width;
+    }
+    addQuad(triangles, bottom[0], bottom[3], bottom[2], bottom[1]);
+    addQuad(triangles, top[0], top[1], top[2], top[3]);
+    for (unsigned int corner_idx = 0; corner_idx < 4; corner_idx++)
+    {
+        const unsigned int next_idx = (corner_idx + 1) % 4;
+        addQuad(triangles, bottom[corner_idx], bottom[next_idx], top[next_idx], top[corner_idx]);
+    }
+}
+
+}
+
+Mesh SyntheticMeshes::sphere(SettingsBaseVirtual* settings, int radius, unsigned int segment_count)
+{
+    const unsigned int ring_count = segment_count / 2;
+    auto vertex = [&](unsigned int ring_idx, unsigned int segment_idx)
+    {
+        const double polar = M_PI * ring_idx / ring_count;
+        const double azimuth = 2 * M_PI * segment_idx / segment_count;
+        return Point3(radius * std::sin(polar) * std::cos(azimuth), radius * std::sin(polar) * std::sin(azimuth), radius - radius * std::cos(polar));
+    };
+    std::vector<Point3> triangles;
+    for (unsigned int ring_idx = 0; ring_idx < ring_count; ring_idx++)
+    {
+        for (unsigned int segment_idx = 0; segment_idx < segment_count; segment_idx++)
+        {
+            const Point3 p00 = vertex(ring_idx, segment_idx);
+            const Point3 p01 = vertex(ring_idx, segment_idx + 1);
+            const Point3 p10 = vertex(ring_idx + 1, segment_idx);
+            const Point3 p11 = vertex(ring_idx + 1, segment_idx + 1);
+            if (ring_idx > 0)
+            { // the top ring is a fan of triangles
+                triangles.insert(triangles.end(), { p00, p10, p01 });
+            }
+            if (ring_idx + 1 < ring_count)
+            { // and so is the bottom ring
+                triangles.insert(triangles.end(), { p01, p10, p11 });
+            }
+        }
+    }
+    Mesh mesh(settings);
+    mesh.addFaces(triangles);
+    mesh.finish();
+    return mesh;
+}
+
+Mesh SyntheticMeshes::starPillars(SettingsBaseVirtual* settings, unsigned int pillars_per_side, int height)
+{
+    constexpr unsigned int point_count = 24; // twelve points of the star
+    constexpr int outer_radius = MM2INT(4);
+    constexpr int inner_radius = MM2INT(2);
+    constexpr int spacing = MM2INT(10);
+    std::vector<Point3> triangles;
+    for (unsigned int row_idx = 0; row_idx < pillars_per_side; row_idx++)
+    {
+        for (unsigned int column_idx = 0; column_idx < pillars_per_side; column_idx++)
+        {
+            const Point3 bottom_center(column_idx * spacing, row_idx * spacing, 0);
+            const Point3 top_center = bottom_center + Point3(0, 0, height);
+            auto bottomVertex = [&](unsigned int point_idx)
+            {
+                const int radius = (point_idx % 2 == 0) ? outer_radius : inner_radius;
+                const double angle = 2 * M_PI * point_idx / point_count;
+                return bottom_center + Point3(radius * std::cos(angle), radius * std::sin(angle), 0);
+            };
+            for (unsigned int point_idx = 0; point_idx < point_count; point_idx++)
+            {
+                const Point3 bottom_a = bottomVertex(point_idx);
+                const Point3 bottom_b = bottomVertex(point_idx + 1);
+                const Point3 top_a = bottom_a + Point3(0, 0, height);
+                const Point3 top_b = bottom_b + Point3(0, 0, height);
+                // the star is fanned from its center, which it contains entirely
+                triangles.insert(triangles.end(), { bottom_center, bottom_b, bottom_a });
+                triangles.insert(triangles.end(), { top_center, top_a, top_b });
+                triangles.insert(triangles.end(), { bottom_a, bottom_b, top_b });
+                triangles.insert(triangles.end(), { bottom_a, top_b, top_a });
+            }
+        }
+    }
+    Mesh mesh(settings);
+    mesh.addFaces(triangles);
+    mesh.finish();
+    return mesh;
+}
+
+Mesh SyntheticMeshes::islandArray(SettingsBaseVirtual* settings, unsigned int columns, unsigned int rows, int height)
+{
+    constexpr int half_width = MM2INT(1);
+    constexpr int spacing = MM2INT(4);
+    std::vector<Point3> triangles;
+    for (unsigned int row_idx = 0; row_idx < rows; row_idx++)
+    {
+        for (unsigned int column_idx = 0; column_idx < columns; column_idx++)
+        {
+            addSquareFrustum(triangles, Point3(column_idx * spacing, row_idx * spacing, 0), height, half_width, half_width);
+        }
+    }
+    Mesh mesh(settings);
+    mesh.addFaces(triangles);
+    mesh.finish();
+    return mesh;
+}
+
+Mesh SyntheticMeshes::sineWall(SettingsBaseVirtual* settings, unsigned int vertex_count, unsigned int wave_count, int height)
+{
+    constexpr int radius = MM2INT(20);
+    constexpr int amplitude = MM2INT(1);
+    const Point3 bottom_center(0, 0, 0);
+    const Point3 top_center(0, 0, height);
+    auto bottomVertex = [&](unsigned int point_idx)
+    {
+        const double angle = 2 * M_PI * point_idx / vertex_count;
+        const double point_radius = radius + amplitude * std::sin(wave_count * angle);
+        return Point3(point_radius * std::cos(angle), point_radius * std::sin(angle), 0);
+    };
+    std::vector<Point3> triangles;
+    for (unsigned int point_idx = 0; point_idx < vertex_count; point_idx++)
+    {
+        const Point3 bottom_a = bottomVertex(point_idx);
+        const Point3 bottom_b = bottomVertex(point_idx + 1);
+        const Point3 top_a = bottom_a + top_center;
+        const Point3 top_b = bottom_b + top_center;
+        // the outline never comes near the center, so it's fanned from there
+        triangles.insert(triangles.end(), { bottom_center, bottom_b, bottom_a });
+        triangles.insert(triangles.end(), { top_center, top_a, top_b });
+        addQuad(triangles, bottom_a, bottom_b, top_b, top_a);
+    }
+    Mesh mesh(settings);
+    mesh.addFaces(triangles);
+    mesh.finish();
+    return mesh;
+}
+
+Mesh SyntheticMeshes::lattice(SettingsBaseVirtual* settings, unsigned int cells_per_side, int cell_size, int strut_width)
+{
+    // the lattice is built from cubic voxels as wide as the struts, of which only the faces between a solid and an empty voxel are added
+    const int period = std::max(1, cell_size / strut_width); // the number of voxels from one strut to the next
+    const int voxels_per_side = cells_per_side * period + 1;
+    auto isSolid = [&](int x, int y, int z)
+    {
+        if (x < 0 || y < 0 || z < 0 || x >= voxels_per_side || y >= voxels_per_side || z >= voxels_per_side)
+        {
+            return false;
+        }
+        // a voxel is part of a strut along one axis if it lies on the struts' grid along both other axes
+        return (x % period == 0) + (y % period == 0) + (z % period == 0) >= 2;
+    };
+    std::vector<Point3> triangles;
+    for (int z = 0; z < voxels_per_side; z++)
+    {
+        for (int y = 0; y < voxels_per_side; y++)
+        {
+            for (int x = 0; x < voxels_per_side; x++)
+            {
+                if (!isSolid(x, y, z))
+                {
+                    continue;
+                }
+                auto corner = [&](int dx, int dy, int dz)
+                {
+                    return Point3((x + dx) * strut_width, (y + dy) * strut_width, (z + dz) * strut_width);
+                };
+                if (!isSolid(x, y, z - 1))
+                {
+                    addQuad(triangles, corner(0, 0, 0), corner(0, 1, 0), corner(1, 1, 0), corner(1, 0, 0));
+                }
+                if (!isSolid(x, y, z + 1))
+                {
+                    addQuad(triangles, corner(0, 0, 1), corner(1, 0, 1), corner(1, 1, 1), corner(0, 1, 1));
+                }
+                if (!isSolid(x, y - 1, z))
+                {
+                    addQuad(triangles, corner(0, 0, 0), corner(1, 0, 0), corner(1, 0, 1), corner(0, 0, 1));
+                }
+                if (!isSolid(x + 1, y, z))
+                {
+                    addQuad(triangles, corner(1, 0, 0), corner(1, 1, 0), corner(1, 1, 1), corner(1, 0, 1));
+                }
+                if (!isSolid(x, y + 1, z))
+                {
+                    addQuad(triangles, corner(1, 1, 0), corner(0, 1, 0), corner(0, 1, 1), corner(1, 1, 1));
+                }
+                if (!isSolid(x - 1, y, z))
+                {
+                    addQuad(triangles, corner(0, 1, 0), corner(0, 0, 0), corner(0, 0, 1), corner(0, 1, 1));
+                }
+            }
+        }
+    }
+    Mesh mesh(settings);
+    mesh.addFaces(triangles);
+    mesh.finish();
+    return mesh;
+}
+
+Mesh SyntheticMeshes::tallPrism(SettingsBaseVirtual* settings, int width, int height)
+{
+    std::vector<Point3> triangles;
+    addSquareFrustum(triangles, Point3(0, 0, 0), height, width / 2, width / 2);
+    Mesh mesh(settings);
+    mesh.addFaces(triangles);
+    mesh.finish();
+    return mesh;
+}
+
+Mesh SyntheticMeshes::overhangs(SettingsBaseVirtual* settings, unsigned int mushrooms_per_side, int height)
+{
+    constexpr int stem_half_width = MM2INT(1);
+    const int stem_height = height / 2;
+    const int cap_height = height - stem_height;
+    const int cap_half_width = stem_half_width + cap_height * std::tan(M_PI / 3); // the sides of the cap overhang by 60 degrees
+    const int spacing = 2 * cap_half_width + MM2INT(2);
+    std::vector<Point3> triangles;
+    for (unsigned int row_idx = 0; row_idx < mushrooms_per_side; row_idx++)
+    {
+        for (unsigned int column_idx = 0; column_idx < mushrooms_per_side; column_idx++)
+        {
+            const Point3 center(column_idx * spacing, row_idx * spacing, 0);
+            // the stem and the cap are closed separately; the face where they touch is never sliced
+            addSquareFrustum(triangles, center, stem_height, stem_half_width, stem_half_width);
+            addSquareFrustum(triangles, center + Point3(0, 0, stem_height), cap_height, stem_half_width, cap_half_width);
+        }
+    }
+    Mesh mesh(settings);
+    mesh.addFaces(triangles);
+    mesh.finish();
+    return mesh;
+}
+
+bool SyntheticMeshes::writeSTL(const Mesh& mesh, const std::string& filename)
+{
+    std::ofstream out(filename, std::ios::binary);
+    char header[80] = "CuraEngine synthetic mesh";
+    out.write(header, sizeof(header));
+    const uint32_t face_count = mesh.faces.size();
+    out.write(reinterpret_cast<const char*>(&face_count), sizeof(face_count));
+    for (const MeshFace& face : mesh.faces)
+    {
+        float values[12] = { 0, 0, 0 }; // the normal is left to the reader
+        for (unsigned int corner_idx = 0; corner_idx < 3; corner_idx++)
+        {
+            const Point3& p = mesh.vertices[face.vertex_index[corner_idx]].p;
+            values[3 + corner_idx * 3] = INT2MM(p.x);
+            values[4 + corner_idx * 3] = INT2MM(p.y);
+            values[5 + corner_idx * 3] = INT2MM(p.z);
+        }
+        char record[50] = {}; // the last two bytes are the unused attribute byte count
+        std::memcpy(record, values, sizeof(values));
+        out.write(record, sizeof(record));
+    }
+    return static_cast<bool>(out);
+}
+
+}//namespace cura
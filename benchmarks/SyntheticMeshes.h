@@ -0,0 +1,93 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef BENCHMARKS_SYNTHETIC_MESHES_H
+#define BENCHMARKS_SYNTHETIC_MESHES_H
+
+#include <string>
+
+#include "../src/mesh.h"
+
+namespace cura
+{
+
+/*!
+ * Generated meshes, so that the benchmarks can be run without any model files.
+ */
+class SyntheticMeshes
+{
+public:
+    /*!
+     * A finely tesselated sphere, with many faces per layer and a single smooth outline.
+     *
+     * \param settings The parent settings of the mesh
+     * \param radius The radius of the sphere
+     * \param segment_count The number of faces around the equator
+     */
+    static Mesh sphere(SettingsBaseVirtual* settings, int radius, unsigned int segment_count);
+
+    /*!
+     * A grid of pillars with a star shaped cross section, giving many concave parts per layer.
+     *
+     * \param settings The parent settings of the mesh
+     * \param pillars_per_side The number of pillars along each side of the grid
+     * \param height The height of the pillars
+     */
+    static Mesh starPillars(SettingsBaseVirtual* settings, unsigned int pillars_per_side, int height);
+
+    /*!
+     * A grid of small square islands, giving as many separate parts per layer as there are islands.
+     *
+     * \param settings The parent settings of the mesh
+     * \param columns The number of islands along the X axis
+     * \param rows The number of islands along the Y axis
+     * \param height The height of the islands
+     */
+    static Mesh islandArray(SettingsBaseVirtual* settings, unsigned int columns, unsigned int rows, int height);
+
+    /*!
+     * A prism of which the outline is a circle with a high frequency sine wave on it, giving a single outline with many vertices.
+     *
+     * \param settings The parent settings of the mesh
+     * \param vertex_count The number of vertices of the outline of each layer
+     * \param wave_count The number of periods of the sine wave around the circle
+     * \param height The height of the prism
+     */
+    static Mesh sineWall(SettingsBaseVirtual* settings, unsigned int vertex_count, unsigned int wave_count, int height);
+
+    /*!
+     * A cubic lattice of square struts, giving layers with a grid of many small parts alternated with layers with a grid of many holes.
+     *
+     * \param settings The parent settings of the mesh
+     * \param cells_per_side The number of cells of the lattice along each axis
+     * \param cell_size The distance between the struts
+     * \param strut_width The width of the struts, which should divide the cell size
+     */
+    static Mesh lattice(SettingsBaseVirtual* settings, unsigned int cells_per_side, int cell_size, int strut_width);
+
+    /*!
+     * A square prism, giving many simple layers.
+     *
+     * \param settings The parent settings of the mesh
+     * \param width The width of the prism
+     * \param height The height of the prism
+     */
+    static Mesh tallPrism(SettingsBaseVirtual* settings, int width, int height);
+
+    /*!
+     * A grid of mushrooms: thin stems carrying caps of which the sides overhang by 60 degrees, which need a lot of support.
+     *
+     * \param settings The parent settings of the mesh
+     * \param mushrooms_per_side The number of mushrooms along each side of the grid
+     * \param height The height of the mushrooms
+     */
+    static Mesh overhangs(SettingsBaseVirtual* settings, unsigned int mushrooms_per_side, int height);
+
+    /*!
+     * Write a mesh to a binary STL file, so that it can be sliced by the engine itself.
+     *
+     * \return Whether the file could be written
+     */
+    static bool writeSTL(const Mesh& mesh, const std::string& filename);
+};
+
+}//namespace cura
+#endif//BENCHMARKS_SYNTHETIC_MESHES_H
@@ -0,0 +1,366 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+
+#include "Benchmark.h"
+#include "PerfCounters.h"
+#include "SyntheticMeshes.h"
+#include "../src/MeshGroup.h"
+#include "../src/progress/SlowLayerCapture.h"
+#include "../src/utils/allocatorTuning.h"
+#include "../src/utils/logoutput.h"
+#include "../src/utils/ThreadPool.h"
+
+namespace cura
+{
+
+/*!
+ * The measured time of a benchmark on a workload.
+ */
+struct BenchmarkResult
+{
+    std::string benchmark; //!< The name of the benchmark
+    std::string workload; //!< The name of the workload
+    uint64_t iterations; //!< The number of times the kernel was run in each repetition
+    std::vector<double> ns_per_iteration; //!< For each repetition the average time of a single run of the kernel
+    std::vector<PerfCounters::Count> counts_per_iteration; //!< The average hardware counts of a single run of the kernel over all repetitions, if counted
+};
+
+constexpr double cache_line_size = 64; //!< The bytes read from memory for each last level cache miss, to estimate the memory bandwidth
+
+volatile uint64_t benchmark_sink; //!< Where the results of the kernels go, so that they aren't optimized away
+
+/*!
+ * Run a kernel a number of times.
+ *
+ * \return The time it took in nanoseconds
+ */
+double timeKernel(const BenchmarkKernel& kernel, uint64_t iterations)
+{
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (uint64_t iteration = 0; iteration < iterations; iteration++)
+    {
+        benchmark_sink = benchmark_sink + kernel();
+    }
+    const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+/*!
+ * Measure the time of a kernel in \p repetition_count repetitions of together about \p min_time seconds.
+ *
+ * \param counters The hardware counters to count the repetitions with, or nullptr to only measure the time
+ */
+BenchmarkResult runKernel(const BenchmarkKernel& kernel, double min_time, unsigned int repetition_count, PerfCounters* counters)
+{
+    BenchmarkResult result;
+    const double repetition_time = min_time * 1e9 / repetition_count;
+    // Find the number of iterations for a single repetition, increasing it until the time measured is meaningful
+    result.iterations = 1;
+    while (true)
+    {
+        const double time = timeKernel(kernel, result.iterations);
+        if (time >= repetition_time || result.iterations >= 1000000000)
+        {
+            break;
+        }
+        const double estimate = repetition_time / std::max(time, 1.0) * result.iterations * 1.2;
+        result.iterations = std::max(result.iterations + 1, std::min(static_cast<uint64_t>(estimate), result.iterations * 100));
+    }
+    if (counters)
+    {
+        counters->start();
+    }
+    for (unsigned int repetition = 0; repetition < repetition_count; repetition++)
+    {
+        result.ns_per_iteration.push_back(timeKernel(kernel, result.iterations) / result.iterations);
+    }
+    if (counters)
+    {
+        result.counts_per_iteration = counters->stop();
+        for (PerfCounters::Count& count : result.counts_per_iteration)
+        {
+            count.value /= result.iterations * repetition_count;
+        }
+    }
+    return result;
+}
+
+double median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    const size_t middle = values.size() / 2;
+    return (values.size() % 2 == 1) ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+}
+
+double mean(const std::vector<double>& values)
+{
+    double total = 0;
+    for (double value : values)
+    {
+        total += value;
+    }
+    return total / values.size();
+}
+
+std::string jsonString(const std::string& value)
+{
+    std::string result = "\"";
+    for (char character : value)
+    {
+        if (character == '"' || character == '\\')
+        {
+            result += '\\';
+        }
+        result += character;
+    }
+    return result + "\"";
+}
+
+/*!
+ * Write the results in JSON, with the statistics of each benchmark on each workload.
+ */
+void writeJSON(std::ostream& out, const std::vector<BenchmarkResult>& results, unsigned int thread_count, double min_time, unsigned int repetition_count)
+{
+    out << std::fixed << std::setprecision(1);
+    out << "{\n";
+    out << "    \"context\": {\n";
+    out << "        \"version\": " << jsonString(VERSION) << ",\n";
+    out << "        \"allocator\": " << jsonString(getAllocatorName()) << ",\n";
+    out << "        \"threads\": " << thread_count << ",\n";
+    out << "        \"min_time\": " << std::setprecision(3) << min_time << std::setprecision(1) << ",\n";
+    out << "        \"repetitions\": " << repetition_count << "\n";
+    out << "    },\n";
+    out << "    \"benchmarks\": [";
+    for (size_t result_idx = 0; result_idx < results.size(); result_idx++)
+    {
+        const BenchmarkResult& result = results[result_idx];
+        const std::vector<double>& times = result.ns_per_iteration;
+        out << ((result_idx == 0) ? "\n" : ",\n");
+        out << "        {\n";
+        out << "            \"name\": " << jsonString(result.benchmark + "/" + result.workload) << ",\n";
+        out << "            \"benchmark\": " << jsonString(result.benchmark) << ",\n";
+        out << "            \"workload\": " << jsonString(result.workload) << ",\n";
+        out << "            \"iterations\": " << result.iterations << ",\n";
+        out << "            \"min_ns\": " << *std::min_element(times.begin(), times.end()) << ",\n";
+        out << "            \"median_ns\": " << median(times) << ",\n";
+        out << "            \"mean_ns\": " << mean(times) << ",\n";
+        out << "            \"max_ns\": " << *std::max_element(times.begin(), times.end());
+        if (!result.counts_per_iteration.empty())
+        {
+            out << ",\n";
+            out << "            \"counters\": {";
+            for (size_t count_idx = 0; count_idx < result.counts_per_iteration.size(); count_idx++)
+            {
+                const PerfCounters::Count& count = result.counts_per_iteration[count_idx];
+                out << ((count_idx == 0) ? "\n" : ",\n");
+                out << "                " << jsonString(count.name) << ": " << count.value;
+                if (count.name == "llc_misses")
+                {
+                    out << ",\n";
+                    out << "                \"memory_bandwidth_mb_s\": " << count.value * cache_line_size / mean(times) * 1e3;
+                }
+            }
+            out << "\n            }";
+        }
+        out << "\n";
+        out << "        }";
+    }
+    out << "\n    ]\n";
+    out << "}\n";
+}
+
+void printUsage()
+{
+    logError("usage: CuraEngineBenchmarks [options] [mesh.stl ...]\n");
+    logError("Runs the benchmarks on two synthetic meshes, on each given STL file and on each given layer.\n");
+    logError("  --json <file>\n\tWrite the results in JSON to a file, or to the standard output for -\n");
+    logError("  --filter <text>\n\tOnly run the benchmarks of which the name contains the text\n");
+    logError("  --min-time <seconds>\n\tThe time to measure each benchmark on each workload for, 1 by default\n");
+    logError("  --repetitions <count>\n\tIn how many repetitions to measure each benchmark, 5 by default\n");
+    logError("  --threads <count>\n\tThe number of threads of the parallel parts, 1 by default and 0 for the number of cores\n");
+    logError("  --counters\n\tAlso count the cycles, instructions, cache misses, TLB misses and branch misses of each benchmark \n\twith the hardware performance counters, on Linux when perf_event_open is permitted\n");
+    logError("  --scale <size>[,<size>...]\n\tAlso run the benchmarks on synthetic stress meshes of each size: arrays of islands, \n\tsine wave walls, lattices, tall prisms and overhangs, which grow linearly with the size\n");
+    logError("  --write-stl <directory>\n\tWrite the meshes of the workloads to STL files in the directory, to slice them with CuraEngine itself\n");
+    logError("  --layer <file.polygons>\n\tAlso run the benchmarks of the layer processing on a layer captured with CuraEngine slice --slow-layers\n");
+}
+
+}//namespace cura
+
+using namespace cura;
+
+int main(int argc, char** argv)
+{
+    std::string json_file;
+    std::string filter;
+    double min_time = 1.0;
+    unsigned int repetition_count = 5;
+    unsigned int thread_count = 1;
+    std::vector<std::string> mesh_files;
+    std::vector<std::string> layer_files;
+    std::vector<unsigned int> stress_sizes;
+    std::string stl_directory;
+    bool count = false;
+    for (int argn = 1; argn < argc; argn++)
+    {
+        const bool has_value = argn + 1 < argc;
+        if (strcmp(argv[argn], "--json") == 0 && has_value)
+        {
+            json_file = argv[++argn];
+        }
+        else if (strcmp(argv[argn], "--filter") == 0 && has_value)
+        {
+            filter = argv[++argn];
+        }
+        else if (strcmp(argv[argn], "--min-time") == 0 && has_value)
+        {
+            min_time = atof(argv[++argn]);
+        }
+        else if (strcmp(argv[argn], "--repetitions") == 0 && has_value)
+        {
+            repetition_count = std::max(1, atoi(argv[++argn]));
+        }
+        else if (strcmp(argv[argn], "--threads") == 0 && has_value)
+        {
+            thread_count = std::max(0, atoi(argv[++argn]));
+        }
+        else if (strcmp(argv[argn], "--counters") == 0)
+        {
+            count = true;
+        }
+        else if (strcmp(argv[argn], "--scale") == 0 && has_value)
+        {
+            for (const char* size = argv[++argn]; size; size = strchr(size, ','))
+            {
+                size += (*size == ',');
+                stress_sizes.push_back(std::max(1, atoi(size)));
+            }
+        }
+        else if (strcmp(argv[argn], "--write-stl") == 0 && has_value)
+        {
+            stl_directory = argv[++argn];
+        }
+        else if (strcmp(argv[argn], "--layer") == 0 && has_value)
+        {
+            layer_files.push_back(argv[++argn]);
+        }
+        else if (argv[argn][0] == '-')
+        {
+            printUsage();
+            return 1;
+        }
+        else
+        {
+            mesh_files.push_back(argv[argn]);
+        }
+    }
+    ThreadPool::getInstance()->setThreadCount(thread_count);
+    std::unique_ptr<PerfCounters> counters;
+    if (count)
+    { // after the threads have been started, so that they're counted too
+        counters.reset(new PerfCounters());
+        if (!counters->isAvailable())
+        {
+            logError("No hardware performance counters could be opened, so only the time is measured.\n");
+            counters.reset();
+        }
+    }
+
+    SettingsBase settings; // the few settings the benchmarked code reads from the mesh
+    settings.setSetting("machine_extruder_count", "1");
+    settings.setSetting("magic_mesh_surface_mode", "normal");
+    settings.setSetting("xy_offset", "0");
+
+    const int layer_thickness = MM2INT(0.1);
+    std::vector<std::unique_ptr<BenchmarkWorkload>> workloads;
+    workloads.emplace_back(new BenchmarkWorkload("sphere", SyntheticMeshes::sphere(&settings, MM2INT(20), 256), layer_thickness));
+    workloads.emplace_back(new BenchmarkWorkload("star_pillars", SyntheticMeshes::starPillars(&settings, 8, MM2INT(20)), layer_thickness));
+    for (unsigned int size : stress_sizes)
+    { // the number of vertices per layer or the number of layers is proportional to the size
+        const std::string suffix = "_" + std::to_string(size);
+        const unsigned int islands_per_side = std::lround(8 * std::sqrt(size));
+        workloads.emplace_back(new BenchmarkWorkload("islands" + suffix, SyntheticMeshes::islandArray(&settings, islands_per_side, islands_per_side, MM2INT(10)), layer_thickness));
+        workloads.emplace_back(new BenchmarkWorkload("sine_wall" + suffix, SyntheticMeshes::sineWall(&settings, 1024 * size, 128 * size, MM2INT(10)), layer_thickness));
+        workloads.emplace_back(new BenchmarkWorkload("lattice" + suffix, SyntheticMeshes::lattice(&settings, 2 * size, MM2INT(5), MM2INT(1)), layer_thickness));
+        workloads.emplace_back(new BenchmarkWorkload("tall_prism" + suffix, SyntheticMeshes::tallPrism(&settings, MM2INT(10), MM2INT(50) * size), layer_thickness));
+        const unsigned int mushrooms_per_side = std::lround(4 * std::sqrt(size));
+        workloads.emplace_back(new BenchmarkWorkload("overhangs" + suffix, SyntheticMeshes::overhangs(&settings, mushrooms_per_side, MM2INT(10)), layer_thickness));
+    }
+    for (const std::string& mesh_file : mesh_files)
+    {
+        MeshGroup meshgroup(&settings);
+        if (!loadMeshIntoMeshGroup(&meshgroup, mesh_file.c_str(), FMatrix3x3(), &settings))
+        {
+            logError("Failed to load mesh file %s\n", mesh_file.c_str());
+            return 1;
+        }
+        const size_t slash_pos = mesh_file.find_last_of("/\\");
+        const std::string name = (slash_pos == std::string::npos) ? mesh_file : mesh_file.substr(slash_pos + 1);
+        workloads.emplace_back(new BenchmarkWorkload(name, std::move(meshgroup.meshes.back()), layer_thickness));
+    }
+    for (const std::string& layer_file : layer_files)
+    {
+        Polygons outline;
+        int64_t outline_z;
+        if (!SlowLayerCapture::readPolygons(layer_file, outline, outline_z))
+        {
+            logError("Failed to load layer file %s\n", layer_file.c_str());
+            return 1;
+        }
+        const size_t slash_pos = layer_file.find_last_of("/\\");
+        const std::string name = (slash_pos == std::string::npos) ? layer_file : layer_file.substr(slash_pos + 1);
+        workloads.emplace_back(new BenchmarkWorkload(name, std::move(outline), outline_z, &settings));
+    }
+
+    if (!stl_directory.empty())
+    {
+        for (const std::unique_ptr<BenchmarkWorkload>& workload : workloads)
+        {
+            if (!workload->mesh.faces.empty() && !SyntheticMeshes::writeSTL(workload->mesh, stl_directory + "/" + workload->name + ".stl"))
+            {
+                logError("Failed to write %s to %s\n", workload->name.c_str(), stl_directory.c_str());
+                return 1;
+            }
+        }
+    }
+
+    std::vector<BenchmarkResult> results;
+    for (const BenchmarkRegistry::Entry& entry : BenchmarkRegistry::getInstance().getEntries())
+    {
+        if (entry.name.find(filter) == std::string::npos)
+        {
+            continue;
+        }
+        for (const std::unique_ptr<BenchmarkWorkload>& workload : workloads)
+        {
+            const BenchmarkKernel kernel = entry.setup(*workload);
+            if (!kernel)
+            {
+                continue;
+            }
+            results.push_back(runKernel(kernel, min_time, repetition_count, counters.get()));
+            results.back().benchmark = entry.name;
+            results.back().workload = workload->name;
+            std::fprintf(stderr, "%-40s %-16s %14.0f ns\n", entry.name.c_str(), workload->name.c_str(), median(results.back().ns_per_iteration));
+        }
+    }
+
+    if (json_file == "-")
+    {
+        writeJSON(std::cout, results, thread_count, min_time, repetition_count);
+    }
+    else if (!json_file.empty())
+    {
+        std::ofstream out(json_file);
+        writeJSON(out, results, thread_count, min_time, repetition_count);
+    }
+    return 0;
+}
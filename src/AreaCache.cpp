@@ -0,0 +1,362 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "AreaCache.h"
+
+#include <algorithm> // find
+#include <cstdio> // popen, rename, remove
+#include <cstdlib> // getenv, system
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+#include <unistd.h> // getpid
+#endif
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+#include "settings/settings.h" // VERSION
+#include "utils/logoutput.h"
+#include "utils/MappedFile.h"
+
+namespace cura
+{
+
+AreaCache AreaCache::instance;
+
+namespace
+{
+
+#ifdef HAVE_ZLIB
+const bool compress_snapshots = true;
+#else
+const bool compress_snapshots = false;
+#endif
+const int gzip_wrapper = 16; // added to the window bits to read and write a gzip header and trailer instead of a zlib wrapper
+
+void hashBytes(uint64_t& hash, const char* bytes, size_t size)
+{
+    for (size_t byte_idx = 0; byte_idx < size; byte_idx++)
+    { // FNV-1a
+        hash ^= static_cast<unsigned char>(bytes[byte_idx]);
+        hash *= 1099511628211ull;
+    }
+}
+
+void hashValue(uint64_t& hash, uint64_t value)
+{
+    for (unsigned int byte_idx = 0; byte_idx < sizeof(value); byte_idx++)
+    {
+        const char byte = (value >> (byte_idx * 8)) & 0xff;
+        hashBytes(hash, &byte, 1);
+    }
+}
+
+void hashString(uint64_t& hash, const std::string& value)
+{
+    hashValue(hash, value.size()); // so that the boundaries between the strings count
+    hashBytes(hash, value.data(), value.size());
+}
+
+std::string toHex(uint64_t value)
+{
+    std::ostringstream hex;
+    hex << std::hex << std::setfill('0') << std::setw(16) << value;
+    return hex.str();
+}
+
+std::string getTemporaryFilename(const std::string& filename)
+{
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+    return filename + "." + std::to_string(getpid()) + ".tmp"; // engines sharing the directory may fetch the same entry at the same time
+#else
+    return filename + ".tmp";
+#endif
+}
+
+}//namespace
+
+AreaCache::AreaCache()
+{
+    const char* directory = getenv("CURA_ENGINE_AREA_CACHE");
+    if (directory)
+    {
+        this->directory = directory;
+    }
+    const char* fetch_command = getenv("CURA_ENGINE_AREA_CACHE_FETCH");
+    if (fetch_command)
+    {
+        this->fetch_command = fetch_command;
+    }
+    const char* store_command = getenv("CURA_ENGINE_AREA_CACHE_STORE");
+    if (store_command)
+    {
+        this->store_command = store_command;
+    }
+}
+
+std::string AreaCache::getSettingKeysKey(const std::vector<uint64_t>& mesh_hashes)
+{
+    uint64_t hash = 14695981039346656037ull;
+    hashString(hash, VERSION); // another engine may read other settings and slice differently
+    for (uint64_t mesh_hash : mesh_hashes)
+    {
+        hashValue(hash, mesh_hash);
+    }
+    return toHex(hash) + ".keys";
+}
+
+std::string AreaCache::getSnapshotKey(const std::vector<uint64_t>& mesh_hashes, const std::vector<std::string>& setting_values)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (const std::string& value : setting_values)
+    {
+        hashString(hash, value);
+    }
+    const std::string settings_keys_key = getSettingKeysKey(mesh_hashes);
+    return settings_keys_key.substr(0, settings_keys_key.find('.')) + "-" + toHex(hash) + ".areas";
+}
+
+std::string AreaCache::getRemoteKey(const std::string& key, bool compressed)
+{
+    return compressed ? key + ".gz" : key;
+}
+
+std::string AreaCache::getCommand(const std::string& command, const std::string& key)
+{
+    std::string result = command;
+    const std::string placeholder = "{key}";
+    for (size_t pos = result.find(placeholder); pos != std::string::npos; pos = result.find(placeholder, pos + key.size()))
+    {
+        result.replace(pos, placeholder.size(), key);
+    }
+    return result;
+}
+
+bool AreaCache::getSettingKeys(const std::vector<uint64_t>& mesh_hashes, std::vector<std::string>& setting_keys) const
+{
+    const std::string key = getSettingKeysKey(mesh_hashes);
+    std::ifstream in(directory + "/" + key);
+    if (!in && (fetch_command.empty() || !fetch(key, false)))
+    {
+        return false;
+    }
+    if (!in)
+    {
+        in.clear();
+        in.open(directory + "/" + key);
+    }
+    setting_keys.clear();
+    std::string setting_key;
+    while (std::getline(in, setting_key))
+    {
+        if (!setting_key.empty())
+        {
+            setting_keys.push_back(setting_key);
+        }
+    }
+    return !setting_keys.empty();
+}
+
+std::vector<std::string> AreaCache::addSettingKeys(const std::vector<uint64_t>& mesh_hashes, const std::vector<std::string>& setting_keys) const
+{
+    std::vector<std::string> all_setting_keys;
+    getSettingKeys(mesh_hashes, all_setting_keys);
+    bool changed = false;
+    for (const std::string& setting_key : setting_keys)
+    {
+        if (std::find(all_setting_keys.begin(), all_setting_keys.end(), setting_key) == all_setting_keys.end())
+        {
+            all_setting_keys.push_back(setting_key);
+            changed = true;
+        }
+    }
+    if (!changed)
+    {
+        return all_setting_keys;
+    }
+
+    const std::string key = getSettingKeysKey(mesh_hashes);
+    const std::string filename = directory + "/" + key;
+    const std::string temporary_filename = getTemporaryFilename(filename);
+    {
+        std::ofstream out(temporary_filename);
+        for (const std::string& setting_key : all_setting_keys)
+        {
+            out << setting_key << "\n";
+        }
+        if (!out)
+        {
+            out.close();
+            std::remove(temporary_filename.c_str());
+            logWarning("Couldn't write to the area cache directory %s\n", directory.c_str());
+            return all_setting_keys;
+        }
+    }
+    if (std::rename(temporary_filename.c_str(), filename.c_str()) != 0)
+    {
+        std::remove(temporary_filename.c_str());
+        return all_setting_keys;
+    }
+    if (!store_command.empty())
+    {
+        send(key, false);
+    }
+    return all_setting_keys;
+}
+
+std::string AreaCache::getSnapshot(const std::vector<uint64_t>& mesh_hashes, const std::vector<std::string>& setting_values) const
+{
+    const std::string key = getSnapshotKey(mesh_hashes, setting_values);
+    const std::string filename = directory + "/" + key;
+    if (std::ifstream(filename))
+    {
+        return filename;
+    }
+    if (!fetch_command.empty() && fetch(key, compress_snapshots))
+    {
+        log("Fetched the areas of the mesh group from the remote cache.\n");
+        return filename;
+    }
+    return std::string();
+}
+
+std::string AreaCache::getSnapshotFilename(const std::vector<uint64_t>& mesh_hashes, const std::vector<std::string>& setting_values) const
+{
+    return directory + "/" + getSnapshotKey(mesh_hashes, setting_values);
+}
+
+void AreaCache::store(const std::vector<uint64_t>& mesh_hashes, const std::vector<std::string>& setting_values) const
+{
+    if (!store_command.empty())
+    {
+        send(getSnapshotKey(mesh_hashes, setting_values), compress_snapshots);
+    }
+}
+
+bool AreaCache::fetch(const std::string& key, bool compressed) const
+{
+    const std::string filename = directory + "/" + key;
+    const std::string temporary_filename = getTemporaryFilename(filename);
+    std::FILE* in = popen(getCommand(fetch_command, getRemoteKey(key, compressed)).c_str(), "r");
+    if (!in)
+    {
+        return false;
+    }
+    bool success = true;
+    size_t received_size = 0;
+    {
+        std::ofstream out(temporary_filename, std::ios::binary);
+        std::vector<char> input(1 << 16);
+        std::vector<char> output(1 << 16);
+#ifdef HAVE_ZLIB
+        z_stream stream;
+        stream.zalloc = Z_NULL;
+        stream.zfree = Z_NULL;
+        stream.opaque = Z_NULL;
+        stream.next_in = Z_NULL;
+        stream.avail_in = 0;
+        success = !compressed || inflateInit2(&stream, MAX_WBITS + gzip_wrapper) == Z_OK;
+        bool stream_end = !compressed;
+#endif
+        size_t size;
+        while (success && (size = std::fread(input.data(), 1, input.size(), in)) > 0)
+        { // the entry is decompressed while the rest of it is still being received
+            received_size += size;
+            if (!compressed)
+            {
+                out.write(input.data(), size);
+                continue;
+            }
+#ifdef HAVE_ZLIB
+            stream.next_in = reinterpret_cast<Bytef*>(input.data());
+            stream.avail_in = size;
+            while (success && stream.avail_in > 0 && !stream_end)
+            {
+                stream.next_out = reinterpret_cast<Bytef*>(output.data());
+                stream.avail_out = output.size();
+                const int result = inflate(&stream, Z_NO_FLUSH);
+                success = result == Z_OK || result == Z_STREAM_END;
+                stream_end = result == Z_STREAM_END;
+                out.write(output.data(), output.size() - stream.avail_out);
+            }
+#endif
+        }
+#ifdef HAVE_ZLIB
+        if (compressed)
+        {
+            success = success && stream_end;
+            inflateEnd(&stream);
+        }
+#endif
+        success = success && out;
+    }
+    const bool command_succeeded = pclose(in) == 0;
+    if (!success || !command_succeeded || received_size == 0 || std::rename(temporary_filename.c_str(), filename.c_str()) != 0)
+    { // an entry which isn't in the remote store is usually reported as an empty output or a failing command
+        std::remove(temporary_filename.c_str());
+        return false;
+    }
+    return true;
+}
+
+void AreaCache::send(const std::string& key, bool compressed) const
+{
+    const std::string filename = directory + "/" + key;
+    std::string sent_filename = filename;
+#ifdef HAVE_ZLIB
+    if (compressed)
+    { // compressed into a file first, so that a store command which fails early doesn't break the pipe to the engine
+        MappedFile file(filename.c_str());
+        if (!file.isValid())
+        {
+            return;
+        }
+        sent_filename = getTemporaryFilename(filename + ".gz");
+        std::ofstream out(sent_filename, std::ios::binary);
+        z_stream stream;
+        stream.zalloc = Z_NULL;
+        stream.zfree = Z_NULL;
+        stream.opaque = Z_NULL;
+        if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, MAX_WBITS + gzip_wrapper, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            return;
+        }
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(file.getData()));
+        stream.avail_in = file.getSize();
+        std::vector<char> output(1 << 16);
+        int result;
+        do
+        {
+            stream.next_out = reinterpret_cast<Bytef*>(output.data());
+            stream.avail_out = output.size();
+            result = deflate(&stream, Z_FINISH);
+            out.write(output.data(), output.size() - stream.avail_out);
+        } while (result == Z_OK);
+        deflateEnd(&stream);
+        if (result != Z_STREAM_END || !out)
+        {
+            out.close();
+            std::remove(sent_filename.c_str());
+            return;
+        }
+    }
+#endif
+    const std::string command = getCommand(store_command, getRemoteKey(key, compressed)) + " < \"" + sent_filename + "\"";
+    if (std::system(command.c_str()) != 0)
+    {
+        logWarning("Couldn't store %s in the remote area cache.\n", key.c_str());
+    }
+    if (sent_filename != filename)
+    {
+        std::remove(sent_filename.c_str());
+    }
+}
+
+}//namespace cura
@@ -0,0 +1,143 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef AREA_CACHE_H
+#define AREA_CACHE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "utils/NoCopy.h"
+
+namespace cura
+{
+
+/*!
+ * A cache of the sliced areas of mesh groups in SliceDataSnapshot files, which can be shared by all engines of a slicing farm through a remote store.
+ *
+ * The snapshots are kept in the directory in the environment variable CURA_ENGINE_AREA_CACHE.
+ * A snapshot which isn't in that directory is fetched from the remote store with the command in CURA_ENGINE_AREA_CACHE_FETCH,
+ * and the snapshots of mesh groups which had to be sliced are stored remotely with the command in CURA_ENGINE_AREA_CACHE_STORE.
+ * In both commands {key} is replaced by the key of the entry; the fetch command writes the entry to its standard output
+ * and the store command reads it from its standard input, so that any store can be plugged in, e.g.
+ *     curl -sf http://cache/{key}                      curl -sf -T - http://cache/{key}
+ *     aws s3 cp s3://bucket/{key} -                    aws s3 cp - s3://bucket/{key}
+ *     redis-cli --raw GET {key}                        redis-cli -x SET {key}
+ * The snapshots are gzip compressed in the remote store when building with zlib; the local files are kept uncompressed, so that they can be memory-mapped.
+ *
+ * Which settings the areas depend on is only known once a mesh group has been sliced, so each meshes key has two kinds of entries:
+ * the settings read while slicing those meshes, and a snapshot for each combination of the values of those settings.
+ * The meshes key is a hash of the geometry of the meshes and the version of the engine.
+ * The snapshot itself is checked against its meshes and settings again, so a hash collision only costs a slice.
+ */
+class AreaCache : NoCopy
+{
+public:
+    static AreaCache* getInstance()
+    {
+        return &instance;
+    }
+
+    /*!
+     * Whether the cache has a directory to keep the snapshots in.
+     */
+    bool isEnabled() const
+    {
+        return !directory.empty();
+    }
+
+    /*!
+     * Get the settings read while the same meshes were sliced before, from the local directory or the remote store.
+     *
+     * \param mesh_hashes The Mesh::getGeometryHash of each mesh of the mesh group
+     * \param[out] setting_keys The settings on which the areas of these meshes depend
+     * \return Whether the meshes have been sliced before
+     */
+    bool getSettingKeys(const std::vector<uint64_t>& mesh_hashes, std::vector<std::string>& setting_keys) const;
+
+    /*!
+     * Add settings to those stored for some meshes, keeping the settings read while slicing them with other settings before.
+     *
+     * Settings are never removed, so that the snapshots stored before remain under the same key for as long as possible.
+     *
+     * \param mesh_hashes The Mesh::getGeometryHash of each mesh of the mesh group
+     * \param setting_keys The settings read while slicing the mesh group
+     * \return All settings stored for the meshes, under which the snapshot should be stored
+     */
+    std::vector<std::string> addSettingKeys(const std::vector<uint64_t>& mesh_hashes, const std::vector<std::string>& setting_keys) const;
+
+    /*!
+     * Get the local file with the snapshot of the meshes sliced with the given setting values, fetching it from the remote store if needed.
+     *
+     * \param mesh_hashes The Mesh::getGeometryHash of each mesh of the mesh group
+     * \param setting_values The values of the settings of AreaCache::getSettingKeys, see FffProcessor::getSettingValues
+     * \return The file name of the snapshot, or an empty string if it isn't cached
+     */
+    std::string getSnapshot(const std::vector<uint64_t>& mesh_hashes, const std::vector<std::string>& setting_values) const;
+
+    /*!
+     * Get the local file to which to write a new snapshot, to be stored with AreaCache::store.
+     *
+     * \param mesh_hashes The Mesh::getGeometryHash of each mesh of the mesh group
+     * \param setting_values The values of the settings of AreaCache::addSettingKeys
+     */
+    std::string getSnapshotFilename(const std::vector<uint64_t>& mesh_hashes, const std::vector<std::string>& setting_values) const;
+
+    /*!
+     * Store the settings and the snapshot written to AreaCache::getSnapshotFilename in the remote store.
+     *
+     * \param mesh_hashes The Mesh::getGeometryHash of each mesh of the mesh group
+     * \param setting_values The values of the settings of AreaCache::addSettingKeys
+     */
+    void store(const std::vector<uint64_t>& mesh_hashes, const std::vector<std::string>& setting_values) const;
+
+private:
+    static AreaCache instance;
+
+    std::string directory; //!< The directory in which the snapshots are kept, or empty if the cache is disabled
+    std::string fetch_command; //!< The command which writes an entry of the remote store to its standard output, or empty
+    std::string store_command; //!< The command which stores its standard input as an entry of the remote store, or empty
+
+    AreaCache();
+
+    /*!
+     * Get the key of the entry with the settings on which the areas of some meshes depend.
+     */
+    static std::string getSettingKeysKey(const std::vector<uint64_t>& mesh_hashes);
+
+    /*!
+     * Get the key of the entry with the snapshot of some meshes sliced with some setting values.
+     */
+    static std::string getSnapshotKey(const std::vector<uint64_t>& mesh_hashes, const std::vector<std::string>& setting_values);
+
+    /*!
+     * Get the key of an entry in the remote store, which is compressed where the local file isn't.
+     */
+    static std::string getRemoteKey(const std::string& key, bool compressed);
+
+    /*!
+     * Fetch an entry from the remote store into the local directory, decompressing it while it is received.
+     *
+     * The file is written under a temporary name first, so that no reader ever sees a half fetched file.
+     *
+     * \param key The key of the entry, which is also the name of the local file
+     * \param compressed Whether the entry is compressed in the remote store
+     * \return Whether the entry was fetched
+     */
+    bool fetch(const std::string& key, bool compressed) const;
+
+    /*!
+     * Send a file in the local directory to the remote store, compressing it while it is sent.
+     *
+     * \param key The key of the entry, which is also the name of the local file
+     * \param compressed Whether to compress the entry in the remote store
+     */
+    void send(const std::string& key, bool compressed) const;
+
+    /*!
+     * Get the command with the {key} in it replaced by the key of an entry.
+     */
+    static std::string getCommand(const std::string& command, const std::string& key);
+};
+
+}//namespace cura
+#endif//AREA_CACHE_H
@@ -0,0 +1,368 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "AreaEstimate.h"
+
+#include <algorithm> // max, min, fill
+
+#include "sliceDataStorage.h"
+#include "utils/ThreadPool.h"
+
+namespace cura
+{
+
+namespace
+{
+
+/*!
+ * The settings with which the lines of one feature are printed.
+ */
+struct FeatureSettings
+{
+    int extruder_nr;
+    double line_width; //!< The width of the lines in mm
+    double line_distance; //!< The distance in mm between the lines in each direction, or zero if the area is filled solid
+    unsigned int direction_count; //!< The number of directions in which lines are laid over the area
+    double flow; //!< The flow as a fraction
+    double speed; //!< The speed in mm/s above the initial layers
+    double speed_layer_0; //!< The speed in mm/s on the first layer, from which the speed increases over the initial layers
+};
+
+/*!
+ * The raw estimate of a single layer.
+ */
+struct LayerEstimate
+{
+    double print_time = 0.0;
+    double extruded_length = 0.0; //!< The length of all lines of the layer in mm
+    double material_volume[MAX_EXTRUDERS] = {};
+};
+
+/*!
+ * The number of directions in which an infill pattern lays lines, each of which is spaced the line distance apart.
+ */
+unsigned int getDirectionCount(EFillMethod pattern)
+{
+    switch (pattern)
+    {
+    case EFillMethod::GRID:
+        return 2;
+    case EFillMethod::CUBIC:
+    case EFillMethod::TRIANGLES:
+        return 3;
+    case EFillMethod::TETRAHEDRAL:
+        return 4;
+    case EFillMethod::NONE:
+        return 0;
+    default:
+        return 1;
+    }
+}
+
+/*!
+ * The net area of some polygons in mm^2: holes are oriented the other way around, so their area is subtracted.
+ */
+double getArea(const Polygons& polygons)
+{
+    double area = 0.0;
+    for (unsigned int poly_idx = 0; poly_idx < polygons.size(); poly_idx++)
+    {
+        area += polygons[poly_idx].area();
+    }
+    return std::max(0.0, INT2MM(INT2MM(area)));
+}
+
+/*!
+ * Get the settings of a feature printed with a line width setting and a speed setting.
+ */
+FeatureSettings getFeatureSettings(const SettingsBaseVirtual& settings, int extruder_nr, SettingKey line_width, SettingKey speed)
+{
+    FeatureSettings feature;
+    feature.extruder_nr = extruder_nr;
+    feature.line_width = settings.getSettingInMillimeters(line_width);
+    feature.line_distance = 0.0;
+    feature.direction_count = 1;
+    feature.flow = settings.getSettingInPercentage(SettingKey::material_flow) / 100.0;
+    feature.speed = settings.getSettingInMillimetersPerSecond(speed);
+    feature.speed_layer_0 = settings.getSettingInMillimetersPerSecond(SettingKey::speed_print_layer_0);
+    return feature;
+}
+
+/*!
+ * Estimates the layers of a mesh group.
+ */
+class LayerEstimator
+{
+public:
+    LayerEstimator(const SliceDataStorage& storage)
+    : storage(storage)
+    , layer_height(storage.getSettingInMillimeters(SettingKey::layer_height))
+    , layer_height_0(storage.getSettingInMillimeters(SettingKey::layer_height_0))
+    , slowdown_layers(storage.getSettingAsCount(SettingKey::speed_slowdown_layers))
+    , min_layer_time(storage.getSettingInSeconds(SettingKey::cool_min_layer_time))
+    , min_speed(storage.getSettingInMillimetersPerSecond(SettingKey::cool_min_speed))
+    {
+        for (const SliceMeshStorage& mesh : storage.meshes)
+        {
+            const int extruder_nr = mesh.getSettingAsIndex(SettingKey::extruder_nr);
+            MeshSettings mesh_settings;
+            mesh_settings.wall_0 = getFeatureSettings(mesh, extruder_nr, SettingKey::wall_line_width_0, SettingKey::speed_wall_0);
+            mesh_settings.wall_x = getFeatureSettings(mesh, extruder_nr, SettingKey::wall_line_width_x, SettingKey::speed_wall_x);
+            mesh_settings.skin = getFeatureSettings(mesh, extruder_nr, SettingKey::skin_line_width, SettingKey::speed_topbottom);
+            mesh_settings.infill = getFeatureSettings(mesh, extruder_nr, SettingKey::infill_line_width, SettingKey::speed_infill);
+            mesh_settings.infill.line_distance = mesh.getSettingInMillimeters(SettingKey::infill_line_distance);
+            mesh_settings.infill.direction_count = getDirectionCount(mesh.getSettingAsFillMethod(SettingKey::infill_pattern));
+            mesh_settings.retraction_time = 0.0;
+            if (mesh.getSettingBoolean(SettingKey::retraction_enable))
+            {
+                const double retraction_amount = mesh.getSettingInMillimeters(SettingKey::retraction_amount);
+                const double retract_speed = mesh.getSettingInMillimetersPerSecond(SettingKey::retraction_retract_speed);
+                const double prime_speed = mesh.getSettingInMillimetersPerSecond(SettingKey::retraction_prime_speed);
+                mesh_settings.retraction_time = ((retract_speed > 0.0)? retraction_amount / retract_speed : 0.0) + ((prime_speed > 0.0)? retraction_amount / prime_speed : 0.0);
+            }
+            mesh_settings_per_mesh.push_back(mesh_settings);
+        }
+
+        const ExtruderTrain& infill_train = *storage.meshgroup->getExtruderTrain(storage.getSettingAsIndex(SettingKey::support_infill_extruder_nr));
+        support = getFeatureSettings(infill_train, storage.getSettingAsIndex(SettingKey::support_infill_extruder_nr), SettingKey::support_line_width, SettingKey::speed_support_infill);
+        support.line_distance = infill_train.getSettingInMillimeters(SettingKey::support_line_distance);
+        support_pattern = infill_train.getSettingAsFillMethod(SettingKey::support_pattern);
+        support_extruder_nr_layer_0 = storage.getSettingAsIndex(SettingKey::support_extruder_nr_layer_0);
+
+        const int interface_extruder_nr = storage.getSettingAsIndex(SettingKey::support_interface_extruder_nr);
+        const ExtruderTrain& interface_train = *storage.meshgroup->getExtruderTrain(interface_extruder_nr);
+        support_interface = getFeatureSettings(interface_train, interface_extruder_nr, SettingKey::support_interface_line_width, SettingKey::speed_support_interface);
+        support_interface.line_distance = interface_train.getSettingInMillimeters(SettingKey::support_interface_line_distance);
+        support_interface.direction_count = std::min(1U, getDirectionCount(interface_train.getSettingAsFillMethod(SettingKey::support_interface_pattern))); // interfaces are mostly printed as lines
+
+        for (int extruder_nr = 0; extruder_nr < storage.meshgroup->getExtruderCount(); extruder_nr++)
+        {
+            const ExtruderTrain& train = *storage.meshgroup->getExtruderTrain(extruder_nr);
+            skirt_brim.push_back(getFeatureSettings(train, extruder_nr, SettingKey::skirt_brim_line_width, SettingKey::skirt_brim_speed));
+        }
+
+        layer_count = storage.support.supportLayers.size();
+        for (const SliceMeshStorage& mesh : storage.meshes)
+        {
+            layer_count = std::max(layer_count, static_cast<unsigned int>(mesh.layers.size()));
+        }
+    }
+
+    /*!
+     * The number of layers of the mesh group.
+     */
+    unsigned int getLayerCount() const
+    {
+        return layer_count;
+    }
+
+    /*!
+     * Estimate all features of a layer.
+     */
+    void estimateLayer(unsigned int layer_nr, LayerEstimate& estimate) const
+    {
+        const double thickness = (layer_nr == 0)? layer_height_0 : layer_height;
+        for (unsigned int mesh_idx = 0; mesh_idx < storage.meshes.size(); mesh_idx++)
+        {
+            const SliceMeshStorage& mesh = storage.meshes[mesh_idx];
+            if (layer_nr >= mesh.layers.size())
+            {
+                continue;
+            }
+            const MeshSettings& mesh_settings = mesh_settings_per_mesh[mesh_idx];
+            for (const SliceLayerPart& part : mesh.layers[layer_nr].parts)
+            {
+                estimate.print_time += mesh_settings.retraction_time; // the travel to each part is mostly retracted
+                for (unsigned int inset_idx = 0; inset_idx < part.insets.size(); inset_idx++)
+                {
+                    const FeatureSettings& wall = (inset_idx == 0)? mesh_settings.wall_0 : mesh_settings.wall_x;
+                    addLines(estimate, wall, layer_nr, INT2MM(part.insets[inset_idx].polygonLength()), thickness);
+                }
+                for (const SkinPart& skin_part : part.skin_parts)
+                {
+                    addArea(estimate, mesh_settings.skin, layer_nr, getArea(skin_part.outline), mesh_settings.skin.line_distance, thickness);
+                }
+                estimateInfill(estimate, mesh_settings, part, layer_nr, thickness);
+            }
+        }
+
+        if (layer_nr < storage.support.supportLayers.size())
+        {
+            const SupportLayer& support_layer = storage.support.supportLayers[layer_nr];
+            FeatureSettings support_here = support;
+            if (layer_nr == 0)
+            {
+                support_here.extruder_nr = support_extruder_nr_layer_0;
+            }
+            // the first layer is printed as a grid instead of lines, like in FffGcodeWriter::processSupportInfill
+            const EFillMethod pattern = (layer_nr == 0 && (support_pattern == EFillMethod::LINES || support_pattern == EFillMethod::ZIG_ZAG))? EFillMethod::GRID : support_pattern;
+            support_here.direction_count = getDirectionCount(pattern);
+            addArea(estimate, support_here, layer_nr, getArea(support_layer.supportAreas), support_here.line_distance, thickness);
+            addArea(estimate, support_interface, layer_nr, getArea(support_layer.skin), support_interface.line_distance, thickness);
+        }
+
+        if (layer_nr == 0)
+        {
+            for (const FeatureSettings& skirt_brim_here : skirt_brim)
+            {
+                addLines(estimate, skirt_brim_here, layer_nr, INT2MM(storage.skirt_brim[skirt_brim_here.extruder_nr].polygonLength()), thickness);
+            }
+        }
+
+        // small layers are slowed down to the minimal layer time, but not below the minimal speed, like in GCodePlanner::forceMinimalLayerTime
+        if (estimate.print_time > 0.0 && estimate.print_time < min_layer_time)
+        {
+            const double slowest_time = (min_speed > 0.0)? estimate.extruded_length / min_speed : min_layer_time;
+            estimate.print_time = std::min(min_layer_time, std::max(estimate.print_time, slowest_time));
+        }
+    }
+
+private:
+    /*!
+     * The settings of the features of a mesh.
+     */
+    struct MeshSettings
+    {
+        FeatureSettings wall_0;
+        FeatureSettings wall_x;
+        FeatureSettings skin;
+        FeatureSettings infill;
+        double retraction_time; //!< The time in seconds to retract and prime again for a travel move
+    };
+
+    const SliceDataStorage& storage;
+    const double layer_height; //!< The layer height in mm
+    const double layer_height_0; //!< The height of the first layer in mm
+    const int slowdown_layers; //!< The number of layers over which the speed increases from the first layer speed
+    const double min_layer_time; //!< The minimal time in seconds spent on a layer, so that it can cool down
+    const double min_speed; //!< The minimal speed in mm/s to which a layer is slowed down for the minimal layer time
+    unsigned int layer_count;
+    std::vector<MeshSettings> mesh_settings_per_mesh;
+    FeatureSettings support;
+    EFillMethod support_pattern;
+    int support_extruder_nr_layer_0;
+    FeatureSettings support_interface;
+    std::vector<FeatureSettings> skirt_brim; //!< The skirt and brim settings of each extruder
+
+    /*!
+     * The speed of a feature on a layer, increasing from the first layer speed over the initial layers like in GCodePlanner::processInitialLayersSpeedup.
+     */
+    double getSpeed(const FeatureSettings& feature, unsigned int layer_nr) const
+    {
+        if (int(layer_nr) >= slowdown_layers)
+        {
+            return feature.speed;
+        }
+        return (feature.speed * layer_nr + feature.speed_layer_0 * (slowdown_layers - int(layer_nr))) / slowdown_layers;
+    }
+
+    /*!
+     * Add lines of a feature with a total length.
+     *
+     * \param length The length of the lines in mm
+     * \param thickness The thickness of the lines in mm
+     */
+    void addLines(LayerEstimate& estimate, const FeatureSettings& feature, unsigned int layer_nr, double length, double thickness) const
+    {
+        if (length <= 0.0)
+        {
+            return;
+        }
+        estimate.extruded_length += length;
+        estimate.material_volume[feature.extruder_nr] += length * feature.line_width * thickness * feature.flow;
+        const double speed = getSpeed(feature, layer_nr);
+        if (speed > 0.0)
+        {
+            estimate.print_time += length / speed;
+        }
+    }
+
+    /*!
+     * Add the lines filling an area.
+     *
+     * \param area The area in mm^2
+     * \param line_distance The distance between the lines in each direction in mm, or zero to fill the area solid
+     * \param thickness The thickness of the lines in mm
+     */
+    void addArea(LayerEstimate& estimate, const FeatureSettings& feature, unsigned int layer_nr, double area, double line_distance, double thickness) const
+    {
+        if (area <= 0.0 || feature.line_width <= 0.0)
+        {
+            return;
+        }
+        const double length = (line_distance > 0.0)? area * feature.direction_count / line_distance : area / feature.line_width;
+        addLines(estimate, feature, layer_nr, length, thickness);
+    }
+
+    /*!
+     * Add the sparse infill of a part, for each density of gradual infill and each number of combined layers.
+     */
+    void estimateInfill(LayerEstimate& estimate, const MeshSettings& mesh_settings, const SliceLayerPart& part, unsigned int layer_nr, double thickness) const
+    {
+        const FeatureSettings& infill = mesh_settings.infill;
+        if (infill.line_distance <= 0.0 || infill.direction_count == 0)
+        {
+            return;
+        }
+        const std::vector<std::vector<Polygons>>& areas = part.infill_area_per_combine_per_density;
+        // the denser areas also get the lines of all less dense areas around them, see FffGcodeWriter::generateSingleLayerInfill
+        for (unsigned int density_idx = 0; density_idx < areas.size(); density_idx++)
+        {
+            const double density_factor = (density_idx == areas.size() - 1)? (1 << density_idx) : (2 << density_idx);
+            for (unsigned int combine_idx = 0; combine_idx < areas[density_idx].size(); combine_idx++)
+            {
+                addArea(estimate, infill, layer_nr, getArea(areas[density_idx][combine_idx]), infill.line_distance * density_factor, thickness * (combine_idx + 1));
+            }
+        }
+    }
+};
+
+}//namespace
+
+AreaEstimate::AreaEstimate()
+{
+    reset();
+}
+
+void AreaEstimate::setCalibration(const Calibration& calibration)
+{
+    this->calibration = calibration;
+}
+
+void AreaEstimate::reset()
+{
+    print_time = 0.0;
+    std::fill(material_volume, material_volume + MAX_EXTRUDERS, 0.0);
+}
+
+void AreaEstimate::add(const SliceDataStorage& storage)
+{
+    const LayerEstimator estimator(storage);
+    std::vector<LayerEstimate> layer_estimates(estimator.getLayerCount());
+    ThreadPool::getInstance()->parallelFor(0, layer_estimates.size(), [&](int layer_nr)
+        {
+            estimator.estimateLayer(layer_nr, layer_estimates[layer_nr]);
+        });
+    for (const LayerEstimate& layer_estimate : layer_estimates)
+    { // summed in order, so that the estimate doesn't depend on the number of threads
+        print_time += layer_estimate.print_time;
+        for (unsigned int extruder_nr = 0; extruder_nr < MAX_EXTRUDERS; extruder_nr++)
+        {
+            material_volume[extruder_nr] += layer_estimate.material_volume[extruder_nr];
+        }
+    }
+}
+
+double AreaEstimate::getPrintTime() const
+{
+    return print_time * calibration.time_factor;
+}
+
+double AreaEstimate::getMaterialVolume(int extruder_nr) const
+{
+    if (extruder_nr < 0 || extruder_nr >= MAX_EXTRUDERS)
+    {
+        return 0.0;
+    }
+    return material_volume[extruder_nr] * calibration.material_factor;
+}
+
+}//namespace cura
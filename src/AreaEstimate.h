@@ -0,0 +1,77 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef AREA_ESTIMATE_H
+#define AREA_ESTIMATE_H
+
+#include "settings/settings.h" // MAX_EXTRUDERS
+
+namespace cura
+{
+
+class SliceDataStorage;
+
+/*!
+ * A quick estimate of the print time and material of the sliced areas, without planning any paths.
+ *
+ * The material is the area of the walls, skin, infill and support of each layer times the layer thickness,
+ * thinned out by the density of the infill and support and scaled by the flow.
+ * The print time is the length of line needed to fill those areas at the speed of each feature.
+ *
+ * Each part is counted as one retraction, and small layers are slowed down to the minimal layer time like the layer plans are.
+ * The travel moves themselves and acceleration are not modelled;
+ * they are covered by AreaEstimate::Calibration, which is fitted against the full estimate of the gcode over a corpus of models
+ * with tests/calibrate_area_estimate.py.
+ */
+class AreaEstimate
+{
+public:
+    /*!
+     * The factors by which the raw estimates are scaled to match the full estimate of the gcode.
+     */
+    struct Calibration
+    {
+        double time_factor = 1.0; //!< Accounts for travel moves, acceleration and the retractions not counted
+        double material_factor = 1.0; //!< Accounts for the overlap of the lines and the paths which don't fill an area exactly
+    };
+
+    AreaEstimate();
+
+    /*!
+     * Set the factors by which the estimates are scaled.
+     */
+    void setCalibration(const Calibration& calibration);
+
+    /*!
+     * Forget the estimates of the mesh groups added so far.
+     */
+    void reset();
+
+    /*!
+     * Add the estimate of the sliced areas of a mesh group.
+     *
+     * Should be called after FffPolygonGenerator::generateAreas, instead of writing the gcode of \p storage.
+     *
+     * \param storage The sliced areas of the mesh group
+     */
+    void add(const SliceDataStorage& storage);
+
+    /*!
+     * The estimated print time in seconds of all mesh groups added since the last AreaEstimate::reset.
+     */
+    double getPrintTime() const;
+
+    /*!
+     * The estimated material volume in mm^3 extruded by one extruder over all mesh groups added since the last AreaEstimate::reset.
+     *
+     * \param extruder_nr The extruder for which to get the material volume
+     */
+    double getMaterialVolume(int extruder_nr) const;
+
+private:
+    Calibration calibration;
+    double print_time; //!< The uncalibrated print time in seconds
+    double material_volume[MAX_EXTRUDERS]; //!< The uncalibrated material volume in mm^3 of each extruder
+};
+
+}//namespace cura
+
+#endif//AREA_ESTIMATE_H
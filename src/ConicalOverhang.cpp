@@ -1,6 +1,9 @@
 /** Copyright (C) 2016 Tim Kuipers - Released under terms of the AGPLv3 License */
 #include "ConicalOverhang.h"
 
+#include <algorithm> // min, equal
+
+#include "utils/ThreadPool.h"
 
 namespace cura {
 
@@ -10,26 +13,82 @@ void ConicalOverhang::apply(Slicer* slicer, double angle, int layer_thickness)
     double tanAngle = tan(angle);  // the XY-component of the angle
     int max_dist_from_lower_layer = tanAngle * layer_thickness; // max dist which can be bridged
 
-    for (unsigned int layer_nr = slicer->layers.size() - 2; static_cast<int>(layer_nr) >= 0; layer_nr--)
+    std::vector<SlicerLayer>& layers = slicer->layers;
+    if (layers.size() < 2)
     {
-        SlicerLayer& layer = slicer->layers[layer_nr];
-        SlicerLayer& layer_above = slicer->layers[layer_nr + 1];
-        if (std::abs(max_dist_from_lower_layer) < 5)
-        { // magically nothing happens when max_dist_from_lower_layer == 0
-            // below magic code solves that
-            int safe_dist = 20;
-            Polygons diff = layer_above.polygons.difference(layer.polygons.offset(-safe_dist));
-            layer.polygons = layer.polygons.unionPolygons(diff);
-            layer.polygons = layer.polygons.smooth(safe_dist, 100*100);
-            layer.polygons.simplify(safe_dist, safe_dist * safe_dist / 4);
-            // somehow layer.polygons get really jagged lines with a lot of vertices
-            // without the above steps slicing goes really slow
+        return;
+    }
+
+    // Each layer depends on the expanded layer above it, so the layers below the top layer are split into blocks which are computed in parallel,
+    // each assuming that the layer above the block isn't expanded.
+    // Then going down from the top block, each block is computed again from the expanded layer above it,
+    // until a layer turns out the same as computed before, from which on the rest of the block is the same as well.
+    const int changed_layer_count = layers.size() - 1; // the top layer doesn't change
+    const int block_count = std::min<int>(ThreadPool::getInstance()->getThreadCount(), changed_layer_count);
+    auto block_end = [changed_layer_count, block_count](int block_idx)
+    {
+        return static_cast<int64_t>(changed_layer_count) * (block_idx + 1) / block_count;
+    };
+
+    std::vector<Polygons> expanded(changed_layer_count);
+    ThreadPool::getInstance()->parallelFor(0, block_count, [&](int block_idx)
+        {
+            const int begin = block_end(block_idx - 1);
+            const int end = block_end(block_idx);
+            for (int layer_nr = end - 1; layer_nr >= begin; layer_nr--)
+            {
+                const Polygons& above = (layer_nr + 1 < end) ? expanded[layer_nr + 1] : layers[layer_nr + 1].polygons;
+                expanded[layer_nr] = expandLayer(layers[layer_nr].polygons, above, max_dist_from_lower_layer);
+            }
+        });
+
+    for (int block_idx = block_count - 1; block_idx >= 0; block_idx--)
+    {
+        const int begin = block_end(block_idx - 1);
+        int layer_nr = block_end(block_idx) - 1;
+        if (block_idx < block_count - 1)
+        { // the top block was computed from the actual layer above it already
+            for (; layer_nr >= begin; layer_nr--)
+            {
+                Polygons& layer = layers[layer_nr].polygons;
+                layer = expandLayer(layer, layers[layer_nr + 1].polygons, max_dist_from_lower_layer);
+                if (isSame(layer, expanded[layer_nr]))
+                {
+                    layer_nr--;
+                    break;
+                }
+            }
         }
-        else
+        for (; layer_nr >= begin; layer_nr--)
         {
-            layer.polygons = layer.polygons.unionPolygons(layer_above.polygons.offset(-max_dist_from_lower_layer));
+            layers[layer_nr].polygons = std::move(expanded[layer_nr]);
         }
     }
 }
 
+Polygons ConicalOverhang::expandLayer(const Polygons& layer, const Polygons& layer_above, int max_dist_from_lower_layer)
+{
+    if (std::abs(max_dist_from_lower_layer) < 5)
+    { // magically nothing happens when max_dist_from_lower_layer == 0
+        // below magic code solves that
+        int safe_dist = 20;
+        Polygons diff = layer_above.difference(layer.offset(-safe_dist));
+        Polygons result = layer.unionPolygons(diff);
+        result = result.smooth(safe_dist, 100*100);
+        result.simplify(safe_dist, safe_dist * safe_dist / 4);
+        // somehow layer.polygons get really jagged lines with a lot of vertices
+        // without the above steps slicing goes really slow
+        return result;
+    }
+    else
+    {
+        return layer.unionPolygons(layer_above.offset(-max_dist_from_lower_layer));
+    }
+}
+
+bool ConicalOverhang::isSame(const Polygons& a, const Polygons& b)
+{
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+}
+
 }//namespace cura
@@ -23,6 +23,22 @@ public:
      * \param layer_thickness The general layer thickness
      */
     static void apply(Slicer* slicer, double angle, int layer_thickness);
+
+private:
+    /*!
+     * Expand a layer by the parts of the (expanded) layer above it which can't be printed without support.
+     *
+     * \param layer The layer to expand
+     * \param layer_above The expanded layer above \p layer
+     * \param max_dist_from_lower_layer The distance a layer may stick out of the layer below it
+     * \return The expanded layer
+     */
+    static Polygons expandLayer(const Polygons& layer, const Polygons& layer_above, int max_dist_from_lower_layer);
+
+    /*!
+     * Whether two polygons have exactly the same points in the same order.
+     */
+    static bool isSame(const Polygons& a, const Polygons& b);
 };
 
 }//namespace cura
@@ -2,38 +2,43 @@
 #include <list>
 
 #include "utils/math.h"
+#include "utils/memoryRelease.h"
+#include "utils/ThreadPool.h"
+#include "utils/Trace.h"
 #include "FffGcodeWriter.h"
 #include "FffProcessor.h"
+#include "progress/MemoryGovernor.h"
 #include "progress/Progress.h"
+#include "progress/SlowLayerCapture.h"
 #include "wallOverlap.h"
 
 namespace cura
 {
 
 
-void FffGcodeWriter::writeGCode(SliceDataStorage& storage, TimeKeeper& time_keeper)
+void FffGcodeWriter::writeGCode(SliceDataStorage& storage, TimeKeeper& time_keeper, bool release_layers)
 {
     gcode.preSetup(storage.meshgroup);
     
-    if (FffProcessor::getInstance()->getMeshgroupNr() == 0)
+    if (context.processor->getMeshgroupNr() == 0)
     { // first meshgroup
         gcode.resetTotalPrintTimeAndFilament();
         gcode.setInitialTemps(*storage.meshgroup);
     }
 
     // set the initial extruder of this meshgroup
-    if (FffProcessor::getInstance()->getMeshgroupNr() == 0)
+    if (context.processor->getMeshgroupNr() == 0)
     { // first meshgroup
-        current_extruder_planned = getSettingAsIndex("adhesion_extruder_nr");
+        current_extruder_planned = getSettingAsIndex(SettingKey::adhesion_extruder_nr);
     }
     else
     {
         current_extruder_planned = gcode.getExtruderNr();
     }
 
-    if (CommandSocket::isInstantiated())
+    if (context.command_socket)
     {
-        CommandSocket::getInstance()->beginGCode();
+        context.command_socket->beginGCode();
     }
 
     setConfigFanSpeedLayerTime(storage);
@@ -41,18 +46,25 @@ void FffGcodeWriter::writeGCode(SliceDataStorage& storage, TimeKeeper& time_keep
     setConfigCoasting(storage);
 
     setConfigRetraction(storage);
+
+    setConfigTravel(storage);
     
     initConfigs(storage);
     
     for (int extruder = 0; extruder < storage.meshgroup->getExtruderCount(); extruder++)
     { //Skirt and brim.
-        storage.skirt_brim_config[extruder].setLayerHeight(getSettingInMicrons("layer_height_0"));
+        storage.skirt_brim_config[extruder].setLayerHeight(getSettingInMicrons(SettingKey::layer_height_0));
         skirt_brim_is_processed[extruder] = false;
     }
 
+    mesh_order_per_extruder.assign(storage.meshgroup->getExtruderCount(), std::vector<unsigned int>());
+    recent_part_orders_per_mesh.assign(storage.meshes.size(), std::vector<PartOrder>());
+
     layer_plan_buffer.setPreheatConfig(*storage.meshgroup);
+    layer_plan_buffer.setBufferSize(storage.getSettingAsCount(SettingKey::layer_plan_buffer_size));
+    layer_plan_buffer.setFlushPerLayer(storage.getSettingBoolean(SettingKey::gcode_flush_per_layer));
     
-    if (FffProcessor::getInstance()->getMeshgroupNr() == 0)
+    if (context.processor->getMeshgroupNr() == 0)
     {
         processStartingCode(storage);
     }
@@ -69,8 +81,29 @@ void FffGcodeWriter::writeGCode(SliceDataStorage& storage, TimeKeeper& time_keep
     
     gcode.writeLayerCountComment(total_layers);
 
-    bool has_raft = getSettingAsPlatformAdhesion("adhesion_type") == EPlatformAdhesion::RAFT;
-    if (has_raft)
+    // the layers of which to write the gcode
+    const unsigned int first_layer = std::min(total_layers, size_t(std::max(0, layer_range_first)));
+    const unsigned int end_layer = (layer_range_last < 0) ? total_layers : std::max(first_layer, static_cast<unsigned int>(std::min(total_layers, size_t(layer_range_last) + 1)));
+    const bool is_layer_range = layer_range_first > 0 || layer_range_last >= 0;
+    unsigned int statistics_before_range = 0; // the number of amounts in the print statistics before the range
+    std::vector<double> uncommitted_filament_before_range; // the material extruded since the last reset of the E value before the range
+    if (is_layer_range)
+    {
+        gcode.updateTotalPrintTime();
+        statistics_before_range = gcode.getPrintStatistics().getAmountCount();
+        for (int extruder = 0; extruder < storage.meshgroup->getExtruderCount(); extruder++)
+        {
+            uncommitted_filament_before_range.push_back(gcode.getTotalFilamentUsed(extruder) - gcode.getPrintStatistics().getFilament(extruder));
+        }
+        gcode.writeComment("LAYER_RANGE_START:" + std::to_string(first_layer) + "," + std::to_string(static_cast<int>(end_layer) - 1));
+        if (first_layer > 0)
+        {
+            processLayerRangeStart(storage);
+        }
+    }
+
+    bool has_raft = getSettingAsPlatformAdhesion(SettingKey::adhesion_type) == EPlatformAdhesion::RAFT;
+    if (has_raft && first_layer == 0)
     {
         processRaft(storage, total_layers);
     }
@@ -78,20 +111,96 @@ void FffGcodeWriter::writeGCode(SliceDataStorage& storage, TimeKeeper& time_keep
     for (int extruder = 0; extruder < storage.meshgroup->getExtruderCount(); extruder++)
         last_prime_tower_poly_printed[extruder] = -1; // layer 0 has its prime tower printed during the brim (?)
     
-    for(unsigned int layer_nr=0; layer_nr<total_layers; layer_nr++)
+    comb_boundary_inside_per_layer.clear();
+    comb_boundary_inside_per_layer.resize(total_layers);
+    const unsigned int path_geometry_batch_size = ThreadPool::getInstance()->getThreadCount() * 4; // enough layers to keep all threads busy
+    unsigned int path_geometry_end = first_layer; // the layers below this one have their path geometry generated
+    for(unsigned int layer_nr = first_layer; layer_nr < end_layer; layer_nr++)
     {
+        if (context.isCancelled())
+        { // the layers planned so far are still written, so that the gcode export is left in a consistent state
+            break;
+        }
+        if (layer_nr == path_geometry_end)
+        {
+            unsigned int batch_size = path_geometry_batch_size;
+            if (MemoryGovernor::getInstance().isUnderPressure("path_geometry_window", true))
+            { // only the threads working within a layer use more memory at once
+                batch_size = 1;
+            }
+            else if (MemoryGovernor::getInstance().isUnderPressure("path_geometry_window"))
+            {
+                batch_size = ThreadPool::getInstance()->getThreadCount();
+            }
+            path_geometry_end = std::min(end_layer, layer_nr + batch_size);
+            // the skin of a layer is generated over the layer below, which stays decompressed until the layer above it has been planned
+            ThreadPool::getInstance()->parallelForLayers((layer_nr > 0) ? layer_nr - 1 : 0, path_geometry_end, [&](int batch_layer_nr)
+                {
+                    storage.decompressLayer(batch_layer_nr);
+                }, total_layers);
+            ThreadPool::getInstance()->parallelForLayers(layer_nr, path_geometry_end, [&](int batch_layer_nr)
+                {
+                    generatePathGeometry(storage, batch_layer_nr);
+                }, total_layers);
+        }
+        TimeKeeper layer_timer;
         processLayer(storage, layer_nr, total_layers, has_raft);
+        const double layer_time = layer_timer.restart();
+        if (SlowLayerCapture::getInstance().isSlow(layer_time))
+        { // the layer is only released below
+            SlowLayerCapture::getInstance().capture("planning", -1, layer_nr, storage.meshes[0].layers[layer_nr].printZ, layer_time, storage.getLayerOutlines(layer_nr, false), *this);
+        }
+        if (release_layers && layer_nr > first_layer)
+        { // the bridges of a layer are planned over the layer below, so that layer is only released after planning the layer above it
+            storage.releaseLayer(layer_nr - 1);
+            if (layer_nr % path_geometry_batch_size == 0)
+            { // the released layers are spread over memory which is still in use, so it's only given back once in a while
+                releaseFreedMemory();
+            }
+        }
+        else if (layer_nr > 0)
+        { // the storage is written again or the layer is below the written range, so only a decompressed copy of the layer is freed
+            storage.releaseDecompressedLayer(layer_nr - 1);
+        }
+    }
+    if (!release_layers)
+    {
+        for (unsigned int layer_nr = first_layer; layer_nr < path_geometry_end; layer_nr++)
+        { // the last planned layer and the ones decompressed ahead of it when the writing was cancelled
+            storage.releaseDecompressedLayer(layer_nr);
+        }
     }
     
-    Progress::messageProgressStage(Progress::Stage::FINISH, &time_keeper);
+    Progress::messageProgressStage(Progress::Stage::FINISH, &time_keeper, context.command_socket);
 
     //Store the object height for when we are printing multiple objects, as we need to clear every one of them when moving to the next position.
     max_object_height = std::max(max_object_height, storage.model_max.z);
 
     layer_plan_buffer.flush();
+    storage.comb_boundary_cache.logStatistics();
+    storage.infill_cache.logStatistics();
+    storage.support_infill_cache.logStatistics();
 
     constexpr bool force = true;
     gcode.writeRetraction(&storage.retraction_config_per_extruder[gcode.getExtruderNr()], force); // retract after finishing each meshgroup
+
+    if (is_layer_range)
+    { // the totals of this range, with which the totals of the stitched gcode are computed
+        gcode.updateTotalPrintTime();
+        gcode.writeComment("LAYER_RANGE_END:" + std::to_string(first_layer) + "," + std::to_string(static_cast<int>(end_layer) - 1));
+        // summed over the amounts of the range only, so that they don't depend on the rounding of the totals of the layers before it
+        const PrintStatistics range_statistics = gcode.getPrintStatistics().getStatisticsSince(statistics_before_range);
+        std::ostringstream totals;
+        totals << "LAYER_RANGE_TIME:" << range_statistics.getPrintTime();
+        gcode.writeComment(totals.str());
+        for (int extruder = 0; extruder < storage.meshgroup->getExtruderCount(); extruder++)
+        {
+            const double uncommitted_filament = gcode.getTotalFilamentUsed(extruder) - gcode.getPrintStatistics().getFilament(extruder);
+            totals.str("");
+            totals << "LAYER_RANGE_MATERIAL." << extruder << ":" << (range_statistics.getFilament(extruder) + uncommitted_filament - uncommitted_filament_before_range[extruder]);
+            gcode.writeComment(totals.str());
+        }
+    }
 }
 
 void FffGcodeWriter::setConfigFanSpeedLayerTime(SliceDataStorage& storage)
@@ -101,26 +210,27 @@ void FffGcodeWriter::setConfigFanSpeedLayerTime(SliceDataStorage& storage)
         fan_speed_layer_time_settings_per_extruder.emplace_back();
         FanSpeedLayerTimeSettings& fan_speed_layer_time_settings = fan_speed_layer_time_settings_per_extruder.back();
         ExtruderTrain* train = storage.meshgroup->getExtruderTrain(extr);
-        fan_speed_layer_time_settings.cool_min_layer_time = train->getSettingInSeconds("cool_min_layer_time");
-        fan_speed_layer_time_settings.cool_min_layer_time_fan_speed_max = train->getSettingInSeconds("cool_min_layer_time_fan_speed_max");
-        fan_speed_layer_time_settings.cool_fan_speed_min = train->getSettingInPercentage("cool_fan_speed_min");
-        fan_speed_layer_time_settings.cool_fan_speed_max = train->getSettingInPercentage("cool_fan_speed_max");
-        fan_speed_layer_time_settings.cool_min_speed = train->getSettingInMillimetersPerSecond("cool_min_speed");
-        fan_speed_layer_time_settings.cool_fan_full_layer = train->getSettingAsCount("cool_fan_full_layer");
+        fan_speed_layer_time_settings.cool_min_layer_time = train->getSettingInSeconds(SettingKey::cool_min_layer_time);
+        fan_speed_layer_time_settings.cool_min_layer_time_fan_speed_max = train->getSettingInSeconds(SettingKey::cool_min_layer_time_fan_speed_max);
+        fan_speed_layer_time_settings.cool_fan_speed_min = train->getSettingInPercentage(SettingKey::cool_fan_speed_min);
+        fan_speed_layer_time_settings.cool_fan_speed_max = train->getSettingInPercentage(SettingKey::cool_fan_speed_max);
+        fan_speed_layer_time_settings.cool_min_speed = train->getSettingInMillimetersPerSecond(SettingKey::cool_min_speed);
+        fan_speed_layer_time_settings.cool_fan_full_layer = train->getSettingAsCount(SettingKey::cool_fan_full_layer);
     }
 }
 
 void FffGcodeWriter::setConfigCoasting(SliceDataStorage& storage) 
 {
+    storage.coasting_config.clear(); // the storage may be reused from a previous mesh group
     for (int extr = 0; extr < storage.meshgroup->getExtruderCount(); extr++)
     {
         storage.coasting_config.emplace_back();
         ExtruderTrain* train = storage.meshgroup->getExtruderTrain(extr);
         CoastingConfig& coasting_config = storage.coasting_config.back();
-        coasting_config.coasting_enable = train->getSettingBoolean("coasting_enable"); 
-        coasting_config.coasting_volume = train->getSettingInCubicMillimeters("coasting_volume"); 
-        coasting_config.coasting_min_volume = train->getSettingInCubicMillimeters("coasting_min_volume"); 
-        coasting_config.coasting_speed = train->getSettingInPercentage("coasting_speed") / 100.0; 
+        coasting_config.coasting_enable = train->getSettingBoolean(SettingKey::coasting_enable); 
+        coasting_config.coasting_volume = train->getSettingInCubicMillimeters(SettingKey::coasting_volume); 
+        coasting_config.coasting_min_volume = train->getSettingInCubicMillimeters(SettingKey::coasting_min_volume); 
+        coasting_config.coasting_speed = train->getSettingInPercentage(SettingKey::coasting_speed) / 100.0; 
     }
 }
 
@@ -131,20 +241,20 @@ void FffGcodeWriter::setConfigRetraction(SliceDataStorage& storage)
     {
         ExtruderTrain* train = storage.meshgroup->getExtruderTrain(extruder);
         RetractionConfig& retraction_config = storage.retraction_config_per_extruder[extruder];
-        retraction_config.distance = (train->getSettingBoolean("retraction_enable"))? train->getSettingInMillimeters("retraction_amount") : 0;
-        retraction_config.prime_volume = train->getSettingInCubicMillimeters("retraction_extra_prime_amount");
-        retraction_config.speed = train->getSettingInMillimetersPerSecond("retraction_retract_speed");
-        retraction_config.primeSpeed = train->getSettingInMillimetersPerSecond("retraction_prime_speed");
-        retraction_config.zHop = train->getSettingInMicrons("retraction_hop");
-        retraction_config.retraction_min_travel_distance = train->getSettingInMicrons("retraction_min_travel");
-        retraction_config.retraction_extrusion_window = train->getSettingInMillimeters("retraction_extrusion_window");
-        retraction_config.retraction_count_max = train->getSettingAsCount("retraction_count_max");
+        retraction_config.distance = (train->getSettingBoolean(SettingKey::retraction_enable))? train->getSettingInMillimeters(SettingKey::retraction_amount) : 0;
+        retraction_config.prime_volume = train->getSettingInCubicMillimeters(SettingKey::retraction_extra_prime_amount);
+        retraction_config.speed = train->getSettingInMillimetersPerSecond(SettingKey::retraction_retract_speed);
+        retraction_config.primeSpeed = train->getSettingInMillimetersPerSecond(SettingKey::retraction_prime_speed);
+        retraction_config.zHop = train->getSettingInMicrons(SettingKey::retraction_hop);
+        retraction_config.retraction_min_travel_distance = train->getSettingInMicrons(SettingKey::retraction_min_travel);
+        retraction_config.retraction_extrusion_window = train->getSettingInMillimeters(SettingKey::retraction_extrusion_window);
+        retraction_config.retraction_count_max = train->getSettingAsCount(SettingKey::retraction_count_max);
 
         RetractionConfig& switch_retraction_config = storage.extruder_switch_retraction_config_per_extruder[extruder];
-        switch_retraction_config.distance = train->getSettingInMillimeters("switch_extruder_retraction_amount"); 
+        switch_retraction_config.distance = train->getSettingInMillimeters(SettingKey::switch_extruder_retraction_amount); 
         switch_retraction_config.prime_volume = 0.0;
-        switch_retraction_config.speed = train->getSettingInMillimetersPerSecond("switch_extruder_retraction_speed");
-        switch_retraction_config.primeSpeed = train->getSettingInMillimetersPerSecond("switch_extruder_prime_speed");
+        switch_retraction_config.speed = train->getSettingInMillimetersPerSecond(SettingKey::switch_extruder_retraction_speed);
+        switch_retraction_config.primeSpeed = train->getSettingInMillimetersPerSecond(SettingKey::switch_extruder_prime_speed);
         switch_retraction_config.zHop = retraction_config.zHop; // not used, because the last_retraction_config is used to govern how how high to zHop
         switch_retraction_config.retraction_min_travel_distance = 0; // no limitation on travel distance for an extruder switch retract
         switch_retraction_config.retraction_extrusion_window = 99999.9; // so that extruder switch retractions won't affect the retraction buffer (extruded_volume_at_previous_n_retractions)
@@ -152,32 +262,49 @@ void FffGcodeWriter::setConfigRetraction(SliceDataStorage& storage)
     }
 }
 
+void FffGcodeWriter::setConfigTravel(SliceDataStorage& storage)
+{
+    storage.travel_policy_per_extruder.clear(); // the storage may be reused from a previous mesh group
+    for (int extruder = 0; extruder < storage.meshgroup->getExtruderCount(); extruder++)
+    {
+        storage.travel_policy_per_extruder.emplace_back();
+        ExtruderTrain* train = storage.meshgroup->getExtruderTrain(extruder);
+        TravelConfig& travel_policy = storage.travel_policy_per_extruder.back();
+        travel_policy.perform_z_hops = train->getSettingBoolean(SettingKey::retraction_hop_enabled);
+        travel_policy.z_hops_only_when_collides = train->getSettingBoolean(SettingKey::retraction_hop_only_when_collides);
+        travel_policy.z_hop_after_extruder_switch = train->getSettingBoolean(SettingKey::retraction_hop_after_extruder_switch);
+        travel_policy.avoid_other_parts = train->getSettingBoolean(SettingKey::travel_avoid_other_parts);
+        travel_policy.avoid_distance = train->getSettingInMicrons(SettingKey::travel_avoid_distance);
+        travel_policy.move_inside_distance = train->getSettingInMicrons((train->getSettingAsCount(SettingKey::wall_line_count) > 1) ? SettingKey::wall_line_width_x : SettingKey::wall_line_width_0);
+    }
+}
+
 void FffGcodeWriter::initConfigs(SliceDataStorage& storage)
 {
     for (int extruder = 0; extruder < storage.meshgroup->getExtruderCount(); extruder++)
     { //Skirt and brim.
         SettingsBase* train = storage.meshgroup->getExtruderTrain(extruder);
-        storage.skirt_brim_config[extruder].init(train->getSettingInMillimetersPerSecond("skirt_brim_speed"), train->getSettingInMillimetersPerSecond("acceleration_skirt_brim"), train->getSettingInMillimetersPerSecond("jerk_skirt_brim"), train->getSettingInMicrons("skirt_brim_line_width"), train->getSettingInPercentage("material_flow"));
-        storage.travel_config_per_extruder[extruder].init(train->getSettingInMillimetersPerSecond("speed_travel"), train->getSettingInMillimetersPerSecond("acceleration_travel"), train->getSettingInMillimetersPerSecond("jerk_travel"), 0, 0);
+        storage.skirt_brim_config[extruder].init(train->getSettingInMillimetersPerSecond(SettingKey::skirt_brim_speed), train->getSettingInMillimetersPerSecond(SettingKey::acceleration_skirt_brim), train->getSettingInMillimetersPerSecond(SettingKey::jerk_skirt_brim), train->getSettingInMicrons(SettingKey::skirt_brim_line_width), train->getSettingInPercentage(SettingKey::material_flow));
+        storage.travel_config_per_extruder[extruder].init(train->getSettingInMillimetersPerSecond(SettingKey::speed_travel), train->getSettingInMillimetersPerSecond(SettingKey::acceleration_travel), train->getSettingInMillimetersPerSecond(SettingKey::jerk_travel), 0, 0);
     }
 
     { // support 
-        SettingsBase* infill_train = storage.meshgroup->getExtruderTrain(getSettingAsIndex("support_infill_extruder_nr"));
-        storage.support_config.init(infill_train->getSettingInMillimetersPerSecond("speed_support_infill"), infill_train->getSettingInMillimetersPerSecond("acceleration_support_infill"), infill_train->getSettingInMillimetersPerSecond("jerk_support_infill"), infill_train->getSettingInMicrons("support_line_width"), infill_train->getSettingInPercentage("material_flow"));
+        SettingsBase* infill_train = storage.meshgroup->getExtruderTrain(getSettingAsIndex(SettingKey::support_infill_extruder_nr));
+        storage.support_config.init(infill_train->getSettingInMillimetersPerSecond(SettingKey::speed_support_infill), infill_train->getSettingInMillimetersPerSecond(SettingKey::acceleration_support_infill), infill_train->getSettingInMillimetersPerSecond(SettingKey::jerk_support_infill), infill_train->getSettingInMicrons(SettingKey::support_line_width), infill_train->getSettingInPercentage(SettingKey::material_flow));
     
-        SettingsBase* interface_train = storage.meshgroup->getExtruderTrain(getSettingAsIndex("support_interface_extruder_nr"));
-        storage.support_skin_config.init(interface_train->getSettingInMillimetersPerSecond("speed_support_interface"), interface_train->getSettingInMillimetersPerSecond("acceleration_support_interface"), interface_train->getSettingInMillimetersPerSecond("jerk_support_interface"), interface_train->getSettingInMicrons("support_interface_line_width"), interface_train->getSettingInPercentage("material_flow"));
+        SettingsBase* interface_train = storage.meshgroup->getExtruderTrain(getSettingAsIndex(SettingKey::support_interface_extruder_nr));
+        storage.support_skin_config.init(interface_train->getSettingInMillimetersPerSecond(SettingKey::speed_support_interface), interface_train->getSettingInMillimetersPerSecond(SettingKey::acceleration_support_interface), interface_train->getSettingInMillimetersPerSecond(SettingKey::jerk_support_interface), interface_train->getSettingInMicrons(SettingKey::support_interface_line_width), interface_train->getSettingInPercentage(SettingKey::material_flow));
     }
     
     for (SliceMeshStorage& mesh : storage.meshes)
     {
-        mesh.inset0_config.init(mesh.getSettingInMillimetersPerSecond("speed_wall_0"), mesh.getSettingInMillimetersPerSecond("acceleration_wall_0"), mesh.getSettingInMillimetersPerSecond("jerk_wall_0"), mesh.getSettingInMicrons("wall_line_width_0"), mesh.getSettingInPercentage("material_flow"));
-        mesh.insetX_config.init(mesh.getSettingInMillimetersPerSecond("speed_wall_x"), mesh.getSettingInMillimetersPerSecond("acceleration_wall_x"), mesh.getSettingInMillimetersPerSecond("jerk_wall_x"), mesh.getSettingInMicrons("wall_line_width_x"), mesh.getSettingInPercentage("material_flow"));
-        mesh.skin_config.init(mesh.getSettingInMillimetersPerSecond("speed_topbottom"), mesh.getSettingInMillimetersPerSecond("acceleration_topbottom"), mesh.getSettingInMillimetersPerSecond("jerk_topbottom"), mesh.getSettingInMicrons("skin_line_width"), mesh.getSettingInPercentage("material_flow"));
+        mesh.inset0_config.init(mesh.getSettingInMillimetersPerSecond(SettingKey::speed_wall_0), mesh.getSettingInMillimetersPerSecond(SettingKey::acceleration_wall_0), mesh.getSettingInMillimetersPerSecond(SettingKey::jerk_wall_0), mesh.getSettingInMicrons(SettingKey::wall_line_width_0), mesh.getSettingInPercentage(SettingKey::material_flow));
+        mesh.insetX_config.init(mesh.getSettingInMillimetersPerSecond(SettingKey::speed_wall_x), mesh.getSettingInMillimetersPerSecond(SettingKey::acceleration_wall_x), mesh.getSettingInMillimetersPerSecond(SettingKey::jerk_wall_x), mesh.getSettingInMicrons(SettingKey::wall_line_width_x), mesh.getSettingInPercentage(SettingKey::material_flow));
+        mesh.skin_config.init(mesh.getSettingInMillimetersPerSecond(SettingKey::speed_topbottom), mesh.getSettingInMillimetersPerSecond(SettingKey::acceleration_topbottom), mesh.getSettingInMillimetersPerSecond(SettingKey::jerk_topbottom), mesh.getSettingInMicrons(SettingKey::skin_line_width), mesh.getSettingInPercentage(SettingKey::material_flow));
     
         for (unsigned int idx = 0; idx < MAX_INFILL_COMBINE; idx++)
         {
-            mesh.infill_config[idx].init(mesh.getSettingInMillimetersPerSecond("speed_infill"), mesh.getSettingInMillimetersPerSecond("acceleration_infill"), mesh.getSettingInMillimetersPerSecond("jerk_infill"), mesh.getSettingInMicrons("infill_line_width") * (idx + 1), mesh.getSettingInPercentage("material_flow"));
+            mesh.infill_config[idx].init(mesh.getSettingInMillimetersPerSecond(SettingKey::speed_infill), mesh.getSettingInMillimetersPerSecond(SettingKey::acceleration_infill), mesh.getSettingInMillimetersPerSecond(SettingKey::jerk_infill), mesh.getSettingInMicrons(SettingKey::infill_line_width) * (idx + 1), mesh.getSettingInPercentage(SettingKey::material_flow));
         }
     }
     
@@ -186,62 +313,65 @@ void FffGcodeWriter::initConfigs(SliceDataStorage& storage)
 
 void FffGcodeWriter::processStartingCode(SliceDataStorage& storage)
 {
-    if (!CommandSocket::isInstantiated())
+    if (!context.command_socket)
     {
         std::string prefix = gcode.getFileHeader();
         gcode.writeCode(prefix.c_str());
     }
 
-    int start_extruder_nr = getSettingAsIndex("adhesion_extruder_nr");
+    int start_extruder_nr = getSettingAsIndex(SettingKey::adhesion_extruder_nr);
 
     gcode.writeComment("Generated with Cura_SteamEngine " VERSION);
 
     if (gcode.getFlavor() != EGCodeFlavor::ULTIGCODE && gcode.getFlavor() != EGCodeFlavor::GRIFFIN)
     {
-        if (getSettingBoolean("material_bed_temp_prepend")) 
+        if (getSettingBoolean(SettingKey::material_bed_temp_prepend)) 
         {
-            if (getSettingBoolean("machine_heated_bed") && getSettingInDegreeCelsius("material_bed_temperature") > 0)
+            if (getSettingBoolean(SettingKey::machine_heated_bed) && getSettingInDegreeCelsius(SettingKey::material_bed_temperature) > 0)
             {
-                gcode.writeBedTemperatureCommand(getSettingInDegreeCelsius("material_bed_temperature"), getSettingBoolean("material_bed_temp_wait"));
+                gcode.writeBedTemperatureCommand(getSettingInDegreeCelsius(SettingKey::material_bed_temperature), getSettingBoolean(SettingKey::material_bed_temp_wait));
             }
         }
 
-        if (getSettingBoolean("material_print_temp_prepend")) 
+        if (getSettingBoolean(SettingKey::material_print_temp_prepend)) 
         {
-            for (int extruder_nr = 0; extruder_nr < storage.getSettingAsCount("machine_extruder_count"); extruder_nr++)
+            for (int extruder_nr = 0; extruder_nr < storage.getSettingAsCount(SettingKey::machine_extruder_count); extruder_nr++)
             {
-                double print_temp = storage.meshgroup->getExtruderTrain(extruder_nr)->getSettingInDegreeCelsius("material_print_temperature");
+                double print_temp = storage.meshgroup->getExtruderTrain(extruder_nr)->getSettingInDegreeCelsius(SettingKey::material_print_temperature);
                 gcode.writeTemperatureCommand(extruder_nr, print_temp);
             }
-            if (getSettingBoolean("material_print_temp_wait")) 
+            if (getSettingBoolean(SettingKey::material_print_temp_wait)) 
             {
-                for (int extruder_nr = 0; extruder_nr < storage.getSettingAsCount("machine_extruder_count"); extruder_nr++)
+                for (int extruder_nr = 0; extruder_nr < storage.getSettingAsCount(SettingKey::machine_extruder_count); extruder_nr++)
                 {
-                    double print_temp = storage.meshgroup->getExtruderTrain(extruder_nr)->getSettingInDegreeCelsius("material_print_temperature");
+                    double print_temp = storage.meshgroup->getExtruderTrain(extruder_nr)->getSettingInDegreeCelsius(SettingKey::material_print_temperature);
                     gcode.writeTemperatureCommand(extruder_nr, print_temp, true);
                 }
             }
         }
     }
 
-    gcode.writeCode(getSettingString("machine_start_gcode").c_str());
+    gcode.writeCode(getSettingString(SettingKey::machine_start_gcode).c_str());
 
     if (gcode.getFlavor() == EGCodeFlavor::BFB)
     {
         gcode.writeComment("enable auto-retraction");
         std::ostringstream tmp;
-        tmp << "M227 S" << (getSettingInMicrons("retraction_amount") * 2560 / 1000) << " P" << (getSettingInMicrons("retraction_amount") * 2560 / 1000);
+        tmp << "M227 S" << (getSettingInMicrons(SettingKey::retraction_amount) * 2560 / 1000) << " P" << (getSettingInMicrons(SettingKey::retraction_amount) * 2560 / 1000);
         gcode.writeLine(tmp.str().c_str());
     }
     else if (gcode.getFlavor() == EGCodeFlavor::GRIFFIN)
     { // initialize extruder trains
         gcode.writeCode("T0"); // Toolhead already assumed to be at T0, but writing it just to be safe...
-        CommandSocket::setSendCurrentPosition(gcode.getPositionXY());
+        if (context.command_socket)
+        {
+            context.command_socket->setSendCurrentPosition(gcode.getPositionXY());
+        }
         gcode.startExtruder(start_extruder_nr);
         ExtruderTrain& train = *storage.meshgroup->getExtruderTrain(start_extruder_nr);
         constexpr bool wait = true;
-        gcode.writeTemperatureCommand(start_extruder_nr, train.getSettingInDegreeCelsius("material_print_temperature"), wait);
-        gcode.writePrimeTrain(train.getSettingInMillimetersPerSecond("speed_travel"));
+        gcode.writeTemperatureCommand(start_extruder_nr, train.getSettingInDegreeCelsius(SettingKey::material_print_temperature), wait);
+        gcode.writePrimeTrain(train.getSettingInMillimetersPerSecond(SettingKey::speed_travel));
         RetractionConfig& retraction_config = storage.retraction_config_per_extruder[start_extruder_nr];
         gcode.writeRetraction(&retraction_config);
     }
@@ -251,142 +381,172 @@ void FffGcodeWriter::processNextMeshGroupCode(SliceDataStorage& storage)
 {
     gcode.writeFanCommand(0);
     gcode.resetExtrusionValue();
-    CommandSocket::setSendCurrentPosition(gcode.getPositionXY());
+    if (context.command_socket)
+    {
+        context.command_socket->setSendCurrentPosition(gcode.getPositionXY());
+    }
     gcode.setZ(max_object_height + 5000);
-    gcode.writeMove(gcode.getPositionXY(), storage.meshgroup->getExtruderTrain(gcode.getExtruderNr())->getSettingInMillimetersPerSecond("speed_travel"), 0);
+    gcode.writeMove(gcode.getPositionXY(), storage.meshgroup->getExtruderTrain(gcode.getExtruderNr())->getSettingInMillimetersPerSecond(SettingKey::speed_travel), 0);
     last_position_planned = Point(storage.model_min.x, storage.model_min.y);
-    gcode.writeMove(last_position_planned, storage.meshgroup->getExtruderTrain(gcode.getExtruderNr())->getSettingInMillimetersPerSecond("speed_travel"), 0);
+    gcode.writeMove(last_position_planned, storage.meshgroup->getExtruderTrain(gcode.getExtruderNr())->getSettingInMillimetersPerSecond(SettingKey::speed_travel), 0);
 }
     
+void FffGcodeWriter::processLayerRangeStart(SliceDataStorage& storage)
+{
+    ExtruderTrain& train = *storage.meshgroup->getExtruderTrain(current_extruder_planned);
+    constexpr bool wait = true;
+    gcode.writeTemperatureCommand(current_extruder_planned, train.getSettingInDegreeCelsius(SettingKey::material_print_temperature), wait);
+    gcode.resumeRetracted(current_extruder_planned, storage.retraction_config_per_extruder[current_extruder_planned]);
+    if (context.command_socket)
+    {
+        context.command_socket->setSendCurrentPosition(gcode.getPositionXY());
+    }
+}
+
 void FffGcodeWriter::processRaft(SliceDataStorage& storage, unsigned int total_layers)
 {
-    int extruder_nr = getSettingAsIndex("adhesion_extruder_nr");
+    int extruder_nr = getSettingAsIndex(SettingKey::adhesion_extruder_nr);
     ExtruderTrain* train = storage.meshgroup->getExtruderTrain(extruder_nr);
     
-    CombingMode combing_mode = storage.getSettingAsCombingMode("retraction_combing"); 
+    CombingMode combing_mode = storage.getSettingAsCombingMode(SettingKey::retraction_combing); 
     
-    int n_raft_surface_layers = train->getSettingAsCount("raft_surface_layers");
+    int n_raft_surface_layers = train->getSettingAsCount(SettingKey::raft_surface_layers);
     
     int z = 0;
     
     { // set configs 
-        storage.raft_base_config.init(train->getSettingInMillimetersPerSecond("raft_base_speed"), train->getSettingInMillimetersPerSecond("raft_base_acceleration"), train->getSettingInMillimetersPerSecond("raft_base_jerk"), train->getSettingInMicrons("raft_base_line_width"), train->getSettingInPercentage("material_flow"));
-        storage.raft_base_config.setLayerHeight(train->getSettingInMicrons("raft_base_thickness"));
+        storage.raft_base_config.init(train->getSettingInMillimetersPerSecond(SettingKey::raft_base_speed), train->getSettingInMillimetersPerSecond(SettingKey::raft_base_acceleration), train->getSettingInMillimetersPerSecond(SettingKey::raft_base_jerk), train->getSettingInMicrons(SettingKey::raft_base_line_width), train->getSettingInPercentage(SettingKey::material_flow));
+        storage.raft_base_config.setLayerHeight(train->getSettingInMicrons(SettingKey::raft_base_thickness));
         
-        storage.raft_interface_config.init(train->getSettingInMillimetersPerSecond("raft_interface_speed"), train->getSettingInMillimetersPerSecond("raft_interface_acceleration"), train->getSettingInMillimetersPerSecond("raft_interface_jerk"), train->getSettingInMicrons("raft_interface_line_width"), train->getSettingInPercentage("material_flow"));
-        storage.raft_interface_config.setLayerHeight(train->getSettingInMicrons("raft_interface_thickness"));
+        storage.raft_interface_config.init(train->getSettingInMillimetersPerSecond(SettingKey::raft_interface_speed), train->getSettingInMillimetersPerSecond(SettingKey::raft_interface_acceleration), train->getSettingInMillimetersPerSecond(SettingKey::raft_interface_jerk), train->getSettingInMicrons(SettingKey::raft_interface_line_width), train->getSettingInPercentage(SettingKey::material_flow));
+        storage.raft_interface_config.setLayerHeight(train->getSettingInMicrons(SettingKey::raft_interface_thickness));
 
-        storage.raft_surface_config.init(train->getSettingInMillimetersPerSecond("raft_surface_speed"), train->getSettingInMillimetersPerSecond("raft_surface_acceleration"), train->getSettingInMillimetersPerSecond("raft_surface_jerk"), train->getSettingInMicrons("raft_surface_line_width"), train->getSettingInPercentage("material_flow"));
-        storage.raft_surface_config.setLayerHeight(train->getSettingInMicrons("raft_surface_thickness"));
+        storage.raft_surface_config.init(train->getSettingInMillimetersPerSecond(SettingKey::raft_surface_speed), train->getSettingInMillimetersPerSecond(SettingKey::raft_surface_acceleration), train->getSettingInMillimetersPerSecond(SettingKey::raft_surface_jerk), train->getSettingInMicrons(SettingKey::raft_surface_line_width), train->getSettingInPercentage(SettingKey::material_flow));
+        storage.raft_surface_config.setLayerHeight(train->getSettingInMicrons(SettingKey::raft_surface_thickness));
     }
     
-    // some infill config for all lines infill generation below
-    int offset_from_poly_outline = 0;
-    double fill_overlap = 0; // raft line shouldn't be expanded - there is no boundary polygon printed
-    int extra_infill_shift = 0;
-    Polygons raft_polygons; // should remain empty, since we only have the lines pattern for the raft...
+    // the lines of the base layer, the interface layer and each surface layer only depend on the raft outline, so they are generated at once
+    std::vector<Polygons> raft_lines_per_layer(2 + std::max(0, n_raft_surface_layers));
+    ThreadPool::getInstance()->parallelFor(0, raft_lines_per_layer.size(), [&](int raft_layer_idx)
+    {
+        // some infill config for all lines infill generation below
+        int offset_from_poly_outline = 0;
+        double fill_overlap = 0; // raft line shouldn't be expanded - there is no boundary polygon printed
+        int extra_infill_shift = 0;
+        Polygons raft_polygons; // should remain empty, since we only have the lines pattern for the raft...
+
+        int z = train->getSettingInMicrons(SettingKey::raft_base_thickness);
+        if (raft_layer_idx == 0)
+        { // raft base layer
+            double fill_angle = 0;
+            Infill infill_comp(EFillMethod::LINES, storage.raftOutline, offset_from_poly_outline, storage.raft_base_config.getLineWidth(), train->getSettingInMicrons(SettingKey::raft_base_line_spacing), fill_overlap, fill_angle, z, extra_infill_shift);
+            infill_comp.generate(raft_polygons, raft_lines_per_layer[raft_layer_idx]);
+            return;
+        }
+        z += train->getSettingInMicrons(SettingKey::raft_interface_thickness);
+        if (raft_layer_idx == 1)
+        { // raft interface layer
+            double fill_angle = n_raft_surface_layers > 0 ? 45 : 90;
+            Infill infill_comp(EFillMethod::ZIG_ZAG, storage.raftOutline, offset_from_poly_outline, storage.raft_interface_config.getLineWidth(), train->getSettingInMicrons(SettingKey::raft_interface_line_spacing), fill_overlap, fill_angle, z, extra_infill_shift);
+            infill_comp.generate(raft_polygons, raft_lines_per_layer[raft_layer_idx]);
+            return;
+        }
+        // raft surface layers
+        int raftSurfaceLayer = raft_layer_idx - 1;
+        z += train->getSettingInMicrons(SettingKey::raft_surface_thickness) * raftSurfaceLayer;
+        double fill_angle = 90 * raftSurfaceLayer;
+        Infill infill_comp(EFillMethod::ZIG_ZAG, storage.raftOutline, offset_from_poly_outline, storage.raft_surface_config.getLineWidth(), train->getSettingInMicrons(SettingKey::raft_surface_line_spacing), fill_overlap, fill_angle, z, extra_infill_shift);
+        infill_comp.generate(raft_polygons, raft_lines_per_layer[raft_layer_idx]);
+    });
     
     { // raft base layer
         
         int layer_nr = -n_raft_surface_layers - 2;
-        int layer_height = train->getSettingInMicrons("raft_base_thickness");
+        int layer_height = train->getSettingInMicrons(SettingKey::raft_base_thickness);
         z += layer_height;
-        int64_t comb_offset = train->getSettingInMicrons("raft_base_line_spacing");
-        GCodePlanner& gcode_layer = layer_plan_buffer.emplace_back(storage, layer_nr, z, layer_height, last_position_planned, current_extruder_planned, is_inside_mesh_layer_part, fan_speed_layer_time_settings_per_extruder, combing_mode, comb_offset, train->getSettingBoolean("travel_avoid_other_parts"), train->getSettingInMicrons("travel_avoid_distance"));
+        int64_t comb_offset = train->getSettingInMicrons(SettingKey::raft_base_line_spacing);
+        GCodePlanner& gcode_layer = layer_plan_buffer.emplace_back(storage, layer_nr, z, layer_height, last_position_planned, current_extruder_planned, is_inside_mesh_layer_part, fan_speed_layer_time_settings_per_extruder, combing_mode, comb_offset, storage.travel_policy_per_extruder[extruder_nr].avoid_other_parts, storage.travel_policy_per_extruder[extruder_nr].avoid_distance);
         gcode_layer.setIsInside(true);
 
-        if (getSettingAsIndex("adhesion_extruder_nr") > 0)
+        if (getSettingAsIndex(SettingKey::adhesion_extruder_nr) > 0)
         {
             gcode_layer.setExtruder(extruder_nr);
         }
-        if (CommandSocket::isInstantiated())
+        if (context.command_socket)
         {
-            CommandSocket::getInstance()->sendOptimizedLayerInfo(layer_nr, z, layer_height);
+            context.command_socket->sendOptimizedLayerInfo(layer_nr, z, layer_height);
         }
         gcode_layer.addPolygonsByOptimizer(storage.raftOutline, &storage.raft_base_config);
 
-        Polygons raftLines;
-        double fill_angle = 0;
-        Infill infill_comp(EFillMethod::LINES, storage.raftOutline, offset_from_poly_outline, storage.raft_base_config.getLineWidth(), train->getSettingInMicrons("raft_base_line_spacing"), fill_overlap, fill_angle, z, extra_infill_shift);
-        infill_comp.generate(raft_polygons, raftLines);
-        gcode_layer.addLinesByOptimizer(raftLines, &storage.raft_base_config, SpaceFillType::Lines);
+        gcode_layer.addLinesByOptimizer(raft_lines_per_layer[0], &storage.raft_base_config, SpaceFillType::Lines);
 
         last_position_planned = gcode_layer.getLastPosition();
         current_extruder_planned = gcode_layer.getExtruder();
         is_inside_mesh_layer_part = gcode_layer.getIsInsideMesh();
 
         gcode_layer.processFanSpeedAndMinimalLayerTime();
-        gcode_layer.overrideFanSpeeds(train->getSettingInPercentage("raft_base_fan_speed"));
+        gcode_layer.overrideFanSpeeds(train->getSettingInPercentage(SettingKey::raft_base_fan_speed));
     }
 
     { // raft interface layer
         int layer_nr = -n_raft_surface_layers - 1;
-        int layer_height = train->getSettingInMicrons("raft_interface_thickness");
+        int layer_height = train->getSettingInMicrons(SettingKey::raft_interface_thickness);
         z += layer_height;
-        int64_t comb_offset = train->getSettingInMicrons("raft_interface_line_spacing");
-        GCodePlanner& gcode_layer = layer_plan_buffer.emplace_back(storage, layer_nr, z, layer_height, last_position_planned, current_extruder_planned, is_inside_mesh_layer_part, fan_speed_layer_time_settings_per_extruder, combing_mode, comb_offset, train->getSettingBoolean("travel_avoid_other_parts"), train->getSettingInMicrons("travel_avoid_distance"));
+        int64_t comb_offset = train->getSettingInMicrons(SettingKey::raft_interface_line_spacing);
+        GCodePlanner& gcode_layer = layer_plan_buffer.emplace_back(storage, layer_nr, z, layer_height, last_position_planned, current_extruder_planned, is_inside_mesh_layer_part, fan_speed_layer_time_settings_per_extruder, combing_mode, comb_offset, storage.travel_policy_per_extruder[extruder_nr].avoid_other_parts, storage.travel_policy_per_extruder[extruder_nr].avoid_distance);
         gcode_layer.setIsInside(true);
 
-        if (CommandSocket::isInstantiated())
+        if (context.command_socket)
         {
-            CommandSocket::getInstance()->sendOptimizedLayerInfo(layer_nr, z, layer_height);
+            context.command_socket->sendOptimizedLayerInfo(layer_nr, z, layer_height);
         }
         
-        Polygons raftLines;
-        int offset_from_poly_outline = 0;
-        double fill_angle = train->getSettingAsCount("raft_surface_layers") > 0 ? 45 : 90;
-        Infill infill_comp(EFillMethod::ZIG_ZAG, storage.raftOutline, offset_from_poly_outline, storage.raft_interface_config.getLineWidth(), train->getSettingInMicrons("raft_interface_line_spacing"), fill_overlap, fill_angle, z, extra_infill_shift);
-        infill_comp.generate(raft_polygons, raftLines);
-        gcode_layer.addLinesByOptimizer(raftLines, &storage.raft_interface_config, SpaceFillType::Lines);
+        gcode_layer.addLinesByOptimizer(raft_lines_per_layer[1], &storage.raft_interface_config, SpaceFillType::Lines);
         
         last_position_planned = gcode_layer.getLastPosition();
         current_extruder_planned = gcode_layer.getExtruder();
         is_inside_mesh_layer_part = gcode_layer.getIsInsideMesh();
 
         gcode_layer.processFanSpeedAndMinimalLayerTime();
-        gcode_layer.overrideFanSpeeds(train->getSettingInPercentage("raft_interface_fan_speed"));
+        gcode_layer.overrideFanSpeeds(train->getSettingInPercentage(SettingKey::raft_interface_fan_speed));
     }
     
-    int layer_height = train->getSettingInMicrons("raft_surface_thickness");
+    int layer_height = train->getSettingInMicrons(SettingKey::raft_surface_thickness);
 
     for (int raftSurfaceLayer=1; raftSurfaceLayer <= n_raft_surface_layers; raftSurfaceLayer++)
     { // raft surface layers
         int layer_nr = -n_raft_surface_layers + raftSurfaceLayer - 1;
         z += layer_height;
-        int64_t comb_offset = train->getSettingInMicrons("raft_surface_line_spacing");
-        GCodePlanner& gcode_layer = layer_plan_buffer.emplace_back(storage, layer_nr, z, layer_height, last_position_planned, current_extruder_planned, is_inside_mesh_layer_part, fan_speed_layer_time_settings_per_extruder, combing_mode, comb_offset, train->getSettingBoolean("travel_avoid_other_parts"), train->getSettingInMicrons("travel_avoid_distance"));
+        int64_t comb_offset = train->getSettingInMicrons(SettingKey::raft_surface_line_spacing);
+        GCodePlanner& gcode_layer = layer_plan_buffer.emplace_back(storage, layer_nr, z, layer_height, last_position_planned, current_extruder_planned, is_inside_mesh_layer_part, fan_speed_layer_time_settings_per_extruder, combing_mode, comb_offset, storage.travel_policy_per_extruder[extruder_nr].avoid_other_parts, storage.travel_policy_per_extruder[extruder_nr].avoid_distance);
         gcode_layer.setIsInside(true);
 
-        if (CommandSocket::isInstantiated())
+        if (context.command_socket)
         {
-            CommandSocket::getInstance()->sendOptimizedLayerInfo(layer_nr, z, layer_height);
+            context.command_socket->sendOptimizedLayerInfo(layer_nr, z, layer_height);
         }
         
-        Polygons raft_lines;
-        int offset_from_poly_outline = 0;
-        double fill_angle = 90 * raftSurfaceLayer;
-        Infill infill_comp(EFillMethod::ZIG_ZAG, storage.raftOutline, offset_from_poly_outline, storage.raft_surface_config.getLineWidth(), train->getSettingInMicrons("raft_surface_line_spacing"), fill_overlap, fill_angle, z, extra_infill_shift);
-        infill_comp.generate(raft_polygons, raft_lines);
-        gcode_layer.addLinesByOptimizer(raft_lines, &storage.raft_surface_config, SpaceFillType::Lines);
+        gcode_layer.addLinesByOptimizer(raft_lines_per_layer[raftSurfaceLayer + 1], &storage.raft_surface_config, SpaceFillType::Lines);
 
         last_position_planned = gcode_layer.getLastPosition();
         current_extruder_planned = gcode_layer.getExtruder();
         is_inside_mesh_layer_part = gcode_layer.getIsInsideMesh();
         
         gcode_layer.processFanSpeedAndMinimalLayerTime();
-        gcode_layer.overrideFanSpeeds(train->getSettingInPercentage("raft_surface_fan_speed"));
+        gcode_layer.overrideFanSpeeds(train->getSettingInPercentage(SettingKey::raft_surface_fan_speed));
     }
 }
 
 void FffGcodeWriter::processLayer(SliceDataStorage& storage, unsigned int layer_nr, unsigned int total_layers, bool has_raft)
 {
-    Progress::messageProgress(Progress::Stage::EXPORT, layer_nr+1, total_layers);
+    TRACE_SCOPE("FffGcodeWriter::processLayer", -1, layer_nr);
+    Progress::messageProgress(Progress::Stage::EXPORT, layer_nr+1, total_layers, context.command_socket);
     logDebug("GcodeWriter processing layer %i of %i\n", layer_nr, total_layers);
     
-    int layer_thickness = getSettingInMicrons("layer_height");
+    int layer_thickness = getSettingInMicrons(SettingKey::layer_height);
     if (layer_nr == 0)
     {
-        layer_thickness = getSettingInMicrons("layer_height_0");
+        layer_thickness = getSettingInMicrons(SettingKey::layer_height_0);
     }
 
     bool avoid_other_parts = false;
@@ -395,12 +555,11 @@ void FffGcodeWriter::processLayer(SliceDataStorage& storage, unsigned int layer_
     {
         if (gcode.getExtruderIsUsed(extr_nr))
         {
-            ExtruderTrain* extr = storage.meshgroup->getExtruderTrain(extr_nr);
-
-            if (extr->getSettingBoolean("travel_avoid_other_parts"))
+            const TravelConfig& travel_policy = storage.travel_policy_per_extruder[extr_nr];
+            if (travel_policy.avoid_other_parts)
             {
                 avoid_other_parts = true;
-                avoid_distance = std::max(avoid_distance, extr->getSettingInMicrons("travel_avoid_distance"));
+                avoid_distance = std::max(avoid_distance, travel_policy.avoid_distance);
             }
         }
     }
@@ -408,17 +567,17 @@ void FffGcodeWriter::processLayer(SliceDataStorage& storage, unsigned int layer_
     int max_inner_wall_width = 0;
     for (SettingsBaseVirtual& mesh_settings : storage.meshes)
     {
-        max_inner_wall_width = std::max(max_inner_wall_width, mesh_settings.getSettingInMicrons((mesh_settings.getSettingAsCount("wall_line_count") > 1) ? "wall_line_width_x" : "wall_line_width_0")); 
+        max_inner_wall_width = std::max(max_inner_wall_width, mesh_settings.getSettingInMicrons((mesh_settings.getSettingAsCount(SettingKey::wall_line_count) > 1) ? SettingKey::wall_line_width_x : SettingKey::wall_line_width_0)); 
     }
     int64_t comb_offset_from_outlines = max_inner_wall_width * 2;
 
     int64_t z = storage.meshes[0].layers[layer_nr].printZ;
 
-    GCodePlanner& gcode_layer = layer_plan_buffer.emplace_back(storage, layer_nr, z, layer_thickness, last_position_planned, current_extruder_planned, is_inside_mesh_layer_part, fan_speed_layer_time_settings_per_extruder, getSettingAsCombingMode("retraction_combing"), comb_offset_from_outlines, avoid_other_parts, avoid_distance);
+    GCodePlanner& gcode_layer = layer_plan_buffer.emplace_back(storage, layer_nr, z, layer_thickness, last_position_planned, current_extruder_planned, is_inside_mesh_layer_part, fan_speed_layer_time_settings_per_extruder, getSettingAsCombingMode(SettingKey::retraction_combing), comb_offset_from_outlines, avoid_other_parts, avoid_distance, std::move(comb_boundary_inside_per_layer[layer_nr]));
 
     if (layer_nr == 0)
     { // process the skirt or the brim of the starting extruder.
-        int extruder_nr = getSettingAsIndex("adhesion_extruder_nr");
+        int extruder_nr = getSettingAsIndex(SettingKey::adhesion_extruder_nr);
         if (storage.skirt_brim[extruder_nr].size() > 0)
         {
             gcode_layer.setExtruder(extruder_nr);
@@ -434,11 +593,11 @@ void FffGcodeWriter::processLayer(SliceDataStorage& storage, unsigned int layer_
     processDraftShield(storage, gcode_layer, layer_nr);
 
     //Figure out in which order to print the meshes, do this by looking at the current extruder and preferer the meshes that use that extruder.
-    std::vector<unsigned int> mesh_order = calculateMeshOrder(storage, gcode_layer.getExtruder());
+    const std::vector<unsigned int>& mesh_order = calculateMeshOrder(storage, gcode_layer.getExtruder());
     for(unsigned int mesh_idx : mesh_order)
     {
         SliceMeshStorage* mesh = &storage.meshes[mesh_idx];
-        if (mesh->getSettingAsSurfaceMode("magic_mesh_surface_mode") == ESurfaceMode::SURFACE)
+        if (mesh->getSettingAsSurfaceMode(SettingKey::magic_mesh_surface_mode) == ESurfaceMode::SURFACE)
         {
             addMeshLayerToGCode_meshSurfaceMode(storage, mesh, gcode_layer, layer_nr);
         }
@@ -503,16 +662,16 @@ void FffGcodeWriter::processDraftShield(SliceDataStorage& storage, GCodePlanner&
     {
         return;
     }
-    if (!getSettingBoolean("draft_shield_enabled"))
+    if (!getSettingBoolean(SettingKey::draft_shield_enabled))
     {
         return;
     }
 
-    if (getSettingAsDraftShieldHeightLimitation("draft_shield_height_limitation") == DraftShieldHeightLimitation::LIMITED)
+    if (getSettingAsDraftShieldHeightLimitation(SettingKey::draft_shield_height_limitation) == DraftShieldHeightLimitation::LIMITED)
     {
-        const int draft_shield_height = getSettingInMicrons("draft_shield_height");
-        const int layer_height_0 = getSettingInMicrons("layer_height_0");
-        const int layer_height = getSettingInMicrons("layer_height");
+        const int draft_shield_height = getSettingInMicrons(SettingKey::draft_shield_height);
+        const int layer_height_0 = getSettingInMicrons(SettingKey::layer_height_0);
+        const int layer_height = getSettingInMicrons(SettingKey::layer_height);
         const unsigned int max_screen_layer = (unsigned int)((draft_shield_height - layer_height_0) / layer_height + 1);
         if (layer_nr > max_screen_layer)
         {
@@ -523,9 +682,13 @@ void FffGcodeWriter::processDraftShield(SliceDataStorage& storage, GCodePlanner&
     gcode_layer.addPolygonsByOptimizer(storage.draft_protection_shield, &storage.skirt_brim_config[0]); //TODO: Skirt and brim configuration index should correspond to draft shield extruder number.
 }
 
-std::vector<unsigned int> FffGcodeWriter::calculateMeshOrder(SliceDataStorage& storage, int current_extruder)
+const std::vector<unsigned int>& FffGcodeWriter::calculateMeshOrder(SliceDataStorage& storage, int current_extruder)
 {
-    std::vector<unsigned int> ret;
+    std::vector<unsigned int>& ret = mesh_order_per_extruder[current_extruder];
+    if (!ret.empty())
+    {
+        return ret;
+    }
     std::list<unsigned int> add_list;
     for(unsigned int mesh_idx = 0; mesh_idx < storage.meshes.size(); mesh_idx++)
         add_list.push_back(mesh_idx);
@@ -535,7 +698,7 @@ std::vector<unsigned int> FffGcodeWriter::calculateMeshOrder(SliceDataStorage& s
     {
         for(auto add_it = add_list.begin(); add_it != add_list.end(); )
         {
-            if (storage.meshes[*add_it].getSettingAsIndex("extruder_nr") == add_extruder_nr)
+            if (storage.meshes[*add_it].getSettingAsIndex(SettingKey::extruder_nr) == add_extruder_nr)
             {
                 ret.push_back(*add_it);
                 add_it = add_list.erase(add_it);
@@ -546,7 +709,7 @@ std::vector<unsigned int> FffGcodeWriter::calculateMeshOrder(SliceDataStorage& s
             }
         }
         if (add_list.size() > 0)
-            add_extruder_nr = storage.meshes[*add_list.begin()].getSettingAsIndex("extruder_nr");
+            add_extruder_nr = storage.meshes[*add_list.begin()].getSettingAsIndex(SettingKey::extruder_nr);
     }
     return ret;
 }
@@ -558,7 +721,7 @@ void FffGcodeWriter::addMeshLayerToGCode_meshSurfaceMode(SliceDataStorage& stora
         return;
     }
     
-    setExtruder_addPrime(storage, gcode_layer, layer_nr, mesh->getSettingAsIndex("extruder_nr"));
+    setExtruder_addPrime(storage, gcode_layer, layer_nr, mesh->getSettingAsIndex(SettingKey::extruder_nr));
 
     SliceLayer* layer = &mesh->layers[layer_nr];
 
@@ -569,8 +732,8 @@ void FffGcodeWriter::addMeshLayerToGCode_meshSurfaceMode(SliceDataStorage& stora
         polygons.add(layer->parts[partNr].outline);
     }
 
-    EZSeamType z_seam_type = mesh->getSettingAsZSeamType("z_seam_type");
-    gcode_layer.addPolygonsByOptimizer(polygons, &mesh->inset0_config, nullptr, z_seam_type, mesh->getSettingBoolean("magic_spiralize"));
+    EZSeamType z_seam_type = mesh->getSettingAsZSeamType(SettingKey::z_seam_type);
+    gcode_layer.addPolygonsByOptimizer(polygons, &mesh->inset0_config, nullptr, z_seam_type, mesh->getSettingBoolean(SettingKey::magic_spiralize));
 
     addMeshOpenPolyLinesToGCode(storage, mesh, gcode_layer, layer_nr);
 }
@@ -584,16 +747,113 @@ void FffGcodeWriter::addMeshOpenPolyLinesToGCode(SliceDataStorage& storage, Slic
     {
         for(unsigned int point_idx = 1; point_idx<polyline.size(); point_idx++)
         {
-            Polygon p;
-            p.add(polyline[point_idx-1]);
-            p.add(polyline[point_idx]);
-            lines.add(p);
+            lines.addLine(polyline[point_idx-1], polyline[point_idx]);
         }
     }
     gcode_layer.addLinesByOptimizer(lines, &mesh->inset0_config, SpaceFillType::PolyLines);
     
 }
 
+void FffGcodeWriter::generatePathGeometry(SliceDataStorage& storage, unsigned int layer_nr)
+{
+    TRACE_SCOPE("FffGcodeWriter::generatePathGeometry", -1, layer_nr);
+    comb_boundary_inside_per_layer[layer_nr] = GCodePlanner::getCombBoundaryInside(storage, layer_nr, getSettingAsCombingMode(SettingKey::retraction_combing));
+    for (SliceMeshStorage& mesh : storage.meshes)
+    {
+        if (layer_nr >= mesh.layers.size() || static_cast<int>(layer_nr) > mesh.layer_nr_max_filled_layer
+            || mesh.getSettingAsSurfaceMode(SettingKey::magic_mesh_surface_mode) == ESurfaceMode::SURFACE)
+        {
+            continue;
+        }
+
+        EFillMethod infill_pattern = mesh.getSettingAsFillMethod(SettingKey::infill_pattern);
+        int infill_angle = 45;
+        if ((infill_pattern == EFillMethod::LINES || infill_pattern == EFillMethod::ZIG_ZAG))
+        {
+            unsigned int combined_infill_layers = std::max(1U, round_divide(mesh.getSettingInMicrons(SettingKey::infill_sparse_thickness), std::max(getSettingInMicrons(SettingKey::layer_height), 1)));
+            if ((layer_nr / combined_infill_layers) & 1)
+            { // switch every [combined_infill_layers] layers
+                infill_angle += 90;
+            }
+        }
+        int infill_line_distance = mesh.getSettingInMicrons(SettingKey::infill_line_distance);
+        int infill_overlap = mesh.getSettingInMicrons(SettingKey::infill_overlap_mm);
+
+        bool skin_alternate_rotation = mesh.getSettingBoolean(SettingKey::skin_alternate_rotation) && ( mesh.getSettingAsCount(SettingKey::top_layers) >= 4 || mesh.getSettingAsCount(SettingKey::bottom_layers) >= 4 );
+        EFillMethod skin_pattern = mesh.getSettingAsFillMethod(SettingKey::top_bottom_pattern);
+        int skin_angle = 45;
+        if ((skin_pattern == EFillMethod::LINES || skin_pattern == EFillMethod::ZIG_ZAG) && layer_nr & 1)
+        {
+            skin_angle += 90; // should coincide with infill_angle (if both skin and infill are lines) so that the first top layer is orthogonal to the last infill layer
+        }
+        if (skin_alternate_rotation && ( layer_nr / 2 ) & 1)
+            skin_angle -= 45;
+        int64_t skin_overlap = mesh.getSettingInMicrons(SettingKey::skin_overlap_mm);
+
+        for (SliceLayerPart& part : mesh.layers[layer_nr].parts)
+        {
+            part.releasePathGeometry(); // left over when the layer wasn't planned, e.g. when all its parts are too small for walls
+            if (infill_line_distance > 0)
+            {
+                part.infill_polygons_per_combine.resize(part.infill_area_per_combine_per_density[0].size());
+                part.infill_lines_per_combine.resize(part.infill_area_per_combine_per_density[0].size());
+            }
+            generateMultiLayerInfill(storage, &mesh, part, layer_nr, infill_line_distance, infill_overlap, infill_angle);
+            generateSingleLayerInfill(storage, &mesh, part, layer_nr, infill_line_distance, infill_overlap, infill_angle);
+            generateSkin(&mesh, part, layer_nr, skin_overlap, skin_angle);
+        }
+    }
+}
+
+const std::vector<int>& FffGcodeWriter::getPartOrder(unsigned int mesh_idx, const SliceLayer& layer, EZSeamType z_seam_type)
+{
+    std::vector<PartOrder>& recent_part_orders = recent_part_orders_per_mesh[mesh_idx];
+    if (z_seam_type != EZSeamType::RANDOM) // the random seams of the optimizer draw from the global random numbers, which must stay the same
+    {
+        for (unsigned int recent_idx = 0; recent_idx < recent_part_orders.size(); recent_idx++)
+        {
+            const PartOrder& part_order = recent_part_orders[recent_idx];
+            if (part_order.start_point != last_position_planned || part_order.outer_walls.size() != layer.parts.size())
+            {
+                continue;
+            }
+            bool same_walls = true;
+            for (unsigned int part_idx = 0; part_idx < layer.parts.size() && same_walls; part_idx++)
+            {
+                const PolygonRef recent_wall = part_order.outer_walls[part_idx];
+                const PolygonRef wall = layer.parts[part_idx].insets[0][0];
+                same_walls = recent_wall.size() == wall.size();
+                for (unsigned int point_idx = 0; point_idx < wall.size() && same_walls; point_idx++)
+                {
+                    same_walls = recent_wall[point_idx] == wall[point_idx];
+                }
+            }
+            if (same_walls)
+            {
+                std::rotate(recent_part_orders.begin(), recent_part_orders.begin() + recent_idx, recent_part_orders.begin() + recent_idx + 1);
+                return recent_part_orders.front().order;
+            }
+        }
+    }
+
+    PathOrderOptimizer part_order_optimizer(last_position_planned, z_seam_type);
+    PartOrder part_order;
+    part_order.start_point = last_position_planned;
+    for(unsigned int partNr=0; partNr<layer.parts.size(); partNr++)
+    {
+        part_order_optimizer.addPolygon(layer.parts[partNr].insets[0][0]);
+        part_order.outer_walls.add(layer.parts[partNr].insets[0][0]);
+    }
+    part_order_optimizer.optimize();
+    part_order.order = std::move(part_order_optimizer.polyOrder);
+    if (recent_part_orders.size() == part_orders_per_mesh)
+    {
+        recent_part_orders.pop_back();
+    }
+    recent_part_orders.insert(recent_part_orders.begin(), std::move(part_order));
+    return recent_part_orders.front().order;
+}
+
 void FffGcodeWriter::addMeshLayerToGCode(SliceDataStorage& storage, SliceMeshStorage* mesh, GCodePlanner& gcode_layer, int layer_nr)
 {
     if (layer_nr > mesh->layer_nr_max_filled_layer)
@@ -608,7 +868,7 @@ void FffGcodeWriter::addMeshLayerToGCode(SliceDataStorage& storage, SliceMeshSto
         return;
     }
 
-    if (mesh->getSettingAsCount("wall_line_count") > 0)
+    if (mesh->getSettingAsCount(SettingKey::wall_line_count) > 0)
     { // don't switch extruder if there's nothing to print
         bool empty = true;
         for (SliceLayerPart& part : layer->parts)
@@ -625,94 +885,59 @@ void FffGcodeWriter::addMeshLayerToGCode(SliceDataStorage& storage, SliceMeshSto
         }
     }
 
-    setExtruder_addPrime(storage, gcode_layer, layer_nr, mesh->getSettingAsIndex("extruder_nr"));
+    setExtruder_addPrime(storage, gcode_layer, layer_nr, mesh->getSettingAsIndex(SettingKey::extruder_nr));
 
-    EZSeamType z_seam_type = mesh->getSettingAsZSeamType("z_seam_type");
-    PathOrderOptimizer part_order_optimizer(last_position_planned, z_seam_type);
-    for(unsigned int partNr=0; partNr<layer->parts.size(); partNr++)
-    {
-        part_order_optimizer.addPolygon(layer->parts[partNr].insets[0][0]);
-    }
-    part_order_optimizer.optimize();
-
-    bool skin_alternate_rotation = mesh->getSettingBoolean("skin_alternate_rotation") && ( mesh->getSettingAsCount("top_layers") >= 4 || mesh->getSettingAsCount("bottom_layers") >= 4 );
-    
-    for(int order_idx : part_order_optimizer.polyOrder)
+    EZSeamType z_seam_type = mesh->getSettingAsZSeamType(SettingKey::z_seam_type);
+    for(int order_idx : getPartOrder(mesh - &storage.meshes[0], *layer, z_seam_type))
     {
         SliceLayerPart& part = layer->parts[order_idx];
 
-        EFillMethod infill_pattern = mesh->getSettingAsFillMethod("infill_pattern");
-        int infill_angle = 45;
-        if ((infill_pattern == EFillMethod::LINES || infill_pattern == EFillMethod::ZIG_ZAG))
-        {
-            unsigned int combined_infill_layers = std::max(1U, round_divide(mesh->getSettingInMicrons("infill_sparse_thickness"), std::max(getSettingInMicrons("layer_height"), 1)));
-            if ((layer_nr / combined_infill_layers) & 1)
-            { // switch every [combined_infill_layers] layers
-                infill_angle += 90;
-            }
-        }
-        
-        int infill_line_distance = mesh->getSettingInMicrons("infill_line_distance");
-        int infill_overlap = mesh->getSettingInMicrons("infill_overlap_mm");
-        
         gcode_layer.setIsInside(true); // going to print inside stuff below
         
-        if (mesh->getSettingBoolean("infill_before_walls"))
+        if (mesh->getSettingBoolean(SettingKey::infill_before_walls))
         {
-            processMultiLayerInfill(gcode_layer, mesh, part, layer_nr, infill_line_distance, infill_overlap, infill_angle);
-            processSingleLayerInfill(gcode_layer, mesh, part, layer_nr, infill_line_distance, infill_overlap, infill_angle);
+            processMultiLayerInfill(gcode_layer, mesh, part);
+            processSingleLayerInfill(gcode_layer, mesh, part);
         }
         
         processInsets(gcode_layer, mesh, part, layer_nr, z_seam_type);
 
-        if (!mesh->getSettingBoolean("infill_before_walls"))
+        if (!mesh->getSettingBoolean(SettingKey::infill_before_walls))
         {
-            processMultiLayerInfill(gcode_layer, mesh, part, layer_nr, infill_line_distance, infill_overlap, infill_angle);
-            processSingleLayerInfill(gcode_layer, mesh, part, layer_nr, infill_line_distance, infill_overlap, infill_angle);
+            processMultiLayerInfill(gcode_layer, mesh, part);
+            processSingleLayerInfill(gcode_layer, mesh, part);
         }
 
-        EFillMethod skin_pattern = mesh->getSettingAsFillMethod("top_bottom_pattern");
-        int skin_angle = 45;
-        if ((skin_pattern == EFillMethod::LINES || skin_pattern == EFillMethod::ZIG_ZAG) && layer_nr & 1)
-        {
-            skin_angle += 90; // should coincide with infill_angle (if both skin and infill are lines) so that the first top layer is orthogonal to the last infill layer
-        }
-        if (skin_alternate_rotation && ( layer_nr / 2 ) & 1)
-            skin_angle -= 45;
+        processSkin(gcode_layer, mesh, part);
 
-        int64_t skin_overlap = mesh->getSettingInMicrons("skin_overlap_mm");
-        processSkin(gcode_layer, mesh, part, layer_nr, skin_overlap, skin_angle);
+        part.releasePathGeometry(); // the layer plan holds its own copy of the paths
 
         //After a layer part, make sure the nozzle is inside the comb boundary, so we do not retract on the perimeter.
-        if (!mesh->getSettingBoolean("magic_spiralize") || static_cast<int>(layer_nr) < mesh->getSettingAsCount("bottom_layers"))
+        if (!mesh->getSettingBoolean(SettingKey::magic_spiralize) || static_cast<int>(layer_nr) < mesh->getSettingAsCount(SettingKey::bottom_layers))
         {
-            gcode_layer.moveInsideCombBoundary(mesh->getSettingInMicrons((mesh->getSettingAsCount("wall_line_count") > 1) ? "wall_line_width_x" : "wall_line_width_0") * 1);
+            gcode_layer.moveInsideCombBoundary(mesh->getSettingInMicrons((mesh->getSettingAsCount(SettingKey::wall_line_count) > 1) ? SettingKey::wall_line_width_x : SettingKey::wall_line_width_0) * 1);
         }
 
         gcode_layer.setIsInside(false);
     }
-    if (mesh->getSettingAsSurfaceMode("magic_mesh_surface_mode") != ESurfaceMode::NORMAL)
+    if (mesh->getSettingAsSurfaceMode(SettingKey::magic_mesh_surface_mode) != ESurfaceMode::NORMAL)
     {
         addMeshOpenPolyLinesToGCode(storage, mesh, gcode_layer, layer_nr);
     }
 }
 
-
-            
-
-
-void FffGcodeWriter::processMultiLayerInfill(GCodePlanner& gcode_layer, SliceMeshStorage* mesh, SliceLayerPart& part, unsigned int layer_nr, int infill_line_distance, int infill_overlap, int infill_angle)
+void FffGcodeWriter::generateMultiLayerInfill(SliceDataStorage& storage, SliceMeshStorage* mesh, SliceLayerPart& part, unsigned int layer_nr, int infill_line_distance, int infill_overlap, int infill_angle)
 {
-    int64_t z = layer_nr * getSettingInMicrons("layer_height");
+    int64_t z = layer_nr * getSettingInMicrons(SettingKey::layer_height);
     if (infill_line_distance > 0)
     {
-        //Print the thicker infill lines first. (double or more layer thickness, infill combined with previous layers)
+        //The thicker infill lines. (double or more layer thickness, infill combined with previous layers)
         for(unsigned int combine_idx = 1; combine_idx < part.infill_area_per_combine_per_density[0].size(); combine_idx++)
         {
             const unsigned int infill_line_width = mesh->infill_config[combine_idx].getLineWidth();
-            EFillMethod infill_pattern = mesh->getSettingAsFillMethod("infill_pattern");
-            Polygons infill_polygons;
-            Polygons infill_lines;
+            EFillMethod infill_pattern = mesh->getSettingAsFillMethod(SettingKey::infill_pattern);
+            Polygons& infill_polygons = part.infill_polygons_per_combine[combine_idx];
+            Polygons& infill_lines = part.infill_lines_per_combine[combine_idx];
             for (unsigned int density_idx = 0; density_idx < part.infill_area_per_combine_per_density.size(); density_idx++)
             { // combine different density infill areas (for gradual infill)
                 unsigned int density_factor = 2 << density_idx; // == pow(2, density_idx + 1)
@@ -723,16 +948,14 @@ void FffGcodeWriter::processMultiLayerInfill(GCodePlanner& gcode_layer, SliceMes
                     infill_line_distance_here /= 2;
                 }
                 
-                Infill infill_comp(infill_pattern, part.infill_area_per_combine_per_density[density_idx][combine_idx], 0, infill_line_width, infill_line_distance_here, infill_overlap, infill_angle, z, infill_shift, false, false);
-                infill_comp.generate(infill_polygons, infill_lines);
+                Infill infill_comp(infill_pattern, part.infill_area_per_combine_per_density[density_idx][combine_idx], 0, infill_line_width, infill_line_distance_here, infill_overlap, infill_angle, z, infill_shift, false, false, mesh->getSettingBoolean(SettingKey::concentric_from_outline));
+                storage.infill_cache.generate(infill_comp, infill_polygons, infill_lines);
             }
-            gcode_layer.addPolygonsByOptimizer(infill_polygons, &mesh->infill_config[combine_idx]);
-            gcode_layer.addLinesByOptimizer(infill_lines, &mesh->infill_config[combine_idx], (infill_pattern == EFillMethod::ZIG_ZAG)? SpaceFillType::PolyLines : SpaceFillType::Lines);
         }
     }
 }
 
-void FffGcodeWriter::processSingleLayerInfill(GCodePlanner& gcode_layer, SliceMeshStorage* mesh, SliceLayerPart& part, unsigned int layer_nr, int infill_line_distance, int infill_overlap, int infill_angle)
+void FffGcodeWriter::generateSingleLayerInfill(SliceDataStorage& storage, SliceMeshStorage* mesh, SliceLayerPart& part, unsigned int layer_nr, int infill_line_distance, int infill_overlap, int infill_angle)
 {
     if (infill_line_distance == 0 || part.infill_area_per_combine_per_density[0].size() == 0)
     {
@@ -741,12 +964,12 @@ void FffGcodeWriter::processSingleLayerInfill(GCodePlanner& gcode_layer, SliceMe
     const unsigned int infill_line_width = mesh->infill_config[0].getLineWidth();
         
     //Combine the 1 layer thick infill with the top/bottom skin and print that as one thing.
-    Polygons infill_polygons;
-    Polygons infill_lines;
+    Polygons& infill_polygons = part.infill_polygons_per_combine[0];
+    Polygons& infill_lines = part.infill_lines_per_combine[0];
 
-    int64_t z = layer_nr * getSettingInMicrons("layer_height");
+    int64_t z = layer_nr * getSettingInMicrons(SettingKey::layer_height);
 
-    EFillMethod pattern = mesh->getSettingAsFillMethod("infill_pattern");
+    EFillMethod pattern = mesh->getSettingAsFillMethod(SettingKey::infill_pattern);
     for (unsigned int density_idx = 0; density_idx < part.infill_area_per_combine_per_density.size(); density_idx++)
     {
         unsigned int density_factor = 2 << density_idx; // == pow(2, density_idx + 1)
@@ -779,13 +1002,35 @@ void FffGcodeWriter::processSingleLayerInfill(GCodePlanner& gcode_layer, SliceMe
 //     ^   highest density line dist
             infill_line_distance_here /= 2;
         }
-        Infill infill_comp(pattern, part.infill_area_per_combine_per_density[density_idx][0], 0, infill_line_width, infill_line_distance_here, infill_overlap, infill_angle, z, infill_shift, false, false);
-        infill_comp.generate(infill_polygons, infill_lines);
+        Infill infill_comp(pattern, part.infill_area_per_combine_per_density[density_idx][0], 0, infill_line_width, infill_line_distance_here, infill_overlap, infill_angle, z, infill_shift, false, false, mesh->getSettingBoolean(SettingKey::concentric_from_outline));
+        storage.infill_cache.generate(infill_comp, infill_polygons, infill_lines);
+    }
+}
+
+void FffGcodeWriter::processMultiLayerInfill(GCodePlanner& gcode_layer, SliceMeshStorage* mesh, SliceLayerPart& part)
+{
+    //Print the thicker infill lines first. (double or more layer thickness, infill combined with previous layers)
+    EFillMethod infill_pattern = mesh->getSettingAsFillMethod(SettingKey::infill_pattern);
+    for(unsigned int combine_idx = 1; combine_idx < part.infill_polygons_per_combine.size(); combine_idx++)
+    {
+        gcode_layer.addPolygonsByOptimizer(part.infill_polygons_per_combine[combine_idx], &mesh->infill_config[combine_idx]);
+        gcode_layer.addLinesByOptimizer(part.infill_lines_per_combine[combine_idx], &mesh->infill_config[combine_idx], (infill_pattern == EFillMethod::ZIG_ZAG)? SpaceFillType::PolyLines : SpaceFillType::Lines);
     }
+}
+
+void FffGcodeWriter::processSingleLayerInfill(GCodePlanner& gcode_layer, SliceMeshStorage* mesh, SliceLayerPart& part)
+{
+    if (part.infill_polygons_per_combine.size() == 0)
+    {
+        return;
+    }
+    Polygons& infill_polygons = part.infill_polygons_per_combine[0];
+    Polygons& infill_lines = part.infill_lines_per_combine[0];
+    EFillMethod pattern = mesh->getSettingAsFillMethod(SettingKey::infill_pattern);
     gcode_layer.addPolygonsByOptimizer(infill_polygons, &mesh->infill_config[0]);
     if (pattern == EFillMethod::GRID || pattern == EFillMethod::LINES || pattern == EFillMethod::TRIANGLES)
     {
-        gcode_layer.addLinesByOptimizer(infill_lines, &mesh->infill_config[0], SpaceFillType::Lines, mesh->getSettingInMicrons("infill_wipe_dist")); 
+        gcode_layer.addLinesByOptimizer(infill_lines, &mesh->infill_config[0], SpaceFillType::Lines, mesh->getSettingInMicrons(SettingKey::infill_wipe_dist)); 
     }
     else 
     {
@@ -795,18 +1040,18 @@ void FffGcodeWriter::processSingleLayerInfill(GCodePlanner& gcode_layer, SliceMe
 
 void FffGcodeWriter::processInsets(GCodePlanner& gcode_layer, SliceMeshStorage* mesh, SliceLayerPart& part, unsigned int layer_nr, EZSeamType z_seam_type)
 {
-    bool compensate_overlap_0 = mesh->getSettingBoolean("travel_compensate_overlapping_walls_0_enabled");
-    bool compensate_overlap_x = mesh->getSettingBoolean("travel_compensate_overlapping_walls_x_enabled");
-    if (mesh->getSettingAsCount("wall_line_count") > 0)
+    bool compensate_overlap_0 = mesh->getSettingBoolean(SettingKey::travel_compensate_overlapping_walls_0_enabled);
+    bool compensate_overlap_x = mesh->getSettingBoolean(SettingKey::travel_compensate_overlapping_walls_x_enabled);
+    if (mesh->getSettingAsCount(SettingKey::wall_line_count) > 0)
     {
         bool spiralize = false;
-        if (mesh->getSettingBoolean("magic_spiralize"))
+        if (mesh->getSettingBoolean(SettingKey::magic_spiralize))
         {
-            if (static_cast<int>(layer_nr) >= mesh->getSettingAsCount("bottom_layers"))
+            if (static_cast<int>(layer_nr) >= mesh->getSettingAsCount(SettingKey::bottom_layers))
             {
                 spiralize = true;
             }
-            if (static_cast<int>(layer_nr) == mesh->getSettingAsCount("bottom_layers") && part.insets.size() > 0)
+            if (static_cast<int>(layer_nr) == mesh->getSettingAsCount(SettingKey::bottom_layers) && part.insets.size() > 0)
             { // on the last normal layer first make the outer wall normally and then start a second outer wall from the same hight, but gradually moving upward
                 gcode_layer.addPolygonsByOptimizer(part.insets[0], &mesh->insetX_config, nullptr, EZSeamType::SHORTEST, false);
             }
@@ -822,7 +1067,7 @@ void FffGcodeWriter::processInsets(GCodePlanner& gcode_layer, SliceMeshStorage*
                 else
                 {
                     Polygons& outer_wall = part.insets[0];
-                    WallOverlapComputation wall_overlap_computation(outer_wall, mesh->getSettingInMicrons("wall_line_width_0"));
+                    WallOverlapComputation wall_overlap_computation(outer_wall, mesh->getSettingInMicrons(SettingKey::wall_line_width_0));
                     gcode_layer.addPolygonsByOptimizer(outer_wall, &mesh->inset0_config, &wall_overlap_computation, z_seam_type, spiralize);
                 }
             }
@@ -835,7 +1080,7 @@ void FffGcodeWriter::processInsets(GCodePlanner& gcode_layer, SliceMeshStorage*
                 else
                 {
                     Polygons& outer_wall = part.insets[inset_number];
-                    WallOverlapComputation wall_overlap_computation(outer_wall, mesh->getSettingInMicrons("wall_line_width_x"));
+                    WallOverlapComputation wall_overlap_computation(outer_wall, mesh->getSettingInMicrons(SettingKey::wall_line_width_x));
                     gcode_layer.addPolygonsByOptimizer(outer_wall, &mesh->insetX_config, &wall_overlap_computation);
                 }
             }
@@ -844,17 +1089,14 @@ void FffGcodeWriter::processInsets(GCodePlanner& gcode_layer, SliceMeshStorage*
 }
 
 
-void FffGcodeWriter::processSkin(GCodePlanner& gcode_layer, SliceMeshStorage* mesh, SliceLayerPart& part, unsigned int layer_nr, int skin_overlap, int skin_angle)
+void FffGcodeWriter::generateSkin(SliceMeshStorage* mesh, SliceLayerPart& part, unsigned int layer_nr, int skin_overlap, int skin_angle)
 {
-    int64_t z = layer_nr * getSettingInMicrons("layer_height");
+    int64_t z = layer_nr * getSettingInMicrons(SettingKey::layer_height);
     const unsigned int skin_line_width = mesh->skin_config.getLineWidth();
 
-    for(SkinPart& skin_part : part.skin_parts) // TODO: optimize parts order
+    for(SkinPart& skin_part : part.skin_parts)
     {
-        Polygons skin_polygons;
-        Polygons skin_lines;
-        
-        EFillMethod pattern = mesh->getSettingAsFillMethod("top_bottom_pattern");
+        EFillMethod pattern = mesh->getSettingAsFillMethod(SettingKey::top_bottom_pattern);
         int bridge = -1;
         if (layer_nr > 0)
             bridge = bridgeAngle(skin_part.outline, &mesh->layers[layer_nr-1]);
@@ -867,10 +1109,6 @@ void FffGcodeWriter::processSkin(GCodePlanner& gcode_layer, SliceMeshStorage* me
         int offset_from_inner_skin_outline = 0;
         if (pattern != EFillMethod::CONCENTRIC)
         {
-            for (Polygons& skin_perimeter : skin_part.insets)
-            {
-                gcode_layer.addPolygonsByOptimizer(skin_perimeter, &mesh->insetX_config); // add polygons to gcode in inward order
-            }
             if (skin_part.insets.size() > 0)
             {
                 inner_skin_outline = &skin_part.insets.back();
@@ -884,18 +1122,34 @@ void FffGcodeWriter::processSkin(GCodePlanner& gcode_layer, SliceMeshStorage* me
         }
 
         int extra_infill_shift = 0;
-        Infill infill_comp(pattern, *inner_skin_outline, offset_from_inner_skin_outline, skin_line_width, skin_line_width, skin_overlap, skin_angle, z, extra_infill_shift, false, false);
-        infill_comp.generate(skin_polygons, skin_lines);
+        Infill infill_comp(pattern, *inner_skin_outline, offset_from_inner_skin_outline, skin_line_width, skin_line_width, skin_overlap, skin_angle, z, extra_infill_shift, false, false, mesh->getSettingBoolean(SettingKey::concentric_from_outline));
+        infill_comp.generate(skin_part.fill_polygons, skin_part.fill_lines);
+        skin_part.fill_pattern = pattern;
+    }
+}
 
-        gcode_layer.addPolygonsByOptimizer(skin_polygons, &mesh->skin_config);
+void FffGcodeWriter::processSkin(GCodePlanner& gcode_layer, SliceMeshStorage* mesh, SliceLayerPart& part)
+{
+    for(SkinPart& skin_part : part.skin_parts) // TODO: optimize parts order
+    {
+        EFillMethod pattern = skin_part.fill_pattern;
+        if (pattern != EFillMethod::CONCENTRIC)
+        {
+            for (Polygons& skin_perimeter : skin_part.insets)
+            {
+                gcode_layer.addPolygonsByOptimizer(skin_perimeter, &mesh->insetX_config); // add polygons to gcode in inward order
+            }
+        }
+
+        gcode_layer.addPolygonsByOptimizer(skin_part.fill_polygons, &mesh->skin_config);
 
         if (pattern == EFillMethod::GRID || pattern == EFillMethod::LINES || pattern == EFillMethod::TRIANGLES)
         {
-            gcode_layer.addLinesByOptimizer(skin_lines, &mesh->skin_config, SpaceFillType::Lines, mesh->getSettingInMicrons("infill_wipe_dist"));
+            gcode_layer.addLinesByOptimizer(skin_part.fill_lines, &mesh->skin_config, SpaceFillType::Lines, mesh->getSettingInMicrons(SettingKey::infill_wipe_dist));
         }
         else
         {
-            gcode_layer.addLinesByOptimizer(skin_lines, &mesh->skin_config, (pattern == EFillMethod::ZIG_ZAG)? SpaceFillType::PolyLines : SpaceFillType::Lines);
+            gcode_layer.addLinesByOptimizer(skin_part.fill_lines, &mesh->skin_config, (pattern == EFillMethod::ZIG_ZAG)? SpaceFillType::PolyLines : SpaceFillType::Lines);
         }
     }
 }
@@ -905,8 +1159,8 @@ void FffGcodeWriter::addSupportToGCode(SliceDataStorage& storage, GCodePlanner&
     if (!storage.support.generated || layer_nr > storage.support.layer_nr_max_filled_layer)
         return; 
     
-    int support_skin_extruder_nr = getSettingAsIndex("support_interface_extruder_nr");
-    int support_infill_extruder_nr = (layer_nr == 0)? getSettingAsIndex("support_extruder_nr_layer_0") : getSettingAsIndex("support_infill_extruder_nr");
+    int support_skin_extruder_nr = getSettingAsIndex(SettingKey::support_interface_extruder_nr);
+    int support_infill_extruder_nr = (layer_nr == 0)? getSettingAsIndex(SettingKey::support_extruder_nr_layer_0) : getSettingAsIndex(SettingKey::support_infill_extruder_nr);
     
     bool print_support_before_rest = support_infill_extruder_nr == extruder_nr_before
                                     || support_skin_extruder_nr == extruder_nr_before;
@@ -951,15 +1205,15 @@ void FffGcodeWriter::addSupportInfillToGCode(SliceDataStorage& storage, GCodePla
         return;
     }
 
-    int64_t z = layer_nr * getSettingInMicrons("layer_height");
+    int64_t z = layer_nr * getSettingInMicrons(SettingKey::layer_height);
 
-    const ExtruderTrain& infill_extr = *storage.meshgroup->getExtruderTrain(getSettingAsIndex("support_infill_extruder_nr"));
-    int support_line_distance = infill_extr.getSettingInMicrons("support_line_distance"); // first layer line distance must be the same as the second layer line distance
+    const ExtruderTrain& infill_extr = *storage.meshgroup->getExtruderTrain(getSettingAsIndex(SettingKey::support_infill_extruder_nr));
+    int support_line_distance = infill_extr.getSettingInMicrons(SettingKey::support_line_distance); // first layer line distance must be the same as the second layer line distance
     const int support_line_width = storage.support_config.getLineWidth();
-    EFillMethod support_pattern = infill_extr.getSettingAsFillMethod("support_pattern"); // first layer pattern must be same as other layers
+    EFillMethod support_pattern = infill_extr.getSettingAsFillMethod(SettingKey::support_pattern); // first layer pattern must be same as other layers
     if (layer_nr == 0 && (support_pattern == EFillMethod::LINES || support_pattern == EFillMethod::ZIG_ZAG)) { support_pattern = EFillMethod::GRID; }
 
-    int infill_extruder_nr_here = (layer_nr == 0)? getSettingAsIndex("support_extruder_nr_layer_0") : getSettingAsIndex("support_infill_extruder_nr");
+    int infill_extruder_nr_here = (layer_nr == 0)? getSettingAsIndex(SettingKey::support_extruder_nr_layer_0) : getSettingAsIndex(SettingKey::support_infill_extruder_nr);
     const ExtruderTrain& infill_extr_here = *storage.meshgroup->getExtruderTrain(infill_extruder_nr_here);
 
     Polygons& support = storage.support.supportLayers[layer_nr].supportAreas;
@@ -989,14 +1243,14 @@ void FffGcodeWriter::addSupportInfillToGCode(SliceDataStorage& storage, GCodePla
                 gcode_layer.addPolygonsByOptimizer(boundary, &storage.support_config);
             }
             offset_from_outline = -support_line_width;
-            support_infill_overlap = infill_extr_here.getSettingInMicrons("infill_overlap_mm"); // support lines area should be expanded outward to overlap with the boundary polygon
+            support_infill_overlap = infill_extr_here.getSettingInMicrons(SettingKey::infill_overlap_mm); // support lines area should be expanded outward to overlap with the boundary polygon
         }
 
         int extra_infill_shift = 0;
-        Infill infill_comp(support_pattern, island, offset_from_outline, support_line_width, support_line_distance, support_infill_overlap, 0, z, extra_infill_shift, infill_extr.getSettingBoolean("support_connect_zigzags"), true);
+        Infill infill_comp(support_pattern, island, offset_from_outline, support_line_width, support_line_distance, support_infill_overlap, 0, z, extra_infill_shift, infill_extr.getSettingBoolean(SettingKey::support_connect_zigzags), true);
         Polygons support_polygons;
         Polygons support_lines;
-        infill_comp.generate(support_polygons, support_lines);
+        storage.support_infill_cache.generate(infill_comp, support_polygons, support_lines);
         if (support_lines.size() > 0 || support_polygons.size() > 0)
         {
             setExtruder_addPrime(storage, gcode_layer, layer_nr, infill_extruder_nr_here); // only switch extruder if we're sure we're going to switch
@@ -1015,20 +1269,20 @@ void FffGcodeWriter::addSupportRoofsToGCode(SliceDataStorage& storage, GCodePlan
         return;
     }
 
-    int64_t z = layer_nr * getSettingInMicrons("layer_height");
+    int64_t z = layer_nr * getSettingInMicrons(SettingKey::layer_height);
 
-    int skin_extruder_nr = getSettingAsIndex("support_interface_extruder_nr");
+    int skin_extruder_nr = getSettingAsIndex(SettingKey::support_interface_extruder_nr);
     const ExtruderTrain& interface_extr = *storage.meshgroup->getExtruderTrain(skin_extruder_nr);
     setExtruder_addPrime(storage, gcode_layer, layer_nr, skin_extruder_nr);
 
-    EFillMethod pattern = interface_extr.getSettingAsFillMethod("support_interface_pattern");
-    int support_line_distance = interface_extr.getSettingInMicrons("support_interface_line_distance");
+    EFillMethod pattern = interface_extr.getSettingAsFillMethod(SettingKey::support_interface_pattern);
+    int support_line_distance = interface_extr.getSettingInMicrons(SettingKey::support_interface_line_distance);
     
     
     bool all_roofs_are_low = true;
     for (SliceMeshStorage& mesh : storage.meshes)
     {
-        if (mesh.getSettingInMicrons("support_roof_height") >= 2 * getSettingInMicrons("layer_height"))
+        if (mesh.getSettingInMicrons(SettingKey::support_roof_height) >= 2 * getSettingInMicrons(SettingKey::layer_height))
         {
             all_roofs_are_low = false;
             break;
@@ -1087,56 +1341,65 @@ void FffGcodeWriter::setExtruder_addPrime(SliceDataStorage& storage, GCodePlanne
 void FffGcodeWriter::addPrimeTower(SliceDataStorage& storage, GCodePlanner& gcodeLayer, int layer_nr, int prev_extruder)
 {
     
-    if (!getSettingBoolean("prime_tower_enable"))
+    if (!getSettingBoolean(SettingKey::prime_tower_enable))
     {
         return;
     }
     
-    bool prime_tower_dir_outward = getSettingBoolean("prime_tower_dir_outward");
-    bool wipe = getSettingBoolean("prime_tower_wipe_enabled");
+    bool prime_tower_dir_outward = getSettingBoolean(SettingKey::prime_tower_dir_outward);
+    bool wipe = getSettingBoolean(SettingKey::prime_tower_wipe_enabled);
     
     storage.primeTower.addToGcode(storage, gcodeLayer, gcode, layer_nr, prev_extruder, prime_tower_dir_outward, wipe, last_prime_tower_poly_printed);
 }
 
 void FffGcodeWriter::finalize()
 {
-    if (CommandSocket::isInstantiated())
+    if (context.command_socket && !gcode.isEstimateOnly())
     {
         double print_time = gcode.getTotalPrintTime();
         std::vector<double> filament_used;
         std::vector<std::string> material_ids;
-        for (int extr_nr = 0; extr_nr < getSettingAsCount("machine_extruder_count"); extr_nr++)
+        for (int extr_nr = 0; extr_nr < getSettingAsCount(SettingKey::machine_extruder_count); extr_nr++)
         {
             filament_used.emplace_back(gcode.getTotalFilamentUsed(extr_nr));
             material_ids.emplace_back(gcode.getMaterialGUID(extr_nr));
         }
         std::string prefix = gcode.getFileHeader(&print_time, filament_used, material_ids);
-        CommandSocket::getInstance()->sendGCodePrefix(prefix);
+        context.command_socket->sendGCodePrefix(prefix);
     }
-    if (getSettingBoolean("acceleration_enabled"))
+    if (getSettingBoolean(SettingKey::acceleration_enabled))
     {
-        gcode.writeAcceleration(getSettingInMillimetersPerSecond("machine_acceleration"));
+        gcode.writeAcceleration(getSettingInMillimetersPerSecond(SettingKey::machine_acceleration));
     }
-    if (getSettingBoolean("jerk_enabled"))
+    if (getSettingBoolean(SettingKey::jerk_enabled))
     {
-        gcode.writeJerk(getSettingInMillimetersPerSecond("machine_max_jerk_xy"));
+        gcode.writeJerk(getSettingInMillimetersPerSecond(SettingKey::machine_max_jerk_xy));
     }
     if (gcode.getCurrentMaxZFeedrate() > 0)
     {
-        gcode.writeMaxZFeedrate(getSettingInMillimetersPerSecond("machine_max_feedrate_z"));
+        gcode.writeMaxZFeedrate(getSettingInMillimetersPerSecond(SettingKey::machine_max_feedrate_z));
     }
-    gcode.finalize(getSettingString("machine_end_gcode").c_str());
-    for (int e = 0; e < getSettingAsCount("machine_extruder_count"); e++)
+    gcode.finalize(getSettingString(SettingKey::machine_end_gcode).c_str());
+    for (int e = 0; e < getSettingAsCount(SettingKey::machine_extruder_count); e++)
     {
         gcode.writeTemperatureCommand(e, 0, false);
     }
 
     gcode.writeComment("End of Gcode");
+    if (!context.command_socket && getSettingBoolean(SettingKey::gcode_flush_per_layer))
+    { // the header was read before the totals were known, so they are given at the end; the front end gets the header with the totals instead
+        std::vector<double> filament_used;
+        for (int extr_nr = 0; extr_nr < getSettingAsCount(SettingKey::machine_extruder_count); extr_nr++)
+        {
+            filament_used.emplace_back(gcode.getTotalFilamentUsed(extr_nr));
+        }
+        gcode.writeCode(gcode.getFileTrailer(gcode.getTotalPrintTime(), filament_used).c_str());
+    }
     /*
     the profile string below can be executed since the M25 doesn't end the gcode on an UMO and when printing via USB.
     gcode.writeCode("M25 ;Stop reading from this point on.");
     gcode.writeComment("Cura profile string:");
-    gcode.writeComment(FffProcessor::getInstance()->getAllLocalSettingsString() + FffProcessor::getInstance()->getProfileString());
+    gcode.writeComment(context.processor->getAllLocalSettingsString() + context.processor->getProfileString());
     */
 }
 
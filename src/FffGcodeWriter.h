@@ -2,10 +2,12 @@
 #define GCODE_WRITER_H
 
 
-#include <fstream>
+#include <cstring> // strlen, strcmp
+#include <ostream>
 #include "utils/gettime.h"
 #include "utils/logoutput.h"
 #include "utils/NoCopy.h"
+#include "utils/OutputBuffer.h"
 #include "utils/polygonUtils.h"
 #include "sliceDataStorage.h"
 #include "raft.h"
@@ -21,6 +23,7 @@
 
 
 #include "LayerPlanBuffer.h"
+#include "SliceContext.h"
 
 
 namespace cura 
@@ -39,6 +42,8 @@ class FffGcodeWriter : public SettingsMessenger, NoCopy
 private:
     int max_object_height; //!< The maximal height of all previously sliced meshgroups, used to avoid collision when moving to the next meshgroup to print.
 
+    const SliceContext& context; //!< What the gcode is written for
+
     /*
      * Buffer for all layer plans (of type GCodePlanner)
      * 
@@ -54,10 +59,13 @@ private:
      */
     GCodeExport gcode;
 
+    FileOutputBuffer output_file_buffer; //!< Writes FffGcodeWriter::output_file to disk in large blocks
+    GzipOutputBuffer compressed_output_file_buffer; //!< Compresses FffGcodeWriter::output_file when it's written to a .gz file
+
     /*!
      * The gcode file to write to when using CuraEngine as command line tool.
      */
-    std::ofstream output_file;
+    std::ostream output_file;
 
     /*!
      * Layer number of the last layer in which a prime tower has been printed per extruder train.  
@@ -77,13 +85,55 @@ private:
     Point last_position_planned; //!< The position of the head before planning the next layer
     int current_extruder_planned; //!< The extruder train in use before planning the next layer
     bool is_inside_mesh_layer_part; //!< Whether the last position was inside a layer part (used in combing)
+
+    int layer_range_first; //!< The first layer of which to write the gcode, see FffGcodeWriter::setLayerRange
+    int layer_range_last; //!< The last layer of which to write the gcode, or -1 to write up to the top layer
+
+    std::vector<std::shared_ptr<CombBoundaryInside>> comb_boundary_inside_per_layer; //!< The comb boundaries obtained by FffGcodeWriter::generatePathGeometry for the layers which haven't been planned yet
+
+    std::vector<std::vector<unsigned int>> mesh_order_per_extruder; //!< The result of FffGcodeWriter::calculateMeshOrder for each extruder, empty until it's first needed
+
+    /*!
+     * The order in which the parts of a mesh were printed in a recent layer.
+     * 
+     * The order only depends on the outer walls of the parts and on where the head was before the mesh,
+     * so when both are the same in a later layer, the order is the same too.
+     * This is common for prismatic models, where the head often returns to the same position every other layer because the infill alternates direction.
+     */
+    struct PartOrder
+    {
+        Point start_point; //!< Where the head was before the parts were printed
+        Polygons outer_walls; //!< The outermost wall of each part, in the order of the parts in the layer
+        std::vector<int> order; //!< The order of the parts, as indices into the parts of the layer
+    };
+    static constexpr unsigned int part_orders_per_mesh = 2; //!< How many layers back a part order can be reused
+    std::vector<std::vector<PartOrder>> recent_part_orders_per_mesh; //!< For each mesh, the part orders of the most recent layers, most recent first
+
+    /*!
+     * Get the order in which to print the parts of a layer of a mesh, starting from FffGcodeWriter::last_position_planned.
+     * 
+     * \param mesh_idx The index of the mesh, for FffGcodeWriter::recent_part_orders_per_mesh
+     * \param layer The layer of the mesh
+     * \param z_seam_type The seam type of the mesh, which is used by the PathOrderOptimizer
+     * 
+eturn The indices of the parts of \p layer in the order in which to print them
+     */
+    const std::vector<int>& getPartOrder(unsigned int mesh_idx, const SliceLayer& layer, EZSeamType z_seam_type);
 public:
-    FffGcodeWriter(SettingsBase* settings_)
+    /*!
+     * \param settings_ The settings to start from, which are replaced by those of each mesh group processed
+     * \param context What the gcode is written for, which should outlive this object
+     */
+    FffGcodeWriter(SettingsBase* settings_, const SliceContext& context)
     : SettingsMessenger(settings_)
-    , layer_plan_buffer(this, gcode)
+    , context(context)
+    , layer_plan_buffer(context, this, gcode)
+    , output_file(&output_file_buffer)
     , last_position_planned(no_point)
     , current_extruder_planned(0) // changed somewhere early in FffGcodeWriter::writeGCode
     , is_inside_mesh_layer_part(false)
+    , layer_range_first(0)
+    , layer_range_last(-1)
     {
         max_object_height = 0;
     }
@@ -97,15 +147,31 @@ public:
      */
     bool setTargetFile(const char* filename)
     {
-        output_file.open(filename);
-        if (output_file.is_open())
+        const size_t filename_length = strlen(filename);
+        const bool compress = filename_length >= 3 && strcmp(filename + filename_length - 3, ".gz") == 0;
+        std::streambuf* buffer = compress ? static_cast<std::streambuf*>(&compressed_output_file_buffer) : &output_file_buffer;
+        if (compress ? compressed_output_file_buffer.open(filename) : output_file_buffer.open(filename))
         {
+            output_file.rdbuf(buffer);
             gcode.setOutputStream(&output_file);
             return true;
         }
         return false;
     }
 
+    /*!
+     * Set whether gzip compressed gcode files are compressed with a small window,
+     * so that printers with little memory can decompress them while printing.
+     * 
+     * Has to be called before any gcode is written.
+     * 
+     * \param low_memory Whether to use a small window
+     */
+    void setLowMemoryCompression(bool low_memory)
+    {
+        compressed_output_file_buffer.setWindowBits(low_memory ? GzipOutputBuffer::low_memory_window_bits : GzipOutputBuffer::default_window_bits);
+    }
+
     /*!
      * Set the target to write gcode to: an output stream.
      * 
@@ -118,6 +184,34 @@ public:
         gcode.setOutputStream(stream);
     }
 
+    /*!
+     * Set whether only the print time and material estimates are computed, without writing any gcode.
+     * 
+     * \param estimate_only Whether to skip writing the gcode
+     */
+    void setEstimateOnly(bool estimate_only)
+    {
+        gcode.setEstimateOnly(estimate_only);
+    }
+
+    /*!
+     * Set the layers of which to write the gcode, so that a print can be planned by several processes which each write a range of layers.
+     * 
+     * The gcode of the layers in the range is written between a ;LAYER_RANGE_START and a ;LAYER_RANGE_END comment,
+     * so that tests/distributed_slice.py can stitch the ranges together.
+     * The start gcode before and the end gcode after those comments are written as usual.
+     * A range which doesn't start at the first layer begins by selecting and heating the extruder it starts with,
+     * assuming the nozzle was left retracted by the range below it.
+     * 
+     * \param first The first layer to write
+     * \param last The last layer to write, or -1 to write up to the top layer
+     */
+    void setLayerRange(int first, int last)
+    {
+        layer_range_first = first;
+        layer_range_last = last;
+    }
+
     /*!
      * Get the total extruded volume for a specific extruder in mm^3
      * 
@@ -147,8 +241,9 @@ public:
      * 
      * \param[in] storage The data storage from which to get the polygons to print and the areas to fill.
      * \param timeKeeper The stop watch to see how long it takes for each of the stages in the slicing process.
+     * \param release_layers Whether to free the areas of each layer once its gcode and that of the layer above it has been planned, when the storage isn't reused afterwards.
      */
-    void writeGCode(SliceDataStorage& storage, TimeKeeper& timeKeeper);
+    void writeGCode(SliceDataStorage& storage, TimeKeeper& timeKeeper, bool release_layers);
 
 private:
     /*!
@@ -171,6 +266,13 @@ private:
      * \param[out] storage The data storage to which to save the configurations
      */
     void setConfigRetraction(SliceDataStorage& storage);
+
+    /*!
+     * Create and set the SliceDataStorage::travel_policy_per_extruder for each extruder.
+     * 
+     * \param[out] storage The data storage to which to save the configurations
+     */
+    void setConfigTravel(SliceDataStorage& storage);
     
     /*!
      * Initialize the GcodePathConfig config parameters which don't change over
@@ -198,6 +300,13 @@ private:
      * \param[in] storage where the slice data is stored.
      */
     void processNextMeshGroupCode(SliceDataStorage& storage);
+
+    /*!
+     * Pick up the print where the process which wrote the layers below FffGcodeWriter::layer_range_first left it.
+     * 
+     * \param storage where the slice data is stored.
+     */
+    void processLayerRangeStart(SliceDataStorage& storage);
     
     /*!
      * Add raft layer plans onto the FffGcodeWriter::layer_plan_buffer
@@ -248,11 +357,13 @@ private:
     /*!
      * Calculate in which order to print the meshes.
      * 
+     * The order only depends on the extruder, so it's computed once per extruder for the whole mesh group.
+     * 
      * \param[in] storage where the slice data is stored.
      * \param current_extruder The current extruder with which we last printed
      * \return A vector of mesh indices ordered on print order.
      */
-    std::vector<unsigned int> calculateMeshOrder(SliceDataStorage& storage, int current_extruder);
+    const std::vector<unsigned int>& calculateMeshOrder(SliceDataStorage& storage, int current_extruder);
         
     /*!
      * Add a single layer from a single mesh-volume to the layer plan \p gcodeLayer in mesh surface mode.
@@ -276,6 +387,20 @@ private:
      */
     void addMeshOpenPolyLinesToGCode(SliceDataStorage& storage, SliceMeshStorage* mesh, GCodePlanner& gcode_layer, int layer_nr);
     
+    /*!
+     * Generate the infill and skin lines of all layer parts of a single layer, which the layer plan of the layer is made of,
+     * and obtain the boundary within which the layer plan combs.
+     * 
+     * This only depends on the sliced data and not on the state of the planning,
+     * so that the path geometry of a number of layers is generated in parallel before they are planned.
+     * The paths are stored in the layer parts until FffGcodeWriter::addMeshLayerToGCode has added them to the layer plan,
+     * and the comb boundary in FffGcodeWriter::comb_boundary_inside_per_layer until the layer plan is made.
+     * 
+     * \param[in] storage where the slice data is stored.
+     * \param layer_nr The index of the layer to generate the paths of.
+     */
+    void generatePathGeometry(SliceDataStorage& storage, unsigned int layer_nr);
+    
     /*!
      * Add a single layer from a single mesh-volume to the layer plan \p gcodeLayer.
      * 
@@ -288,29 +413,47 @@ private:
     void addMeshLayerToGCode(SliceDataStorage& storage, SliceMeshStorage* mesh, GCodePlanner& gcodeLayer, int layer_nr);
     
     /*!
-     * Add thicker (multiple layers) sparse infill for a given part in a layer plan.
+     * Generate the thicker (multiple layers) sparse infill for a given part in a layer.
      * 
-     * \param gcodeLayer The initial planning of the gcode of the layer.
-     * \param mesh The mesh for which to add to the layer plan \p gcodeLayer.
-     * \param part The part for which to create gcode
+     * \param storage The storage, of which the infill cache is used to generate the infill.
+     * \param mesh The mesh of which to generate the infill.
+     * \param part The part for which to generate the infill, into SliceLayerPart::infill_polygons_per_combine and SliceLayerPart::infill_lines_per_combine
      * \param layer_nr The current layer number.
      * \param infill_line_distance The distance between the infill lines
      * \param infill_overlap The distance by which the infill overlaps with the wall insets.
      * \param fillAngle The angle in the XY plane at which the infill is generated.
      */
-    void processMultiLayerInfill(GCodePlanner& gcodeLayer, SliceMeshStorage* mesh, SliceLayerPart& part, unsigned int layer_nr, int infill_line_distance, int infill_overlap, int fillAngle); 
+    void generateMultiLayerInfill(SliceDataStorage& storage, SliceMeshStorage* mesh, SliceLayerPart& part, unsigned int layer_nr, int infill_line_distance, int infill_overlap, int fillAngle);
     
     /*!
-     * Add normal sparse infill for a given part in a layer.
-     * \param gcodeLayer The initial planning of the gcode of the layer.
-     * \param mesh The mesh for which to add to the layer plan \p gcodeLayer.
-     * \param part The part for which to create gcode
+     * Generate the normal sparse infill for a given part in a layer.
+     * 
+     * \param storage The storage, of which the infill cache is used to generate the infill.
+     * \param mesh The mesh of which to generate the infill.
+     * \param part The part for which to generate the infill, into the first element of SliceLayerPart::infill_polygons_per_combine and SliceLayerPart::infill_lines_per_combine
      * \param layer_nr The current layer number.
      * \param infill_line_distance The distance between the infill lines
      * \param infill_overlap The distance by which the infill overlaps with the wall insets.
      * \param fillAngle The angle in the XY plane at which the infill is generated.
      */
-    void processSingleLayerInfill(GCodePlanner& gcodeLayer, SliceMeshStorage* mesh, SliceLayerPart& part, unsigned int layer_nr, int infill_line_distance, int infill_overlap, int fillAngle);
+    void generateSingleLayerInfill(SliceDataStorage& storage, SliceMeshStorage* mesh, SliceLayerPart& part, unsigned int layer_nr, int infill_line_distance, int infill_overlap, int fillAngle);
+    
+    /*!
+     * Add thicker (multiple layers) sparse infill for a given part in a layer plan.
+     * 
+     * \param gcodeLayer The initial planning of the gcode of the layer.
+     * \param mesh The mesh for which to add to the layer plan \p gcodeLayer.
+     * \param part The part for which to create gcode, of which the infill has been generated by FffGcodeWriter::generateMultiLayerInfill
+     */
+    void processMultiLayerInfill(GCodePlanner& gcodeLayer, SliceMeshStorage* mesh, SliceLayerPart& part);
+    
+    /*!
+     * Add normal sparse infill for a given part in a layer.
+     * \param gcodeLayer The initial planning of the gcode of the layer.
+     * \param mesh The mesh for which to add to the layer plan \p gcodeLayer.
+     * \param part The part for which to create gcode, of which the infill has been generated by FffGcodeWriter::generateSingleLayerInfill
+     */
+    void processSingleLayerInfill(GCodePlanner& gcodeLayer, SliceMeshStorage* mesh, SliceLayerPart& part);
     
     /*!
      * Generate the insets for the walls of a given layer part.
@@ -323,16 +466,23 @@ private:
     void processInsets(GCodePlanner& gcodeLayer, SliceMeshStorage* mesh, SliceLayerPart& part, unsigned int layer_nr, EZSeamType z_seam_type);
     
     
+    /*!
+     * Generate the top/bottom skin lines of the given part, into SkinPart::fill_polygons and SkinPart::fill_lines of its skin parts.
+     * \param mesh The mesh of which to generate the skin.
+     * \param part The part for which to generate the skin
+     * \param layer_nr The current layer number.
+     * \param skin_overlap The distance by which the skin overlaps with the wall insets.
+     * \param skin_angle The angle in the XY plane at which the skin is generated, where it isn't bridging.
+     */
+    void generateSkin(SliceMeshStorage* mesh, SliceLayerPart& part, unsigned int layer_nr, int skin_overlap, int skin_angle);
+    
     /*!
      * Add the gcode of the top/bottom skin of the given part.
      * \param gcodeLayer The initial planning of the gcode of the layer.
      * \param mesh The mesh for which to add to the layer plan \p gcodeLayer.
-     * \param part The part for which to create gcode
-     * \param layer_nr The current layer number.
-     * \param skin_overlap The distance by which the skin overlaps with the wall insets.
-     * \param fillAngle The angle in the XY plane at which the infill is generated.
+     * \param part The part for which to create gcode, of which the skin has been generated by FffGcodeWriter::generateSkin
      */
-    void processSkin(cura::GCodePlanner& gcode_layer, cura::SliceMeshStorage* mesh, cura::SliceLayerPart& part, unsigned int layer_nr, int skin_overlap, int infill_angle);
+    void processSkin(GCodePlanner& gcode_layer, SliceMeshStorage* mesh, SliceLayerPart& part);
     
     /*!
      * Add the support to the layer plan \p gcodeLayer of the current layer.
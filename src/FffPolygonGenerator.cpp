@@ -1,12 +1,20 @@
 #include "FffPolygonGenerator.h"
 
 #include <algorithm>
+#include <cmath> // abs
 #include <map> // multimap (ordered map allowing duplicate keys)
+#include <mutex>
 
 #include "utils/math.h"
 #include "slicer.h"
+#include "SliceCache.h"
+#include "utils/CounterRandom.h"
 #include "utils/gettime.h"
+#include "utils/LayerArena.h"
 #include "utils/logoutput.h"
+#include "utils/TaskGraph.h"
+#include "utils/ThreadPool.h"
+#include "utils/Trace.h"
 #include "MeshGroup.h"
 #include "support.h"
 #include "multiVolumes.h"
@@ -17,61 +25,121 @@
 #include "infill.h"
 #include "raft.h"
 #include "progress/Progress.h"
+#include "progress/ProfilingReport.h"
+#include "progress/SlowLayerCapture.h"
 #include "PrintFeature.h"
 #include "ConicalOverhang.h"
-#include "progress/ProgressEstimator.h"
-#include "progress/ProgressStageEstimator.h"
-#include "progress/ProgressEstimatorLinear.h"
 
 
 namespace cura
 {
 
 
-bool FffPolygonGenerator::generateAreas(SliceDataStorage& storage, MeshGroup* meshgroup, TimeKeeper& timeKeeper)
+bool FffPolygonGenerator::generateAreas(SliceDataStorage& storage, MeshGroup* meshgroup, TimeKeeper& timeKeeper, bool use_slice_cache)
 {
-    if (!sliceModel(meshgroup, timeKeeper, storage)) 
+    if (!sliceModel(meshgroup, timeKeeper, storage, use_slice_cache)) 
     {
         return false;
     }
     
     slices2polygons(storage, timeKeeper);
     
-    return true;
+    return !context.isCancelled();
 }
 
 unsigned int FffPolygonGenerator::getDraftShieldHeight(const unsigned int total_layers) const
 {
-    if (!getSettingBoolean("draft_shield_enabled"))
+    if (!getSettingBoolean(SettingKey::draft_shield_enabled))
     {
         return 0;
     }
-    switch (getSettingAsDraftShieldHeightLimitation("draft_shield_height_limitation"))
+    switch (getSettingAsDraftShieldHeightLimitation(SettingKey::draft_shield_height_limitation))
     {
         default:
         case DraftShieldHeightLimitation::FULL:
             return total_layers;
         case DraftShieldHeightLimitation::LIMITED:
-            return getSettingInMicrons("draft_shield_height");
+            return getSettingInMicrons(SettingKey::draft_shield_height);
     }
 }
 
-bool FffPolygonGenerator::sliceModel(MeshGroup* meshgroup, TimeKeeper& timeKeeper, SliceDataStorage& storage) /// slices the model
+std::vector<int> FffPolygonGenerator::findMeshCopies(const MeshGroup& meshgroup, std::vector<Point>& copy_offsets) const
 {
-    Progress::messageProgressStage(Progress::Stage::SLICING, &timeKeeper);
+    const unsigned int mesh_count = meshgroup.meshes.size();
+    std::vector<int> copy_of_mesh_idx(mesh_count, -1);
+    copy_offsets.assign(mesh_count, Point(0, 0));
+
+    std::vector<AABB3D> boxes;
+    std::vector<int> margins; // how far the outlines of a mesh can reach beyond its bounding box to interact with other meshes
+    for (const Mesh& mesh : meshgroup.meshes)
+    {
+        boxes.push_back(mesh.getAABB());
+        margins.push_back(std::abs(mesh.getSettingInMicrons(SettingKey::xy_offset)) + std::max(0, mesh.getSettingInMicrons(SettingKey::multiple_mesh_overlap)));
+    }
+    std::vector<bool> is_isolated(mesh_count, true);
+    for (unsigned int mesh_idx = 0; mesh_idx < mesh_count; mesh_idx++)
+    {
+        if (meshgroup.meshes[mesh_idx].getSettingBoolean(SettingKey::infill_mesh))
+        {
+            is_isolated[mesh_idx] = false;
+            continue;
+        }
+        for (unsigned int other_mesh_idx = 0; other_mesh_idx < mesh_count; other_mesh_idx++)
+        {
+            AABB3D box = boxes[mesh_idx];
+            box.expandXY(margins[mesh_idx] + margins[other_mesh_idx]);
+            if (other_mesh_idx != mesh_idx && box.hit(boxes[other_mesh_idx]))
+            {
+                is_isolated[mesh_idx] = false;
+                break;
+            }
+        }
+    }
+
+    const std::vector<std::string> placement_keys = { toString(SettingKey::mesh_position_x), toString(SettingKey::mesh_position_y), toString(SettingKey::mesh_position_z) }; // already applied to the vertices
+    std::vector<unsigned int> originals;
+    for (unsigned int mesh_idx = 0; mesh_idx < mesh_count; mesh_idx++)
+    {
+        if (!is_isolated[mesh_idx])
+        {
+            continue;
+        }
+        const Mesh& mesh = meshgroup.meshes[mesh_idx];
+        for (unsigned int original_idx : originals)
+        {
+            const Mesh& original = meshgroup.meshes[original_idx];
+            Point3 offset;
+            if (mesh.hasSameSettings(original, placement_keys) && mesh.isTranslatedCopyOf(original, offset))
+            {
+                copy_of_mesh_idx[mesh_idx] = original_idx;
+                copy_offsets[mesh_idx] = Point(offset.x, offset.y);
+                break;
+            }
+        }
+        if (copy_of_mesh_idx[mesh_idx] < 0)
+        {
+            originals.push_back(mesh_idx);
+        }
+    }
+    return copy_of_mesh_idx;
+}
+
+bool FffPolygonGenerator::sliceModel(MeshGroup* meshgroup, TimeKeeper& timeKeeper, SliceDataStorage& storage, bool use_slice_cache) /// slices the model
+{
+    Progress::messageProgressStage(Progress::Stage::SLICING, &timeKeeper, context.command_socket);
     
     storage.model_min = meshgroup->min();
     storage.model_max = meshgroup->max();
     storage.model_size = storage.model_max - storage.model_min;
 
     log("Slicing model...\n");
-    int initial_layer_thickness = getSettingInMicrons("layer_height_0");
+    int initial_layer_thickness = getSettingInMicrons(SettingKey::layer_height_0);
     if(initial_layer_thickness <= 0) //Initial layer height of 0 is not allowed. Negative layer height is nonsense.
     {
         logError("Initial layer height %i is disallowed.\n", initial_layer_thickness);
         return false;
     }
-    int layer_thickness = getSettingInMicrons("layer_height");
+    int layer_thickness = getSettingInMicrons(SettingKey::layer_height);
     if(layer_thickness <= 0) //Layer height of 0 is not allowed. Negative layer height is nonsense.
     {
         logError("Layer height %i is disallowed.\n", layer_thickness);
@@ -84,12 +152,64 @@ bool FffPolygonGenerator::sliceModel(MeshGroup* meshgroup, TimeKeeper& timeKeepe
         return true; //This is NOT an error state!
     }
 
-    std::vector<Slicer*> slicerList;
-    for(unsigned int mesh_idx = 0; mesh_idx < meshgroup->meshes.size(); mesh_idx++)
+    // the copies of a mesh aren't sliced, but get the layers of the original once its walls, skin and infill are computed
+    std::vector<Point> copy_offsets;
+    const std::vector<int> copy_of_mesh_idx = findMeshCopies(*meshgroup, copy_offsets);
+    const unsigned int copy_count = meshgroup->meshes.size() - std::count(copy_of_mesh_idx.begin(), copy_of_mesh_idx.end(), -1);
+    if (copy_count > 0)
+    {
+        log("%i meshes are copies of other meshes.\n", copy_count);
+    }
+
+    // the meshes are sliced independently of each other, so they are sliced at the same time, each with its own layers in parallel
+    const unsigned int mesh_count = meshgroup->meshes.size();
+    std::vector<Slicer*> slicerList(mesh_count, nullptr);
+    if (mesh_count > 0)
+    {
+        ProfilingReport::getInstance().getMesh(mesh_count - 1); // allocate the profiles of all meshes up front, so that the references to them stay valid
+    }
+    // the progress of slicing is the part of all faces which has been sliced, since the time to slice a mesh mostly depends on its number of faces
+    size_t total_face_count = 0;
+    for (const Mesh& mesh : meshgroup->meshes)
     {
+        total_face_count += mesh.faces.size();
+    }
+    std::mutex progress_mutex;
+    size_t sliced_face_count = 0;
+    ThreadPool::getInstance()->parallelFor(0, mesh_count, [&](int mesh_idx)
+    {
+        if (context.isCancelled())
+        {
+            return;
+        }
         Mesh& mesh = meshgroup->meshes[mesh_idx];
-        Slicer* slicer = new Slicer(&mesh, initial_slice_z, layer_thickness, slice_layer_count, mesh.getSettingBoolean("meshfix_keep_open_polygons"), mesh.getSettingBoolean("meshfix_extensive_stitching"));
-        slicerList.push_back(slicer);
+        ProfilingReport::MeshProfile& mesh_profile = ProfilingReport::getInstance().getMesh(mesh_idx);
+        mesh_profile.face_count = mesh.faces.size();
+        mesh_profile.vertex_count = mesh.vertices.size();
+        if (copy_of_mesh_idx[mesh_idx] < 0)
+        {
+            TimeKeeper slice_timer;
+            TRACE_SCOPE("SliceCache::slice", mesh_idx, -1);
+            const bool keep_none_closed = mesh.getSettingBoolean(SettingKey::meshfix_keep_open_polygons);
+            const bool extensive_stitching = mesh.getSettingBoolean(SettingKey::meshfix_extensive_stitching);
+            Slicer* slicer;
+            if (use_slice_cache)
+            {
+                slicer = SliceCache::getInstance()->slice(&mesh, initial_slice_z, layer_thickness, slice_layer_count, keep_none_closed, extensive_stitching, &context.cancelled);
+            }
+            else
+            {
+                slicer = new Slicer(&mesh, initial_slice_z, layer_thickness, slice_layer_count, keep_none_closed, extensive_stitching, &context.cancelled);
+            }
+            if (mesh.getSettingBoolean(SettingKey::conical_overhang_enabled) && !context.isCancelled())
+            {
+                ConicalOverhang::apply(slicer, mesh.getSettingInAngleRadians(SettingKey::conical_overhang_angle), layer_thickness);
+            }
+            mesh_profile.slice_time = slice_timer.restart();
+            slicerList[mesh_idx] = slicer;
+        }
+        mesh_profile.layer_count = slice_layer_count;
+        mesh.clear(); // the faces and vertices are no longer needed, so free them while the other meshes are sliced
         /*
         for(SlicerLayer& layer : slicer->layers)
         {
@@ -98,66 +218,115 @@ bool FffPolygonGenerator::sliceModel(MeshGroup* meshgroup, TimeKeeper& timeKeepe
             sendPolygons("openoutline", layer_nr, layer.openPolygonList);
         }
         */
-        Progress::messageProgress(Progress::Stage::SLICING, mesh_idx + 1, meshgroup->meshes.size());
+        std::lock_guard<std::mutex> lock(progress_mutex);
+        sliced_face_count += mesh_profile.face_count;
+        Progress::messageProgress(Progress::Stage::SLICING, sliced_face_count, std::max<size_t>(1, total_face_count), context.command_socket);
+    });
+    if (context.isCancelled())
+    {
+        for (Slicer* sliced : slicerList)
+        {
+            delete sliced;
+        }
+        return false;
     }
 
-    meshgroup->clear();///Clear the mesh face and vertex data, it is no longer needed after this point, and it saves a lot of memory.
-
-
-    for(unsigned int meshIdx=0; meshIdx < slicerList.size(); meshIdx++)
+    std::vector<Slicer*> sliced_meshes; // without the copies
+    for (Slicer* slicer : slicerList)
     {
-        Mesh& mesh = storage.meshgroup->meshes[meshIdx];
-        if (mesh.getSettingBoolean("conical_overhang_enabled"))
+        if (slicer)
         {
-            ConicalOverhang::apply(slicerList[meshIdx], mesh.getSettingInAngleRadians("conical_overhang_angle"), layer_thickness);
+            sliced_meshes.push_back(slicer);
         }
     }
 
-    Progress::messageProgressStage(Progress::Stage::PARTS, &timeKeeper);
+    Progress::messageProgressStage(Progress::Stage::PARTS, &timeKeeper, context.command_socket);
     //carveMultipleVolumes(storage.meshes);
-    generateMultipleVolumesOverlap(slicerList);
+    generateMultipleVolumesOverlap(sliced_meshes); // the copies and their originals don't overlap with any other mesh
 
     storage.meshes.reserve(slicerList.size()); // causes there to be no resize in meshes so that the pointers in sliceMeshStorage._config to retraction_config don't get invalidated.
     for (unsigned int meshIdx = 0; meshIdx < slicerList.size(); meshIdx++)
+    {
+        storage.meshes.emplace_back(&meshgroup->meshes[meshIdx], slice_layer_count); // new mesh in storage had settings from the Mesh
+        storage.meshes.back().copy_of_mesh_idx = copy_of_mesh_idx[meshIdx];
+        storage.meshes.back().copy_offset = copy_offsets[meshIdx];
+    }
+
+    //Add the raft offset to each layer.
+    const int layer_0_offset = getSettingInMicrons(SettingKey::layer_height_0) - initial_slice_z;
+    int raft_offset = 0;
+    int layer_0_z_overlap = 0;
+    if (getSettingAsPlatformAdhesion(SettingKey::adhesion_type) == EPlatformAdhesion::RAFT)
+    {
+        ExtruderTrain* train = storage.meshgroup->getExtruderTrain(getSettingAsIndex(SettingKey::adhesion_extruder_nr));
+        layer_0_z_overlap = train->getSettingInMicrons(SettingKey::layer_0_z_overlap);
+        raft_offset =
+            train->getSettingInMicrons(SettingKey::raft_base_thickness)
+            + train->getSettingInMicrons(SettingKey::raft_interface_thickness)
+            + train->getSettingAsCount(SettingKey::raft_surface_layers) * train->getSettingInMicrons(SettingKey::raft_surface_thickness)
+            + train->getSettingInMicrons(SettingKey::raft_airgap)
+            - layer_0_z_overlap; // shift all layers (except 0) down
+    }
+
+    // the parts of the meshes are also created at the same time, now that the overlap between the meshes is resolved
+    unsigned int parted_mesh_count = 0;
+    ThreadPool::getInstance()->parallelFor(0, slicerList.size(), [&](int meshIdx)
     {
         Slicer* slicer = slicerList[meshIdx];
-        storage.meshes.emplace_back(&meshgroup->meshes[meshIdx], slicer->layers.size()); // new mesh in storage had settings from the Mesh
-        SliceMeshStorage& meshStorage = storage.meshes.back();
+        if (!slicer)
+        { // the parts of a copy are made once those of its original are finished
+            return;
+        }
+        SliceMeshStorage& meshStorage = storage.meshes[meshIdx];
         Mesh& mesh = storage.meshgroup->meshes[meshIdx];
 
-        createLayerParts(meshStorage, slicer, mesh.getSettingBoolean("meshfix_union_all"), mesh.getSettingBoolean("meshfix_union_all_remove_holes"));
-        delete slicerList[meshIdx];
+        TimeKeeper parts_timer;
+        createLayerParts(meshStorage, slicer, mesh.getSettingBoolean(SettingKey::meshfix_union_all), mesh.getSettingBoolean(SettingKey::meshfix_union_all_remove_holes));
+        delete slicer;
+        ProfilingReport::MeshProfile& mesh_profile = ProfilingReport::getInstance().getMesh(meshIdx);
+        mesh_profile.parts_time = parts_timer.restart();
+        for (const SliceLayer& layer : meshStorage.layers)
+        {
+            mesh_profile.part_count += layer.parts.size();
+        }
 
-        bool has_raft = getSettingAsPlatformAdhesion("adhesion_type") == EPlatformAdhesion::RAFT;
-        //Add the raft offset to each layer.
         for(unsigned int layer_nr=0; layer_nr<meshStorage.layers.size(); layer_nr++)
         {
             SliceLayer& layer = meshStorage.layers[layer_nr];
-            meshStorage.layers[layer_nr].printZ += 
-                getSettingInMicrons("layer_height_0")
-                - initial_slice_z;
-            if (has_raft)
+            layer.printZ += layer_0_offset + raft_offset;
+            if (layer_nr == 0)
             {
-                ExtruderTrain* train = storage.meshgroup->getExtruderTrain(getSettingAsIndex("adhesion_extruder_nr"));
-                layer.printZ += 
-                    train->getSettingInMicrons("raft_base_thickness") 
-                    + train->getSettingInMicrons("raft_interface_thickness") 
-                    + train->getSettingAsCount("raft_surface_layers") * train->getSettingInMicrons("raft_surface_thickness")
-                    + train->getSettingInMicrons("raft_airgap")
-                    - train->getSettingInMicrons("layer_0_z_overlap"); // shift all layers (except 0) down
-                if (layer_nr == 0)
-                {
-                    layer.printZ += train->getSettingInMicrons("layer_0_z_overlap"); // undo shifting down of first layer
-                }
+                layer.printZ += layer_0_z_overlap; // undo shifting down of first layer
             }
 
-            if (layer.parts.size() > 0 || (mesh.getSettingAsSurfaceMode("magic_mesh_surface_mode") != ESurfaceMode::NORMAL && layer.openPolyLines.size() > 0) )
+            if (layer.parts.size() > 0 || (mesh.getSettingAsSurfaceMode(SettingKey::magic_mesh_surface_mode) != ESurfaceMode::NORMAL && layer.openPolyLines.size() > 0) )
             {
                 meshStorage.layer_nr_max_filled_layer = layer_nr; // last set by the highest non-empty layer
             } 
         }
 
-        Progress::messageProgress(Progress::Stage::PARTS, meshIdx + 1, slicerList.size());
+        std::lock_guard<std::mutex> lock(progress_mutex);
+        parted_mesh_count++;
+        Progress::messageProgress(Progress::Stage::PARTS, parted_mesh_count, sliced_meshes.size(), context.command_socket);
+    });
+
+    for (unsigned int meshIdx = 0; meshIdx < storage.meshes.size(); meshIdx++)
+    {
+        SliceMeshStorage& meshStorage = storage.meshes[meshIdx];
+        if (meshStorage.copy_of_mesh_idx < 0)
+        {
+            continue;
+        }
+        // the layers stay empty until the walls, skin and infill of the original are copied into them
+        const SliceMeshStorage& original = storage.meshes[meshStorage.copy_of_mesh_idx];
+        meshStorage.layers.resize(original.layers.size());
+        for (unsigned int layer_nr = 0; layer_nr < original.layers.size(); layer_nr++)
+        {
+            meshStorage.layers[layer_nr].sliceZ = original.layers[layer_nr].sliceZ;
+            meshStorage.layers[layer_nr].printZ = original.layers[layer_nr].printZ;
+        }
+        meshStorage.layer_nr_max_filled_layer = original.layer_nr_max_filled_layer;
+        ProfilingReport::getInstance().getMesh(meshIdx).part_count = ProfilingReport::getInstance().getMesh(meshStorage.copy_of_mesh_idx).part_count;
     }
     return true;
 }
@@ -169,37 +338,55 @@ void FffPolygonGenerator::slices2polygons(SliceDataStorage& storage, TimeKeeper&
     unsigned int slice_layer_count = 0;
     for (SliceMeshStorage& mesh : storage.meshes)
     {
-        if (!mesh.getSettingBoolean("infill_mesh"))
+        if (!mesh.getSettingBoolean(SettingKey::infill_mesh))
         {
             slice_layer_count = std::max<unsigned int>(slice_layer_count, mesh.layers.size());
         }
     }
 
     // handle meshes
-    std::vector<double> mesh_timings;
-    for (unsigned int mesh_idx = 0; mesh_idx < storage.meshes.size(); mesh_idx++)
-    {
-        mesh_timings.push_back(1.0); // TODO: have a more accurate estimate of the relative time it takes per mesh, based on the height and number of polygons
-    }
-    ProgressStageEstimator inset_skin_progress_estimate(mesh_timings);
+    // TODO: have a more accurate estimate of the relative time it takes per mesh, based on the height and number of polygons
+    // the walls and skins of all meshes are computed at the same time, so progress is the estimated time of all finished layers relative to the estimated time of all layers of all meshes
+    std::mutex progress_mutex;
+    double finished_inset_skin_time = 0.0;
+    const double total_inset_skin_time = storage.meshes.size() * slice_layer_count * (inset_time_per_layer + skin_time_per_layer);
+    std::function<void(double)> report_inset_skin_progress = [&](double finished_time)
+        {
+            std::lock_guard<std::mutex> lock(progress_mutex);
+            finished_inset_skin_time += finished_time;
+            Progress::messageProgress(Progress::Stage::INSET_SKIN, finished_inset_skin_time / total_inset_skin_time * 100, 100, context.command_socket);
+        };
 
-    Progress::messageProgressStage(Progress::Stage::INSET_SKIN, &time_keeper);
+    Progress::messageProgressStage(Progress::Stage::INSET_SKIN, &time_keeper, context.command_socket);
     std::vector<unsigned int> mesh_order;
     { // compute mesh order
         std::multimap<int, unsigned int> order_to_mesh_indices;
         for (unsigned int mesh_idx = 0; mesh_idx < storage.meshes.size(); mesh_idx++)
         {
-            order_to_mesh_indices.emplace(storage.meshes[mesh_idx].getSettingAsIndex("infill_mesh_order"), mesh_idx);
+            order_to_mesh_indices.emplace(storage.meshes[mesh_idx].getSettingAsIndex(SettingKey::infill_mesh_order), mesh_idx);
         }
         for (std::pair<const int, unsigned int>& order_and_mesh_idx : order_to_mesh_indices)
         {
             mesh_order.push_back(order_and_mesh_idx.second);
         }
     }
+    TaskGraph task_graph;
+    std::vector<std::vector<TaskGraph::TaskIdx>> mesh_tasks(mesh_order.size());
     for (unsigned int mesh_order_idx(0); mesh_order_idx < mesh_order.size(); ++mesh_order_idx)
     {
-        processBasicWallsSkinInfill(storage, mesh_order_idx, mesh_order, slice_layer_count, inset_skin_progress_estimate);
-        Progress::messageProgress(Progress::Stage::INSET_SKIN, mesh_order_idx + 1, storage.meshes.size());
+        processBasicWallsSkinInfill(storage, mesh_order_idx, mesh_order, slice_layer_count, task_graph, mesh_tasks, report_inset_skin_progress);
+    }
+    task_graph.run();
+    if (context.isCancelled())
+    {
+        return;
+    }
+    for (SliceMeshStorage& mesh : storage.meshes)
+    { // the inside areas are only shared between the skins of neighbouring layers
+        for (SliceLayer& layer : mesh.layers)
+        {
+            layer.releaseInsideArea();
+        }
     }
 
     unsigned int print_layer_count = 0;
@@ -218,9 +405,11 @@ void FffPolygonGenerator::slices2polygons(SliceDataStorage& storage, TimeKeeper&
         }
         if (layer != nullptr)
         {
-            if (CommandSocket::isInstantiated())
+            if (context.command_socket)
             { // send layer info
-                CommandSocket::getInstance()->sendOptimizedLayerInfo(layer_nr, layer->printZ, layer_nr == 0? getSettingInMicrons("layer_height_0") : getSettingInMicrons("layer_height"));
+                storage.layer_infos.push_back({ int(layer_nr), layer->printZ, layer_nr == 0? getSettingInMicrons(SettingKey::layer_height_0) : getSettingInMicrons(SettingKey::layer_height) });
+                const SliceDataStorage::LayerInfo& layer_info = storage.layer_infos.back();
+                context.command_socket->sendOptimizedLayerInfo(layer_info.layer_nr, layer_info.z, layer_info.thickness);
             }
         }
     }
@@ -232,16 +421,23 @@ void FffPolygonGenerator::slices2polygons(SliceDataStorage& storage, TimeKeeper&
     // we need to remove empty layers after we have procesed the insets
     // processInsets might throw away parts if they have no wall at all (cause it doesn't fit)
     // brim depends on the first layer not being empty
-    removeEmptyFirstLayers(storage, getSettingInMicrons("layer_height"), print_layer_count); // changes total_layers!
+    removeEmptyFirstLayers(storage, getSettingInMicrons(SettingKey::layer_height), print_layer_count); // changes total_layers!
     if (print_layer_count == 0)
     {
         log("Stopping process because there are no non-empty layers.\n");
         return;
     }
 
-    Progress::messageProgressStage(Progress::Stage::SUPPORT, &time_keeper);  
+    // the support and the helper parts all need the outlines of the model, which don't change anymore
+    storage.cacheLayerOutlines(print_layer_count);
 
-    AreaSupport::generateSupportAreas(storage, print_layer_count);
+    Progress::messageProgressStage(Progress::Stage::SUPPORT, &time_keeper, context.command_socket);  
+
+    // the helper parts each depend on the ones computed before them, but the derived infill of the meshes is independent of them
+    TaskGraph::TaskIdx support_task = task_graph.addTask([&]()
+        {
+            AreaSupport::generateSupportAreas(storage, print_layer_count, context);
+        });
     
     /*
     if (storage.support.generated)
@@ -249,77 +445,169 @@ void FffPolygonGenerator::slices2polygons(SliceDataStorage& storage, TimeKeeper&
         for (unsigned int layer_idx = 0; layer_idx < total_layers; layer_idx++)
         {
             Polygons& support = storage.support.supportLayers[layer_idx].supportAreas;
-            ExtruderTrain* infill_extr = storage.meshgroup->getExtruderTrain(storage.getSettingAsIndex("support_infill_extruder_nr"));
-            CommandSocket::sendPolygons(PrintFeatureType::Infill, support, 100); // infill_extr->getSettingInMicrons("support_line_width"));
+            ExtruderTrain* infill_extr = storage.meshgroup->getExtruderTrain(storage.getSettingAsIndex(SettingKey::support_infill_extruder_nr));
+            context.command_socket->sendPolygons(PrintFeatureType::Infill, support, 100); // infill_extr->getSettingInMicrons(SettingKey::support_line_width));
         }
     }
     */
 
     // handle helpers
-    storage.primeTower.computePrimeTowerMax(storage);
-    storage.primeTower.generatePaths(storage, print_layer_count);
-    
-    logDebug("Processing ooze shield\n");
-    processOozeShield(storage, print_layer_count);
+    TaskGraph::TaskIdx prime_tower_task = task_graph.addTask([&]()
+        {
+            storage.primeTower.computePrimeTowerMax(storage);
+            storage.primeTower.generatePaths(storage, print_layer_count);
+        }, { support_task });
 
-    logDebug("Processing draft shield\n");
-    processDraftShield(storage, print_layer_count);
+    TaskGraph::TaskIdx ooze_shield_task = task_graph.addTask([&]()
+        {
+            logDebug("Processing ooze shield\n");
+            processOozeShield(storage, print_layer_count);
+        }, { prime_tower_task });
+
+    TaskGraph::TaskIdx draft_shield_task = task_graph.addTask([&]()
+        {
+            logDebug("Processing draft shield\n");
+            processDraftShield(storage, print_layer_count);
+        }, { prime_tower_task });
+
+    TaskGraph::TaskIdx platform_adhesion_task = task_graph.addTask([&]()
+        {
+            logDebug("Processing platform adhesion\n");
+            processPlatformAdhesion(storage);
+        }, { ooze_shield_task, draft_shield_task });
 
-    logDebug("Processing platform adhesion\n");
-    processPlatformAdhesion(storage);
-    
     // meshes post processing
-    for (SliceMeshStorage& mesh : storage.meshes)
+    // fuzzy skin changes the walls and outlines used by the helper parts
+    for (unsigned int mesh_idx = 0; mesh_idx < storage.meshes.size(); mesh_idx++)
     {
-        processDerivedWallsSkinInfill(mesh, print_layer_count);
+        SliceMeshStorage& mesh = storage.meshes[mesh_idx];
+        TaskGraph::TaskIdx derived_task = task_graph.addTask([&, print_layer_count]()
+            {
+                processDerivedWallsSkinInfill(mesh, print_layer_count);
+            });
+        if (mesh.getSettingBoolean(SettingKey::magic_fuzzy_skin_enabled))
+        {
+            task_graph.addTask([&, mesh_idx]()
+                {
+                    processFuzzyWalls(mesh, mesh_idx);
+                }, { platform_adhesion_task, derived_task });
+        }
     }
+    task_graph.run();
 }
 
-void FffPolygonGenerator::processBasicWallsSkinInfill(SliceDataStorage& storage, unsigned int mesh_order_idx, std::vector<unsigned int>& mesh_order, size_t total_layers, ProgressStageEstimator& inset_skin_progress_estimate)
+void FffPolygonGenerator::processBasicWallsSkinInfill(SliceDataStorage& storage, unsigned int mesh_order_idx, std::vector<unsigned int>& mesh_order, size_t total_layers, TaskGraph& task_graph, std::vector<std::vector<TaskGraph::TaskIdx>>& mesh_tasks, const std::function<void(double)>& report_progress)
 {
     unsigned int mesh_idx = mesh_order[mesh_order_idx];
     SliceMeshStorage& mesh = storage.meshes[mesh_idx];
-    if (mesh.getSettingBoolean("infill_mesh"))
-    {
-        processInfillMesh(storage, mesh_order_idx, mesh_order, total_layers);
+    const unsigned int range_count = (total_layers + layers_per_task - 1) / layers_per_task;
+    if (mesh.copy_of_mesh_idx >= 0)
+    { // a copy has the same settings as its original, so it comes later in the mesh order
+        const unsigned int original_order_idx = std::find(mesh_order.begin(), mesh_order.end(), mesh.copy_of_mesh_idx) - mesh_order.begin();
+        const SliceMeshStorage& original = storage.meshes[mesh.copy_of_mesh_idx];
+        const std::vector<TaskGraph::TaskIdx>& original_tasks = mesh_tasks[original_order_idx]; // originals aren't infill meshes, so these are the skin tasks of each range
+        for (unsigned int range_idx = 0; range_idx < range_count; range_idx++)
+        {
+            const unsigned int start_layer = range_idx * layers_per_task;
+            const unsigned int end_layer = std::min<unsigned int>(total_layers, start_layer + layers_per_task);
+            std::vector<TaskGraph::TaskIdx> copy_dependencies;
+            if (original_tasks.size() == range_count)
+            {
+                copy_dependencies.push_back(original_tasks[range_idx]);
+            }
+            else
+            {
+                copy_dependencies = original_tasks;
+            }
+            mesh_tasks[mesh_order_idx].push_back(task_graph.addTask([this, &mesh, &original, start_layer, end_layer, &report_progress]()
+                {
+                    for (unsigned int layer_number = start_layer; layer_number < end_layer; layer_number++)
+                    {
+                        if (context.isCancelled())
+                        {
+                            return;
+                        }
+                        mesh.layers[layer_number].copyTranslated(original.layers[layer_number], mesh.copy_offset);
+                    }
+                    report_progress((end_layer - start_layer) * (inset_time_per_layer + skin_time_per_layer));
+                }, copy_dependencies, ThreadPool::getInstance()->getLayerThread(start_layer, total_layers)));
+        }
+        return;
     }
-    
-    // TODO: make progress more accurate!!
-    // note: estimated time for     insets : skins = 22.953 : 48.858
-    std::vector<double> walls_vs_skin_timing({22.953, 48.858});
-    ProgressStageEstimator* mesh_inset_skin_progress_estimator = new ProgressStageEstimator(walls_vs_skin_timing);
-    
-    inset_skin_progress_estimate.nextStage(mesh_inset_skin_progress_estimator); // the stage of this function call
-    
-    ProgressEstimatorLinear* inset_estimator = new ProgressEstimatorLinear(total_layers);
-    mesh_inset_skin_progress_estimator->nextStage(inset_estimator);
-    
-    
+    std::vector<TaskGraph::TaskIdx> inset_dependencies;
+    if (mesh.getSettingBoolean(SettingKey::infill_mesh))
+    { // the infill mesh changes the infill of all meshes before it in the mesh order, so those have to be finished first
+        std::vector<TaskGraph::TaskIdx> infill_mesh_dependencies;
+        for (unsigned int other_mesh_order_idx = 0; other_mesh_order_idx < mesh_order_idx; other_mesh_order_idx++)
+        {
+            infill_mesh_dependencies.insert(infill_mesh_dependencies.end(), mesh_tasks[other_mesh_order_idx].begin(), mesh_tasks[other_mesh_order_idx].end());
+        }
+        inset_dependencies.push_back(task_graph.addTask([this, &storage, mesh_order_idx, &mesh_order, total_layers]()
+            {
+                processInfillMesh(storage, mesh_order_idx, mesh_order, total_layers);
+            }, infill_mesh_dependencies));
+    }
+
+    // the tasks are started longest first, so that the expensive layers don't end up at the end of the stage, leaving the other threads idle
+    std::vector<ProfilingReport::LayerProfile>& layer_profiles = ProfilingReport::getInstance().getMesh(mesh_idx).layers;
+    estimateLayerCosts(mesh, total_layers, layer_profiles);
+    auto estimateRangeCost = [&layer_profiles](unsigned int start_layer, unsigned int end_layer, bool skin)
+        {
+            double cost = 0.0;
+            for (unsigned int layer_nr = start_layer; layer_nr < end_layer; layer_nr++)
+            {
+                const ProfilingReport::LayerProfile& layer_profile = layer_profiles[layer_nr];
+                cost += (skin || !layer_profile.skin) ? layer_profile.estimated_cost : layer_profile.estimated_cost / skin_layer_cost_factor;
+            }
+            return skin ? cost : cost * inset_time_per_layer / skin_time_per_layer;
+        };
+
     // walls
-    for(unsigned int layer_number = 0; layer_number < total_layers; layer_number++)
+    // the insets of a layer only depend on the outline of that same layer
+    std::vector<TaskGraph::TaskIdx> inset_tasks;
+    for (unsigned int range_idx = 0; range_idx < range_count; range_idx++)
     {
-        logDebug("Processing insets for layer %i of %i\n", layer_number, total_layers);
-        processInsets(mesh, layer_number);
-        double progress = inset_skin_progress_estimate.progress(layer_number);
-        Progress::messageProgress(Progress::Stage::INSET_SKIN, progress * 100, 100);
+        const unsigned int start_layer = range_idx * layers_per_task;
+        const unsigned int end_layer = std::min<unsigned int>(total_layers, start_layer + layers_per_task);
+        inset_tasks.push_back(task_graph.addTask([this, &mesh, mesh_idx, start_layer, end_layer, total_layers, &report_progress, &layer_profiles]()
+            {
+                InsetsMemo memo; // the layers of this range are only changed by this task until it's finished
+                for (unsigned int layer_number = start_layer; layer_number < end_layer; layer_number++)
+                {
+                    if (context.isCancelled())
+                    {
+                        return;
+                    }
+                    logDebug("Processing insets for layer %i of %i\n", layer_number, total_layers);
+                    TRACE_SCOPE("processInsets", mesh_idx, layer_number);
+                    TimeKeeper layer_timer;
+                    LayerArena arena; // the polygon operations of the layer reuse the same memory for their temporaries
+                    processInsets(mesh, layer_number, memo);
+                    layer_profiles[layer_number].inset_time = layer_timer.restart();
+                    if (SlowLayerCapture::getInstance().isSlow(layer_profiles[layer_number].inset_time))
+                    { // the outlines are the input of the walls, and aren't changed by computing them
+                        const SliceLayer& layer = mesh.layers[layer_number];
+                        SlowLayerCapture::getInstance().capture("inset", mesh_idx, layer_number, layer.printZ, layer_profiles[layer_number].inset_time, layer.getOutlines(), mesh);
+                    }
+                }
+                report_progress((end_layer - start_layer) * inset_time_per_layer);
+            }, inset_dependencies, ThreadPool::getInstance()->getLayerThread(start_layer, total_layers) // the thread which computes the skin of the same layers
+            , estimateRangeCost(start_layer, end_layer, false)));
     }
 
-    ProgressEstimatorLinear* skin_estimator = new ProgressEstimatorLinear(total_layers);
-    mesh_inset_skin_progress_estimator->nextStage(skin_estimator);
-
-    bool process_infill = mesh.getSettingInMicrons("infill_line_distance") > 0;
+    bool process_infill = mesh.getSettingInMicrons(SettingKey::infill_line_distance) > 0;
     if (!process_infill)
     { // do process infill anyway if it's modified by modifier meshes
         for (unsigned int other_mesh_order_idx(mesh_order_idx + 1); other_mesh_order_idx < mesh_order.size(); ++other_mesh_order_idx)
         {
             unsigned int other_mesh_idx = mesh_order[other_mesh_order_idx];
             SliceMeshStorage& other_mesh = storage.meshes[other_mesh_idx];
-            if (other_mesh.getSettingBoolean("infill_mesh"))
+            if (other_mesh.getSettingBoolean(SettingKey::infill_mesh))
             {
                 AABB3D aabb = storage.meshgroup->meshes[mesh_idx].getAABB();
                 AABB3D other_aabb = storage.meshgroup->meshes[other_mesh_idx].getAABB();
-                aabb.expandXY(mesh.getSettingInMicrons("xy_offset"));
-                other_aabb.expandXY(other_mesh.getSettingInMicrons("xy_offset"));
+                aabb.expandXY(mesh.getSettingInMicrons(SettingKey::xy_offset));
+                other_aabb.expandXY(other_mesh.getSettingInMicrons(SettingKey::xy_offset));
                 if (aabb.hit(other_aabb))
                 {
                     process_infill = true;
@@ -328,21 +616,87 @@ void FffPolygonGenerator::processBasicWallsSkinInfill(SliceDataStorage& storage,
         }
     }
     // skin & infill
-//     Progress::messageProgressStage(Progress::Stage::SKIN, &time_keeper);
+    // the skin of a layer depends on the insets of the layers within the bottom and top skin distance
     int mesh_max_bottom_layer_count = 0;
-    if (mesh.getSettingBoolean("magic_spiralize"))
+    if (mesh.getSettingBoolean(SettingKey::magic_spiralize))
     {
-        mesh_max_bottom_layer_count = std::max(mesh_max_bottom_layer_count, mesh.getSettingAsCount("bottom_layers"));
+        mesh_max_bottom_layer_count = std::max(mesh_max_bottom_layer_count, mesh.getSettingAsCount(SettingKey::bottom_layers));
     }
-    for(unsigned int layer_number = 0; layer_number < total_layers; layer_number++)
+    const unsigned int bottom_layers = std::max(0, mesh.getSettingAsCount(SettingKey::bottom_layers));
+    const unsigned int top_layers = std::max(0, mesh.getSettingAsCount(SettingKey::top_layers));
+    for (unsigned int range_idx = 0; range_idx < range_count; range_idx++)
     {
-        logDebug("Processing skins and infill layer %i of %i\n", layer_number, total_layers);
-        if (!mesh.getSettingBoolean("magic_spiralize") || static_cast<int>(layer_number) < mesh_max_bottom_layer_count)    //Only generate up/downskin and infill for the first X layers when spiralize is choosen.
+        const unsigned int start_layer = range_idx * layers_per_task;
+        const unsigned int end_layer = std::min<unsigned int>(total_layers, start_layer + layers_per_task);
+        const unsigned int first_inset_range_idx = (start_layer - std::min(start_layer, bottom_layers)) / layers_per_task;
+        const unsigned int last_inset_range_idx = std::min<unsigned int>(total_layers - 1, end_layer - 1 + top_layers) / layers_per_task;
+        std::vector<TaskGraph::TaskIdx> skin_dependencies(inset_tasks.begin() + first_inset_range_idx, inset_tasks.begin() + last_inset_range_idx + 1);
+        mesh_tasks[mesh_order_idx].push_back(task_graph.addTask([this, &mesh, mesh_idx, start_layer, end_layer, total_layers, mesh_max_bottom_layer_count, process_infill, &report_progress, &layer_profiles]()
+            {
+                for (unsigned int layer_number = start_layer; layer_number < end_layer; layer_number++)
+                {
+                    if (context.isCancelled())
+                    {
+                        return;
+                    }
+                    logDebug("Processing skins and infill layer %i of %i\n", layer_number, total_layers);
+                    if (!mesh.getSettingBoolean(SettingKey::magic_spiralize) || static_cast<int>(layer_number) < mesh_max_bottom_layer_count)    //Only generate up/downskin and infill for the first X layers when spiralize is choosen.
+                    {
+                        TRACE_SCOPE("processSkinsAndInfill", mesh_idx, layer_number);
+                        TimeKeeper layer_timer;
+                        LayerArena arena; // the polygon operations of the layer reuse the same memory for their temporaries
+                        processSkinsAndInfill(mesh, layer_number, process_infill);
+                        layer_profiles[layer_number].skin_time = layer_timer.restart();
+                        if (SlowLayerCapture::getInstance().isSlow(layer_profiles[layer_number].skin_time))
+                        {
+                            const SliceLayer& layer = mesh.layers[layer_number];
+                            SlowLayerCapture::getInstance().capture("skin", mesh_idx, layer_number, layer.printZ, layer_profiles[layer_number].skin_time, layer.getOutlines(), mesh);
+                        }
+                    }
+                }
+                report_progress((end_layer - start_layer) * skin_time_per_layer);
+            }, skin_dependencies, ThreadPool::getInstance()->getLayerThread(start_layer, total_layers), estimateRangeCost(start_layer, end_layer, true)));
+    }
+    if (range_count == 0)
+    { // later infill meshes still need to wait for the infill mesh processing of this mesh
+        mesh_tasks[mesh_order_idx] = inset_dependencies;
+    }
+}
+
+void FffPolygonGenerator::estimateLayerCosts(const SliceMeshStorage& mesh, size_t total_layers, std::vector<ProfilingReport::LayerProfile>& layer_profiles) const
+{
+    layer_profiles.assign(total_layers, ProfilingReport::LayerProfile());
+    const unsigned int layer_count = std::min<size_t>(total_layers, mesh.layers.size());
+    std::vector<double> areas(layer_count, 0.0);
+    for (unsigned int layer_nr = 0; layer_nr < layer_count; layer_nr++)
+    {
+        ProfilingReport::LayerProfile& layer_profile = layer_profiles[layer_nr];
+        for (const SliceLayerPart& part : mesh.layers[layer_nr].parts)
+        {
+            for (unsigned int poly_idx = 0; poly_idx < part.outline.size(); poly_idx++)
+            {
+                layer_profile.vertex_count += part.outline[poly_idx].size();
+                areas[layer_nr] += part.outline[poly_idx].area();
+            }
+        }
+        layer_profile.part_count = mesh.layers[layer_nr].parts.size();
+    }
+
+    const unsigned int bottom_layers = std::max(0, mesh.getSettingAsCount(SettingKey::bottom_layers));
+    const unsigned int top_layers = std::max(0, mesh.getSettingAsCount(SettingKey::top_layers));
+    for (unsigned int layer_nr = 0; layer_nr < layer_count; layer_nr++)
+    {
+        ProfilingReport::LayerProfile& layer_profile = layer_profiles[layer_nr];
+        if (layer_profile.part_count == 0)
         {
-            processSkinsAndInfill(mesh, layer_number, process_infill);
+            continue;
         }
-        double progress = inset_skin_progress_estimate.progress(layer_number);
-        Progress::messageProgress(Progress::Stage::INSET_SKIN, progress * 100, 100);
+        // a different area at the skin distance means that part of this layer is too close to the air below or above it
+        const double area_tolerance = 0.01 * std::abs(areas[layer_nr]);
+        layer_profile.skin = layer_nr < bottom_layers || layer_nr + top_layers >= layer_count
+            || std::abs(areas[layer_nr - bottom_layers] - areas[layer_nr]) > area_tolerance
+            || std::abs(areas[layer_nr + top_layers] - areas[layer_nr]) > area_tolerance;
+        layer_profile.estimated_cost = (layer_profile.vertex_count + layer_cost_per_part * layer_profile.part_count) * (layer_profile.skin ? skin_layer_cost_factor : 1.0);
     }
 }
 
@@ -350,11 +704,18 @@ void FffPolygonGenerator::processInfillMesh(SliceDataStorage& storage, unsigned
 {
     unsigned int mesh_idx = mesh_order[mesh_order_idx];
     SliceMeshStorage& mesh = storage.meshes[mesh_idx];
-    mesh.layer_nr_max_filled_layer = -1;
-    for (unsigned int layer_idx = 0; layer_idx < mesh.layers.size(); layer_idx++)
+    // each layer of the infill mesh only changes the same layer of the meshes before it in the mesh order
+    ThreadPool::getInstance()->parallelForLayers(0, mesh.layers.size(), [&](int layer_idx)
     {
+        if (context.isCancelled())
+        {
+            return;
+        }
+        LayerArena arena; // the polygon operations of the layer reuse the same memory for their temporaries
         SliceLayer& layer = mesh.layers[layer_idx];
         std::vector<PolygonsPart> new_parts;
+        std::vector<unsigned int> other_part_indices;
+        std::vector<Polygons> removed_outlines_per_other_part; // the outlines of the parts of this infill mesh hitting each part of the other mesh
 
         for (unsigned int other_mesh_idx : mesh_order)
         { // limit the infill mesh's outline to within the infill of all meshes with lower order
@@ -363,21 +724,21 @@ void FffPolygonGenerator::processInfillMesh(SliceDataStorage& storage, unsigned
                 break; // all previous meshes have been processed
             }
             SliceMeshStorage& other_mesh = storage.meshes[other_mesh_idx];
-            if (layer_idx >= other_mesh.layers.size())
+            if (static_cast<unsigned int>(layer_idx) >= other_mesh.layers.size())
             { // there can be no interaction between the infill mesh and this other non-infill mesh
                 continue;
             }
 
             SliceLayer& other_layer = other_mesh.layers[layer_idx];
+            removed_outlines_per_other_part.assign(other_layer.parts.size(), Polygons());
 
             for (SliceLayerPart& part : layer.parts)
             {
-                for (SliceLayerPart& other_part : other_layer.parts)
+                other_layer.findPartsHitting(part.boundaryBox, other_part_indices);
+                for (unsigned int other_part_idx : other_part_indices)
                 { // limit the outline of each part of this infill mesh to the infill of parts of the other mesh with lower infill mesh order
-                    if (!part.boundaryBox.hit(other_part.boundaryBox))
-                    { // early out
-                        continue;
-                    }
+                    SliceLayerPart& other_part = other_layer.parts[other_part_idx];
+                    // the parts of the infill mesh don't overlap, so the infill of the other part is only cut down once all of them have been limited to it
                     Polygons new_outline = part.outline.intersection(other_part.getOwnInfillArea());
                     if (new_outline.size() == 1)
                     { // we don't have to call splitIntoParts, because a single polygon can only be a single part
@@ -393,12 +754,21 @@ void FffPolygonGenerator::processInfillMesh(SliceDataStorage& storage, unsigned
                             new_parts.push_back(new_part_here);
                         }
                     }
-                    // change the infill area of the non-infill mesh which is to be filled with e.g. lines
-                    other_part.infill_area_own = other_part.getOwnInfillArea().difference(part.outline);
-                    // note: don't change the part.infill_area, because we change the structure of that area, while the basic area in which infill is printed remains the same
-                    //       the infill area remains the same for combing
+                    removed_outlines_per_other_part[other_part_idx].add(part.outline);
                 }
             }
+            for (unsigned int other_part_idx = 0; other_part_idx < other_layer.parts.size(); other_part_idx++)
+            {
+                if (removed_outlines_per_other_part[other_part_idx].size() == 0)
+                {
+                    continue;
+                }
+                SliceLayerPart& other_part = other_layer.parts[other_part_idx];
+                // change the infill area of the non-infill mesh which is to be filled with e.g. lines
+                other_part.infill_area_own = other_part.getOwnInfillArea().difference(removed_outlines_per_other_part[other_part_idx]);
+                // note: don't change the part.infill_area, because we change the structure of that area, while the basic area in which infill is printed remains the same
+                //       the infill area remains the same for combing
+            }
         }
         
         layer.parts.clear();
@@ -408,8 +778,13 @@ void FffPolygonGenerator::processInfillMesh(SliceDataStorage& storage, unsigned
             layer.parts.back().outline = part;
             layer.parts.back().boundaryBox.calculate(part);
         }
+    });
 
-        if (layer.parts.size() > 0 || (mesh.getSettingAsSurfaceMode("magic_mesh_surface_mode") != ESurfaceMode::NORMAL && layer.openPolyLines.size() > 0) )
+    mesh.layer_nr_max_filled_layer = -1;
+    for (unsigned int layer_idx = 0; layer_idx < mesh.layers.size(); layer_idx++)
+    {
+        SliceLayer& layer = mesh.layers[layer_idx];
+        if (layer.parts.size() > 0 || (mesh.getSettingAsSurfaceMode(SettingKey::magic_mesh_surface_mode) != ESurfaceMode::NORMAL && layer.openPolyLines.size() > 0) )
         {
             mesh.layer_nr_max_filled_layer = layer_idx; // last set by the highest non-empty layer
         } 
@@ -420,35 +795,54 @@ void FffPolygonGenerator::processInfillMesh(SliceDataStorage& storage, unsigned
 void FffPolygonGenerator::processDerivedWallsSkinInfill(SliceMeshStorage& mesh, size_t total_layers)
 {
     // create gradual infill areas
-    SkinInfillAreaComputation::generateGradualInfill(mesh, mesh.getSettingInMicrons("gradual_infill_step_height"), mesh.getSettingAsCount("gradual_infill_steps"));
+    SkinInfillAreaComputation::generateGradualInfill(mesh, mesh.getSettingInMicrons(SettingKey::gradual_infill_step_height), mesh.getSettingAsCount(SettingKey::gradual_infill_steps));
 
     // combine infill
-    unsigned int combined_infill_layers = std::max(1U, round_divide(mesh.getSettingInMicrons("infill_sparse_thickness"), std::max(getSettingInMicrons("layer_height"), 1))); //How many infill layers to combine to obtain the requested sparse thickness.
+    unsigned int combined_infill_layers = std::max(1U, round_divide(mesh.getSettingInMicrons(SettingKey::infill_sparse_thickness), std::max(getSettingInMicrons(SettingKey::layer_height), 1))); //How many infill layers to combine to obtain the requested sparse thickness.
     combineInfillLayers(mesh,combined_infill_layers);
-
-    // fuzzy skin
-    if (mesh.getSettingBoolean("magic_fuzzy_skin_enabled"))
-    {
-        processFuzzyWalls(mesh);
-    }
 }
 
-void FffPolygonGenerator::processInsets(SliceMeshStorage& mesh, unsigned int layer_nr) 
+void FffPolygonGenerator::processInsets(SliceMeshStorage& mesh, unsigned int layer_nr, InsetsMemo& memo)
 {
     SliceLayer* layer = &mesh.layers[layer_nr];
-    if (mesh.getSettingAsSurfaceMode("magic_mesh_surface_mode") != ESurfaceMode::SURFACE)
+    if (mesh.getSettingAsSurfaceMode(SettingKey::magic_mesh_surface_mode) != ESurfaceMode::SURFACE)
     {
-        int inset_count = mesh.getSettingAsCount("wall_line_count");
-        if (mesh.getSettingBoolean("magic_spiralize") && static_cast<int>(layer_nr) < mesh.getSettingAsCount("bottom_layers") && layer_nr % 2 == 1)//Add extra insets every 2 layers when spiralizing, this makes bottoms of cups watertight.
+        int inset_count = mesh.getSettingAsCount(SettingKey::wall_line_count);
+        const bool spiralize = mesh.getSettingBoolean(SettingKey::magic_spiralize);
+        const bool is_spiralized_layer = spiralize && static_cast<int>(layer_nr) >= mesh.getSettingAsCount(SettingKey::bottom_layers);
+        if (spiralize && !is_spiralized_layer && layer_nr % 2 == 1)//Add extra insets every 2 layers when spiralizing, this makes bottoms of cups watertight.
             inset_count += 5;
-        int line_width_x = mesh.getSettingInMicrons("wall_line_width_x");
-        int line_width_0 = mesh.getSettingInMicrons("wall_line_width_0");
-        if (mesh.getSettingBoolean("alternate_extra_perimeter"))
+        int line_width_x = mesh.getSettingInMicrons(SettingKey::wall_line_width_x);
+        int line_width_0 = mesh.getSettingInMicrons(SettingKey::wall_line_width_0);
+        if (mesh.getSettingBoolean(SettingKey::alternate_extra_perimeter))
             inset_count += layer_nr % 2; 
-        bool recompute_outline_based_on_outer_wall = mesh.getSettingBoolean("support_enable");
-        WallsComputation walls_computation(mesh.getSettingInMicrons("wall_0_inset"), line_width_0, line_width_x, inset_count, recompute_outline_based_on_outer_wall);
-        walls_computation.generateInsets(layer);
+        if (is_spiralized_layer)
+        { // only the outer wall is spiralized, and no skin or infill is generated within it; the skin of the bottom layers doesn't depend on the walls above them either, since they're skin all over
+            inset_count = std::min(inset_count, 1);
+        }
+        bool recompute_outline_based_on_outer_wall = mesh.getSettingBoolean(SettingKey::support_enable);
+        bool insets_from_outline = mesh.getSettingBoolean(SettingKey::wall_insets_from_outline);
+        Polygons outlines; // the print outlines of the parts are only set by the walls computation
+        for (const SliceLayerPart& part : layer->parts)
+        {
+            outlines.add(part.outline);
+        }
+        layer->outline_hash = PolygonUtils::hashPoints(outlines);
+        if (memo.layer && !layer->parts.empty() && memo.inset_count == inset_count
+            && memo.layer->outline_hash == layer->outline_hash && PolygonUtils::haveSamePoints(memo.outlines, outlines))
+        { // the other settings of the walls are the same for all layers of a mesh
+            layer->parts = memo.layer->parts;
+        }
+        else
+        {
+            WallsComputation walls_computation(mesh.getSettingInMicrons(SettingKey::wall_0_inset), line_width_0, line_width_x, inset_count, recompute_outline_based_on_outer_wall, insets_from_outline);
+            walls_computation.generateInsets(layer);
+            memo.layer = layer;
+            memo.inset_count = inset_count;
+            memo.outlines = std::move(outlines);
+        }
     }
+    layer->indexParts();
 }
 
 void FffPolygonGenerator::removeEmptyFirstLayers(SliceDataStorage& storage, const int layer_height, unsigned int& total_layers)
@@ -460,7 +854,7 @@ void FffPolygonGenerator::removeEmptyFirstLayers(SliceDataStorage& storage, cons
         for (SliceMeshStorage& mesh : storage.meshes)
         {
             SliceLayer& layer = mesh.layers[layer_idx];
-            if (layer.parts.size() > 0 || (mesh.getSettingAsSurfaceMode("magic_mesh_surface_mode") != ESurfaceMode::NORMAL && layer.openPolyLines.size() > 0) )
+            if (layer.parts.size() > 0 || (mesh.getSettingAsSurfaceMode(SettingKey::magic_mesh_surface_mode) != ESurfaceMode::NORMAL && layer.openPolyLines.size() > 0) )
             {
                 layer_is_empty = false;
                 break;
@@ -494,21 +888,21 @@ void FffPolygonGenerator::removeEmptyFirstLayers(SliceDataStorage& storage, cons
   
 void FffPolygonGenerator::processSkinsAndInfill(SliceMeshStorage& mesh, unsigned int layer_nr, bool process_infill) 
 {
-    if (mesh.getSettingAsSurfaceMode("magic_mesh_surface_mode") == ESurfaceMode::SURFACE) 
+    if (mesh.getSettingAsSurfaceMode(SettingKey::magic_mesh_surface_mode) == ESurfaceMode::SURFACE) 
     { 
         return;
     }
 
-    const int wall_line_count = mesh.getSettingAsCount("wall_line_count");
-    const int innermost_wall_line_width = (wall_line_count == 1) ? mesh.getSettingInMicrons("wall_line_width_0") : mesh.getSettingInMicrons("wall_line_width_x");
-    generateSkins(layer_nr, mesh, mesh.getSettingAsCount("bottom_layers"), mesh.getSettingAsCount("top_layers"), wall_line_count, innermost_wall_line_width, mesh.getSettingAsCount("skin_outline_count"), mesh.getSettingBoolean("skin_no_small_gaps_heuristic"));
+    const int wall_line_count = mesh.getSettingAsCount(SettingKey::wall_line_count);
+    const int innermost_wall_line_width = (wall_line_count == 1) ? mesh.getSettingInMicrons(SettingKey::wall_line_width_0) : mesh.getSettingInMicrons(SettingKey::wall_line_width_x);
+    generateSkins(layer_nr, mesh, mesh.getSettingAsCount(SettingKey::bottom_layers), mesh.getSettingAsCount(SettingKey::top_layers), wall_line_count, innermost_wall_line_width, mesh.getSettingAsCount(SettingKey::skin_outline_count), mesh.getSettingBoolean(SettingKey::skin_no_small_gaps_heuristic));
 
     if (process_infill)
     { // process infill when infill density > 0
         // or when other infill meshes want to modify this infill
         int infill_skin_overlap = 0;
-        bool infill_is_dense = mesh.getSettingInMicrons("infill_line_distance") < mesh.getSettingInMicrons("infill_line_width") + 10;
-        if (!infill_is_dense && mesh.getSettingAsFillMethod("infill_pattern") != EFillMethod::CONCENTRIC)
+        bool infill_is_dense = mesh.getSettingInMicrons(SettingKey::infill_line_distance) < mesh.getSettingInMicrons(SettingKey::infill_line_width) + 10;
+        if (!infill_is_dense && mesh.getSettingAsFillMethod(SettingKey::infill_pattern) != EFillMethod::CONCENTRIC)
         {
             infill_skin_overlap = innermost_wall_line_width / 2;
         }
@@ -518,24 +912,21 @@ void FffPolygonGenerator::processSkinsAndInfill(SliceMeshStorage& mesh, unsigned
 
 void FffPolygonGenerator::processOozeShield(SliceDataStorage& storage, unsigned int total_layers)
 {
-    if (!getSettingBoolean("ooze_shield_enabled"))
+    if (!getSettingBoolean(SettingKey::ooze_shield_enabled))
     {
         return;
     }
     
-    int ooze_shield_dist = getSettingInMicrons("ooze_shield_dist");
-    
-    for(unsigned int layer_nr=0; layer_nr<total_layers; layer_nr++)
-    {
-        storage.oozeShield.push_back(storage.getLayerOutlines(layer_nr, true).offset(ooze_shield_dist));
-    }
+    int ooze_shield_dist = getSettingInMicrons(SettingKey::ooze_shield_dist);
     
     int largest_printed_radius = MM2INT(1.0); // TODO: make var a parameter, and perhaps even a setting?
-    for(unsigned int layer_nr=0; layer_nr<total_layers; layer_nr++)
+    storage.oozeShield.resize(total_layers);
+    ThreadPool::getInstance()->parallelForLayers(0, total_layers, [&](int layer_nr)
     {
-        storage.oozeShield[layer_nr] = storage.oozeShield[layer_nr].offset(-largest_printed_radius).offset(largest_printed_radius); 
-    }
-    int allowed_angle_offset = tan(getSettingInAngleRadians("ooze_shield_angle")) * getSettingInMicrons("layer_height");//Allow for a 60deg angle in the oozeShield.
+        storage.oozeShield[layer_nr] = storage.getLayerOutlines(layer_nr, true).offset(ooze_shield_dist).offset(-largest_printed_radius).offset(largest_printed_radius);
+    });
+    int allowed_angle_offset = tan(getSettingInAngleRadians(SettingKey::ooze_shield_angle)) * getSettingInMicrons(SettingKey::layer_height);//Allow for a 60deg angle in the oozeShield.
+    // each layer widens the one above and below it after that one has been widened itself, so these passes stay serial
     for(unsigned int layer_nr=1; layer_nr<total_layers; layer_nr++)
     {
         storage.oozeShield[layer_nr] = storage.oozeShield[layer_nr].unionPolygons(storage.oozeShield[layer_nr-1].offset(-allowed_angle_offset));
@@ -553,77 +944,107 @@ void FffPolygonGenerator::processDraftShield(SliceDataStorage& storage, unsigned
     {
         return;
     }
-    const int layer_height_0 = getSettingInMicrons("layer_height_0");
-    const int layer_height = getSettingInMicrons("layer_height");
+    const int layer_height_0 = getSettingInMicrons(SettingKey::layer_height_0);
+    const int layer_height = getSettingInMicrons(SettingKey::layer_height);
 
     const unsigned int max_screen_layer = (draft_shield_layers - layer_height_0) / layer_height + 1;
     const unsigned int layer_skip = 500 / layer_height + 1;
 
-    Polygons& draft_shield = storage.draft_protection_shield;
-    for (unsigned int layer_nr = 0; layer_nr < total_layers && layer_nr < max_screen_layer; layer_nr += layer_skip)
+    // union the outlines pairwise, so that each round of unions is computed at once
+    const unsigned int shield_layer_end = std::min(total_layers, max_screen_layer);
+    std::vector<Polygons> draft_shield_parts((shield_layer_end + layer_skip - 1) / layer_skip);
+    ThreadPool::getInstance()->parallelFor(0, draft_shield_parts.size(), [&](int part_idx)
+    {
+        draft_shield_parts[part_idx] = storage.getLayerOutlines(part_idx * layer_skip, true);
+    });
+    if (draft_shield_parts.size() == 1)
     {
-        draft_shield = draft_shield.unionPolygons(storage.getLayerOutlines(layer_nr, true));
+        draft_shield_parts[0] = draft_shield_parts[0].unionPolygons();
     }
+    std::vector<std::pair<const Polygons*, const Polygons*>> operands;
+    std::vector<Polygons> unions;
+    while (draft_shield_parts.size() > 1)
+    {
+        operands.clear();
+        for (unsigned int part_idx = 0; part_idx + 1 < draft_shield_parts.size(); part_idx += 2)
+        {
+            operands.emplace_back(&draft_shield_parts[part_idx], &draft_shield_parts[part_idx + 1]);
+        }
+        Polygons::batchOperation(ClipperLib::ctUnion, operands, unions);
+        if (draft_shield_parts.size() % 2 == 1)
+        {
+            unions.push_back(std::move(draft_shield_parts.back()));
+        }
+        draft_shield_parts.swap(unions);
+    }
+    Polygons draft_shield = draft_shield_parts.empty() ? Polygons() : std::move(draft_shield_parts[0]);
 
-    const int draft_shield_dist = getSettingInMicrons("draft_shield_dist");
+    const int draft_shield_dist = getSettingInMicrons(SettingKey::draft_shield_dist);
     storage.draft_protection_shield = draft_shield.approxConvexHull(draft_shield_dist);
 }
 
 void FffPolygonGenerator::processPlatformAdhesion(SliceDataStorage& storage)
 {
-    SettingsBaseVirtual* train = storage.meshgroup->getExtruderTrain(getSettingBoolean("adhesion_extruder_nr"));
-    switch(getSettingAsPlatformAdhesion("adhesion_type"))
+    SettingsBaseVirtual* train = storage.meshgroup->getExtruderTrain(getSettingBoolean(SettingKey::adhesion_extruder_nr));
+    switch(getSettingAsPlatformAdhesion(SettingKey::adhesion_type))
     {
     case EPlatformAdhesion::SKIRT:
-        if (!getSettingBoolean("draft_shield_enabled")
-            || (getSettingAsDraftShieldHeightLimitation("draft_shield_height_limitation") == DraftShieldHeightLimitation::LIMITED && getSettingInMicrons("draft_shield_height") == 0)) //Draft shield replaces skirt.
+        if (!getSettingBoolean(SettingKey::draft_shield_enabled)
+            || (getSettingAsDraftShieldHeightLimitation(SettingKey::draft_shield_height_limitation) == DraftShieldHeightLimitation::LIMITED && getSettingInMicrons(SettingKey::draft_shield_height) == 0)) //Draft shield replaces skirt.
         {
             constexpr bool outside_polygons_only = true;
-            generateSkirtBrim(storage, train->getSettingInMicrons("skirt_gap"), train->getSettingAsCount("skirt_line_count"), train->getSettingInMicrons("skirt_brim_minimal_length"), outside_polygons_only);
+            generateSkirtBrim(storage, train->getSettingInMicrons(SettingKey::skirt_gap), train->getSettingAsCount(SettingKey::skirt_line_count), train->getSettingInMicrons(SettingKey::skirt_brim_minimal_length), outside_polygons_only);
         }
         break;
     case EPlatformAdhesion::BRIM:
-        generateSkirtBrim(storage, 0, train->getSettingAsCount("brim_line_count"), train->getSettingInMicrons("skirt_brim_minimal_length"), train->getSettingBoolean("brim_outside_only"));
+        generateSkirtBrim(storage, 0, train->getSettingAsCount(SettingKey::brim_line_count), train->getSettingInMicrons(SettingKey::skirt_brim_minimal_length), train->getSettingBoolean(SettingKey::brim_outside_only));
         break;
     case EPlatformAdhesion::RAFT:
-        generateRaft(storage, train->getSettingInMicrons("raft_margin"));
+        generateRaft(storage, train->getSettingInMicrons(SettingKey::raft_margin));
         break;
     }
 }
 
 
-void FffPolygonGenerator::processFuzzyWalls(SliceMeshStorage& mesh)
+void FffPolygonGenerator::processFuzzyWalls(SliceMeshStorage& mesh, unsigned int mesh_idx)
 {
-    if (mesh.getSettingAsCount("wall_line_count") == 0)
+    if (mesh.getSettingAsCount(SettingKey::wall_line_count) == 0)
     {
         return;
     }
-    int64_t fuzziness = mesh.getSettingInMicrons("magic_fuzzy_skin_thickness");
-    int64_t avg_dist_between_points = mesh.getSettingInMicrons("magic_fuzzy_skin_point_dist");
+    int64_t fuzziness = mesh.getSettingInMicrons(SettingKey::magic_fuzzy_skin_thickness);
+    int64_t avg_dist_between_points = mesh.getSettingInMicrons(SettingKey::magic_fuzzy_skin_point_dist);
     int64_t min_dist_between_points = avg_dist_between_points * 3 / 4; // hardcoded: the point distance may vary between 3/4 and 5/4 the supplied value
     int64_t range_random_point_dist = avg_dist_between_points / 2;
-    for (unsigned int layer_nr = 0; layer_nr < mesh.layers.size(); layer_nr++)
+    const bool surface_mode = mesh.getSettingAsSurfaceMode(SettingKey::magic_mesh_surface_mode) == ESurfaceMode::SURFACE;
+    // each polygon draws its own random numbers, so that the layers can be processed in any order
+    ThreadPool::getInstance()->parallelForLayers(0, mesh.layers.size(), [&](int layer_nr)
     {
         SliceLayer& layer = mesh.layers[layer_nr];
-        for (SliceLayerPart& part : layer.parts)
+        for (unsigned int part_idx = 0; part_idx < layer.parts.size(); part_idx++)
         {
+            SliceLayerPart& part = layer.parts[part_idx];
             Polygons results;
-            Polygons& skin = (mesh.getSettingAsSurfaceMode("magic_mesh_surface_mode") == ESurfaceMode::SURFACE)? part.outline : part.insets[0];
-            for (PolygonRef poly : skin)
+            Polygons& skin = (surface_mode)? part.outline : part.insets[0];
+            results.reserve(skin.size());
+            for (unsigned int poly_idx = 0; poly_idx < skin.size(); poly_idx++)
             {
+                PolygonRef poly = skin[poly_idx];
+                CounterRandom random({mesh_idx, static_cast<uint64_t>(layer_nr), part_idx, poly_idx});
                 // generate points in between p0 and p1
                 PolygonRef result = results.newPoly();
-                
-                int64_t dist_left_over = rand() % (min_dist_between_points / 2); // the distance to be traversed on the line before making the first new point
+                result.reserve(poly.polygonLength() / min_dist_between_points + 3); // the new points are at least min_dist_between_points apart
+
+                int64_t dist_left_over = random.next(min_dist_between_points / 2); // the distance to be traversed on the line before making the first new point
                 Point* p0 = &poly.back();
                 for (Point& p1 : poly)
                 { // 'a' is the (next) new point between p0 and p1
                     Point p0p1 = p1 - *p0;
                     int64_t p0p1_size = vSize(p0p1);    
                     int64_t dist_last_point = dist_left_over + p0p1_size * 2; // so that p0p1_size - dist_last_point evaulates to dist_left_over - p0p1_size
-                    for (int64_t p0pa_dist = dist_left_over; p0pa_dist < p0p1_size; p0pa_dist += min_dist_between_points + rand() % range_random_point_dist)
+                    for (int64_t p0pa_dist = dist_left_over; p0pa_dist < p0p1_size; p0pa_dist += min_dist_between_points + random.next(range_random_point_dist))
                     {
-                        int r = rand() % (fuzziness * 2) - fuzziness;
+                        int r = random.next(fuzziness * 2) - fuzziness;
                         Point perp_to_p0p1 = turn90CCW(p0p1);
                         Point fuzz = normal(perp_to_p0p1, r);
                         Point pa = *p0 + normal(p0p1, p0pa_dist) + fuzz;
@@ -650,7 +1071,7 @@ void FffPolygonGenerator::processFuzzyWalls(SliceMeshStorage& mesh)
             }
             skin = results;
         }
-    }
+    });
 }
 
 
@@ -9,9 +9,10 @@
 #include "settings/settings.h"
 #include "sliceDataStorage.h"
 #include "commandSocket.h"
+#include "SliceContext.h"
 #include "PrintFeature.h"
-#include "progress/ProgressEstimator.h"
-#include "progress/ProgressStageEstimator.h"
+#include "progress/ProfilingReport.h"
+#include "utils/TaskGraph.h"
 
 namespace cura
 {
@@ -30,9 +31,13 @@ class FffPolygonGenerator : public SettingsMessenger, NoCopy
 public:
     /*!
      * Basic constructor
+     * 
+     * \param settings_ The settings to start from, which are replaced by those of each mesh group processed
+     * \param context What the slicing is done for, which should outlive this object
      */
-    FffPolygonGenerator(SettingsBase* settings_)
+    FffPolygonGenerator(SettingsBase* settings_, const SliceContext& context)
     : SettingsMessenger(settings_)
+    , context(context)
     {
     }
 
@@ -42,10 +47,20 @@ public:
      * \param object The object to slice.
      * \param timeKeeper Object which keeps track of timings of each stage.
      * \param storage Output parameter: where the outlines are stored. See SliceLayerPart::outline.
+     * \param use_slice_cache Whether the layers of the meshes are looked up in and stored in the SliceCache
      */
-    bool generateAreas(SliceDataStorage& storage, MeshGroup* object, TimeKeeper& timeKeeper);
+    bool generateAreas(SliceDataStorage& storage, MeshGroup* object, TimeKeeper& timeKeeper, bool use_slice_cache = true);
   
 private:
+    const SliceContext& context; //!< What the slicing is done for
+
+    static constexpr unsigned int layers_per_task = 4; //!< The number of layers of a mesh of which the insets or the skins are computed in a single task
+    // note: estimated time for     insets : skins = 22.953 : 48.858
+    static constexpr double inset_time_per_layer = 22.953; //!< The relative time it takes to compute the insets of a layer
+    static constexpr double skin_time_per_layer = 48.858; //!< The relative time it takes to compute the skins and infill of a layer
+    static constexpr double layer_cost_per_part = 50.0; //!< The estimated cost of each part of a layer, apart from its vertices, relative to the cost of a vertex
+    static constexpr double skin_layer_cost_factor = 4.0; //!< How much more a layer with skin is estimated to cost than a layer with only infill
+
     /*!
      * \brief Helper function to get the actual height of the draft shield.
      *
@@ -59,16 +74,30 @@ private:
      */
     unsigned int getDraftShieldHeight(unsigned int total_layers) const;
 
+    /*!
+     * Find the meshes which are a copy of an earlier mesh with the same settings, only moved in the horizontal plane.
+     * 
+     * Such a copy isn't sliced and its walls, skin and infill are those of the original, moved.
+     * This is only done for meshes of which neither the original nor the copy comes close to any other mesh,
+     * so that the overlap with other meshes and infill meshes don't change either of them.
+     * 
+     * \param meshgroup The meshes, before they are sliced
+     * \param[out] copy_offsets For each mesh, the offset of the copy relative to its original
+     * \return For each mesh, the index of the mesh it's a copy of, or -1 when it isn't a copy
+     */
+    std::vector<int> findMeshCopies(const MeshGroup& meshgroup, std::vector<Point>& copy_offsets) const;
+
     /*!
      * Slice the \p object and store the outlines in the \p storage.
      * 
      * \param object The object to slice.
      * \param timeKeeper Object which keeps track of timings of each stage.
      * \param storage Output parameter: where the outlines are stored. See SliceLayerPart::outline.
+     * \param use_slice_cache Whether the layers of the meshes are looked up in and stored in the SliceCache
      * 
      * \return Whether the process succeeded (always true).
      */
-    bool sliceModel(MeshGroup* object, TimeKeeper& timeKeeper, SliceDataStorage& storage); /// slices the model
+    bool sliceModel(MeshGroup* object, TimeKeeper& timeKeeper, SliceDataStorage& storage, bool use_slice_cache); /// slices the model
 
     /*!
      * Processes the outline information as stored in the \p storage: generates inset perimeter polygons, support area polygons, etc. 
@@ -79,16 +108,35 @@ private:
     void slices2polygons(SliceDataStorage& storage, TimeKeeper& timeKeeper);
     
     /*!
-     * Processes the outline information as stored in the \p storage: generates inset perimeter polygons, skin and infill
+     * Add the tasks which process the outline information as stored in the \p storage to the \p task_graph: generates inset perimeter polygons, skin and infill
+     * 
+     * The insets and the skins are each computed in tasks of \ref FffPolygonGenerator::layers_per_task layers,
+     * where the skin of a range of layers waits for the insets of the layers within the top and bottom skin distance.
      * 
      * \param storage Input and Output parameter: fetches the outline information (see SliceLayerPart::outline) and generates the other reachable field of the \p storage
      * \param mesh_order_idx The index of the mesh_idx in \p mesh_order to process in the vector of meshes in \p storage
      * \param mesh_order The order in which the meshes are processed (used for infill meshes)
      * \param total_layers The total number of layers over all objects
-     * \param inset_skin_progress_estimate The progress stage estimate calculator
+     * \param task_graph The graph to which to add the tasks
+     * \param mesh_tasks Input and Output parameter: for each mesh in \p mesh_order, the tasks which need to be finished before that mesh is done. The tasks of this mesh are added.
+     * \param report_progress Called with the estimated time of the work of each finished task
      */
-    void processBasicWallsSkinInfill(SliceDataStorage& storage, unsigned int mesh_order_idx, std::vector<unsigned int>& mesh_order, size_t total_layers, ProgressStageEstimator& inset_skin_progress_estimate);
+    void processBasicWallsSkinInfill(SliceDataStorage& storage, unsigned int mesh_order_idx, std::vector<unsigned int>& mesh_order, size_t total_layers, TaskGraph& task_graph, std::vector<std::vector<TaskGraph::TaskIdx>>& mesh_tasks, const std::function<void(double)>& report_progress);
     
+    /*!
+     * Estimate the cost of computing the walls, skin and infill of each layer of a mesh, from its outlines alone.
+     * 
+     * The cost grows with the number of vertices and the number of parts of the outlines of a layer,
+     * and is \ref FffPolygonGenerator::skin_layer_cost_factor times as high for a layer which is estimated to contain skin:
+     * a layer near the bottom or the top of the mesh, or of which the area differs from that of the layer
+     * at the bottom or top skin distance, which is where the skin ends up.
+     * 
+     * \param mesh The mesh, of which the layer parts have been created
+     * \param total_layers The total number of layers over all objects
+     * \param[out] layer_profiles The predictors and the estimated cost of each layer
+     */
+    void estimateLayerCosts(const SliceMeshStorage& mesh, size_t total_layers, std::vector<ProfilingReport::LayerProfile>& layer_profiles) const;
+
     /*!
      * Process the mesh to be an infill mesh: limit all outlines to within the infill of normal meshes and subtract their volume from the infill of those meshes
      * 
@@ -101,7 +149,7 @@ private:
     
     /*!
      * Process features which are derived from the basic walls, skin, and infill:
-     * fuzzy skin, infill combine
+     * gradual infill, infill combine
      * 
      * \param mesh Input and Output parameter: fetches the outline information (see SliceLayerPart::outline) and generates the other reachable field of the \p storage
      * \param total_layers The total number of layers over all objects
@@ -119,12 +167,29 @@ private:
      */
     void removeEmptyFirstLayers(SliceDataStorage& storage, const int layer_height, unsigned int& total_layers);
     
+    /*!
+     * The last layer of a mesh of which the insets were generated, so that the next layers with the same outlines can copy them.
+     */
+    struct InsetsMemo
+    {
+        const SliceLayer* layer = nullptr; //!< The layer of which the insets were generated, or nullptr if none yet
+        int inset_count = 0; //!< The number of insets generated for that layer
+        Polygons outlines; //!< The outlines of the parts of that layer before the insets were generated
+    };
+
     /*!
      * Generate the inset polygons which form the walls.
+     *
+     * Layers are often the same as the one below, in prismatic parts of a mesh. When the outlines and the number of insets
+     * are exactly the same as those of the layer in \p memo, its parts are copied with their insets instead.
+     *
+     * When spiralizing, the layers above the bottom layers only get the outer wall, since that's all which is printed of them.
+     *
      * \param mesh Input and Output parameter: fetches the outline information (see SliceLayerPart::outline) and generates the other reachable field of the \p storage
      * \param layer_nr The layer for which to generate the insets.
+     * \param memo The layer processed before by the same task, which may not be changed by other tasks in the meantime. Updated when the insets are generated.
      */
-    void processInsets(SliceMeshStorage& mesh, unsigned int layer_nr);
+    void processInsets(SliceMeshStorage& mesh, unsigned int layer_nr, InsetsMemo& memo);
 
     /*!
      * Generate the outline of the ooze shield.
@@ -162,9 +227,12 @@ private:
      * 
      * This only changes the outer wall.
      * 
+     * The random numbers are drawn per polygon, so the result doesn't depend on the order in which the layers and meshes are processed.
+     * 
      * \param[in,out] mesh where the outer wall is retrieved and stored in.
+     * \param mesh_idx The index of \p mesh, which is part of the seed of the random numbers
      */
-    void processFuzzyWalls(SliceMeshStorage& mesh);
+    void processFuzzyWalls(SliceMeshStorage& mesh, unsigned int mesh_idx);
 
 
 };
@@ -1,14 +1,69 @@
 #include "FffProcessor.h" 
 
+#include <algorithm> // mismatch, max
+#include <cmath> // ceil
+#include <exception> // exception_ptr
+#include <thread>
+
+#include "AreaCache.h"
+#include "SliceDataSnapshot.h"
+#include "progress/MemoryGovernor.h"
+#include "progress/ProfilingReport.h"
+#include "utils/memoryRelease.h"
+#include "utils/ThreadPool.h"
+
 namespace cura 
 {
 
 FffProcessor FffProcessor::instance; // definition must be in cpp
 
+namespace
+{
+
+/*!
+ * Change the settings of one settings base of a mesh group to those of its coarse preview, see FffProcessor::processPreview.
+ * 
+ * Every settings base of the mesh group gets the settings, since the front end sends most settings for each extruder train as well.
+ * 
+ * \param settings The mesh group, one of its extruder trains or one of its meshes
+ * \param preview_layer_height The minimal layer height of the preview in microns
+ * \param preview_maximum_deviation The minimal maximum deviation of the outlines of the preview in microns
+ */
+void setPreviewSettings(SettingsBase& settings, int64_t preview_layer_height, int64_t preview_maximum_deviation)
+{
+    const int64_t layer_height = settings.getSettingInMicrons(SettingKey::layer_height);
+    if (layer_height > 0 && layer_height < preview_layer_height)
+    {
+        settings.setSetting("layer_height", std::to_string(INT2MM(preview_layer_height)));
+        const int64_t infill_sparse_thickness = settings.getSettingInMicrons(SettingKey::infill_sparse_thickness);
+        settings.setSetting("infill_sparse_thickness", std::to_string(INT2MM(std::max(infill_sparse_thickness, preview_layer_height))));
+        // the skins keep their thickness, so that the estimate of the preview stays close to that of the full slice
+        const double layer_count_factor = double(layer_height) / preview_layer_height;
+        settings.setSetting("top_layers", std::to_string(int(std::ceil(settings.getSettingAsCount(SettingKey::top_layers) * layer_count_factor))));
+        settings.setSetting("bottom_layers", std::to_string(int(std::ceil(settings.getSettingAsCount(SettingKey::bottom_layers) * layer_count_factor))));
+    }
+    const int64_t maximum_deviation = settings.getSettingInMicrons(SettingKey::meshfix_maximum_deviation);
+    settings.setSetting("meshfix_maximum_deviation", std::to_string(INT2MM(std::max(maximum_deviation, preview_maximum_deviation))));
+    settings.setSetting("support_enable", "false");
+    settings.setSetting("adhesion_type", "none");
+    settings.setSetting("prime_tower_enable", "false");
+    settings.setSetting("ooze_shield_enabled", "false");
+    settings.setSetting("draft_shield_enabled", "false");
+    settings.setSetting("magic_fuzzy_skin_enabled", "false");
+}
+
+}//namespace
+
 FffProcessor::FffProcessor()
-: polygon_generator(this)
-, gcode_writer(this)
+: context(this, nullptr)
+, polygon_generator(this, context)
+, gcode_writer(this, context)
+, low_memory_compression(false)
+, area_estimate_only(false)
 , meshgroup_number(0)
+, reuse_slice_data(false)
+, pending_meshgroup(nullptr)
+, pending_profile_idx(0)
 {
 }
 
@@ -17,6 +72,26 @@ int FffProcessor::getMeshgroupNr()
     return meshgroup_number;
 }
 
+void FffProcessor::setCommandSocket(CommandSocket* command_socket)
+{
+    context.command_socket = command_socket;
+    gcode_writer.gcode.setCommandSocket(command_socket);
+}
+
+SettingsBase* FffProcessor::addOutputTarget(const char* filename)
+{
+    std::unique_ptr<OutputTarget> target(new OutputTarget(this, context, filename));
+    target->gcode_writer.setLowMemoryCompression(low_memory_compression);
+    if (!target->gcode_writer.setTargetFile(filename))
+    {
+        return nullptr;
+    }
+    target->gcode_writer.setEstimateOnly(gcode_writer.gcode.isEstimateOnly());
+    target->gcode_writer.setLayerRange(gcode_writer.layer_range_first, gcode_writer.layer_range_last);
+    output_targets.push_back(std::move(target));
+    return &output_targets.back()->settings;
+}
+
 
 std::string FffProcessor::getAllSettingsString(MeshGroup& meshgroup, bool first_meshgroup)
 {
@@ -39,7 +114,7 @@ std::string FffProcessor::getAllSettingsString(MeshGroup& meshgroup, bool first_
     for (unsigned int mesh_idx = 0; mesh_idx < meshgroup.meshes.size(); mesh_idx++)
     {
         Mesh& mesh = meshgroup.meshes[mesh_idx];
-        sstream << " -e" << mesh.getSettingAsIndex("extruder_nr") << " -l \"" << mesh_idx << "\"" << mesh.getAllLocalSettingsString();
+        sstream << " -e" << mesh.getSettingAsIndex(SettingKey::extruder_nr) << " -l \"" << mesh_idx << "\"" << mesh.getAllLocalSettingsString();
     }
     sstream << "\n";
     return sstream.str();
@@ -68,40 +143,369 @@ bool FffProcessor::processFiles(const std::vector< std::string >& files)
     return processMeshGroup(meshgroup);
 }
 
+std::vector<std::string> FffProcessor::getSettingValues(MeshGroup& meshgroup, const std::vector<std::string>& keys)
+{
+    std::vector<const SettingsBaseVirtual*> settings_bases = { this, &meshgroup };
+    for (int extruder_nr = 0; extruder_nr < meshgroup.getExtruderCount(); extruder_nr++)
+    {
+        settings_bases.push_back(meshgroup.getExtruderTrain(extruder_nr));
+    }
+    for (const Mesh& mesh : meshgroup.meshes)
+    {
+        settings_bases.push_back(&mesh);
+    }
+    std::vector<std::string> values;
+    values.reserve(settings_bases.size() * keys.size());
+    for (const SettingsBaseVirtual* settings_base : settings_bases)
+    {
+        for (const std::string& key : keys)
+        {
+            values.push_back(settings_base->getSettingString(key));
+        }
+    }
+    return values;
+}
+
+std::string FffProcessor::getAreaSnapshotFilename(const std::string& filename) const
+{
+    if (meshgroup_number == 0)
+    {
+        return filename;
+    }
+    return filename + "." + std::to_string(meshgroup_number);
+}
+
+std::unique_ptr<SliceDataStorage> FffProcessor::readAreaSnapshot(MeshGroup* meshgroup, const std::vector<uint64_t>& mesh_hashes, const std::string& filename)
+{
+    SliceDataSnapshot snapshot(filename);
+    if (!snapshot.isValid())
+    {
+        logWarning("%s doesn't contain the areas of a mesh group, so the mesh group is sliced.\n", filename.c_str());
+        return nullptr;
+    }
+    const SliceDataSnapshot::Validation& validation = snapshot.getValidation();
+    if (validation.mesh_hashes != mesh_hashes || getSettingValues(*meshgroup, validation.setting_keys) != validation.setting_values)
+    {
+        logWarning("The areas in %s are of other meshes or settings, so the mesh group is sliced.\n", filename.c_str());
+        return nullptr;
+    }
+    std::unique_ptr<SliceDataStorage> storage(new SliceDataStorage(meshgroup));
+    // only the layers written and the layers below them, over which their bridges are planned, are needed
+    const int first_layer = std::max(0, gcode_writer.layer_range_first - 1);
+    if (!snapshot.read(*storage, first_layer, gcode_writer.layer_range_last))
+    {
+        logError("%s is damaged, so the mesh group is sliced.\n", filename.c_str());
+        return nullptr;
+    }
+    log("Using the areas of the mesh group from %s\n", filename.c_str());
+    last_slicing_setting_keys = validation.setting_keys;
+    last_mesh_hashes.clear(); // only some layers may have been read, so the storage isn't reused for the next mesh group
+    if (context.command_socket)
+    {
+        for (const SliceDataStorage::LayerInfo& layer_info : storage->layer_infos)
+        {
+            context.command_socket->sendOptimizedLayerInfo(layer_info.layer_nr, layer_info.z, layer_info.thickness);
+        }
+    }
+    return storage;
+}
+
+bool FffProcessor::writeAreaSnapshot(const SliceDataStorage& storage, MeshGroup& meshgroup, const std::vector<uint64_t>& mesh_hashes, const std::string& filename)
+{
+    SliceDataSnapshot::Validation validation;
+    validation.mesh_hashes = mesh_hashes;
+    validation.setting_keys = last_slicing_setting_keys;
+    validation.setting_values = getSettingValues(meshgroup, last_slicing_setting_keys);
+    if (!SliceDataSnapshot::write(storage, validation, filename))
+    {
+        return false;
+    }
+    log("Wrote the areas of the mesh group to %s\n", filename.c_str());
+    return true;
+}
+
+std::unique_ptr<SliceDataStorage> FffProcessor::readCachedAreas(MeshGroup* meshgroup, const std::vector<uint64_t>& mesh_hashes)
+{
+    AreaCache* cache = AreaCache::getInstance();
+    std::vector<std::string> setting_keys;
+    if (!cache->getSettingKeys(mesh_hashes, setting_keys))
+    {
+        return nullptr;
+    }
+    const std::string filename = cache->getSnapshot(mesh_hashes, getSettingValues(*meshgroup, setting_keys));
+    if (filename.empty())
+    {
+        return nullptr;
+    }
+    return readAreaSnapshot(meshgroup, mesh_hashes, filename);
+}
+
+void FffProcessor::saveAreas(const SliceDataStorage& storage, MeshGroup& meshgroup, const std::vector<uint64_t>& mesh_hashes)
+{
+    if (!area_snapshot_output.empty())
+    {
+        writeAreaSnapshot(storage, meshgroup, mesh_hashes, getAreaSnapshotFilename(area_snapshot_output));
+    }
+    AreaCache* cache = AreaCache::getInstance();
+    if (cache->isEnabled())
+    {
+        const std::vector<std::string> setting_values = getSettingValues(meshgroup, cache->addSettingKeys(mesh_hashes, last_slicing_setting_keys));
+        if (writeAreaSnapshot(storage, meshgroup, mesh_hashes, cache->getSnapshotFilename(mesh_hashes, setting_values)))
+        {
+            cache->store(mesh_hashes, setting_values);
+        }
+    }
+}
+
+std::unique_ptr<SliceDataStorage> FffProcessor::generateAreas(MeshGroup* meshgroup)
+{
+    // the meshes are cleared while slicing, so they are hashed beforehand
+    std::vector<uint64_t> mesh_hashes;
+    const bool save_areas = !area_snapshot_output.empty() || AreaCache::getInstance()->isEnabled();
+    if (reuse_slice_data || save_areas || !area_snapshot_input.empty())
+    {
+        for (const Mesh& mesh : meshgroup->meshes)
+        {
+            mesh_hashes.push_back(mesh.getGeometryHash());
+        }
+    }
+    if (!area_snapshot_input.empty() || AreaCache::getInstance()->isEnabled())
+    {
+        std::unique_ptr<SliceDataStorage> storage = !area_snapshot_input.empty()
+            ? readAreaSnapshot(meshgroup, mesh_hashes, getAreaSnapshotFilename(area_snapshot_input))
+            : readCachedAreas(meshgroup, mesh_hashes);
+        if (storage)
+        {
+            return storage;
+        }
+    }
+
+    if (!reuse_slice_data)
+    {
+        std::unique_ptr<SliceDataStorage> storage(new SliceDataStorage(meshgroup));
+        const bool record_settings = !output_targets.empty() || save_areas;
+        if (record_settings)
+        { // record what the sliced data depends on, which the output targets may not change and against which the saved areas are checked
+            SettingReadRecorder::start();
+        }
+        const bool success = polygon_generator.generateAreas(*storage, meshgroup, time_keeper);
+        if (record_settings)
+        {
+            last_slicing_setting_keys = SettingReadRecorder::stop();
+        }
+        if (!success)
+        {
+            return nullptr;
+        }
+        if (save_areas)
+        {
+            saveAreas(*storage, *meshgroup, mesh_hashes);
+        }
+        return storage;
+    }
+
+    std::unique_ptr<SliceDataStorage> storage = std::move(last_storage);
+    if (storage && mesh_hashes == last_mesh_hashes && getSettingValues(*meshgroup, last_slicing_setting_keys) == last_slicing_setting_values)
+    {
+        log("Reusing the sliced data of the last mesh group, because no setting it depends on has changed.\n");
+        storage->setMeshGroup(meshgroup);
+        // pointing the storage to the new mesh group invalidated the settings caches
+        buildSettingsCache();
+        meshgroup->buildSettingsCaches();
+        if (context.command_socket)
+        {
+            for (const SliceDataStorage::LayerInfo& layer_info : storage->layer_infos)
+            {
+                context.command_socket->sendOptimizedLayerInfo(layer_info.layer_nr, layer_info.z, layer_info.thickness);
+            }
+        }
+        return storage;
+    }
+
+    SettingReadRecorder::start(); // record everything the sliced data depends on
+    storage.reset(new SliceDataStorage(meshgroup));
+    const bool success = polygon_generator.generateAreas(*storage, meshgroup, time_keeper);
+    last_slicing_setting_keys = SettingReadRecorder::stop();
+    if (!success)
+    {
+        return nullptr;
+    }
+    last_mesh_hashes = mesh_hashes;
+    last_slicing_setting_values = getSettingValues(*meshgroup, last_slicing_setting_keys);
+    if (save_areas)
+    {
+        saveAreas(*storage, *meshgroup, mesh_hashes);
+    }
+    return storage;
+}
+
+bool FffProcessor::canPipeline(MeshGroup& meshgroup)
+{
+    return meshgroup.getSettingBoolean(SettingKey::pipeline_mesh_groups)
+        && !meshgroup.getSettingBoolean(SettingKey::wireframe_enabled)
+        && !reuse_slice_data
+        && !area_estimate_only
+        && output_targets.empty()
+        && !context.command_socket;
+}
+
+void FffProcessor::writeOutputTargets(SliceDataStorage& storage, MeshGroup* meshgroup, bool release_layers)
+{
+    std::vector<OutputTarget*> accepted_targets;
+    for (std::unique_ptr<OutputTarget>& target : output_targets)
+    {
+        if (target->rejected)
+        {
+            continue;
+        }
+        const std::vector<std::string> sliced_values = getSettingValues(*meshgroup, last_slicing_setting_keys);
+        meshgroup->setParent(&target->settings);
+        const std::vector<std::string> target_values = getSettingValues(*meshgroup, last_slicing_setting_keys);
+        meshgroup->setParent(this);
+        const auto difference = std::mismatch(sliced_values.begin(), sliced_values.end(), target_values.begin());
+        if (difference.first != sliced_values.end())
+        {
+            const std::string& key = last_slicing_setting_keys[(difference.first - sliced_values.begin()) % last_slicing_setting_keys.size()];
+            logError("The output target %s changes %s, which the sliced data depends on, so no gcode is written for it.\n", target->filename.c_str(), key.c_str());
+            target->rejected = true;
+            continue;
+        }
+        accepted_targets.push_back(target.get());
+    }
+
+    for (unsigned int target_idx = 0; target_idx < accepted_targets.size(); target_idx++)
+    {
+        OutputTarget& target = *accepted_targets[target_idx];
+        if (context.isCancelled())
+        {
+            return;
+        }
+        meshgroup->setParent(&target.settings);
+        target.gcode_writer.setParent(meshgroup);
+        buildSettingsCache();
+        meshgroup->buildSettingsCaches();
+
+        TimeKeeper target_time_keeper;
+        target.gcode_writer.writeGCode(storage, target_time_keeper, release_layers && target_idx + 1 == accepted_targets.size());
+
+        meshgroup->setParent(this);
+        target.gcode_writer.setParent(&target.settings);
+    }
+    buildSettingsCache();
+    meshgroup->buildSettingsCaches();
+}
+
+void FffProcessor::writePendingGCode()
+{
+    ProfilingReport::getInstance().continueMeshGroup(pending_profile_idx);
+    TimeKeeper export_time_keeper; // FffProcessor::time_keeper times the mesh group being sliced meanwhile
+    gcode_writer.writeGCode(*pending_storage, export_time_keeper, true);
+}
+
+void FffProcessor::finishPendingMeshGroup()
+{
+    pending_storage.reset();
+    releaseFreedMemory();
+    finishMeshGroup(*pending_meshgroup, pending_time_keeper_total);
+    pending_meshgroup = nullptr;
+}
+
+void FffProcessor::flushPendingMeshGroup()
+{
+    if (!pending_meshgroup)
+    {
+        return;
+    }
+    pending_meshgroup->buildSettingsCaches(); // settings may have been set since, which invalidated the caches
+    writePendingGCode();
+    finishPendingMeshGroup();
+}
+
+void FffProcessor::finishMeshGroup(MeshGroup& meshgroup, TimeKeeper& time_keeper_total)
+{
+    Progress::messageProgress(Progress::Stage::FINISH, 1, 1, context.command_socket); // 100% on this meshgroup
+    if (context.command_socket)
+    {
+        context.command_socket->flushGcode();
+        context.command_socket->sendOptimizedLayerData();
+        context.command_socket->sendProfilingReport(meshgroup_number);
+    }
+    log("Total time elapsed %5.2fs.\n", time_keeper_total.restart());
+
+    profile_string += getAllSettingsString(meshgroup, meshgroup_number == 0);
+    meshgroup_number++;
+
+    gcode_writer.setParent(this); // otherwise consequent getSetting calls (e.g. for finalize) will refer to non-existent meshgroup
+}
+
 bool FffProcessor::processMeshGroup(MeshGroup* meshgroup)
 {
-    if (SHOW_ALL_SETTINGS) { logWarning(getAllSettingsString(*meshgroup, meshgroup_number == 0).c_str()); }
+    if (SHOW_ALL_SETTINGS) { logWarning(getAllSettingsString(*meshgroup, meshgroup_number == 0 && !pending_meshgroup).c_str()); }
     time_keeper.restart();
     if (!meshgroup)
         return false;
-
-    TimeKeeper time_keeper_total;
-
-    polygon_generator.setParent(meshgroup);
-    gcode_writer.setParent(meshgroup);
+    if (context.isCancelled())
+    {
+        log("Skipping the mesh group, because the slicing was cancelled.\n");
+        return false;
+    }
+    if (!meshgroup->inClipperLowRange())
+    {
+        logError("The mesh group lies more than %dm from the origin, which is too far to slice.\n", MeshGroup::max_mesh_coordinate / 1000000);
+        return false;
+    }
 
     bool empty = true;
     for (Mesh& mesh : meshgroup->meshes)
     {
-        if (!mesh.getSettingBoolean("infill_mesh"))
+        if (!mesh.getSettingBoolean(SettingKey::infill_mesh))
         {
             empty = false;
         }
     }
+    MemoryGovernor& memory_governor = MemoryGovernor::getInstance();
+    memory_governor.setBudget(size_t(std::max(0, meshgroup->getSettingAsCount(SettingKey::memory_budget))) << 20);
+    const bool pipeline = !empty && canPipeline(*meshgroup);
+    if (!pipeline || (pending_meshgroup && memory_governor.isUnderPressure("overlap_mesh_groups")))
+    { // close to the memory budget the previous mesh group is written before this one is sliced, rather than at the same time
+        flushPendingMeshGroup();
+    }
+
+    if (meshgroup_number == 0)
+    { // first meshgroup
+        area_estimate.reset();
+    }
+
+    TimeKeeper time_keeper_total;
+    const unsigned int profile_idx = ProfilingReport::getInstance().startMeshGroup();
+
+    polygon_generator.setParent(meshgroup);
+    if (!pending_meshgroup)
+    {
+        gcode_writer.setParent(meshgroup);
+    } // otherwise the gcode writer is set to the mesh group it is about to write
+
+    ThreadPool::getInstance()->setThreadCount(meshgroup->getSettingAsCount(SettingKey::slicing_thread_count), meshgroup->getSettingBoolean(SettingKey::slicing_thread_pinning));
+    Polygons::setTilingPointCount(std::max(0, meshgroup->getSettingAsCount(SettingKey::polygon_tiling_point_count)));
+
+    // resolve all settings once, so that the settings used in the loops over layers and parts don't need to be looked up through all settings bases
+    buildSettingsCache();
+    meshgroup->buildSettingsCaches();
+
     if (empty)
     {
-        Progress::messageProgress(Progress::Stage::FINISH, 1, 1); // 100% on this meshgroup
+        Progress::messageProgress(Progress::Stage::FINISH, 1, 1, context.command_socket); // 100% on this meshgroup
         log("Total time elapsed %5.2fs.\n", time_keeper_total.restart());
 
         profile_string += getAllSettingsString(*meshgroup, meshgroup_number == 0);
         return true;
     }
     
-    if (meshgroup->getSettingBoolean("wireframe_enabled"))
+    if (meshgroup->getSettingBoolean(SettingKey::wireframe_enabled))
     {
         log("starting Neith Weaver...\n");
                     
-        Weaver w(this);
+        Weaver w(this, context.command_socket);
         w.weave(meshgroup);
         
         log("starting Neith Gcode generation...\n");
@@ -111,31 +515,194 @@ bool FffProcessor::processMeshGroup(MeshGroup* meshgroup)
         
     } else 
     {
-        SliceDataStorage storage(meshgroup);
-
-        if (!polygon_generator.generateAreas(storage, meshgroup, time_keeper))
+        // write the gcode of the previous mesh group while this one is sliced
+        std::thread pending_writer;
+        std::exception_ptr pending_writer_exception;
+        if (pending_meshgroup)
+        {
+            pending_meshgroup->buildSettingsCaches(); // its settings caches were invalidated when the settings of this mesh group were set
+            pending_writer = std::thread([this, &pending_writer_exception]()
+                {
+                    try
+                    {
+                        writePendingGCode();
+                    }
+                    catch (...)
+                    {
+                        pending_writer_exception = std::current_exception();
+                    }
+                });
+        }
+        std::unique_ptr<SliceDataStorage> storage;
+        try
+        {
+            storage = generateAreas(meshgroup);
+        }
+        catch (...)
         {
+            if (pending_writer.joinable())
+            {
+                pending_writer.join();
+            }
+            throw;
+        }
+        if (pending_writer.joinable())
+        {
+            pending_writer.join();
+            if (pending_writer_exception)
+            {
+                std::rethrow_exception(pending_writer_exception);
+            }
+            finishPendingMeshGroup();
+            gcode_writer.setParent(meshgroup);
+        }
+        if (!storage)
+        {
+            if (context.isCancelled())
+            {
+                log("Slicing was cancelled, so the sliced data of the mesh group is dropped.\n");
+            }
+            polygon_generator.setParent(this);
+            gcode_writer.setParent(this);
             return false;
         }
         
-        Progress::messageProgressStage(Progress::Stage::EXPORT, &time_keeper);
-        gcode_writer.writeGCode(storage, time_keeper);
+        size_t layer_data_memory_budget = static_cast<size_t>(std::max(0, meshgroup->getSettingAsCount(SettingKey::layer_data_memory_budget))) * 1024 * 1024;
+        bool compress_layers = meshgroup->getSettingBoolean(SettingKey::layer_data_compression) || layer_data_memory_budget > 0;
+        if (!compress_layers && !area_estimate_only && memory_governor.isUnderPressure("compress_layer_data"))
+        {
+            compress_layers = true;
+        }
+        if (compress_layers && layer_data_memory_budget == 0 && memory_governor.isUnderPressure("spill_layer_data", true))
+        { // the headroom is measured before compressing, so rather more layers are spilled than needed
+            layer_data_memory_budget = std::max(size_t(1), memory_governor.getHeadroom());
+        }
+        if (compress_layers && !area_estimate_only)
+        { // each layer is decompressed again just before its gcode is planned
+            storage->compressLayers(layer_data_memory_budget);
+        }
+
+        Progress::messageProgressStage(Progress::Stage::EXPORT, &time_keeper, context.command_socket);
+        if (pipeline && !memory_governor.isUnderPressure("defer_mesh_group_gcode"))
+        { // at most the sliced data of this and the next mesh group are kept at the same time
+            pending_meshgroup = meshgroup;
+            pending_storage = std::move(storage);
+            pending_profile_idx = profile_idx;
+            pending_time_keeper_total = time_keeper_total;
+            polygon_generator.setParent(this);
+            return true;
+        }
+        if (area_estimate_only)
+        { // no paths are planned at all
+            area_estimate.add(*storage);
+        }
+        else
+        {
+            const bool release_layers = !reuse_slice_data; // the reused storage is written again for the next mesh group
+            gcode_writer.writeGCode(*storage, time_keeper, release_layers && output_targets.empty());
+            writeOutputTargets(*storage, meshgroup, release_layers);
+        }
+
+        if (context.isCancelled())
+        { // the gcode of the mesh group is incomplete, so it isn't reported as done
+            log("Slicing was cancelled while writing the gcode.\n");
+            polygon_generator.setParent(this);
+            gcode_writer.setParent(this);
+            return false;
+        }
+        if (reuse_slice_data)
+        {
+            last_storage = std::move(storage);
+        }
     }
+    releaseFreedMemory(); // the sliced data of the mesh group has been freed, unless it's kept for reuse
+
+    finishMeshGroup(*meshgroup, time_keeper_total);
 
-    Progress::messageProgress(Progress::Stage::FINISH, 1, 1); // 100% on this meshgroup
-    if (CommandSocket::isInstantiated())
+    polygon_generator.setParent(this); // otherwise consequent getSetting calls (e.g. for finalize) will refer to non-existent meshgroup
+
+    return true;
+}
+
+bool FffProcessor::processPreview(MeshGroup* meshgroup, AreaEstimate& estimate)
+{
+    if (!meshgroup || context.isCancelled() || !meshgroup->inClipperLowRange() || meshgroup->getSettingBoolean(SettingKey::wireframe_enabled))
     {
-        CommandSocket::getInstance()->flushGcode();
-        CommandSocket::getInstance()->sendOptimizedLayerData();
+        return false;
     }
-    log("Total time elapsed %5.2fs.\n", time_keeper_total.restart());
+    TimeKeeper time_keeper_total;
 
-    profile_string += getAllSettingsString(*meshgroup, meshgroup_number == 0);
-    meshgroup_number++;
+    const int64_t layer_height = meshgroup->getSettingInMicrons(SettingKey::layer_height);
+    const int64_t preview_layer_height = std::max(layer_height, int64_t(getSettingInMicrons(SettingKey::preview_layer_height)));
+    const int64_t preview_maximum_deviation = getSettingInMicrons(SettingKey::preview_maximum_deviation);
+    setPreviewSettings(*meshgroup, preview_layer_height, preview_maximum_deviation);
+    for (int extruder_nr = 0; extruder_nr < meshgroup->getExtruderCount(); extruder_nr++)
+    {
+        setPreviewSettings(*meshgroup->getExtruderTrain(extruder_nr), preview_layer_height, preview_maximum_deviation);
+    }
+    for (Mesh& mesh : meshgroup->meshes)
+    {
+        setPreviewSettings(mesh, preview_layer_height, preview_maximum_deviation);
+    }
+    AreaEstimate::Calibration calibration;
+    calibration.time_factor = (layer_height > 0)? double(preview_layer_height) / layer_height : 1.0; // the full slice has more layers, each of which takes about as long
+    estimate.setCalibration(calibration);
 
-    polygon_generator.setParent(this); // otherwise consequent getSetting calls (e.g. for finalize) will refer to non-existent meshgroup
-    gcode_writer.setParent(this); // otherwise consequent getSetting calls (e.g. for finalize) will refer to non-existent meshgroup
+    ProfilingReport::getInstance().startMeshGroup();
+    polygon_generator.setParent(meshgroup);
+    ThreadPool::getInstance()->setThreadCount(meshgroup->getSettingAsCount(SettingKey::slicing_thread_count), meshgroup->getSettingBoolean(SettingKey::slicing_thread_pinning));
+    Polygons::setTilingPointCount(std::max(0, meshgroup->getSettingAsCount(SettingKey::polygon_tiling_point_count)));
+    buildSettingsCache();
+    meshgroup->buildSettingsCaches();
 
+    SliceDataStorage storage(meshgroup);
+    TimeKeeper time_keeper;
+    const bool success = polygon_generator.generateAreas(storage, meshgroup, time_keeper, false); // the coarse layers of the preview would only push the layers of full slices out of the cache
+    polygon_generator.setParent(this);
+    if (!success)
+    {
+        return false;
+    }
+    estimate.add(storage);
+
+    if (context.command_socket)
+    { // only the walls are sent, which is enough to see the shape of each layer
+        unsigned int layer_count = 0;
+        for (const SliceMeshStorage& mesh : storage.meshes)
+        {
+            layer_count = std::max(layer_count, static_cast<unsigned int>(mesh.layers.size()));
+        }
+        for (unsigned int layer_nr = 0; layer_nr < layer_count; layer_nr++)
+        {
+            context.command_socket->setLayerForSend(layer_nr);
+            for (const SliceMeshStorage& mesh : storage.meshes)
+            {
+                if (layer_nr >= mesh.layers.size())
+                {
+                    continue;
+                }
+                context.command_socket->setExtruderForSend(mesh.getSettingAsIndex(SettingKey::extruder_nr));
+                const int wall_line_width_0 = mesh.getSettingInMicrons(SettingKey::wall_line_width_0);
+                const int wall_line_width_x = mesh.getSettingInMicrons(SettingKey::wall_line_width_x);
+                for (const SliceLayerPart& part : mesh.layers[layer_nr].parts)
+                {
+                    for (unsigned int inset_idx = 0; inset_idx < part.insets.size(); inset_idx++)
+                    {
+                        if (inset_idx == 0)
+                        {
+                            context.command_socket->sendPolygons(PrintFeatureType::OuterWall, part.insets[inset_idx], wall_line_width_0);
+                        }
+                        else
+                        {
+                            context.command_socket->sendPolygons(PrintFeatureType::InnerWall, part.insets[inset_idx], wall_line_width_x);
+                        }
+                    }
+                }
+            }
+        }
+        context.command_socket->sendOptimizedLayerData();
+    }
+    log("Preview of the mesh group sliced in %5.2fs.\n", time_keeper_total.restart());
     return true;
 }
 
@@ -1,9 +1,13 @@
 #ifndef FFF_PROCESSOR_H
 #define FFF_PROCESSOR_H
 
+#include <memory> // unique_ptr
+
 #include "settings/settings.h"
+#include "AreaEstimate.h"
 #include "FffGcodeWriter.h"
 #include "FffPolygonGenerator.h"
+#include "SliceContext.h"
 #include "commandSocket.h"
 #include "Weaver.h"
 #include "Wireframe2gcode.h"
@@ -15,19 +19,26 @@
 
 namespace cura {
 
-//FusedFilamentFabrication processor. Singleton class
+/*!
+ * FusedFilamentFabrication processor.
+ * 
+ * The slicing pipeline only refers to the processor it is run by, through its SliceContext,
+ * so that several processors can slice independently in the same process.
+ * The process-wide instance is the one used by the command line and by the command socket.
+ */
 class FffProcessor : public SettingsBase , NoCopy
 {
 private:
     /*!
-     * The FffProcessor used for the (current) slicing (The instance of this singleton)
+     * The FffProcessor used by the command line and the command socket
      */
     static FffProcessor instance; 
     
-    FffProcessor();
 public:
+    FffProcessor();
+
     /*!
-     * Get the instance
+     * Get the process-wide instance
      * \return The instance
      */
     static FffProcessor* getInstance() 
@@ -40,7 +51,46 @@ public:
      */
     int getMeshgroupNr();
 
+    /*!
+     * Set where to send the progress, the layer view and the gcode of the slicing to.
+     * 
+     * \param command_socket The command socket, or nullptr to only write the gcode to the target file or stream
+     */
+    void setCommandSocket(CommandSocket* command_socket);
+
+    /*!
+     * Stop the slicing as soon as possible, from any thread.
+     * 
+     * The slicing stops at the start of the next layer it processes, after which FffProcessor::processMeshGroup returns false
+     * without keeping anything of the mesh group. Mesh groups processed after that are skipped as well until FffProcessor::clearCancellation.
+     */
+    void cancel()
+    {
+        context.cancelled = true;
+    }
+
+    /*!
+     * Whether FffProcessor::cancel was called since the last FffProcessor::clearCancellation.
+     */
+    bool isCancelled() const
+    {
+        return context.isCancelled();
+    }
+
+    /*!
+     * Allow slicing again after FffProcessor::cancel, to start a new slicing.
+     */
+    void clearCancellation()
+    {
+        context.cancelled = false;
+    }
+
 private:
+    /*!
+     * What the slicing by this processor is done for, which the polygon generator and the gcode writer refer to.
+     */
+    SliceContext context;
+
     /*!
      * The polygon generator, which slices the models and generates all polygons to be printed and areas to be filled.
      */
@@ -51,6 +101,48 @@ private:
      */
     FffGcodeWriter gcode_writer;
 
+    /*!
+     * A gcode file written from the same sliced data as the main output, with different settings which slicing doesn't depend on,
+     * e.g. for a machine variant with another gcode flavor, start and end gcode or speeds.
+     */
+    struct OutputTarget
+    {
+        /*!
+         * The settings which differ from the global settings, with the global settings as parent.
+         * 
+         * While the gcode of the target is written, the mesh group gets its settings from here instead of from the global settings.
+         */
+        SettingsBase settings;
+        std::string filename; //!< The file to which the gcode is written
+        FffGcodeWriter gcode_writer; //!< Writes the gcode of this target, keeping its own state of the printer between mesh groups
+        bool rejected; //!< Whether a setting of this target would have changed the sliced data, so that no gcode is written for it
+
+        OutputTarget(FffProcessor* processor, const SliceContext& context, const std::string& filename)
+        : settings(processor)
+        , filename(filename)
+        , gcode_writer(&settings, context)
+        , rejected(false)
+        {
+        }
+    };
+
+    /*!
+     * The targets to which gcode is written in addition to FffProcessor::gcode_writer, one after another, from the same sliced data.
+     */
+    std::vector<std::unique_ptr<OutputTarget>> output_targets;
+
+    bool low_memory_compression; //!< Whether gzip compressed gcode files are compressed with a small window, see FffProcessor::setLowMemoryCompression
+
+    /*!
+     * Whether the estimates are computed from the sliced areas by FffProcessor::area_estimate, instead of by writing the gcode.
+     */
+    bool area_estimate_only;
+
+    /*!
+     * The estimate of the sliced areas of the mesh groups, if FffProcessor::area_estimate_only.
+     */
+    AreaEstimate area_estimate;
+
     /*!
      * The index of the meshgroup currently being processed, starting at zero.
      */
@@ -63,6 +155,147 @@ private:
      */
     std::string profile_string = "";
 
+    /*!
+     * Whether to keep the sliced data of the last mesh group, so that it can be reused for a next mesh group which only differs from it in settings which slicing doesn't depend on.
+     */
+    bool reuse_slice_data;
+
+    /*!
+     * The sliced data of the last mesh group, if FffProcessor::reuse_slice_data.
+     */
+    std::unique_ptr<SliceDataStorage> last_storage;
+
+    /*!
+     * The mesh group of which the areas have been generated, but of which the gcode is yet to be written, if mesh groups are pipelined.
+     * 
+     * Its gcode is written while the next mesh group is sliced, or when the processing is finalized.
+     */
+    MeshGroup* pending_meshgroup;
+    std::unique_ptr<SliceDataStorage> pending_storage; //!< The sliced data of FffProcessor::pending_meshgroup
+    unsigned int pending_profile_idx; //!< The index of FffProcessor::pending_meshgroup in the ProfilingReport
+    TimeKeeper pending_time_keeper_total; //!< Started when FffProcessor::pending_meshgroup started to be processed
+
+    std::vector<uint64_t> last_mesh_hashes; //!< The geometry hash of each mesh of the last mesh group
+    std::vector<std::string> last_slicing_setting_keys; //!< The settings which were read while slicing the last mesh group
+    std::vector<std::string> last_slicing_setting_values; //!< The values of FffProcessor::last_slicing_setting_keys in the last mesh group, see FffProcessor::getSettingValues
+
+    /*!
+     * Get the values of some settings in all settings bases of a mesh group: the global settings, the mesh group, its extruder trains and its meshes.
+     * 
+     * When these are the same for two mesh groups, reading any of these settings anywhere gives the same result.
+     * 
+     * \param meshgroup The mesh group
+     * \param keys The settings to get
+     * \return The values of the settings, per settings base
+     */
+    std::vector<std::string> getSettingValues(MeshGroup& meshgroup, const std::vector<std::string>& keys);
+
+    std::string area_snapshot_input; //!< The SliceDataSnapshot file from which to read the areas instead of slicing, or empty to always slice
+    std::string area_snapshot_output; //!< The SliceDataSnapshot file to which to write the areas after slicing, or empty
+
+    /*!
+     * Get the name of the snapshot file of the current mesh group: the given name for the first mesh group,
+     * followed by the number of the mesh group for the others.
+     * 
+     * \param filename The file name given for the snapshots
+     */
+    std::string getAreaSnapshotFilename(const std::string& filename) const;
+
+    /*!
+     * Read the areas of a mesh group from a SliceDataSnapshot file, if they are of the same meshes and settings.
+     * 
+     * Only the areas of the layers written by the gcode writer are read, see FffGcodeWriter::setLayerRange.
+     * 
+     * \param meshgroup The mesh group of which to read the areas
+     * \param mesh_hashes The geometry hash of each mesh of \p meshgroup
+     * \param filename The snapshot file
+     * \return The sliced data, or nullptr if the mesh group has to be sliced
+     */
+    std::unique_ptr<SliceDataStorage> readAreaSnapshot(MeshGroup* meshgroup, const std::vector<uint64_t>& mesh_hashes, const std::string& filename);
+
+    /*!
+     * Write the areas of a mesh group to a SliceDataSnapshot file, with the settings read while slicing it.
+     * 
+     * \param storage The sliced data of the mesh group
+     * \param meshgroup The mesh group
+     * \param mesh_hashes The geometry hash of each mesh of \p meshgroup, from before slicing
+     * \param filename The file to write
+     * \return Whether the file was written
+     */
+    bool writeAreaSnapshot(const SliceDataStorage& storage, MeshGroup& meshgroup, const std::vector<uint64_t>& mesh_hashes, const std::string& filename);
+
+    /*!
+     * Read the areas of a mesh group from the AreaCache, if it has them for the same meshes and settings.
+     * 
+     * \param meshgroup The mesh group of which to read the areas
+     * \param mesh_hashes The geometry hash of each mesh of \p meshgroup
+     * \return The sliced data, or nullptr if the mesh group has to be sliced
+     */
+    std::unique_ptr<SliceDataStorage> readCachedAreas(MeshGroup* meshgroup, const std::vector<uint64_t>& mesh_hashes);
+
+    /*!
+     * Write the areas of a mesh group which has just been sliced to FffProcessor::area_snapshot_output and to the AreaCache.
+     * 
+     * \param storage The sliced data of the mesh group
+     * \param meshgroup The mesh group
+     * \param mesh_hashes The geometry hash of each mesh of \p meshgroup, from before slicing
+     */
+    void saveAreas(const SliceDataStorage& storage, MeshGroup& meshgroup, const std::vector<uint64_t>& mesh_hashes);
+
+    /*!
+     * Generate the areas of a mesh group, or reuse those of the last mesh group if this mesh group has the same meshes
+     * and only differs in settings which weren't read while the areas of the last mesh group were generated.
+     * 
+     * \param meshgroup The mesh group for which to generate the areas
+     * \return The sliced data, or nullptr if slicing failed
+     */
+    std::unique_ptr<SliceDataStorage> generateAreas(MeshGroup* meshgroup);
+
+    /*!
+     * Whether the gcode of a mesh group may be written while the next mesh group is sliced.
+     * 
+     * The sliced data is only kept for the front end, which also receives the progress and layer data of a single mesh group at a time.
+     * 
+     * \param meshgroup The mesh group
+     */
+    bool canPipeline(MeshGroup& meshgroup);
+
+    /*!
+     * Write the gcode of a mesh group to each of the FffProcessor::output_targets, after it has been written to the main output.
+     * 
+     * Rejects the targets which change a setting read while slicing, see FffProcessor::last_slicing_setting_keys.
+     * 
+     * \param storage The sliced data of the mesh group
+     * \param meshgroup The mesh group
+     * \param release_layers Whether the last target may release the layers of \p storage once they're written
+     */
+    void writeOutputTargets(SliceDataStorage& storage, MeshGroup* meshgroup, bool release_layers);
+
+    /*!
+     * Write the gcode of FffProcessor::pending_meshgroup.
+     * 
+     * Only uses the mesh group, its sliced data and the gcode writer, so that it can be called on another thread while the next mesh group is sliced.
+     */
+    void writePendingGCode();
+
+    /*!
+     * Report that FffProcessor::pending_meshgroup is done and release it, after its gcode has been written.
+     */
+    void finishPendingMeshGroup();
+
+    /*!
+     * Write the gcode of FffProcessor::pending_meshgroup if there is one, on the calling thread.
+     */
+    void flushPendingMeshGroup();
+
+    /*!
+     * Report that the gcode of a mesh group has been written, and restore the settings parent of the gcode writer.
+     * 
+     * \param meshgroup The mesh group
+     * \param time_keeper_total Started when the mesh group started to be processed
+     */
+    void finishMeshGroup(MeshGroup& meshgroup, TimeKeeper& time_keeper_total);
+
     /*!
      * Get all settings for the current meshgroup in the format by which CuraEngine is called via the command line.
      * 
@@ -96,6 +329,21 @@ public:
         meshgroup_number = 0;
     }
 
+    /*!
+     * Set whether to keep the sliced data of each mesh group, so that only the gcode needs to be generated again
+     * when the next mesh group has the same meshes and only settings which slicing doesn't depend on have changed.
+     * 
+     * \param reuse Whether to reuse sliced data
+     */
+    void setReuseSliceData(bool reuse)
+    {
+        reuse_slice_data = reuse;
+        if (!reuse)
+        {
+            last_storage.reset();
+        }
+    }
+
     /*!
      * Set the target to write gcode to: to a file.
      * 
@@ -108,6 +356,28 @@ public:
         return gcode_writer.setTargetFile(filename);
     }
 
+    /*!
+     * Set whether gzip compressed gcode files are compressed with a small window, for printers with little memory.
+     * 
+     * \param low_memory Whether to use a small window
+     */
+    void setLowMemoryCompression(bool low_memory)
+    {
+        low_memory_compression = low_memory;
+        gcode_writer.setLowMemoryCompression(low_memory);
+    }
+
+    /*!
+     * Add a file to which gcode is written as well, generated from the same sliced data with some settings changed.
+     * 
+     * The settings of the target override the global settings while its gcode is written, so settings of the mesh groups, extruder trains and meshes still take precedence.
+     * A target which changes a setting that slicing depends on is rejected when the mesh group is processed, since it would need different sliced data.
+     * 
+     * \param filename The file to write the gcode of the target to
+     * \return The settings of the target, in which to set the settings that differ from the main output, or nullptr if the file couldn't be opened
+     */
+    SettingsBase* addOutputTarget(const char* filename);
+
     /*!
      * Set the target to write gcode to: an output stream.
      * 
@@ -120,6 +390,74 @@ public:
         return gcode_writer.setTargetStream(stream);
     }
 
+    /*!
+     * Set whether only the print time and material estimates are computed, as for quoting a print.
+     * 
+     * Every layer is still planned and fed to the time estimate, but no gcode text is formatted or written.
+     * 
+     * \param estimate_only Whether to skip writing the gcode
+     */
+    void setEstimateOnly(bool estimate_only)
+    {
+        gcode_writer.setEstimateOnly(estimate_only);
+        for (std::unique_ptr<OutputTarget>& target : output_targets)
+        {
+            target->gcode_writer.setEstimateOnly(estimate_only);
+        }
+    }
+
+    /*!
+     * Set the layers of which to write the gcode, for planning a print with several processes, see FffGcodeWriter::setLayerRange.
+     * 
+     * \param first The first layer to write
+     * \param last The last layer to write, or -1 to write up to the top layer
+     */
+    void setLayerRange(int first, int last)
+    {
+        gcode_writer.setLayerRange(first, last);
+        for (std::unique_ptr<OutputTarget>& target : output_targets)
+        {
+            target->gcode_writer.setLayerRange(first, last);
+        }
+    }
+
+    /*!
+     * Read the areas of each mesh group from a SliceDataSnapshot file instead of slicing it, if it was written for the same meshes and settings.
+     * 
+     * Mesh groups after the first one are read from the file name followed by the number of the mesh group.
+     * 
+     * \param filename The snapshot file written with FffProcessor::setAreaSnapshotOutput
+     */
+    void setAreaSnapshotInput(const std::string& filename)
+    {
+        area_snapshot_input = filename;
+    }
+
+    /*!
+     * Write the areas of each mesh group to a SliceDataSnapshot file after slicing it.
+     * 
+     * \param filename The file to write
+     */
+    void setAreaSnapshotOutput(const std::string& filename)
+    {
+        area_snapshot_output = filename;
+    }
+
+    /*!
+     * Set whether the estimates are computed from the sliced areas only, without planning any paths, for an instant quote.
+     * 
+     * The gcode writer is skipped completely, so this should be combined with FffProcessor::setEstimateOnly to discard the start and end gcode.
+     * The estimates are less accurate; see AreaEstimate.
+     * 
+     * \param area_estimate_only Whether to estimate from the sliced areas
+     * \param calibration The factors by which the estimates of the areas are scaled
+     */
+    void setAreaEstimateOnly(bool area_estimate_only, const AreaEstimate::Calibration& calibration = AreaEstimate::Calibration())
+    {
+        this->area_estimate_only = area_estimate_only;
+        area_estimate.setCalibration(calibration);
+    }
+
     /*!
      * Get the total extruded volume for a specific extruder in mm^3
      * 
@@ -130,6 +468,10 @@ public:
      */
     double getTotalFilamentUsed(int extruder_nr)
     {
+        if (area_estimate_only)
+        {
+            return area_estimate.getMaterialVolume(extruder_nr);
+        }
         return gcode_writer.getTotalFilamentUsed(extruder_nr);
     }
 
@@ -140,6 +482,10 @@ public:
      */
     double getTotalPrintTime()
     {
+        if (area_estimate_only)
+        {
+            return area_estimate.getPrintTime();
+        }
         return gcode_writer.getTotalPrintTime();
     }
 
@@ -148,7 +494,15 @@ public:
      */
     void finalize()
     {
+        flushPendingMeshGroup();
         gcode_writer.finalize();
+        for (std::unique_ptr<OutputTarget>& target : output_targets)
+        {
+            if (!target->rejected)
+            {
+                target->gcode_writer.finalize();
+            }
+        }
     }
 
     /*!
@@ -162,10 +516,28 @@ public:
      * Generate gcode for a given \p meshgroup
      * The primary function of this class.
      * 
+     * When pipelining mesh groups (see FffProcessor::canPipeline), the gcode of \p meshgroup is written while the next mesh group is processed,
+     * so that the caller has to keep \p meshgroup alive until the next call returns or until FffProcessor::finalize.
+     * 
      * \param meshgroup The meshgroup for which to generate gcode
      * \return Whether this function succeeded
      */
     bool processMeshGroup(MeshGroup* meshgroup);
+
+    /*!
+     * Slice a coarse preview of a mesh group and send the walls of its layers to the front end, before the mesh group is sliced with its own settings.
+     * 
+     * The settings of \p meshgroup are changed for the preview: the layers are at least preview_layer_height thick,
+     * the outlines are simplified by at least preview_maximum_deviation and there is no support, adhesion, prime tower or shield.
+     * No paths are planned and no gcode is written; the estimates come from the sliced areas, see AreaEstimate.
+     * The layers of the preview aren't looked up in or stored in the SliceCache, so that they're never mixed up with those of the full slice.
+     * The meshes are cleared while slicing, so \p meshgroup must be a copy of the mesh group which is processed afterwards.
+     * 
+     * \param meshgroup A copy of the mesh group to preview, which is changed and can't be used for anything else afterwards
+     * \param[out] estimate The estimate of the preview, scaled to the layer height of the mesh group itself
+     * \return Whether the preview was sliced, which it isn't for wireframe printing or when the slicing was cancelled
+     */
+    bool processPreview(MeshGroup* meshgroup, AreaEstimate& estimate);
 };
 
 }//namespace cura
@@ -1,7 +1,9 @@
 #ifndef FLOW_TEMP_GRAPH
 #define FLOW_TEMP_GRAPH
 
+#include <algorithm>
 #include <cassert>
+#include <vector>
 
 #include "utils/logoutput.h"
 
@@ -24,7 +26,7 @@ public:
         , temp(temp)
         {}
     };
-    std::vector<Datum> data; //!< The points of the graph between which the graph is linearly interpolated
+    std::vector<Datum> data; //!< The points of the graph between which the graph is linearly interpolated, ordered by flow
 
     FlowTempGraph()
     {}
@@ -39,7 +41,7 @@ public:
      * \param material_print_temperature The default printing temp (backward compatibility for when the graph fails)
      * \return the corresponding temp
      */
-    double getTemp(double flow, double material_print_temperature, bool flow_dependent_temperature)
+    double getTemp(double flow, double material_print_temperature, bool flow_dependent_temperature) const
     {
         if (!flow_dependent_temperature || data.size() == 0)
         {
@@ -54,15 +56,16 @@ public:
             logWarning("Warning! Flow too low!\n"); // TODO
             return data.front().temp;
         }
-        Datum* last_datum = &data.front();
-        for (unsigned int datum_idx = 1; datum_idx < data.size(); datum_idx++)
+        // the first datum with at least the flow, found by binary search since this is evaluated for every extruder plan
+        const std::vector<Datum>::const_iterator datum = std::lower_bound(data.begin(), data.end(), flow, [](const Datum& graph_point, double sought_flow) { return graph_point.flow < sought_flow; });
+        if (datum == data.begin())
         {
-            Datum& datum = data[datum_idx];
-            if (datum.flow >= flow)
-            {
-                return last_datum->temp + (datum.temp - last_datum->temp) * (flow - last_datum->flow) / (datum.flow - last_datum->flow);
-            }
-            last_datum = &datum;
+            return datum->temp;
+        }
+        if (datum != data.end())
+        {
+            const Datum& last_datum = *(datum - 1);
+            return last_datum.temp + (datum->temp - last_datum.temp) * (flow - last_datum.flow) / (datum->flow - last_datum.flow);
         }
         
         logWarning("Warning! Flow too high!\n"); // TODO
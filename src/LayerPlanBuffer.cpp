@@ -1,30 +1,153 @@
 /** Copyright (C) 2015 Ultimaker - Released under terms of the AGPLv3 License */
 
+#include <cassert>
+#include <iterator> // prev
+
 #include "LayerPlanBuffer.h"
 #include "gcodeExport.h"
 #include "utils/logoutput.h"
 #include "FffProcessor.h"
+#include "utils/ThreadPool.h"
+#include "utils/Trace.h"
 
 namespace cura {
 
+constexpr unsigned int LayerPlanBuffer::no_plan;
 
+LayerPlanBuffer::~LayerPlanBuffer()
+{
+    stopWriterThread(); // only still running when planning was aborted by an exception
+}
 
 void LayerPlanBuffer::flush()
 {
+    TRACE_SCOPE("LayerPlanBuffer::flush", -1, -1);
     if (buffer.size() > 0)
     {
         insertPreheatCommands(); // insert preheat commands of the very last layer
     }
     while (!buffer.empty())
+    {
+        writeFront();
+    }
+    std::exception_ptr exception = stopWriterThread();
+    written_plans.clear();
+    if (exception)
+    {
+        std::rethrow_exception(exception);
+    }
+}
+
+void LayerPlanBuffer::writeFront()
+{
+    while (!timeline.empty() && timeline.front().layer_plan == &buffer.front())
+    {
+        timeline.pop_front();
+        timeline_start_idx++;
+    }
+    buffer.front().freezeConfigs(); // on this thread, because completing the configs of a layer changes the configs used while planning
+
+    if (context.command_socket || ThreadPool::getInstance()->getThreadCount() <= 1)
     {
         buffer.front().writeGCode(gcode);
-        if (CommandSocket::isInstantiated())
+        if (context.command_socket)
         {
-            CommandSocket::getInstance()->flushGcode();
+            context.command_socket->flushGcode();
         }
-        buffer.pop_front();
+        else if (flush_per_layer)
+        {
+            gcode.flushOutput();
+        }
+        std::lock_guard<std::mutex> lock(write_queue_mutex);
+        keepWrittenPlan(buffer);
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(write_queue_mutex);
+    if (!writer_thread.joinable())
+    {
+        planning_finished = false;
+        writer_thread = std::thread(&LayerPlanBuffer::writeQueuedLayers, this);
+    }
+    write_queue_changed.wait(lock, [this]() { return write_queue.size() < write_queue_size; });
+    write_queue.splice(write_queue.end(), buffer, buffer.begin());
+    write_queue_changed.notify_all();
+}
+
+void LayerPlanBuffer::keepWrittenPlan(std::list<GCodePlanner>& written)
+{
+    written_plans.splice(written_plans.end(), written, written.begin());
+    if (written_plans.size() > max_written_plans)
+    {
+        written_plans.pop_front();
+    }
+}
+
+void LayerPlanBuffer::recycleWrittenPlan(GCodePlanner& layer_plan)
+{
+    std::list<GCodePlanner> recycled;
+    {
+        std::lock_guard<std::mutex> lock(write_queue_mutex);
+        if (written_plans.empty())
+        {
+            return;
+        }
+        recycled.splice(recycled.end(), written_plans, written_plans.begin());
+    }
+    layer_plan.reuseBuffers(recycled.front());
+}
+
+void LayerPlanBuffer::writeQueuedLayers()
+{
+    std::unique_lock<std::mutex> lock(write_queue_mutex);
+    while (true)
+    {
+        write_queue_changed.wait(lock, [this]() { return !write_queue.empty() || planning_finished; });
+        if (write_queue.empty())
+        {
+            return;
+        }
+        GCodePlanner& layer_plan = write_queue.front(); // the planning thread only adds layer plans at the back, so this one stays valid
+        const bool write = !writer_exception; // after an exception the remaining layer plans are only discarded, so that planning isn't blocked
+        lock.unlock();
+        if (write)
+        {
+            try
+            {
+                layer_plan.writeGCode(gcode);
+                if (flush_per_layer)
+                {
+                    gcode.flushOutput();
+                }
+            }
+            catch (...)
+            {
+                lock.lock();
+                writer_exception = std::current_exception();
+                lock.unlock();
+            }
+        }
+        lock.lock();
+        keepWrittenPlan(write_queue);
+        write_queue_changed.notify_all();
     }
-    
+}
+
+std::exception_ptr LayerPlanBuffer::stopWriterThread()
+{
+    if (!writer_thread.joinable())
+    {
+        return nullptr;
+    }
+    {
+        std::lock_guard<std::mutex> lock(write_queue_mutex);
+        planning_finished = true;
+    }
+    write_queue_changed.notify_all();
+    writer_thread.join();
+    std::exception_ptr exception = writer_exception;
+    writer_exception = nullptr;
+    return exception;
 }
 
 void LayerPlanBuffer::insertPreheatCommand(ExtruderPlan& extruder_plan_before, double time_after_extruder_plan_start, int extruder, double temp)
@@ -45,26 +168,22 @@ void LayerPlanBuffer::insertPreheatCommand(ExtruderPlan& extruder_plan_before, d
     extruder_plan_before.insertCommand(0, extruder, temp, false); // insert at start of extruder plan if time_after_extruder_plan_start > extruder_plan.time
 }
 
-Preheat::WarmUpResult LayerPlanBuffer::timeBeforeExtruderPlanToInsert(std::vector<ExtruderPlan*>& extruder_plans, unsigned int extruder_plan_idx)
+Preheat::WarmUpResult LayerPlanBuffer::timeBeforeExtruderPlanToInsert(unsigned int extruder_plan_idx)
 {
-    ExtruderPlan& extruder_plan = *extruder_plans[extruder_plan_idx];
-    int extruder = extruder_plan.extruder;
-    double required_temp = extruder_plan.required_temp;
+    const TimelineEntry& entry = timeline[extruder_plan_idx];
+    int extruder = entry.extruder_plan->extruder;
+    double required_temp = entry.extruder_plan->required_temp;
     
-    double in_between_time = 0.0;
-    for (unsigned int extruder_plan_before_idx = extruder_plan_idx - 1; int(extruder_plan_before_idx) >= 0; extruder_plan_before_idx--)
-    { // find a previous extruder plan where the same extruder is used to see what time this extruder wasn't used
-        ExtruderPlan& extruder_plan = *extruder_plans[extruder_plan_before_idx];
-        if (extruder_plan.extruder == extruder)
-        {
-            Preheat::WarmUpResult warm_up = preheat_config.timeBeforeEndToInsertPreheatCommand_coolDownWarmUp(in_between_time, extruder, required_temp);
-            warm_up.heating_time = std::min(in_between_time, warm_up.heating_time + extra_preheat_time);
-            return warm_up;
-        }
-        in_between_time += extruder_plan.estimates.getTotalTime();
+    if (entry.prev_same_extruder != no_plan && entry.prev_same_extruder >= timeline_start_idx)
+    { // use the previous extruder plan where the same extruder is used to see what time this extruder wasn't used
+        double in_between_time = entry.start_time - timeline[entry.prev_same_extruder - timeline_start_idx].end_time;
+        Preheat::WarmUpResult warm_up = preheat_config.timeBeforeEndToInsertPreheatCommand_coolDownWarmUp(in_between_time, extruder, required_temp);
+        warm_up.heating_time = std::min(in_between_time, warm_up.heating_time + extra_preheat_time);
+        return warm_up;
     }
     // The last extruder plan with the same extruder falls outside of the buffer
     // assume the nozzle has cooled down to strandby temperature already.
+    double in_between_time = entry.start_time - timeline.front().start_time;
     Preheat::WarmUpResult warm_up;
     warm_up.total_time_window = in_between_time;
     warm_up.lowest_temperature = preheat_config.getStandbyTemp(extruder);
@@ -89,69 +208,61 @@ void LayerPlanBuffer::insertPreheatCommand_singleExtrusion(ExtruderPlan& prev_ex
 }
 
 
-void LayerPlanBuffer::handleStandbyTemp(std::vector<ExtruderPlan*>& extruder_plans, unsigned int extruder_plan_idx, double standby_temp)
+void LayerPlanBuffer::handleStandbyTemp(unsigned int extruder_plan_idx, double standby_temp)
 {
-    ExtruderPlan& extruder_plan = *extruder_plans[extruder_plan_idx];
-    int extruder = extruder_plan.extruder;
-    for (unsigned int extruder_plan_before_idx = extruder_plan_idx - 2; int(extruder_plan_before_idx) >= 0; extruder_plan_before_idx--)
+    const TimelineEntry& entry = timeline[extruder_plan_idx];
+    int extruder = entry.extruder_plan->extruder;
+    if (entry.prev_same_extruder != no_plan && entry.prev_same_extruder >= timeline_start_idx)
     {
-        if (extruder_plans[extruder_plan_before_idx]->extruder == extruder)
-        {
-            extruder_plans[extruder_plan_before_idx + 1]->prev_extruder_standby_temp = standby_temp;
-            return;
-        }
+        timeline[entry.prev_same_extruder - timeline_start_idx + 1].extruder_plan->prev_extruder_standby_temp = standby_temp;
+        return;
     }
     logWarning("Warning: Couldn't find previous extruder plan so as to set the standby temperature. Inserting temp command in earliest available layer.\n");
-    ExtruderPlan& earliest_extruder_plan = *extruder_plans[0];
+    ExtruderPlan& earliest_extruder_plan = *timeline.front().extruder_plan;
     constexpr bool wait = false;
     earliest_extruder_plan.insertCommand(0, extruder, standby_temp, wait);
 }
 
-void LayerPlanBuffer::insertPreheatCommand_multiExtrusion(std::vector<ExtruderPlan*>& extruder_plans, unsigned int extruder_plan_idx)
+void LayerPlanBuffer::insertPreheatCommand_multiExtrusion(unsigned int extruder_plan_idx)
 {
-    ExtruderPlan& extruder_plan = *extruder_plans[extruder_plan_idx];
-    int extruder = extruder_plan.extruder;
-    double required_temp = extruder_plan.required_temp;
+    const TimelineEntry& entry = timeline[extruder_plan_idx];
+    int extruder = entry.extruder_plan->extruder;
+    double required_temp = entry.extruder_plan->required_temp;
     
-    Preheat::WarmUpResult heating_time_and_from_temp = timeBeforeExtruderPlanToInsert(extruder_plans, extruder_plan_idx);
+    Preheat::WarmUpResult heating_time_and_from_temp = timeBeforeExtruderPlanToInsert(extruder_plan_idx);
 
     if (heating_time_and_from_temp.total_time_window < preheat_config.getMinimalTimeWindow(extruder))
     {
-        handleStandbyTemp(extruder_plans, extruder_plan_idx, required_temp);
+        handleStandbyTemp(extruder_plan_idx, required_temp);
         return; // don't insert preheat command and just stay on printing temperature
     }
     else
     {
-        handleStandbyTemp(extruder_plans, extruder_plan_idx, heating_time_and_from_temp.lowest_temperature);
+        handleStandbyTemp(extruder_plan_idx, heating_time_and_from_temp.lowest_temperature);
     }
 
-    double time_before_extruder_plan_to_insert = heating_time_and_from_temp.heating_time;
-    for (unsigned int extruder_plan_before_idx = extruder_plan_idx - 1; int(extruder_plan_before_idx) >= 0; extruder_plan_before_idx--)
-    {
-        ExtruderPlan& extruder_plan_before = *extruder_plans[extruder_plan_before_idx];
-        assert (extruder_plan_before.extruder != extruder);
-        
-        double time_here = extruder_plan_before.estimates.getTotalTime();
-        if (time_here >= time_before_extruder_plan_to_insert)
-        {
-            insertPreheatCommand(extruder_plan_before, time_before_extruder_plan_to_insert, extruder, required_temp);
-            return;
-        }
-        time_before_extruder_plan_to_insert -= time_here;
+    // the preheat command goes into the last extruder plan before this one which starts no later than the heating time before this one starts
+    const double insert_time = entry.start_time - heating_time_and_from_temp.heating_time;
+    std::deque<TimelineEntry>::iterator after_insert = std::upper_bound(timeline.begin(), timeline.begin() + extruder_plan_idx, insert_time,
+        [](double time, const TimelineEntry& entry_after) { return time < entry_after.start_time; });
+    if (after_insert == timeline.begin())
+    { // insert_time falls before all plans in the buffer
+        timeline.front().extruder_plan->insertCommand(0, extruder, required_temp, false); // insert preheat command at verfy beginning of buffer
+        return;
     }
-    
-    // time_before_extruder_plan_to_insert falls before all plans in the buffer
-    extruder_plans[0]->insertCommand(0, extruder, required_temp, false); // insert preheat command at verfy beginning of buffer
+    const TimelineEntry& entry_before = *std::prev(after_insert);
+    assert (entry_before.extruder_plan->extruder != extruder);
+    insertPreheatCommand(*entry_before.extruder_plan, entry_before.end_time - insert_time, extruder, required_temp);
 }
 
-void LayerPlanBuffer::insertPreheatCommand(std::vector<ExtruderPlan*>& extruder_plans, unsigned int extruder_plan_idx)
+void LayerPlanBuffer::insertPreheatCommand(unsigned int extruder_plan_idx)
 {   
-    ExtruderPlan& extruder_plan = *extruder_plans[extruder_plan_idx];
+    ExtruderPlan& extruder_plan = *timeline[extruder_plan_idx].extruder_plan;
     int extruder = extruder_plan.extruder;
     double required_temp = extruder_plan.required_temp;
     
     
-    ExtruderPlan* prev_extruder_plan = extruder_plans[extruder_plan_idx - 1];
+    ExtruderPlan* prev_extruder_plan = timeline[extruder_plan_idx - 1].extruder_plan;
     
     int prev_extruder = prev_extruder_plan->extruder;
     
@@ -169,11 +280,32 @@ void LayerPlanBuffer::insertPreheatCommand(std::vector<ExtruderPlan*>& extruder_
     }
     else 
     {
-        insertPreheatCommand_multiExtrusion(extruder_plans, extruder_plan_idx);
+        insertPreheatCommand_multiExtrusion(extruder_plan_idx);
     }
     
 }
 
+void LayerPlanBuffer::addToTimeline()
+{
+    const GCodePlanner& layer_plan = buffer.back();
+    for (ExtruderPlan& extruder_plan : buffer.back().extruder_plans)
+    {
+        TimelineEntry entry;
+        entry.extruder_plan = &extruder_plan;
+        entry.layer_plan = &layer_plan;
+        entry.start_time = timeline.empty() ? 0.0 : timeline.back().end_time;
+        entry.end_time = entry.start_time + extruder_plan.estimates.getTotalTime();
+        if (extruder_plan.extruder >= int(last_plan_of_extruder.size()))
+        {
+            last_plan_of_extruder.resize(extruder_plan.extruder + 1, no_plan);
+        }
+        unsigned int& last_plan = last_plan_of_extruder[extruder_plan.extruder];
+        entry.prev_same_extruder = last_plan;
+        last_plan = timeline_start_idx + timeline.size();
+        timeline.push_back(entry);
+    }
+}
+
 void LayerPlanBuffer::insertPreheatCommands()
 {
     if (buffer.back().extruder_plans.size() == 0 || (buffer.back().extruder_plans.size() == 1 && buffer.back().extruder_plans[0].paths.size() == 0))
@@ -181,17 +313,12 @@ void LayerPlanBuffer::insertPreheatCommands()
         buffer.pop_back();
         return;
     }
-
-    std::vector<ExtruderPlan*> extruder_plans;
-    extruder_plans.reserve(buffer.size() * 2);
-    for (GCodePlanner& layer_plan : buffer)
+    if (accurate_time_estimates)
     {
-        for (ExtruderPlan& extr_plan : layer_plan.extruder_plans)
-        {
-            extruder_plans.push_back(&extr_plan);
-        }
+        buffer.back().computeAccurateTimeEstimates();
     }
 
+    addToTimeline();
 
     // insert commands for all extruder plans on this layer
     GCodePlanner& layer_plan = buffer.back();
@@ -212,9 +339,9 @@ void LayerPlanBuffer::insertPreheatCommands()
         if (buffer.size() == 1 && extruder_plan_idx == 0)
         { // the very first extruder plan of the current meshgroup
             int extruder = extruder_plan.extruder;
-            for (int extruder_idx = 0; extruder_idx < getSettingAsCount("machine_extruder_count"); extruder_idx++)
+            for (int extruder_idx = 0; extruder_idx < getSettingAsCount(SettingKey::machine_extruder_count); extruder_idx++)
             { // set temperature of the first nozzle, turn other nozzles down
-                if (FffProcessor::getInstance()->getMeshgroupNr() == 0)
+                if (context.processor->getMeshgroupNr() == 0)
                 {
                     // override values from GCodeExport::setInitialTemps
                     // the first used extruder should be set to the required temp in the start gcode
@@ -239,8 +366,8 @@ void LayerPlanBuffer::insertPreheatCommands()
             continue;
         }
 
-        unsigned int overall_extruder_plan_idx = extruder_plans.size() - layer_plan.extruder_plans.size() + extruder_plan_idx;
-        insertPreheatCommand(extruder_plans, overall_extruder_plan_idx);
+        unsigned int timeline_idx = timeline.size() - layer_plan.extruder_plans.size() + extruder_plan_idx;
+        insertPreheatCommand(timeline_idx);
     }
 }
 
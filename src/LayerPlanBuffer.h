@@ -1,7 +1,16 @@
 #ifndef LAYER_PLAN_BUFFER_H
 #define LAYER_PLAN_BUFFER_H
 
+#include <algorithm> // max
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <limits>
 #include <list>
+#include <mutex>
+#include <thread>
+#include <utility> // forward
+#include <vector>
 
 #include "settings/settings.h"
 #include "commandSocket.h"
@@ -11,37 +20,118 @@
 #include "MeshGroup.h"
 
 #include "Preheat.h"
+#include "SliceContext.h"
 
 namespace cura 
 {
 
 class LayerPlanBuffer : SettingsMessenger
 {
+    const SliceContext& context; //!< What the gcode is written for
     GCodeExport& gcode;
     
     Preheat preheat_config; //!< the nozzle and material temperature settings for each extruder train.
+    bool accurate_time_estimates; //!< Whether to time the preheat commands with estimates which take acceleration and jerk into account; see GCodePlanner::computeAccurateTimeEstimates
     
-    static constexpr unsigned int buffer_size = 5; // should be as low as possible while still allowing enough time in the buffer to heat up from standby temp to printing temp // TODO: hardcoded value
+    static constexpr unsigned int default_buffer_size = 5; // should be as low as possible while still allowing enough time in the buffer to heat up from standby temp to printing temp
     // this value should be higher than 1, cause otherwise each layer is viewed as the first layer and no temp commands are inserted.
+    unsigned int buffer_size; //!< The number of layer plans kept in the buffer, in which preheat commands can be inserted; see LayerPlanBuffer::setBufferSize
+    bool flush_per_layer; //!< Whether the output is flushed after each layer written; see LayerPlanBuffer::setFlushPerLayer
 
     static constexpr const double extra_preheat_time = 1.0; //!< Time to start heating earlier than computed to avoid accummulative discrepancy between actual heating times and computed ones.
 
+    static constexpr unsigned int write_queue_size = 2; //!< The maximum number of layer plans waiting for the writer thread, so that planning can't run far ahead of writing
+
+    static constexpr unsigned int max_written_plans = 2; //!< The maximum number of written layer plans kept to be recycled
+
+    /*
+     * The layer plans which have left the buffer are written to gcode on a separate writer thread,
+     * so that writing a layer overlaps with planning the next layers.
+     * The writer thread is started when the first layer plan leaves the buffer and stops in LayerPlanBuffer::flush.
+     */
+    std::thread writer_thread; //!< The thread writing the layer plans in the write queue
+    std::mutex write_queue_mutex; //!< Guards the write queue, LayerPlanBuffer::planning_finished and LayerPlanBuffer::writer_exception
+    std::condition_variable write_queue_changed; //!< Notified when a layer plan is added to or removed from the write queue, or when planning is finished
+    std::list<GCodePlanner> write_queue; //!< The layer plans which have left the buffer and wait to be written, in order of layer
+    bool planning_finished; //!< Whether no more layer plans will be added to the write queue
+    std::exception_ptr writer_exception; //!< The exception thrown while writing a layer plan, which is rethrown in LayerPlanBuffer::flush
+    std::list<GCodePlanner> written_plans; //!< The layer plans which have been written, of which the next layer plans reuse the memory; guarded by LayerPlanBuffer::write_queue_mutex
+
+    static constexpr unsigned int no_plan = std::numeric_limits<unsigned int>::max(); //!< The overall index of no extruder plan
+
+    /*!
+     * An extruder plan in the buffer, with the time at which it starts and ends when printing the buffered extruder plans one after the other.
+     */
+    struct TimelineEntry
+    {
+        ExtruderPlan* extruder_plan;
+        const GCodePlanner* layer_plan; //!< The layer plan of which the extruder plan is part
+        double start_time; //!< The end time of the extruder plan before this one
+        double end_time; //!< The start time plus the estimated duration of the extruder plan
+        unsigned int prev_same_extruder; //!< The overall index of the last extruder plan before this one with the same extruder, or no_plan
+    };
+
+    /*
+     * The extruder plans are added to the timeline when the preheat commands of their layer are inserted and leave it with their layer plan,
+     * so that the preheat planning of a layer doesn't have to go over all earlier extruder plans in the buffer.
+     * The overall index of an extruder plan is the number of extruder plans added to the timeline before it.
+     */
+    std::deque<TimelineEntry> timeline; //!< The extruder plans of the layer plans in the buffer for which preheat commands have been inserted, from lower to upper layers
+    unsigned int timeline_start_idx; //!< The overall index of the front of the timeline
+    std::vector<unsigned int> last_plan_of_extruder; //!< For each extruder the overall index of its last extruder plan added to the timeline, or no_plan
+
 public:
     std::list<GCodePlanner> buffer; //!< The buffer containing several layer plans (GCodePlanner) before writing them to gcode.
     
-    LayerPlanBuffer(SettingsBaseVirtual* settings, GCodeExport& gcode)
+    LayerPlanBuffer(const SliceContext& context, SettingsBaseVirtual* settings, GCodeExport& gcode)
     : SettingsMessenger(settings)
+    , context(context)
     , gcode(gcode)
+    , accurate_time_estimates(false)
+    , buffer_size(default_buffer_size)
+    , flush_per_layer(false)
+    , planning_finished(false)
+    , timeline_start_idx(0)
     { }
+
+    ~LayerPlanBuffer();
     
     void setPreheatConfig(MeshGroup& settings)
     {
         preheat_config.setConfig(settings);
+        accurate_time_estimates = settings.getSettingBoolean(SettingKey::preheat_accurate_time_estimates);
+    }
+
+    /*!
+     * Set the number of layer plans kept in the buffer before they're written.
+     * 
+     * A larger buffer leaves more time to preheat a nozzle before it is used, which changes the gcode.
+     * 
+     * \param size The number of layer plans, or zero (or less) for the default of 5. Sizes of 1 are raised to 2.
+     */
+    void setBufferSize(int size)
+    {
+        buffer_size = (size <= 0) ? default_buffer_size : std::max(2, size);
+    }
+
+    /*!
+     * Set whether to flush the gcode output after each layer written, so that a printer or print server
+     * reading the output can start on the first layers while the next ones are still being written.
+     * 
+     * Gcode sent over the command socket is always sent per layer.
+     * 
+     * \param flush Whether to flush after each layer
+     */
+    void setFlushPerLayer(bool flush)
+    {
+        flush_per_layer = flush;
     }
     
     /*!
      * Place a new layer plan (GcodePlanner) by constructing it with the given arguments.
      * Pop back the oldest layer plan is it exceeds the buffer size and write it to gcode.
+     * 
+     * The oldest layer plan may still be being written when this function returns; see LayerPlanBuffer::writeFront.
      */
     template<typename... Args>
     GCodePlanner& emplace_back(Args&&... constructor_args)
@@ -50,21 +140,19 @@ public:
         {
             insertPreheatCommands(); // insert preheat commands of the just completed layer plan (not the newly emplaced one)
         }
-        buffer.emplace_back(constructor_args...);
+        buffer.emplace_back(std::forward<Args>(constructor_args)...);
+        recycleWrittenPlan(buffer.back());
         if (buffer.size() > buffer_size)
         {
-            buffer.front().writeGCode(gcode);
-            if (CommandSocket::isInstantiated())
-            {
-                CommandSocket::getInstance()->flushGcode();
-            }
-            buffer.pop_front();
+            writeFront();
         }
         return buffer.back();
     }
     
     /*!
      * Write all remaining layer plans (GCodePlanner) to gcode and empty the buffer.
+     * 
+     * Waits until everything is written, so that the gcode can be used directly after this call.
      */
     void flush();
     
@@ -82,11 +170,10 @@ public:
      * Compute the time needed to preheat, based either on the time the extruder has been on standby 
      * or based on the temp of the previous extruder plan which has the same extruder nr.
      * 
-     * \param extruder_plans The extruder plans in the buffer, moved to a temporary vector (from lower to upper layers)
-     * \param extruder_plan_idx The index of the extruder plan in \p extruder_plans for which to find the preheat time needed
+     * \param extruder_plan_idx The index in LayerPlanBuffer::timeline of the extruder plan for which to find the preheat time needed
      * \return the time needed to preheat and the temperature from which heating starts
      */
-    Preheat::WarmUpResult timeBeforeExtruderPlanToInsert(std::vector<ExtruderPlan*>& extruder_plans, unsigned int extruder_plan_idx);
+    Preheat::WarmUpResult timeBeforeExtruderPlanToInsert(unsigned int extruder_plan_idx);
     
     /*!
      * For two consecutive extruder plans of the same extruder (so on different layers), 
@@ -106,18 +193,16 @@ public:
      * and compute at what time the preheat command needs to be inserted.
      * Then insert the preheat command in the right extruder plan.
      * 
-     * \param extruder_plans The extruder plans in the buffer, moved to a temporary vector (from lower to upper layers)
-     * \param extruder_plan_idx The index of the extruder plan in \p extruder_plans for which to find the preheat time needed
+     * \param extruder_plan_idx The index in LayerPlanBuffer::timeline of the extruder plan for which to find the preheat time needed
      */
-    void insertPreheatCommand_multiExtrusion(std::vector<ExtruderPlan*>& extruder_plans, unsigned int extruder_plan_idx);
+    void insertPreheatCommand_multiExtrusion(unsigned int extruder_plan_idx);
     
     /*!
      * Insert the preheat command for the extruder plan corersponding to @p extruder_plan_idx of the layer corresponding to @p layer_plan_idx.
      * 
-     * \param extruder_plans The extruder plans in the buffer, moved to a temporary vector (from lower to upper layers)
-     * \param extruder_plan_idx The index of the extruder plan in \p extruder_plans for which to generate the preheat command
+     * \param extruder_plan_idx The index in LayerPlanBuffer::timeline of the extruder plan for which to generate the preheat command
      */
-    void insertPreheatCommand(std::vector<ExtruderPlan*>& extruder_plans, unsigned int extruder_plan_idx);
+    void insertPreheatCommand(unsigned int extruder_plan_idx);
 
     /*!
      * Insert the preheat commands for the last added layer (unless that layer was empty)
@@ -126,14 +211,53 @@ public:
 private:
     /*!
      * Reconfigure the standby temperature during which we didn't print with this extruder.
-     * Find the previous extruder plan with the same extruder as layers[layer_plan_idx].extruder_plans[extruder_plan_idx]
+     * Find the previous extruder plan with the same extruder as the extruder plan at \p extruder_plan_idx
      * Set the prev_extruder_standby_temp in the next extruder plan
      * 
-     * \param extruder_plans The extruder plans in the buffer, moved to a temporary vector (from lower to upper layers)
-     * \param extruder_plan_idx The index of the extruder plan in \p extruder_plans before which to reconfigure the standby temperature
+     * \param extruder_plan_idx The index in LayerPlanBuffer::timeline of the extruder plan before which to reconfigure the standby temperature
      * \param standby_temp The temperature to which to cool down when the extruder is in standby mode.
      */
-    void handleStandbyTemp(std::vector<ExtruderPlan*>& extruder_plans, unsigned int extruder_plan_idx, double standby_temp);
+    void handleStandbyTemp(unsigned int extruder_plan_idx, double standby_temp);
+
+    /*!
+     * Add the extruder plans of the last layer plan in the buffer to LayerPlanBuffer::timeline.
+     */
+    void addToTimeline();
+
+    /*!
+     * Remove the oldest layer plan from the buffer and write it to gcode.
+     * 
+     * The layer plan is handed over to the writer thread, which writes it while the next layers are planned.
+     * When the engine is connected to a front-end, or only a single thread may be used, the layer plan is written right away instead,
+     * because the layer data sent to the front-end can't be sent from two threads at the same time.
+     */
+    void writeFront();
+
+    /*!
+     * Keep a layer plan which has been written, so that its memory can be reused.
+     * 
+     * \param written A list of which the front is the layer plan which has been written; it is moved out of this list
+     */
+    void keepWrittenPlan(std::list<GCodePlanner>& written);
+
+    /*!
+     * Let a new layer plan take over the memory of a layer plan which has been written, if there is one.
+     * 
+     * \param layer_plan The new layer plan, in which nothing has been planned yet
+     */
+    void recycleWrittenPlan(GCodePlanner& layer_plan);
+
+    /*!
+     * The main loop of the writer thread: write the layer plans in the write queue until planning is finished and the queue is empty.
+     */
+    void writeQueuedLayers();
+
+    /*!
+     * Wait until the writer thread has written all layer plans handed over to it and stop it.
+     * 
+     * \return The exception thrown while writing, if any
+     */
+    std::exception_ptr stopWriterThread();
 };
 
 
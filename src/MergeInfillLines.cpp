@@ -1,13 +1,14 @@
 #include "MergeInfillLines.h"
 
 #include <algorithm> // min
+#include <cassert>
 
 #include "utils/linearAlg2D.h"
 
 namespace cura
 {
     
-void MergeInfillLines::writeCompensatedMove(Point& to, double speed, GCodePath& last_path, int64_t new_line_width)
+void MergeInfillLines::writeCompensatedMove(GCodeExport& gcode, Point to, double speed, GCodePath& last_path, int64_t new_line_width, bool speed_equalize_flow_enabled, double speed_equalize_flow_max)
 {
     double old_line_width = INT2MM(last_path.config->getLineWidth());
     double new_line_width_mm = INT2MM(new_line_width);
@@ -18,60 +19,81 @@ void MergeInfillLines::writeCompensatedMove(Point& to, double speed, GCodePath&
         double speed_mod = old_line_width / new_line_width_mm;
         new_speed = std::min(speed * speed_mod, speed_equalize_flow_max);
     }
-    sendLineTo(last_path.config->type, to, last_path.getLineWidth());
+    if (gcode.getCommandSocket())
+    {
+        gcode.getCommandSocket()->sendLineTo(last_path.config->type, to, last_path.getLineWidth());
+    }
     gcode.writeMove(to, new_speed, last_path.getExtrusionMM3perMM() * extrusion_mod);
 }
-    
-bool MergeInfillLines::mergeInfillLines(unsigned int& path_idx)
+
+void MergeInfillLines::findMerges()
 { //Check for lots of small moves and combine them into one large line
+    std::vector<InfillLineMerge>& merges = extruder_plan.infill_line_merges;
+    merges.clear();
     Point prev_middle;
     Point last_middle;
     int64_t line_width;
+    for (unsigned int path_idx = 0; path_idx < paths.size(); path_idx++)
+    {
+        if (!isConvertible(path_idx, prev_middle, last_middle, line_width))
+        {
+            continue;
+        }
+        merges.emplace_back();
+        InfillLineMerge& merge = merges.back();
+        merge.first_path_idx = path_idx;
+        merge.middles.push_back(prev_middle);
+        do
+        { //   path_idx + 3 is the index of the next extrusion move to be converted in combination with the one before
+            merge.middles.push_back(last_middle);
+            merge.line_widths.push_back(line_width);
+            path_idx += 2;
+        } while (isConvertible(path_idx, prev_middle, last_middle, line_width));
+        path_idx = path_idx + 1; // the next path considered is the travel path after the last converted extrusion path
+    }
+}
 
-    if (isConvertible(path_idx, prev_middle, last_middle, line_width, false))
+void MergeInfillLines::writeMerge(GCodeExport& gcode, ExtruderPlan& extruder_plan, const InfillLineMerge& merge, GCodePathConfig& travel_config, bool speed_equalize_flow_enabled, double speed_equalize_flow_max, unsigned int& path_idx)
+{
+    assert(path_idx == merge.first_path_idx);
+    std::vector<GCodePath>& paths = extruder_plan.paths;
     {
-        //   path_idx + 3 is the index of the second extrusion move to be converted in combination with the first
+        GCodePath& move_path = paths[path_idx];
+        GCodePathPoints move_points = extruder_plan.getPoints(move_path);
+        for(unsigned int point_idx = 0; point_idx < move_points.size() - 1; point_idx++)
         {
-            GCodePath& move_path = paths[path_idx];
-            for(unsigned int point_idx = 0; point_idx < move_path.points.size() - 1; point_idx++)
-            {
-                gcode.writeMove(move_path.points[point_idx], move_path.config->getSpeed() * extruder_plan.getTravelSpeedFactor(), move_path.getExtrusionMM3perMM());
-            }
-            gcode.writeMove(prev_middle, travelConfig.getSpeed(), 0);
-            GCodePath& last_path = paths[path_idx + 3];
-            
-            writeCompensatedMove(last_middle, last_path.config->getSpeed() * extruder_plan.getExtrudeSpeedFactor(), last_path, line_width);
+            gcode.writeMove(move_points[point_idx], move_path.config->getSpeed() * extruder_plan.getTravelSpeedFactor(), move_path.getExtrusionMM3perMM());
         }
-        
-        path_idx += 2;
-        extruder_plan.handleInserts(path_idx, gcode);
-        for (; isConvertible(path_idx, prev_middle, last_middle, line_width, true); path_idx += 2)
+        gcode.writeMove(merge.middles[0], travel_config.getSpeed(), 0);
+    }
+    for (unsigned int line_idx = 0; line_idx < merge.line_widths.size(); line_idx++)
+    {
+        if (line_idx > 0)
         {
             extruder_plan.handleInserts(path_idx, gcode);
-            GCodePath& last_path = paths[path_idx + 3];
-            writeCompensatedMove(last_middle, last_path.config->getSpeed() * extruder_plan.getExtrudeSpeedFactor(), last_path, line_width);
         }
-        path_idx = path_idx + 1; // means that the next path considered is the travel path after the converted extrusion path corresponding to the updated path_idx
-        extruder_plan.handleInserts(path_idx, gcode);
-        return true;
+        GCodePath& last_path = paths[path_idx + 3];
+        writeCompensatedMove(gcode, merge.middles[line_idx + 1], last_path.config->getSpeed() * extruder_plan.getExtrudeSpeedFactor(), last_path, merge.line_widths[line_idx], speed_equalize_flow_enabled, speed_equalize_flow_max);
+        path_idx += 2;
     }
-    return false;
-};
+    path_idx = path_idx + 1; // means that the next path considered is the travel path after the converted extrusion path corresponding to the updated path_idx
+    extruder_plan.handleInserts(path_idx, gcode);
+}
 
-bool MergeInfillLines::isConvertible(unsigned int path_idx_first_move, Point& first_middle, Point& second_middle, int64_t& resulting_line_width, bool use_second_middle_as_first)
+bool MergeInfillLines::isConvertible(unsigned int path_idx_first_move, Point& first_middle, Point& second_middle, int64_t& resulting_line_width)
 {
     unsigned int idx = path_idx_first_move;
     if (idx + 3 > paths.size()-1) 
     {
         return false;
     }
-    if (   paths[idx+0].config != &travelConfig // must be travel
-        || paths[idx+1].points.size() > 1       // extrusion path is single line
-        || paths[idx+1].config == &travelConfig // must be extrusion
-//        || paths[idx+2].points.size() > 1       // travel must be direct
-        || paths[idx+2].config != &travelConfig // must be travel
-        || paths[idx+3].points.size() > 1       // extrusion path is single line
-        || paths[idx+3].config == &travelConfig // must be extrusion
+    if (   paths[idx+0].config != travelConfig // must be travel
+        || extruder_plan.getPoints(paths[idx+1]).size() > 1       // extrusion path is single line
+        || paths[idx+1].config == travelConfig // must be extrusion
+//        || extruder_plan.getPoints(paths[idx+2]).size() > 1       // travel must be direct
+        || paths[idx+2].config != travelConfig // must be travel
+        || extruder_plan.getPoints(paths[idx+3]).size() > 1       // extrusion path is single line
+        || paths[idx+3].config == travelConfig // must be extrusion
         || paths[idx+1].config != paths[idx+3].config // both extrusion moves should have the same config
     )
     {
@@ -90,17 +112,16 @@ bool MergeInfillLines::isConvertible(unsigned int path_idx_first_move, Point& fi
 
     int64_t line_width = paths[idx+1].config->getLineWidth();
     
-    Point& a = paths[idx+0].points.back(); // first extruded line from
-    Point& b = paths[idx+1].points.back(); // first extruded line to
-    Point& c = paths[idx+2].points.back(); // second extruded line from
-    Point& d = paths[idx+3].points.back(); // second extruded line to
+    Point& a = extruder_plan.getPoints(paths[idx+0]).back(); // first extruded line from
+    Point& b = extruder_plan.getPoints(paths[idx+1]).back(); // first extruded line to
+    Point& c = extruder_plan.getPoints(paths[idx+2]).back(); // second extruded line from
+    Point& d = extruder_plan.getPoints(paths[idx+3]).back(); // second extruded line to
     
-    return isConvertible(a, b, c, d, line_width, first_middle, second_middle, resulting_line_width, use_second_middle_as_first);
+    return isConvertible(a, b, c, d, line_width, first_middle, second_middle, resulting_line_width);
 }
 
-bool MergeInfillLines::isConvertible(const Point& a, const Point& b, const Point& c, const Point& d, int64_t line_width, Point& first_middle, Point& second_middle, int64_t& resulting_line_width, bool use_second_middle_as_first)
+bool MergeInfillLines::isConvertible(const Point& a, const Point& b, const Point& c, const Point& d, int64_t line_width, Point& first_middle, Point& second_middle, int64_t& resulting_line_width)
 {
-    use_second_middle_as_first = false;
     int64_t max_line_width = nozzle_size * 3 / 2;
 
     Point ab = b - a;
@@ -140,9 +161,7 @@ bool MergeInfillLines::isConvertible(const Point& a, const Point& b, const Point
         return false; // the line segments are connected!
     }
 
-    first_middle = (use_second_middle_as_first)?
-                    second_middle :
-                    (a + b) / 2;
+    first_middle = (a + b) / 2;
     second_middle = (c + d) / 2;
     
     Point dir_vector_perp = turn90CCW(second_middle - first_middle);
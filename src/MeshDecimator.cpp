@@ -0,0 +1,532 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "MeshDecimator.h"
+
+#include <algorithm> // sort, find, unique, binary_search
+#include <cmath> // sqrt
+#include <queue>
+#include <vector>
+
+#include "utils/ThreadPool.h"
+
+namespace cura
+{
+
+namespace
+{
+
+const int chunks_per_axis = 8; //!< The size of the grid of chunks which are decimated in parallel, along each axis
+
+/*!
+ * A position in mm relative to the minimum of the bounding box of the mesh, so that translated copies of a mesh get exactly the same errors.
+ */
+struct Position
+{
+    double x, y, z;
+
+    Position operator-(const Position& other) const
+    {
+        return Position{x - other.x, y - other.y, z - other.z};
+    }
+
+    Position cross(const Position& other) const
+    {
+        return Position{y * other.z - z * other.y, z * other.x - x * other.z, x * other.y - y * other.x};
+    }
+
+    double dot(const Position& other) const
+    {
+        return x * other.x + y * other.y + z * other.z;
+    }
+};
+
+/*!
+ * The sum of the squared distances to a set of planes, as a symmetric 4x4 matrix.
+ */
+struct Quadric
+{
+    double a2 = 0.0, ab = 0.0, ac = 0.0, ad = 0.0, b2 = 0.0, bc = 0.0, bd = 0.0, c2 = 0.0, cd = 0.0, d2 = 0.0;
+
+    /*!
+     * Add the plane ax + by + cz + d = 0, of which the normal (a, b, c) has unit length.
+     */
+    void addPlane(double a, double b, double c, double d)
+    {
+        a2 += a * a; ab += a * b; ac += a * c; ad += a * d;
+        b2 += b * b; bc += b * c; bd += b * d;
+        c2 += c * c; cd += c * d;
+        d2 += d * d;
+    }
+
+    void add(const Quadric& other)
+    {
+        a2 += other.a2; ab += other.ab; ac += other.ac; ad += other.ad;
+        b2 += other.b2; bc += other.bc; bd += other.bd;
+        c2 += other.c2; cd += other.cd;
+        d2 += other.d2;
+    }
+
+    /*!
+     * The sum of the squared distances of a position to the planes, in mm^2.
+     */
+    double evaluate(const Position& p) const
+    {
+        return a2 * p.x * p.x + 2 * ab * p.x * p.y + 2 * ac * p.x * p.z + 2 * ad * p.x
+            + b2 * p.y * p.y + 2 * bc * p.y * p.z + 2 * bd * p.y
+            + c2 * p.z * p.z + 2 * cd * p.z
+            + d2;
+    }
+};
+
+/*!
+ * A collapse of an edge into one of its vertices, queued by its cost.
+ */
+struct Collapse
+{
+    double cost; //!< The quadric error of the remaining vertex
+    uint32_t vertex_idx; //!< The vertex which is removed
+    uint32_t target_idx; //!< The vertex into which it is merged
+    uint32_t version; //!< The version of the removed vertex when the collapse was queued; it's outdated when the vertex changed since
+
+    bool operator<(const Collapse& other) const
+    { // the std::priority_queue puts the largest element on top, which should be the cheapest collapse
+        return cost > other.cost || (cost == other.cost && vertex_idx > other.vertex_idx);
+    }
+};
+
+/*!
+ * The state of the decimation of one mesh.
+ */
+class Decimation
+{
+public:
+    Decimation(Mesh& mesh, int64_t maximum_deviation)
+    : mesh(mesh)
+    , max_error(INT2MM(maximum_deviation) * INT2MM(maximum_deviation))
+    {
+    }
+
+    unsigned int run()
+    {
+        const size_t vertex_count = mesh.vertices.size();
+        origin = mesh.min();
+        const Point3 size = mesh.max() - origin;
+        chunk_size = Point3(size.x / chunks_per_axis + 1, size.y / chunks_per_axis + 1, size.z / chunks_per_axis + 1);
+        vertex_chunk.resize(vertex_count);
+        std::vector<uint32_t> chunk_start;
+        std::vector<uint32_t> chunk_vertices;
+
+        // number the vertices chunk by chunk and the faces by their first vertex, so that the data of each chunk is close together in memory
+        divideIntoChunks(Point3(0, 0, 0), chunk_start, chunk_vertices);
+        std::vector<uint32_t> new_vertex_idx(vertex_count);
+        std::vector<MeshVertex> sorted_vertices;
+        sorted_vertices.reserve(vertex_count);
+        for (uint32_t vertex_idx : chunk_vertices)
+        {
+            new_vertex_idx[vertex_idx] = sorted_vertices.size();
+            sorted_vertices.push_back(mesh.vertices[vertex_idx]);
+        }
+        mesh.vertices.swap(sorted_vertices);
+        std::vector<uint32_t> face_start(vertex_count + 1, 0);
+        for (MeshFace& face : mesh.faces)
+        {
+            for (int corner = 0; corner < 3; corner++)
+            {
+                face.vertex_index[corner] = new_vertex_idx[face.vertex_index[corner]];
+            }
+            face_start[face.vertex_index[0] + 1]++;
+        }
+        for (size_t vertex_idx = 0; vertex_idx < vertex_count; vertex_idx++)
+        {
+            face_start[vertex_idx + 1] += face_start[vertex_idx];
+        }
+        std::vector<MeshFace> sorted_faces(mesh.faces.size());
+        for (const MeshFace& face : mesh.faces)
+        {
+            sorted_faces[face_start[face.vertex_index[0]]++] = face;
+        }
+        mesh.faces.swap(sorted_faces);
+        std::vector<MeshFace>().swap(sorted_faces);
+
+        positions.resize(vertex_count);
+        vertex_faces.resize(vertex_count);
+        quadrics.resize(vertex_count);
+        versions.assign(vertex_count, 0);
+        removed_vertices.assign(vertex_count, false);
+        removed_faces.assign(mesh.faces.size(), false);
+        for (uint32_t face_idx = 0; face_idx < mesh.faces.size(); face_idx++)
+        {
+            for (int corner = 0; corner < 3; corner++)
+            {
+                vertex_faces[mesh.faces[face_idx].vertex_index[corner]].push_back(face_idx);
+            }
+        }
+        ThreadPool::getInstance()->parallelFor(0, vertex_count, [&](int vertex_idx)
+            {
+                const Point3 p = mesh.vertices[vertex_idx].p - origin;
+                positions[vertex_idx] = Position{INT2MM(p.x), INT2MM(p.y), INT2MM(p.z)};
+            }, 4096);
+        ThreadPool::getInstance()->parallelFor(0, vertex_count, [&](int vertex_idx)
+            {
+                for (uint32_t face_idx : vertex_faces[vertex_idx])
+                {
+                    const MeshFace& face = mesh.faces[face_idx];
+                    const Position& p0 = positions[face.vertex_index[0]];
+                    Position normal = (positions[face.vertex_index[1]] - p0).cross(positions[face.vertex_index[2]] - p0);
+                    const double length = std::sqrt(normal.dot(normal));
+                    if (length <= 0.0)
+                    { // a degenerate face has no plane
+                        continue;
+                    }
+                    normal = Position{normal.x / length, normal.y / length, normal.z / length};
+                    quadrics[vertex_idx].addPlane(normal.x, normal.y, normal.z, -normal.dot(p0));
+                }
+            }, 1024);
+
+        for (int pass = 0; pass < 2; pass++)
+        {
+            const Point3 shift = (pass == 0)? Point3(0, 0, 0) : Point3(chunk_size.x / 2, chunk_size.y / 2, chunk_size.z / 2);
+            divideIntoChunks(shift, chunk_start, chunk_vertices);
+            ThreadPool::getInstance()->parallelFor(0, chunk_start.size() - 1, [&](int chunk_idx)
+                {
+                    decimateChunk(chunk_idx, chunk_vertices.data() + chunk_start[chunk_idx], chunk_vertices.data() + chunk_start[chunk_idx + 1]);
+                });
+        }
+
+        std::vector<int> compacted_vertex_idx(vertex_count, -1);
+        std::vector<MeshVertex> new_vertices;
+        std::vector<MeshFace> new_faces;
+        for (size_t face_idx = 0; face_idx < mesh.faces.size(); face_idx++)
+        {
+            if (removed_faces[face_idx])
+            {
+                continue;
+            }
+            MeshFace face;
+            for (int corner = 0; corner < 3; corner++)
+            {
+                const int vertex_idx = mesh.faces[face_idx].vertex_index[corner];
+                if (compacted_vertex_idx[vertex_idx] < 0)
+                {
+                    compacted_vertex_idx[vertex_idx] = new_vertices.size();
+                    new_vertices.push_back(mesh.vertices[vertex_idx]);
+                }
+                face.vertex_index[corner] = compacted_vertex_idx[vertex_idx];
+            }
+            new_faces.push_back(face);
+        }
+        const unsigned int removed_face_count = mesh.faces.size() - new_faces.size();
+        mesh.setGeometry(std::move(new_vertices), std::move(new_faces));
+        return removed_face_count;
+    }
+
+private:
+    Mesh& mesh;
+    const double max_error; //!< The square of the maximum deviation in mm^2
+    Point3 origin; //!< The minimum of the bounding box of the mesh
+    Point3 chunk_size;
+    std::vector<Position> positions;
+    std::vector<std::vector<uint32_t>> vertex_faces; //!< The faces connected to each vertex, which change with each collapse
+    std::vector<Quadric> quadrics; //!< The planes of the original faces merged into each vertex
+    std::vector<uint32_t> versions; //!< How often the surroundings of each vertex changed, to recognize the outdated collapses in the queue
+    std::vector<char> removed_vertices;
+    std::vector<char> removed_faces;
+    std::vector<uint32_t> vertex_chunk; //!< The chunk of each vertex in the current pass
+
+    /*!
+     * Divide the vertices over the chunks of the grid.
+     *
+     * \param shift The offset of the grid, by which the vertices on the borders of the chunks of the first pass are inside a chunk in the second pass
+     * \param[out] chunk_start The start of each chunk in \p chunk_vertices, with one extra element for the end of the last chunk
+     * \param[out] chunk_vertices The vertices of each chunk, in increasing order within each chunk
+     */
+    void divideIntoChunks(const Point3& shift, std::vector<uint32_t>& chunk_start, std::vector<uint32_t>& chunk_vertices)
+    {
+        const unsigned int cells_per_axis = chunks_per_axis + 1; // the shifted grid has one more chunk along each axis
+        const size_t vertex_count = mesh.vertices.size();
+        chunk_start.assign(cells_per_axis * cells_per_axis * cells_per_axis + 1, 0);
+        for (size_t vertex_idx = 0; vertex_idx < vertex_count; vertex_idx++)
+        {
+            const Point3 p = mesh.vertices[vertex_idx].p - origin + shift;
+            vertex_chunk[vertex_idx] = ((p.x / chunk_size.x) * cells_per_axis + p.y / chunk_size.y) * cells_per_axis + p.z / chunk_size.z;
+            chunk_start[vertex_chunk[vertex_idx] + 1]++;
+        }
+        for (size_t chunk_idx = 0; chunk_idx + 1 < chunk_start.size(); chunk_idx++)
+        {
+            chunk_start[chunk_idx + 1] += chunk_start[chunk_idx];
+        }
+        chunk_vertices.resize(vertex_count);
+        std::vector<uint32_t> insert_idx(chunk_start.begin(), chunk_start.end() - 1);
+        for (size_t vertex_idx = 0; vertex_idx < vertex_count; vertex_idx++)
+        {
+            chunk_vertices[insert_idx[vertex_chunk[vertex_idx]]++] = vertex_idx;
+        }
+    }
+
+    /*!
+     * The buffers used while decimating a chunk, so that they aren't allocated for every vertex.
+     */
+    struct Buffers
+    {
+        std::vector<uint32_t> neighbours;
+        std::vector<uint32_t> target_neighbours;
+        std::vector<std::pair<double, uint32_t>> targets; //!< The cost and index of each neighbour to merge into
+    };
+
+    /*!
+     * Collapse the cheapest edges of the vertices of a chunk, until no collapse stays within the maximum deviation.
+     *
+     * The queued collapses aren't updated when their surroundings change. The quadrics only grow, so a queued cost can only be too low;
+     * each collapse is checked again when it comes out of the queue, and queued again with its current cost when it changed.
+     */
+    void decimateChunk(uint32_t chunk_idx, const uint32_t* begin, const uint32_t* end)
+    {
+        std::priority_queue<Collapse> queue;
+        Buffers buffers;
+        for (const uint32_t* vertex_idx = begin; vertex_idx != end; ++vertex_idx)
+        {
+            queueCollapse(queue, *vertex_idx, chunk_idx, buffers);
+        }
+        while (!queue.empty())
+        {
+            const Collapse collapse = queue.top();
+            queue.pop();
+            if (removed_vertices[collapse.vertex_idx] || collapse.version != versions[collapse.vertex_idx])
+            {
+                continue;
+            }
+            if (removed_vertices[collapse.target_idx]
+                || getCost(collapse.vertex_idx, collapse.target_idx) > collapse.cost
+                || !getRemovableNeighbours(collapse.vertex_idx, chunk_idx, buffers.neighbours)
+                || !std::binary_search(buffers.neighbours.begin(), buffers.neighbours.end(), collapse.target_idx)
+                || !canCollapse(collapse.vertex_idx, collapse.target_idx, buffers))
+            { // its surroundings were changed by another collapse
+                versions[collapse.vertex_idx]++;
+                queueCollapse(queue, collapse.vertex_idx, chunk_idx, buffers);
+                continue;
+            }
+            collapseEdge(collapse.vertex_idx, collapse.target_idx);
+            if (vertex_chunk[collapse.target_idx] == chunk_idx)
+            { // the merged vertex has a larger quadric, so its own collapse is more expensive now
+                versions[collapse.target_idx]++;
+                queueCollapse(queue, collapse.target_idx, chunk_idx, buffers);
+            }
+        }
+    }
+
+    /*!
+     * Get the other vertices of the faces of a vertex, sorted by index.
+     */
+    void getNeighbours(uint32_t vertex_idx, std::vector<uint32_t>& neighbours) const
+    {
+        neighbours.clear();
+        for (uint32_t face_idx : vertex_faces[vertex_idx])
+        {
+            for (int corner = 0; corner < 3; corner++)
+            {
+                const uint32_t neighbour_idx = mesh.faces[face_idx].vertex_index[corner];
+                if (neighbour_idx != vertex_idx)
+                {
+                    neighbours.push_back(neighbour_idx);
+                }
+            }
+        }
+        std::sort(neighbours.begin(), neighbours.end());
+        neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+    }
+
+    /*!
+     * Get the neighbours of a vertex if it may be removed in a chunk:
+     * all its edges are connected to exactly two faces and all its neighbours are in the same chunk.
+     *
+     * \return Whether the vertex may be removed
+     */
+    bool getRemovableNeighbours(uint32_t vertex_idx, uint32_t chunk_idx, std::vector<uint32_t>& neighbours) const
+    {
+        if (removed_vertices[vertex_idx] || vertex_chunk[vertex_idx] != chunk_idx)
+        {
+            return false;
+        }
+        neighbours.clear();
+        for (uint32_t face_idx : vertex_faces[vertex_idx])
+        {
+            for (int corner = 0; corner < 3; corner++)
+            {
+                const uint32_t neighbour_idx = mesh.faces[face_idx].vertex_index[corner];
+                if (neighbour_idx != vertex_idx)
+                {
+                    if (vertex_chunk[neighbour_idx] != chunk_idx)
+                    {
+                        return false;
+                    }
+                    neighbours.push_back(neighbour_idx);
+                }
+            }
+        }
+        std::sort(neighbours.begin(), neighbours.end());
+        if (neighbours.size() < 6 || neighbours.size() % 2 != 0)
+        {
+            return false;
+        }
+        for (size_t neighbour_idx = 0; neighbour_idx < neighbours.size(); neighbour_idx += 2)
+        { // each edge is in exactly two faces
+            if (neighbours[neighbour_idx] != neighbours[neighbour_idx + 1] || (neighbour_idx + 2 < neighbours.size() && neighbours[neighbour_idx + 2] == neighbours[neighbour_idx]))
+            {
+                return false;
+            }
+        }
+        neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+        return true;
+    }
+
+    /*!
+     * Whether a vertex can be merged into one of its neighbours without changing the topology of the surface or folding a face over.
+     *
+     * \param vertex_idx The vertex to remove
+     * \param target_idx The vertex into which it is merged
+     * \param buffers The buffers of the chunk, with the neighbours of the removed vertex
+     */
+    bool canCollapse(uint32_t vertex_idx, uint32_t target_idx, Buffers& buffers) const
+    {
+        const std::vector<uint32_t>& neighbours = buffers.neighbours;
+        std::vector<uint32_t>& target_neighbours = buffers.target_neighbours;
+        getNeighbours(target_idx, target_neighbours);
+        unsigned int common_neighbour_count = 0;
+        for (std::vector<uint32_t>::const_iterator it = neighbours.begin(), target_it = target_neighbours.begin(); it != neighbours.end() && target_it != target_neighbours.end(); )
+        {
+            if (*it < *target_it)
+            {
+                ++it;
+            }
+            else if (*target_it < *it)
+            {
+                ++target_it;
+            }
+            else
+            {
+                common_neighbour_count++;
+                ++it;
+                ++target_it;
+            }
+        }
+        if (common_neighbour_count != 2)
+        { // the surface would be pinched together
+            return false;
+        }
+        if (neighbours.size() == 3 && target_neighbours.size() == 3)
+        { // a tetrahedron would collapse into two faces on top of each other
+            return false;
+        }
+        for (uint32_t face_idx : vertex_faces[vertex_idx])
+        {
+            const MeshFace& face = mesh.faces[face_idx];
+            Position corners[3];
+            Position moved_corners[3];
+            bool has_target = false;
+            for (int corner = 0; corner < 3; corner++)
+            {
+                has_target = has_target || uint32_t(face.vertex_index[corner]) == target_idx;
+                corners[corner] = positions[face.vertex_index[corner]];
+                moved_corners[corner] = (uint32_t(face.vertex_index[corner]) == vertex_idx)? positions[target_idx] : corners[corner];
+            }
+            if (has_target)
+            { // removed by the collapse
+                continue;
+            }
+            const Position normal = (corners[1] - corners[0]).cross(corners[2] - corners[0]);
+            const Position moved_normal = (moved_corners[1] - moved_corners[0]).cross(moved_corners[2] - moved_corners[0]);
+            if (normal.dot(moved_normal) <= 0.0)
+            { // the face would fold over or become degenerate
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /*!
+     * The quadric error of merging a vertex into another.
+     */
+    double getCost(uint32_t vertex_idx, uint32_t target_idx) const
+    {
+        Quadric quadric = quadrics[vertex_idx];
+        quadric.add(quadrics[target_idx]);
+        return quadric.evaluate(positions[target_idx]);
+    }
+
+    /*!
+     * Queue the cheapest collapse of a vertex into one of its neighbours within the maximum deviation, if any.
+     */
+    void queueCollapse(std::priority_queue<Collapse>& queue, uint32_t vertex_idx, uint32_t chunk_idx, Buffers& buffers) const
+    {
+        if (!getRemovableNeighbours(vertex_idx, chunk_idx, buffers.neighbours))
+        {
+            return;
+        }
+        buffers.targets.clear();
+        for (uint32_t target_idx : buffers.neighbours)
+        {
+            const double cost = getCost(vertex_idx, target_idx);
+            if (cost <= max_error)
+            {
+                buffers.targets.emplace_back(cost, target_idx);
+            }
+        }
+        std::sort(buffers.targets.begin(), buffers.targets.end());
+        for (const std::pair<double, uint32_t>& target : buffers.targets)
+        { // the cheapest collapse is usually allowed, so the more expensive check is only done until one is found
+            if (canCollapse(vertex_idx, target.second, buffers))
+            {
+                queue.push(Collapse{target.first, vertex_idx, target.second, versions[vertex_idx]});
+                return;
+            }
+        }
+    }
+
+    /*!
+     * Merge a vertex into one of its neighbours: the two faces of their edge are removed and the other faces of the vertex are connected to the neighbour instead.
+     */
+    void collapseEdge(uint32_t vertex_idx, uint32_t target_idx)
+    {
+        for (uint32_t face_idx : vertex_faces[vertex_idx])
+        {
+            MeshFace& face = mesh.faces[face_idx];
+            if (uint32_t(face.vertex_index[0]) == target_idx || uint32_t(face.vertex_index[1]) == target_idx || uint32_t(face.vertex_index[2]) == target_idx)
+            {
+                removed_faces[face_idx] = true;
+                for (int corner = 0; corner < 3; corner++)
+                {
+                    if (uint32_t(face.vertex_index[corner]) != vertex_idx)
+                    {
+                        std::vector<uint32_t>& faces = vertex_faces[face.vertex_index[corner]];
+                        faces.erase(std::find(faces.begin(), faces.end(), face_idx));
+                    }
+                }
+                continue;
+            }
+            for (int corner = 0; corner < 3; corner++)
+            {
+                if (uint32_t(face.vertex_index[corner]) == vertex_idx)
+                {
+                    face.vertex_index[corner] = target_idx;
+                }
+            }
+            vertex_faces[target_idx].push_back(face_idx);
+        }
+        std::vector<uint32_t>().swap(vertex_faces[vertex_idx]);
+        quadrics[target_idx].add(quadrics[vertex_idx]);
+        removed_vertices[vertex_idx] = true;
+    }
+};
+
+}//namespace
+
+unsigned int MeshDecimator::decimate(Mesh& mesh, int64_t maximum_deviation)
+{
+    if (maximum_deviation <= 0 || mesh.faces.empty())
+    {
+        return 0;
+    }
+    Decimation decimation(mesh, maximum_deviation);
+    return decimation.run();
+}
+
+}//namespace cura
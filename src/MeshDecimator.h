@@ -0,0 +1,43 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef MESH_DECIMATOR_H
+#define MESH_DECIMATOR_H
+
+#include <stdint.h>
+
+#include "mesh.h"
+
+namespace cura
+{
+
+/*!
+ * Reduces the number of faces of finely tessellated meshes, such as 3D scans, before they are sliced.
+ *
+ * Edges are collapsed in order of their quadric error: the sum of the squared distances of the remaining vertex
+ * to the planes of all original faces merged into it. A collapse is only done while that sum stays below the square of the maximum deviation,
+ * so that no vertex ends up farther than the maximum deviation from the plane of any original face around it.
+ * The remaining vertex is always one of the two vertices of the edge, so all vertices keep their exact original positions.
+ *
+ * Only vertices of which all edges are connected to exactly two faces are removed, so open edges and non-manifold edges are kept as they are.
+ * Collapses which would fold a face over or disconnect the surface aren't done.
+ *
+ * The mesh is divided into a fixed grid of chunks which are decimated in parallel.
+ * A vertex is only removed when all its neighbours are in the same chunk, so the chunks never touch the same faces;
+ * the vertices along the borders of the chunks are decimated in a second pass over a grid shifted by half a chunk.
+ * The grid depends on the bounding box of the mesh only, so the result doesn't depend on the number of threads
+ * and translated copies of a mesh are decimated the same way.
+ */
+class MeshDecimator
+{
+public:
+    /*!
+     * Decimate a mesh with the connected faces of Mesh::finish.
+     *
+     * \param mesh The mesh to decimate, which is finished again afterwards
+     * \param maximum_deviation The maximum distance in microns of a vertex to the planes of the original faces it was merged with
+     * \return The number of faces removed
+     */
+    static unsigned int decimate(Mesh& mesh, int64_t maximum_deviation);
+};
+
+}//namespace cura
+#endif//MESH_DECIMATOR_H
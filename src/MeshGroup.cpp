@@ -2,31 +2,730 @@
 #include <string.h>
 #include <strings.h>
 #include <stdio.h>
+#include <stdlib.h> // strtof, strtod
+#include <algorithm> // min, max, any_of
+#include <list>
+#include <unordered_map>
 
 #include "MeshGroup.h"
+#include "MeshDecimator.h"
 #include "utils/gettime.h"
 #include "utils/logoutput.h"
+#include "utils/MappedFile.h"
 #include "utils/string.h"
+#include "utils/ThreadPool.h"
+#include "utils/ZipArchive.h"
 
 namespace cura
 {
 
 FILE* binaryMeshBlob = nullptr;
 
-/* Custom fgets function to support Mac line-ends in Ascii STL files. OpenSCAD produces this when used on Mac */
-void* fgets_(char* ptr, size_t len, FILE* f)
+namespace
 {
-    while(len && fread(ptr, 1, 1, f) > 0)
+
+/*!
+ * A mesh as loaded from a file, kept in memory so that it doesn't need to be loaded again.
+ */
+struct CachedMesh
+{
+    uint64_t content_hash; //!< The hash of the file contents
+    size_t file_size; //!< The size of the file
+    FMatrix3x3 transformation; //!< The transformation with which the mesh was loaded
+    Mesh mesh; //!< The loaded mesh, without a parent settings object
+
+    CachedMesh(uint64_t content_hash, size_t file_size, const FMatrix3x3& transformation, const Mesh& mesh)
+    : content_hash(content_hash)
+    , file_size(file_size)
+    , transformation(transformation)
+    , mesh(mesh)
+    {
+        this->mesh.setParent(nullptr);
+    }
+};
+
+std::list<CachedMesh> mesh_cache; //!< The cached meshes, the most recently used first
+unsigned int max_cached_meshes = 0; //!< The number of meshes to keep in \ref mesh_cache
+
+/*!
+ * Compute the 64-bit FNV-1a hash of the contents of a file.
+ */
+uint64_t hashContents(const char* data, size_t size)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t byte_idx = 0; byte_idx < size; byte_idx++)
+    {
+        hash ^= static_cast<unsigned char>(data[byte_idx]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+/*!
+ * Whether a character is white space within a line; lines end at both Unix and Mac line-ends.
+ */
+bool isSpaceInLine(char c)
+{
+    return c == ' ' || c == '\t' || c == '\v' || c == '\f';
+}
+
+/*!
+ * Parse a number like sscanf's %f does, for a number which starts at \p start and which lies before \p end.
+ *
+ * Numbers with few significant digits and a small exponent, as written by all STL exporters, are computed directly:
+ * both the digits and the power of ten are exact floats then, so a single multiplication or division rounds correctly, just like strtof.
+ * Any other number is handed to strtof.
+ *
+ * \param start Where the number starts, after any white space
+ * \param end The end of the line, before which the number lies
+ * \param result Output parameter: the parsed number
+ * \return Where the number ends, or \p start if there is no number
+ */
+const char* parseFloat(const char* start, const char* end, float& result)
+{
+    static const float powers_of_ten[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+    constexpr uint32_t max_exact_digits = 1 << 24; // all integers below this are exact floats
+    const char* p = start;
+    const bool negative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        p++;
+    }
+    uint32_t digits = 0;
+    int exponent = 0;
+    bool any_digit = false;
+    bool exact = true;
+    for (; p < end && *p >= '0' && *p <= '9'; p++)
+    {
+        any_digit = true;
+        if (exact)
+        {
+            digits = digits * 10 + (*p - '0');
+            exact = digits <= max_exact_digits;
+        }
+    }
+    if (p < end && *p == '.')
+    {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++)
+        {
+            any_digit = true;
+            if (exact)
+            {
+                digits = digits * 10 + (*p - '0');
+                exact = digits <= max_exact_digits;
+            }
+            exponent--;
+        }
+    }
+    if (any_digit && p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char* exponent_start = p + 1;
+        const bool exponent_negative = exponent_start < end && *exponent_start == '-';
+        if (exponent_start < end && (*exponent_start == '-' || *exponent_start == '+'))
+        {
+            exponent_start++;
+        }
+        int written_exponent = 0;
+        const char* exponent_end = exponent_start;
+        for (; exponent_end < end && *exponent_end >= '0' && *exponent_end <= '9' && written_exponent < 1000; exponent_end++)
+        {
+            written_exponent = written_exponent * 10 + (*exponent_end - '0');
+        }
+        if (exponent_end > exponent_start)
+        {
+            exponent += exponent_negative ? -written_exponent : written_exponent;
+            p = exponent_end;
+        }
+        else
+        {
+            exact = false; // strtof only takes the part before the 'e'; leave such odd cases to strtof
+        }
+    }
+    if (any_digit && exact && std::abs(exponent) <= 10 && (p == end || isSpaceInLine(*p)))
+    {
+        const float value = (exponent >= 0) ? float(digits) * powers_of_ten[exponent] : float(digits) / powers_of_ten[-exponent];
+        result = negative ? -value : value;
+        return p;
+    }
+
+    // copy the number, so that strtof doesn't read past the end of the line, which might be the end of the file
+    char buffer[64];
+    const char* token_end = start;
+    while (token_end < end && !isSpaceInLine(*token_end) && token_end - start < int(sizeof(buffer)) - 1)
+    {
+        token_end++;
+    }
+    memcpy(buffer, start, token_end - start);
+    buffer[token_end - start] = '\0';
+    char* parsed_end;
+    result = strtof(buffer, &parsed_end);
+    return start + (parsed_end - buffer);
+}
+
+const size_t line_chunk_size = 1 << 20; //!< The approximate number of bytes of a text file parsed at once
+
+/*!
+ * Get the start of a chunk of a text file which is parsed in chunks of whole lines of about \ref line_chunk_size bytes.
+ *
+ * \param data The contents of the file
+ * \param size The number of bytes in \p data
+ * \param chunk_idx The chunk, where the chunk after the last one starts at the end of the file
+ */
+size_t lineChunkStart(const char* data, size_t size, size_t chunk_idx)
+{
+    size_t start = std::min(size, chunk_idx * line_chunk_size);
+    while (start > 0 && start < size && data[start - 1] != '\n' && data[start - 1] != '\r')
+    {
+        start++;
+    }
+    return start;
+}
+
+/*!
+ * Parse the vertices of the lines of the form " vertex %f %f %f" in a part of an ASCII STL file.
+ *
+ * \param start The start of a line
+ * \param end The end of a line
+ * \param matrix The transformation to apply to the vertices
+ * \param vertices Output parameter: the transformed vertices are added to this
+ */
+void parseAsciiSTLVertices(const char* start, const char* end, const FMatrix3x3& matrix, std::vector<Point3>& vertices)
+{
+    const char* line = start;
+    while (line < end)
+    {
+        const char* line_end = line;
+        while (line_end < end && *line_end != '\n' && *line_end != '\r')
+        {
+            line_end++;
+        }
+        const char* p = line;
+        while (p < line_end && isSpaceInLine(*p))
+        {
+            p++;
+        }
+        if (line_end - p >= 6 && memcmp(p, "vertex", 6) == 0)
+        {
+            p += 6;
+            float coordinates[3];
+            unsigned int coordinate_count = 0;
+            for (; coordinate_count < 3; coordinate_count++)
+            {
+                while (p < line_end && isSpaceInLine(*p))
+                {
+                    p++;
+                }
+                const char* number_end = parseFloat(p, line_end, coordinates[coordinate_count]);
+                if (number_end == p)
+                {
+                    break;
+                }
+                p = number_end;
+            }
+            if (coordinate_count == 3)
+            {
+                vertices.push_back(matrix.apply(FPoint3(coordinates[0], coordinates[1], coordinates[2])));
+            }
+        }
+        line = line_end + 1;
+    }
+}
+
+/*!
+ * Parse a vertex index of a face in an OBJ file, like "12", "-3" or the "12" of "12/4/7".
+ *
+ * \param start Where the index starts, after any white space
+ * \param end The end of the line
+ * \param result Output parameter: the index as written, which is one-based if positive and relative to the last vertex if negative
+ * \return Where the corner ends, after any texture coordinate and normal indices, or \p start if there is no index
+ */
+const char* parseOBJIndex(const char* start, const char* end, int64_t& result)
+{
+    const char* p = start;
+    const bool negative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        p++;
+    }
+    const char* digits_start = p;
+    int64_t index = 0;
+    for (; p < end && *p >= '0' && *p <= '9' && index < (int64_t(1) << 40); p++)
+    {
+        index = index * 10 + (*p - '0');
+    }
+    if (p == digits_start)
+    {
+        return start;
+    }
+    result = negative ? -index : index;
+    while (p < end && !isSpaceInLine(*p))
+    {
+        p++;
+    }
+    return p;
+}
+
+/*!
+ * The vertices and the triangulated faces of a part of an OBJ file.
+ */
+struct OBJChunk
+{
+    std::vector<Point3> vertices; //!< The transformed vertices
+    std::vector<int64_t> corner_indices; //!< Three zero-based vertex indices per triangle, which may be out of range
+    std::vector<size_t> relative_corners; //!< The corners of which the index is relative to the first vertex of this chunk, rather than absolute
+};
+
+/*!
+ * Parse the vertex lines "v %f %f %f" and face lines "f %d %d %d..." in a part of an OBJ file.
+ *
+ * Faces with more than three corners are split into a fan of triangles.
+ * Everything else, like texture coordinates, normals, groups and materials, is ignored.
+ *
+ * \param start The start of a line
+ * \param end The end of a line
+ * \param matrix The transformation to apply to the vertices
+ * \param chunk Output parameter: where to store the vertices and faces
+ */
+void parseOBJChunk(const char* start, const char* end, const FMatrix3x3& matrix, OBJChunk& chunk)
+{
+    std::vector<int64_t> face_corners;
+    std::vector<bool> face_corner_relative;
+    const char* line = start;
+    while (line < end)
+    {
+        const char* line_end = line;
+        while (line_end < end && *line_end != '\n' && *line_end != '\r')
+        {
+            line_end++;
+        }
+        const char* p = line;
+        while (p < line_end && isSpaceInLine(*p))
+        {
+            p++;
+        }
+        if (line_end - p >= 2 && p[0] == 'v' && isSpaceInLine(p[1]))
+        {
+            p++;
+            float coordinates[3];
+            unsigned int coordinate_count = 0;
+            for (; coordinate_count < 3; coordinate_count++)
+            {
+                while (p < line_end && isSpaceInLine(*p))
+                {
+                    p++;
+                }
+                const char* number_end = parseFloat(p, line_end, coordinates[coordinate_count]);
+                if (number_end == p)
+                {
+                    break;
+                }
+                p = number_end;
+            }
+            if (coordinate_count < 3)
+            {
+                coordinates[0] = coordinates[1] = coordinates[2] = 0; // keep the numbering of the later vertices intact
+            }
+            chunk.vertices.push_back(matrix.apply(FPoint3(coordinates[0], coordinates[1], coordinates[2])));
+        }
+        else if (line_end - p >= 2 && p[0] == 'f' && isSpaceInLine(p[1]))
+        {
+            p++;
+            face_corners.clear();
+            face_corner_relative.clear();
+            bool valid = true;
+            while (true)
+            {
+                while (p < line_end && isSpaceInLine(*p))
+                {
+                    p++;
+                }
+                int64_t index;
+                const char* index_end = parseOBJIndex(p, line_end, index);
+                if (index_end == p)
+                {
+                    valid = valid && p == line_end;
+                    break;
+                }
+                p = index_end;
+                valid = valid && index != 0;
+                face_corners.push_back(index > 0 ? index - 1 : int64_t(chunk.vertices.size()) + index);
+                face_corner_relative.push_back(index < 0);
+            }
+            for (size_t corner = 2; valid && corner < face_corners.size(); corner++)
+            {
+                for (size_t fan_corner : { size_t(0), corner - 1, corner })
+                {
+                    if (face_corner_relative[fan_corner])
+                    {
+                        chunk.relative_corners.push_back(chunk.corner_indices.size());
+                    }
+                    chunk.corner_indices.push_back(face_corners[fan_corner]);
+                }
+            }
+        }
+        line = line_end + 1;
+    }
+}
+
+/*!
+ * Finds the tags of an XML document one by one, such as the 3D model part of a 3MF package.
+ *
+ * Only the tags and their attributes are of interest, so text, comments, processing instructions and the document type are skipped.
+ * Entities in attribute values aren't resolved.
+ */
+class XMLTagScanner
+{
+public:
+    XMLTagScanner(const char* start, const char* end)
+    : p(start)
+    , end(end)
+    , name_start(start)
+    , name_end(start)
+    , attributes_end(start)
+    , end_tag(false)
+    , empty_tag(false)
+    {
+    }
+
+    /*!
+     * Go to the next start, end or empty element tag.
+     *
+     * \return Whether there was another tag
+     */
+    bool next()
+    {
+        while (true)
+        {
+            p = static_cast<const char*>(memchr(p, '<', end - p));
+            if (!p)
+            {
+                p = end;
+                return false;
+            }
+            if (skipPast("<!--", "-->") || skipPast("<![CDATA[", "]]>") || skipPast("<?", "?>") || skipPast("<!", ">"))
+            {
+                continue;
+            }
+            p++;
+            end_tag = p < end && *p == '/';
+            if (end_tag)
+            {
+                p++;
+            }
+            name_start = p;
+            while (p < end && !isXMLSpace(*p) && *p != '/' && *p != '>')
+            {
+                if (*p == ':') // drop the namespace prefix
+                {
+                    name_start = p + 1;
+                }
+                p++;
+            }
+            name_end = p;
+            char quote = 0;
+            for (; p < end && (quote || *p != '>'); p++)
+            {
+                if (quote ? *p == quote : (*p == '"' || *p == '\''))
+                {
+                    quote = quote ? 0 : *p;
+                }
+            }
+            if (p == end)
+            {
+                return false;
+            }
+            attributes_end = p;
+            empty_tag = p[-1] == '/';
+            p++;
+            return true;
+        }
+    }
+
+    /*!
+     * Whether the current tag is an end tag, like "</mesh>".
+     */
+    bool isEndTag() const
+    {
+        return end_tag;
+    }
+
+    /*!
+     * Whether the current tag is an empty element tag, like "<vertex x="1" y="2" z="3"/>", which has no end tag.
+     */
+    bool isEmptyTag() const
+    {
+        return empty_tag;
+    }
+
+    /*!
+     * Whether the name of the current tag without any namespace prefix is \p name.
+     */
+    bool nameIs(const char* name) const
+    {
+        const size_t length = strlen(name);
+        return size_t(name_end - name_start) == length && memcmp(name_start, name, length) == 0;
+    }
+
+    /*!
+     * Find an attribute of the current tag.
+     *
+     * \param name The name of the attribute
+     * \param[out] value_start Where the value starts
+     * \param[out] value_end Where the value ends, before the closing quote
+     * \return Whether the tag has the attribute
+     */
+    bool getAttribute(const char* name, const char*& value_start, const char*& value_end) const
+    {
+        const size_t length = strlen(name);
+        const char* q = name_end;
+        while (q < attributes_end)
+        {
+            while (q < attributes_end && isXMLSpace(*q))
+            {
+                q++;
+            }
+            const char* attribute_name = q;
+            while (q < attributes_end && *q != '=' && !isXMLSpace(*q))
+            {
+                q++;
+            }
+            const char* attribute_name_end = q;
+            while (q < attributes_end && (isXMLSpace(*q) || *q == '='))
+            {
+                q++;
+            }
+            if (q == attributes_end || (*q != '"' && *q != '\''))
+            {
+                return false;
+            }
+            const char quote = *q;
+            const char* value = q + 1;
+            q = static_cast<const char*>(memchr(value, quote, attributes_end - value));
+            if (!q)
+            {
+                return false;
+            }
+            if (size_t(attribute_name_end - attribute_name) == length && memcmp(attribute_name, name, length) == 0)
+            {
+                value_start = value;
+                value_end = q;
+                return true;
+            }
+            q++;
+        }
+        return false;
+    }
+
+    /*!
+     * Get an attribute of the current tag as a string, or an empty string if the tag doesn't have it.
+     */
+    std::string getAttribute(const char* name) const
+    {
+        const char* value_start;
+        const char* value_end;
+        if (!getAttribute(name, value_start, value_end))
+        {
+            return std::string();
+        }
+        return std::string(value_start, value_end);
+    }
+
+private:
+    const char* p; //!< Where to continue looking for tags
+    const char* end; //!< The end of the document
+    const char* name_start; //!< The start of the local name of the current tag
+    const char* name_end; //!< The end of the name of the current tag, where its attributes start
+    const char* attributes_end; //!< The closing '>' or "/>" of the current tag
+    bool end_tag; //!< Whether the current tag is an end tag
+    bool empty_tag; //!< Whether the current tag is an empty element tag
+
+    static bool isXMLSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    /*!
+     * If the document continues with \p open at the current position, skip past the next \p close.
+     */
+    bool skipPast(const char* open, const char* close)
+    {
+        const size_t open_length = strlen(open);
+        if (size_t(end - p) < open_length || memcmp(p, open, open_length) != 0)
+        {
+            return false;
+        }
+        const size_t close_length = strlen(close);
+        for (p += open_length; p < end; p++)
+        {
+            if (size_t(end - p) >= close_length && memcmp(p, close, close_length) == 0)
+            {
+                p += close_length;
+                return true;
+            }
+        }
+        return true;
+    }
+};
+
+/*!
+ * An affine transformation of a 3MF file: a 3x3 matrix followed by a translation, applied to row vectors.
+ */
+struct Transform3MF
+{
+    double m[4][3]; //!< The rows m00 m01 m02, m10 m11 m12, m20 m21 m22 and the translation m30 m31 m32
+
+    Transform3MF()
+    : m{ {1, 0, 0}, {0, 1, 0}, {0, 0, 1}, {0, 0, 0} }
+    {
+    }
+
+    /*!
+     * Parse the twelve space separated numbers of a transform attribute.
+     *
+     * \return Whether the transform could be parsed; if not the transformation is left unchanged
+     */
+    bool parse(const std::string& value)
+    {
+        double parsed[12];
+        const char* p = value.c_str();
+        for (unsigned int number_idx = 0; number_idx < 12; number_idx++)
+        {
+            char* number_end;
+            parsed[number_idx] = strtod(p, &number_end);
+            if (number_end == p)
+            {
+                return false;
+            }
+            p = number_end;
+        }
+        memcpy(m, parsed, sizeof(m));
+        return true;
+    }
+
+    /*!
+     * The transformation which first applies this one and then \p after.
+     */
+    Transform3MF then(const Transform3MF& after) const
+    {
+        Transform3MF result;
+        for (unsigned int row = 0; row < 4; row++)
+        {
+            for (unsigned int column = 0; column < 3; column++)
+            {
+                result.m[row][column] = m[row][0] * after.m[0][column] + m[row][1] * after.m[1][column] + m[row][2] * after.m[2][column] + ((row == 3) ? after.m[3][column] : 0);
+            }
+        }
+        return result;
+    }
+
+    FPoint3 apply(const FPoint3& p) const
     {
-        if (*ptr == '\n' || *ptr == '\r')
+        return FPoint3(
+            p.x * m[0][0] + p.y * m[1][0] + p.z * m[2][0] + m[3][0],
+            p.x * m[0][1] + p.y * m[1][1] + p.z * m[2][1] + m[3][1],
+            p.x * m[0][2] + p.y * m[1][2] + p.z * m[2][2] + m[3][2]);
+    }
+};
+
+/*!
+ * An object resource of a 3MF model: either a mesh or a set of components which refer to other objects.
+ */
+struct Object3MF
+{
+    /*!
+     * A reference to another object, placed with a transformation.
+     */
+    struct Component
+    {
+        std::string object_id;
+        Transform3MF transform;
+    };
+
+    std::vector<FPoint3> vertices; //!< The vertices of the mesh, in the unit of the model
+    std::vector<uint32_t> corner_indices; //!< Three indices into \ref Object3MF::vertices per triangle
+    std::vector<Component> components; //!< The components, if the object isn't a mesh
+};
+
+/*!
+ * Find the meshes which make up an object of a 3MF model, together with the transformation of each.
+ *
+ * \param objects The objects of the model by id
+ * \param object_id The object to flatten
+ * \param transform The transformation of the object
+ * \param depth How many components deep the object is, to detect components which (indirectly) contain themselves
+ * \param meshes Output parameter: the meshes of the object are added to this
+ * \return Whether all referenced objects exist
+ */
+bool flattenObject3MF(const std::unordered_map<std::string, Object3MF>& objects, const std::string& object_id, const Transform3MF& transform, unsigned int depth, std::vector<std::pair<const Object3MF*, Transform3MF>>& meshes)
+{
+    const unsigned int max_depth = 32;
+    auto object = objects.find(object_id);
+    if (object == objects.end() || depth > max_depth)
+    {
+        return false;
+    }
+    if (!object->second.corner_indices.empty())
+    {
+        meshes.emplace_back(&object->second, transform);
+    }
+    bool success = true;
+    for (const Object3MF::Component& component : object->second.components)
+    {
+        success = flattenObject3MF(objects, component.object_id, component.transform.then(transform), depth + 1, meshes) && success;
+    }
+    return success;
+}
+
+/*!
+ * Find the 3D model part of a 3MF package through the relationships of the package, or fall back to the usual name.
+ */
+std::string find3MFModelPart(const ZipArchive& archive)
+{
+    std::vector<char> buffer;
+    const char* relationships;
+    size_t relationships_size;
+    if (archive.getEntry("_rels/.rels", buffer, relationships, relationships_size))
+    {
+        XMLTagScanner scanner(relationships, relationships + relationships_size);
+        const std::string model_type = "/3dmodel";
+        while (scanner.next())
         {
-            *ptr = '\0';
-            return ptr;
+            if (!scanner.isEndTag() && scanner.nameIs("Relationship"))
+            {
+                const std::string type = scanner.getAttribute("Type");
+                if (type.size() >= model_type.size() && type.compare(type.size() - model_type.size(), model_type.size(), model_type) == 0)
+                {
+                    return scanner.getAttribute("Target");
+                }
+            }
         }
-        ptr++;
-        len--;
     }
-    return nullptr;
+    return "3D/3dmodel.model";
+}
+
+/*!
+ * Get the length of a unit of a 3MF model in millimeters, or zero if the unit is unknown.
+ */
+double unitLength3MF(const std::string& unit)
+{
+    if (unit.empty() || unit == "millimeter") return 1.0;
+    if (unit == "micron") return 0.001;
+    if (unit == "centimeter") return 10.0;
+    if (unit == "inch") return 25.4;
+    if (unit == "foot") return 304.8;
+    if (unit == "meter") return 1000.0;
+    return 0.0;
+}
+
+}//namespace
+
+void setMeshCacheSize(unsigned int mesh_count)
+{
+    max_cached_meshes = mesh_count;
+    while (mesh_cache.size() > max_cached_meshes)
+    {
+        mesh_cache.pop_back();
+    }
 }
 
 MeshGroup::MeshGroup(SettingsBaseVirtual* settings_base)
@@ -49,7 +748,7 @@ int MeshGroup::getExtruderCount()
 {
     if (extruder_count == -1)
     {
-        extruder_count = getSettingAsCount("machine_extruder_count");
+        extruder_count = getSettingAsCount(SettingKey::machine_extruder_count);
     }
     return extruder_count;
 }
@@ -75,6 +774,37 @@ const ExtruderTrain* MeshGroup::getExtruderTrain(unsigned int extruder_nr) const
     return extruders[extruder_nr];
 }
 
+void MeshGroup::buildSettingsCaches()
+{
+    buildSettingsCache();
+    for (ExtruderTrain* train : extruders)
+    {
+        if (train)
+        {
+            train->buildSettingsCache();
+        }
+    }
+    // the meshes with the same settings, like the many copies of an object on a large plate, share their settings and their cache
+    const std::vector<std::string> no_ignored_keys;
+    std::vector<const Mesh*> meshes_with_other_settings; // the first mesh with each combination of settings
+    for (Mesh& mesh : meshes)
+    {
+        auto same_settings = std::find_if(meshes_with_other_settings.begin(), meshes_with_other_settings.end(), [&mesh, &no_ignored_keys](const Mesh* other)
+            {
+                return mesh.hasSameSettings(*other, no_ignored_keys);
+            });
+        if (same_settings != meshes_with_other_settings.end())
+        {
+            mesh.shareSettings(**same_settings);
+        }
+        else
+        {
+            mesh.buildSettingsCache();
+            meshes_with_other_settings.push_back(&mesh);
+        }
+    }
+}
+
 Point3 MeshGroup::min() const
 {
     if (meshes.size() < 1)
@@ -109,6 +839,19 @@ Point3 MeshGroup::max() const
     return ret;
 }
 
+constexpr int32_t MeshGroup::max_mesh_coordinate;
+
+bool MeshGroup::inClipperLowRange() const
+{
+    if (meshes.empty())
+    {
+        return true;
+    }
+    const Point3 min = this->min();
+    const Point3 max = this->max();
+    return min.x >= -max_mesh_coordinate && min.y >= -max_mesh_coordinate && max.x <= max_mesh_coordinate && max.y <= max_mesh_coordinate;
+}
+
 void MeshGroup::clear()
 {
     for(Mesh& m : meshes)
@@ -119,16 +862,16 @@ void MeshGroup::clear()
 
 void MeshGroup::finalize()
 {
-    extruder_count = getSettingAsCount("machine_extruder_count");
+    extruder_count = getSettingAsCount(SettingKey::machine_extruder_count);
 
     for (int extruder_nr = 0; extruder_nr < extruder_count; extruder_nr++)
     {
         createExtruderTrain(extruder_nr); // create it if it didn't exist yet
 
-        if (getSettingAsIndex("adhesion_extruder_nr") == extruder_nr
-            || (getSettingBoolean("support_enable") && getSettingAsIndex("support_infill_extruder_nr") == extruder_nr)
-            || (getSettingBoolean("support_enable") && getSettingAsIndex("support_extruder_nr_layer_0") == extruder_nr)
-            || (getSettingBoolean("support_enable") && getSettingBoolean("support_interface_enable") && getSettingAsIndex("support_interface_extruder_nr") == extruder_nr)
+        if (getSettingAsIndex(SettingKey::adhesion_extruder_nr) == extruder_nr
+            || (getSettingBoolean(SettingKey::support_enable) && getSettingAsIndex(SettingKey::support_infill_extruder_nr) == extruder_nr)
+            || (getSettingBoolean(SettingKey::support_enable) && getSettingAsIndex(SettingKey::support_extruder_nr_layer_0) == extruder_nr)
+            || (getSettingBoolean(SettingKey::support_enable) && getSettingBoolean(SettingKey::support_interface_enable) && getSettingAsIndex(SettingKey::support_interface_extruder_nr) == extruder_nr)
             )
         {
             getExtruderTrain(extruder_nr)->setIsUsed(true);
@@ -137,22 +880,22 @@ void MeshGroup::finalize()
 
     for (const Mesh& mesh : meshes)
     {
-        getExtruderTrain(mesh.getSettingAsIndex("extruder_nr"))->setIsUsed(true);
+        getExtruderTrain(mesh.getSettingAsIndex(SettingKey::extruder_nr))->setIsUsed(true);
     }
 
     //If the machine settings have been supplied, offset the given position vertices to the center of vertices (0,0,0) is at the bed center.
     Point3 meshgroup_offset(0, 0, 0);
-    if (!getSettingBoolean("machine_center_is_zero"))
+    if (!getSettingBoolean(SettingKey::machine_center_is_zero))
     {
-        meshgroup_offset.x = getSettingInMicrons("machine_width") / 2;
-        meshgroup_offset.y = getSettingInMicrons("machine_depth") / 2;
+        meshgroup_offset.x = getSettingInMicrons(SettingKey::machine_width) / 2;
+        meshgroup_offset.y = getSettingInMicrons(SettingKey::machine_depth) / 2;
     }
     
     // If a mesh position was given, put the mesh at this position in 3D space. 
     for(Mesh& mesh : meshes)
     {
-        Point3 mesh_offset(mesh.getSettingInMicrons("mesh_position_x"), mesh.getSettingInMicrons("mesh_position_y"), mesh.getSettingInMicrons("mesh_position_z"));
-        if (mesh.getSettingBoolean("center_object"))
+        Point3 mesh_offset(mesh.getSettingInMicrons(SettingKey::mesh_position_x), mesh.getSettingInMicrons(SettingKey::mesh_position_y), mesh.getSettingInMicrons(SettingKey::mesh_position_z));
+        if (mesh.getSettingBoolean(SettingKey::center_object))
         {
             Point3 object_min = mesh.min();
             Point3 object_max = mesh.max();
@@ -161,65 +904,102 @@ void MeshGroup::finalize()
         }
         mesh.offset(mesh_offset + meshgroup_offset);
     }
+
+    // Faces below the first layer are never sliced, e.g. the part of a model which is sunk into the build plate.
+    // Same layer heights as FffPolygonGenerator::sliceModel; the bed is included in case the first layer is below it.
+    const int first_slice_z = std::min(0, getSettingInMicrons(SettingKey::layer_height_0) - getSettingInMicrons(SettingKey::layer_height) / 2);
+    for (Mesh& mesh : meshes)
+    {
+        if (mesh.faces.empty() || mesh.min().z >= first_slice_z)
+        {
+            continue;
+        }
+        const unsigned int face_count = mesh.faces.size();
+        const unsigned int removed_face_count = mesh.removeFacesBelow(first_slice_z);
+        if (removed_face_count > 0)
+        {
+            log("Removed %u of %u faces of a mesh below the first layer\n", removed_face_count, face_count);
+        }
+    }
+
+    for (Mesh& mesh : meshes)
+    {
+        const int decimation_deviation = mesh.getSettingInMicrons(SettingKey::meshfix_decimation_deviation);
+        if (decimation_deviation <= 0 || mesh.faces.empty())
+        {
+            continue;
+        }
+        TimeKeeper decimation_timer;
+        const unsigned int face_count = mesh.faces.size();
+        const unsigned int removed_face_count = MeshDecimator::decimate(mesh, decimation_deviation);
+        log("Decimated a mesh from %u to %u faces (%.1fx) in %5.3fs\n", face_count, face_count - removed_face_count, double(face_count) / std::max(1u, face_count - removed_face_count), decimation_timer.restart());
+    }
 }
 
 bool loadMeshSTL_ascii(Mesh* mesh, const char* filename, const FMatrix3x3& matrix)
 {
-    FILE* f = fopen(filename, "rt");
-    char buffer[1024];
-    FPoint3 vertex;
-    int n = 0;
-    Point3 v0(0,0,0), v1(0,0,0), v2(0,0,0);
-    while(fgets_(buffer, sizeof(buffer), f))
+    TimeKeeper load_timer;
+
+    MappedFile file(filename);
+    if (!file.isValid())
     {
-        if (sscanf(buffer, " vertex %f %f %f", &vertex.x, &vertex.y, &vertex.z) == 3)
+        return false;
+    }
+    const char* data = file.getData();
+    const size_t size = file.getSize();
+
+    // The file is parsed in parallel chunks of whole lines. Every three consecutive vertices form a face, regardless of the facets around them.
+    const size_t chunk_count = (size + line_chunk_size - 1) / line_chunk_size;
+    std::vector<std::vector<Point3>> chunk_vertices(chunk_count);
+    ThreadPool::getInstance()->parallelFor(0, chunk_count, [&](int chunk_idx)
         {
-            n++;
-            switch(n)
-            {
-            case 1:
-                v0 = matrix.apply(vertex);
-                break;
-            case 2:
-                v1 = matrix.apply(vertex);
-                break;
-            case 3:
-                v2 = matrix.apply(vertex);
-                mesh->addFace(v0, v1, v2);
-                n = 0;
-                break;
-            }
-        }
+            parseAsciiSTLVertices(data + lineChunkStart(data, size, chunk_idx), data + lineChunkStart(data, size, chunk_idx + 1), matrix, chunk_vertices[chunk_idx]);
+        });
+
+    size_t vertex_count = 0;
+    for (const std::vector<Point3>& vertices : chunk_vertices)
+    {
+        vertex_count += vertices.size();
+    }
+    std::vector<Point3> triangle_vertices;
+    triangle_vertices.reserve(vertex_count);
+    for (std::vector<Point3>& vertices : chunk_vertices)
+    {
+        triangle_vertices.insert(triangle_vertices.end(), vertices.begin(), vertices.end());
+        std::vector<Point3>().swap(vertices);
+    }
+    triangle_vertices.resize(vertex_count / 3 * 3); // vertices of an incomplete last face are ignored
+    log("reading %s faces took %.3f seconds\n", std::to_string(triangle_vertices.size() / 3).c_str(), load_timer.restart());
+
+    if (!triangle_vertices.empty())
+    {
+        mesh->addFaces(triangle_vertices);
+        log("melding %s vertices took %.3f seconds\n", std::to_string(mesh->vertices.size()).c_str(), load_timer.restart());
     }
-    fclose(f);
     mesh->finish();
     return true;
 }
 
 bool loadMeshSTL_binary(Mesh* mesh, const char* filename, const FMatrix3x3& matrix)
 {
-    FILE* f = fopen(filename, "rb");
-
-    fseek(f, 0L, SEEK_END);
-    long long file_size = ftell(f); //The file size is the position of the cursor after seeking to the end.
-    rewind(f); //Seek back to start.
-    size_t face_count = (file_size - 80 - sizeof(uint32_t)) / 50; //Subtract the size of the header. Every face uses exactly 50 bytes.
+    TimeKeeper load_timer;
 
-    char buffer[80];
-    //Skip the header
-    if (fread(buffer, 80, 1, f) != 1)
+    MappedFile file(filename);
+    if (!file.isValid())
     {
-        fclose(f);
         return false;
     }
-
-    uint32_t reported_face_count;
-    //Read the face count. We'll use it as a sort of redundancy code to check for file corruption.
-    if (fread(&reported_face_count, sizeof(uint32_t), 1, f) != 1)
+    const size_t header_size = 80 + sizeof(uint32_t); // 80 bytes of text and the face count
+    const size_t face_size = 50; // Every face uses exactly 50 bytes.
+    if (file.getSize() < header_size)
     {
-        fclose(f);
         return false;
     }
+    size_t face_count = (file.getSize() - header_size) / face_size; //Subtract the size of the header.
+
+    uint32_t reported_face_count;
+    //Read the face count. We'll use it as a sort of redundancy code to check for file corruption.
+    memcpy(&reported_face_count, file.getData() + 80, sizeof(uint32_t));
     if (reported_face_count != face_count)
     {
         logWarning("Face count reported by file (%s) is not equal to actual face count (%s). File could be corrupt!\n", std::to_string(reported_face_count).c_str(), std::to_string(face_count).c_str());
@@ -228,23 +1008,27 @@ bool loadMeshSTL_binary(Mesh* mesh, const char* filename, const FMatrix3x3& matr
     //For each face read:
     //float(x,y,z) = normal, float(X,Y,Z)*3 = vertexes, uint16_t = flags
     // Every Face is 50 Bytes: Normal(3*float), Vertices(9*float), 2 Bytes Spacer
-    mesh->faces.reserve(face_count);
-    mesh->vertices.reserve(face_count);
-    for (unsigned int i = 0; i < face_count; i++)
-    {
-        if (fread(buffer, 50, 1, f) != 1)
+    // The faces are transformed in parallel chunks directly from the mapped file.
+    std::vector<Point3> triangle_vertices(face_count * 3);
+    const int faces_per_chunk = 4096;
+    const int chunk_count = (face_count + faces_per_chunk - 1) / faces_per_chunk;
+    ThreadPool::getInstance()->parallelFor(0, chunk_count, [&](int chunk_idx)
         {
-            fclose(f);
-            return false;
-        }
-        float *v= ((float*)buffer)+3;
+            const size_t face_idx_end = std::min(face_count, size_t(chunk_idx + 1) * faces_per_chunk);
+            for (size_t face_idx = size_t(chunk_idx) * faces_per_chunk; face_idx < face_idx_end; face_idx++)
+            {
+                float v[9];
+                memcpy(v, file.getData() + header_size + face_idx * face_size + 3 * sizeof(float), sizeof(v)); // skip the normal
+                triangle_vertices[face_idx * 3] = matrix.apply(FPoint3(v[0], v[1], v[2]));
+                triangle_vertices[face_idx * 3 + 1] = matrix.apply(FPoint3(v[3], v[4], v[5]));
+                triangle_vertices[face_idx * 3 + 2] = matrix.apply(FPoint3(v[6], v[7], v[8]));
+            }
+        });
+    log("reading %s faces took %.3f seconds\n", std::to_string(face_count).c_str(), load_timer.restart());
+
+    mesh->addFaces(triangle_vertices);
+    log("melding %s vertices took %.3f seconds\n", std::to_string(mesh->vertices.size()).c_str(), load_timer.restart());
 
-        Point3 v0 = matrix.apply(FPoint3(v[0], v[1], v[2]));
-        Point3 v1 = matrix.apply(FPoint3(v[3], v[4], v[5]));
-        Point3 v2 = matrix.apply(FPoint3(v[6], v[7], v[8]));
-        mesh->addFace(v0, v1, v2);
-    }
-    fclose(f);
     mesh->finish();
     return true;
 }
@@ -303,17 +1087,309 @@ bool loadMeshSTL(Mesh* mesh, const char* filename, const FMatrix3x3& matrix)
     return loadMeshSTL_binary(mesh, filename, matrix);
 }
 
+bool loadMeshOBJ(Mesh* mesh, const char* filename, const FMatrix3x3& matrix)
+{
+    TimeKeeper load_timer;
+
+    MappedFile file(filename);
+    if (!file.isValid())
+    {
+        return false;
+    }
+    const char* data = file.getData();
+    const size_t size = file.getSize();
+
+    const size_t chunk_count = (size + line_chunk_size - 1) / line_chunk_size;
+    std::vector<OBJChunk> chunks(chunk_count);
+    ThreadPool::getInstance()->parallelFor(0, chunk_count, [&](int chunk_idx)
+        {
+            parseOBJChunk(data + lineChunkStart(data, size, chunk_idx), data + lineChunkStart(data, size, chunk_idx + 1), matrix, chunks[chunk_idx]);
+        });
+
+    size_t vertex_count = 0;
+    size_t corner_count = 0;
+    for (const OBJChunk& chunk : chunks)
+    {
+        vertex_count += chunk.vertices.size();
+        corner_count += chunk.corner_indices.size();
+    }
+    std::vector<Point3> vertices;
+    vertices.reserve(vertex_count);
+    std::vector<uint32_t> corner_indices;
+    corner_indices.reserve(corner_count);
+    size_t invalid_face_count = 0;
+    for (OBJChunk& chunk : chunks)
+    {
+        const int64_t vertex_offset = vertices.size();
+        for (size_t relative_corner : chunk.relative_corners)
+        {
+            chunk.corner_indices[relative_corner] += vertex_offset;
+        }
+        vertices.insert(vertices.end(), chunk.vertices.begin(), chunk.vertices.end());
+        std::vector<Point3>().swap(chunk.vertices);
+        for (size_t corner_idx = 0; corner_idx + 2 < chunk.corner_indices.size(); corner_idx += 3)
+        {
+            const int64_t* corners = &chunk.corner_indices[corner_idx];
+            if (std::any_of(corners, corners + 3, [vertex_count](int64_t index) { return index < 0 || index >= int64_t(vertex_count); }))
+            {
+                invalid_face_count++;
+                continue;
+            }
+            corner_indices.insert(corner_indices.end(), corners, corners + 3);
+        }
+        std::vector<int64_t>().swap(chunk.corner_indices);
+    }
+    if (invalid_face_count > 0)
+    {
+        logWarning("%s faces of %s refer to vertices which don't exist and are left out.\n", std::to_string(invalid_face_count).c_str(), filename);
+    }
+    log("reading %s faces took %.3f seconds\n", std::to_string(corner_indices.size() / 3).c_str(), load_timer.restart());
+
+    mesh->addIndexedFaces(vertices, corner_indices);
+    mesh->finish();
+    return true;
+}
+
+bool loadMesh3MF(MeshGroup* meshgroup, const char* filename, const FMatrix3x3& matrix, SettingsBaseVirtual* parent)
+{
+    TimeKeeper load_timer;
+
+    MappedFile file(filename);
+    if (!file.isValid())
+    {
+        return false;
+    }
+    ZipArchive archive(file.getData(), file.getSize());
+    if (!archive.isValid())
+    {
+        logError("%s is not a 3MF package.\n", filename);
+        return false;
+    }
+    const std::string model_part = find3MFModelPart(archive);
+    std::vector<char> buffer;
+    const char* model;
+    size_t model_size;
+    if (!archive.getEntry(model_part, buffer, model, model_size))
+    {
+        logError("Could not read the model %s of %s.\n", model_part.c_str(), filename);
+        return false;
+    }
+
+    // Read the model in a single pass over its tags: the vertices and triangles of each object go straight into its buffers.
+    std::unordered_map<std::string, Object3MF> objects;
+    std::vector<Object3MF::Component> items; // the build items, which are placed like the components of an object
+    double unit_length = 1.0;
+    Object3MF* object = nullptr; // the object of which the tags are being read
+    XMLTagScanner scanner(model, model + model_size);
+    auto getCoordinate = [&scanner](const char* name, float& coordinate)
+    {
+        const char* value_start;
+        const char* value_end;
+        return scanner.getAttribute(name, value_start, value_end) && value_end > value_start && parseFloat(value_start, value_end, coordinate) == value_end;
+    };
+    auto getIndex = [&scanner](const char* name, uint32_t& index)
+    {
+        const char* value_start;
+        const char* value_end;
+        if (!scanner.getAttribute(name, value_start, value_end) || value_end == value_start || value_end - value_start > 9)
+        {
+            return false;
+        }
+        index = 0;
+        for (const char* p = value_start; p < value_end; p++)
+        {
+            if (*p < '0' || *p > '9')
+            {
+                return false;
+            }
+            index = index * 10 + (*p - '0');
+        }
+        return true;
+    };
+    size_t invalid_element_count = 0;
+    while (scanner.next())
+    {
+        if (scanner.isEndTag())
+        {
+            if (scanner.nameIs("object"))
+            {
+                object = nullptr;
+            }
+        }
+        else if (object && scanner.nameIs("vertex"))
+        {
+            FPoint3 vertex;
+            if (!getCoordinate("x", vertex.x) || !getCoordinate("y", vertex.y) || !getCoordinate("z", vertex.z))
+            {
+                invalid_element_count++;
+                vertex = FPoint3(0, 0, 0); // keep the numbering of the later vertices intact
+            }
+            object->vertices.push_back(vertex);
+        }
+        else if (object && scanner.nameIs("triangle"))
+        {
+            uint32_t corners[3];
+            if (getIndex("v1", corners[0]) && getIndex("v2", corners[1]) && getIndex("v3", corners[2]))
+            {
+                object->corner_indices.insert(object->corner_indices.end(), corners, corners + 3);
+            }
+            else
+            {
+                invalid_element_count++;
+            }
+        }
+        else if (object && scanner.nameIs("component"))
+        {
+            object->components.emplace_back();
+            object->components.back().object_id = scanner.getAttribute("objectid");
+            object->components.back().transform.parse(scanner.getAttribute("transform"));
+        }
+        else if (scanner.nameIs("object"))
+        {
+            object = scanner.isEmptyTag() ? nullptr : &objects[scanner.getAttribute("id")];
+        }
+        else if (scanner.nameIs("item"))
+        {
+            items.emplace_back();
+            items.back().object_id = scanner.getAttribute("objectid");
+            items.back().transform.parse(scanner.getAttribute("transform"));
+        }
+        else if (scanner.nameIs("model"))
+        {
+            unit_length = unitLength3MF(scanner.getAttribute("unit"));
+            if (unit_length == 0.0)
+            {
+                logError("Unknown unit %s of %s.\n", scanner.getAttribute("unit").c_str(), filename);
+                return false;
+            }
+        }
+    }
+    if (invalid_element_count > 0)
+    {
+        logWarning("%s vertices and triangles of %s could not be read.\n", std::to_string(invalid_element_count).c_str(), filename);
+    }
+    Transform3MF to_millimeters;
+    for (unsigned int axis = 0; axis < 3; axis++)
+    {
+        to_millimeters.m[axis][axis] = unit_length;
+    }
+
+    // Each build item becomes a mesh made of all the meshes of its object.
+    size_t face_count = 0;
+    const size_t mesh_count_before = meshgroup->meshes.size();
+    for (const Object3MF::Component& item : items)
+    {
+        std::vector<std::pair<const Object3MF*, Transform3MF>> item_meshes;
+        if (!flattenObject3MF(objects, item.object_id, item.transform.then(to_millimeters), 0, item_meshes))
+        {
+            logWarning("A build item of %s refers to an object which doesn't exist.\n", filename);
+        }
+        std::vector<Point3> vertices;
+        std::vector<uint32_t> corner_indices;
+        size_t invalid_face_count = 0;
+        for (const std::pair<const Object3MF*, Transform3MF>& item_mesh : item_meshes)
+        {
+            const uint32_t vertex_offset = vertices.size();
+            for (const FPoint3& vertex : item_mesh.first->vertices)
+            {
+                vertices.push_back(matrix.apply(item_mesh.second.apply(vertex)));
+            }
+            const std::vector<uint32_t>& corners = item_mesh.first->corner_indices;
+            for (size_t corner_idx = 0; corner_idx + 2 < corners.size(); corner_idx += 3)
+            {
+                const uint32_t object_vertex_count = item_mesh.first->vertices.size();
+                if (corners[corner_idx] >= object_vertex_count || corners[corner_idx + 1] >= object_vertex_count || corners[corner_idx + 2] >= object_vertex_count)
+                {
+                    invalid_face_count++;
+                    continue;
+                }
+                for (size_t corner = corner_idx; corner < corner_idx + 3; corner++)
+                {
+                    corner_indices.push_back(vertex_offset + corners[corner]);
+                }
+            }
+        }
+        if (invalid_face_count > 0)
+        {
+            logWarning("%s triangles of %s refer to vertices which don't exist and are left out.\n", std::to_string(invalid_face_count).c_str(), filename);
+        }
+        if (corner_indices.empty())
+        {
+            continue;
+        }
+        meshgroup->meshes.emplace_back(parent);
+        Mesh& mesh = meshgroup->meshes.back();
+        mesh.addIndexedFaces(vertices, corner_indices);
+        mesh.finish();
+        face_count += mesh.faces.size();
+    }
+    if (meshgroup->meshes.size() == mesh_count_before)
+    {
+        logError("%s doesn't contain any build items with triangles.\n", filename);
+        return false;
+    }
+    log("reading %s faces of %s build items took %.3f seconds\n", std::to_string(face_count).c_str(), std::to_string(meshgroup->meshes.size() - mesh_count_before).c_str(), load_timer.restart());
+    return true;
+}
+
 bool loadMeshIntoMeshGroup(MeshGroup* meshgroup, const char* filename, const FMatrix3x3& transformation, SettingsBaseVirtual* object_parent_settings)
 {
     TimeKeeper load_timer;
 
     const char* ext = strrchr(filename, '.');
-    if (ext && (strcmp(ext, ".stl") == 0 || strcmp(ext, ".STL") == 0))
+    SettingsBaseVirtual* parent = object_parent_settings ? object_parent_settings : meshgroup; //If we have object_parent_settings, use them as parent settings. Otherwise, just use meshgroup.
+    if (ext && stringcasecompare(ext, ".3mf") == 0)
     {
-        Mesh mesh = object_parent_settings ? Mesh(object_parent_settings) : Mesh(meshgroup); //If we have object_parent_settings, use them as parent settings. Otherwise, just use meshgroup.
-        if(loadMeshSTL(&mesh,filename,transformation)) //Load it! If successful...
+        if (loadMesh3MF(meshgroup, filename, transformation, parent))
         {
-            meshgroup->meshes.push_back(mesh);
+            log("loading '%s' took %.3f seconds\n", filename, load_timer.restart());
+            return true;
+        }
+        return false;
+    }
+    bool (*loadMesh)(Mesh*, const char*, const FMatrix3x3&) = nullptr; // the loader of the formats with a single mesh, which can be cached
+    if (ext && stringcasecompare(ext, ".stl") == 0)
+    {
+        loadMesh = loadMeshSTL;
+    }
+    else if (ext && stringcasecompare(ext, ".obj") == 0)
+    {
+        loadMesh = loadMeshOBJ;
+    }
+    if (loadMesh)
+    {
+        uint64_t content_hash = 0;
+        size_t file_size = 0;
+        if (max_cached_meshes > 0)
+        {
+            MappedFile file(filename);
+            if (file.isValid())
+            {
+                content_hash = hashContents(file.getData(), file.getSize());
+                file_size = file.getSize();
+            }
+            for (auto cached = mesh_cache.begin(); cached != mesh_cache.end(); ++cached)
+            {
+                if (file.isValid() && cached->content_hash == content_hash && cached->file_size == file_size
+                    && memcmp(cached->transformation.m, transformation.m, sizeof(transformation.m)) == 0)
+                {
+                    mesh_cache.splice(mesh_cache.begin(), mesh_cache, cached); // mark as most recently used
+                    meshgroup->meshes.push_back(mesh_cache.front().mesh);
+                    meshgroup->meshes.back().setParent(parent);
+                    log("loading '%s' from the mesh cache took %.3f seconds\n", filename, load_timer.restart());
+                    return true;
+                }
+            }
+        }
+        Mesh mesh(parent);
+        if(loadMesh(&mesh,filename,transformation)) //Load it! If successful...
+        {
+            if (max_cached_meshes > 0 && file_size > 0)
+            {
+                mesh_cache.emplace_front(content_hash, file_size, transformation, mesh);
+                setMeshCacheSize(max_cached_meshes); // evict the least recently used mesh
+            }
+            meshgroup->meshes.push_back(std::move(mesh));
             log("loading '%s' took %.3f seconds\n",filename,load_timer.restart());
             return true;
         }
@@ -321,4 +1397,61 @@ bool loadMeshIntoMeshGroup(MeshGroup* meshgroup, const char* filename, const FMa
     return false;
 }
 
+MeshPrefetch::~MeshPrefetch()
+{
+    wait();
+}
+
+void MeshPrefetch::start(const std::vector<std::string>& filenames, const FMatrix3x3& transformation)
+{
+    wait();
+    files.clear();
+    if (max_cached_meshes > 0 || filenames.empty())
+    {
+        return;
+    }
+    for (const std::string& filename : filenames)
+    {
+        files.push_back(PrefetchedFile{filename, transformation, false, std::vector<Mesh>()});
+    }
+    loader = std::thread([this]()
+        {
+            for (PrefetchedFile& file : files)
+            {
+                MeshGroup placeholder(nullptr); // only holds the meshes till they're taken, so that no settings are touched while the current mesh group is sliced
+                file.success = loadMeshIntoMeshGroup(&placeholder, file.filename.c_str(), file.transformation);
+                file.meshes = std::move(placeholder.meshes);
+            }
+        });
+}
+
+void MeshPrefetch::wait()
+{
+    if (loader.joinable())
+    {
+        loader.join();
+    }
+}
+
+bool MeshPrefetch::load(MeshGroup* meshgroup, const char* filename, const FMatrix3x3& transformation, SettingsBaseVirtual* object_parent_settings)
+{
+    wait();
+    for (auto file = files.begin(); file != files.end(); ++file)
+    {
+        if (file->filename == filename && memcmp(file->transformation.m, transformation.m, sizeof(transformation.m)) == 0)
+        {
+            SettingsBaseVirtual* parent = object_parent_settings ? object_parent_settings : meshgroup;
+            for (Mesh& mesh : file->meshes)
+            {
+                meshgroup->meshes.push_back(std::move(mesh));
+                meshgroup->meshes.back().setParent(parent);
+            }
+            const bool success = file->success;
+            files.erase(file);
+            return success;
+        }
+    }
+    return loadMeshIntoMeshGroup(meshgroup, filename, transformation, object_parent_settings);
+}
+
 }//namespace cura
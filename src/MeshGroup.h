@@ -2,6 +2,10 @@
 #ifndef MESH_GROUP_H
 #define MESH_GROUP_H
 
+#include <string>
+#include <thread>
+#include <vector>
+
 #include "utils/NoCopy.h"
 #include "mesh.h"
 #include "ExtruderTrain.h"
@@ -35,11 +39,31 @@ public:
 
     const ExtruderTrain* getExtruderTrain(unsigned int extruder_nr) const;
 
+    /*!
+     * Build the settings caches of this meshgroup, its extruder trains and its meshes.
+     * See \ref SettingsBase::buildSettingsCache
+     * 
+     * The meshes with the same settings get a single cache, and share their local settings, see \ref SettingsBase::shareSettings
+     */
+    void buildSettingsCaches();
+
     std::vector<Mesh> meshes;
 
     Point3 min() const; //! minimal corner of bounding box
     Point3 max() const; //! maximal corner of bounding box
 
+    /*!
+     * The largest coordinate of a mesh which can be sliced, in microns: half of \ref clipper_low_range, about 530m.
+     * The other half leaves room for the skirt, brim, shields and offsets around it.
+     */
+    static constexpr int32_t max_mesh_coordinate = 0x3FFFFFFF / 2;
+
+    /*!
+     * Whether all meshes lie within max_mesh_coordinate of the origin in X and Y,
+     * so that Clipper never needs its slower 128 bit math for the polygons sliced from them.
+     */
+    bool inClipperLowRange() const;
+
     void clear();
 
     void finalize();
@@ -48,6 +72,9 @@ public:
 /*!
  * Load a Mesh from file and store it in the \p meshgroup.
  * 
+ * STL, OBJ and 3MF files are supported. The vertices of OBJ and 3MF files are indexed already, so they aren't melded again.
+ * A 3MF file gives a mesh for each of its build items, placed with the transformation of the item.
+ * 
  * \param meshgroup The meshgroup where to store the mesh
  * \param filename The filename of the mesh file
  * \param transformation The transformation applied to all vertices
@@ -56,5 +83,70 @@ public:
  */
 bool loadMeshIntoMeshGroup(MeshGroup* meshgroup, const char* filename, const FMatrix3x3& transformation, SettingsBaseVirtual* object_parent_settings = nullptr);
 
+/*!
+ * Keep the meshes loaded by \ref loadMeshIntoMeshGroup in memory, keyed by a hash of the file contents,
+ * so that loading a file with the same contents again only needs to read the file to hash it.
+ * 
+ * This is used by the slice daemon, which slices the same models over and over again.
+ * 
+ * \param mesh_count The number of most recently used meshes to keep, or zero to disable the cache (the default)
+ */
+void setMeshCacheSize(unsigned int mesh_count);
+
+/*!
+ * Loads the model files of the next mesh group on a background thread, while the current mesh group is sliced and its gcode written,
+ * so that reading and parsing the files doesn't add to the total time of a job with several mesh groups.
+ * 
+ * Only the files are loaded in the background. The meshes are handed to their mesh group by \ref MeshPrefetch::load
+ * when the command line reaches them, since only then their extruder train and settings are known.
+ * 
+ * Nothing is prefetched while the mesh cache is enabled (see \ref setMeshCacheSize), since the cache isn't thread safe.
+ */
+class MeshPrefetch : NoCopy
+{
+public:
+    ~MeshPrefetch();
+
+    /*!
+     * Start loading model files on a background thread, after the files of an earlier call have been loaded.
+     * 
+     * \param filenames The files to load
+     * \param transformation The transformation applied to all vertices
+     */
+    void start(const std::vector<std::string>& filenames, const FMatrix3x3& transformation);
+
+    /*!
+     * Wait till the background thread has loaded all files.
+     */
+    void wait();
+
+    /*!
+     * Load a Mesh from file and store it in the \p meshgroup, like \ref loadMeshIntoMeshGroup,
+     * but take the meshes loaded in the background if the file was prefetched with the same transformation.
+     * 
+     * \param meshgroup The meshgroup where to store the mesh
+     * \param filename The filename of the mesh file
+     * \param transformation The transformation applied to all vertices
+     * \param object_parent_settings (optional) The parent settings object of the new mesh. Defaults to \p meshgroup if none is given.
+     * \return whether the file could be loaded
+     */
+    bool load(MeshGroup* meshgroup, const char* filename, const FMatrix3x3& transformation, SettingsBaseVirtual* object_parent_settings = nullptr);
+
+private:
+    /*!
+     * A file loaded in the background.
+     */
+    struct PrefetchedFile
+    {
+        std::string filename; //!< The file
+        FMatrix3x3 transformation; //!< The transformation with which the file was loaded
+        bool success; //!< Whether the file could be loaded
+        std::vector<Mesh> meshes; //!< The loaded meshes, of which the parent is a placeholder
+    };
+
+    std::vector<PrefetchedFile> files; //!< The files loaded by the background thread, in the order in which they were given
+    std::thread loader; //!< The background thread
+};
+
 }//namespace cura
 #endif//MESH_GROUP_H
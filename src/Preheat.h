@@ -86,18 +86,18 @@ public:
             ExtruderTrain& extruder_train = *settings.getExtruderTrain(extruder_nr);
             config_per_extruder.emplace_back();
             Config& config = config_per_extruder.back();
-            config.time_to_cooldown_1_degree = 1.0 / extruder_train.getSettingInSeconds("machine_nozzle_cool_down_speed"); // 0.5
-            config.time_to_heatup_1_degree = 1.0 / extruder_train.getSettingInSeconds("machine_nozzle_heat_up_speed"); // 0.5
-            config.heatup_cooldown_time_mod_while_printing = 1.0 / extruder_train.getSettingInSeconds("material_extrusion_cool_down_speed"); // 0.1
-            config.standby_temp = extruder_train.getSettingInSeconds("material_standby_temperature"); // 150
+            config.time_to_cooldown_1_degree = 1.0 / extruder_train.getSettingInSeconds(SettingKey::machine_nozzle_cool_down_speed); // 0.5
+            config.time_to_heatup_1_degree = 1.0 / extruder_train.getSettingInSeconds(SettingKey::machine_nozzle_heat_up_speed); // 0.5
+            config.heatup_cooldown_time_mod_while_printing = 1.0 / extruder_train.getSettingInSeconds(SettingKey::material_extrusion_cool_down_speed); // 0.1
+            config.standby_temp = extruder_train.getSettingInSeconds(SettingKey::material_standby_temperature); // 150
 
-            config.min_time_window = extruder_train.getSettingInSeconds("machine_min_cool_heat_time_window");
+            config.min_time_window = extruder_train.getSettingInSeconds(SettingKey::machine_min_cool_heat_time_window);
 
-            config.material_print_temperature = extruder_train.getSettingInDegreeCelsius("material_print_temperature"); // 220
+            config.material_print_temperature = extruder_train.getSettingInDegreeCelsius(SettingKey::material_print_temperature); // 220
             
-            config.flow_dependent_temperature = extruder_train.getSettingBoolean("material_flow_dependent_temperature"); 
+            config.flow_dependent_temperature = extruder_train.getSettingBoolean(SettingKey::material_flow_dependent_temperature); 
             
-            config.flow_temp_graph = extruder_train.getSettingAsFlowTempGraph("material_flow_temp_graph"); // [[0.1,180],[20,230]]
+            config.flow_temp_graph = extruder_train.getSettingAsFlowTempGraph(SettingKey::material_flow_temp_graph); // [[0.1,180],[20,230]]
         }
     }
     
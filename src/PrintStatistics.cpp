@@ -0,0 +1,64 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "PrintStatistics.h"
+
+namespace cura
+{
+
+PrintStatistics::PrintStatistics()
+{
+    reset();
+}
+
+void PrintStatistics::addPrintTime(double time)
+{
+    add(Amount{time, -1});
+}
+
+void PrintStatistics::addFilament(unsigned int extruder_nr, double volume)
+{
+    add(Amount{volume, static_cast<int>(extruder_nr)});
+}
+
+void PrintStatistics::add(const Amount& amount)
+{
+    if (amount.extruder_nr < 0)
+    {
+        print_time += amount.value;
+    }
+    else
+    {
+        filament[amount.extruder_nr] += amount.value;
+    }
+    amounts.push_back(amount);
+}
+
+void PrintStatistics::merge(const PrintStatistics& next)
+{
+    amounts.reserve(amounts.size() + next.amounts.size());
+    for (const Amount& amount : next.amounts)
+    {
+        add(amount);
+    }
+}
+
+PrintStatistics PrintStatistics::getStatisticsSince(unsigned int first_amount) const
+{
+    PrintStatistics chunk;
+    for (unsigned int amount_idx = first_amount; amount_idx < amounts.size(); amount_idx++)
+    {
+        chunk.add(amounts[amount_idx]);
+    }
+    return chunk;
+}
+
+void PrintStatistics::reset()
+{
+    amounts.clear();
+    print_time = 0.0;
+    for (unsigned int extruder_nr = 0; extruder_nr < MAX_EXTRUDERS; extruder_nr++)
+    {
+        filament[extruder_nr] = 0.0;
+    }
+}
+
+}//namespace cura
@@ -0,0 +1,108 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef PRINT_STATISTICS_H
+#define PRINT_STATISTICS_H
+
+#include <vector>
+
+#include "settings/settings.h" // MAX_EXTRUDERS
+
+namespace cura
+{
+
+/*!
+ * The estimated print time and the material used by each extruder of (a part of) a print, accumulated from partial amounts.
+ *
+ * Floating point addition isn't associative, so totals which are summed per chunk of gcode and then added together
+ * generally differ in their last bits from totals summed over the whole gcode at once.
+ * Therefore the partial amounts are kept in the order in which they were added, and PrintStatistics::merge folds
+ * the partial amounts of the next chunk into the totals one by one, rather than adding the totals of that chunk.
+ * The totals of statistics merged in the order of the gcode are thereby bit-identical to those accumulated serially,
+ * however the gcode was divided into chunks.
+ */
+class PrintStatistics
+{
+public:
+    PrintStatistics();
+
+    /*!
+     * Add to the estimated print time.
+     *
+     * \param time The time in seconds
+     */
+    void addPrintTime(double time);
+
+    /*!
+     * Add to the material used by an extruder.
+     *
+     * \param extruder_nr The extruder which used the material
+     * \param volume The volume in mm^3
+     */
+    void addFilament(unsigned int extruder_nr, double volume);
+
+    /*!
+     * Add the partial amounts of the statistics of the gcode following the gcode of these statistics.
+     *
+     * \param next The statistics of the next chunk of gcode
+     */
+    void merge(const PrintStatistics& next);
+
+    /*!
+     * Get the statistics of only the amounts added after a given number of amounts,
+     * e.g. of the chunk of gcode written since PrintStatistics::getAmountCount returned that number.
+     *
+     * \param first_amount The number of amounts added before the chunk
+     * \return The statistics of the chunk
+     */
+    PrintStatistics getStatisticsSince(unsigned int first_amount) const;
+
+    /*!
+     * Get the number of partial amounts added so far.
+     */
+    unsigned int getAmountCount() const
+    {
+        return amounts.size();
+    }
+
+    /*!
+     * Get the total estimated print time in seconds.
+     */
+    double getPrintTime() const
+    {
+        return print_time;
+    }
+
+    /*!
+     * Get the total volume of material used by an extruder in mm^3.
+     */
+    double getFilament(unsigned int extruder_nr) const
+    {
+        return filament[extruder_nr];
+    }
+
+    /*!
+     * Remove all amounts.
+     */
+    void reset();
+
+private:
+    /*!
+     * A partial amount of time or of material.
+     */
+    struct Amount
+    {
+        double value; //!< The time in seconds or the volume in mm^3
+        int extruder_nr; //!< The extruder which used the volume, or -1 for time
+    };
+
+    std::vector<Amount> amounts; //!< All partial amounts in the order in which they were added
+    double print_time; //!< The sum of the times in PrintStatistics::amounts
+    double filament[MAX_EXTRUDERS]; //!< The sums of the volumes in PrintStatistics::amounts per extruder
+
+    /*!
+     * Add an amount to the totals and append it to the amounts.
+     */
+    void add(const Amount& amount);
+};
+
+}//namespace cura
+#endif//PRINT_STATISTICS_H
@@ -1,6 +1,7 @@
 /** Copyright (C) 2013 David Braam - Released under terms of the AGPLv3 License */
 #include "SkirtBrim.h"
 #include "support.h"
+#include "utils/ThreadPool.h"
 
 namespace cura 
 {
@@ -11,8 +12,8 @@ void generateSkirtBrim(SliceDataStorage& storage, int start_distance, unsigned i
     
     bool externalOnly = (start_distance > 0); // whether to include holes or not
 
-    const int primary_extruder = storage.getSettingAsIndex("adhesion_extruder_nr");
-    const int primary_extruder_skirt_brim_line_width = storage.meshgroup->getExtruderTrain(primary_extruder)->getSettingInMicrons("skirt_brim_line_width");
+    const int primary_extruder = storage.getSettingAsIndex(SettingKey::adhesion_extruder_nr);
+    const int primary_extruder_skirt_brim_line_width = storage.meshgroup->getExtruderTrain(primary_extruder)->getSettingInMicrons(SettingKey::skirt_brim_line_width);
 
     Polygons& skirt_brim_primary_extruder = storage.skirt_brim[primary_extruder];
     
@@ -37,31 +38,48 @@ void generateSkirtBrim(SliceDataStorage& storage, int start_distance, unsigned i
         }
     }
 
-    Polygons outer_skirt_brim_line_primary_extruder;
-    for (unsigned int skirt_brim_number = 0; skirt_brim_number < count; skirt_brim_number++)
+    auto generate_skirt_brim_line = [&](unsigned int skirt_brim_number)
     {
         const int offsetDistance = start_distance + primary_extruder_skirt_brim_line_width * skirt_brim_number + primary_extruder_skirt_brim_line_width / 2;
 
-        outer_skirt_brim_line_primary_extruder = first_layer_outline.offset(offsetDistance, ClipperLib::jtRound);
+        Polygons skirt_brim_line = first_layer_outline.offset(offsetDistance, ClipperLib::jtRound);
 
         //Remove small inner skirt and brim holes. Holes have a negative area, remove anything smaller then 100x extrusion "area"
-        for (unsigned int n = 0; n < outer_skirt_brim_line_primary_extruder.size(); n++)
+        for (unsigned int n = 0; n < skirt_brim_line.size(); n++)
         {
-            double area = outer_skirt_brim_line_primary_extruder[n].area();
+            double area = skirt_brim_line[n].area();
             if (area < 0 && area > -primary_extruder_skirt_brim_line_width * primary_extruder_skirt_brim_line_width * 100)
             {
-                outer_skirt_brim_line_primary_extruder.remove(n--);
+                skirt_brim_line.remove(n--);
             }
         }
+        return skirt_brim_line;
+    };
 
-        skirt_brim_primary_extruder.add(outer_skirt_brim_line_primary_extruder);
+    // each line is an offset of the first layer outline, so the requested lines are generated in parallel; additional lines for the minimal length one by one
+    std::vector<Polygons> skirt_brim_lines(count);
+    ThreadPool::getInstance()->parallelFor(0, count, [&](int skirt_brim_number)
+    {
+        skirt_brim_lines[skirt_brim_number] = generate_skirt_brim_line(skirt_brim_number);
+    });
+    for (unsigned int skirt_brim_number = 0; skirt_brim_number < count; skirt_brim_number++)
+    {
+        if (skirt_brim_number == skirt_brim_lines.size())
+        {
+            skirt_brim_lines.push_back(generate_skirt_brim_line(skirt_brim_number));
+        }
+        skirt_brim_primary_extruder.add(skirt_brim_lines[skirt_brim_number]);
 
-        int length = skirt_brim_primary_extruder.polygonLength();
-        if (skirt_brim_number + 1 >= count && length > 0 && length < minLength) //Make brim or skirt have more lines when total length is too small.
+        if (skirt_brim_number + 1 >= count) //Make brim or skirt have more lines when total length is too small.
         {
-            count++;
+            int length = skirt_brim_primary_extruder.polygonLength();
+            if (length > 0 && length < minLength)
+            {
+                count++;
+            }
         }
     }
+    const Polygons& outer_skirt_brim_line_primary_extruder = skirt_brim_lines.back();
     
     { // process other extruders' brim/skirt (as one brim line around the old brim)
         int offset_distance = 0;
@@ -72,7 +90,7 @@ void generateSkirtBrim(SliceDataStorage& storage, int start_distance, unsigned i
             {
                 continue;
             }
-            int width = storage.meshgroup->getExtruderTrain(extruder)->getSettingInMicrons("skirt_brim_line_width");
+            int width = storage.meshgroup->getExtruderTrain(extruder)->getSettingInMicrons(SettingKey::skirt_brim_line_width);
             offset_distance += last_width / 2 + width/2;
             last_width = width;
             while (storage.skirt_brim[extruder].polygonLength() < minLength)
@@ -90,7 +108,7 @@ void generateSkirtBrim(SliceDataStorage& storage, int start_distance, unsigned i
             Polygons& last_brim = storage.skirt_brim[extruder_nr];
             if (last_brim.size() > 0)
             {
-                int brim_line_width = storage.meshgroup->getExtruderTrain(extruder_nr)->getSettingInMicrons("skirt_brim_line_width");
+                int brim_line_width = storage.meshgroup->getExtruderTrain(extruder_nr)->getSettingInMicrons(SettingKey::skirt_brim_line_width);
                 SupportLayer& support_layer = storage.support.supportLayers[0];
                 Polygons area_covered_by_brim = last_brim.offset(brim_line_width / 2);
                 support_layer.skin = support_layer.skin.difference(area_covered_by_brim);
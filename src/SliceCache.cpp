@@ -0,0 +1,324 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "SliceCache.h"
+
+#include <cstdio> // rename, remove
+#include <cstdlib> // getenv
+#include <cstring> // memcmp
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+#include <unistd.h> // getpid
+#endif
+
+#include "utils/logoutput.h"
+
+namespace cura
+{
+
+SliceCache SliceCache::instance;
+
+namespace
+{
+
+const char magic[8] = { 'C', 'u', 'r', 'a', 'S', 'l', 'c', 'e' }; // the first bytes of every file in the cache directory
+const uint32_t format_version = 3; // increased whenever the format of the files changes
+const uint32_t max_count = 1 << 28; // larger counts are only found in corrupt files
+
+void hashValue(uint64_t& hash, uint64_t value)
+{
+    for (unsigned int byte_idx = 0; byte_idx < sizeof(value); byte_idx++)
+    { // FNV-1a
+        hash ^= (value >> (byte_idx * 8)) & 0xff;
+        hash *= 1099511628211ull;
+    }
+}
+
+template<typename T>
+void writeValue(std::ostream& out, T value)
+{
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+bool readValue(std::istream& in, T& value)
+{
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+void writePolygons(std::ostream& out, const Polygons& polygons)
+{
+    writeValue<uint32_t>(out, polygons.size());
+    for (unsigned int poly_idx = 0; poly_idx < polygons.size(); poly_idx++)
+    {
+        const PolygonRef polygon = polygons[poly_idx];
+        writeValue<uint32_t>(out, polygon.size());
+        for (unsigned int point_idx = 0; point_idx < polygon.size(); point_idx++)
+        {
+            writeValue<int64_t>(out, polygon[point_idx].X);
+            writeValue<int64_t>(out, polygon[point_idx].Y);
+        }
+    }
+}
+
+bool readPolygons(std::istream& in, Polygons& polygons)
+{
+    uint32_t poly_count;
+    if (!readValue(in, poly_count) || poly_count > max_count)
+    {
+        return false;
+    }
+    for (uint32_t poly_idx = 0; poly_idx < poly_count; poly_idx++)
+    {
+        uint32_t point_count;
+        if (!readValue(in, point_count) || point_count > max_count)
+        {
+            return false;
+        }
+        PolygonRef polygon = polygons.newPoly();
+        for (uint32_t point_idx = 0; point_idx < point_count; point_idx++)
+        {
+            int64_t x;
+            int64_t y;
+            if (!readValue(in, x) || !readValue(in, y))
+            {
+                return false;
+            }
+            polygon.add(Point(x, y));
+        }
+    }
+    return true;
+}
+
+}//namespace
+
+bool SliceCache::Key::operator==(const Key& other) const
+{
+    return mesh_hash == other.mesh_hash
+        && vertex_count == other.vertex_count
+        && face_count == other.face_count
+        && initial == other.initial
+        && thickness == other.thickness
+        && slice_layer_count == other.slice_layer_count
+        && keep_none_closed == other.keep_none_closed
+        && extensive_stitching == other.extensive_stitching
+        && maximum_deviation == other.maximum_deviation
+        && xy_offset == other.xy_offset
+        && surface_mode == other.surface_mode
+        && copy_prismatic_layers == other.copy_prismatic_layers;
+}
+
+uint64_t SliceCache::Key::hash() const
+{
+    uint64_t result = mesh_hash;
+    hashValue(result, vertex_count);
+    hashValue(result, face_count);
+    hashValue(result, static_cast<uint32_t>(initial));
+    hashValue(result, static_cast<uint32_t>(thickness));
+    hashValue(result, static_cast<uint32_t>(slice_layer_count));
+    hashValue(result, keep_none_closed);
+    hashValue(result, extensive_stitching);
+    hashValue(result, static_cast<uint32_t>(maximum_deviation));
+    hashValue(result, static_cast<uint32_t>(xy_offset));
+    hashValue(result, static_cast<uint32_t>(surface_mode));
+    hashValue(result, copy_prismatic_layers);
+    return result;
+}
+
+SliceCache::SliceCache()
+: max_memory_cache_size(0)
+{
+    const char* directory = getenv("CURA_ENGINE_SLICE_CACHE");
+    if (directory)
+    {
+        cache_directory = directory;
+    }
+}
+
+void SliceCache::setMemoryCacheSize(unsigned int mesh_count)
+{
+    std::lock_guard<std::mutex> lock(memory_cache_mutex);
+    max_memory_cache_size = mesh_count;
+    while (memory_cache.size() > max_memory_cache_size)
+    {
+        memory_cache.pop_back();
+    }
+}
+
+SliceCache::Key SliceCache::getKey(const Mesh* mesh, int initial, int thickness, int slice_layer_count, bool keep_none_closed, bool extensive_stitching)
+{
+    Key key;
+    key.mesh_hash = mesh->getGeometryHash();
+    key.vertex_count = mesh->vertices.size();
+    key.face_count = mesh->faces.size();
+    key.initial = initial;
+    key.thickness = thickness;
+    key.slice_layer_count = slice_layer_count;
+    key.keep_none_closed = keep_none_closed;
+    key.extensive_stitching = extensive_stitching;
+    key.maximum_deviation = mesh->getSettingInMicrons(SettingKey::meshfix_maximum_deviation);
+    key.xy_offset = mesh->getSettingInMicrons(SettingKey::xy_offset);
+    key.surface_mode = static_cast<int32_t>(mesh->getSettingAsSurfaceMode(SettingKey::magic_mesh_surface_mode));
+    key.copy_prismatic_layers = mesh->getSettingBoolean(SettingKey::slicing_copy_prismatic_layers);
+    return key;
+}
+
+std::string SliceCache::getFilename(const Key& key) const
+{
+    std::ostringstream filename;
+    filename << cache_directory << "/" << std::hex << std::setfill('0') << std::setw(16) << key.hash() << ".slices";
+    return filename.str();
+}
+
+Slicer* SliceCache::slice(const Mesh* mesh, int initial, int thickness, int slice_layer_count, bool keep_none_closed, bool extensive_stitching, const std::atomic<bool>* cancelled)
+{
+    if (max_memory_cache_size == 0 && cache_directory.empty())
+    {
+        return new Slicer(mesh, initial, thickness, slice_layer_count, keep_none_closed, extensive_stitching, cancelled);
+    }
+
+    const Key key = getKey(mesh, initial, thickness, slice_layer_count, keep_none_closed, extensive_stitching);
+    std::unique_lock<std::mutex> lock(memory_cache_mutex);
+    for (std::list<CachedSlices>::iterator cached = memory_cache.begin(); cached != memory_cache.end(); ++cached)
+    {
+        if (cached->key == key)
+        {
+            memory_cache.splice(memory_cache.begin(), memory_cache, cached);
+            log("Using the layers of the mesh from memory.\n");
+            return new Slicer(mesh, std::vector<SlicerLayer>(cached->layers));
+        }
+    }
+
+    lock.unlock(); // don't hold up the other meshes while reading or slicing this one
+
+    std::vector<SlicerLayer> layers;
+    if (!cache_directory.empty() && readFile(key, layers))
+    {
+        log("Using the layers of the mesh from %s\n", getFilename(key).c_str());
+        addToMemory(key, layers);
+        return new Slicer(mesh, std::move(layers));
+    }
+
+    Slicer* slicer = new Slicer(mesh, initial, thickness, slice_layer_count, keep_none_closed, extensive_stitching, cancelled);
+    if (cancelled && cancelled->load(std::memory_order_relaxed))
+    {
+        return slicer;
+    }
+    if (!cache_directory.empty())
+    {
+        writeFile(key, slicer->layers);
+    }
+    addToMemory(key, slicer->layers);
+    return slicer;
+}
+
+void SliceCache::addToMemory(const Key& key, const std::vector<SlicerLayer>& layers)
+{
+    if (max_memory_cache_size == 0)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(memory_cache_mutex);
+    if (memory_cache.size() >= max_memory_cache_size)
+    {
+        memory_cache.pop_back();
+    }
+    memory_cache.emplace_front();
+    CachedSlices& cached = memory_cache.front();
+    cached.key = key;
+    cached.layers.resize(layers.size());
+    for (unsigned int layer_nr = 0; layer_nr < layers.size(); layer_nr++)
+    { // the segments are only used while slicing, so they aren't cached
+        cached.layers[layer_nr].z = layers[layer_nr].z;
+        cached.layers[layer_nr].polygons = layers[layer_nr].polygons;
+        cached.layers[layer_nr].openPolylines = layers[layer_nr].openPolylines;
+    }
+}
+
+bool SliceCache::readFile(const Key& key, std::vector<SlicerLayer>& layers) const
+{
+    std::ifstream in(getFilename(key), std::ios::binary);
+    if (!in)
+    {
+        return false;
+    }
+    char file_magic[sizeof(magic)];
+    uint32_t file_format_version;
+    Key file_key;
+    if (!in.read(file_magic, sizeof(file_magic)) || std::memcmp(file_magic, magic, sizeof(magic)) != 0
+        || !readValue(in, file_format_version) || file_format_version != format_version
+        || !readValue(in, file_key.mesh_hash) || !readValue(in, file_key.vertex_count) || !readValue(in, file_key.face_count)
+        || !readValue(in, file_key.initial) || !readValue(in, file_key.thickness) || !readValue(in, file_key.slice_layer_count)
+        || !readValue(in, file_key.keep_none_closed) || !readValue(in, file_key.extensive_stitching)
+        || !readValue(in, file_key.maximum_deviation) || !readValue(in, file_key.xy_offset) || !readValue(in, file_key.surface_mode)
+        || !readValue(in, file_key.copy_prismatic_layers)
+        || !(file_key == key))
+    {
+        return false;
+    }
+    layers.clear(); // the layer count of the key is already checked, so it can be trusted
+    layers.resize(key.slice_layer_count);
+    for (SlicerLayer& layer : layers)
+    {
+        if (!readValue(in, layer.z) || !readPolygons(in, layer.polygons) || !readPolygons(in, layer.openPolylines))
+        {
+            layers.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+void SliceCache::writeFile(const Key& key, const std::vector<SlicerLayer>& layers) const
+{
+    const std::string filename = getFilename(key);
+    const std::string thread_id = std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())); // equal meshes of a mesh group are sliced at the same time
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+    const std::string temporary_filename = filename + "." + std::to_string(getpid()) + "." + thread_id + ".tmp"; // jobs running at the same time may write the same file
+#else
+    const std::string temporary_filename = filename + "." + thread_id + ".tmp";
+#endif
+    {
+        std::ofstream out(temporary_filename, std::ios::binary);
+        if (!out)
+        {
+            logWarning("Couldn't write to the slice cache directory %s\n", cache_directory.c_str());
+            return;
+        }
+        out.write(magic, sizeof(magic));
+        writeValue<uint32_t>(out, format_version);
+        writeValue(out, key.mesh_hash);
+        writeValue(out, key.vertex_count);
+        writeValue(out, key.face_count);
+        writeValue(out, key.initial);
+        writeValue(out, key.thickness);
+        writeValue(out, key.slice_layer_count);
+        writeValue(out, key.keep_none_closed);
+        writeValue(out, key.extensive_stitching);
+        writeValue(out, key.maximum_deviation);
+        writeValue(out, key.xy_offset);
+        writeValue(out, key.surface_mode);
+        writeValue(out, key.copy_prismatic_layers);
+        for (const SlicerLayer& layer : layers)
+        {
+            writeValue<int32_t>(out, layer.z);
+            writePolygons(out, layer.polygons);
+            writePolygons(out, layer.openPolylines);
+        }
+        if (!out)
+        {
+            out.close();
+            std::remove(temporary_filename.c_str());
+            logWarning("Couldn't write to the slice cache directory %s\n", cache_directory.c_str());
+            return;
+        }
+    }
+    if (std::rename(temporary_filename.c_str(), filename.c_str()) != 0)
+    {
+        std::remove(temporary_filename.c_str());
+    }
+}
+
+}//namespace cura
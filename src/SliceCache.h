@@ -0,0 +1,147 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef SLICE_CACHE_H
+#define SLICE_CACHE_H
+
+#include <list>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "slicer.h"
+#include "utils/NoCopy.h"
+
+namespace cura
+{
+
+/*!
+ * A cache of the output of the Slicer, so that a mesh which is sliced again with the same slicing parameters doesn't need to be sliced.
+ *
+ * A job which is sliced again after only changing settings which don't affect the slicing - temperatures, speeds, start gcode etc. -
+ * then only needs to redo the stages after slicing.
+ *
+ * The layers of a mesh are identified by a hash of the geometry of the mesh, as positioned on the build plate,
+ * all parameters of the Slicer: the layer heights, the number of layers and the options for closing polygons,
+ * and the settings of the mesh which change its polygons: the maximum deviation, the horizontal expansion, the surface mode
+ * and whether prismatic layers are copied.
+ *
+ * Layers are kept in memory for the most recently sliced meshes, see \ref SliceCache::setMemoryCacheSize,
+ * which helps when a single process slices many jobs.
+ * When the environment variable CURA_ENGINE_SLICE_CACHE contains a directory, the layers are also stored in that directory,
+ * which helps when the engine is started for every job.
+ */
+class SliceCache : NoCopy
+{
+public:
+    static SliceCache* getInstance()
+    {
+        return &instance;
+    }
+
+    /*!
+     * Slice a mesh, or get its layers from the cache if it has been sliced with the same parameters before.
+     *
+     * The parameters are those of the Slicer constructor.
+     *
+     * \param mesh The mesh to slice
+     * \param initial The z coordinate of the first layer
+     * \param thickness The distance between two layers
+     * \param slice_layer_count The number of layers
+     * \param keep_none_closed Whether to keep the polylines which couldn't be closed into polygons
+     * \param extensive_stitching Whether to do extra work to close polylines with large gaps
+     * \param cancelled When set, slicing stops early and the incomplete layers aren't cached (optional)
+     * \return A newly allocated Slicer with the layers of the mesh
+     */
+    Slicer* slice(const Mesh* mesh, int initial, int thickness, int slice_layer_count, bool keep_none_closed, bool extensive_stitching, const std::atomic<bool>* cancelled = nullptr);
+
+    /*!
+     * Set the number of most recently sliced meshes of which the layers are kept in memory.
+     *
+     * 0 disables caching in memory, which is the default.
+     *
+     * \param mesh_count The number of meshes
+     */
+    void setMemoryCacheSize(unsigned int mesh_count);
+
+private:
+    static SliceCache instance;
+
+    /*!
+     * Everything which determines the output of the Slicer.
+     */
+    struct Key
+    {
+        uint64_t mesh_hash; //!< Hash of the vertex positions and faces of the mesh
+        uint32_t vertex_count;
+        uint32_t face_count;
+        int32_t initial;
+        int32_t thickness;
+        int32_t slice_layer_count;
+        bool keep_none_closed;
+        bool extensive_stitching;
+        int32_t maximum_deviation; //!< meshfix_maximum_deviation, which differs between a preview and a full slice
+        int32_t xy_offset;
+        int32_t surface_mode;
+        bool copy_prismatic_layers;
+
+        bool operator==(const Key& other) const;
+
+        /*!
+         * Get a hash of the whole key, used to name the file in which its layers are stored.
+         */
+        uint64_t hash() const;
+    };
+
+    /*!
+     * The layers of a mesh sliced with the parameters in \ref CachedSlices::key.
+     */
+    struct CachedSlices
+    {
+        Key key;
+        std::vector<SlicerLayer> layers; //!< Only the z, polygons and open polylines of each layer
+    };
+
+    std::list<CachedSlices> memory_cache; //!< Most recently used first
+    std::mutex memory_cache_mutex; //!< Guards \ref SliceCache::memory_cache, since the meshes of a mesh group are sliced at the same time
+    unsigned int max_memory_cache_size;
+    std::string cache_directory; //!< The directory in which layers are stored, or empty if they aren't stored on disk
+
+    SliceCache();
+
+    /*!
+     * Compute the key of a mesh with the given Slicer parameters.
+     */
+    static Key getKey(const Mesh* mesh, int initial, int thickness, int slice_layer_count, bool keep_none_closed, bool extensive_stitching);
+
+    /*!
+     * Get the name of the file in which the layers of a key are stored.
+     */
+    std::string getFilename(const Key& key) const;
+
+    /*!
+     * Read the layers of a key from the cache directory.
+     *
+     * \param key The key of which to read the layers
+     * \param[out] layers The layers read
+     * \return Whether the cache directory contains the layers of this key
+     */
+    bool readFile(const Key& key, std::vector<SlicerLayer>& layers) const;
+
+    /*!
+     * Store the layers of a key in the cache directory.
+     *
+     * The file is written under a temporary name first, so that other processes never read a half written file.
+     *
+     * \param key The key of which to write the layers
+     * \param layers The layers to write
+     */
+    void writeFile(const Key& key, const std::vector<SlicerLayer>& layers) const;
+
+    /*!
+     * Add the layers of a key to the front of the memory cache, removing the least recently used layers when the cache is full.
+     */
+    void addToMemory(const Key& key, const std::vector<SlicerLayer>& layers);
+};
+
+}//namespace cura
+#endif//SLICE_CACHE_H
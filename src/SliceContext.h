@@ -0,0 +1,49 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef SLICE_CONTEXT_H
+#define SLICE_CONTEXT_H
+
+#include <atomic>
+
+namespace cura
+{
+
+class FffProcessor;
+class CommandSocket;
+
+/*!
+ * What a slice is done for: the processor which is slicing and where its results are sent.
+ *
+ * The polygon generator and the gcode writer get these from here instead of from process-wide instances,
+ * so that several processors can slice independently of each other in the same process.
+ */
+struct SliceContext
+{
+    FffProcessor* processor; //!< The processor which is slicing, which is also the root of the settings hierarchy and counts the mesh groups
+    CommandSocket* command_socket; //!< Where the progress, the layer view and the gcode are sent to, or nullptr when the gcode is only written to a file or stream
+
+    /*!
+     * Set from any thread to stop the slicing.
+     *
+     * The layer loops check it at the start of each layer and stop early when it's set,
+     * after which the processor drops what it computed of the mesh group.
+     */
+    std::atomic<bool> cancelled;
+
+    SliceContext(FffProcessor* processor, CommandSocket* command_socket)
+    : processor(processor)
+    , command_socket(command_socket)
+    , cancelled(false)
+    {
+    }
+
+    /*!
+     * Whether the slicing should stop at the next layer, see SliceContext::cancelled.
+     */
+    bool isCancelled() const
+    {
+        return cancelled.load(std::memory_order_relaxed);
+    }
+};
+
+}//namespace cura
+#endif//SLICE_CONTEXT_H
@@ -0,0 +1,630 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "SliceDaemon.h"
+
+#include <algorithm> // max
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define SLICE_DAEMON_SUPPORTED
+#endif
+
+#include "MeshGroup.h"
+#include "settings/SettingRegistry.h"
+#include "utils/gettime.h"
+#include "utils/logoutput.h"
+#include "utils/ThreadPool.h"
+
+namespace cura
+{
+
+SliceDaemon::SliceDaemon(const std::function<void(int, char**)>& slice, unsigned int max_jobs)
+: slice(slice)
+, max_jobs(std::max(1u, max_jobs))
+, listen_socket(-1)
+{
+}
+
+#ifdef SLICE_DAEMON_SUPPORTED
+
+namespace
+{
+
+bool sendAll(int socket, const void* data, size_t length)
+{
+    const char* ptr = static_cast<const char*>(data);
+    while (length > 0)
+    {
+        ssize_t n = send(socket, ptr, length, 0);
+        if (n <= 0)
+        {
+            return false;
+        }
+        ptr += n;
+        length -= n;
+    }
+    return true;
+}
+
+bool recvAll(int socket, void* data, size_t length)
+{
+    char* ptr = static_cast<char*>(data);
+    while (length > 0)
+    {
+        ssize_t n = recv(socket, ptr, length, 0);
+        if (n <= 0)
+        {
+            return false;
+        }
+        ptr += n;
+        length -= n;
+    }
+    return true;
+}
+
+bool sendInt32(int socket, int32_t value)
+{
+    return sendAll(socket, &value, sizeof(value));
+}
+
+bool recvInt32(int socket, int32_t& value)
+{
+    return recvAll(socket, &value, sizeof(value));
+}
+
+/*!
+ * Receive the strings of a job: the working directory followed by the arguments.
+ */
+bool receiveJob(int socket, std::vector<std::string>& strings)
+{
+    const int32_t max_string_count = 1 << 16;
+    const int32_t max_string_size = 1 << 20;
+    int32_t string_count;
+    if (!recvInt32(socket, string_count) || string_count < 1 || string_count > max_string_count)
+    {
+        return false;
+    }
+    strings.resize(string_count);
+    for (std::string& string : strings)
+    {
+        int32_t size;
+        if (!recvInt32(socket, size) || size < 0 || size > max_string_size)
+        {
+            return false;
+        }
+        string.resize(size);
+        if (size > 0 && !recvAll(socket, &string[0], size))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*!
+ * Split a line of a batch manifest into the arguments of a job.
+ *
+ * \return Whether the line could be parsed; it can't if a quote isn't closed
+ */
+bool parseManifestLine(const std::string& line, std::vector<std::string>& arguments)
+{
+    size_t pos = line.find_first_not_of(" \t\r");
+    if (pos == std::string::npos || line[pos] == '#')
+    {
+        return true;
+    }
+    while (pos < line.size())
+    {
+        std::string argument;
+        bool quoted = false;
+        for (; pos < line.size() && (quoted || (line[pos] != ' ' && line[pos] != '\t' && line[pos] != '\r')); pos++)
+        {
+            if (line[pos] == '"')
+            {
+                quoted = !quoted;
+            }
+            else
+            {
+                argument.push_back(line[pos]);
+            }
+        }
+        if (quoted)
+        {
+            return false;
+        }
+        arguments.push_back(std::move(argument));
+        pos = line.find_first_not_of(" \t\r", pos);
+    }
+    return true;
+}
+
+/*!
+ * The address of a daemon: a port of the loopback interface or the path of a unix domain socket.
+ */
+struct DaemonAddress
+{
+    sockaddr_storage storage;
+    socklen_t length;
+    std::string description; //!< For messages, e.g. "port 4242"
+
+    sockaddr* get()
+    {
+        return reinterpret_cast<sockaddr*>(&storage);
+    }
+};
+
+/*!
+ * Interpret an address given on the command line: a number is a port of the loopback interface, anything else the path of a unix domain socket.
+ *
+ * \param text The address given on the command line
+ * \param[out] address The resolved address
+ * \return Whether the address is valid
+ */
+bool getDaemonAddress(const std::string& text, DaemonAddress& address)
+{
+    memset(&address.storage, 0, sizeof(address.storage));
+    if (!text.empty() && text.find_first_not_of("0123456789") == std::string::npos)
+    {
+        sockaddr_in* inet_address = reinterpret_cast<sockaddr_in*>(&address.storage);
+        inet_address->sin_family = AF_INET;
+        inet_address->sin_port = htons(atoi(text.c_str()));
+        inet_address->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.length = sizeof(sockaddr_in);
+        address.description = "port " + text;
+        return true;
+    }
+    sockaddr_un* unix_address = reinterpret_cast<sockaddr_un*>(&address.storage);
+    if (text.empty() || text.size() >= sizeof(unix_address->sun_path))
+    {
+        logError("Invalid socket path: %s\n", text.c_str());
+        return false;
+    }
+    unix_address->sun_family = AF_UNIX;
+    memcpy(unix_address->sun_path, text.c_str(), text.size() + 1);
+    address.length = sizeof(sockaddr_un);
+    address.description = "socket " + text;
+    return true;
+}
+
+}//namespace
+
+int SliceDaemon::serve(const std::string& address_text)
+{
+    DaemonAddress address;
+    if (!getDaemonAddress(address_text, address))
+    {
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN); // a client which disconnects early shouldn't stop the daemon
+
+    // the daemon itself stays single threaded, because worker threads don't survive the fork into a job
+    ThreadPool::getInstance()->setThreadCount(1);
+    setMeshCacheSize(cached_mesh_count);
+
+    listen_socket = socket(address.storage.ss_family, SOCK_STREAM, 0);
+    if (listen_socket < 0)
+    {
+        logError("Couldn't create a socket for the slice daemon.\n");
+        return 1;
+    }
+    bool bound;
+    if (address.storage.ss_family == AF_UNIX)
+    {
+        struct stat existing_file;
+        if (stat(address_text.c_str(), &existing_file) == 0 && S_ISSOCK(existing_file.st_mode))
+        {
+            unlink(address_text.c_str()); // the socket of an earlier daemon isn't removed when it's killed
+        }
+        // only the user running the daemon may submit jobs, unlike on a port, to which every user of the machine can connect
+        const mode_t old_umask = umask(S_IRWXG | S_IRWXO);
+        bound = bind(listen_socket, address.get(), address.length) == 0;
+        umask(old_umask);
+    }
+    else
+    {
+        int reuse_address = 1;
+        setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, &reuse_address, sizeof(reuse_address));
+        bound = bind(listen_socket, address.get(), address.length) == 0;
+    }
+    if (!bound || listen(listen_socket, 64) < 0)
+    {
+        logError("Couldn't listen on %s.\n", address.description.c_str());
+        close(listen_socket);
+        return 1;
+    }
+
+    std::vector<char> daemon_directory(4096);
+    if (!getcwd(daemon_directory.data(), daemon_directory.size()))
+    {
+        logError("Couldn't get the working directory of the slice daemon.\n");
+        close(listen_socket);
+        return 1;
+    }
+    log("Slice daemon listening on %s, slicing at most %u jobs at the same time.\n", address.description.c_str(), max_jobs);
+
+    while (true)
+    {
+        finishJobs(running_jobs.size() >= max_jobs); // wait for a free slot before accepting the next job
+        pollfd listen_poll;
+        listen_poll.fd = listen_socket;
+        listen_poll.events = POLLIN;
+        const int poll_timeout = 100; // milliseconds; finished jobs are reported at least this often
+        if (poll(&listen_poll, 1, poll_timeout) <= 0)
+        {
+            continue;
+        }
+        int connection = accept(listen_socket, nullptr, nullptr);
+        if (connection < 0)
+        {
+            continue;
+        }
+        timeval receive_timeout;
+        receive_timeout.tv_sec = 10; // a stalled client shouldn't block the daemon forever
+        receive_timeout.tv_usec = 0;
+        setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &receive_timeout, sizeof(receive_timeout));
+
+        std::vector<std::string> job;
+        if (!receiveJob(connection, job))
+        {
+            logError("Received an invalid job.\n");
+            close(connection);
+            continue;
+        }
+        if (chdir(job[0].c_str()) != 0)
+        {
+            logError("Job has an invalid working directory: %s\n", job[0].c_str());
+            sendInt32(connection, -1);
+            close(connection);
+            continue;
+        }
+        std::vector<std::string> arguments(job.begin() + 1, job.end());
+        prepareJob(arguments, true);
+
+        const bool started = startJob(arguments, connection, [connection](int exit_status)
+            {
+                sendInt32(connection, exit_status);
+                close(connection);
+            });
+        if (chdir(daemon_directory.data()) != 0)
+        {
+            logError("Couldn't return to the working directory of the slice daemon.\n");
+        }
+        if (!started)
+        {
+            logError("Couldn't start a process for a job.\n");
+            sendInt32(connection, -1);
+            close(connection);
+        }
+    }
+}
+
+int SliceDaemon::runBatch(const char* manifest, size_t memory_limit)
+{
+    std::ifstream manifest_file(manifest);
+    if (!manifest_file)
+    {
+        logError("Couldn't open the manifest %s.\n", manifest);
+        return -1;
+    }
+    std::vector<std::vector<std::string>> jobs;
+    std::vector<unsigned int> job_lines; // the line of the manifest of each job, for reporting
+    std::string line;
+    for (unsigned int line_nr = 1; std::getline(manifest_file, line); line_nr++)
+    {
+        std::vector<std::string> arguments;
+        if (!parseManifestLine(line, arguments))
+        {
+            logError("Line %u of the manifest has an unterminated quote.\n", line_nr);
+            return -1;
+        }
+        if (!arguments.empty())
+        {
+            jobs.push_back(std::move(arguments));
+            job_lines.push_back(line_nr);
+        }
+    }
+
+    // the batch itself stays single threaded, because worker threads don't survive the fork into a job
+    ThreadPool::getInstance()->setThreadCount(1);
+    log("Slicing %u jobs, at most %u at the same time.\n", static_cast<unsigned int>(jobs.size()), max_jobs);
+    TimeKeeper batch_timer;
+    int failed_job_count = 0;
+    for (unsigned int job_idx = 0; job_idx < jobs.size(); job_idx++)
+    {
+        while (true)
+        {
+            finishJobs(false);
+            if (running_jobs.size() >= max_jobs)
+            {
+                finishJobs(true);
+            }
+            else if (memory_limit > 0 && !running_jobs.empty() && getRunningJobsMemory() >= memory_limit)
+            {
+                const useconds_t memory_poll_interval = 100000; // microseconds
+                usleep(memory_poll_interval);
+            }
+            else
+            {
+                break;
+            }
+        }
+        prepareJob(jobs[job_idx], false); // each model is usually sliced only once, so caching the meshes would only delay the jobs
+
+        const unsigned int job_line = job_lines[job_idx];
+        auto finish = [job_line, &failed_job_count](int exit_status)
+            {
+                if (exit_status != 0)
+                {
+                    logError("The job on line %u of the manifest failed with exit status %d.\n", job_line, exit_status);
+                    failed_job_count++;
+                }
+            };
+        if (!startJob(jobs[job_idx], -1, finish))
+        {
+            logError("Couldn't start a process for the job on line %u of the manifest.\n", job_line);
+            failed_job_count++;
+        }
+    }
+    while (!running_jobs.empty())
+    {
+        finishJobs(true);
+    }
+    log("Sliced %u jobs in %.3f seconds, of which %d failed.\n", static_cast<unsigned int>(jobs.size()), batch_timer.restart(), failed_job_count);
+    return failed_job_count;
+}
+
+bool SliceDaemon::startJob(const std::vector<std::string>& arguments, int connection, const std::function<void(int)>& finish)
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        if (listen_socket >= 0)
+        {
+            close(listen_socket);
+        }
+        if (connection >= 0)
+        {
+            close(connection);
+        }
+        for (const std::pair<const int, RunningJob>& running_job : running_jobs)
+        {
+            if (running_job.second.connection >= 0)
+            {
+                close(running_job.second.connection);
+            }
+        }
+        runJob(arguments);
+    }
+    if (pid < 0)
+    {
+        return false;
+    }
+    RunningJob& running_job = running_jobs[pid];
+    running_job.connection = connection;
+    running_job.finish = finish;
+    return true;
+}
+
+size_t SliceDaemon::getRunningJobsMemory() const
+{
+    size_t memory = 0;
+#ifdef __linux__
+    const size_t page_size = sysconf(_SC_PAGESIZE);
+    for (const std::pair<const int, RunningJob>& running_job : running_jobs)
+    {
+        std::ifstream statm("/proc/" + std::to_string(running_job.first) + "/statm");
+        size_t total_pages;
+        size_t resident_pages;
+        if (statm >> total_pages >> resident_pages)
+        {
+            memory += resident_pages * page_size;
+        }
+    }
+#endif
+    return memory;
+}
+
+void SliceDaemon::finishJobs(bool wait)
+{
+    while (!running_jobs.empty())
+    {
+        int status;
+        pid_t pid = waitpid(-1, &status, wait ? 0 : WNOHANG);
+        if (pid <= 0)
+        {
+            return;
+        }
+        wait = false; // only wait for the first job, then report all others which happen to be finished as well
+        auto running_job = running_jobs.find(pid);
+        if (running_job == running_jobs.end())
+        {
+            continue;
+        }
+        const int32_t exit_status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+        const std::function<void(int)> finish = running_job->second.finish;
+        running_jobs.erase(running_job);
+        finish(exit_status);
+    }
+}
+
+void SliceDaemon::prepareJob(const std::vector<std::string>& arguments, bool load_meshes)
+{
+    SettingsBase settings; // the definitions and meshes are only loaded for the caches, so their settings aren't used
+    MeshGroup meshgroup(&settings);
+    FMatrix3x3 transformation; // the same transformation as "CuraEngine slice" uses
+    for (unsigned int argn = 0; argn < arguments.size(); argn++)
+    {
+        const std::string& argument = arguments[argn];
+        if (argument.size() < 2 || argument[0] != '-')
+        {
+            continue;
+        }
+        if (argument[1] == '-')
+        {
+            if (argument == "--threads" || argument == "--profile" || argument == "--trace")
+            {
+                argn++;
+            }
+            continue;
+        }
+        // consume the arguments of the options in the same way as "CuraEngine slice"
+        for (unsigned int char_idx = 1; char_idx < argument.size() && argn < arguments.size(); char_idx++)
+        {
+            switch (argument[char_idx])
+            {
+                case 'j':
+                    argn++;
+                    if (argn < arguments.size())
+                    {
+                        SettingRegistry::getInstance()->loadJSONsettings(arguments[argn], &settings);
+                        for (unsigned int extruder_nr = 0; extruder_nr < MAX_EXTRUDERS; extruder_nr++)
+                        {
+                            SettingsBase extruder_train_settings;
+                            SettingRegistry::getInstance()->loadExtruderJSONsettings(extruder_nr, &extruder_train_settings);
+                        }
+                    }
+                    break;
+                case 'l':
+                    argn++;
+                    if (argn < arguments.size() && load_meshes)
+                    {
+                        loadMeshIntoMeshGroup(&meshgroup, arguments[argn].c_str(), transformation);
+                        meshgroup.meshes.clear();
+                    }
+                    break;
+                case 'e':
+                    char_idx++;
+                    break;
+                case 'o':
+                case 'g':
+                case 's':
+                    argn++;
+                    break;
+            }
+        }
+    }
+}
+
+void SliceDaemon::runJob(const std::vector<std::string>& arguments)
+{
+    // "CuraEngine slice" modifies its arguments, so they need to be copied into writable memory
+    std::vector<std::string> command_line = { "CuraEngine", "slice" };
+    command_line.insert(command_line.end(), arguments.begin(), arguments.end());
+    std::vector<std::vector<char>> argument_buffers;
+    for (const std::string& argument : command_line)
+    {
+        argument_buffers.emplace_back(argument.begin(), argument.end());
+    }
+    std::vector<char*> argv;
+    for (std::vector<char>& buffer : argument_buffers)
+    {
+        buffer.push_back('\0');
+        argv.push_back(buffer.data());
+    }
+    argv.push_back(nullptr);
+    slice(argv.size() - 1, argv.data());
+    exit(0);
+}
+
+int SliceDaemon::submit(const std::string& address_text, const std::vector<std::string>& arguments)
+{
+    DaemonAddress address;
+    if (!getDaemonAddress(address_text, address))
+    {
+        return -1;
+    }
+    std::vector<char> working_directory(4096);
+    if (!getcwd(working_directory.data(), working_directory.size()))
+    {
+        logError("Couldn't get the working directory.\n");
+        return -1;
+    }
+    int connection = socket(address.storage.ss_family, SOCK_STREAM, 0);
+    if (connection < 0)
+    {
+        logError("Couldn't create a socket.\n");
+        return -1;
+    }
+    if (connect(connection, address.get(), address.length) < 0)
+    {
+        logError("Couldn't connect to a slice daemon on %s.\n", address.description.c_str());
+        close(connection);
+        return -1;
+    }
+    std::vector<std::string> job;
+    job.emplace_back(working_directory.data());
+    job.insert(job.end(), arguments.begin(), arguments.end());
+    bool success = sendInt32(connection, job.size());
+    for (const std::string& string : job)
+    {
+        success = success && sendInt32(connection, string.size()) && sendAll(connection, string.data(), string.size());
+    }
+    int32_t exit_status = -1;
+    if (!success || !recvInt32(connection, exit_status))
+    {
+        logError("Lost the connection to the slice daemon.\n");
+        exit_status = -1;
+    }
+    close(connection);
+    return exit_status;
+}
+
+#else // SLICE_DAEMON_SUPPORTED
+
+int SliceDaemon::serve(const std::string&)
+{
+    logError("The slice daemon isn't supported on this platform.\n");
+    return 1;
+}
+
+int SliceDaemon::submit(const std::string&, const std::vector<std::string>&)
+{
+    logError("The slice daemon isn't supported on this platform.\n");
+    return -1;
+}
+
+int SliceDaemon::runBatch(const char*, size_t)
+{
+    logError("Batch slicing isn't supported on this platform.\n");
+    return -1;
+}
+
+void SliceDaemon::finishJobs(bool)
+{
+}
+
+size_t SliceDaemon::getRunningJobsMemory() const
+{
+    return 0;
+}
+
+void SliceDaemon::prepareJob(const std::vector<std::string>&, bool)
+{
+}
+
+bool SliceDaemon::startJob(const std::vector<std::string>&, int, const std::function<void(int)>&)
+{
+    return false;
+}
+
+void SliceDaemon::runJob(const std::vector<std::string>&)
+{
+}
+
+#endif // SLICE_DAEMON_SUPPORTED
+
+}//namespace cura
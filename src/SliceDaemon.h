@@ -0,0 +1,136 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef SLICE_DAEMON_H
+#define SLICE_DAEMON_H
+
+#include <cstddef> // size_t
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "utils/NoCopy.h"
+
+namespace cura
+{
+
+/*!
+ * A long-lived process which slices the jobs sent to it over a socket, so that the engine doesn't need to be started for every job.
+ *
+ * A job consists of the arguments which would be given to "CuraEngine slice" and the working directory in which to interpret them.
+ * The daemon keeps the setting definitions and the meshes of earlier jobs in memory (see SettingRegistry::loadJSONsettings and setMeshCacheSize).
+ * Before a job is started the daemon loads its definitions and meshes, if they aren't in memory yet,
+ * and then slices the job in a forked child process, which starts out with everything already loaded.
+ * Because every job has its own process, a job which fails can't affect the daemon or other jobs.
+ *
+ * At most a given number of jobs are sliced at the same time; further jobs wait until a running job is finished.
+ *
+ * The same machinery slices a batch of jobs listed in a manifest file, see SliceDaemon::runBatch.
+ *
+ * Protocol, with all numbers as 32 bit integers in the byte order of the machine:
+ * - The client sends the number of strings, followed by each string as its length and its characters:
+ *   first the working directory, then the arguments.
+ * - The daemon replies with the exit status of the job, or -1 if the job couldn't be run.
+ */
+class SliceDaemon : NoCopy
+{
+public:
+    /*!
+     * \param slice The function which slices a job, given the command line of "CuraEngine slice"
+     * \param max_jobs The maximum number of jobs which are sliced at the same time
+     */
+    SliceDaemon(const std::function<void(int, char**)>& slice, unsigned int max_jobs);
+
+    /*!
+     * Listen for jobs on a port of the loopback interface or on a unix domain socket and slice them.
+     *
+     * A unix domain socket is only accessible to the user running the daemon,
+     * whereas every user of the machine can connect to a port and have jobs sliced with the permissions of the daemon.
+     *
+     * \param address The port to listen on, or the path of the socket for anything which isn't a number
+     * \return Only returns when the daemon couldn't be started, with a non-zero error code
+     */
+    int serve(const std::string& address);
+
+    /*!
+     * Slice all jobs listed in a manifest file and wait till they're finished.
+     *
+     * Each line of the manifest holds the arguments of one job, as would be given to "CuraEngine slice".
+     * Arguments are separated by white space, and can be put in double quotes to include white space.
+     * Empty lines and lines starting with '#' are skipped.
+     * The setting definitions are loaded once, before the job which first uses them is started.
+     *
+     * A job is only started when fewer than the maximum number of jobs are running
+     * and, if \p memory_limit is given, the running jobs use less memory than that together.
+     *
+     * \param manifest The manifest file
+     * \param memory_limit The number of bytes of memory the running jobs may use together before no more jobs are started, or zero for no limit
+     * \return The number of jobs which failed, or -1 if the manifest couldn't be read
+     */
+    int runBatch(const char* manifest, size_t memory_limit);
+
+    /*!
+     * Send a job to a daemon and wait till it's finished.
+     *
+     * \param address The port on which the daemon listens, or the path of its socket
+     * \param arguments The arguments which would be given to "CuraEngine slice"
+     * \return The exit status of the job, or -1 if it couldn't be run
+     */
+    static int submit(const std::string& address, const std::vector<std::string>& arguments);
+
+private:
+    static constexpr unsigned int cached_mesh_count = 16; //!< The number of most recently used meshes which are kept in memory
+
+    /*!
+     * A job which is being sliced in a child process.
+     */
+    struct RunningJob
+    {
+        int connection; //!< The connection to the client of the job, or -1 for a job of a batch
+        std::function<void(int)> finish; //!< Reports the exit status of the job
+    };
+
+    std::function<void(int, char**)> slice; //!< The function which slices a job
+    unsigned int max_jobs; //!< The maximum number of jobs which are sliced at the same time
+    std::unordered_map<int, RunningJob> running_jobs; //!< The running jobs by their process id
+    int listen_socket; //!< The socket on which new connections are accepted
+
+    /*!
+     * Send the exit status of finished jobs to their clients.
+     *
+     * \param wait Whether to wait until at least one job is finished
+     */
+    void finishJobs(bool wait);
+
+    /*!
+     * Get the memory used by the running jobs together, in bytes, or zero where this isn't known.
+     */
+    size_t getRunningJobsMemory() const;
+
+    /*!
+     * Load the definitions and meshes used by a job into the memory of the daemon, so that this job and later jobs don't need to load them.
+     *
+     * \param arguments The arguments of the job, interpreted in the same way as "CuraEngine slice" does
+     * \param load_meshes Whether to load the meshes as well, for when they are likely to be used by later jobs
+     */
+    void prepareJob(const std::vector<std::string>& arguments, bool load_meshes);
+
+    /*!
+     * Start slicing a job in a child process.
+     *
+     * \param arguments The arguments of the job
+     * \param connection The connection to the client of the job, or -1, which is closed in the child process
+     * \param finish Reports the exit status of the job when it's finished
+     * \return Whether the child process could be started
+     */
+    bool startJob(const std::vector<std::string>& arguments, int connection, const std::function<void(int)>& finish);
+
+    /*!
+     * Slice a job in the current process and exit; called in the forked child process.
+     *
+     * \param arguments The arguments of the job
+     */
+    void runJob(const std::vector<std::string>& arguments);
+};
+
+}//namespace cura
+#endif//SLICE_DAEMON_H
@@ -0,0 +1,605 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "SliceDataSnapshot.h"
+
+#include <algorithm> // max, min
+#include <cstdio> // rename, remove
+#include <cstring> // memcpy, memcmp
+#include <fstream>
+#include <limits>
+
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+#include <unistd.h> // getpid
+#endif
+
+#include "sliceDataStorage.h"
+#include "utils/logoutput.h"
+
+namespace cura
+{
+
+namespace
+{
+
+const char magic[8] = { 'C', 'u', 'r', 'a', 'A', 'r', 'e', 'a' }; // the first bytes of every snapshot
+const uint32_t format_version = 1; // increased whenever the format of the snapshots changes
+const uint32_t max_count = 1 << 28; // larger counts are only found in corrupt files
+
+/*!
+ * Appends the values of a section to a buffer.
+ */
+class Encoder
+{
+public:
+    std::string data;
+    bool coordinates_fit = true; //!< Whether all coordinates written so far fit in 32 bits
+
+    template<typename T>
+    void value(T value)
+    {
+        data.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void string(const std::string& value)
+    {
+        this->value<uint32_t>(value.size());
+        data.append(value);
+    }
+
+    void coordinate(int64_t coordinate)
+    {
+        if (coordinate < std::numeric_limits<int32_t>::min() || coordinate > std::numeric_limits<int32_t>::max())
+        {
+            coordinates_fit = false;
+        }
+        value<int32_t>(coordinate);
+    }
+
+    void point(Point point)
+    {
+        coordinate(point.X);
+        coordinate(point.Y);
+    }
+
+    void polygons(const Polygons& polygons)
+    {
+        value<uint32_t>(polygons.size());
+        for (unsigned int poly_idx = 0; poly_idx < polygons.size(); poly_idx++)
+        {
+            value<uint32_t>(polygons[poly_idx].size());
+        }
+        for (unsigned int poly_idx = 0; poly_idx < polygons.size(); poly_idx++)
+        {
+            for (const Point& point : polygons[poly_idx])
+            {
+                coordinate(point.X);
+            }
+        }
+        for (unsigned int poly_idx = 0; poly_idx < polygons.size(); poly_idx++)
+        {
+            for (const Point& point : polygons[poly_idx])
+            {
+                coordinate(point.Y);
+            }
+        }
+    }
+
+    void polygonsList(const std::vector<Polygons>& polygons_list)
+    {
+        value<uint32_t>(polygons_list.size());
+        for (const Polygons& polygons : polygons_list)
+        {
+            this->polygons(polygons);
+        }
+    }
+
+    /*!
+     * Pad the section to a multiple of 8 bytes, so that the next section is aligned in the mapped file.
+     */
+    void pad()
+    {
+        data.resize((data.size() + 7) / 8 * 8, '\0');
+    }
+};
+
+/*!
+ * Reads the values of a section from the mapped file.
+ *
+ * Every read checks the end of the section; once one fails, Decoder::ok is false and all further reads return zeroes.
+ */
+class Decoder
+{
+public:
+    bool ok = true;
+
+    Decoder(const char* data, size_t size)
+    : data(data)
+    , size(size)
+    , pos(0)
+    {
+    }
+
+    template<typename T>
+    T value()
+    {
+        T result = T();
+        if (ok && size - pos >= sizeof(T))
+        {
+            std::memcpy(&result, data + pos, sizeof(T));
+            pos += sizeof(T);
+        }
+        else
+        {
+            ok = false;
+        }
+        return result;
+    }
+
+    uint32_t count()
+    {
+        const uint32_t result = value<uint32_t>();
+        if (result > max_count)
+        {
+            ok = false;
+            return 0;
+        }
+        return result;
+    }
+
+    std::string string()
+    {
+        const uint32_t length = count();
+        if (!ok || size - pos < length)
+        {
+            ok = false;
+            return std::string();
+        }
+        std::string result(data + pos, length);
+        pos += length;
+        return result;
+    }
+
+    Point point()
+    {
+        const int32_t x = value<int32_t>();
+        const int32_t y = value<int32_t>();
+        return Point(x, y);
+    }
+
+    void polygons(Polygons& polygons)
+    {
+        const uint32_t poly_count = count();
+        if (!ok || (size - pos) / sizeof(uint32_t) < poly_count)
+        {
+            ok = false;
+            return;
+        }
+        const char* point_counts = data + pos;
+        pos += poly_count * sizeof(uint32_t);
+        uint64_t total_point_count = 0;
+        for (uint32_t poly_idx = 0; poly_idx < poly_count; poly_idx++)
+        {
+            uint32_t point_count;
+            std::memcpy(&point_count, point_counts + poly_idx * sizeof(uint32_t), sizeof(uint32_t));
+            total_point_count += point_count;
+        }
+        if ((size - pos) / (2 * sizeof(int32_t)) < total_point_count)
+        {
+            ok = false;
+            return;
+        }
+        const char* xs = data + pos;
+        const char* ys = xs + total_point_count * sizeof(int32_t);
+        pos += total_point_count * 2 * sizeof(int32_t);
+        polygons.reserve(polygons.size() + poly_count);
+        for (uint32_t poly_idx = 0; poly_idx < poly_count; poly_idx++)
+        {
+            uint32_t point_count;
+            std::memcpy(&point_count, point_counts + poly_idx * sizeof(uint32_t), sizeof(uint32_t));
+            ClipperLib::Path& path = *polygons.newPoly();
+            path.resize(point_count);
+            for (ClipperLib::IntPoint& point : path)
+            {
+                int32_t x;
+                int32_t y;
+                std::memcpy(&x, xs, sizeof(int32_t));
+                std::memcpy(&y, ys, sizeof(int32_t));
+                xs += sizeof(int32_t);
+                ys += sizeof(int32_t);
+                point = ClipperLib::IntPoint(x, y);
+            }
+        }
+    }
+
+    void polygonsList(std::vector<Polygons>& polygons_list)
+    {
+        polygons_list.resize(count());
+        for (Polygons& polygons : polygons_list)
+        {
+            this->polygons(polygons);
+        }
+    }
+
+private:
+    const char* data;
+    size_t size;
+    size_t pos;
+};
+
+void writePart(Encoder& out, const SliceLayerPart& part)
+{
+    for (const Point& corner : { part.boundaryBox.min, part.boundaryBox.max })
+    { // the box of a part without outline is left at the extreme values
+        out.value<int64_t>(corner.X);
+        out.value<int64_t>(corner.Y);
+    }
+    out.polygons(part.outline);
+    out.polygons(part.print_outline);
+    out.polygonsList(part.insets);
+    out.value<uint32_t>(part.skin_parts.size());
+    for (const SkinPart& skin_part : part.skin_parts)
+    {
+        out.polygons(skin_part.outline);
+        out.polygonsList(skin_part.insets);
+    }
+    out.polygons(part.infill_area);
+    out.value<uint8_t>(static_cast<bool>(part.infill_area_own));
+    if (part.infill_area_own)
+    {
+        out.polygons(*part.infill_area_own);
+    }
+    out.value<uint32_t>(part.infill_area_per_combine_per_density.size());
+    for (const std::vector<Polygons>& infill_area_per_combine : part.infill_area_per_combine_per_density)
+    {
+        out.polygonsList(infill_area_per_combine);
+    }
+}
+
+void readPart(Decoder& in, SliceLayerPart& part)
+{
+    for (Point* corner : { &part.boundaryBox.min, &part.boundaryBox.max })
+    {
+        corner->X = in.value<int64_t>();
+        corner->Y = in.value<int64_t>();
+    }
+    in.polygons(part.outline);
+    in.polygons(part.print_outline);
+    in.polygonsList(part.insets);
+    part.skin_parts.resize(in.count());
+    for (SkinPart& skin_part : part.skin_parts)
+    {
+        in.polygons(skin_part.outline);
+        in.polygonsList(skin_part.insets);
+    }
+    in.polygons(part.infill_area);
+    if (in.value<uint8_t>())
+    {
+        part.infill_area_own.emplace();
+        in.polygons(*part.infill_area_own);
+    }
+    part.infill_area_per_combine_per_density.resize(in.count());
+    for (std::vector<Polygons>& infill_area_per_combine : part.infill_area_per_combine_per_density)
+    {
+        in.polygonsList(infill_area_per_combine);
+    }
+}
+
+}//namespace
+
+bool SliceDataSnapshot::write(const SliceDataStorage& storage, const Validation& validation, const std::string& filename)
+{
+    std::vector<Encoder> sections(2);
+
+    Encoder& settings = sections[0];
+    settings.value<uint32_t>(validation.mesh_hashes.size());
+    for (uint64_t mesh_hash : validation.mesh_hashes)
+    {
+        settings.value(mesh_hash);
+    }
+    settings.value<uint32_t>(validation.setting_keys.size());
+    for (const std::string& key : validation.setting_keys)
+    {
+        settings.string(key);
+    }
+    settings.value<uint32_t>(validation.setting_values.size());
+    for (const std::string& value : validation.setting_values)
+    {
+        settings.string(value);
+    }
+
+    Encoder& print = sections[1];
+    for (const Point3& point : { storage.model_size, storage.model_min, storage.model_max })
+    {
+        print.value<int32_t>(point.x);
+        print.value<int32_t>(point.y);
+        print.value<int32_t>(point.z);
+    }
+    unsigned int layer_count = std::max(storage.support.supportLayers.size(), std::max(storage.oozeShield.size(), storage.cached_layer_outlines.size()));
+    print.value<uint32_t>(storage.meshes.size());
+    for (const SliceMeshStorage& mesh : storage.meshes)
+    {
+        layer_count = std::max<unsigned int>(layer_count, mesh.layers.size());
+        print.value<uint32_t>(mesh.layers.size());
+        print.value<int32_t>(mesh.layer_nr_max_filled_layer);
+        print.value<int32_t>(mesh.copy_of_mesh_idx);
+        print.point(mesh.copy_offset);
+        for (const SliceLayer& layer : mesh.layers)
+        {
+            print.value<int32_t>(layer.sliceZ);
+        }
+        for (const SliceLayer& layer : mesh.layers)
+        {
+            print.value<int32_t>(layer.printZ);
+        }
+    }
+    print.value<uint8_t>(storage.support.generated);
+    print.value<int32_t>(storage.support.layer_nr_max_filled_layer);
+    print.value<uint32_t>(storage.support.supportLayers.size());
+    print.value<uint32_t>(storage.oozeShield.size());
+    print.value<uint32_t>(storage.cached_layer_outlines.size());
+    print.value<int32_t>(storage.max_object_height_second_to_last_extruder);
+    print.point(storage.wipePoint);
+    print.value<uint32_t>(MAX_EXTRUDERS);
+    for (const Polygons& skirt_brim : storage.skirt_brim)
+    {
+        print.polygons(skirt_brim);
+    }
+    print.polygons(storage.raftOutline);
+    print.polygons(storage.draft_protection_shield);
+    print.polygons(storage.primeTower.ground_poly);
+    print.value<uint32_t>(storage.primeTower.patterns_per_extruder.size());
+    for (const std::vector<Polygons>& patterns : storage.primeTower.patterns_per_extruder)
+    {
+        print.polygonsList(patterns);
+    }
+    print.value<uint32_t>(storage.layer_infos.size());
+    for (const SliceDataStorage::LayerInfo& layer_info : storage.layer_infos)
+    {
+        print.value<int32_t>(layer_info.layer_nr);
+        print.value<int32_t>(layer_info.z);
+        print.value<int32_t>(layer_info.thickness);
+    }
+
+    sections.resize(2 + layer_count);
+    for (unsigned int layer_nr = 0; layer_nr < layer_count; layer_nr++)
+    {
+        Encoder& layer_out = sections[2 + layer_nr];
+        for (const SliceMeshStorage& mesh : storage.meshes)
+        {
+            if (layer_nr >= mesh.layers.size())
+            {
+                continue;
+            }
+            const SliceLayer& layer = mesh.layers[layer_nr];
+            layer_out.value(layer.outline_hash);
+            layer_out.polygons(layer.openPolyLines);
+            layer_out.value<uint32_t>(layer.parts.size());
+            for (const SliceLayerPart& part : layer.parts)
+            {
+                writePart(layer_out, part);
+            }
+        }
+        if (layer_nr < storage.support.supportLayers.size())
+        {
+            layer_out.polygons(storage.support.supportLayers[layer_nr].supportAreas);
+            layer_out.polygons(storage.support.supportLayers[layer_nr].skin);
+        }
+        if (layer_nr < storage.oozeShield.size())
+        {
+            layer_out.polygons(storage.oozeShield[layer_nr]);
+        }
+        if (layer_nr < storage.cached_layer_outlines.size())
+        {
+            layer_out.polygons(storage.cached_layer_outlines[layer_nr]);
+        }
+    }
+
+    Encoder header;
+    header.data.append(magic, sizeof(magic));
+    header.value<uint32_t>(format_version);
+    header.value<uint32_t>(sections.size());
+    uint64_t offset = sizeof(magic) + 2 * sizeof(uint32_t) + (sections.size() + 1) * sizeof(uint64_t);
+    for (Encoder& section : sections)
+    {
+        if (!section.coordinates_fit)
+        {
+            logWarning("The areas lie too far from the origin to be stored in %s.\n", filename.c_str());
+            return false;
+        }
+        section.pad();
+        header.value(offset);
+        offset += section.data.size();
+    }
+    header.value(offset);
+
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+    const std::string temporary_filename = filename + "." + std::to_string(getpid()) + ".tmp";
+#else
+    const std::string temporary_filename = filename + ".tmp";
+#endif
+    {
+        std::ofstream out(temporary_filename, std::ios::binary);
+        out.write(header.data.data(), header.data.size());
+        for (const Encoder& section : sections)
+        {
+            out.write(section.data.data(), section.data.size());
+        }
+        if (!out)
+        {
+            out.close();
+            std::remove(temporary_filename.c_str());
+            logWarning("Couldn't write the areas to %s\n", filename.c_str());
+            return false;
+        }
+    }
+    if (std::rename(temporary_filename.c_str(), filename.c_str()) != 0)
+    {
+        std::remove(temporary_filename.c_str());
+        logWarning("Couldn't write the areas to %s\n", filename.c_str());
+        return false;
+    }
+    return true;
+}
+
+SliceDataSnapshot::SliceDataSnapshot(const std::string& filename)
+: file(filename.c_str())
+, valid(false)
+{
+    if (!file.isValid())
+    {
+        return;
+    }
+    if (file.getSize() < sizeof(magic) || std::memcmp(file.getData(), magic, sizeof(magic)) != 0)
+    {
+        return;
+    }
+    Decoder header(file.getData() + sizeof(magic), file.getSize() - sizeof(magic));
+    const uint32_t file_format_version = header.value<uint32_t>();
+    const uint32_t section_count = header.count();
+    if (!header.ok || file_format_version != format_version || section_count < 2 || file.getSize() / sizeof(uint64_t) < section_count)
+    {
+        return;
+    }
+    section_offsets.resize(section_count + 1);
+    for (uint64_t& offset : section_offsets)
+    {
+        offset = header.value<uint64_t>();
+    }
+    if (!header.ok || section_offsets.back() != file.getSize() || !std::is_sorted(section_offsets.begin(), section_offsets.end()))
+    {
+        return;
+    }
+
+    Decoder settings(file.getData() + section_offsets[0], section_offsets[1] - section_offsets[0]);
+    validation.mesh_hashes.resize(settings.count());
+    for (uint64_t& mesh_hash : validation.mesh_hashes)
+    {
+        mesh_hash = settings.value<uint64_t>();
+    }
+    validation.setting_keys.resize(settings.count());
+    for (std::string& key : validation.setting_keys)
+    {
+        key = settings.string();
+    }
+    validation.setting_values.resize(settings.count());
+    for (std::string& value : validation.setting_values)
+    {
+        value = settings.string();
+    }
+    valid = settings.ok;
+}
+
+bool SliceDataSnapshot::read(SliceDataStorage& storage, int first_layer, int last_layer) const
+{
+    if (!valid)
+    {
+        return false;
+    }
+    Decoder print(file.getData() + section_offsets[1], section_offsets[2] - section_offsets[1]);
+    for (Point3* point : { &storage.model_size, &storage.model_min, &storage.model_max })
+    {
+        point->x = print.value<int32_t>();
+        point->y = print.value<int32_t>();
+        point->z = print.value<int32_t>();
+    }
+    const uint32_t mesh_count = print.count();
+    if (!print.ok || mesh_count != storage.meshgroup->meshes.size())
+    {
+        return false;
+    }
+    storage.meshes.reserve(mesh_count); // the path configs of the meshes point to the retraction configs of the storage, see FffPolygonGenerator::sliceModel
+    for (unsigned int mesh_idx = 0; mesh_idx < mesh_count; mesh_idx++)
+    {
+        const uint32_t layer_count = print.count();
+        storage.meshes.emplace_back(&storage.meshgroup->meshes[mesh_idx], layer_count);
+        SliceMeshStorage& mesh = storage.meshes.back();
+        mesh.layer_nr_max_filled_layer = print.value<int32_t>();
+        mesh.copy_of_mesh_idx = print.value<int32_t>();
+        mesh.copy_offset = print.point();
+        mesh.layers.resize(layer_count);
+        for (SliceLayer& layer : mesh.layers)
+        {
+            layer.sliceZ = print.value<int32_t>();
+        }
+        for (SliceLayer& layer : mesh.layers)
+        {
+            layer.printZ = print.value<int32_t>();
+        }
+    }
+    storage.support.generated = print.value<uint8_t>();
+    storage.support.layer_nr_max_filled_layer = print.value<int32_t>();
+    storage.support.supportLayers.resize(print.count());
+    storage.oozeShield.resize(print.count());
+    storage.cached_layer_outlines.resize(print.count());
+    storage.max_object_height_second_to_last_extruder = print.value<int32_t>();
+    storage.wipePoint = print.point();
+    if (print.count() != MAX_EXTRUDERS)
+    {
+        return false;
+    }
+    for (Polygons& skirt_brim : storage.skirt_brim)
+    {
+        print.polygons(skirt_brim);
+    }
+    print.polygons(storage.raftOutline);
+    print.polygons(storage.draft_protection_shield);
+    print.polygons(storage.primeTower.ground_poly);
+    storage.primeTower.patterns_per_extruder.resize(print.count());
+    for (std::vector<Polygons>& patterns : storage.primeTower.patterns_per_extruder)
+    {
+        print.polygonsList(patterns);
+    }
+    storage.layer_infos.resize(print.count());
+    for (SliceDataStorage::LayerInfo& layer_info : storage.layer_infos)
+    {
+        layer_info.layer_nr = print.value<int32_t>();
+        layer_info.z = print.value<int32_t>();
+        layer_info.thickness = print.value<int32_t>();
+    }
+    if (!print.ok)
+    {
+        return false;
+    }
+
+    const unsigned int layer_count = section_offsets.size() - 3;
+    const unsigned int end_layer = (last_layer < 0) ? layer_count : std::min<unsigned int>(layer_count, last_layer + 1);
+    for (unsigned int layer_nr = std::max(0, first_layer); layer_nr < end_layer; layer_nr++)
+    {
+        Decoder layer_in(file.getData() + section_offsets[2 + layer_nr], section_offsets[3 + layer_nr] - section_offsets[2 + layer_nr]);
+        for (SliceMeshStorage& mesh : storage.meshes)
+        {
+            if (layer_nr >= mesh.layers.size())
+            {
+                continue;
+            }
+            SliceLayer& layer = mesh.layers[layer_nr];
+            layer.outline_hash = layer_in.value<uint64_t>();
+            layer_in.polygons(layer.openPolyLines);
+            layer.parts.resize(layer_in.count());
+            for (SliceLayerPart& part : layer.parts)
+            {
+                readPart(layer_in, part);
+            }
+            layer.indexParts();
+        }
+        if (layer_nr < storage.support.supportLayers.size())
+        {
+            layer_in.polygons(storage.support.supportLayers[layer_nr].supportAreas);
+            layer_in.polygons(storage.support.supportLayers[layer_nr].skin);
+        }
+        if (layer_nr < storage.oozeShield.size())
+        {
+            layer_in.polygons(storage.oozeShield[layer_nr]);
+        }
+        if (layer_nr < storage.cached_layer_outlines.size())
+        {
+            layer_in.polygons(storage.cached_layer_outlines[layer_nr]);
+        }
+        if (!layer_in.ok)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+}//namespace cura
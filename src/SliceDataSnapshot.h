@@ -0,0 +1,99 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef SLICE_DATA_SNAPSHOT_H
+#define SLICE_DATA_SNAPSHOT_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "utils/MappedFile.h"
+#include "utils/NoCopy.h"
+
+namespace cura
+{
+
+class SliceDataStorage;
+
+/*!
+ * A file with the areas of a SliceDataStorage after FffPolygonGenerator::generateAreas, from which the gcode can be written without slicing again:
+ * the walls, skin and infill areas of every layer part, the support, the ooze shield and the outlines of each layer,
+ * and the skirt, brim, raft, draft shield and prime tower of the whole print.
+ *
+ * The snapshot is stored with the geometry hash of each mesh and the settings read while generating the areas,
+ * so that a reader can check whether the areas are those of the mesh group it is about to write, like FffProcessor does when reusing sliced data.
+ * The path configs aren't stored; the SliceDataStorage computes them from the settings as usual.
+ *
+ * The file starts with a table of the offsets of its sections: the settings, the data of the whole print and then each layer.
+ * Polygons are stored as columns: the number of polygons, the number of points of each polygon and then all X and all Y coordinates.
+ * The file is memory-mapped, so that a reader of a range of layers only reads and decodes the sections of those layers.
+ */
+class SliceDataSnapshot : NoCopy
+{
+public:
+    /*!
+     * What the areas in a snapshot depend on.
+     */
+    struct Validation
+    {
+        std::vector<uint64_t> mesh_hashes; //!< The Mesh::getGeometryHash of each mesh, computed before slicing cleared the meshes
+        std::vector<std::string> setting_keys; //!< The settings read while generating the areas
+        std::vector<std::string> setting_values; //!< The values of the settings in each settings base, see FffProcessor::getSettingValues
+    };
+
+    /*!
+     * Write the areas of a mesh group to a file.
+     *
+     * The file is written under a temporary name first, so that no reader ever sees a half written file.
+     *
+     * \param storage The sliced data, just after FffPolygonGenerator::generateAreas
+     * \param validation What the areas depend on
+     * \param filename The file to write
+     * \return Whether the file was written; it isn't when a coordinate doesn't fit in 32 bits or the file can't be written
+     */
+    static bool write(const SliceDataStorage& storage, const Validation& validation, const std::string& filename);
+
+    /*!
+     * Map a snapshot file and read its table of sections and its Validation.
+     *
+     * \param filename The file to read
+     */
+    SliceDataSnapshot(const std::string& filename);
+
+    /*!
+     * Whether the file is a snapshot in the current format, of which the table of sections is intact.
+     */
+    bool isValid() const
+    {
+        return valid;
+    }
+
+    /*!
+     * What the areas in the snapshot depend on. Only valid if \ref SliceDataSnapshot::isValid.
+     */
+    const Validation& getValidation() const
+    {
+        return validation;
+    }
+
+    /*!
+     * Fill a storage with the areas in the snapshot.
+     *
+     * All layers get their heights, but the areas are only read for a range of layers;
+     * the other layers are left empty, as if they had been released by SliceDataStorage::releaseLayer.
+     *
+     * \param storage The storage of the mesh group with the meshes of the snapshot, of which no areas have been generated
+     * \param first_layer The first layer of which to read the areas
+     * \param last_layer The last layer of which to read the areas, or -1 to read up to the top layer
+     * \return Whether all sections read were intact; if not, \p storage is left in an incomplete state
+     */
+    bool read(SliceDataStorage& storage, int first_layer = 0, int last_layer = -1) const;
+
+private:
+    MappedFile file;
+    bool valid; //!< Whether the file is a snapshot of which the table of sections is intact
+    Validation validation;
+    std::vector<uint64_t> section_offsets; //!< The start of the settings, the data of the whole print and each layer, followed by the end of the last layer
+};
+
+}//namespace cura
+#endif//SLICE_DATA_SNAPSHOT_H
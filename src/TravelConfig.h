@@ -0,0 +1,29 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef TRAVEL_CONFIG_H
+#define TRAVEL_CONFIG_H
+
+
+namespace cura
+{
+
+/*!
+ * How the travel moves of an extruder are planned: when to z hop, whether to avoid other parts and how far to move inside before retracting.
+ *
+ * Resolved once per mesh group from the extruder train settings, so that GCodePlanner::addTravel doesn't need to look up any settings.
+ * The minimal travel distance for retracting is in the RetractionConfig of the extruder.
+ */
+class TravelConfig
+{
+public:
+    bool perform_z_hops; //!< Whether to lift the head during a retracted travel
+    bool z_hops_only_when_collides; //!< Whether to only z hop when the travel would go through printed parts
+    bool z_hop_after_extruder_switch; //!< Whether to z hop instead of combing on the first travel after switching to this extruder
+    bool avoid_other_parts; //!< Whether combed travels avoid the printed parts they travel over
+    int avoid_distance; //!< The distance to keep from the printed parts when avoiding them (in micron)
+    int move_inside_distance; //!< The distance to move inside the part before an uncombed retraction (in micron)
+};
+
+
+}//namespace cura
+
+#endif // TRAVEL_CONFIG_H
@@ -1,14 +1,16 @@
 /** Copyright (C) 2013 David Braam - Released under terms of the AGPLv3 License */
 #include "WallsComputation.h"
 #include "utils/polygonUtils.h"
+#include "utils/ThreadPool.h"
 namespace cura {
 
-WallsComputation::WallsComputation(int wall_0_inset, int line_width_0, int line_width_x, int insetCount, bool recompute_outline_based_on_outer_wall)
+WallsComputation::WallsComputation(int wall_0_inset, int line_width_0, int line_width_x, int insetCount, bool recompute_outline_based_on_outer_wall, bool insets_from_outline)
 : wall_0_inset(wall_0_inset)
 , line_width_0(line_width_0)
 , line_width_x(line_width_x)
 , insetCount(insetCount)
 , recompute_outline_based_on_outer_wall(recompute_outline_based_on_outer_wall)
+, insets_from_outline(insets_from_outline)
 {
 }
 
@@ -20,19 +22,24 @@ void WallsComputation::generateInsets(SliceLayerPart* part)
         part->print_outline = part->outline;
         return;
     }
+    if (insets_from_outline)
+    {
+        generateInsetsFromOutline(part);
+        return;
+    }
     
     for(int i=0; i<insetCount; i++)
     {
-        part->insets.push_back(Polygons());
+        part->insets.emplace_back();
         if (i == 0)
         {
-            part->insets[0] = part->outline.offset(-line_width_0 / 2 - wall_0_inset);
+            part->outline.offset(-line_width_0 / 2 - wall_0_inset, part->insets[0]);
         } else if (i == 1)
         {
-            part->insets[1] = part->insets[0].offset(-line_width_0 / 2 + wall_0_inset - line_width_x / 2);
+            part->insets[0].offset(-line_width_0 / 2 + wall_0_inset - line_width_x / 2, part->insets[1]);
         } else
         {
-            part->insets[i] = part->insets[i-1].offset(-line_width_x);
+            part->insets[i-1].offset(-line_width_x, part->insets[i]);
         }
         
         
@@ -42,7 +49,7 @@ void WallsComputation::generateInsets(SliceLayerPart* part)
         {
             if (recompute_outline_based_on_outer_wall)
             {
-                part->print_outline = part->insets[0].offset(line_width_0 / 2);
+                part->insets[0].offset(line_width_0 / 2, part->print_outline);
             }
             else
             {
@@ -57,12 +64,50 @@ void WallsComputation::generateInsets(SliceLayerPart* part)
     }
 }
 
+void WallsComputation::generateInsetsFromOutline(SliceLayerPart* part)
+{
+    std::vector<int> distances;
+    distances.reserve(insetCount);
+    int distance = -line_width_0 / 2 - wall_0_inset;
+    distances.push_back(distance);
+    if (insetCount > 1)
+    {
+        distance += -line_width_0 / 2 + wall_0_inset - line_width_x / 2;
+        distances.push_back(distance);
+    }
+    for (int i = 2; i < insetCount; i++)
+    {
+        distance -= line_width_x;
+        distances.push_back(distance);
+    }
+    part->outline.offsetMulti(distances, part->insets);
+
+    for (unsigned int i = 0; i < part->insets.size(); i++)
+    {
+        //Finally optimize all the polygons. Every point removed saves time in the long run.
+        part->insets[i].simplify();
+        if (part->insets[i].size() < 1)
+        {
+            part->insets.resize(i);
+            break;
+        }
+    }
+    if (recompute_outline_based_on_outer_wall && part->insets.size() > 0)
+    {
+        part->insets[0].offset(line_width_0 / 2, part->print_outline);
+    }
+    else
+    {
+        part->print_outline = part->outline;
+    }
+}
+
 void WallsComputation::generateInsets(SliceLayer* layer)
 {
-    for(unsigned int partNr = 0; partNr < layer->parts.size(); partNr++)
+    ThreadPool::getInstance()->parallelFor(0, layer->parts.size(), [&](int partNr)
     {
         generateInsets(&layer->parts[partNr]);
-    }
+    });
     
     //Remove the parts which did not generate an inset. As these parts are too small to print,
     // and later code can now assume that there is always minimal 1 inset line.
@@ -33,6 +33,10 @@ public:
      * Whether to compute a more accurate poly representation of the printed outlines, based on the outer wall
      */
     bool recompute_outline_based_on_outer_wall;
+    /*!
+     * Whether to offset the outline once by the distance of each inset, instead of offsetting each inset from the previous one
+     */
+    bool insets_from_outline;
 
     /*!
      * Basic constructor initializing the parameters with which to perform the walls computation
@@ -42,8 +46,9 @@ public:
      * \param line_width_x line width of other walls
      * \param insetCount The number of insets to to generate
      * \param recompute_outline_based_on_outer_wall Whether to compute a more accurate poly representation of the printed outlines, based on the outer wall
+     * \param insets_from_outline Whether to offset the outline once by the distance of each inset, instead of offsetting each inset from the previous one
      */
-    WallsComputation(int wall_0_inset, int line_width_0, int line_width_x, int insetCount, bool recompute_outline_based_on_outer_wall);
+    WallsComputation(int wall_0_inset, int line_width_0, int line_width_x, int insetCount, bool recompute_outline_based_on_outer_wall, bool insets_from_outline);
 
     /*!
      * Generates the insets / perimeters for all parts in a layer.
@@ -63,6 +68,16 @@ private:
      */
     void generateInsets(SliceLayerPart* part);
 
+    /*!
+     * Generates the insets / perimeters for a single layer part with a single prepared offset of its outline.
+     * 
+     * The insets differ slightly from offsetting each inset from the previous one at sharp corners,
+     * where the mitered corners of consecutive offsets don't add up to the mitered corner of their summed offset.
+     * 
+     * \param part The part for which to generate the insets.
+     */
+    void generateInsetsFromOutline(SliceLayerPart* part);
+
 };
 }//namespace cura
 
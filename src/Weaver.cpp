@@ -5,6 +5,7 @@
 #include <unistd.h>
 
 #include "progress/Progress.h"
+#include "utils/ThreadPool.h"
 #include "weaveDataStorage.h"
 #include "PrintFeature.h"
 
@@ -25,7 +26,7 @@ void Weaver::weave(MeshGroup* meshgroup)
 
     for(Mesh& mesh : meshgroup->meshes)
     {
-        cura::Slicer* slicer = new cura::Slicer(&mesh, initial_layer_thickness, connectionHeight, layer_count, mesh.getSettingBoolean("meshfix_keep_open_polygons"), mesh.getSettingBoolean("meshfix_extensive_stitching"));
+        cura::Slicer* slicer = new cura::Slicer(&mesh, initial_layer_thickness, connectionHeight, layer_count, mesh.getSettingBoolean(SettingKey::meshfix_keep_open_polygons), mesh.getSettingBoolean(SettingKey::meshfix_extensive_stitching));
         slicerList.push_back(slicer);
     }
 
@@ -53,7 +54,10 @@ void Weaver::weave(MeshGroup* meshgroup)
         for (cura::Slicer* slicer : slicerList)
             wireFrame.bottom_outline.add(slicer->layers[starting_layer_idx].polygons);
         
-        CommandSocket::sendPolygons(PrintFeatureType::OuterWall, /*0,*/ wireFrame.bottom_outline, 1);
+        if (command_socket)
+        {
+            command_socket->sendPolygons(PrintFeatureType::OuterWall, /*0,*/ wireFrame.bottom_outline, 1);
+        }
         
         if (slicerList.empty()) //Wait, there is nothing to slice.
         {
@@ -70,10 +74,10 @@ void Weaver::weave(MeshGroup* meshgroup)
         else 
             starting_point_in_layer = (Point(0,0) + meshgroup->max() + meshgroup->min()) / 2;
         
-        Progress::messageProgressStage(Progress::Stage::INSET_SKIN, nullptr);
+        Progress::messageProgressStage(Progress::Stage::INSET_SKIN, nullptr, command_socket);
         for (int layer_idx = starting_layer_idx + 1; layer_idx < layer_count; layer_idx++)
         {
-            Progress::messageProgress(Progress::Stage::INSET_SKIN, layer_idx+1, layer_count); // abuse the progress system of the normal mode of CuraEngine
+            Progress::messageProgress(Progress::Stage::INSET_SKIN, layer_idx+1, layer_count, command_socket); // abuse the progress system of the normal mode of CuraEngine
             
             Polygons parts1;
             for (cura::Slicer* slicer : slicerList)
@@ -84,7 +88,10 @@ void Weaver::weave(MeshGroup* meshgroup)
 
             chainify_polygons(parts1, starting_point_in_layer, chainified, false);
             
-            CommandSocket::sendPolygons(PrintFeatureType::OuterWall, /*layer_idx - starting_layer_idx,*/ chainified, 1);
+            if (command_socket)
+            {
+                command_socket->sendPolygons(PrintFeatureType::OuterWall, /*layer_idx - starting_layer_idx,*/ chainified, 1);
+            }
 
             if (chainified.size() > 0)
             {
@@ -102,64 +109,88 @@ void Weaver::weave(MeshGroup* meshgroup)
         }
     }
     
-    std::cerr<< "finding horizontal parts..." << std::endl;
+    for (cura::Slicer* slicer : slicerList)
     {
-        Polygons* lower_top_parts = &wireFrame.bottom_outline;
-        
-        Progress::messageProgressStage(Progress::Stage::SUPPORT, nullptr);
-        for (unsigned int layer_idx = 0; layer_idx < wireFrame.layers.size(); layer_idx++)
+        delete slicer;
+    }
+    
+    { // bottom:
+        if (!wireFrame.layers.empty()) //If there are no layers, create no bottom.
+        {
+            Polygons to_be_supported; // is empty for the bottom layer, cause the order of insets doesn't really matter (in a sense everything is to be supported)
+            fillRoofs(wireFrame.bottom_outline, to_be_supported, -1, wireFrame.layers.front().z0, wireFrame.bottom_infill);
+        }
+    }
+}
+
+void Weaver::weaveLayers(unsigned int layer_begin, unsigned int layer_end)
+{
+    // at this point layer.supported still only contains the polygons to be connected for the layers from layer_begin onward
+    { // finding horizontal parts:
+        // the horizontal parts of a layer only depend on the chainified polygons of the layer itself and the layer above
+        ThreadPool::getInstance()->parallelFor(layer_begin, layer_end, [&](int layer_idx)
         {
-            Progress::messageProgress(Progress::Stage::SUPPORT, layer_idx+1, wireFrame.layers.size()); // abuse the progress system of the normal mode of CuraEngine
-            
             WeaveLayer& layer = wireFrame.layers[layer_idx];
             
+            Polygons& lower_top_parts = (layer_idx > 0)? wireFrame.layers[layer_idx - 1].supported : wireFrame.bottom_outline;
             Polygons empty;
-            Polygons& layer_above = (layer_idx+1 < wireFrame.layers.size())? wireFrame.layers[layer_idx+1].supported : empty;
+            Polygons& layer_above = (layer_idx + 1 < static_cast<int>(wireFrame.layers.size()))? wireFrame.layers[layer_idx + 1].supported : empty;
             
-            createHorizontalFill(*lower_top_parts, layer, layer_above, layer.z1);
-            lower_top_parts = &layer.supported;
-        }
+            createHorizontalFill(lower_top_parts, layer, layer_above, layer.z1);
+        });
     }
-    // at this point layer.supported still only contains the polygons to be connected
-    // when connecting layers, we further add the supporting polygons created by the roofs
     
-    std::cerr<< "connecting layers..." << std::endl;
-    {
-        Polygons* lower_top_parts = &wireFrame.bottom_outline;
-        int last_z = wireFrame.z_bottom;
-        for (unsigned int layer_idx = 0; layer_idx < wireFrame.layers.size(); layer_idx++) // use top of every layer but the last
+    { // connecting layers:
+        // a layer is connected to the polygons of the layer below including its roofs, which are only added to the layers of this range once all of them are connected
+        // the layer below the range already got its roofs added when its own range was woven
+        ThreadPool::getInstance()->parallelFor(layer_begin, layer_end, [&](int layer_idx)
+        {
+            WeaveLayer& layer = wireFrame.layers[layer_idx];
+            if (layer_idx == 0)
+            {
+                connect_polygons(wireFrame.bottom_outline, wireFrame.z_bottom, layer.supported, layer.z1, layer);
+            }
+            else if (layer_idx == static_cast<int>(layer_begin))
+            {
+                WeaveLayer& layer_below = wireFrame.layers[layer_idx - 1];
+                connect_polygons(layer_below.supported, layer_below.z1, layer.supported, layer.z1, layer);
+            }
+            else
+            {
+                WeaveLayer& layer_below = wireFrame.layers[layer_idx - 1];
+                Polygons lower_top_parts = layer_below.supported;
+                lower_top_parts.add(layer_below.roofs.roof_outlines);
+                connect_polygons(lower_top_parts, layer_below.z1, layer.supported, layer.z1, layer);
+            }
+        });
+        for (unsigned int layer_idx = layer_begin; layer_idx < layer_end; layer_idx++)
         {
             WeaveLayer& layer = wireFrame.layers[layer_idx];
-            
-            connect_polygons(*lower_top_parts, last_z, layer.supported, layer.z1, layer);
             layer.supported.add(layer.roofs.roof_outlines);
-            lower_top_parts = &layer.supported;
-            
-            last_z = layer.z1;
         }
     }
 
-
     { // roofs:
-        if (!wireFrame.layers.empty()) //If there are no layers, create no roof.
+        if (layer_end == wireFrame.layers.size() && layer_end > layer_begin)
         {
             WeaveLayer& top_layer = wireFrame.layers.back();
             Polygons to_be_supported; // empty for the top layer
             fillRoofs(top_layer.supported, to_be_supported, -1, top_layer.z1, top_layer.roofs);
         }
     }
-    
-    
-    { // bottom:
-        if (!wireFrame.layers.empty()) //If there are no layers, create no bottom.
-        {
-            Polygons to_be_supported; // is empty for the bottom layer, cause the order of insets doesn't really matter (in a sense everything is to be supported)
-            fillRoofs(wireFrame.bottom_outline, to_be_supported, -1, wireFrame.layers.front().z0, wireFrame.bottom_infill);
-        }
-    }
-    
 }
 
+void Weaver::releaseLayer(unsigned int layer_idx)
+{
+    WeaveLayer& layer = wireFrame.layers[layer_idx];
+    std::vector<WeaveConnectionPart>().swap(layer.connections);
+    std::vector<WeaveRoofPart>().swap(layer.roofs.roof_insets);
+    Polygons().swap(layer.roofs.roof_outlines);
+    if (layer_idx > 0)
+    { // the polygons of the layer below were only needed to connect this layer to
+        Polygons().swap(wireFrame.layers[layer_idx - 1].supported);
+    }
+}
 
 
 void Weaver::createHorizontalFill(Polygons& lower_top_parts, WeaveLayer& layer, Polygons& layer_above, int z1)
@@ -36,21 +36,24 @@ private:
     double nozzle_expansion_angle; 
     int nozzle_clearance; 
     int nozzle_top_diameter;
-   
+
+    CommandSocket* command_socket; //!< Where the progress and the layer view are sent to, or nullptr
     
 public:
-    Weaver(SettingsBase* settings_base) : SettingsMessenger(settings_base) 
+    Weaver(SettingsBase* settings_base, CommandSocket* command_socket)
+    : SettingsMessenger(settings_base)
+    , command_socket(command_socket)
     {
         
-        initial_layer_thickness = getSettingInMicrons("layer_height_0");
-        connectionHeight = getSettingInMicrons("wireframe_height"); 
+        initial_layer_thickness = getSettingInMicrons(SettingKey::layer_height_0);
+        connectionHeight = getSettingInMicrons(SettingKey::wireframe_height); 
         
-        line_width = getSettingInMicrons("wall_line_width_x");
+        line_width = getSettingInMicrons(SettingKey::wall_line_width_x);
         
-        roof_inset = getSettingInMicrons("wireframe_roof_inset"); 
-        nozzle_outer_diameter = getSettingInMicrons("machine_nozzle_tip_outer_diameter");      // ___       ___   .
-        nozzle_expansion_angle = getSettingInAngleRadians("machine_nozzle_expansion_angle");  //     \_U_/       .
-        nozzle_clearance = getSettingInMicrons("wireframe_nozzle_clearance");                // at least line width
+        roof_inset = getSettingInMicrons(SettingKey::wireframe_roof_inset); 
+        nozzle_outer_diameter = getSettingInMicrons(SettingKey::machine_nozzle_tip_outer_diameter);      // ___       ___   .
+        nozzle_expansion_angle = getSettingInAngleRadians(SettingKey::machine_nozzle_expansion_angle);  //     \_U_/       .
+        nozzle_clearance = getSettingInMicrons(SettingKey::wireframe_nozzle_clearance);                // at least line width
         nozzle_top_diameter = tan(nozzle_expansion_angle) * connectionHeight + nozzle_outer_diameter + nozzle_clearance;
     }
 
@@ -58,9 +61,30 @@ public:
      * This is the main function for Neith / Weaving / WirePrinting / Webbed printing.
      * Creates a wireframe for the model consisting of horizontal 'flat' parts and connections between consecutive flat parts consisting of UP moves and diagonally DOWN moves.
      * 
+     * This only computes the outlines of the layers and the bottom;
+     * the horizontal parts and connections of the layers are computed by Weaver::weaveLayers while the gcode is written.
+     * 
      * \param objects The objects for which to create a wireframe print
      */
     void weave(MeshGroup* objects);
+
+    /*!
+     * Compute the horizontal parts and the connections of a range of layers in parallel, and the roofs of the top layer when the range ends there.
+     * 
+     * The ranges have to be woven in order, since a layer is connected to the roofs of the layer below.
+     * 
+     * \param layer_begin The first layer of the range
+     * \param layer_end The layer after the last layer of the range
+     */
+    void weaveLayers(unsigned int layer_begin, unsigned int layer_end);
+
+    /*!
+     * Free the connections and horizontal parts of a layer of which the gcode has been written,
+     * together with the outlines of the layer below, to which no more layers have to be connected.
+     * 
+     * \param layer_idx The layer to release
+     */
+    void releaseLayer(unsigned int layer_idx);
     
 
 private:
@@ -1,5 +1,6 @@
 #include "Wireframe2gcode.h"
 
+#include <algorithm> // min
 #include <cmath> // sqrt
 #include <fstream> // debug IO
 
@@ -8,6 +9,8 @@
 #include "progress/Progress.h"
 
 #include "pathOrderOptimizer.h" //For skirt/brim.
+#include "utils/memoryRelease.h"
+#include "utils/ThreadPool.h"
 
 namespace cura 
 {
@@ -18,10 +21,10 @@ void Wireframe2gcode::writeGCode()
 
     gcode.preSetup(wireFrame.meshgroup);
     
-    gcode.setInitialTemps(wireFrame.meshgroup);
+    gcode.setInitialTemps(*wireFrame.meshgroup);
     
-    if (CommandSocket::getInstance())
-        CommandSocket::getInstance()->beginGCode();
+    if (gcode.getCommandSocket())
+        gcode.getCommandSocket()->beginGCode();
     
     processStartingCode();
     
@@ -79,18 +82,26 @@ void Wireframe2gcode::writeGCode()
                         gcode.writeMove(segment.to, speedBottom, extrusion_per_mm_flat); 
                 }
             );
-    Progress::messageProgressStage(Progress::Stage::EXPORT, nullptr);
+    Progress::messageProgressStage(Progress::Stage::EXPORT, nullptr, gcode.getCommandSocket());
+    // the layers are woven in batches just ahead of writing them, and released once written, so that only a few layers are kept in memory at once
+    const unsigned int weave_batch_size = ThreadPool::getInstance()->getThreadCount() * 4; // enough layers to keep all threads busy
+    unsigned int woven_end = 0; // the layers below this one have been woven
     for (unsigned int layer_nr = 0; layer_nr < wireFrame.layers.size(); layer_nr++)
     {
-        Progress::messageProgress(Progress::Stage::EXPORT, layer_nr+1, total_layers); // abuse the progress system of the normal mode of CuraEngine
+        if (layer_nr == woven_end)
+        {
+            woven_end = std::min(static_cast<unsigned int>(wireFrame.layers.size()), layer_nr + weave_batch_size);
+            weaver.weaveLayers(layer_nr, woven_end);
+        }
+        Progress::messageProgress(Progress::Stage::EXPORT, layer_nr+1, total_layers, gcode.getCommandSocket()); // abuse the progress system of the normal mode of CuraEngine
         
         WeaveLayer& layer = wireFrame.layers[layer_nr];
         
         gcode.writeLayerComment(layer_nr+1);
         
-        double fanSpeed = getSettingInPercentage("cool_fan_speed_max");
+        double fanSpeed = getSettingInPercentage(SettingKey::cool_fan_speed_max);
         if (layer_nr == 0)
-            fanSpeed = getSettingInPercentage("cool_fan_speed_min");
+            fanSpeed = getSettingInPercentage(SettingKey::cool_fan_speed_min);
         gcode.writeFanCommand(fanSpeed);
         
         for (unsigned int part_nr = 0; part_nr < layer.connections.size(); part_nr++)
@@ -153,8 +164,11 @@ void Wireframe2gcode::writeGCode()
                     }
                 });
         
-     
-        
+        weaver.releaseLayer(layer_nr);
+        if ((layer_nr + 1) % weave_batch_size == 0)
+        { // the released layers are spread over memory which is still in use, so it's only given back once in a while
+            releaseFreedMemory();
+        }
     }
     
     gcode.setZ(maxObjectHeight);
@@ -236,14 +250,14 @@ void Wireframe2gcode::strategy_retract(WeaveLayer& layer, WeaveConnectionPart& p
     
     RetractionConfig retraction_config;
     // TODO: get these from the settings!
-    retraction_config.distance = 500; //INT2MM(getSettingInt("retraction_amount"))
+    retraction_config.distance = 500; //INT2MM(getSettingInt(SettingKey::retraction_amount))
     retraction_config.prime_volume = 0;//INT2MM(getSettingInt("retractionPrime
     retraction_config.speed = 20; // 40;
     retraction_config.primeSpeed = 15; // 30;
-    retraction_config.zHop = 0; //getSettingInt("retraction_hop");
-    retraction_config.retraction_count_max = getSettingAsCount("retraction_count_max");
-    retraction_config.retraction_extrusion_window = getSettingInMillimeters("retraction_extrusion_window");
-    retraction_config.retraction_min_travel_distance = getSettingInMicrons("retraction_min_travel");
+    retraction_config.zHop = 0; //getSettingInt(SettingKey::retraction_hop);
+    retraction_config.retraction_count_max = getSettingAsCount(SettingKey::retraction_count_max);
+    retraction_config.retraction_extrusion_window = getSettingInMillimeters(SettingKey::retraction_extrusion_window);
+    retraction_config.retraction_min_travel_distance = getSettingInMicrons(SettingKey::retraction_min_travel);
 
     double top_retract_pause = 2.0;
     int retract_hop_dist = 1000;
@@ -481,109 +495,110 @@ void Wireframe2gcode::writeMoveWithRetract(Point to)
 Wireframe2gcode::Wireframe2gcode(Weaver& weaver, GCodeExport& gcode, SettingsBase* settings_base) 
 : SettingsMessenger(settings_base) 
 , gcode(gcode)
+, weaver(weaver)
 , wireFrame(weaver.wireFrame)
 {
-    initial_layer_thickness = getSettingInMicrons("layer_height_0");
-    connectionHeight = getSettingInMicrons("wireframe_height"); 
-    roof_inset = getSettingInMicrons("wireframe_roof_inset"); 
+    initial_layer_thickness = getSettingInMicrons(SettingKey::layer_height_0);
+    connectionHeight = getSettingInMicrons(SettingKey::wireframe_height); 
+    roof_inset = getSettingInMicrons(SettingKey::wireframe_roof_inset); 
     
-    filament_diameter = getSettingInMicrons("material_diameter");
-    line_width = getSettingInMicrons("wall_line_width_x");
+    filament_diameter = getSettingInMicrons(SettingKey::material_diameter);
+    line_width = getSettingInMicrons(SettingKey::wall_line_width_x);
     
-    flowConnection = getSettingInPercentage("wireframe_flow_connection");
-    flowFlat = getSettingInPercentage("wireframe_flow_flat");
+    flowConnection = getSettingInPercentage(SettingKey::wireframe_flow_connection);
+    flowFlat = getSettingInPercentage(SettingKey::wireframe_flow_flat);
     
     const double filament_area = /* M_PI * */ (INT2MM(filament_diameter) / 2.0) * (INT2MM(filament_diameter) / 2.0);
     const double lineArea = /* M_PI * */ (INT2MM(line_width) / 2.0) * (INT2MM(line_width) / 2.0);
     extrusion_per_mm_connection = lineArea / filament_area * flowConnection / 100.0;
     extrusion_per_mm_flat = lineArea / filament_area * flowFlat / 100.0;
     
-    nozzle_outer_diameter = getSettingInMicrons("machine_nozzle_tip_outer_diameter"); // ___       ___   .
-    nozzle_head_distance = getSettingInMicrons("machine_nozzle_head_distance");      //    |     |      .
-    nozzle_expansion_angle = getSettingInAngleRadians("machine_nozzle_expansion_angle");  //     \_U_/       .
-    nozzle_clearance = getSettingInMicrons("wireframe_nozzle_clearance");    // at least line width
+    nozzle_outer_diameter = getSettingInMicrons(SettingKey::machine_nozzle_tip_outer_diameter); // ___       ___   .
+    nozzle_head_distance = getSettingInMicrons(SettingKey::machine_nozzle_head_distance);      //    |     |      .
+    nozzle_expansion_angle = getSettingInAngleRadians(SettingKey::machine_nozzle_expansion_angle);  //     \_U_/       .
+    nozzle_clearance = getSettingInMicrons(SettingKey::wireframe_nozzle_clearance);    // at least line width
     nozzle_top_diameter = tan(nozzle_expansion_angle) * connectionHeight + nozzle_outer_diameter + nozzle_clearance;
     
     moveSpeed = 40;
-    speedBottom =  getSettingInMillimetersPerSecond("wireframe_printspeed_bottom");
-    speedUp = getSettingInMillimetersPerSecond("wireframe_printspeed_up");
-    speedDown = getSettingInMillimetersPerSecond("wireframe_printspeed_down");
-    speedFlat = getSettingInMillimetersPerSecond("wireframe_printspeed_flat");
+    speedBottom =  getSettingInMillimetersPerSecond(SettingKey::wireframe_printspeed_bottom);
+    speedUp = getSettingInMillimetersPerSecond(SettingKey::wireframe_printspeed_up);
+    speedDown = getSettingInMillimetersPerSecond(SettingKey::wireframe_printspeed_down);
+    speedFlat = getSettingInMillimetersPerSecond(SettingKey::wireframe_printspeed_flat);
 
-    flat_delay = getSettingInSeconds("wireframe_flat_delay");
-    bottom_delay = getSettingInSeconds("wireframe_bottom_delay");
-    top_delay = getSettingInSeconds("wireframe_top_delay");
+    flat_delay = getSettingInSeconds(SettingKey::wireframe_flat_delay);
+    bottom_delay = getSettingInSeconds(SettingKey::wireframe_bottom_delay);
+    top_delay = getSettingInSeconds(SettingKey::wireframe_top_delay);
     
-    up_dist_half_speed = getSettingInMicrons("wireframe_up_half_speed");
+    up_dist_half_speed = getSettingInMicrons(SettingKey::wireframe_up_half_speed);
     
-    top_jump_dist = getSettingInMicrons("wireframe_top_jump");
+    top_jump_dist = getSettingInMicrons(SettingKey::wireframe_top_jump);
     
-    fall_down = getSettingInMicrons("wireframe_fall_down");
-    drag_along = getSettingInMicrons("wireframe_drag_along");
+    fall_down = getSettingInMicrons(SettingKey::wireframe_fall_down);
+    drag_along = getSettingInMicrons(SettingKey::wireframe_drag_along);
     
     strategy = STRATEGY_COMPENSATE;
-    if (getSettingString("wireframe_strategy") == "Compensate")
+    if (getSettingString(SettingKey::wireframe_strategy) == "Compensate")
         strategy = STRATEGY_COMPENSATE;
-    if (getSettingString("wireframe_strategy") == "Knot")
+    if (getSettingString(SettingKey::wireframe_strategy) == "Knot")
         strategy = STRATEGY_KNOT;
-    if (getSettingString("wireframe_strategy") == "Retract")
+    if (getSettingString(SettingKey::wireframe_strategy) == "Retract")
         strategy = STRATEGY_RETRACT;
     
     go_back_to_last_top = false;
-    straight_first_when_going_down = getSettingInPercentage("wireframe_straight_before_down");
+    straight_first_when_going_down = getSettingInPercentage(SettingKey::wireframe_straight_before_down);
     
-    roof_fall_down = getSettingInMicrons("wireframe_roof_fall_down");
-    roof_drag_along = getSettingInMicrons("wireframe_roof_drag_along");
-    roof_outer_delay = getSettingInSeconds("wireframe_roof_outer_delay");
+    roof_fall_down = getSettingInMicrons(SettingKey::wireframe_roof_fall_down);
+    roof_drag_along = getSettingInMicrons(SettingKey::wireframe_roof_drag_along);
+    roof_outer_delay = getSettingInSeconds(SettingKey::wireframe_roof_outer_delay);
     
     
-    standard_retraction_config.distance = getSettingInMillimeters("retraction_amount");
-    standard_retraction_config.prime_volume = getSettingInCubicMillimeters("retraction_extra_prime_amount");
-    standard_retraction_config.speed = getSettingInMillimetersPerSecond("retraction_retract_speed");
-    standard_retraction_config.primeSpeed = getSettingInMillimetersPerSecond("retraction_prime_speed");
-    standard_retraction_config.zHop = getSettingInMicrons("retraction_hop");
-    standard_retraction_config.retraction_count_max = getSettingAsCount("retraction_count_max");
-    standard_retraction_config.retraction_extrusion_window = getSettingInMillimeters("retraction_extrusion_window");
-    standard_retraction_config.retraction_min_travel_distance = getSettingInMicrons("retraction_min_travel");
+    standard_retraction_config.distance = getSettingInMillimeters(SettingKey::retraction_amount);
+    standard_retraction_config.prime_volume = getSettingInCubicMillimeters(SettingKey::retraction_extra_prime_amount);
+    standard_retraction_config.speed = getSettingInMillimetersPerSecond(SettingKey::retraction_retract_speed);
+    standard_retraction_config.primeSpeed = getSettingInMillimetersPerSecond(SettingKey::retraction_prime_speed);
+    standard_retraction_config.zHop = getSettingInMicrons(SettingKey::retraction_hop);
+    standard_retraction_config.retraction_count_max = getSettingAsCount(SettingKey::retraction_count_max);
+    standard_retraction_config.retraction_extrusion_window = getSettingInMillimeters(SettingKey::retraction_extrusion_window);
+    standard_retraction_config.retraction_min_travel_distance = getSettingInMicrons(SettingKey::retraction_min_travel);
 }
 
 void Wireframe2gcode::processStartingCode()
 {
-    if (!CommandSocket::isInstantiated())
+    if (!gcode.getCommandSocket())
     {
         gcode.writeCode(gcode.getFileHeader().c_str());
     }
     else 
     {
-        if (getSettingBoolean("material_bed_temp_prepend"))
+        if (getSettingBoolean(SettingKey::material_bed_temp_prepend))
         {
-            if (getSettingBoolean("machine_heated_bed") && getSettingInDegreeCelsius("material_bed_temperature") > 0)
+            if (getSettingBoolean(SettingKey::machine_heated_bed) && getSettingInDegreeCelsius(SettingKey::material_bed_temperature) > 0)
             {
-                gcode.writeBedTemperatureCommand(getSettingInDegreeCelsius("material_bed_temperature"), getSettingBoolean("material_bed_temp_wait"));
+                gcode.writeBedTemperatureCommand(getSettingInDegreeCelsius(SettingKey::material_bed_temperature), getSettingBoolean(SettingKey::material_bed_temp_wait));
             }
         }
         
-        if (getSettingBoolean("material_print_temp_prepend"))
+        if (getSettingBoolean(SettingKey::material_print_temp_prepend))
         {
-            if (getSettingInDegreeCelsius("material_print_temperature") > 0)
+            if (getSettingInDegreeCelsius(SettingKey::material_print_temperature) > 0)
             {
-                gcode.writeTemperatureCommand(getSettingAsIndex("extruder_nr"), getSettingInDegreeCelsius("material_print_temperature"));
-                if (getSettingBoolean("machine_print_temp_wait"))
+                gcode.writeTemperatureCommand(getSettingAsIndex(SettingKey::extruder_nr), getSettingInDegreeCelsius(SettingKey::material_print_temperature));
+                if (getSettingBoolean(SettingKey::machine_print_temp_wait))
                 {
-                    gcode.writeTemperatureCommand(getSettingAsIndex("extruder_nr"), getSettingInDegreeCelsius("material_print_temperature"), true);
+                    gcode.writeTemperatureCommand(getSettingAsIndex(SettingKey::extruder_nr), getSettingInDegreeCelsius(SettingKey::material_print_temperature), true);
                 }
             }
         }
         
     }
-    gcode.writeCode(getSettingString("machine_start_gcode").c_str());
+    gcode.writeCode(getSettingString(SettingKey::machine_start_gcode).c_str());
     
     gcode.writeComment("Generated with Cura_SteamEngine " VERSION);
     if (gcode.getFlavor() == EGCodeFlavor::BFB)
     {
         gcode.writeComment("enable auto-retraction");
         std::ostringstream tmp;
-        tmp << "M227 S" << (getSettingInMicrons("retraction_amount") * 2560 / 1000) << " P" << (getSettingInMicrons("retraction_amount") * 2560 / 1000);
+        tmp << "M227 S" << (getSettingInMicrons(SettingKey::retraction_amount) * 2560 / 1000) << " P" << (getSettingInMicrons(SettingKey::retraction_amount) * 2560 / 1000);
         gcode.writeLine(tmp.str().c_str());
     }
 }
@@ -604,11 +619,11 @@ void Wireframe2gcode::processSkirt()
     {
         unsigned int poly_idx = order.polyOrder[poly_order_idx];
         PolygonRef poly = skirt[poly_idx];
-        gcode.writeMove(poly[order.polyStart[poly_idx]], getSettingInMillimetersPerSecond("speed_travel"), 0);
+        gcode.writeMove(poly[order.polyStart[poly_idx]], getSettingInMillimetersPerSecond(SettingKey::speed_travel), 0);
         for (unsigned int point_idx = 0; point_idx < poly.size(); point_idx++)
         {
             Point& p = poly[(point_idx + order.polyStart[poly_idx] + 1) % poly.size()];
-            gcode.writeMove(p, getSettingInMillimetersPerSecond("skirt_brim_speed"), getSettingInMillimetersPerSecond("skirt_brim_line_width"));
+            gcode.writeMove(p, getSettingInMillimetersPerSecond(SettingKey::skirt_brim_speed), getSettingInMillimetersPerSecond(SettingKey::skirt_brim_line_width));
         }
     }
 }
@@ -616,8 +631,8 @@ void Wireframe2gcode::processSkirt()
 
 void Wireframe2gcode::finalize()
 {
-    gcode.finalize(getSettingString("machine_end_gcode").c_str());
-    for(int e=0; e<getSettingAsCount("machine_extruder_count"); e++)
+    gcode.finalize(getSettingString(SettingKey::machine_end_gcode).c_str());
+    for(int e=0; e<getSettingAsCount(SettingKey::machine_extruder_count); e++)
         gcode.writeTemperatureCommand(e, 0, false);
 }
 }//namespace cura    
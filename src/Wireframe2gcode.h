@@ -73,6 +73,7 @@ public:
 
 
 private:
+    Weaver& weaver; //!< The weaver which computes the layers of the wireframe while their gcode is written
     WireFrame& wireFrame;
     
     /*!
@@ -0,0 +1,240 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "cura_engine.h"
+
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <vector>
+
+#include "../FffProcessor.h"
+#include "../MeshGroup.h"
+#include "../settings/SettingRegistry.h"
+#include "../utils/logoutput.h"
+
+namespace cura
+{
+
+namespace
+{
+
+/*!
+ * Slices share the thread pool, the setting registry, the settings caches and the polygon tiling of the process, none of which are thread safe.
+ * This is held while a slice runs and while anything which reads or changes that state is called, so only one slice uses it at a time.
+ */
+std::mutex process_mutex;
+
+/*!
+ * A stream buffer which passes the gcode to the output callback of a slice in blocks.
+ */
+class CallbackStreamBuffer : public std::streambuf
+{
+public:
+    CallbackStreamBuffer(CuraOutputCallback output, void* user_data)
+    : output(output)
+    , user_data(user_data)
+    , buffer(1 << 16)
+    {
+        setp(buffer.data(), buffer.data() + buffer.size());
+    }
+
+protected:
+    int_type overflow(int_type c) override
+    {
+        flush();
+        if (!traits_type::eq_int_type(c, traits_type::eof()))
+        {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    int sync() override
+    {
+        flush();
+        return 0;
+    }
+
+private:
+    CuraOutputCallback output;
+    void* user_data;
+    std::vector<char> buffer;
+
+    void flush()
+    {
+        if (pptr() > pbase())
+        {
+            output(pbase(), pptr() - pbase(), user_data);
+        }
+        setp(buffer.data(), buffer.data() + buffer.size());
+    }
+};
+
+}
+
+}//namespace cura
+
+using namespace cura;
+
+struct CuraSlice
+{
+    FffProcessor processor;
+    MeshGroup meshgroup;
+    std::ostream discarded_output; //!< Where the processor writes after the slice has run, when the output callback may no longer be called
+    bool has_run;
+
+    CuraSlice()
+    : meshgroup(&processor)
+    , discarded_output(nullptr)
+    , has_run(false)
+    {
+        meshgroup.createExtruderTrain(0);
+    }
+};
+
+CuraSlice* cura_slice_create(void)
+{
+    std::lock_guard<std::mutex> lock(process_mutex);
+    try
+    {
+        return new CuraSlice();
+    }
+    catch (...)
+    {
+        return nullptr;
+    }
+}
+
+void cura_slice_destroy(CuraSlice* slice)
+{
+    std::lock_guard<std::mutex> lock(process_mutex);
+    delete slice;
+}
+
+int cura_slice_load_definitions(CuraSlice* slice, const char* json, size_t size)
+{
+    std::lock_guard<std::mutex> lock(process_mutex);
+    return SettingRegistry::getInstance()->loadJSONsettingsFromMemory(json, size, &slice->processor);
+}
+
+int cura_slice_set_setting(CuraSlice* slice, int extruder_nr, const char* key, const char* value)
+{
+    std::lock_guard<std::mutex> lock(process_mutex);
+    if (extruder_nr >= MAX_EXTRUDERS)
+    {
+        return -1;
+    }
+    SettingsBase* settings = extruder_nr < 0 ? static_cast<SettingsBase*>(&slice->processor) : slice->meshgroup.createExtruderTrain(extruder_nr);
+    settings->setSetting(key, value);
+    return 0;
+}
+
+int cura_slice_add_mesh(CuraSlice* slice, const float* vertices, size_t vertex_count, const uint32_t* indices, size_t index_count, int extruder_nr)
+{
+    std::lock_guard<std::mutex> lock(process_mutex);
+    if (extruder_nr < 0 || extruder_nr >= MAX_EXTRUDERS || (indices ? index_count : vertex_count) % 3 != 0)
+    {
+        return -1;
+    }
+    const FMatrix3x3 transformation; // from millimeters to microns
+    std::vector<Point3> points(vertex_count);
+    for (size_t vertex_idx = 0; vertex_idx < vertex_count; vertex_idx++)
+    {
+        const float* vertex = vertices + vertex_idx * 3;
+        points[vertex_idx] = transformation.apply(FPoint3(vertex[0], vertex[1], vertex[2]));
+    }
+    slice->meshgroup.meshes.emplace_back(slice->meshgroup.createExtruderTrain(extruder_nr));
+    Mesh& mesh = slice->meshgroup.meshes.back();
+    if (indices)
+    {
+        for (size_t index_idx = 0; index_idx < index_count; index_idx++)
+        {
+            if (indices[index_idx] >= vertex_count)
+            {
+                slice->meshgroup.meshes.pop_back();
+                return -1;
+            }
+        }
+        mesh.addIndexedFaces(points, std::vector<uint32_t>(indices, indices + index_count));
+    }
+    else
+    {
+        mesh.addFaces(points);
+    }
+    mesh.finish();
+    return slice->meshgroup.meshes.size() - 1;
+}
+
+int cura_slice_set_mesh_setting(CuraSlice* slice, int mesh_idx, const char* key, const char* value)
+{
+    std::lock_guard<std::mutex> lock(process_mutex);
+    if (mesh_idx < 0 || static_cast<size_t>(mesh_idx) >= slice->meshgroup.meshes.size())
+    {
+        return -1;
+    }
+    slice->meshgroup.meshes[mesh_idx].setSetting(key, value);
+    return 0;
+}
+
+int cura_slice_run(CuraSlice* slice, CuraOutputCallback output, void* user_data)
+{
+    if (slice->has_run)
+    {
+        return -1;
+    }
+    slice->has_run = true;
+
+    std::lock_guard<std::mutex> lock(process_mutex);
+    FffProcessor& processor = slice->processor;
+    MeshGroup& meshgroup = slice->meshgroup;
+    for (int extruder_nr = 0; extruder_nr < processor.getSettingAsCount(SettingKey::machine_extruder_count); extruder_nr++)
+    { // load the defaults of the extruder trains
+        ExtruderTrain* train = meshgroup.createExtruderTrain(extruder_nr);
+        SettingRegistry::getInstance()->loadExtruderJSONsettings(extruder_nr, train);
+    }
+
+    CallbackStreamBuffer buffer(output, user_data);
+    std::ostream stream(&buffer);
+    processor.setTargetStream(&stream);
+    processor.time_keeper.restart();
+    bool success;
+    try
+    {
+        meshgroup.finalize();
+        success = processor.processMeshGroup(&meshgroup);
+        processor.finalize();
+    }
+    catch (...)
+    {
+        logError("Unknown exception\n");
+        success = false;
+    }
+    stream.flush();
+    processor.setTargetStream(&slice->discarded_output);
+    if (processor.isCancelled())
+    {
+        return 1;
+    }
+    return success ? 0 : 2;
+}
+
+void cura_slice_cancel(CuraSlice* slice)
+{
+    slice->processor.cancel();
+}
+
+double cura_slice_get_print_time(CuraSlice* slice)
+{
+    std::lock_guard<std::mutex> lock(process_mutex);
+    return slice->processor.getTotalPrintTime();
+}
+
+double cura_slice_get_material_volume(CuraSlice* slice, int extruder_nr)
+{
+    std::lock_guard<std::mutex> lock(process_mutex);
+    if (extruder_nr < 0 || extruder_nr >= slice->processor.getSettingAsCount(SettingKey::machine_extruder_count))
+    {
+        return 0.0;
+    }
+    return slice->processor.getTotalFilamentUsed(extruder_nr);
+}
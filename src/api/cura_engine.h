@@ -0,0 +1,108 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef CURA_ENGINE_API_H
+#define CURA_ENGINE_API_H
+
+/*
+ * Slicing in the process of the caller, by linking the _CuraEngine library, instead of running CuraEngine for every job.
+ *
+ * A slice is a single job: its settings, its meshes and its gcode. Create it, load the setting definitions and set the settings,
+ * add the meshes, run it once and read the estimates, then destroy it.
+ * The gcode is passed to a callback while it's written, so nothing is written to files.
+ *
+ * Several slices may exist at the same time and be used from different threads, but only one slice runs at a time:
+ * the thread pool, the registry of setting definitions, the caches of settings and the log output belong to the process.
+ * All calls except cura_slice_cancel wait until a slice which is running on another thread has finished.
+ * Settings are registered as definitions are loaded, so all slices should load the same definitions,
+ * or at least definitions which agree on the settings they both have.
+ *
+ * Units are those of the command line: millimeters for coordinates and lengths, and the units of the definitions for settings.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct CuraSlice CuraSlice;
+
+/*
+ * Receives a piece of the gcode. The data is only valid during the call.
+ */
+typedef void (*CuraOutputCallback)(const char* data, size_t size, void* user_data);
+
+/*
+ * Create an empty slice without any settings. Returns NULL if it couldn't be created.
+ */
+CuraSlice* cura_slice_create(void);
+
+/*
+ * Destroy a slice which isn't running.
+ */
+void cura_slice_destroy(CuraSlice* slice);
+
+/*
+ * Load setting definitions and their defaults from a .def.json document in memory, like the -j argument of the command line.
+ * The definitions it inherits from are loaded from the files in the search paths (the CURA_ENGINE_SEARCH_PATH environment variable
+ * and the folders of files loaded before).
+ * For a document with "machine_extruder_trains", the definitions of the extruder trains are loaded when the slice is run.
+ *
+ * Returns 0 on success.
+ */
+int cura_slice_load_definitions(CuraSlice* slice, const char* json, size_t size);
+
+/*
+ * Set a setting of the whole slice, or of a single extruder train for extruder_nr >= 0.
+ *
+ * Returns 0 on success.
+ */
+int cura_slice_set_setting(CuraSlice* slice, int extruder_nr, const char* key, const char* value);
+
+/*
+ * Add a mesh to be printed with the given extruder train.
+ *
+ * vertices holds three floats per vertex: x, y and z in millimeters.
+ * indices holds three indices into vertices per face. When indices is NULL, every three consecutive vertices form a face.
+ * The mesh is copied, so the caller keeps owning the buffers and may reuse them right away.
+ *
+ * Returns the index of the mesh for cura_slice_set_mesh_setting, or -1 on failure.
+ */
+int cura_slice_add_mesh(CuraSlice* slice, const float* vertices, size_t vertex_count, const uint32_t* indices, size_t index_count, int extruder_nr);
+
+/*
+ * Set a setting of a single mesh, e.g. infill_mesh.
+ *
+ * Returns 0 on success.
+ */
+int cura_slice_set_mesh_setting(CuraSlice* slice, int mesh_idx, const char* key, const char* value);
+
+/*
+ * Slice the meshes and write the gcode to the callback, on the calling thread. A slice can only be run once.
+ * When another slice is running, this waits until it has finished.
+ * The estimates are only written to the gcode header when the gcode is complete, so the header sent to the callback has placeholders.
+ *
+ * Returns 0 on success, 1 when the slice was cancelled and another value when it failed.
+ */
+int cura_slice_run(CuraSlice* slice, CuraOutputCallback output, void* user_data);
+
+/*
+ * Stop a running slice as soon as possible, from any thread. cura_slice_run then returns 1.
+ */
+void cura_slice_cancel(CuraSlice* slice);
+
+/*
+ * The estimated print time of a slice which has been run, in seconds.
+ */
+double cura_slice_get_print_time(CuraSlice* slice);
+
+/*
+ * The estimated material use of an extruder train of a slice which has been run, in cubic millimeters.
+ */
+double cura_slice_get_material_volume(CuraSlice* slice, int extruder_nr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif//CURA_ENGINE_API_H
@@ -1,22 +1,42 @@
 /** Copyright (C) 2013 David Braam - Released under terms of the AGPLv3 License */
 #include "bridge.h"
 
+#include <vector>
+
 #include "sliceDataStorage.h"
 
 namespace cura {
 
-int bridgeAngle(Polygons outline, SliceLayer* prevLayer)
+namespace
+{
+
+thread_local std::vector<unsigned int> prev_part_indices; // the parts of the previous layer under the skin part being checked, reused by the next check on this thread
+
+}//namespace
+
+int bridgeAngle(const Polygons& outline, const SliceLayer* prevLayer)
 {
     AABB boundaryBox(outline);
     //To detect if we have a bridge, first calculate the intersection of the current layer with the previous layer.
     // This gives us the islands that the layer rests on.
+    prevLayer->findPartsHitting(boundaryBox, prev_part_indices);
+    if (prev_part_indices.empty())
+    {
+        return -1;
+    }
     Polygons islands;
-    for(auto prevLayerPart : prevLayer->parts)
+    if (prev_part_indices.size() == 1)
     {
-        if (!boundaryBox.hit(prevLayerPart.boundaryBox))
-            continue;
-        
-        islands.add(outline.intersection(prevLayerPart.outline));
+        islands = outline.intersection(prevLayer->parts[prev_part_indices[0]].outline);
+    }
+    else
+    { // the parts of a layer don't overlap, so they can be intersected with the outline all at once
+        Polygons prev_outlines;
+        for (unsigned int prev_part_idx : prev_part_indices)
+        {
+            prev_outlines.add(prevLayer->parts[prev_part_idx].outline);
+        }
+        islands = outline.intersection(prev_outlines);
     }
     if (islands.size() > 5 || islands.size() < 1)
         return -1;
@@ -1,10 +1,25 @@
+#include "utils/linearAlg2D.h"
 #include "utils/logoutput.h"
+#include "utils/OutputBuffer.h"
+#include "utils/SharedMemoryRing.h"
+#include "utils/ThreadPool.h"
 #include "commandSocket.h"
 #include "FffProcessor.h"
 #include "progress/Progress.h"
-
+#include "progress/ProfilingReport.h"
+
+#include <algorithm> // max
+#include <atomic>
+#include <chrono>
+#include <cmath> // abs
+#include <condition_variable>
+#include <cstring> // memcpy
+#include <mutex>
 #include <thread>
 #include <cinttypes>
+#include <climits> // INT_MAX
+#include <deque>
+#include <map>
 
 #ifdef ARCUS
 #include <Arcus/Socket.h>
@@ -16,6 +31,8 @@
 
 #ifdef _WIN32
 #include <windows.h>
+#else
+#include <unistd.h> // getpid
 #endif
 
 #include "settings/SettingRegistry.h" // loadExtruderJSONsettings
@@ -36,12 +53,30 @@ CommandSocket* CommandSocket::instance = nullptr; // instantiate instance
 class Listener : public Arcus::SocketListener
 {
 public:
+    /*!
+     * \param processor The processor to cancel when a message is received while it's slicing
+     */
+    Listener(FffProcessor* processor)
+    : processor(processor)
+    , event_count(0)
+    {
+    }
+
     void stateChanged(Arcus::SocketState::SocketState newState) override
     {
+        notifyEvent();
     }
 
+    /*!
+     * The front end only sends a message while slicing to replace the slice with a new one,
+     * so the running slice is stopped right away rather than finished for nothing.
+     * 
+     * This is called on the thread of the socket; the processor stops at its next layer.
+     */
     void messageReceived() override
     {
+        processor->cancel();
+        notifyEvent();
     }
 
     void error(const Arcus::Error & error) override
@@ -55,10 +90,125 @@ public:
             logError("%s\n", error.toString().c_str());
         }
     }
+
+    /*!
+     * Block until a message has been received or the state of the socket has changed since the last call,
+     * so that the engine uses no processor time while it waits for the front end.
+     * 
+     * A message is queued before its notification, so a message which isn't in the queue yet when the caller last looked
+     * wakes the caller up, rather than waiting for the next message.
+     */
+    void waitForEvent()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [this]() { return event_count > 0; });
+        event_count = 0;
+    }
+
+private:
+    FffProcessor* processor; //!< The processor to cancel when a message is received
+    std::mutex mutex; //!< Guards Listener::event_count
+    std::condition_variable condition; //!< Notified when Listener::event_count is increased
+    unsigned int event_count; //!< The number of messages received and state changes since the last Listener::waitForEvent
+
+    /*!
+     * Wake up the thread waiting in Listener::waitForEvent. Called on the thread of the socket.
+     */
+    void notifyEvent()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            event_count++;
+        }
+        condition.notify_all();
+    }
+};
+
+/*!
+ * Sends the messages with bulk data, the layer view and the gcode, through a SharedMemoryRing when the front end asked for one,
+ * so that their serialized form is written once into memory the front end reads directly, rather than copied through the socket.
+ *
+ * For each such message a small SharedMemoryBlock message is sent through the socket, so all messages still arrive in order.
+ * A message which doesn't fit in the space which the front end has released is sent through the socket instead,
+ * so the engine never waits for the front end.
+ */
+class BulkSender
+{
+public:
+    BulkSender()
+    : socket(nullptr)
+    , ring_count(0)
+    { }
+
+    Arcus::Socket* socket; //!< The socket through which the control messages are sent
+
+    /*!
+     * Create a ring of the size asked for by the front end and announce it, unless the current ring already has that size.
+     *
+     * \param size The size of the buffer of the ring in bytes, or zero to send everything through the socket
+     */
+    void setRingSize(int64_t size)
+    {
+        if (size <= 0)
+        {
+            ring.reset();
+            return;
+        }
+        if (ring && int64_t(ring->getCapacity()) == size)
+        {
+            return;
+        }
+        ring.reset(); // the front end keeps its mapping of the old ring until it has read the rest of it
+        const std::string name = "/cura_engine_" + std::to_string(getpid()) + "_" + std::to_string(ring_count++);
+        ring.reset(new SharedMemoryRing(name, size));
+        if (!ring->isValid())
+        {
+            logWarning("Couldn't create the shared memory %s; sending all data through the socket.\n", name.c_str());
+            ring.reset();
+            return;
+        }
+        auto message = std::make_shared<cura::proto::SharedMemoryRing>();
+        message->set_name(name);
+        message->set_size(size);
+        socket->sendMessage(message);
+    }
+
+    /*!
+     * Send a message with bulk data, through the ring if there is space in it.
+     *
+     * Can be called from any thread: the layer view is sent by the threads which compile it, while the gcode is sent by the thread writing it.
+     */
+    void send(const Arcus::MessagePtr& message)
+    {
+        std::lock_guard<std::mutex> lock(send_mutex);
+        uint64_t position;
+        char* data;
+        const size_t size = ring ? message->ByteSizeLong() : 0;
+        if (size == 0 || !ring->reserve(size, position, data))
+        {
+            socket->sendMessage(message);
+            return;
+        }
+        message->SerializeWithCachedSizesToArray(reinterpret_cast<google::protobuf::uint8*>(data));
+        ring->commit(position, size);
+        auto block = std::make_shared<cura::proto::SharedMemoryBlock>();
+        block->set_type(message->GetTypeName());
+        block->set_position(position);
+        block->set_size(size);
+        socket->sendMessage(block);
+    }
+
+private:
+    std::unique_ptr<SharedMemoryRing> ring; //!< The ring the front end asked for, or nullptr
+    unsigned int ring_count; //!< The number of rings created so far, so that each ring gets a new name
+    std::mutex send_mutex; //!< Keeps the messages sent by different threads from being written into the ring at the same time
 };
 
 /*!
  * A template structure used to store data to be sent to the front end.
+ * 
+ * The layers are buffered until no more data is added to them, after which they are sent right away,
+ * so that the front end can show them while the rest is still being sliced.
  */
 template <typename T>
 class SliceDataStruct
@@ -79,7 +229,47 @@ public:
     int current_layer_count;//!< Number of layers for which data has been buffered in slice_data so far.
     int current_layer_offset;//!< Offset to add to layer number for the current slice object when slicing one at a time.
 
-    std::unordered_map<int, std::shared_ptr<T>> slice_data;
+    std::map<int, std::shared_ptr<T>> slice_data; //!< The buffered layers which haven't been sent yet, by their id
+
+    /*!
+     * Send the buffered layers with an id below \p layer_id to the front end and forget them.
+     * 
+     * \param sender Sends the layer messages, which are queued in the socket and sent on its own thread
+     * \param layer_id The id of the lowest layer to which data may still be added
+     */
+    void sendLayersBefore(BulkSender& sender, int layer_id)
+    {
+        while (!slice_data.empty() && slice_data.begin()->first < layer_id)
+        {
+            sender.send(slice_data.begin()->second);
+            slice_data.erase(slice_data.begin());
+        }
+    }
+
+    /*!
+     * Forget all buffered layers without sending them, when the slice they belong to was cancelled.
+     */
+    void clear()
+    {
+        slice_data.clear();
+        sliced_objects = 0;
+        current_layer_count = 0;
+        current_layer_offset = 0;
+    }
+
+    /*!
+     * Send all buffered layers to the front end and forget them.
+     * 
+     * \param sender Sends the layer messages, which are queued in the socket and sent on its own thread
+     */
+    void sendLayers(BulkSender& sender)
+    {
+        for (std::pair<const int, std::shared_ptr<T>>& entry : slice_data)
+        {
+            sender.send(entry.second);
+        }
+        slice_data.clear();
+    }
 };
 
 class CommandSocket::Private
@@ -87,31 +277,106 @@ class CommandSocket::Private
 public:
     Private()
         : socket(nullptr)
+        , listener(nullptr)
         , object_count(0)
+        , compact_layer_data(false)
+        , layer_view_tolerance2(0)
+        , estimate_only(false)
+        , preview(false)
+        , gcode_output_stream(&gcode_output_buffer)
     { }
 
     std::shared_ptr<cura::proto::Layer> getLayerById(int id);
 
+    /*!
+     * Get the buffered message of an optimized layer, creating it if it doesn't exist yet. The optimized_layers_mutex should be locked.
+     */
     std::shared_ptr<cura::proto::LayerOptimized> getOptimizedLayerById(int id);
 
+    /*!
+     * Create an empty message for the paths of an optimized layer, which isn't buffered yet, see Private::addOptimizedLayer.
+     */
+    std::shared_ptr<cura::proto::LayerOptimized> createOptimizedLayer(int layer_nr);
+
+    /*!
+     * Buffer the paths compiled for an optimized layer, adding them to the paths which other threads compiled for the same layer.
+     *
+     * \param layer The message created by Private::createOptimizedLayer, of which the paths are taken
+     */
+    void addOptimizedLayer(const std::shared_ptr<cura::proto::LayerOptimized>& layer);
+
+    /*!
+     * Send the buffered optimized layers below the layers which the path compilers of all threads are still compiling.
+     */
+    void sendCompletedOptimizedLayers();
+
+    /*!
+     * Get the path compiler of the calling thread, which compiles the layer view sent by that thread.
+     *
+     * The layer view of a layer is compiled on the thread which writes its gcode, but the planning of higher layers on other threads
+     * may send paths as well, so each thread compiles its own layer from its own position, and hands it off when it's finished.
+     */
+    PathCompiler& getPathCompiler();
+
+    /*!
+     * Hand off the paths buffered by the path compilers of all threads, so that they can be sent.
+     *
+     * Only to be called while no other thread is sending layer view data, e.g. at the end of a mesh group.
+     */
+    void flushPathCompilers();
+
+    /*!
+     * Forget the paths buffered by the path compilers of all threads, when the slice they belong to was cancelled.
+     *
+     * Only to be called while no other thread is sending layer view data.
+     */
+    void discardPathCompilers();
+
     Arcus::Socket* socket;
-    
+    Listener* listener; //!< Wakes up the message loop when a message arrives; kept as long as the socket
+    BulkSender bulk_sender; //!< Sends the layer view and the gcode through the socket or shared memory
+    std::unique_ptr<SharedMemoryRing> upload_ring; //!< The ring in which the front end wrote the vertices of the current Slice, or nullptr
+
     // Number of objects that need to be sliced
     int object_count;
 
+    bool compact_layer_data; //!< Whether the front end asked for the compact encoding of the path segments in the Slice message
+    int64_t layer_view_tolerance2; //!< The square of the distance by which the sent paths may deviate from the paths in the gcode, as asked for in the Slice message
+    bool estimate_only; //!< Whether the Slice message asked for the estimates only, so that no gcode is sent
+    bool preview; //!< Whether the coarse preview is being sliced, of which the layers are marked and no progress is sent
+
     std::string temp_gcode_file;
-    std::ostringstream gcode_output_stream;
+    StringOutputBuffer gcode_output_buffer; //!< Collects the gcode of a layer, which is handed off to a message without copying it
+    std::ostream gcode_output_stream;
+
+    static constexpr unsigned int max_pooled_gcode_messages = 8; //!< The number of sent gcode messages kept to reuse their memory
+    std::deque<std::shared_ptr<cura::proto::GCodeLayer>> sent_gcode_messages; //!< The most recently sent gcode messages, oldest first
+
+    /*!
+     * Get a message to hand the gcode of a layer off to.
+     * 
+     * Once the socket has sent a gcode message and released it, the message is reused together with the memory of its data,
+     * which StringOutputBuffer::take then collects the next gcode in, so that no memory is allocated for each layer.
+     */
+    std::shared_ptr<cura::proto::GCodeLayer> getGCodeMessage();
     
     // Print object that olds one or more meshes that need to be sliced. 
     std::vector< std::shared_ptr<MeshGroup> > objects_to_slice;
+    std::vector<std::shared_ptr<MeshGroup>> objects_to_preview; //!< The copies of the meshgroups of which a coarse preview is sliced first
 
     SliceDataStruct<cura::proto::Layer> sliced_layers;
     SliceDataStruct<cura::proto::LayerOptimized> optimized_layers;
+    std::mutex optimized_layers_mutex; //!< Guards optimized_layers, to which the planning and the writing of the gcode add from different threads
+
+    std::vector<std::unique_ptr<PathCompiler>> path_compilers; //!< The path compiler of each thread which has sent layer view data
+    std::mutex path_compilers_mutex; //!< Guards path_compilers
 };
 
 /*!
- * PathCompiler buffers and prepares the sliced data to be sent to the front end and saves them in
- * appropriate buffers
+ * PathCompiler buffers and prepares the layer view of a single thread to be sent to the front end.
+ *
+ * It compiles one layer at a time into its own message, which is handed off to the CommandSocket when it moves on to another layer.
+ * The paths of a layer compiled by several threads end up in the same layer, each in its own path segments.
  */
 class CommandSocket::PathCompiler
 {
@@ -119,14 +384,17 @@ class CommandSocket::PathCompiler
     static_assert(sizeof(PrintFeatureType) == 1, "To be compatible with the Cura frontend code PrintFeatureType needs to be of size 1");
     //! Reference to the private data of the CommandSocket used to send the data to the front end.
     CommandSocket::Private& _cs_private_data;
-    //! Keeps track of the current layer number being processed. If layer number is set to a different value, the current data is flushed to CommandSocket.
+    //! Keeps track of the current layer number being processed. If layer number is set to a different value, the current layer is handed off to the CommandSocket.
     int _layer_nr;
+    //! The layer being compiled, which the layers sent to the front end have to stay below, or INT_MAX when nothing is being compiled; read by other threads
+    std::atomic<int> active_layer_nr;
     int extruder;
     PointType data_point_type;
+    std::shared_ptr<cura::proto::LayerOptimized> layer; //!< The path segments compiled for the current layer which haven't been handed off yet, or nullptr
 
     std::vector<PrintFeatureType> line_types; //!< Line types for the line segments stored, the size of this vector is N.
-    std::vector<float> line_widths; //!< Line widths for the line segments stored, the size of this vector is N.
-    std::vector<float> points; //!< The points used to define the line segments, the size of this vector is D*(N+1) as each line segment is defined from one point to the next. D is the dimensionality of the point.
+    std::vector<int> line_widths; //!< Line widths for the line segments stored in microns, the size of this vector is N.
+    std::vector<Point> points; //!< The points used to define the line segments, the size of this vector is N+1 as each line segment is defined from one point to the next.
 
     Point last_point;
 
@@ -136,6 +404,7 @@ public:
     PathCompiler(CommandSocket::Private& cs_private_data):
         _cs_private_data(cs_private_data),
         _layer_nr(0),
+        active_layer_nr(INT_MAX),
         extruder(0),
         data_point_type(cura::proto::PathSegment::Point2D),
         line_types(),
@@ -143,23 +412,22 @@ public:
         points(),
         last_point{0,0}
     {}
-    ~PathCompiler()
-    {
-        if (line_types.size())
-        {
-            flushPathSegments();
-        }
-    }
 
     /*!
      * Used to select which layer the following layer data is intended for.
      */
     void setLayer(int new_layer_nr)
     {
-        if (_layer_nr != new_layer_nr)
+        if (_layer_nr != new_layer_nr || !isActive())
         {
-            flushPathSegments();
+            handOffLayer(); // stays active meanwhile, so that no other thread sends the new layer before it's compiled
+            const bool moves_up = new_layer_nr > _layer_nr;
             _layer_nr = new_layer_nr;
+            active_layer_nr.store(new_layer_nr, std::memory_order_relaxed);
+            if (moves_up)
+            { // the layers are written from the bottom up, so no more paths are added to the layers below
+                _cs_private_data.sendCompletedOptimizedLayers();
+            }
         }
     }
     /*!
@@ -169,6 +437,13 @@ public:
     {
         return _layer_nr;
     }
+    /*!
+     * The layer being compiled, or INT_MAX when the compiler is idle; can be called from any thread.
+     */
+    int getActiveLayer() const
+    {
+        return active_layer_nr.load(std::memory_order_relaxed);
+    }
     /*!
      * Used to set which extruder will be used for printing the following layer data is intended for.
      */
@@ -199,10 +474,27 @@ public:
     }
 
     /*!
-     * Transfers the currently buffered line segments to the
-     * CommandSocket layer message storage.
+     * Transfers the currently buffered line segments to the message of the current layer.
      */
     void flushPathSegments();
+
+    /*!
+     * Flush the buffered line segments and hand the message of the current layer off to the CommandSocket,
+     * after which the compiler is idle until a layer is set again.
+     */
+    void finishLayer();
+
+    /*!
+     * Forget the buffered line segments and the message of the current layer, after which the compiler is idle until a layer is set again.
+     */
+    void discard()
+    {
+        points.clear();
+        line_widths.clear();
+        line_types.clear();
+        layer.reset();
+        active_layer_nr.store(INT_MAX, std::memory_order_relaxed);
+    }
     /*!
      * Move the current point of this path to \position.
      */
@@ -219,13 +511,21 @@ public:
      */
     void sendPolygon(PrintFeatureType print_feature_type, Polygon poly, int width);
 private:
+    bool isActive() const
+    {
+        return getActiveLayer() != INT_MAX;
+    }
+
+    /*!
+     * Flush the buffered line segments and hand the message of the current layer off to the CommandSocket.
+     */
+    void handOffLayer();
     /*!
-     * Convert and add a point to the points buffer, each point being represented as two consecutive floats. All members adding a 2D point to the data should use this function.
+     * Add a point to the points buffer. All members adding a 2D point to the data should use this function.
      */
     void addPoint2D(Point point)
     {
-        points.push_back(INT2MM(point.X));
-        points.push_back(INT2MM(point.Y));
+        points.push_back(point);
         last_point = point;
     }
     /*!
@@ -233,17 +533,54 @@ private:
      */
     void addLineSegment(PrintFeatureType print_feature_type, Point point, int line_width)
     {
+        if (canExtendLastSegment(print_feature_type, point, line_width))
+        {
+            points.back() = point;
+            last_point = point;
+            return;
+        }
         addPoint2D(point);
         line_types.push_back(print_feature_type);
-        line_widths.push_back(INT2MM(line_width));
+        line_widths.push_back(line_width);
     }
+
+    /*!
+     * Whether the last line segment can be extended to \p point instead of adding a new line segment,
+     * because it has the same type and width and its end lies within the layer view tolerance from the line to \p point.
+     * 
+     * Like PolygonRef::simplify, each removed point is only checked against the line replacing it.
+     */
+    bool canExtendLastSegment(PrintFeatureType print_feature_type, Point point, int line_width) const
+    {
+        if (_cs_private_data.layer_view_tolerance2 == 0 || line_types.empty()
+            || line_types.back() != print_feature_type || line_widths.back() != line_width)
+        {
+            return false;
+        }
+        char is_beyond_line = 0;
+        const int64_t error2 = LinearAlg2D::getDist2FromLineSegment(points[points.size() - 2], points.back(), point, &is_beyond_line);
+        return is_beyond_line == 0 && error2 < _cs_private_data.layer_view_tolerance2;
+    }
+
+    /*!
+     * Fill the float arrays of a path segment with the buffered line segments.
+     */
+    void setFloatData(cura::proto::PathSegment& path_segment) const;
+
+    /*!
+     * Fill the compact fields of a path segment with the buffered line segments, see Cura.proto.
+     */
+    void setCompactData(cura::proto::PathSegment& path_segment) const;
 };
 #endif
 
 CommandSocket::CommandSocket()
+    : last_sent_progress(-1)
+    , last_progress_time(0)
+    , send_layer_view(true)
+    , default_send_layer_view(true)
 #ifdef ARCUS
-    : private_data(new Private)
-    , path_comp(new PathCompiler(*private_data))
+    , private_data(new Private)
 #endif
 {
 #ifdef ARCUS
@@ -265,12 +602,20 @@ bool CommandSocket::isInstantiated()
     return instance != nullptr;
 }
 
+void CommandSocket::setSendLayerView(bool send_layer_view)
+{
+    this->send_layer_view = send_layer_view;
+    default_send_layer_view = send_layer_view;
+}
+
 
 void CommandSocket::connect(const std::string& ip, int port)
 {
 #ifdef ARCUS
     private_data->socket = new Arcus::Socket();
-    private_data->socket->addListener(new Listener());
+    private_data->listener = new Listener(FffProcessor::getInstance());
+    private_data->socket->addListener(private_data->listener);
+    private_data->bulk_sender.socket = private_data->socket;
 
     //private_data->socket->registerMessageType(1, &Cura::ObjectList::default_instance());
     private_data->socket->registerMessageType(&cura::proto::Slice::default_instance());
@@ -283,6 +628,9 @@ void CommandSocket::connect(const std::string& ip, int port)
     private_data->socket->registerMessageType(&cura::proto::GCodePrefix::default_instance());
     private_data->socket->registerMessageType(&cura::proto::SlicingFinished::default_instance());
     private_data->socket->registerMessageType(&cura::proto::SettingExtruder::default_instance());
+    private_data->socket->registerMessageType(&cura::proto::ProfilingReport::default_instance());
+    private_data->socket->registerMessageType(&cura::proto::SharedMemoryRing::default_instance());
+    private_data->socket->registerMessageType(&cura::proto::SharedMemoryBlock::default_instance());
 
     private_data->socket->connect(ip, port);
 
@@ -290,7 +638,7 @@ void CommandSocket::connect(const std::string& ip, int port)
 
     while(private_data->socket->getState() != Arcus::SocketState::Connected && private_data->socket->getState() != Arcus::SocketState::Error)
     {
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        private_data->listener->waitForEvent();
     }
 
     log("Connected to %s:%i\n", ip.c_str(), port);
@@ -326,22 +674,48 @@ void CommandSocket::connect(const std::string& ip, int port)
         if (slice)
         {
             logDebug("Received a Slice message\n");
+            FffProcessor::getInstance()->clearCancellation(); // only messages received after this one cancel its slice
+            private_data->compact_layer_data = slice->compact_layer_data();
+            const int64_t layer_view_tolerance = MM2INT(slice->layer_view_tolerance());
+            private_data->layer_view_tolerance2 = layer_view_tolerance * layer_view_tolerance;
+            private_data->estimate_only = slice->estimate_only() || slice->area_estimate_only();
+            FffProcessor::getInstance()->setEstimateOnly(private_data->estimate_only);
+            FffProcessor::getInstance()->setAreaEstimateOnly(slice->area_estimate_only());
+            send_layer_view = default_send_layer_view && !slice->skip_layer_view() && !private_data->estimate_only;
+            private_data->bulk_sender.setRingSize(slice->download_ring_size()); // announced before any message is sent through it
+            private_data->upload_ring.reset();
+            if (!slice->upload_ring().name().empty())
+            {
+                private_data->upload_ring.reset(new SharedMemoryRing(slice->upload_ring().name()));
+                if (!private_data->upload_ring->isValid())
+                {
+                    logError("Couldn't open the shared memory %s with the meshes of the front end.\n", slice->upload_ring().name().c_str());
+                }
+            }
             const cura::proto::SettingList& global_settings = slice->global_settings();
-            for (auto setting : global_settings.settings())
+            for (const cura::proto::Setting& setting : global_settings.settings())
             {
                 FffProcessor::getInstance()->setSetting(setting.name(), setting.value());
             }
             // Reset object counts
             private_data->object_count = 0;
-            for (auto object : slice->object_lists())
+            last_sent_progress = -1; // so that the first progress of the new slice is sent right away
+            last_progress_time = 0;
+            for (const cura::proto::ObjectList& object : slice->object_lists())
             {
+                if (slice->preview())
+                { // loaded first, because the meshgroup itself releases the vertices in the upload ring
+                    handleObjectList(&object, slice->extruders(), true);
+                }
                 handleObjectList(&object, slice->extruders());
             }
             //For every object, set the extruder fallbacks from the global_inherits_stack.
-            for (const cura::proto::SettingExtruder setting_extruder : slice->global_inherits_stack())
+            for (const cura::proto::SettingExtruder& setting_extruder : slice->global_inherits_stack())
             {
                 const int32_t extruder_nr = setting_extruder.extruder(); //Implicit cast from Protobuf's int32 to normal int32.
-                for (std::shared_ptr<MeshGroup> meshgroup : private_data->objects_to_slice)
+                std::vector<std::shared_ptr<MeshGroup>> meshgroups = private_data->objects_to_slice;
+                meshgroups.insert(meshgroups.end(), private_data->objects_to_preview.begin(), private_data->objects_to_preview.end());
+                for (std::shared_ptr<MeshGroup> meshgroup : meshgroups)
                 {
                     if (extruder_nr < 0 || extruder_nr >= meshgroup->getExtruderCount()) //We obtained an invalid value from the front-end. Ignore.
                     {
@@ -354,12 +728,17 @@ void CommandSocket::connect(const std::string& ip, int port)
                     }
                 }
             }
+            private_data->upload_ring.reset(); // the meshes have been loaded from it
             logDebug("Done reading Slice message\n");
         }
 
         //If there is an object to slice, do so.
         if (private_data->objects_to_slice.size())
         {
+            if (!private_data->objects_to_preview.empty())
+            {
+                slicePreview();
+            }
             int object_count = private_data->objects_to_slice.size();
             logDebug("Slicing %i objects\n", object_count);
             FffProcessor::getInstance()->resetMeshGroupNumber();
@@ -367,7 +746,7 @@ void CommandSocket::connect(const std::string& ip, int port)
             for (auto object : private_data->objects_to_slice)
             {
                 logDebug("Slicing object %i of %i\n", i, object_count);
-                if (!FffProcessor::getInstance()->processMeshGroup(object.get()))
+                if (!FffProcessor::getInstance()->processMeshGroup(object.get()) && !FffProcessor::getInstance()->isCancelled())
                 {
                     logError("Slicing mesh group failed!");
                 }
@@ -376,6 +755,12 @@ void CommandSocket::connect(const std::string& ip, int port)
             logDebug("Done slicing objects\n");
 
             private_data->objects_to_slice.clear();
+            if (FffProcessor::getInstance()->isCancelled())
+            { // a new message is waiting, which usually is the Slice message replacing this slice
+                log("Slicing was cancelled by a new message.\n");
+                discardSlice();
+                continue;
+            }
             FffProcessor::getInstance()->finalize();
             flushGcode();
             sendPrintTimeMaterialEstimates();
@@ -389,7 +774,10 @@ void CommandSocket::connect(const std::string& ip, int port)
             //sendPrintTimeMaterialEstimates();
         }
 
-        std::this_thread::sleep_for(std::chrono::milliseconds(250));
+        if (!message)
+        { // all messages are handled, so wait for the next one, or for the socket to close
+            private_data->listener->waitForEvent();
+        }
     }
     log("Closing connection\n");
     private_data->socket->close();
@@ -397,47 +785,56 @@ void CommandSocket::connect(const std::string& ip, int port)
 }
 
 #ifdef ARCUS
-void CommandSocket::handleObjectList(cura::proto::ObjectList* list, const google::protobuf::RepeatedPtrField<cura::proto::Extruder> settings_per_extruder_train)
+void CommandSocket::handleObjectList(const cura::proto::ObjectList* list, const google::protobuf::RepeatedPtrField<cura::proto::Extruder>& settings_per_extruder_train, bool preview)
 {
     if (list->objects_size() <= 0)
     {
         return;
     }
 
-    FMatrix3x3 matrix;
+    FMatrix3x3 matrix; // the front-end sends the vertices already transformed, so this stays the identity
     //private_data->object_count = 0;
     //private_data->object_ids.clear();
-    private_data->objects_to_slice.push_back(std::make_shared<MeshGroup>(FffProcessor::getInstance()));
-    MeshGroup* meshgroup = private_data->objects_to_slice.back().get();
+    std::vector<std::shared_ptr<MeshGroup>>& meshgroups = preview ? private_data->objects_to_preview : private_data->objects_to_slice;
+    meshgroups.push_back(std::make_shared<MeshGroup>(FffProcessor::getInstance()));
+    MeshGroup* meshgroup = meshgroups.back().get();
 
     // load meshgroup settings
-    for (auto setting : list->settings())
+    for (const cura::proto::Setting& setting : list->settings())
     {
         meshgroup->setSetting(setting.name(), setting.value());
     }
 
     { // load extruder settings
-        for (int extruder_nr = 0; extruder_nr < FffProcessor::getInstance()->getSettingAsCount("machine_extruder_count"); extruder_nr++)
+        for (int extruder_nr = 0; extruder_nr < FffProcessor::getInstance()->getSettingAsCount(SettingKey::machine_extruder_count); extruder_nr++)
         { // initialize remaining extruder trains and load the defaults
             ExtruderTrain* train = meshgroup->createExtruderTrain(extruder_nr); // create new extruder train objects or use already existing ones
             SettingRegistry::getInstance()->loadExtruderJSONsettings(extruder_nr, train);
         }
 
-        for (auto extruder : settings_per_extruder_train)
+        for (const cura::proto::Extruder& extruder : settings_per_extruder_train)
         {
             int extruder_nr = extruder.id();
             ExtruderTrain* train = meshgroup->createExtruderTrain(extruder_nr); // create new extruder train objects or use already existing ones
-            for (auto setting : extruder.settings().settings())
+            for (const cura::proto::Setting& setting : extruder.settings().settings())
             {
                 train->setSetting(setting.name(), setting.value());
             }
         }
     }
 
-    for (auto object : list->objects())
+    for (const cura::proto::Object& object : list->objects())
     {
         int bytes_per_face = BYTES_PER_FLOAT * FLOATS_PER_VECTOR * VECTORS_PER_FACE;
-        int face_count = object.vertices().size() / bytes_per_face;
+        const char* vertex_data = object.vertices().data();
+        size_t vertex_data_size = object.vertices().size();
+        if (object.has_vertices_block())
+        { // the vertices are read directly from the memory of the front end
+            const cura::proto::SharedMemoryBlock& block = object.vertices_block();
+            vertex_data = private_data->upload_ring ? private_data->upload_ring->getBlock(block.position(), block.size()) : nullptr;
+            vertex_data_size = vertex_data ? block.size() : 0;
+        }
+        int face_count = vertex_data_size / bytes_per_face;
 
         if (face_count <= 0)
         {
@@ -448,7 +845,7 @@ void CommandSocket::handleObjectList(cura::proto::ObjectList* list, const google
 
         // Check to which extruder train this object belongs
         int extruder_train_nr = 0; // assume extruder 0 if setting wasn't supplied
-        for (auto setting : object.settings())
+        for (const cura::proto::Setting& setting : object.settings())
         {
             if (setting.name() == "extruder_nr")
             {
@@ -461,29 +858,41 @@ void CommandSocket::handleObjectList(cura::proto::ObjectList* list, const google
         meshgroup->meshes.push_back(extruder_train); //Construct a new mesh (with the corresponding extruder train as settings parent object) and put it into MeshGroup's mesh list.
         Mesh& mesh = meshgroup->meshes.back();
 
+        // The faces are transformed in parallel chunks directly from the bytes of the message, like the faces of a binary STL file.
+        std::vector<Point3> triangle_vertices(face_count * 3);
+        const int faces_per_chunk = 4096;
+        const int chunk_count = (face_count + faces_per_chunk - 1) / faces_per_chunk;
+        ThreadPool::getInstance()->parallelFor(0, chunk_count, [&](int chunk_idx)
+            {
+                const int face_idx_end = std::min(face_count, (chunk_idx + 1) * faces_per_chunk);
+                for (int face_idx = chunk_idx * faces_per_chunk; face_idx < face_idx_end; face_idx++)
+                {
+                    float v[FLOATS_PER_VECTOR * VECTORS_PER_FACE];
+                    memcpy(v, vertex_data + size_t(face_idx) * bytes_per_face, sizeof(v));
+                    triangle_vertices[face_idx * 3] = matrix.apply(FPoint3(v[0], v[1], v[2]));
+                    triangle_vertices[face_idx * 3 + 1] = matrix.apply(FPoint3(v[3], v[4], v[5]));
+                    triangle_vertices[face_idx * 3 + 2] = matrix.apply(FPoint3(v[6], v[7], v[8]));
+                }
+            });
+        mesh.addFaces(triangle_vertices);
+        if (object.has_vertices_block() && !preview)
+        { // the front end may reuse the memory of the vertices for the next Slice
+            private_data->upload_ring->release(object.vertices_block().position(), object.vertices_block().size());
+        }
+
         for (int i = 0; i < face_count; ++i)
         {
-            //TODO: Apply matrix
-            std::string data = object.vertices().substr(i * bytes_per_face, bytes_per_face);
-            const FPoint3* float_vertices = reinterpret_cast<const FPoint3*>(data.data());
-
-            Point3 verts[3];
-            verts[0] = matrix.apply(float_vertices[0]);
-            verts[1] = matrix.apply(float_vertices[1]);
-            verts[2] = matrix.apply(float_vertices[2]);
-            mesh.addFace(verts[0], verts[1], verts[2]);
-
             DEBUG_OUTPUT_OBJECT_STL_THROUGH_CERR("  facet normal -1 0 0\n");
             DEBUG_OUTPUT_OBJECT_STL_THROUGH_CERR("    outer loop\n");
-            DEBUG_OUTPUT_OBJECT_STL_THROUGH_CERR("      vertex "<<INT2MM(verts[0].x) <<" " << INT2MM(verts[0].y) <<" " << INT2MM(verts[0].z) << "\n");
-            DEBUG_OUTPUT_OBJECT_STL_THROUGH_CERR("      vertex "<<INT2MM(verts[1].x) <<" " << INT2MM(verts[1].y) <<" " << INT2MM(verts[1].z) << "\n");
-            DEBUG_OUTPUT_OBJECT_STL_THROUGH_CERR("      vertex "<<INT2MM(verts[2].x) <<" " << INT2MM(verts[2].y) <<" " << INT2MM(verts[2].z) << "\n");
+            DEBUG_OUTPUT_OBJECT_STL_THROUGH_CERR("      vertex "<<INT2MM(triangle_vertices[i * 3 + 0].x) <<" " << INT2MM(triangle_vertices[i * 3 + 0].y) <<" " << INT2MM(triangle_vertices[i * 3 + 0].z) << "\n");
+            DEBUG_OUTPUT_OBJECT_STL_THROUGH_CERR("      vertex "<<INT2MM(triangle_vertices[i * 3 + 1].x) <<" " << INT2MM(triangle_vertices[i * 3 + 1].y) <<" " << INT2MM(triangle_vertices[i * 3 + 1].z) << "\n");
+            DEBUG_OUTPUT_OBJECT_STL_THROUGH_CERR("      vertex "<<INT2MM(triangle_vertices[i * 3 + 2].x) <<" " << INT2MM(triangle_vertices[i * 3 + 2].y) <<" " << INT2MM(triangle_vertices[i * 3 + 2].z) << "\n");
             DEBUG_OUTPUT_OBJECT_STL_THROUGH_CERR("    endloop\n");
             DEBUG_OUTPUT_OBJECT_STL_THROUGH_CERR("  endfacet\n");
         }
         DEBUG_OUTPUT_OBJECT_STL_THROUGH_CERR("endsolid Cura_out\n");
 
-        for (auto setting : object.settings())
+        for (const cura::proto::Setting& setting : object.settings())
         {
             mesh.setSetting(setting.name(), setting.value());
         }
@@ -491,9 +900,68 @@ void CommandSocket::handleObjectList(cura::proto::ObjectList* list, const google
         mesh.finish();
     }
 
-    private_data->object_count++;
+    if (!preview)
+    {
+        private_data->object_count++;
+    }
     meshgroup->finalize();
 }
+
+void CommandSocket::slicePreview()
+{
+    logDebug("Slicing the preview of %i objects\n", int(private_data->objects_to_preview.size()));
+    private_data->preview = true;
+    double print_time = 0.0;
+    std::vector<double> material_volumes(FffProcessor::getInstance()->getSettingAsCount(SettingKey::machine_extruder_count), 0.0);
+    bool cancelled = false;
+    for (std::shared_ptr<MeshGroup>& meshgroup : private_data->objects_to_preview)
+    {
+        AreaEstimate estimate;
+        const bool success = FffProcessor::getInstance()->processPreview(meshgroup.get(), estimate);
+        meshgroup.reset(); // the copy can't be used for anything else, so its settings and sliced data are freed right away
+        if (!success)
+        {
+            cancelled = FffProcessor::getInstance()->isCancelled();
+            if (cancelled)
+            {
+                break;
+            }
+            continue; // e.g. wireframe printing, of which no preview is sliced
+        }
+        print_time += estimate.getPrintTime();
+        for (unsigned int extruder_nr = 0; extruder_nr < material_volumes.size(); extruder_nr++)
+        {
+            material_volumes[extruder_nr] += estimate.getMaterialVolume(extruder_nr);
+        }
+    }
+    private_data->objects_to_preview.clear();
+    private_data->preview = false;
+    private_data->flushPathCompilers();
+    {
+        std::lock_guard<std::mutex> lock(private_data->optimized_layers_mutex);
+        if (!cancelled)
+        {
+            private_data->optimized_layers.sendLayers(private_data->bulk_sender);
+        }
+        private_data->optimized_layers.clear(); // the layers of the full slice are counted from the first mesh group again
+    }
+    if (cancelled)
+    {
+        return;
+    }
+
+    auto message = std::make_shared<cura::proto::PrintTimeMaterialEstimates>();
+    message->set_time(print_time);
+    for (unsigned int extruder_nr = 0; extruder_nr < material_volumes.size(); extruder_nr++)
+    {
+        cura::proto::MaterialEstimates* material_message = message->add_materialestimates();
+        material_message->set_id(extruder_nr);
+        material_message->set_material_amount(material_volumes[extruder_nr]);
+    }
+    message->set_preview(true);
+    private_data->socket->sendMessage(message);
+    last_sent_progress = -1; // the progress of the full slice starts from zero again
+}
 #endif
 
 void CommandSocket::sendLayerInfo(int layer_nr, int32_t z, int32_t height)
@@ -508,6 +976,11 @@ void CommandSocket::sendLayerInfo(int layer_nr, int32_t z, int32_t height)
 void CommandSocket::sendOptimizedLayerInfo(int layer_nr, int32_t z, int32_t height)
 {
 #ifdef ARCUS
+    if (!send_layer_view)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(private_data->optimized_layers_mutex);
     std::shared_ptr<cura::proto::LayerOptimized> layer = private_data->getOptimizedLayerById(layer_nr);
     layer->set_height(z);
     layer->set_thickness(height);
@@ -522,13 +995,12 @@ void CommandSocket::sendPolygons(PrintFeatureType type, const Polygons& polygons
         return;
     }
 
-    if (CommandSocket::isInstantiated())
+    if (isSendingLayerView())
     {
-        auto& path_comp = CommandSocket::getInstance()->path_comp;
-
+        PathCompiler& path_compiler = private_data->getPathCompiler();
         for (unsigned int i = 0; i < polygons.size(); ++i)
         {
-            path_comp->sendPolygon(type, polygons[i], line_width);
+            path_compiler.sendPolygon(type, polygons[i], line_width);
         }
     }
 #endif
@@ -537,11 +1009,9 @@ void CommandSocket::sendPolygons(PrintFeatureType type, const Polygons& polygons
 void CommandSocket::sendPolygon(PrintFeatureType type, Polygon& polygon, int line_width)
 {
 #ifdef ARCUS
-    if (CommandSocket::isInstantiated())
+    if (isSendingLayerView())
     {
-        auto& path_comp = CommandSocket::getInstance()->path_comp;
-
-        path_comp->sendPolygon(type, polygon, line_width);
+        private_data->getPathCompiler().sendPolygon(type, polygon, line_width);
     }
 #endif
 }
@@ -549,11 +1019,9 @@ void CommandSocket::sendPolygon(PrintFeatureType type, Polygon& polygon, int lin
 void CommandSocket::sendLineTo(cura::PrintFeatureType type, Point to, int line_width)
 {
 #ifdef ARCUS
-    if (CommandSocket::isInstantiated())
+    if (isSendingLayerView())
     {
-        auto& path_comp = CommandSocket::getInstance()->path_comp;
-
-        path_comp->sendLineTo(type, to, line_width);
+        private_data->getPathCompiler().sendLineTo(type, to, line_width);
     }
 #endif
 }
@@ -561,10 +1029,9 @@ void CommandSocket::sendLineTo(cura::PrintFeatureType type, Point to, int line_w
 void CommandSocket::setSendCurrentPosition(Point position)
 {
 #ifdef ARCUS
-    if (CommandSocket::isInstantiated())
+    if (isSendingLayerView())
     {
-        auto& path_comp = CommandSocket::getInstance()->path_comp;
-        path_comp->setCurrentPosition(position);
+        private_data->getPathCompiler().setCurrentPosition(position);
     }
 #endif
 }
@@ -572,32 +1039,77 @@ void CommandSocket::setSendCurrentPosition(Point position)
 void CommandSocket::setLayerForSend(int layer_nr)
 {
 #ifdef ARCUS
-    if (CommandSocket::isInstantiated())
+    if (isSendingLayerView())
+    {
+        private_data->getPathCompiler().setLayer(layer_nr);
+    }
+#endif
+}
+
+void CommandSocket::sendPolygonsOfLayer(PrintFeatureType type, int layer_nr, int extruder, const Polygons& polygons, int line_width)
+{
+#ifdef ARCUS
+    if (polygons.size() == 0 || !isSendingLayerView())
     {
-        auto& path_comp = CommandSocket::getInstance()->path_comp;
-        path_comp->setLayer(layer_nr);
+        return;
+    }
+    PathCompiler path_compiler(*private_data); // not the compiler of this thread, of which the layer and the position stay as they are
+    path_compiler.setLayer(layer_nr);
+    path_compiler.setExtruder(extruder);
+    for (unsigned int poly_idx = 0; poly_idx < polygons.size(); poly_idx++)
+    {
+        path_compiler.sendPolygon(type, polygons[poly_idx], line_width);
     }
+    path_compiler.finishLayer();
 #endif
 }
 
 void CommandSocket::setExtruderForSend(int extruder)
 {
 #ifdef ARCUS
-    if (CommandSocket::isInstantiated())
+    if (isSendingLayerView())
     {
-        auto& path_comp = CommandSocket::getInstance()->path_comp;
-        path_comp->setExtruder(extruder);
+        private_data->getPathCompiler().setExtruder(extruder);
     }
 #endif
 }
 
 
+bool CommandSocket::claimProgressMessage(float amount)
+{
+    const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t last_time = last_progress_time.load(std::memory_order_relaxed);
+    if (now - last_time < min_progress_interval)
+    {
+        return false;
+    }
+    const float last_progress = last_sent_progress.load(std::memory_order_relaxed);
+    if (last_progress >= 0 && std::abs(amount - last_progress) < min_progress_change)
+    {
+        return false;
+    }
+    if (!last_progress_time.compare_exchange_strong(last_time, now, std::memory_order_relaxed))
+    { // another thread is sending its progress right now
+        return false;
+    }
+    last_sent_progress.store(amount, std::memory_order_relaxed);
+    return true;
+}
+
 void CommandSocket::sendProgress(float amount)
 {
 #ifdef ARCUS
-    auto message = std::make_shared<cura::proto::Progress>();
+    if (private_data->preview)
+    { // the preview is only a small part of the slicing time, so the progress is that of the full slice only
+        return;
+    }
     amount /= private_data->object_count;
     amount += private_data->optimized_layers.sliced_objects * (1. / private_data->object_count);
+    if (!claimProgressMessage(amount))
+    {
+        return;
+    }
+    auto message = std::make_shared<cura::proto::Progress>();
     message->set_amount(amount);
     private_data->socket->sendMessage(message);
 #endif
@@ -615,7 +1127,7 @@ void CommandSocket::sendPrintTimeMaterialEstimates()
     auto message = std::make_shared<cura::proto::PrintTimeMaterialEstimates>();
 
     message->set_time(FffProcessor::getInstance()->getTotalPrintTime());
-    int num_extruders = FffProcessor::getInstance()->getSettingAsCount("machine_extruder_count");
+    int num_extruders = FffProcessor::getInstance()->getSettingAsCount(SettingKey::machine_extruder_count);
     for (int extruder_nr (0); extruder_nr < num_extruders; ++extruder_nr)
     {
         cura::proto::MaterialEstimates* material_message = message->add_materialestimates();
@@ -629,6 +1141,83 @@ void CommandSocket::sendPrintTimeMaterialEstimates()
 #endif
 }
 
+void CommandSocket::sendProfilingReport(int meshgroup_nr)
+{
+#ifdef ARCUS
+    const std::vector<ProfilingReport::MeshGroupProfile>& meshgroups = ProfilingReport::getInstance().getMeshGroups();
+    if (meshgroups.empty())
+    {
+        return;
+    }
+    const ProfilingReport::MeshGroupProfile& meshgroup = meshgroups.back();
+    auto message = std::make_shared<cura::proto::ProfilingReport>();
+    message->set_meshgroup_nr(meshgroup_nr);
+    for (const ProfilingReport::StageProfile& stage : meshgroup.stages)
+    {
+        cura::proto::StageProfile* stage_message = message->add_stages();
+        stage_message->set_stage(Progress::getStageName(stage.stage));
+        stage_message->set_wall_time(stage.wall_time);
+        stage_message->set_cpu_time(stage.cpu_time);
+        stage_message->set_rss(stage.rss);
+        stage_message->set_peak_rss(stage.peak_rss);
+        stage_message->set_allocation_count(stage.allocation_count);
+        stage_message->set_allocated_bytes(stage.allocated_bytes);
+        stage_message->set_peak_live_bytes(stage.peak_live_bytes);
+        for (const ProfilingReport::ThreadAllocationProfile& thread : stage.threads)
+        {
+            cura::proto::ThreadAllocationProfile* thread_message = stage_message->add_threads();
+            thread_message->set_thread(thread.thread_idx);
+            thread_message->set_allocation_count(thread.allocation_count);
+            thread_message->set_allocated_bytes(thread.allocated_bytes);
+        }
+        stage_message->set_thread_cpu_time(stage.thread_cpu_time);
+        for (double worker_cpu_time : stage.worker_cpu_times)
+        {
+            stage_message->add_worker_cpu_times(worker_cpu_time);
+        }
+    }
+    for (unsigned int mesh_idx = 0; mesh_idx < meshgroup.meshes.size(); mesh_idx++)
+    {
+        const ProfilingReport::MeshProfile& mesh = meshgroup.meshes[mesh_idx];
+        cura::proto::MeshProfile* mesh_message = message->add_meshes();
+        mesh_message->set_id(mesh_idx);
+        mesh_message->set_face_count(mesh.face_count);
+        mesh_message->set_vertex_count(mesh.vertex_count);
+        mesh_message->set_layer_count(mesh.layer_count);
+        mesh_message->set_part_count(mesh.part_count);
+        mesh_message->set_slice_time(mesh.slice_time);
+        mesh_message->set_parts_time(mesh.parts_time);
+        for (const ProfilingReport::LayerProfile& layer : mesh.layers)
+        {
+            cura::proto::LayerProfile* layer_message = mesh_message->add_layers();
+            layer_message->set_vertex_count(layer.vertex_count);
+            layer_message->set_part_count(layer.part_count);
+            layer_message->set_skin(layer.skin);
+            layer_message->set_estimated_cost(layer.estimated_cost);
+            layer_message->set_inset_time(layer.inset_time);
+            layer_message->set_skin_time(layer.skin_time);
+        }
+    }
+    for (const ProfilingReport::GridProfile& grid : meshgroup.grids)
+    {
+        cura::proto::GridProfile* grid_message = message->add_grids();
+        grid_message->set_use(grid.use);
+        grid_message->set_grid_count(grid.grid_count);
+        grid_message->set_element_count(grid.element_count);
+        grid_message->set_cell_count(grid.cell_count);
+        grid_message->set_max_cell_element_count(grid.max_cell_element_count);
+    }
+    for (const ProfilingReport::ThrottleProfile& throttle : meshgroup.throttles)
+    {
+        cura::proto::ThrottleProfile* throttle_message = message->add_throttles();
+        throttle_message->set_action(throttle.action);
+        throttle_message->set_count(throttle.count);
+        throttle_message->set_max_rss(throttle.max_rss);
+    }
+    private_data->socket->sendMessage(message);
+#endif
+}
+
 void CommandSocket::sendPrintMaterialForObject(int index, int extruder_nr, float print_time)
 {
 //     socket.sendInt32(CMD_OBJECT_PRINT_MATERIAL);
@@ -649,17 +1238,13 @@ void CommandSocket::sendLayerData()
     data.current_layer_offset = data.current_layer_count;
 //    log("End sliced object called. Sending %d layers.", data.current_layer_count);
 
-    // Only send the data to the front end when all mesh groups have been processed.
+    // the layers of this mesh group are complete, so they don't have to wait for the other mesh groups
+    data.sendLayers(private_data->bulk_sender);
     if (data.sliced_objects >= private_data->object_count)
     {
-        for (std::pair<const int, std::shared_ptr<cura::proto::Layer>> entry : data.slice_data) //Note: This is in no particular order!
-        {
-            private_data->socket->sendMessage(entry.second); //Send the actual layers.
-        }
         data.sliced_objects = 0;
         data.current_layer_count = 0;
         data.current_layer_offset = 0;
-        data.slice_data.clear();
     }
 #endif
 }
@@ -667,28 +1252,40 @@ void CommandSocket::sendLayerData()
 void CommandSocket::sendOptimizedLayerData()
 {
 #ifdef ARCUS
-    path_comp->flushPathSegments(); // make sure the last path segment has been flushed from the compiler
+    private_data->flushPathCompilers(); // make sure the last path segments have been flushed from the compilers
 
+    std::lock_guard<std::mutex> lock(private_data->optimized_layers_mutex);
     auto& data = private_data->optimized_layers;
 
     data.sliced_objects++;
     data.current_layer_offset = data.current_layer_count;
-    log("End sliced object called. Sending %d layers.", data.current_layer_count);
+    log("End sliced object called. Sending remaining %d of %d layers.", int(data.slice_data.size()), data.current_layer_count);
 
+    // most layers have been sent while the gcode was written; the rest of this mesh group is complete now
+    data.sendLayers(private_data->bulk_sender);
     if (data.sliced_objects >= private_data->object_count)
     {
-        for (std::pair<const int, std::shared_ptr<cura::proto::LayerOptimized>> entry : data.slice_data) //Note: This is in no particular order!
-        {
-            private_data->socket->sendMessage(entry.second); //Send the actual layers.
-        }
         data.sliced_objects = 0;
         data.current_layer_count = 0;
         data.current_layer_offset = 0;
-        data.slice_data.clear();
     }
 #endif
 }
 
+void CommandSocket::discardSlice()
+{
+#ifdef ARCUS
+    private_data->discardPathCompilers();
+    {
+        std::lock_guard<std::mutex> lock(private_data->optimized_layers_mutex);
+        private_data->optimized_layers.clear();
+    }
+    private_data->sliced_layers.clear();
+    std::string unsent_gcode;
+    private_data->gcode_output_buffer.take(unsent_gcode);
+#endif
+}
+
 void CommandSocket::sendFinishedSlicing()
 {
 #ifdef ARCUS
@@ -709,11 +1306,13 @@ void CommandSocket::beginGCode()
 void CommandSocket::flushGcode()
 {
 #ifdef ARCUS
-    auto message = std::make_shared<cura::proto::GCodeLayer>();
-    message->set_data(private_data->gcode_output_stream.str());
-    private_data->socket->sendMessage(message);
-    
-    private_data->gcode_output_stream.str("");
+    if (private_data->estimate_only)
+    {
+        return;
+    }
+    std::shared_ptr<cura::proto::GCodeLayer> message = private_data->getGCodeMessage();
+    private_data->gcode_output_buffer.take(*message->mutable_data());
+    private_data->bulk_sender.send(message);
 #endif
 }
 
@@ -726,6 +1325,30 @@ void CommandSocket::sendGCodePrefix(std::string prefix)
 #endif
 }
 
+#ifdef ARCUS
+constexpr unsigned int CommandSocket::Private::max_pooled_gcode_messages;
+
+std::shared_ptr<cura::proto::GCodeLayer> CommandSocket::Private::getGCodeMessage()
+{
+    std::shared_ptr<cura::proto::GCodeLayer> message;
+    if (!sent_gcode_messages.empty() && sent_gcode_messages.front().use_count() == 1)
+    { // the socket is done with it
+        message = std::move(sent_gcode_messages.front());
+        sent_gcode_messages.pop_front();
+    }
+    else
+    {
+        message = std::make_shared<cura::proto::GCodeLayer>();
+    }
+    if (sent_gcode_messages.size() >= max_pooled_gcode_messages)
+    { // the socket is lagging behind; let it free the oldest message itself
+        sent_gcode_messages.pop_front();
+    }
+    sent_gcode_messages.push_back(message);
+    return message;
+}
+#endif
+
 #ifdef ARCUS
 std::shared_ptr<cura::proto::Layer> CommandSocket::Private::getLayerById(int id)
 {
@@ -766,6 +1389,7 @@ std::shared_ptr<cura::proto::LayerOptimized> CommandSocket::Private::getOptimize
     {
         layer = std::make_shared<cura::proto::LayerOptimized>();
         layer->set_id(id);
+        layer->set_preview(preview);
         optimized_layers.current_layer_count++;
         optimized_layers.slice_data[id] = layer;
     }
@@ -775,30 +1399,209 @@ std::shared_ptr<cura::proto::LayerOptimized> CommandSocket::Private::getOptimize
 #endif
 
 #ifdef ARCUS
+std::shared_ptr<cura::proto::LayerOptimized> CommandSocket::Private::createOptimizedLayer(int layer_nr)
+{
+    std::shared_ptr<cura::proto::LayerOptimized> layer = std::make_shared<cura::proto::LayerOptimized>();
+    std::lock_guard<std::mutex> lock(optimized_layers_mutex);
+    layer->set_id(layer_nr + optimized_layers.current_layer_offset);
+    layer->set_preview(preview);
+    return layer;
+}
+
+void CommandSocket::Private::addOptimizedLayer(const std::shared_ptr<cura::proto::LayerOptimized>& layer)
+{
+    std::lock_guard<std::mutex> lock(optimized_layers_mutex);
+    auto itr = optimized_layers.slice_data.find(layer->id());
+    if (itr == optimized_layers.slice_data.end())
+    {
+        optimized_layers.current_layer_count++;
+        optimized_layers.slice_data[layer->id()] = layer;
+        return;
+    }
+    google::protobuf::RepeatedPtrField<cura::proto::PathSegment>& path_segments = *layer->mutable_path_segment();
+    for (cura::proto::PathSegment& path_segment : path_segments)
+    {
+        itr->second->add_path_segment()->Swap(&path_segment);
+    }
+}
+
+void CommandSocket::Private::sendCompletedOptimizedLayers()
+{
+    int min_active_layer_nr = INT_MAX;
+    {
+        std::lock_guard<std::mutex> lock(path_compilers_mutex);
+        for (const std::unique_ptr<PathCompiler>& path_compiler : path_compilers)
+        {
+            min_active_layer_nr = std::min(min_active_layer_nr, path_compiler->getActiveLayer());
+        }
+    }
+    if (min_active_layer_nr == INT_MAX)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(optimized_layers_mutex);
+    optimized_layers.sendLayersBefore(bulk_sender, min_active_layer_nr + optimized_layers.current_layer_offset);
+}
+
+CommandSocket::PathCompiler& CommandSocket::Private::getPathCompiler()
+{
+    thread_local Private* owner = nullptr;
+    thread_local PathCompiler* path_compiler = nullptr;
+    if (owner != this)
+    {
+        std::lock_guard<std::mutex> lock(path_compilers_mutex);
+        path_compilers.emplace_back(new PathCompiler(*this));
+        path_compiler = path_compilers.back().get();
+        owner = this;
+    }
+    return *path_compiler;
+}
+
+void CommandSocket::Private::flushPathCompilers()
+{
+    std::lock_guard<std::mutex> lock(path_compilers_mutex);
+    for (const std::unique_ptr<PathCompiler>& path_compiler : path_compilers)
+    {
+        path_compiler->finishLayer();
+    }
+}
+
+void CommandSocket::Private::discardPathCompilers()
+{
+    std::lock_guard<std::mutex> lock(path_compilers_mutex);
+    for (const std::unique_ptr<PathCompiler>& path_compiler : path_compilers)
+    {
+        path_compiler->discard();
+    }
+}
+
 void CommandSocket::PathCompiler::flushPathSegments()
 {
     if (line_types.size() > 0 && CommandSocket::isInstantiated())
     {
-        std::shared_ptr<cura::proto::LayerOptimized> proto_layer = _cs_private_data.getOptimizedLayerById(_layer_nr);
+        if (!layer)
+        {
+            layer = _cs_private_data.createOptimizedLayer(_layer_nr);
+        }
 
-        cura::proto::PathSegment* p = proto_layer->add_path_segment();
+        cura::proto::PathSegment* p = layer->add_path_segment();
         p->set_extruder(extruder);
         p->set_point_type(data_point_type);
-        std::string line_type_data;
-        line_type_data.append(reinterpret_cast<const char*>(line_types.data()), line_types.size()*sizeof(PrintFeatureType));
-        p->set_line_type(line_type_data);
-        std::string polydata;
-        polydata.append(reinterpret_cast<const char*>(points.data()), points.size() * sizeof(float));
-        p->set_points(polydata);
-        std::string line_width_data;
-        line_width_data.append(reinterpret_cast<const char*>(line_widths.data()), line_widths.size()*sizeof(float));
-        p->set_line_width(line_width_data);
+        if (_cs_private_data.compact_layer_data)
+        {
+            setCompactData(*p);
+        }
+        else
+        {
+            setFloatData(*p);
+        }
     }
     points.clear();
     line_widths.clear();
     line_types.clear();
 }
 
+void CommandSocket::PathCompiler::handOffLayer()
+{
+    flushPathSegments();
+    if (layer)
+    {
+        _cs_private_data.addOptimizedLayer(layer);
+        layer.reset();
+    }
+}
+
+void CommandSocket::PathCompiler::finishLayer()
+{
+    handOffLayer();
+    active_layer_nr.store(INT_MAX, std::memory_order_relaxed);
+}
+
+void CommandSocket::PathCompiler::setFloatData(cura::proto::PathSegment& path_segment) const
+{
+    std::string line_type_data;
+    line_type_data.append(reinterpret_cast<const char*>(line_types.data()), line_types.size()*sizeof(PrintFeatureType));
+    path_segment.set_line_type(line_type_data);
+    std::vector<float> point_coords;
+    point_coords.reserve(points.size() * 2);
+    for (Point point : points)
+    {
+        point_coords.push_back(INT2MM(point.X));
+        point_coords.push_back(INT2MM(point.Y));
+    }
+    std::string polydata;
+    polydata.append(reinterpret_cast<const char*>(point_coords.data()), point_coords.size() * sizeof(float));
+    path_segment.set_points(polydata);
+    std::vector<float> line_widths_mm;
+    line_widths_mm.reserve(line_widths.size());
+    for (int line_width : line_widths)
+    {
+        line_widths_mm.push_back(INT2MM(line_width));
+    }
+    std::string line_width_data;
+    line_width_data.append(reinterpret_cast<const char*>(line_widths_mm.data()), line_widths_mm.size()*sizeof(float));
+    path_segment.set_line_width(line_width_data);
+}
+
+namespace
+{
+void appendVarInt(std::string& data, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        data.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    data.push_back(static_cast<char>(value));
+}
+
+void appendZigZagVarInt(std::string& data, int64_t value)
+{
+    appendVarInt(data, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63)); // small negative numbers get small codes too
+}
+}
+
+void CommandSocket::PathCompiler::setCompactData(cura::proto::PathSegment& path_segment) const
+{
+    std::string point_data;
+    point_data.reserve(points.size() * 4); // most moves take less than two bytes per coordinate
+    Point previous(0, 0);
+    for (Point point : points)
+    {
+        appendZigZagVarInt(point_data, point.X - previous.X);
+        appendZigZagVarInt(point_data, point.Y - previous.Y);
+        previous = point;
+    }
+    path_segment.set_compact_points(point_data);
+
+    std::string line_type_data;
+    std::string line_width_data;
+    for (unsigned int run_start = 0; run_start < line_types.size(); )
+    {
+        unsigned int run_end = run_start + 1;
+        while (run_end < line_types.size() && line_types[run_end] == line_types[run_start])
+        {
+            run_end++;
+        }
+        appendVarInt(line_type_data, run_end - run_start);
+        line_type_data.push_back(static_cast<char>(line_types[run_start]));
+        run_start = run_end;
+    }
+    for (unsigned int run_start = 0; run_start < line_widths.size(); )
+    {
+        unsigned int run_end = run_start + 1;
+        while (run_end < line_widths.size() && line_widths[run_end] == line_widths[run_start])
+        {
+            run_end++;
+        }
+        appendVarInt(line_width_data, run_end - run_start);
+        appendVarInt(line_width_data, std::max(0, line_widths[run_start]));
+        run_start = run_end;
+    }
+    path_segment.set_compact_line_type(line_type_data);
+    path_segment.set_compact_line_width(line_width_data);
+}
+
 void CommandSocket::PathCompiler::sendLineTo(PrintFeatureType print_feature_type, Point to, int width)
 {
     assert(points.size() > 0 && "A point must already be in the buffer for sendLineTo(.) to function properly");
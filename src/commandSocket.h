@@ -7,6 +7,7 @@
 #include "progress/Progress.h"
 #include "PrintFeature.h"
 
+#include <atomic>
 #include <memory>
 
 #ifdef ARCUS
@@ -30,6 +31,23 @@ public:
 
     static bool isInstantiated(); //!< Check whether the singleton is instantiated
 
+    /*!
+     * Whether the paths have to be sent to the front end for the layer view at all.
+     * 
+     * When the front end has asked not to get the layer view, all the layer view calls return right away.
+     */
+    bool isSendingLayerView() const
+    {
+        return send_layer_view;
+    }
+
+    /*!
+     * Set whether to send the layer view, unless the Slice message asks not to.
+     * 
+     * \param send_layer_view Whether to send the optimized layers to the front end
+     */
+    void setSendLayerView(bool send_layer_view);
+
     /*!
      * Connect with the GUI
      * This creates and initialises the arcus socket and then continues listening for messages. 
@@ -47,8 +65,16 @@ public:
      * 
      * \param[in] list The list of objects to slice
      * \param[in] settings_per_extruder_train The extruder train settings to load into the meshgroup
+     * \param[in] preview Whether to load a copy of the meshgroup for the coarse preview, which is sliced before the meshgroup itself
      */
-    void handleObjectList(cura::proto::ObjectList* list, const google::protobuf::RepeatedPtrField<cura::proto::Extruder> settings_per_extruder_train);
+    void handleObjectList(const cura::proto::ObjectList* list, const google::protobuf::RepeatedPtrField<cura::proto::Extruder>& settings_per_extruder_train, bool preview = false);
+
+    /*!
+     * Slice the coarse preview of each meshgroup loaded for it, and send its layers and its estimates to the front end.
+     * 
+     * See FffProcessor::processPreview.
+     */
+    void slicePreview();
 #endif
     
     /*!
@@ -64,40 +90,47 @@ public:
     /*! 
      * Send a polygon to the front-end. This is used for the layerview in the GUI
      */
-    static void sendPolygons(cura::PrintFeatureType type, const cura::Polygons& polygons, int line_width);
+    void sendPolygons(cura::PrintFeatureType type, const cura::Polygons& polygons, int line_width);
 
     /*! 
      * Send a polygon to the front-end. This is used for the layerview in the GUI
      */
-    static void sendPolygon(cura::PrintFeatureType type, Polygon& polygon, int line_width);
+    void sendPolygon(cura::PrintFeatureType type, Polygon& polygon, int line_width);
 
     /*!
      * Send a line to the front-end. This is used for the layerview in the GUI
      */
-    static void sendLineTo(cura::PrintFeatureType type, Point to, int line_width);
+    void sendLineTo(cura::PrintFeatureType type, Point to, int line_width);
 
     /*!
-     * Set the current position of the path compiler to \p position. This is used for the layerview in the GUI
+     * Set the current position of the path compiler of the calling thread to \p position. This is used for the layerview in the GUI
      */
-    static void setSendCurrentPosition(Point position);
+    void setSendCurrentPosition(Point position);
 
     /*!
     * Set which layer is being used for the following calls to SendPolygons, SendPolygon and SendLineTo.
+    * Each thread sends to its own layer, so that layers can be sent from several threads at once.
     */
-    static void setLayerForSend(int layer_nr);
+    void setLayerForSend(int layer_nr);
 
      /*!
-     * Set which extruder is being used for the following calls to SendPolygons, SendPolygon and SendLineTo.
+     * Set which extruder is being used for the following calls to SendPolygons, SendPolygon and SendLineTo by the calling thread.
      */
-    static void setExtruderForSend(int extruder);
+    void setExtruderForSend(int extruder);
 
     /*!
-     * Send a polygon to the front-end if the command socket is instantiated. This is used for the layerview in the GUI
+     * Send polygons to a given layer of the layerview in the GUI, without changing the layer, extruder and position set for the calling thread.
+     *
+     * For the paths added while planning a layer, of which the gcode is written later, possibly while lower layers are still being written.
      */
-    static void sendPolygonsToCommandSocket(cura::PrintFeatureType type, int layer_nr, const cura::Polygons& polygons, int line_width);
+    void sendPolygonsOfLayer(cura::PrintFeatureType type, int layer_nr, int extruder, const cura::Polygons& polygons, int line_width);
 
     /*! 
      * Send progress to GUI
+     * 
+     * The layer loops report progress for every layer, from several threads at once,
+     * so the progress is only sent when it has changed noticeably and some time has passed since it was last sent.
+     * Can be called from any thread.
      */
     void sendProgress(float amount);
     
@@ -106,6 +139,11 @@ public:
      */
     void sendProgressStage(Progress::Stage stage);
     
+    /*!
+     * Forget the layer view data and the gcode of a cancelled slice which haven't been sent yet.
+     */
+    void discardSlice();
+
     /*!
      * Send time estimate of how long print would take.
      */
@@ -115,6 +153,13 @@ public:
      * Does nothing at the moment
      */
     void sendPrintMaterialForObject(int index, int extruder_nr, float material_amount);
+
+    /*!
+     * Send the time and memory used to slice the last mesh group, as recorded in the ProfilingReport.
+     *
+     * \param meshgroup_nr The index of the mesh group
+     */
+    void sendProfilingReport(int meshgroup_nr);
     
     /*!
      * Send the slices of the model as polygons to the GUI.
@@ -130,6 +175,10 @@ public:
      *
      * The GUI may use this to visualize the g-code, so that the user can
      * inspect the result of slicing.
+     *
+     * Each layer is already sent while the g-code is written, as soon as the
+     * paths of a higher layer are being sent; this sends the remaining layers
+     * of the mesh group.
      */
     void sendOptimizedLayerData();
 
@@ -149,12 +198,30 @@ public:
     void flushGcode();
     void sendGCodePrefix(std::string prefix);
 
-#ifdef ARCUS
 private:
+    static constexpr int64_t min_progress_interval = 50000000; //!< The minimal time between two progress messages in nanoseconds, so that at most 20 are sent per second
+    static constexpr float min_progress_change = 0.001; //!< The minimal change of the progress since the last message for which a new one is sent
+
+    std::atomic<float> last_sent_progress; //!< The progress last sent to the front end, or a negative number when none has been sent in this slice
+    std::atomic<int64_t> last_progress_time; //!< When the progress was last sent, in nanoseconds of the steady clock
+
+    /*!
+     * Check whether a progress value is worth sending and if so claim the right to send it, see CommandSocket::sendProgress.
+     * 
+     * When several threads report progress at the same time, only one of them gets to send it.
+     * 
+     * \param amount The progress to send
+     * \return Whether the progress should be sent
+     */
+    bool claimProgressMessage(float amount);
+
+    bool send_layer_view; //!< Whether to send the optimized layers to the front end
+    bool default_send_layer_view; //!< Whether to send the layer view when the Slice message doesn't ask to skip it, as set on the command line
+
+#ifdef ARCUS
     class Private;
     const std::unique_ptr<Private> private_data;
-    class PathCompiler;
-    const std::unique_ptr<PathCompiler> path_comp;
+    class PathCompiler; //!< Compiles the layer view sent by a single thread
 #endif
 };
 
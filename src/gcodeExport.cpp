@@ -1,5 +1,7 @@
 /** Copyright (C) 2013 David Braam - Released under terms of the AGPLv3 License */
 #include <stdarg.h>
+#include <stdio.h> // snprintf
+#include <algorithm> // min, max
 #include <iomanip>
 #include <cmath>
 
@@ -7,11 +9,75 @@
 #include "utils/logoutput.h"
 #include "PrintFeature.h"
 #include "utils/Date.h"
+#include "utils/ThreadPool.h"
 
 namespace cura {
 
+namespace
+{
+
+/*!
+ * Write a coordinate in microns as millimeters with three decimals.
+ * 
+ * This gives the same characters as writing INT2MM(\p value) to a stream with std::fixed and std::setprecision(3),
+ * but without the conversion to a double and the formatting machinery of the stream.
+ * 
+ * \param pos Where to write the characters
+ * \param value The coordinate in microns
+ * \return The position after the written characters
+ */
+char* writeMicrons(char* pos, int64_t value)
+{
+    uint64_t magnitude = value;
+    if (value < 0)
+    {
+        *pos++ = '-';
+        magnitude = -magnitude;
+    }
+    uint64_t millimeters = magnitude / 1000;
+    unsigned int fraction = magnitude % 1000;
+    char digits[20]; // the most digits a 64 bit integer can have
+    unsigned int digit_count = 0;
+    do
+    {
+        digits[digit_count++] = '0' + millimeters % 10;
+        millimeters /= 10;
+    } while (millimeters > 0);
+    while (digit_count > 0)
+    {
+        *pos++ = digits[--digit_count];
+    }
+    *pos++ = '.';
+    *pos++ = '0' + fraction / 100;
+    *pos++ = '0' + fraction / 10 % 10;
+    *pos++ = '0' + fraction % 10;
+    return pos;
+}
+
+/*!
+ * Write a floating point value with a fixed number of decimals, giving the same characters as a stream with std::fixed would.
+ * 
+ * \param pos Where to write the characters
+ * \param end The end of the buffer
+ * \param value The value to write
+ * \param precision The number of decimals
+ * \return The position after the written characters
+ */
+char* writeFixed(char* pos, char* end, double value, int precision)
+{
+    int length = snprintf(pos, end - pos, "%.*f", precision, value);
+    return pos + std::max(0, std::min(length, int(end - pos) - 1));
+}
+
+}//namespace
+
 GCodeExport::GCodeExport()
 : output_stream(&std::cout)
+, target_output_stream(&std::cout)
+, discarded_output(nullptr)
+, estimate_only(false)
+, buffered_output_stream(nullptr)
+, command_socket(nullptr)
 , currentPosition(0,0,MM2INT(20))
 , layer_nr(0)
 {
@@ -21,8 +87,6 @@ GCodeExport::GCodeExport()
     current_extruder = 0;
     currentFanSpeed = -1;
 
-    totalPrintTime = 0.0;
-
     currentSpeed = 1;
     current_acceleration = -1;
     current_jerk = -1;
@@ -41,35 +105,35 @@ GCodeExport::~GCodeExport()
 
 void GCodeExport::preSetup(const MeshGroup* settings)
 {
-    setFlavor(settings->getSettingAsGCodeFlavor("machine_gcode_flavor"));
-    use_extruder_offset_to_offset_coords = settings->getSettingBoolean("machine_use_extruder_offset_to_offset_coords");
+    setFlavor(settings->getSettingAsGCodeFlavor(SettingKey::machine_gcode_flavor));
+    use_extruder_offset_to_offset_coords = settings->getSettingBoolean(SettingKey::machine_use_extruder_offset_to_offset_coords);
 
-    extruder_count = settings->getSettingAsCount("machine_extruder_count");
+    extruder_count = settings->getSettingAsCount(SettingKey::machine_extruder_count);
 
     for (unsigned int extruder_nr = 0; extruder_nr < extruder_count; extruder_nr++)
     {
         const ExtruderTrain* train = settings->getExtruderTrain(extruder_nr);
         extruder_attr[extruder_nr].is_used |= settings->getExtruderTrain(extruder_nr)->getIsUsed();
 
-        setFilamentDiameter(extruder_nr, train->getSettingInMicrons("material_diameter")); 
+        setFilamentDiameter(extruder_nr, train->getSettingInMicrons(SettingKey::material_diameter)); 
 
-        extruder_attr[extruder_nr].prime_pos = Point3(train->getSettingInMicrons("extruder_prime_pos_x"), train->getSettingInMicrons("extruder_prime_pos_y"), train->getSettingInMicrons("extruder_prime_pos_z"));
-        extruder_attr[extruder_nr].prime_pos_is_abs = train->getSettingBoolean("extruder_prime_pos_abs");
+        extruder_attr[extruder_nr].prime_pos = Point3(train->getSettingInMicrons(SettingKey::extruder_prime_pos_x), train->getSettingInMicrons(SettingKey::extruder_prime_pos_y), train->getSettingInMicrons(SettingKey::extruder_prime_pos_z));
+        extruder_attr[extruder_nr].prime_pos_is_abs = train->getSettingBoolean(SettingKey::extruder_prime_pos_abs);
 
-        extruder_attr[extruder_nr].nozzle_size = train->getSettingInMicrons("machine_nozzle_size");
-        extruder_attr[extruder_nr].nozzle_offset = Point(train->getSettingInMicrons("machine_nozzle_offset_x"), train->getSettingInMicrons("machine_nozzle_offset_y"));
-        extruder_attr[extruder_nr].material_guid = train->getSettingString("material_guid");
+        extruder_attr[extruder_nr].nozzle_size = train->getSettingInMicrons(SettingKey::machine_nozzle_size);
+        extruder_attr[extruder_nr].nozzle_offset = Point(train->getSettingInMicrons(SettingKey::machine_nozzle_offset_x), train->getSettingInMicrons(SettingKey::machine_nozzle_offset_y));
+        extruder_attr[extruder_nr].material_guid = train->getSettingString(SettingKey::material_guid);
 
-        extruder_attr[extruder_nr].start_code = train->getSettingString("machine_extruder_start_code");
-        extruder_attr[extruder_nr].end_code = train->getSettingString("machine_extruder_end_code");
+        extruder_attr[extruder_nr].start_code = train->getSettingString(SettingKey::machine_extruder_start_code);
+        extruder_attr[extruder_nr].end_code = train->getSettingString(SettingKey::machine_extruder_end_code);
 
-        extruder_attr[extruder_nr].last_retraction_prime_speed = train->getSettingInMillimetersPerSecond("retraction_prime_speed"); // the alternative would be switch_extruder_prime_speed, but dual extrusion might not even be configured...
+        extruder_attr[extruder_nr].last_retraction_prime_speed = train->getSettingInMillimetersPerSecond(SettingKey::retraction_prime_speed); // the alternative would be switch_extruder_prime_speed, but dual extrusion might not even be configured...
     }
-    machine_dimensions.x = settings->getSettingInMicrons("machine_width");
-    machine_dimensions.y = settings->getSettingInMicrons("machine_depth");
-    machine_dimensions.z = settings->getSettingInMicrons("machine_height");
+    machine_dimensions.x = settings->getSettingInMicrons(SettingKey::machine_width);
+    machine_dimensions.y = settings->getSettingInMicrons(SettingKey::machine_depth);
+    machine_dimensions.z = settings->getSettingInMicrons(SettingKey::machine_height);
 
-    machine_name = settings->getSettingString("machine_name");
+    machine_name = settings->getSettingString(SettingKey::machine_name);
 
     if (flavor == EGCodeFlavor::BFB)
     {
@@ -89,11 +153,11 @@ void GCodeExport::setInitialTemps(const MeshGroup& settings)
     {
         const ExtruderTrain* extr_train = settings.getExtruderTrain(extr_nr);
         assert(extr_train);
-        double temp = extr_train->getSettingInDegreeCelsius((extr_nr == 0)? "material_print_temperature" : "material_standby_temperature");
+        double temp = extr_train->getSettingInDegreeCelsius((extr_nr == 0)? SettingKey::material_print_temperature : SettingKey::material_standby_temperature);
         setInitialTemp(extr_nr, temp);
     }
 
-    initial_bed_temp = settings.getSettingInDegreeCelsius("material_bed_temperature");
+    initial_bed_temp = settings.getSettingInDegreeCelsius(SettingKey::material_bed_temperature);
 }
 
 void GCodeExport::setInitialTemp(int extruder_nr, double temp)
@@ -167,6 +231,32 @@ std::string GCodeExport::getFileHeader(const double* print_time, const std::vect
     }
 }
 
+std::string GCodeExport::getFileTrailer(double print_time, const std::vector<double>& filament_used)
+{
+    std::ostringstream trailer;
+    switch (flavor)
+    {
+    case EGCodeFlavor::GRIFFIN:
+        trailer << ";PRINT.TIME:" << static_cast<int>(print_time) << new_line;
+        for (unsigned int extr_nr = 0; extr_nr < extruder_count && extr_nr < filament_used.size(); extr_nr++)
+        {
+            if (extruder_attr[extr_nr].is_used)
+            {
+                trailer << ";EXTRUDER_TRAIN." << extr_nr << ".MATERIAL.VOLUME_USED:" << static_cast<int>(filament_used[extr_nr]) << new_line;
+            }
+        }
+        return trailer.str();
+    default:
+        trailer << ";TIME:" << static_cast<int>(print_time) << new_line;
+        if (flavor == EGCodeFlavor::ULTIGCODE)
+        {
+            trailer << ";MATERIAL:" << ((filament_used.size() >= 1)? static_cast<int>(filament_used[0]) : 0) << new_line;
+            trailer << ";MATERIAL2:" << ((filament_used.size() >= 2)? static_cast<int>(filament_used[1]) : 0) << new_line;
+        }
+        return trailer.str();
+    }
+}
+
 
 void GCodeExport::setLayerNr(unsigned int layer_nr_) {
     layer_nr = layer_nr_;
@@ -174,10 +264,24 @@ void GCodeExport::setLayerNr(unsigned int layer_nr_) {
 
 void GCodeExport::setOutputStream(std::ostream* stream)
 {
-    output_stream = stream;
+    buffered_output_stream = nullptr; // a layer of which the writing was aborted
+    buffered_moves.clear();
+    target_output_stream = stream;
+    output_stream = estimate_only ? &discarded_output : stream;
     *output_stream << std::fixed;
 }
 
+void GCodeExport::setEstimateOnly(bool estimate_only)
+{
+    this->estimate_only = estimate_only;
+    setOutputStream(target_output_stream);
+}
+
+void GCodeExport::flushOutput()
+{
+    output_stream->flush();
+}
+
 bool GCodeExport::getExtruderIsUsed(int extruder_nr)
 {
     return extruder_attr[extruder_nr].is_used;
@@ -231,6 +335,19 @@ void GCodeExport::setFlavor(EGCodeFlavor flavor)
     {
         firmware_retract = false;
     }
+
+    if (flavor == EGCodeFlavor::BFB)
+    {
+        write_move = &GCodeExport::writeMoveBFB;
+    }
+    else if (is_volumatric)
+    {
+        write_move = firmware_retract ? &GCodeExport::writeMoveE<true, true> : &GCodeExport::writeMoveE<true, false>;
+    }
+    else
+    {
+        write_move = firmware_retract ? &GCodeExport::writeMoveE<false, true> : &GCodeExport::writeMoveE<false, false>;
+    }
 }
 
 EGCodeFlavor GCodeExport::getFlavor()
@@ -327,21 +444,20 @@ double GCodeExport::mmToE(double mm)
 double GCodeExport::getTotalFilamentUsed(int extruder_nr)
 {
     if (extruder_nr == current_extruder)
-        return extruder_attr[extruder_nr].totalFilament + getCurrentExtrudedVolume();
-    return extruder_attr[extruder_nr].totalFilament;
+        return statistics.getFilament(extruder_nr) + getCurrentExtrudedVolume();
+    return statistics.getFilament(extruder_nr);
 }
 
 double GCodeExport::getTotalPrintTime()
 {
-    return totalPrintTime;
+    return statistics.getPrintTime();
 }
 
 void GCodeExport::resetTotalPrintTimeAndFilament()
 {
-    totalPrintTime = 0;
+    statistics.reset();
     for(unsigned int e=0; e<MAX_EXTRUDERS; e++)
     {
-        extruder_attr[e].totalFilament = 0.0;
         extruder_attr[e].currentTemperature = 0;
     }
     current_e_value = 0.0;
@@ -350,9 +466,9 @@ void GCodeExport::resetTotalPrintTimeAndFilament()
 
 void GCodeExport::updateTotalPrintTime()
 {
-    totalPrintTime += estimateCalculator.calculate();
+    statistics.addPrintTime(estimateCalculator.calculate());
     estimateCalculator.reset();
-    writeTimeComment(totalPrintTime);
+    writeTimeComment(statistics.getPrintTime());
 }
 
 void GCodeExport::writeComment(std::string comment)
@@ -430,7 +546,7 @@ void GCodeExport::resetExtrusionValue()
     {
         *output_stream << "G92 " << extruder_attr[current_extruder].extruderCharacter << "0" << new_line;
         double current_extruded_volume = getCurrentExtrudedVolume();
-        extruder_attr[current_extruder].totalFilament += current_extruded_volume;
+        statistics.addFilament(current_extruder, current_extruded_volume);
         for (double& extruded_volume_at_retraction : extruder_attr[current_extruder].extruded_volume_at_previous_n_retractions)
         { // update the extruded_volume_at_previous_n_retractions only of the current extruder, since other extruders don't extrude the current volume
             extruded_volume_at_retraction -= current_extruded_volume;
@@ -523,13 +639,13 @@ void GCodeExport::writeMove(int x, int y, int z, double speed, double extrusion_
     if (extrusion_mm3_per_mm < 0)
         logWarning("Warning! Negative extrusion move!");
 
-    if (flavor == EGCodeFlavor::BFB)
-    {
-        writeMoveBFB(x, y, z, speed, extrusion_mm3_per_mm);
-        return;
-    }
+    (this->*write_move)(x, y, z, speed, extrusion_mm3_per_mm);
+}
 
-    double extrusion_per_mm = mm3ToE(extrusion_mm3_per_mm);
+template<bool volumetric, bool firmware_retraction>
+void GCodeExport::writeMoveE(int x, int y, int z, double speed, double extrusion_mm3_per_mm)
+{
+    double extrusion_per_mm = mm3ToE<volumetric>(extrusion_mm3_per_mm);
 
     Point gcode_pos = getGcodePos(x,y, current_extruder);
 
@@ -542,11 +658,11 @@ void GCodeExport::writeMove(int x, int y, int z, double speed, double extrusion_
             isZHopped = 0;
         }
         double prime_volume = extruder_attr[current_extruder].prime_volume;
-        current_e_value += mm3ToE(prime_volume);
+        current_e_value += mm3ToE<volumetric>(prime_volume);
         if (extruder_attr[current_extruder].retraction_e_amount_current)
         {
-            if (firmware_retract)
-            { // note that BFB is handled differently
+            if (firmware_retraction)
+            { // note that BFB is handled by writeMoveBFB
                 *output_stream << "G11" << new_line;
                 //Assume default UM2 retraction settings.
                 if (prime_volume > 0)
@@ -554,14 +670,14 @@ void GCodeExport::writeMove(int x, int y, int z, double speed, double extrusion_
                     *output_stream << "G1 F" << (extruder_attr[current_extruder].last_retraction_prime_speed * 60) << " " << extruder_attr[current_extruder].extruderCharacter << std::setprecision(5) << current_e_value << new_line;
                     currentSpeed = extruder_attr[current_extruder].last_retraction_prime_speed;
                 }
-                estimateCalculator.plan(TimeEstimateCalculator::Position(INT2MM(currentPosition.x), INT2MM(currentPosition.y), INT2MM(currentPosition.z), eToMm(current_e_value)), 25.0);
+                estimateCalculator.plan(TimeEstimateCalculator::Position(INT2MM(currentPosition.x), INT2MM(currentPosition.y), INT2MM(currentPosition.z), eToMm<volumetric>(current_e_value)), 25.0);
             }
             else
             {
                 current_e_value += extruder_attr[current_extruder].retraction_e_amount_current;
                 *output_stream << "G1 F" << (extruder_attr[current_extruder].last_retraction_prime_speed * 60) << " " << extruder_attr[current_extruder].extruderCharacter << std::setprecision(5) << current_e_value << new_line;
                 currentSpeed = extruder_attr[current_extruder].last_retraction_prime_speed;
-                estimateCalculator.plan(TimeEstimateCalculator::Position(INT2MM(currentPosition.x), INT2MM(currentPosition.y), INT2MM(currentPosition.z), eToMm(current_e_value)), currentSpeed);
+                estimateCalculator.plan(TimeEstimateCalculator::Position(INT2MM(currentPosition.x), INT2MM(currentPosition.y), INT2MM(currentPosition.z), eToMm<volumetric>(current_e_value)), currentSpeed);
             }
             if (getCurrentExtrudedVolume() > 10000.0) //According to https://github.com/Ultimaker/CuraEngine/issues/14 having more then 21m of extrusion causes inaccuracies. So reset it every 10m, just to be sure.
             {
@@ -573,36 +689,139 @@ void GCodeExport::writeMove(int x, int y, int z, double speed, double extrusion_
         {
             *output_stream << "G1 F" << (extruder_attr[current_extruder].last_retraction_prime_speed * 60) << " " << extruder_attr[current_extruder].extruderCharacter << std::setprecision(5) << current_e_value << new_line;
             currentSpeed = extruder_attr[current_extruder].last_retraction_prime_speed;
-            estimateCalculator.plan(TimeEstimateCalculator::Position(INT2MM(currentPosition.x), INT2MM(currentPosition.y), INT2MM(currentPosition.z), eToMm(current_e_value)), currentSpeed);
+            estimateCalculator.plan(TimeEstimateCalculator::Position(INT2MM(currentPosition.x), INT2MM(currentPosition.y), INT2MM(currentPosition.z), eToMm<volumetric>(current_e_value)), currentSpeed);
         }
         extruder_attr[current_extruder].prime_volume = 0.0;
         current_e_value += extrusion_per_mm * diff.vSizeMM();
-        *output_stream << "G1";
     }
-    else
+    else if (command_socket)
     {
-        *output_stream << "G0";
-
-        CommandSocket::sendLineTo(extruder_attr[current_extruder].retraction_e_amount_current ? PrintFeatureType::MoveRetraction : PrintFeatureType::MoveCombing, Point(x, y), extruder_attr[current_extruder].retraction_e_amount_current ? MM2INT(0.2) : MM2INT(0.1));
+        command_socket->sendLineTo(extruder_attr[current_extruder].retraction_e_amount_current ? PrintFeatureType::MoveRetraction : PrintFeatureType::MoveCombing, Point(x, y), extruder_attr[current_extruder].retraction_e_amount_current ? MM2INT(0.2) : MM2INT(0.1));
     }
 
+    const bool is_extrusion = extrusion_mm3_per_mm > 0.000001;
+    MoveLine move;
+    move.x = gcode_pos.X;
+    move.y = gcode_pos.Y;
+    move.z = z + isZHopped;
+    move.write_z = z != currentPosition.z + isZHopped;
+    move.feedrate = speed * 60;
+    move.feedrate_precision = -1;
     if (currentSpeed != speed)
     {
-        *output_stream << " F" << (speed * 60);
+        move.feedrate_precision = output_stream->precision(); // with the precision left by the previous line, like before
         currentSpeed = speed;
     }
-
-    *output_stream << std::setprecision(3) << 
-        " X" << INT2MM(gcode_pos.X) << 
-        " Y" << INT2MM(gcode_pos.Y);
-    if (z != currentPosition.z + isZHopped)
-        *output_stream << " Z" << INT2MM(z + isZHopped);
-    if (extrusion_mm3_per_mm > 0.000001)
-        *output_stream << " " << extruder_attr[current_extruder].extruderCharacter << std::setprecision(5) << current_e_value;
-    *output_stream << new_line;
+    move.e = current_e_value;
+    move.e_character = is_extrusion ? extruder_attr[current_extruder].extruderCharacter : 0;
+    if (estimate_only)
+    {
+        // the state above is all the estimates need
+    }
+    else if (buffered_output_stream)
+    {
+        buffered_moves.push_back(BufferedMove{static_cast<size_t>(buffered_text.tellp()), move});
+    }
+    else
+    {
+        // moves are by far the most written lines, so they are formatted into a buffer directly instead of through the stream
+        char line[1024]; // enough for the longest possible doubles
+        char* pos = formatMoveLine(move, line, line + sizeof(line));
+        output_stream->write(line, pos - line);
+    }
+    output_stream->precision(is_extrusion ? 5 : 3); // later lines rely on the precision of the stream
     
     currentPosition = Point3(x, y, z);
-    estimateCalculator.plan(TimeEstimateCalculator::Position(INT2MM(currentPosition.x), INT2MM(currentPosition.y), INT2MM(currentPosition.z), eToMm(current_e_value)), speed);
+    estimateCalculator.plan(TimeEstimateCalculator::Position(INT2MM(currentPosition.x), INT2MM(currentPosition.y), INT2MM(currentPosition.z), eToMm<volumetric>(current_e_value)), speed);
+}
+
+char* GCodeExport::formatMoveLine(const MoveLine& line, char* pos, char* end) const
+{
+    *pos++ = 'G';
+    *pos++ = line.e_character ? '1' : '0';
+    if (line.feedrate_precision >= 0)
+    {
+        *pos++ = ' ';
+        *pos++ = 'F';
+        pos = writeFixed(pos, end, line.feedrate, line.feedrate_precision);
+    }
+    *pos++ = ' ';
+    *pos++ = 'X';
+    pos = writeMicrons(pos, line.x);
+    *pos++ = ' ';
+    *pos++ = 'Y';
+    pos = writeMicrons(pos, line.y);
+    if (line.write_z)
+    {
+        *pos++ = ' ';
+        *pos++ = 'Z';
+        pos = writeMicrons(pos, line.z);
+    }
+    if (line.e_character)
+    {
+        *pos++ = ' ';
+        *pos++ = line.e_character;
+        pos = writeFixed(pos, end, line.e, 5);
+    }
+    return std::copy(new_line.begin(), new_line.end(), pos);
+}
+
+void GCodeExport::startBufferingMoves()
+{
+    if (buffered_output_stream || estimate_only)
+    {
+        return;
+    }
+    buffered_output_stream = output_stream;
+    buffered_text.str(std::string());
+    buffered_text.flags(output_stream->flags());
+    buffered_text.precision(output_stream->precision());
+    output_stream = &buffered_text;
+}
+
+void GCodeExport::writeBufferedMoves()
+{
+    if (!buffered_output_stream)
+    {
+        return;
+    }
+    output_stream = buffered_output_stream;
+    buffered_output_stream = nullptr;
+    output_stream->precision(buffered_text.precision());
+    const std::string text = buffered_text.str();
+    buffered_text.str(std::string());
+
+    if (buffered_moves.empty())
+    {
+        output_stream->write(text.data(), text.size());
+        return;
+    }
+    // each chunk is the text from its first move up to the first move of the next chunk
+    constexpr unsigned int chunk_size = 2048;
+    const unsigned int chunk_count = (buffered_moves.size() + chunk_size - 1) / chunk_size;
+    std::vector<std::string> chunks(chunk_count);
+    ThreadPool::getInstance()->parallelFor(0, chunk_count, [&](int chunk_idx)
+        {
+            const size_t first_move_idx = chunk_idx * chunk_size;
+            const size_t end_move_idx = std::min<size_t>(first_move_idx + chunk_size, buffered_moves.size());
+            const size_t text_end = (end_move_idx < buffered_moves.size()) ? buffered_moves[end_move_idx].text_offset : text.size();
+            std::string& chunk = chunks[chunk_idx];
+            chunk.reserve(text_end - buffered_moves[first_move_idx].text_offset + (end_move_idx - first_move_idx) * 40); // a typical move line
+            char line[1024]; // enough for the longest possible doubles
+            for (size_t move_idx = first_move_idx; move_idx < end_move_idx; move_idx++)
+            {
+                const BufferedMove& move = buffered_moves[move_idx];
+                chunk.append(line, formatMoveLine(move.line, line, line + sizeof(line)) - line);
+                const size_t next_offset = (move_idx + 1 < buffered_moves.size()) ? buffered_moves[move_idx + 1].text_offset : text.size();
+                chunk.append(text, move.text_offset, next_offset - move.text_offset);
+            }
+        });
+    output_stream->write(text.data(), buffered_moves.front().text_offset);
+    for (const std::string& chunk : chunks)
+    {
+        output_stream->write(chunk.data(), chunk.size());
+    }
+    buffered_moves.clear();
 }
 
 void GCodeExport::writeRetraction(RetractionConfig* config, bool force, bool extruder_switch)
@@ -714,13 +933,36 @@ void GCodeExport::startExtruder(int new_extruder)
     resetExtrusionValue(); // zero the E value on the new extruder, just to be sure
 
     writeCode(extruder_attr[new_extruder].start_code.c_str());
-    CommandSocket::setExtruderForSend(new_extruder);
-    CommandSocket::setSendCurrentPosition( getPositionXY() );
+    if (command_socket)
+    {
+        command_socket->setExtruderForSend(new_extruder);
+        command_socket->setSendCurrentPosition( getPositionXY() );
+    }
 
     //Change the Z position so it gets re-writting again. We do not know if the switch code modified the Z position.
     currentPosition.z += 1;
 }
 
+void GCodeExport::resumeRetracted(int extruder_nr, const RetractionConfig& retraction_config)
+{
+    if (flavor == EGCodeFlavor::MAKERBOT)
+    {
+        *output_stream << "M135 T" << extruder_nr << new_line;
+    }
+    else
+    {
+        *output_stream << "T" << extruder_nr << new_line;
+    }
+    current_extruder = extruder_nr;
+    extruder_attr[extruder_nr].retraction_e_amount_current = mmToE(retraction_config.distance);
+    extruder_attr[extruder_nr].last_retraction_prime_speed = retraction_config.primeSpeed;
+    resetExtrusionValue(); // E0 is the retracted position
+    if (command_socket)
+    {
+        command_socket->setExtruderForSend(extruder_nr);
+    }
+}
+
 void GCodeExport::switchExtruder(int new_extruder, const RetractionConfig& retraction_config_old_extruder)
 {
     if (current_extruder == new_extruder)
@@ -5,12 +5,14 @@
 #include <stdio.h>
 #include <deque> // for extrusionAmountAtPreviousRetractions
 #include <sstream> // for stream.str()
+#include <vector>
 
 #include "settings/settings.h"
 #include "utils/intpoint.h"
 #include "utils/NoCopy.h"
 #include "timeEstimate.h"
 #include "MeshGroup.h"
+#include "PrintStatistics.h"
 #include "commandSocket.h"
 #include "RetractionConfig.h"
 
@@ -52,7 +54,6 @@ private:
         std::string end_code;
         double filament_area; //!< in mm^2 for non-volumetric, cylindrical filament
 
-        double totalFilament; //!< total filament used per extruder in mm^3
         int currentTemperature;
         int initial_temp; //!< Temperature this nozzle needs to be at the start of the print.
 
@@ -74,7 +75,6 @@ private:
         , start_code("")
         , end_code("")
         , filament_area(0)
-        , totalFilament(0)
         , currentTemperature(0)
         , initial_temp(0)
         , retraction_e_amount_current(0.0)
@@ -89,8 +89,50 @@ private:
     Point3 machine_dimensions;
     std::string machine_name;
 
-    std::ostream* output_stream;
+    std::ostream* output_stream; //!< Where the gcode is written: the target stream, or GCodeExport::discarded_output when only estimating
     std::string new_line;
+    std::ostream* target_output_stream; //!< The stream given to GCodeExport::setOutputStream
+    std::ostream discarded_output; //!< A stream without buffer, on which all output fails early without being formatted
+    bool estimate_only; //!< Whether only the print time and material estimates are computed, without any gcode text
+
+    /*!
+     * A move line as written by GCodeExport::writeMoveE, with the state of the exporter it depends on already resolved.
+     */
+    struct MoveLine
+    {
+        int64_t x; //!< The X coordinate in the gcode, in microns
+        int64_t y; //!< The Y coordinate in the gcode, in microns
+        int64_t z; //!< The Z coordinate in microns, if \ref MoveLine::write_z
+        double feedrate; //!< The F value in mm/min, if \ref MoveLine::feedrate_precision isn't negative
+        double e; //!< The E value, if \ref MoveLine::e_character isn't zero
+        int feedrate_precision; //!< The number of decimals of the F value, or -1 if the feedrate didn't change
+        char e_character; //!< The character of the E axis for an extrusion, or zero for a travel move
+        bool write_z; //!< Whether the Z coordinate changed
+    };
+
+    /*!
+     * A move line which is formatted later, at \ref BufferedMove::text_offset in the other gcode of the layer.
+     */
+    struct BufferedMove
+    {
+        size_t text_offset; //!< The number of characters of GCodeExport::buffered_text written before the move
+        MoveLine line; //!< The move itself
+    };
+
+    std::ostream* buffered_output_stream; //!< While moves are buffered, the stream to write everything to at the end of the layer; otherwise nullptr
+    std::ostringstream buffered_text; //!< While moves are buffered, all gcode except the moves, which GCodeExport::output_stream points to meanwhile
+    std::vector<BufferedMove> buffered_moves; //!< The moves buffered since GCodeExport::startBufferingMoves, in order
+
+    /*!
+     * Format a move line, including the line ending.
+     * 
+     * \param line The move to format
+     * \param pos Where to write the characters
+     * \param end The end of the room for the characters, which should fit the longest possible line
+     * \return The position after the written characters
+     */
+    char* formatMoveLine(const MoveLine& line, char* pos, char* end) const;
+    CommandSocket* command_socket; //!< Where the travel moves are sent for the layer view, or nullptr
 
     double current_e_value; //!< The last E value written to gcode (in mm or mm^3)
     Point3 currentPosition;
@@ -113,12 +155,18 @@ private:
     int currentFanSpeed;
     EGCodeFlavor flavor;
 
-    double totalPrintTime; //!< The total estimated print time in seconds
+    PrintStatistics statistics; //!< The estimated print time and the material used by each extruder, up to the last G92 of the current extruder
     TimeEstimateCalculator estimateCalculator;
     
     bool is_volumatric;
     bool firmware_retract; //!< whether retractions are done in the firmware, or hardcoded in E values.
 
+    /*!
+     * The instance of writeMove for the flavor, chosen in GCodeExport::setFlavor:
+     * GCodeExport::writeMoveBFB or an instance of GCodeExport::writeMoveE for whether E is volumetric and whether retraction is done in the firmware.
+     */
+    void (GCodeExport::*write_move)(int x, int y, int z, double speed, double extrusion_per_mm);
+
     unsigned int layer_nr; //!< for sending travel data
 
     int initial_bed_temp; //!< bed temperature at the beginning of the print.
@@ -156,6 +204,32 @@ protected:
      */
     double mmToE(double mm);
 
+    /*!
+     * Convert a volume value to an E value for the current extruder, with the kind of E axis known at compile time.
+     * 
+     * \tparam volumetric Whether the E axis is volumetric, as GCodeExport::is_volumatric
+     * \param mm3 the value to convert
+     * \return the value converted to mm or mm3 depending on whether the E axis is volumetric
+     */
+    template<bool volumetric>
+    double mm3ToE(double mm3)
+    {
+        return volumetric ? mm3 : mm3 / extruder_attr[current_extruder].filament_area;
+    }
+
+    /*!
+     * Convert an E value to a value in mm for the current extruder, with the kind of E axis known at compile time.
+     * 
+     * \tparam volumetric Whether the E axis is volumetric, as GCodeExport::is_volumatric
+     * \param e the value to convert
+     * \return the value converted to mm
+     */
+    template<bool volumetric>
+    double eToMm(double e)
+    {
+        return volumetric ? e / extruder_attr[current_extruder].filament_area : e;
+    }
+
 public:
     
     GCodeExport();
@@ -171,10 +245,61 @@ public:
      */
     std::string getFileHeader(const double* print_time = nullptr, const std::vector<double>& filament_used = std::vector<double>(), const std::vector<std::string>& mat_ids = std::vector<std::string>());
 
+    /*!
+     * Get the fields of the file header which depend on the whole print, with their final values.
+     * 
+     * When the gcode is read while it's being written, the header is written before these are known,
+     * so they're repeated at the end of the file, where a reader which takes the last value of each field finds the final ones.
+     * 
+     * \param print_time The total print time in seconds of the whole gcode
+     * \param filament_used The total mm^3 filament used for each extruder
+     * \return The string representing the file trailer
+     */
+    std::string getFileTrailer(double print_time, const std::vector<double>& filament_used);
+
     void setLayerNr(unsigned int layer_nr);
     
     void setOutputStream(std::ostream* stream);
 
+    /*!
+     * Set whether only the print time and the material used are estimated, as for quoting a print.
+     * 
+     * The state of the printer is still tracked for every command, so that the estimates are the same as when writing the gcode,
+     * but the moves aren't formatted and all other gcode goes to a stream which discards it before formatting.
+     * 
+     * \param estimate_only Whether to skip writing the gcode
+     */
+    void setEstimateOnly(bool estimate_only);
+
+    /*!
+     * Whether only the print time and the material used are estimated, see GCodeExport::setEstimateOnly.
+     */
+    bool isEstimateOnly() const
+    {
+        return estimate_only;
+    }
+
+    /*!
+     * Hand the gcode written so far to the file or stream it's written to, rather than keeping it buffered.
+     */
+    void flushOutput();
+
+    /*!
+     * Set where to send the layer view of the written paths, or nullptr to not send it.
+     */
+    void setCommandSocket(CommandSocket* command_socket)
+    {
+        this->command_socket = command_socket;
+    }
+
+    /*!
+     * Get where the layer view of the written paths is sent, or nullptr.
+     */
+    CommandSocket* getCommandSocket() const
+    {
+        return command_socket;
+    }
+
     bool getExtruderIsUsed(int extruder_nr); //!< Returns whether the extruder with the given index is used up until the current meshgroup
 
     int getNozzleSize(int extruder_nr);
@@ -223,6 +348,19 @@ public:
      * \return total print time in seconds
      */
     double getTotalPrintTime();
+
+    /*!
+     * Get the estimated print time and the material used, of which the material of the current extruder only
+     * up to the last reset of its E value, see GCodeExport::resetExtrusionValue.
+     * 
+     * The amounts are kept in the order of the gcode, so that the statistics of the gcode written since
+     * PrintStatistics::getAmountCount can be taken apart and merged again with bit-identical totals.
+     */
+    const PrintStatistics& getPrintStatistics() const
+    {
+        return statistics;
+    }
+
     void updateTotalPrintTime();
     void resetTotalPrintTimeAndFilament();
     
@@ -248,6 +386,23 @@ public:
     void resetExtrusionValue();
     
     void writeDelay(double timeAmount);
+
+    /*!
+     * Collect the moves written from now on, to format them in parallel in GCodeExport::writeBufferedMoves.
+     * 
+     * Formatting the numbers of the moves is most of the time spent writing a layer, but the state it depends on,
+     * like the E value, the feedrate and the position, is only known after all earlier commands.
+     * So the moves are planned serially as before, which resolves that state, and only their text is formatted later.
+     * Everything else is meanwhile written to a buffer, and the moves are put between it in order when writing the buffered moves.
+     */
+    void startBufferingMoves();
+
+    /*!
+     * Format the moves collected since GCodeExport::startBufferingMoves in chunks on the threads of the ThreadPool,
+     * and write them together with the other buffered gcode to the output stream.
+     * Nothing happens if the moves weren't buffered.
+     */
+    void writeBufferedMoves();
     
     void writeMove(Point p, double speed, double extrusion_per_mm);
     
@@ -258,6 +413,14 @@ private:
      * The writeMove when flavor == BFB
      */
     void writeMoveBFB(int x, int y, int z, double speed, double extrusion_per_mm);
+    /*!
+     * The writeMove of all flavors which write E values, compiled for each kind of E axis and retraction so that the branches on them fold away.
+     * 
+     * \tparam volumetric Whether the E axis is volumetric, as GCodeExport::is_volumatric
+     * \tparam firmware_retraction Whether retractions are done in the firmware, as GCodeExport::firmware_retract
+     */
+    template<bool volumetric, bool firmware_retraction>
+    void writeMoveE(int x, int y, int z, double speed, double extrusion_per_mm);
 public:
     void writeRetraction(RetractionConfig* config, bool force = false, bool extruder_switch = false);
 
@@ -291,6 +454,17 @@ public:
      */
     void switchExtruder(int new_extruder, const RetractionConfig& retraction_config_old_extruder);
 
+    /*!
+     * Continue gcode of which the part before was written by another process, which left the nozzle retracted.
+     * 
+     * Selects the extruder and zeroes its E value, without any retraction or extruder start gcode,
+     * so that the next extrusion primes the retracted distance.
+     * 
+     * \param extruder_nr The extruder with which to continue
+     * \param retraction_config The retraction config with which the filament of that extruder was retracted
+     */
+    void resumeRetracted(int extruder_nr, const RetractionConfig& retraction_config);
+
     void writeCode(const char* str);
     
     /*!
@@ -1,8 +1,17 @@
+#include <algorithm> // upper_bound
+#include <cmath> // M_PI
 #include <cstring>
+#include <limits>
+#include <unordered_map>
 #include "gcodePlanner.h"
 #include "pathOrderOptimizer.h"
 #include "sliceDataStorage.h"
+#include "progress/SlowLayerCapture.h"
+#include "utils/gettime.h"
+#include "utils/linearAlg2D.h"
 #include "utils/polygonUtils.h"
+#include "utils/ThreadPool.h"
+#include "utils/Trace.h"
 #include "MergeInfillLines.h"
 
 namespace cura {
@@ -33,6 +42,7 @@ ExtruderPlan::ExtruderPlan(int extruder, Point start_position, int layer_nr, int
 , travelSpeedFactor(1.0)
 , extraTime(0.0)
 , totalPrintTime(0)
+, slowest_extrusion_speed(std::numeric_limits<double>::infinity())
 {
 }
 
@@ -78,6 +88,8 @@ GCodePath* GCodePlanner::getLatestPathWithConfig(GCodePathConfig* config, SpaceF
     ret->flow = flow;
     ret->spiralize = spiralize;
     ret->space_fill_type = space_fill_type;
+    ret->points_start = extruder_plans.back().path_points.size();
+    ret->point_count = 0;
     return ret;
 }
 
@@ -88,7 +100,7 @@ void GCodePlanner::forceNewPathStart()
         paths[paths.size()-1].done = true;
 }
 
-GCodePlanner::GCodePlanner(SliceDataStorage& storage, unsigned int layer_nr, int z, int layer_thickness, Point last_position, int current_extruder, bool is_inside_mesh, std::vector<FanSpeedLayerTimeSettings>& fan_speed_layer_time_settings_per_extruder, CombingMode combing_mode, int64_t comb_boundary_offset, bool travel_avoid_other_parts, int64_t travel_avoid_distance)
+GCodePlanner::GCodePlanner(SliceDataStorage& storage, unsigned int layer_nr, int z, int layer_thickness, Point last_position, int current_extruder, bool is_inside_mesh, std::vector<FanSpeedLayerTimeSettings>& fan_speed_layer_time_settings_per_extruder, CombingMode combing_mode, int64_t comb_boundary_offset, bool travel_avoid_other_parts, int64_t travel_avoid_distance, std::shared_ptr<CombBoundaryInside> prepared_comb_boundary_inside)
 : storage(storage)
 , layer_nr(layer_nr)
 , z(z)
@@ -97,8 +109,9 @@ GCodePlanner::GCodePlanner(SliceDataStorage& storage, unsigned int layer_nr, int
 , lastPosition(last_position)
 , last_extruder_previous_layer(current_extruder)
 , last_planned_extruder_setting_base(storage.meshgroup->getExtruderTrain(current_extruder))
-, comb_boundary_inside(computeCombBoundaryInside(combing_mode))
+, comb_boundary_inside(prepared_comb_boundary_inside ? prepared_comb_boundary_inside : getCombBoundaryInside(storage, layer_nr, combing_mode))
 , fan_speed_layer_time_settings_per_extruder(fan_speed_layer_time_settings_per_extruder)
+, configs_frozen(false)
 {
     extruder_plans.reserve(storage.meshgroup->getExtruderCount());
     extruder_plans.emplace_back(current_extruder, start_position, layer_nr, layer_thickness, fan_speed_layer_time_settings_per_extruder[current_extruder], storage.retraction_config_per_extruder[current_extruder]);
@@ -125,7 +138,55 @@ SettingsBaseVirtual* GCodePlanner::getLastPlannedExtruderTrainSettings()
 }
 
 
-Polygons GCodePlanner::computeCombBoundaryInside(CombingMode combing_mode)
+void GCodePlanner::reuseBuffers(GCodePlanner& written)
+{
+    for (ExtruderPlan& extruder_plan : written.extruder_plans)
+    {
+        extruder_plan.paths.clear(); // keeps the capacity
+        spare_path_buffers.emplace_back(std::move(extruder_plan.paths));
+        extruder_plan.path_points.clear();
+        spare_point_buffers.emplace_back(std::move(extruder_plan.path_points));
+    }
+    for (std::vector<GCodePath>& spare_path_buffer : written.spare_path_buffers)
+    {
+        spare_path_buffers.emplace_back(std::move(spare_path_buffer));
+    }
+    for (std::vector<Point>& spare_point_buffer : written.spare_point_buffers)
+    {
+        spare_point_buffers.emplace_back(std::move(spare_point_buffer));
+    }
+    for (ExtruderPlan& extruder_plan : extruder_plans)
+    {
+        useSparePathBuffer(extruder_plan);
+    }
+}
+
+void GCodePlanner::useSparePathBuffer(ExtruderPlan& extruder_plan)
+{
+    if (!extruder_plan.paths.empty())
+    {
+        return;
+    }
+    if (!spare_path_buffers.empty())
+    {
+        extruder_plan.paths.swap(spare_path_buffers.back());
+        spare_path_buffers.pop_back();
+    }
+    if (!spare_point_buffers.empty())
+    {
+        extruder_plan.path_points.swap(spare_point_buffers.back());
+        spare_point_buffers.pop_back();
+    }
+}
+
+std::shared_ptr<CombBoundaryInside> GCodePlanner::getCombBoundaryInside(SliceDataStorage& storage, int layer_nr, CombingMode combing_mode)
+{
+    std::vector<unsigned int> part_starts;
+    const Polygons boundary = computeCombBoundaryInside(storage, layer_nr, combing_mode, part_starts);
+    return storage.comb_boundary_cache.getInside(boundary, part_starts);
+}
+
+Polygons GCodePlanner::computeCombBoundaryInside(SliceDataStorage& storage, int layer_nr, CombingMode combing_mode, std::vector<unsigned int>& part_starts)
 {
     if (combing_mode == CombingMode::OFF)
     {
@@ -145,24 +206,31 @@ Polygons GCodePlanner::computeCombBoundaryInside(CombingMode combing_mode)
     else 
     {
         Polygons comb_boundary;
+        unsigned int contributing_mesh_count = 0;
         for (SliceMeshStorage& mesh : storage.meshes)
         {
             SliceLayer& layer = mesh.layers[layer_nr];
-            if (mesh.getSettingAsCombingMode("retraction_combing") == CombingMode::NO_SKIN)
+            if (mesh.getSettingAsCombingMode(SettingKey::retraction_combing) == CombingMode::NO_SKIN)
             {
                 for (SliceLayerPart& part : layer.parts)
                 {
+                    part_starts.push_back(comb_boundary.size());
                     comb_boundary.add(part.infill_area);
                 }
             }
             else
             {
-                if (mesh.getSettingBoolean("infill_mesh"))
+                if (mesh.getSettingBoolean(SettingKey::infill_mesh))
                 {
                     continue;
                 }
-                layer.getSecondOrInnermostWalls(comb_boundary);
+                layer.getSecondOrInnermostWalls(comb_boundary, &part_starts);
             }
+            contributing_mesh_count++;
+        }
+        if (contributing_mesh_count > 1)
+        { // the areas of different meshes may overlap, in which case they are only split into parts correctly by a PolyTree over all of them
+            part_starts.clear();
         }
         return comb_boundary;
     }
@@ -182,15 +250,15 @@ bool GCodePlanner::setExtruder(int extruder)
     setIsInside(false);
     { // handle end position of the prev extruder
         SettingsBaseVirtual* train = getLastPlannedExtruderTrainSettings();
-        bool end_pos_absolute = train->getSettingBoolean("machine_extruder_end_pos_abs");
-        Point end_pos(train->getSettingInMicrons("machine_extruder_end_pos_x"), train->getSettingInMicrons("machine_extruder_end_pos_y"));
+        bool end_pos_absolute = train->getSettingBoolean(SettingKey::machine_extruder_end_pos_abs);
+        Point end_pos(train->getSettingInMicrons(SettingKey::machine_extruder_end_pos_x), train->getSettingInMicrons(SettingKey::machine_extruder_end_pos_y));
         if (!end_pos_absolute)
         {
             end_pos += lastPosition;
         }
         else 
         {
-            Point extruder_offset(train->getSettingInMicrons("machine_nozzle_offset_x"), train->getSettingInMicrons("machine_nozzle_offset_y"));
+            Point extruder_offset(train->getSettingInMicrons(SettingKey::machine_nozzle_offset_x), train->getSettingInMicrons(SettingKey::machine_nozzle_offset_y));
             end_pos += extruder_offset; // absolute end pos is given as a head position
         }
         addTravel(end_pos); //  + extruder_offset cause it 
@@ -202,6 +270,7 @@ bool GCodePlanner::setExtruder(int extruder)
     else 
     {
         extruder_plans.emplace_back(extruder, lastPosition, layer_nr, layer_thickness, fan_speed_layer_time_settings_per_extruder[extruder], storage.retraction_config_per_extruder[extruder]);
+        useSparePathBuffer(extruder_plans.back());
     }
     last_planned_extruder_setting_base = storage.meshgroup->getExtruderTrain(extruder);
 
@@ -209,15 +278,15 @@ bool GCodePlanner::setExtruder(int extruder)
 
     { // handle starting pos of the new extruder
         SettingsBaseVirtual* train = getLastPlannedExtruderTrainSettings();
-        bool start_pos_absolute = train->getSettingBoolean("machine_extruder_start_pos_abs");
-        Point start_pos(train->getSettingInMicrons("machine_extruder_start_pos_x"), train->getSettingInMicrons("machine_extruder_start_pos_y"));
+        bool start_pos_absolute = train->getSettingBoolean(SettingKey::machine_extruder_start_pos_abs);
+        Point start_pos(train->getSettingInMicrons(SettingKey::machine_extruder_start_pos_x), train->getSettingInMicrons(SettingKey::machine_extruder_start_pos_y));
         if (!start_pos_absolute)
         {
             start_pos += lastPosition;
         }
         else 
         {
-            Point extruder_offset(train->getSettingInMicrons("machine_nozzle_offset_x"), train->getSettingInMicrons("machine_nozzle_offset_y"));
+            Point extruder_offset(train->getSettingInMicrons(SettingKey::machine_nozzle_offset_x), train->getSettingInMicrons(SettingKey::machine_nozzle_offset_y));
             start_pos += extruder_offset; // absolute start pos is given as a head position
         }
         lastPosition = start_pos;
@@ -230,11 +299,11 @@ void GCodePlanner::moveInsideCombBoundary(int distance)
     int max_dist2 = MM2INT(2.0) * MM2INT(2.0); // if we are further than this distance, we conclude we are not inside even though we thought we were.
     // this function is to be used to move from the boudary of a part to inside the part
     Point p = lastPosition; // copy, since we are going to move p
-    if (PolygonUtils::moveInside(comb_boundary_inside, p, distance, max_dist2) != NO_INDEX)
+    if (PolygonUtils::moveInside(comb_boundary_inside->polygons, p, distance, max_dist2) != NO_INDEX)
     {
         //Move inside again, so we move out of tight 90deg corners
-        PolygonUtils::moveInside(comb_boundary_inside, p, distance, max_dist2);
-        if (comb_boundary_inside.inside(p))
+        PolygonUtils::moveInside(comb_boundary_inside->polygons, p, distance, max_dist2);
+        if (comb_boundary_inside->polygons.inside(p))
         {
             addTravel_simple(p);
             //Make sure the that any retraction happens after this move, not before it by starting a new move path.
@@ -251,16 +320,16 @@ void GCodePlanner::addTravel(Point p)
     
     bool combed = false;
 
-    SettingsBaseVirtual* extr = getLastPlannedExtruderTrainSettings();
+    const TravelConfig& travel_policy = storage.travel_policy_per_extruder[getExtruder()];
 
-    const bool perform_z_hops = extr->getSettingBoolean("retraction_hop_enabled");
+    const bool perform_z_hops = travel_policy.perform_z_hops;
 
     const bool is_first_travel_of_extruder_after_switch = extruder_plans.back().paths.size() == 0 && (extruder_plans.size() > 1 || last_extruder_previous_layer != getExtruder());
-    const bool bypass_combing = is_first_travel_of_extruder_after_switch && extr->getSettingBoolean("retraction_hop_after_extruder_switch");
+    const bool bypass_combing = is_first_travel_of_extruder_after_switch && travel_policy.z_hop_after_extruder_switch;
 
     if (comb != nullptr && !bypass_combing && lastPosition != no_point)
     {
-        const bool perform_z_hops_only_when_collides = extr->getSettingBoolean("retraction_hop_only_when_collides");
+        const bool perform_z_hops_only_when_collides = travel_policy.z_hops_only_when_collides;
 
         CombPaths combPaths;
         bool via_outside_makes_combing_fail = perform_z_hops && !perform_z_hops_only_when_collides;
@@ -307,7 +376,7 @@ void GCodePlanner::addTravel(Point p)
                 // don't perform a z-hop
                 for (Point& combPoint : combPath)
                 {
-                    path->points.push_back(combPoint);
+                    extruder_plans.back().addPoint(*path, combPoint);
                 }
                 lastPosition = combPath.back();
             }
@@ -320,8 +389,7 @@ void GCodePlanner::addTravel(Point p)
         {
             if (was_inside) // when the previous location was from printing something which is considered inside (not support or prime tower etc)
             {               // then move inside the printed part, so that we don't ooze on the outer wall while retraction, but on the inside of the print.
-                assert (extr != nullptr);
-                moveInsideCombBoundary(extr->getSettingInMicrons((extr->getSettingAsCount("wall_line_count") > 1) ? "wall_line_width_x" : "wall_line_width_0") * 1);
+                moveInsideCombBoundary(travel_policy.move_inside_distance);
             }
             path = getLatestPathWithConfig(&travel_config, SpaceFillType::None);
             path->retract = true;
@@ -339,14 +407,14 @@ void GCodePlanner::addTravel_simple(Point p, GCodePath* path)
     {
         path = getLatestPathWithConfig(&storage.travel_config_per_extruder[getExtruder()], SpaceFillType::None);
     }
-    path->points.push_back(p);
+    extruder_plans.back().addPoint(*path, p);
     lastPosition = p;
 }
 
 
 void GCodePlanner::addExtrusionMove(Point p, GCodePathConfig* config, SpaceFillType space_fill_type, float flow, bool spiralize)
 {
-    getLatestPathWithConfig(config, space_fill_type, flow, spiralize)->points.push_back(p);
+    extruder_plans.back().addPoint(*getLatestPathWithConfig(config, space_fill_type, flow, spiralize), p);
     lastPosition = p;
 }
 
@@ -428,13 +496,9 @@ void ExtruderPlan::forceMinimalLayerTime(double minTime, double minimalSpeed, do
         if (minExtrudeTime < 1)
             minExtrudeTime = 1;
         double factor = extrudeTime / minExtrudeTime;
-        for (GCodePath& path : paths)
-        {
-            if (path.isTravelPath())
-                continue;
-            double speed = path.config->getSpeed() * factor;
-            if (speed < minimalSpeed)
-                factor = minimalSpeed / path.config->getSpeed();
+        if (slowest_extrusion_speed * factor < minimalSpeed)
+        { // the slowest path limits how much all paths can be slowed down
+            factor = minimalSpeed / slowest_extrusion_speed;
         }
 
         //Only slow down for the minimal time if that will be slower.
@@ -467,7 +531,10 @@ void ExtruderPlan::forceMinimalLayerTime(double minTime, double minimalSpeed, do
 TimeMaterialEstimates ExtruderPlan::computeNaiveTimeEstimates()
 {
     TimeMaterialEstimates ret;
-    Point p0 = start_position;
+
+    // the points of all paths are consecutive, so the lengths of all moves can be computed in one go
+    std::vector<double> move_lengths(path_points.size());
+    LinearAlg2D::getSegmentLengthsMM(start_position, path_points.data(), path_points.size(), move_lengths.data());
 
     bool was_retracted = false; // wrong assumption; won't matter that much. (TODO)
     for (GCodePath& path : paths)
@@ -479,6 +546,7 @@ TimeMaterialEstimates ExtruderPlan::computeNaiveTimeEstimates()
         {
             is_extrusion_path = true;
             path_time_estimate = &path.estimates.extrude_time;
+            slowest_extrusion_speed = std::min(slowest_extrusion_speed, path.config->getSpeed());
         }
         else 
         {
@@ -505,22 +573,83 @@ TimeMaterialEstimates ExtruderPlan::computeNaiveTimeEstimates()
                 path.estimates.unretracted_travel_time += 0.5 * retract_unretract_time;
             }
         }
-        for(Point& p1 : path.points)
+        for (unsigned int point_idx = path.points_start; point_idx < path.points_start + path.point_count; point_idx++)
         {
-            double length = vSizeMM(p0 - p1);
+            double length = move_lengths[point_idx];
             if (is_extrusion_path)
             {
                 material_estimate += length * INT2MM(layer_thickness) * INT2MM(path.config->getLineWidth());
             }
             double thisTime = length / path.config->getSpeed();
             *path_time_estimate += thisTime;
-            p0 = p1;
         }
         estimates += path.estimates;
     }
     return estimates;
 }
 
+void ExtruderPlan::computeAccurateTimeEstimates(const SettingsBaseVirtual* firmware_settings, double filament_area, int z, bool acceleration_enabled, bool jerk_enabled)
+{
+    const double naive_time = estimates.getTotalTime();
+    if (naive_time <= 0.0)
+    {
+        return;
+    }
+    TimeEstimateCalculator calculator;
+    calculator.setFirmwareDefaults(firmware_settings);
+    const double z_mm = INT2MM(z);
+    double e = 0.0; // the position of the filament in mm, like GCodeExport::eToMm
+    bool is_retracted = false;
+    Point p0 = start_position;
+    calculator.setPosition(TimeEstimateCalculator::Position(INT2MM(p0.X), INT2MM(p0.Y), z_mm, e));
+    for (GCodePath& path : paths)
+    {
+        if (acceleration_enabled)
+        {
+            calculator.setAcceleration(path.config->getAcceleration());
+        }
+        if (jerk_enabled)
+        {
+            calculator.setMaxXyJerk(path.config->getJerk());
+        }
+        const bool is_travel_path = path.isTravelPath();
+        if (path.retract && !is_retracted)
+        {
+            e -= retraction_config.distance;
+            calculator.plan(TimeEstimateCalculator::Position(INT2MM(p0.X), INT2MM(p0.Y), z_mm, e), retraction_config.speed);
+            is_retracted = true;
+        }
+        else if (!is_travel_path && is_retracted)
+        {
+            e += retraction_config.distance;
+            calculator.plan(TimeEstimateCalculator::Position(INT2MM(p0.X), INT2MM(p0.Y), z_mm, e), retraction_config.primeSpeed);
+            is_retracted = false;
+        }
+        const double speed = path.config->getSpeed() * (is_travel_path ? getTravelSpeedFactor() : getExtrudeSpeedFactor());
+        // the same material as in the naive estimates; the extrusion of the configs isn't complete until the layer is written
+        const double e_per_mm = is_travel_path ? 0.0 : path.flow * INT2MM(layer_thickness) * INT2MM(path.config->getLineWidth()) / filament_area;
+        for (Point& p1 : getPoints(path))
+        {
+            e += vSizeMM(p1 - p0) * e_per_mm;
+            calculator.plan(TimeEstimateCalculator::Position(INT2MM(p1.X), INT2MM(p1.Y), z_mm, e), speed);
+            p0 = p1;
+        }
+    }
+
+    const double time_factor = calculator.calculate() / naive_time;
+    auto scale_time = [time_factor](TimeMaterialEstimates& time_estimates)
+    {
+        time_estimates.extrude_time *= time_factor;
+        time_estimates.unretracted_travel_time *= time_factor;
+        time_estimates.retracted_travel_time *= time_factor;
+    };
+    scale_time(estimates);
+    for (GCodePath& path : paths)
+    {
+        scale_time(path.estimates);
+    }
+}
+
 void ExtruderPlan::processFanSpeedAndMinimalLayerTime(bool force_minimal_layer_time)
 {
     FanSpeedLayerTimeSettings& fsml = fan_speed_layer_time_settings;
@@ -601,15 +730,77 @@ void GCodePlanner::processFanSpeedAndMinimalLayerTime()
     }
 }
 
+void GCodePlanner::computeAccurateTimeEstimates()
+{
+    TRACE_SCOPE("GCodePlanner::computeAccurateTimeEstimates", -1, layer_nr);
+    const bool acceleration_enabled = storage.getSettingBoolean(SettingKey::acceleration_enabled);
+    const bool jerk_enabled = storage.getSettingBoolean(SettingKey::jerk_enabled);
+    ThreadPool::getInstance()->parallelFor(0, extruder_plans.size(), [&](int extruder_plan_idx)
+    {
+        ExtruderPlan& extruder_plan = extruder_plans[extruder_plan_idx];
+        const double filament_radius = INT2MM(storage.meshgroup->getExtruderTrain(extruder_plan.extruder)->getSettingInMicrons(SettingKey::material_diameter)) / 2.0;
+        extruder_plan.computeAccurateTimeEstimates(storage.meshgroup, M_PI * filament_radius * filament_radius, z, acceleration_enabled, jerk_enabled);
+    });
+}
 
 
-void GCodePlanner::writeGCode(GCodeExport& gcode)
+
+void GCodePlanner::freezeConfigs()
 {
+    ThreadPool::getInstance()->parallelFor(0, extruder_plans.size(), [&](int extruder_plan_idx)
+    {
+        ExtruderPlan& extruder_plan = extruder_plans[extruder_plan_idx];
+        const int64_t nozzle_size = storage.meshgroup->getExtruderTrain(extruder_plan.extruder)->getSettingInMicrons(SettingKey::machine_nozzle_size);
+        MergeInfillLines(extruder_plan, &storage.travel_config_per_extruder[extruder_plan.extruder], nozzle_size).findMerges();
+    });
+
     completeConfigs();
+
+    std::unordered_map<GCodePathConfig*, GCodePathConfig*> frozen_config_of; // the copy of each config, so that configs which are the same object stay the same object
+    auto freeze = [this, &frozen_config_of](GCodePathConfig* config)
+    {
+        std::unordered_map<GCodePathConfig*, GCodePathConfig*>::iterator frozen = frozen_config_of.find(config);
+        if (frozen == frozen_config_of.end())
+        {
+            frozen_configs.push_back(*config);
+            frozen = frozen_config_of.emplace(config, &frozen_configs.back()).first;
+        }
+        return frozen->second;
+    };
+    for (ExtruderPlan& extruder_plan : extruder_plans)
+    {
+        for (GCodePath& path : extruder_plan.paths)
+        {
+            path.config = freeze(path.config);
+        }
+    }
+    for (GCodePathConfig& travel_config : storage.travel_config_per_extruder)
+    {
+        frozen_travel_config_per_extruder.push_back(freeze(&travel_config));
+    }
+    configs_frozen = true;
+}
+
+void GCodePlanner::writeGCode(GCodeExport& gcode)
+{
+    TRACE_SCOPE("GCodePlanner::writeGCode", -1, layer_nr);
+    TimeKeeper layer_timer;
+    if (!configs_frozen)
+    {
+        freezeConfigs();
+    }
     
-    CommandSocket::setLayerForSend(layer_nr);
-    CommandSocket::setSendCurrentPosition( gcode.getPositionXY() );
+    CommandSocket* command_socket = gcode.getCommandSocket();
+    if (command_socket)
+    {
+        command_socket->setLayerForSend(layer_nr);
+        command_socket->setSendCurrentPosition( gcode.getPositionXY() );
+    }
     gcode.setLayerNr(layer_nr);
+    if (ThreadPool::getInstance()->getThreadCount() > 1)
+    {
+        gcode.startBufferingMoves(); // their text is formatted in parallel at the end of the layer
+    }
     
     gcode.writeLayerComment(layer_nr);
     
@@ -619,8 +810,8 @@ void GCodePlanner::writeGCode(GCodeExport& gcode)
     GCodePathConfig* last_extrusion_config = nullptr; // used to check whether we need to insert a TYPE comment in the gcode.
 
     int extruder = gcode.getExtruderNr();
-    bool acceleration_enabled = storage.getSettingBoolean("acceleration_enabled");
-    bool jerk_enabled = storage.getSettingBoolean("jerk_enabled");
+    bool acceleration_enabled = storage.getSettingBoolean(SettingKey::acceleration_enabled);
+    bool jerk_enabled = storage.getSettingBoolean(SettingKey::jerk_enabled);
 
     for(unsigned int extruder_plan_idx = 0; extruder_plan_idx < extruder_plans.size(); extruder_plan_idx++)
     {
@@ -634,9 +825,9 @@ void GCodePlanner::writeGCode(GCodeExport& gcode)
             gcode.switchExtruder(extruder, storage.extruder_switch_retraction_config_per_extruder[prev_extruder]);
 
             const ExtruderTrain* train = storage.meshgroup->getExtruderTrain(extruder);
-            if (train->getSettingInMillimetersPerSecond("max_feedrate_z_override") > 0)
+            if (train->getSettingInMillimetersPerSecond(SettingKey::max_feedrate_z_override) > 0)
             {
-                gcode.writeMaxZFeedrate(train->getSettingInMillimetersPerSecond("max_feedrate_z_override"));
+                gcode.writeMaxZFeedrate(train->getSettingInMillimetersPerSecond(SettingKey::max_feedrate_z_override));
             }
 
             { // require printing temperature to be met
@@ -645,7 +836,7 @@ void GCodePlanner::writeGCode(GCodeExport& gcode)
             }
 
             // prime extruder if it hadn't been used yet
-            gcode.writePrimeTrain(storage.meshgroup->getExtruderTrain(extruder)->getSettingInMillimetersPerSecond("speed_travel"));
+            gcode.writePrimeTrain(storage.meshgroup->getExtruderTrain(extruder)->getSettingInMillimetersPerSecond(SettingKey::speed_travel));
             gcode.writeRetraction(&retraction_config);
 
             if (extruder_plan.prev_extruder_standby_temp)
@@ -662,13 +853,14 @@ void GCodePlanner::writeGCode(GCodeExport& gcode)
             } );
 
         const ExtruderTrain* train = storage.meshgroup->getExtruderTrain(extruder);
-        if (train->getSettingInMillimetersPerSecond("max_feedrate_z_override") > 0)
+        if (train->getSettingInMillimetersPerSecond(SettingKey::max_feedrate_z_override) > 0)
         {
-            gcode.writeMaxZFeedrate(train->getSettingInMillimetersPerSecond("max_feedrate_z_override"));
+            gcode.writeMaxZFeedrate(train->getSettingInMillimetersPerSecond(SettingKey::max_feedrate_z_override));
         }
-        bool speed_equalize_flow_enabled = train->getSettingBoolean("speed_equalize_flow_enabled");
-        double speed_equalize_flow_max = train->getSettingInMillimetersPerSecond("speed_equalize_flow_max");
+        bool speed_equalize_flow_enabled = train->getSettingBoolean(SettingKey::speed_equalize_flow_enabled);
+        double speed_equalize_flow_max = train->getSettingInMillimetersPerSecond(SettingKey::speed_equalize_flow_max);
         int64_t nozzle_size = gcode.getNozzleSize(extruder);
+        std::vector<InfillLineMerge>::const_iterator next_merge = extruder_plan.infill_line_merges.begin();
 
         for(unsigned int path_idx = 0; path_idx < paths.size(); path_idx++)
         {
@@ -707,18 +899,20 @@ void GCodePlanner::writeGCode(GCodeExport& gcode)
             else
                 speed *= extruder_plan.getExtrudeSpeedFactor();
 
-            if (MergeInfillLines(gcode, layer_nr, paths, extruder_plan, storage.travel_config_per_extruder[extruder], nozzle_size, speed_equalize_flow_enabled, speed_equalize_flow_max).mergeInfillLines(path_idx)) // !! has effect on path_idx !!
-            { // !! has effect on path_idx !!
-                // works when path_idx is the index of the travel move BEFORE the infill lines to be merged
+            if (next_merge != extruder_plan.infill_line_merges.end() && next_merge->first_path_idx == path_idx)
+            { // path_idx is the index of the travel move BEFORE the infill lines to be merged
+                MergeInfillLines::writeMerge(gcode, extruder_plan, *next_merge, *frozen_travel_config_per_extruder[extruder], speed_equalize_flow_enabled, speed_equalize_flow_max, path_idx); // !! has effect on path_idx !!
+                ++next_merge;
                 continue;
             }
 
+            GCodePathPoints points = extruder_plan.getPoints(path);
             if (path.config->isTravelPath())
             { // early comp for travel paths, which are handled more simply
-                for(unsigned int point_idx = 0; point_idx < path.points.size(); point_idx++)
+                for(unsigned int point_idx = 0; point_idx < points.size(); point_idx++)
                 {
-                    gcode.writeMove(path.points[point_idx], speed, path.getExtrusionMM3perMM());
-                    if (point_idx == path.points.size() - 1)
+                    gcode.writeMove(points[point_idx], speed, path.getExtrusionMM3perMM());
+                    if (point_idx == points.size() - 1)
                     {
                         gcode.setZ(z); // go down to extrusion level when we spiralized before on this layer
                         gcode.writeMove(gcode.getPositionXY(), speed, path.getExtrusionMM3perMM());
@@ -741,24 +935,24 @@ void GCodePlanner::writeGCode(GCodeExport& gcode)
                     if (  // change infill  ||||||   to  /\/\/\/\/ ...
                         false &&
                         path_idx + 2 < paths.size() // has a next move
-                        && paths[path_idx+1].points.size() == 1 // is single extruded line
+                        && extruder_plan.getPoints(paths[path_idx+1]).size() == 1 // is single extruded line
                         && !paths[path_idx+1].config->isTravelPath() // next move is extrusion
                         && paths[path_idx+2].config->isTravelPath() // next next move is travel
-                        && shorterThen(path.points.back() - gcode.getPositionXY(), 2 * nozzle_size) // preceding extrusion is close by
-                        && shorterThen(paths[path_idx+1].points.back() - path.points.back(), 2 * nozzle_size) // extrusion move is small
-                        && shorterThen(paths[path_idx+2].points.back() - paths[path_idx+1].points.back(), 2 * nozzle_size) // consecutive extrusion is close by
+                        && shorterThen(points.back() - gcode.getPositionXY(), 2 * nozzle_size) // preceding extrusion is close by
+                        && shorterThen(extruder_plan.getPoints(paths[path_idx+1]).back() - points.back(), 2 * nozzle_size) // extrusion move is small
+                        && shorterThen(extruder_plan.getPoints(paths[path_idx+2]).back() - extruder_plan.getPoints(paths[path_idx+1]).back(), 2 * nozzle_size) // consecutive extrusion is close by
                     )
                     {
-                        sendLineTo(paths[path_idx+2].config->type, paths[path_idx+2].points.back(), paths[path_idx+2].getLineWidth());
-                        gcode.writeMove(paths[path_idx+2].points.back(), speed, paths[path_idx+1].getExtrusionMM3perMM());
+                        sendLineTo(gcode, paths[path_idx+2].config->type, extruder_plan.getPoints(paths[path_idx+2]).back(), paths[path_idx+2].getLineWidth());
+                        gcode.writeMove(extruder_plan.getPoints(paths[path_idx+2]).back(), speed, paths[path_idx+1].getExtrusionMM3perMM());
                         path_idx += 2;
                     }
                     else 
                     {
-                        for(unsigned int point_idx = 0; point_idx < path.points.size(); point_idx++)
+                        for(unsigned int point_idx = 0; point_idx < points.size(); point_idx++)
                         {
-                            sendLineTo(path.config->type, path.points[point_idx], path.getLineWidth());
-                            gcode.writeMove(path.points[point_idx], speed, path.getExtrusionMM3perMM());
+                            sendLineTo(gcode, path.config->type, points[point_idx], path.getLineWidth());
+                            gcode.writeMove(points[point_idx], speed, path.getExtrusionMM3perMM());
                         }
                     }
                 }
@@ -770,10 +964,8 @@ void GCodePlanner::writeGCode(GCodeExport& gcode)
                 Point p0 = gcode.getPositionXY();
                 for (unsigned int _path_idx = path_idx; _path_idx < paths.size() && !paths[_path_idx].isTravelPath(); _path_idx++)
                 {
-                    GCodePath& _path = paths[_path_idx];
-                    for (unsigned int point_idx = 0; point_idx < _path.points.size(); point_idx++)
+                    for (Point& p1 : extruder_plan.getPoints(paths[_path_idx]))
                     {
-                        Point p1 = _path.points[point_idx];
                         totalLength += vSizeMM(p0 - p1);
                         p0 = p1;
                     }
@@ -784,32 +976,31 @@ void GCodePlanner::writeGCode(GCodeExport& gcode)
                 for (; path_idx < paths.size() && paths[path_idx].spiralize; path_idx++)
                 { // handle all consecutive spiralized paths > CHANGES path_idx!
                     GCodePath& path = paths[path_idx];
-                    for (unsigned int point_idx = 0; point_idx < path.points.size(); point_idx++)
+                    for (Point& p1 : extruder_plan.getPoints(path))
                     {
-                        Point p1 = path.points[point_idx];
                         length += vSizeMM(p0 - p1);
                         p0 = p1;
                         gcode.setZ(z + layer_thickness * length / totalLength);
-                        sendLineTo(path.config->type, path.points[point_idx], path.getLineWidth());
-                        gcode.writeMove(path.points[point_idx], speed, path.getExtrusionMM3perMM());
+                        sendLineTo(gcode, path.config->type, p1, path.getLineWidth());
+                        gcode.writeMove(p1, speed, path.getExtrusionMM3perMM());
                     }
                 }
                 path_idx--; // the last path_idx didnt spiralize, so it's not part of the current spiralize path
             }
         } // paths for this extruder /\  .
 
-        if (train->getSettingBoolean("cool_lift_head") && extruder_plan.extraTime > 0.0)
+        if (train->getSettingBoolean(SettingKey::cool_lift_head) && extruder_plan.extraTime > 0.0)
         {
             gcode.writeComment("Small layer, adding delay");
             RetractionConfig& retraction_config = storage.retraction_config_per_extruder[gcode.getExtruderNr()];
             gcode.writeRetraction(&retraction_config);
-            if (extruder_plan_idx == extruder_plans.size() - 1 || !train->getSettingBoolean("machine_extruder_end_pos_abs"))
+            if (extruder_plan_idx == extruder_plans.size() - 1 || !train->getSettingBoolean(SettingKey::machine_extruder_end_pos_abs))
             { // only move the head if it's the last extruder plan; otherwise it's already at the switching bay area 
                 // or do it anyway when we switch extruder in-place
                 gcode.setZ(gcode.getPositionZ() + MM2INT(3.0));
-                gcode.writeMove(gcode.getPositionXY(), storage.travel_config_per_extruder[extruder].getSpeed(), 0);
+                gcode.writeMove(gcode.getPositionXY(), frozen_travel_config_per_extruder[extruder]->getSpeed(), 0);
                 // TODO: is this safe?! wouldn't the head move into the sides then?!
-                gcode.writeMove(gcode.getPositionXY() - Point(-MM2INT(20.0), 0), storage.travel_config_per_extruder[extruder].getSpeed(), 0);
+                gcode.writeMove(gcode.getPositionXY() - Point(-MM2INT(20.0), 0), frozen_travel_config_per_extruder[extruder]->getSpeed(), 0);
             }
             gcode.writeDelay(extruder_plan.extraTime);
         }
@@ -817,7 +1008,30 @@ void GCodePlanner::writeGCode(GCodeExport& gcode)
         extruder_plan.handleAllRemainingInserts(gcode);
     } // extruder plans /\  .
     
+    gcode.writeBufferedMoves();
     gcode.updateTotalPrintTime();
+
+    const double layer_time = layer_timer.restart();
+    if (SlowLayerCapture::getInstance().isSlow(layer_time))
+    { // the layer parts may already have been released, so the planned extrusion paths are captured instead
+        Polygons extrusion_paths;
+        for (ExtruderPlan& extruder_plan : extruder_plans)
+        {
+            for (GCodePath& path : extruder_plan.paths)
+            {
+                if (!path.isTravelPath())
+                {
+                    GCodePathPoints points = extruder_plan.getPoints(path);
+                    PolygonRef poly = extrusion_paths.newPoly();
+                    for (const Point& point : points)
+                    {
+                        poly.add(point);
+                    }
+                }
+            }
+        }
+        SlowLayerCapture::getInstance().capture("export", -1, layer_nr, z, layer_time, extrusion_paths, storage);
+    }
 }
 
 void GCodePlanner::overrideFanSpeeds(double speed)
@@ -854,31 +1068,31 @@ void GCodePlanner::completeConfigs()
 
 void GCodePlanner::processInitialLayersSpeedup()
 {
-    int initial_speedup_layers = storage.getSettingAsCount("speed_slowdown_layers");
+    int initial_speedup_layers = storage.getSettingAsCount(SettingKey::speed_slowdown_layers);
     if (layer_nr >= 0 && layer_nr < initial_speedup_layers)
     {
         GCodePathConfig::BasicConfig initial_layer_speed_config;
-        int extruder_nr_support_infill = storage.getSettingAsIndex((layer_nr == 0)? "support_extruder_nr_layer_0" : "support_infill_extruder_nr");
-        initial_layer_speed_config.speed = storage.meshgroup->getExtruderTrain(extruder_nr_support_infill)->getSettingInMillimetersPerSecond("speed_print_layer_0");
-        initial_layer_speed_config.acceleration = storage.meshgroup->getExtruderTrain(extruder_nr_support_infill)->getSettingInMillimetersPerSecond("acceleration_print_layer_0");
-        initial_layer_speed_config.jerk = storage.meshgroup->getExtruderTrain(extruder_nr_support_infill)->getSettingInMillimetersPerSecond("jerk_print_layer_0");
+        int extruder_nr_support_infill = storage.getSettingAsIndex((layer_nr == 0)? SettingKey::support_extruder_nr_layer_0 : SettingKey::support_infill_extruder_nr);
+        initial_layer_speed_config.speed = storage.meshgroup->getExtruderTrain(extruder_nr_support_infill)->getSettingInMillimetersPerSecond(SettingKey::speed_print_layer_0);
+        initial_layer_speed_config.acceleration = storage.meshgroup->getExtruderTrain(extruder_nr_support_infill)->getSettingInMillimetersPerSecond(SettingKey::acceleration_print_layer_0);
+        initial_layer_speed_config.jerk = storage.meshgroup->getExtruderTrain(extruder_nr_support_infill)->getSettingInMillimetersPerSecond(SettingKey::jerk_print_layer_0);
 
         //Support (global).
         storage.support_config.smoothSpeed(initial_layer_speed_config, layer_nr, initial_speedup_layers);
 
         //Support roof (global).
-        int extruder_nr_support_skin = storage.getSettingAsIndex("support_interface_extruder_nr");
-        initial_layer_speed_config.speed = storage.meshgroup->getExtruderTrain(extruder_nr_support_skin)->getSettingInMillimetersPerSecond("speed_print_layer_0");
-        initial_layer_speed_config.acceleration = storage.meshgroup->getExtruderTrain(extruder_nr_support_skin)->getSettingInMillimetersPerSecond("acceleration_print_layer_0");
-        initial_layer_speed_config.jerk = storage.meshgroup->getExtruderTrain(extruder_nr_support_skin)->getSettingInMillimetersPerSecond("jerk_print_layer_0");
+        int extruder_nr_support_skin = storage.getSettingAsIndex(SettingKey::support_interface_extruder_nr);
+        initial_layer_speed_config.speed = storage.meshgroup->getExtruderTrain(extruder_nr_support_skin)->getSettingInMillimetersPerSecond(SettingKey::speed_print_layer_0);
+        initial_layer_speed_config.acceleration = storage.meshgroup->getExtruderTrain(extruder_nr_support_skin)->getSettingInMillimetersPerSecond(SettingKey::acceleration_print_layer_0);
+        initial_layer_speed_config.jerk = storage.meshgroup->getExtruderTrain(extruder_nr_support_skin)->getSettingInMillimetersPerSecond(SettingKey::jerk_print_layer_0);
         storage.support_skin_config.smoothSpeed(initial_layer_speed_config, layer_nr, initial_speedup_layers);
 
         for (int extruder_nr = 0; extruder_nr < storage.meshgroup->getExtruderCount(); ++extruder_nr)
         {
             const ExtruderTrain* extruder_train = storage.meshgroup->getExtruderTrain(extruder_nr);
-            initial_layer_speed_config.speed = extruder_train->getSettingInMillimetersPerSecond("speed_travel_layer_0");
-            initial_layer_speed_config.acceleration = extruder_train->getSettingInMillimetersPerSecond("acceleration_travel_layer_0");
-            initial_layer_speed_config.jerk = extruder_train->getSettingInMillimetersPerSecond("jerk_travel_layer_0");
+            initial_layer_speed_config.speed = extruder_train->getSettingInMillimetersPerSecond(SettingKey::speed_travel_layer_0);
+            initial_layer_speed_config.acceleration = extruder_train->getSettingInMillimetersPerSecond(SettingKey::acceleration_travel_layer_0);
+            initial_layer_speed_config.jerk = extruder_train->getSettingInMillimetersPerSecond(SettingKey::jerk_travel_layer_0);
 
             //Travel speed (per extruder).
             storage.travel_config_per_extruder[extruder_nr].smoothSpeed(initial_layer_speed_config, layer_nr, initial_speedup_layers);
@@ -886,9 +1100,9 @@ void GCodePlanner::processInitialLayersSpeedup()
 
         for (SliceMeshStorage& mesh : storage.meshes)
         {
-            initial_layer_speed_config.speed = mesh.getSettingInMillimetersPerSecond("speed_print_layer_0");
-            initial_layer_speed_config.acceleration = mesh.getSettingInMillimetersPerSecond("acceleration_print_layer_0");
-            initial_layer_speed_config.jerk = mesh.getSettingInMillimetersPerSecond("jerk_print_layer_0");
+            initial_layer_speed_config.speed = mesh.getSettingInMillimetersPerSecond(SettingKey::speed_print_layer_0);
+            initial_layer_speed_config.acceleration = mesh.getSettingInMillimetersPerSecond(SettingKey::acceleration_print_layer_0);
+            initial_layer_speed_config.jerk = mesh.getSettingInMillimetersPerSecond(SettingKey::jerk_print_layer_0);
 
             //Outer wall speed (per mesh).
             mesh.inset0_config.smoothSpeed(initial_layer_speed_config, layer_nr, initial_speedup_layers);
@@ -964,11 +1178,12 @@ bool GCodePlanner::writePathWithCoasting(GCodeExport& gcode, unsigned int extrud
     ExtruderPlan& extruder_plan = extruder_plans[extruder_plan_idx];
     std::vector<GCodePath>& paths = extruder_plan.paths;
     GCodePath& path = paths[path_idx];
+    GCodePathPoints points = extruder_plan.getPoints(path);
     if (path_idx + 1 >= paths.size()
         ||
         ! (!path.isTravelPath() &&  paths[path_idx + 1].config->isTravelPath()) 
         ||
-        path.points.size() < 2
+        points.size() < 2
         )
     {
         return false;
@@ -984,7 +1199,8 @@ bool GCodePlanner::writePathWithCoasting(GCodeExport& gcode, unsigned int extrud
     //           /\ the minimal distance when coasting will coast the full coasting volume instead of linearly less with linearly smaller paths
     
     
-    std::vector<int64_t> accumulated_dist_per_point; // the first accumulated dist is that of the last point! (that of the last point is always zero...)
+    std::vector<int64_t>& accumulated_dist_per_point = coasting_accumulated_dists; // the first accumulated dist is that of the last point! (that of the last point is always zero...)
+    accumulated_dist_per_point.clear();
     accumulated_dist_per_point.push_back(0);
     
     int64_t accumulated_dist = 0;
@@ -995,10 +1211,10 @@ bool GCodePlanner::writePathWithCoasting(GCodeExport& gcode, unsigned int extrud
      // == the point printed BEFORE the start point for coasting
     
     
-    Point* last = &path.points[path.points.size() - 1];
-    for (unsigned int backward_point_idx = 1; backward_point_idx < path.points.size(); backward_point_idx++)
+    Point* last = &points[points.size() - 1];
+    for (unsigned int backward_point_idx = 1; backward_point_idx < points.size(); backward_point_idx++)
     {
-        Point& point = path.points[path.points.size() - 1 - backward_point_idx];
+        Point& point = points[points.size() - 1 - backward_point_idx];
         int64_t dist = vSize(point - *last);
         accumulated_dist += dist;
         accumulated_dist_per_point.push_back(accumulated_dist);
@@ -1026,41 +1242,36 @@ bool GCodePlanner::writePathWithCoasting(GCodeExport& gcode, unsigned int extrud
     {
         // in this case accumulated_dist is the length of the whole path
         actual_coasting_dist = accumulated_dist * coasting_dist / coasting_min_dist;
-        for (acc_dist_idx_gt_coast_dist = 0 ; acc_dist_idx_gt_coast_dist < accumulated_dist_per_point.size() ; acc_dist_idx_gt_coast_dist++)
-        { // search for the correct coast_dist_idx
-            if (accumulated_dist_per_point[acc_dist_idx_gt_coast_dist] > actual_coasting_dist)
-            {
-                break;
-            }
-        }
+        // search for the correct coast_dist_idx; the accumulated distances only increase
+        acc_dist_idx_gt_coast_dist = std::upper_bound(accumulated_dist_per_point.begin(), accumulated_dist_per_point.end(), actual_coasting_dist) - accumulated_dist_per_point.begin();
     }
 
     assert (acc_dist_idx_gt_coast_dist < accumulated_dist_per_point.size()); // something has gone wrong; coasting_min_dist < coasting_dist ?
 
-    unsigned int point_idx_before_start = path.points.size() - 1 - acc_dist_idx_gt_coast_dist;
+    unsigned int point_idx_before_start = points.size() - 1 - acc_dist_idx_gt_coast_dist;
 
     Point start;
     { // computation of begin point of coasting
         int64_t residual_dist = actual_coasting_dist - accumulated_dist_per_point[acc_dist_idx_gt_coast_dist - 1];
-        Point& a = path.points[point_idx_before_start];
-        Point& b = path.points[point_idx_before_start + 1];
+        Point& a = points[point_idx_before_start];
+        Point& b = points[point_idx_before_start + 1];
         start = b + normal(a-b, residual_dist);
     }
 
     { // write normal extrude path:
         for(unsigned int point_idx = 0; point_idx <= point_idx_before_start; point_idx++)
         {
-            sendLineTo(path.config->type, path.points[point_idx], path.getLineWidth());
-            gcode.writeMove(path.points[point_idx], extrude_speed, path.getExtrusionMM3perMM());
+            sendLineTo(gcode, path.config->type, points[point_idx], path.getLineWidth());
+            gcode.writeMove(points[point_idx], extrude_speed, path.getExtrusionMM3perMM());
         }
-        sendLineTo(path.config->type, start, path.getLineWidth());
+        sendLineTo(gcode, path.config->type, start, path.getLineWidth());
         gcode.writeMove(start, extrude_speed, path.getExtrusionMM3perMM());
     }
 
     // write coasting path
-    for (unsigned int point_idx = point_idx_before_start + 1; point_idx < path.points.size(); point_idx++)
+    for (unsigned int point_idx = point_idx_before_start + 1; point_idx < points.size(); point_idx++)
     {
-        gcode.writeMove(path.points[point_idx], coasting_speed * path.config->getSpeed(), 0);
+        gcode.writeMove(points[point_idx], coasting_speed * path.config->getSpeed(), 0);
     }
 
     gcode.addLastCoastedVolume(path.getExtrusionMM3perMM() * INT2MM(actual_coasting_dist));
@@ -1,6 +1,7 @@
 #ifndef GCODE_PLANNER_H
 #define GCODE_PLANNER_H
 
+#include <deque>
 #include <vector>
 
 #include "gcodeExport.h"
@@ -206,6 +207,49 @@ public:
     }
 };
 
+/*!
+ * The points of a GCodePath, which are stored in the ExtruderPlan::path_points of the extruder plan of the path.
+ * 
+ * \warning Only valid until points are added to the extruder plan.
+ */
+class GCodePathPoints
+{
+public:
+    GCodePathPoints(Point* first, unsigned int count)
+    : first(first)
+    , count(count)
+    {
+    }
+
+    unsigned int size() const
+    {
+        return count;
+    }
+
+    Point& operator[](unsigned int point_idx) const
+    {
+        return first[point_idx];
+    }
+
+    Point& back() const
+    {
+        return first[count - 1];
+    }
+
+    Point* begin() const
+    {
+        return first;
+    }
+
+    Point* end() const
+    {
+        return first + count;
+    }
+private:
+    Point* first; //!< The first point of the path
+    unsigned int count; //!< The number of points of the path
+};
+
 /*!
  * A class for representing a planned path.
  * 
@@ -215,6 +259,8 @@ public:
  * 
  * In the final representation (gcode) each line segment may have different properties, 
  * which are added when the generated GCodePaths are processed.
+ * 
+ * The points of the path aren't stored in the path itself, but in the point buffer of its extruder plan, see ExtruderPlan::getPoints.
  */
 class GCodePath
 {
@@ -224,7 +270,8 @@ public:
     float flow; //!< A type-independent flow configuration (used for wall overlap compensation)
     bool retract; //!< Whether the path is a move path preceded by a retraction move; whether the path is a retracted move path. 
     bool perform_z_hop; //!< Whether to perform a z_hop in this path, which is assumed to be a travel path.
-    std::vector<Point> points; //!< The points constituting this path.
+    unsigned int points_start; //!< The index of the first point of this path in ExtruderPlan::path_points
+    unsigned int point_count; //!< The number of points constituting this path.
     bool done;//!< Path is finished, no more moves should be added, and a new path should be started instead of any appending done to this one.
 
     bool spiralize; //!< Whether to gradually increment the z position during the printing of this path. A sequence of spiralized paths should start at the given layer height and end in one layer higher.
@@ -265,6 +312,19 @@ public:
 
 class GCodePlanner; // forward declaration so that ExtruderPlan can be a friend
 class LayerPlanBuffer; // forward declaration so that ExtruderPlan can be a friend
+class MergeInfillLines; // forward declaration so that ExtruderPlan can be a friend
+
+/*!
+ * Thin parallel (skin) infill lines of an extruder plan which are printed as a single wider line crossing them; see MergeInfillLines.
+ * 
+ * The merged lines are the single line extrusion paths after ExtruderPlan::paths[first_path_idx], each preceded by a travel path.
+ */
+struct InfillLineMerge
+{
+    unsigned int first_path_idx; //!< The travel path before the first merged line
+    std::vector<Point> middles; //!< The middle of each merged line; the print head travels to the first and extrudes to each next one
+    std::vector<int64_t> line_widths; //!< The width of the line extruded to each next middle
+};
 
 /*!
  * An extruder plan contains all planned paths (GCodePath) pertaining to a single extruder train.
@@ -275,9 +335,12 @@ class ExtruderPlan
 {
     friend class GCodePlanner; // TODO: GCodePlanner still does a lot which should actually be handled in this class.
     friend class LayerPlanBuffer; // TODO: LayerPlanBuffer handles paths directly
+    friend class MergeInfillLines;
 protected:
     std::vector<GCodePath> paths; //!< The paths planned for this extruder
+    std::vector<Point> path_points; //!< The points of all paths, path after path, so that each path is a range of this buffer; see GCodePath::points_start
     std::list<NozzleTempInsert> inserts; //!< The nozzle temperature command inserts, to be inserted in between paths
+    std::vector<InfillLineMerge> infill_line_merges; //!< The infill lines to be printed merged, in order of their paths; found in GCodePlanner::freezeConfigs
 
     int extruder; //!< The extruder used for this paths in the current plan.
     double required_temp; //!< The required temperature at the start of this extruder plan.
@@ -295,6 +358,32 @@ public:
      */
     ExtruderPlan(int extruder, Point start_position, int layer_nr, int layer_thickness, FanSpeedLayerTimeSettings& fan_speed_layer_time_settings, const RetractionConfig& retraction_config);
 
+    /*!
+     * Get the points of one of the paths of this extruder plan.
+     * 
+     * \param path One of ExtruderPlan::paths
+     * \return The points of the path
+     */
+    GCodePathPoints getPoints(const GCodePath& path)
+    {
+        return GCodePathPoints(path_points.data() + path.points_start, path.point_count);
+    }
+
+    /*!
+     * Add a point to the end of the last path of this extruder plan.
+     * 
+     * Points can only be added to the last path, so that the points of each path stay contiguous.
+     * 
+     * \param path The last of ExtruderPlan::paths
+     * \param point The point to add
+     */
+    void addPoint(GCodePath& path, Point point)
+    {
+        assert(&path == &paths.back() && path.points_start + path.point_count == path_points.size());
+        path_points.push_back(point);
+        path.point_count++;
+    }
+
     /*!
      * Add a new Insert, constructed with the given arguments
      * 
@@ -408,6 +497,7 @@ protected:
 
     double extraTime; //!< Extra waiting time at the and of this extruder plan, so that the filament can cool
     double totalPrintTime; //!< The total naive time estimate for this extruder plan
+    double slowest_extrusion_speed; //!< The lowest speed of the configs of the extrusion paths, gathered by ExtruderPlan::computeNaiveTimeEstimates
 
     double fan_speed; //!< The fan speed to be used during this extruder plan
 
@@ -421,6 +511,8 @@ protected:
     /*!
      * Force the minimal layer time to hold by slowing down and lifting the head if required.
      * 
+     * The speed factor follows directly from the time estimates and the slowest extrusion speed,
+     * so the naive time estimates must have been computed with ExtruderPlan::computeNaiveTimeEstimates.
      */
     void forceMinimalLayerTime(double minTime, double minimalSpeed, double travelTime, double extrusionTime);
 
@@ -431,6 +523,23 @@ protected:
      * \return the total estimates of this layer
      */
     TimeMaterialEstimates computeNaiveTimeEstimates();
+
+    /*!
+     * Rescale the naive time estimates of this extruder plan and of each of its paths,
+     * so that they add up to an estimate which takes the acceleration and jerk of the firmware into account.
+     * 
+     * The estimate starts from standstill at the start position of this extruder plan,
+     * like the estimate of the gcode starts from standstill at the start of each layer.
+     * 
+     * \warning Assumes the naive time estimates have been computed and the speed factors have been set; see ExtruderPlan::processFanSpeedAndMinimalLayerTime
+     * 
+     * \param firmware_settings The settings of the machine to get the maximum feedrates, accelerations and jerks from
+     * \param filament_area The cross section of the filament of the extruder of this extruder plan, in mm^2
+     * \param z The height of the layer
+     * \param acceleration_enabled Whether the acceleration of the config of each path is used instead of the default acceleration
+     * \param jerk_enabled Whether the jerk of the config of each path is used instead of the default jerk
+     */
+    void computeAccurateTimeEstimates(const SettingsBaseVirtual* firmware_settings, double filament_area, int z, bool acceleration_enabled, bool jerk_enabled);
 };
 
 class LayerPlanBuffer; // forward declaration to prevent circular dependency
@@ -467,11 +576,19 @@ private:
     SettingsBaseVirtual* last_planned_extruder_setting_base; //!< The setting base of the last planned extruder.
     bool was_inside; //!< Whether the last planned (extrusion) move was inside a layer part
     bool is_inside; //!< Whether the destination of the next planned travel move is inside a layer part
-    Polygons comb_boundary_inside; //!< The boundary within which to comb, or to move into when performing a retraction.
+    std::shared_ptr<CombBoundaryInside> comb_boundary_inside; //!< The boundary within which to comb, or to move into when performing a retraction, possibly shared with the layer plans of other layers.
     Comb* comb;
 
 
     std::vector<FanSpeedLayerTimeSettings>& fan_speed_layer_time_settings_per_extruder;
+
+    bool configs_frozen; //!< Whether the paths of this layer plan refer to the copies in GCodePlanner::frozen_configs, see GCodePlanner::freezeConfigs
+    std::deque<GCodePathConfig> frozen_configs; //!< Copies of the configs used by this layer plan, as they were completed for this layer
+    std::vector<GCodePathConfig*> frozen_travel_config_per_extruder; //!< The copy of the travel config of each extruder, to be used instead of SliceDataStorage::travel_config_per_extruder
+
+    std::vector<std::vector<GCodePath>> spare_path_buffers; //!< Empty vectors of paths taken over from a layer plan which has been written, to be used by the next extruder plans of this layer plan; see GCodePlanner::reuseBuffers
+    std::vector<std::vector<Point>> spare_point_buffers; //!< Empty point buffers taken over from a layer plan which has been written, like GCodePlanner::spare_path_buffers
+    std::vector<int64_t> coasting_accumulated_dists; //!< The buffer in which GCodePlanner::writePathWithCoasting accumulates the lengths from the end of a path, kept to not allocate for each coasted path
     
 private:
     /*!
@@ -497,6 +614,13 @@ private:
      * - when changing extruder, the same travel config is used, but its extruder field is changed.
      */
     void forceNewPathStart();
+
+    /*!
+     * Give a new extruder plan one of the spare vectors of paths and point buffers, which can hold paths without allocating.
+     * 
+     * \param extruder_plan The new extruder plan, which doesn't have any paths yet
+     */
+    void useSparePathBuffer(ExtruderPlan& extruder_plan);
 public:
     /*!
      * 
@@ -505,10 +629,33 @@ public:
      * \param travel_avoid_distance The distance by which to avoid other layer parts when traveling through air.
      * \param last_position The position of the head at the start of this gcode layer
      * \param combing_mode Whether combing is enabled and full or within infill only.
+     * \param prepared_comb_boundary_inside The boundary within which to comb, as obtained from GCodePlanner::getCombBoundaryInside before, or nullptr to obtain it here
      */
-    GCodePlanner(SliceDataStorage& storage, unsigned int layer_nr, int z, int layer_height, Point last_position, int current_extruder, bool is_inside_mesh, std::vector<FanSpeedLayerTimeSettings>& fan_speed_layer_time_settings_per_extruder, CombingMode combing_mode, int64_t comb_boundary_offset, bool travel_avoid_other_parts, int64_t travel_avoid_distance);
+    GCodePlanner(SliceDataStorage& storage, unsigned int layer_nr, int z, int layer_height, Point last_position, int current_extruder, bool is_inside_mesh, std::vector<FanSpeedLayerTimeSettings>& fan_speed_layer_time_settings_per_extruder, CombingMode combing_mode, int64_t comb_boundary_offset, bool travel_avoid_other_parts, int64_t travel_avoid_distance, std::shared_ptr<CombBoundaryInside> prepared_comb_boundary_inside = nullptr);
     ~GCodePlanner();
 
+    /*!
+     * Get the boundary within which the layer plan of a layer combs, without making the layer plan.
+     * 
+     * The boundary doesn't depend on where the planning of the layer starts,
+     * so that it can be obtained for a number of layers in parallel before they are planned.
+     * 
+     * \param storage where the slice data is stored.
+     * \param layer_nr The layer of which to get the boundary; negative for the layers of the raft
+     * \param combing_mode Whether combing is enabled and full or within infill only.
+     * \return The boundary from SliceDataStorage::comb_boundary_cache
+     */
+    static std::shared_ptr<CombBoundaryInside> getCombBoundaryInside(SliceDataStorage& storage, int layer_nr, CombingMode combing_mode);
+
+    /*!
+     * Take over the memory of the vectors of paths and the point buffers of a layer plan which has been written, so that planning this layer plan reallocates them less.
+     * 
+     * Should be called before anything is planned in this layer plan.
+     * 
+     * \param written The layer plan which has been written, of which the paths are discarded
+     */
+    void reuseBuffers(GCodePlanner& written);
+
     void overrideFanSpeeds(double speed);
     /*!
      * Get the settings base of the last extruder planned.
@@ -518,10 +665,13 @@ public:
 private:
     /*!
      * Compute the boundary within which to comb, or to move into when performing a retraction.
+     * \param storage where the slice data is stored.
+     * \param layer_nr The layer of which to compute the boundary; negative for the layers of the raft
      * \param combing_mode Whether combing is enabled and full or within infill only.
+     * \param[out] part_starts The index of the first polygon of each layer part in the boundary, when the boundary comes from the parts of a single mesh, so that they don't overlap; left empty otherwise
      * \return the comb_boundary_inside
      */
-    Polygons computeCombBoundaryInside(CombingMode combing_mode);
+    static Polygons computeCombBoundaryInside(SliceDataStorage& storage, int layer_nr, CombingMode combing_mode, std::vector<unsigned int>& part_starts);
 
 public:
     int getLayerNr()
@@ -542,11 +692,15 @@ public:
         return was_inside;
     }
     /*!
-     * send a line segment through the command socket from the previous point to the given point \p to
+     * send a line segment through the command socket of \p gcode from the previous point to the given point \p to
      */
-    void sendLineTo(PrintFeatureType print_feature_type, Point to, int line_width)
+    void sendLineTo(GCodeExport& gcode, PrintFeatureType print_feature_type, Point to, int line_width)
     {
-        CommandSocket::sendLineTo(print_feature_type, to, line_width);
+        CommandSocket* command_socket = gcode.getCommandSocket();
+        if (command_socket)
+        {
+            command_socket->sendLineTo(print_feature_type, to, line_width);
+        }
     }
 
     /*!
@@ -644,9 +798,23 @@ public:
      */
     TimeMaterialEstimates computeNaiveTimeEstimates();
     
+    /*!
+     * Complete the configs for this layer (see GCodePlanner::completeConfigs)
+     * and let the paths of this layer plan refer to copies of them.
+     * Also find the infill lines which are to be merged (see MergeInfillLines), in parallel for the extruder plans.
+     * 
+     * The configs in the SliceDataStorage are shared by all layers and are changed again when the next layer is completed,
+     * so after this call the layer plan can be written to gcode on another thread while the next layers are completed.
+     * 
+     * Nothing may be planned in this layer plan anymore after this call.
+     */
+    void freezeConfigs();
+
     /*!
      * Write the planned paths to gcode
      * 
+     * Calls GCodePlanner::freezeConfigs if that hasn't been done yet.
+     * 
      * \param gcode The gcode to write the planned paths to
      */
     void writeGCode(GCodeExport& gcode);
@@ -695,6 +863,14 @@ public:
      * Applying speed corrections for minimal layer times and determine the fanSpeed. 
      */
     void processFanSpeedAndMinimalLayerTime();
+
+    /*!
+     * Replace the naive time estimates of the extruder plans by estimates which take acceleration and jerk into account.
+     * The extruder plans are estimated in parallel.
+     * 
+     * \warning Should be called after GCodePlanner::processFanSpeedAndMinimalLayerTime
+     */
+    void computeAccurateTimeEstimates();
     
     /*!
      * Add a travel move to the layer plan to move inside the current layer part by a given distance away from the outline.
@@ -1,11 +1,50 @@
 /** Copyright (C) 2013 David Braam - Released under terms of the AGPLv3 License */
 #include "infill.h"
+#include <algorithm> // sort
 #include "functional"
+#include "utils/AABB.h"
 #include "utils/polygonUtils.h"
 #include "utils/logoutput.h"
 
 namespace cura {
 
+namespace
+{
+
+// the crossings of the last linear based infill generated on this thread, shared by all processor types of Infill::generateLinearBasedInfill so that their buffers are reused
+thread_local ScanlineCrossings linear_infill_crossings;
+
+}//namespace
+
+void ScanlineCrossings::reset(unsigned int scanline_count)
+{
+    this->scanline_count = scanline_count;
+    added.clear();
+}
+
+void ScanlineCrossings::group()
+{
+    scanline_start.assign(scanline_count + 1, 0);
+    for (const std::pair<unsigned int, int64_t>& crossing : added)
+    {
+        scanline_start[crossing.first + 1]++;
+    }
+    for (unsigned int scanline_idx = 0; scanline_idx < scanline_count; scanline_idx++)
+    {
+        scanline_start[scanline_idx + 1] += scanline_start[scanline_idx];
+    }
+    crossings.resize(added.size());
+    insert_idx.assign(scanline_start.begin(), scanline_start.end() - 1);
+    for (const std::pair<unsigned int, int64_t>& crossing : added)
+    {
+        crossings[insert_idx[crossing.first]++] = crossing.second;
+    }
+    for (unsigned int scanline_idx = 0; scanline_idx < scanline_count; scanline_idx++)
+    { // a scanline mostly has only a few crossings, for which std::sort does an insertion sort
+        std::sort(crossings.begin() + scanline_start[scanline_idx], crossings.begin() + scanline_start[scanline_idx + 1]);
+    }
+}
+
 int Infill::computeScanSegmentIdx(int x, int line_width)
 {
     if (x < 0)
@@ -17,6 +56,19 @@ int Infill::computeScanSegmentIdx(int x, int line_width)
     return x / line_width;
 }
 
+int64_t Infill::getLayerShift() const
+{
+    switch(pattern)
+    {
+    case EFillMethod::CUBIC:
+        return one_over_sqrt_2 * z;
+    case EFillMethod::TETRAHEDRAL:
+        return int64_t(one_over_sqrt_2 * z) % line_distance;
+    default:
+        return 0;
+    }
+}
+
 void Infill::generate(Polygons& result_polygons, Polygons& result_lines)
 {
     if (in_outline.size() == 0) return;
@@ -56,6 +108,26 @@ void Infill::generate(Polygons& result_polygons, Polygons& result_lines)
 
 void Infill::generateConcentricInfill(Polygons outline, Polygons& result, int inset_value)
 {
+    if (concentric_from_outline && outline.size() > 0 && inset_value > 0)
+    {
+        result.add(outline);
+        // no ring lies further inward than half the smallest size of the bounding box
+        const AABB aabb(outline);
+        const int64_t max_inset = std::min(aabb.max.X - aabb.min.X, aabb.max.Y - aabb.min.Y) / 2;
+        std::vector<int> distances;
+        for (int64_t inset = inset_value; inset <= max_inset; inset += inset_value)
+        {
+            distances.push_back(-inset);
+        }
+        std::vector<Polygons> rings;
+        outline.offsetMulti(distances, rings);
+        for (Polygons& ring : rings)
+        {
+            ring.simplify();
+            result.add(ring);
+        }
+        return;
+    }
     while(outline.size() > 0)
     {
         result.add(outline);
@@ -66,66 +138,42 @@ void Infill::generateConcentricInfill(Polygons outline, Polygons& result, int in
 
 void Infill::generateGridInfill(Polygons& result)
 {
-    generateLineInfill(result, line_distance, fill_angle, 0);
-    generateLineInfill(result, line_distance, fill_angle + 90, 0);
+    generateMultiLineInfill(result, line_distance, { fill_angle, fill_angle + 90 }, { 0, 0 });
 }
 
 void Infill::generateCubicInfill(Polygons& result)
 {
-    int64_t shift = one_over_sqrt_2 * z;
-    generateLineInfill(result, line_distance, fill_angle, shift);
-    generateLineInfill(result, line_distance, fill_angle + 120, shift);
-    generateLineInfill(result, line_distance, fill_angle + 240, shift);
+    int64_t shift = getLayerShift();
+    generateMultiLineInfill(result, line_distance, { fill_angle, fill_angle + 120, fill_angle + 240 }, { shift, shift, shift });
 }
 
 void Infill::generateTetrahedralInfill(Polygons& result)
 {
-    int shift = int64_t(one_over_sqrt_2 * z) % line_distance;
+    int shift = getLayerShift();
     shift = std::min(shift, line_distance - shift); // symmetry due to the fact that we are applying the shift in both directions
     shift = std::min(shift, line_distance / 2 - infill_line_width / 2); // don't put lines too close to each other
     shift = std::max(shift, infill_line_width / 2); // don't put lines too close to each other
-    generateLineInfill(result, line_distance, fill_angle, shift);
-    generateLineInfill(result, line_distance, fill_angle, -shift);
-    generateLineInfill(result, line_distance, fill_angle + 90, shift);
-    generateLineInfill(result, line_distance, fill_angle + 90, -shift);
+    generateMultiLineInfill(result, line_distance, { fill_angle, fill_angle, fill_angle + 90, fill_angle + 90 }, { shift, -shift, shift, -shift });
 }
 
 void Infill::generateTriangleInfill(Polygons& result)
 {
-    generateLineInfill(result, line_distance, fill_angle, 0);
-    generateLineInfill(result, line_distance, fill_angle + 60, 0);
-    generateLineInfill(result, line_distance, fill_angle + 120, 0);
+    generateMultiLineInfill(result, line_distance, { fill_angle, fill_angle + 60, fill_angle + 120 }, { 0, 0, 0 });
 }
 
-void Infill::addLineInfill(Polygons& result, const PointMatrix& rotation_matrix, const int scanline_min_idx, const int line_distance, const AABB boundary, std::vector<std::vector<int64_t>>& cut_list, int64_t shift)
+void Infill::addLineInfill(Polygons& result, const PointMatrix& rotation_matrix, const int scanline_min_idx, const int line_distance, const AABB boundary, const ScanlineCrossings& cut_list, unsigned int first_scanline, int64_t shift)
 {
     auto addLine = [&](Point from, Point to)
     {
-        PolygonRef p = result.newPoly();
-        p.add(rotation_matrix.unapply(from));
-        p.add(rotation_matrix.unapply(to));
+        result.addLine(rotation_matrix.unapply(from), rotation_matrix.unapply(to));
     };
 
-    auto compare_int64_t = [](const void* a, const void* b)
-    {
-        int64_t n = (*(int64_t*)a) - (*(int64_t*)b);
-        if (n < 0)
-        {
-            return -1;
-        }
-        if (n > 0)
-        {
-            return 1;
-        }
-        return 0;
-    };
-
-    int scanline_idx = 0;
+    unsigned int scanline_idx = first_scanline;
     for(int64_t x = scanline_min_idx * line_distance + shift; x < boundary.max.X; x += line_distance)
     {
-        std::vector<int64_t>& crossings = cut_list[scanline_idx];
-        qsort(crossings.data(), crossings.size(), sizeof(int64_t), compare_int64_t);
-        for(unsigned int crossing_idx = 0; crossing_idx + 1 < crossings.size(); crossing_idx += 2)
+        const int64_t* crossings = cut_list[scanline_idx];
+        const unsigned int crossing_count = cut_list.size(scanline_idx);
+        for(unsigned int crossing_idx = 0; crossing_idx + 1 < crossing_count; crossing_idx += 2)
         {
             if (crossings[crossing_idx + 1] - crossings[crossing_idx] < infill_line_width / 5)
             { // segment is too short to create infill
@@ -145,6 +193,120 @@ void Infill::generateLineInfill(Polygons& result, int line_distance, const doubl
     generateLinearBasedInfill(outline_offset, result, line_distance, rotation_matrix, lines_processor, connected_zigzags, shift);
 }
 
+void Infill::generateMultiLineInfill(Polygons& result, int line_distance, const std::vector<double>& fill_angles, const std::vector<int64_t>& extra_shifts)
+{
+    if (line_distance == 0 || in_outline.size() == 0)
+    {
+        return;
+    }
+    Polygons outline = (outline_offset != 0) ? in_outline.offset(outline_offset) : in_outline;
+    outline = outline.offset(infill_overlap);
+    if (outline.size() == 0)
+    {
+        return;
+    }
+
+    const unsigned int direction_count = fill_angles.size();
+    std::vector<PointMatrix> rotation_matrices;
+    std::vector<int> shifts;
+    for (unsigned int direction_idx = 0; direction_idx < direction_count; direction_idx++)
+    {
+        rotation_matrices.emplace_back(fill_angles[direction_idx]);
+        int shift = extra_shifts[direction_idx] + this->shift;
+        if (shift < 0)
+        {
+            shift = line_distance - (-shift) % line_distance;
+        }
+        else
+        {
+            shift = shift % line_distance;
+        }
+        shifts.push_back(shift);
+    }
+
+    // the outline rotated in all directions, with the points of each direction after each other for each point of the outline
+    std::vector<Point> rotated_points;
+    std::vector<AABB> boundaries(direction_count);
+    for (unsigned int poly_idx = 0; poly_idx < outline.size(); poly_idx++)
+    {
+        for (const Point& point : outline[poly_idx])
+        {
+            for (unsigned int direction_idx = 0; direction_idx < direction_count; direction_idx++)
+            {
+                rotated_points.push_back(rotation_matrices[direction_idx].apply(point));
+                boundaries[direction_idx].include(rotated_points.back());
+            }
+        }
+    }
+
+    std::vector<int> scanline_min_idxs(direction_count);
+    std::vector<unsigned int> first_scanlines(direction_count + 1, 0);
+    for (unsigned int direction_idx = 0; direction_idx < direction_count; direction_idx++)
+    {
+        const AABB& boundary = boundaries[direction_idx];
+        scanline_min_idxs[direction_idx] = computeScanSegmentIdx(boundary.min.X - shifts[direction_idx], line_distance);
+        const int line_count = computeScanSegmentIdx(boundary.max.X - shifts[direction_idx], line_distance) + 1 - scanline_min_idxs[direction_idx];
+        first_scanlines[direction_idx + 1] = first_scanlines[direction_idx] + std::max(0, line_count);
+    }
+
+    ScanlineCrossings& cut_list = linear_infill_crossings; // mapping from the scanlines of all directions to all intersections with polygon segments
+    cut_list.reset(first_scanlines.back());
+    unsigned int poly_start = 0;
+    for (unsigned int poly_idx = 0; poly_idx < outline.size(); poly_idx++)
+    {
+        const unsigned int poly_size = outline[poly_idx].size();
+        for (unsigned int direction_idx = 0; direction_idx < direction_count; direction_idx++)
+        { // see Infill::generateLinearBasedInfill
+            const int shift = shifts[direction_idx];
+            const int scanline_offset = first_scanlines[direction_idx] - scanline_min_idxs[direction_idx];
+            Point p0 = rotated_points[(poly_start + poly_size - 1) * direction_count + direction_idx];
+            for (unsigned int point_idx = 0; point_idx < poly_size; point_idx++)
+            {
+                const Point p1 = rotated_points[(poly_start + point_idx) * direction_count + direction_idx];
+                if (p1.X == p0.X)
+                {
+                    p0 = p1;
+                    continue;
+                }
+                int scanline_idx0;
+                int scanline_idx1;
+                int direction = 1;
+                if (p0.X < p1.X)
+                {
+                    scanline_idx0 = computeScanSegmentIdx(p0.X - shift, line_distance) + 1;
+                    scanline_idx1 = computeScanSegmentIdx(p1.X - shift, line_distance);
+                }
+                else
+                {
+                    direction = -1;
+                    scanline_idx0 = computeScanSegmentIdx(p0.X - shift, line_distance);
+                    scanline_idx1 = computeScanSegmentIdx(p1.X - shift, line_distance) + 1;
+                }
+                for (int scanline_idx = scanline_idx0; scanline_idx != scanline_idx1 + direction; scanline_idx += direction)
+                {
+                    int x = scanline_idx * line_distance + shift;
+                    int y = p1.Y + (p0.Y - p1.Y) * (x - p1.X) / (p0.X - p1.X);
+                    cut_list.add(scanline_idx + scanline_offset, y);
+                }
+                p0 = p1;
+            }
+        }
+        poly_start += poly_size;
+    }
+    if (cut_list.getScanlineCount() == 0)
+    {
+        return;
+    }
+    cut_list.group();
+
+    for (unsigned int direction_idx = 0; direction_idx < direction_count; direction_idx++)
+    {
+        if (first_scanlines[direction_idx + 1] > first_scanlines[direction_idx])
+        {
+            addLineInfill(result, rotation_matrices[direction_idx], scanline_min_idxs[direction_idx], line_distance, boundaries[direction_idx], cut_list, first_scanlines[direction_idx], shifts[direction_idx]);
+        }
+    }
+}
 
 void Infill::generateZigZagInfill(Polygons& result, const int line_distance, const double& fill_angle, const bool connected_zigzags, const bool use_endpieces)
 {
@@ -193,7 +355,8 @@ void Infill::generateZigZagInfill(Polygons& result, const int line_distance, con
  * Edit: the term scansegment is wrong, since I call a boundary segment leaving from an even scanline to the left as belonging to an even scansegment, 
  *  while I also call a boundary segment leaving from an even scanline toward the right as belonging to an even scansegment.
  */
-void Infill::generateLinearBasedInfill(const int outline_offset, Polygons& result, const int line_distance, const PointMatrix& rotation_matrix, ZigzagConnectorProcessor& zigzag_connector_processor, const bool connected_zigzags, int64_t extra_shift)
+template<class ZigzagProcessor>
+void Infill::generateLinearBasedInfill(const int outline_offset, Polygons& result, const int line_distance, const PointMatrix& rotation_matrix, ZigzagProcessor& zigzag_connector_processor, const bool connected_zigzags, int64_t extra_shift)
 {
     if (line_distance == 0)
     {
@@ -239,12 +402,8 @@ void Infill::generateLinearBasedInfill(const int outline_offset, Polygons& resul
     int scanline_min_idx = computeScanSegmentIdx(boundary.min.X - shift, line_distance);
     int line_count = computeScanSegmentIdx(boundary.max.X - shift, line_distance) + 1 - scanline_min_idx;
 
-    std::vector<std::vector<int64_t> > cut_list; // mapping from scanline to all intersections with polygon segments
-
-    for(int scanline_idx = 0; scanline_idx < line_count; scanline_idx++)
-    {
-        cut_list.push_back(std::vector<int64_t>());
-    }
+    ScanlineCrossings& cut_list = linear_infill_crossings; // mapping from scanline to all intersections with polygon segments
+    cut_list.reset(std::max(0, line_count));
 
     for(unsigned int poly_idx = 0; poly_idx < outline.size(); poly_idx++)
     {
@@ -285,8 +444,8 @@ void Infill::generateLinearBasedInfill(const int outline_offset, Polygons& resul
             {
                 int x = scanline_idx * line_distance + shift;
                 int y = p1.Y + (p0.Y - p1.Y) * (x - p1.X) / (p0.X - p1.X);
-                assert(scanline_idx - scanline_min_idx >= 0 && scanline_idx - scanline_min_idx < int(cut_list.size()) && "reading infill cutlist index out of bounds!");
-                cut_list[scanline_idx - scanline_min_idx].push_back(y);
+                assert(scanline_idx - scanline_min_idx >= 0 && scanline_idx - scanline_min_idx < int(cut_list.getScanlineCount()) && "reading infill cutlist index out of bounds!");
+                cut_list.add(scanline_idx - scanline_min_idx, y);
                 Point scanline_linesegment_intersection(x, y);
                 zigzag_connector_processor.registerScanlineSegmentIntersection(scanline_linesegment_intersection, scanline_idx % 2 == 0);
             }
@@ -296,16 +455,17 @@ void Infill::generateLinearBasedInfill(const int outline_offset, Polygons& resul
         zigzag_connector_processor.registerPolyFinished();
     }
 
-    if (cut_list.size() == 0)
+    if (cut_list.getScanlineCount() == 0)
     {
         return;
     }
-    if (connected_zigzags && cut_list.size() == 1 && cut_list[0].size() <= 2)
+    cut_list.group();
+    if (connected_zigzags && cut_list.getScanlineCount() == 1 && cut_list.size(0) <= 2)
     {
         return;  // don't add connection if boundary already contains whole outline!
     }
 
-    addLineInfill(result, rotation_matrix, scanline_min_idx, line_distance, boundary, cut_list, shift);
+    addLineInfill(result, rotation_matrix, scanline_min_idx, line_distance, boundary, cut_list, 0, shift);
 }
 
 }//namespace cura
@@ -18,8 +18,72 @@
 namespace cura
 {
 
+/*!
+ * The y-coordinates at which polygons cross a range of scanlines, with the crossings of each scanline stored consecutively in a single buffer.
+ * 
+ * The crossings are added in any order and then grouped per scanline with a counting sort,
+ * so that no vector is allocated per scanline.
+ * The buffers are kept when the crossings are reset, so a reused ScanlineCrossings stops allocating once it is large enough.
+ */
+class ScanlineCrossings
+{
+public:
+    /*!
+     * Remove all crossings and start collecting the crossings of a new range of scanlines.
+     * 
+     * \param scanline_count The number of scanlines in the range
+     */
+    void reset(unsigned int scanline_count);
+
+    /*!
+     * Add a crossing.
+     * 
+     * \param scanline_idx The index of the scanline within the range
+     * \param y The y-coordinate at which the scanline is crossed
+     */
+    void add(unsigned int scanline_idx, int64_t y)
+    {
+        added.emplace_back(scanline_idx, y);
+    }
+
+    /*!
+     * Group the crossings added by scanline, and sort the crossings of each scanline by their y-coordinate.
+     */
+    void group();
+
+    unsigned int getScanlineCount() const
+    {
+        return scanline_count;
+    }
+
+    /*!
+     * The number of crossings of a scanline, after ScanlineCrossings::group.
+     */
+    unsigned int size(unsigned int scanline_idx) const
+    {
+        return scanline_start[scanline_idx + 1] - scanline_start[scanline_idx];
+    }
+
+    /*!
+     * The sorted crossings of a scanline, after ScanlineCrossings::group.
+     */
+    const int64_t* operator[](unsigned int scanline_idx) const
+    {
+        return crossings.data() + scanline_start[scanline_idx];
+    }
+
+private:
+    unsigned int scanline_count = 0; //!< The number of scanlines in the range
+    std::vector<std::pair<unsigned int, int64_t>> added; //!< The crossings in the order in which they were added, with the index of their scanline
+    std::vector<unsigned int> scanline_start; //!< For each scanline the index in ScanlineCrossings::crossings of its first crossing, plus the total number of crossings at the end
+    std::vector<int64_t> crossings; //!< The crossings grouped by scanline
+    std::vector<unsigned int> insert_idx; //!< While grouping, the index in ScanlineCrossings::crossings at which to store the next crossing of each scanline
+};
+
 class Infill 
 {
+    friend class InfillCache;
+
     EFillMethod pattern; //!< the space filling pattern of the infill to generate
     const Polygons& in_outline; //!< a reference polygon for getting the actual area within which to generate infill (see outline_offset)
     int outline_offset; //!< Offset from Infill::in_outline to get the actual area within which to generate infill
@@ -31,10 +95,11 @@ class Infill
     int64_t shift; //!< shift of the scanlines in the direction perpendicular to the fill_angle
     bool connected_zigzags; //!< (ZigZag) Whether endpieces of zigzag infill should be connected to the nearest infill line on both sides of the zigzag connector
     bool use_endpieces; //!< (ZigZag) Whether to include endpieces: zigzag connector segments from one infill line to itself
+    bool concentric_from_outline; //!< (Concentric) Whether to offset each ring from the outline by its total distance, instead of from the previous ring
 
     static constexpr double one_over_sqrt_2 = 0.7071067811865475244008443621048490392848359376884740; //!< 1.0 / sqrt(2.0)
 public:
-    Infill(EFillMethod pattern, const Polygons& in_outline, int outline_offset, int infill_line_width, int line_distance, int infill_overlap, double fill_angle, int64_t z, int64_t shift, bool connected_zigzags = false, bool use_endpieces = false)
+    Infill(EFillMethod pattern, const Polygons& in_outline, int outline_offset, int infill_line_width, int line_distance, int infill_overlap, double fill_angle, int64_t z, int64_t shift, bool connected_zigzags = false, bool use_endpieces = false, bool concentric_from_outline = false)
     : pattern(pattern)
     , in_outline(in_outline)
     , outline_offset(outline_offset)
@@ -46,6 +111,7 @@ public:
     , shift(shift)
     , connected_zigzags(connected_zigzags)
     , use_endpieces(use_endpieces)
+    , concentric_from_outline(concentric_from_outline)
     {
     }
     /*!
@@ -68,6 +134,13 @@ private:
      * \param line_distance the width of the scan segments
      */
     static inline int computeScanSegmentIdx(int x, int line_distance);
+
+    /*!
+     * The shift of the scanlines which depends on the height of the layer, for the patterns which shift from layer to layer.
+     * 
+     * \return The shift of cubic infill, the unclamped shift of tetrahedral infill, or zero for patterns which are the same on all layers
+     */
+    int64_t getLayerShift() const;
     /*!
      * Generate sparse concentric infill 
      * \param outline The actual outline of the area within which to generate infill
@@ -107,10 +180,11 @@ private:
      * \param scanline_min_idx The lowest index of all scanlines crossing the polygon
      * \param line_distance The distance between two lines which are in the same direction
      * \param boundary The axis aligned boundary box within which the polygon is
-     * \param cut_list A mapping of each scanline to all y-coordinates (in the space transformed by rotation_matrix) where the polygons are crossing the scanline
+     * \param cut_list The sorted y-coordinates (in the space transformed by rotation_matrix) where the polygons are crossing each scanline
+     * \param first_scanline The index in \p cut_list of the scanline with index \p scanline_min_idx
      * \param total_shift total shift of the scanlines in the direction perpendicular to the fill_angle.
      */
-    void addLineInfill(Polygons& result, const PointMatrix& rotation_matrix, const int scanline_min_idx, const int line_distance, const AABB boundary, std::vector<std::vector<int64_t>>& cut_list, int64_t total_shift);
+    void addLineInfill(Polygons& result, const PointMatrix& rotation_matrix, const int scanline_min_idx, const int line_distance, const AABB boundary, const ScanlineCrossings& cut_list, unsigned int first_scanline, int64_t total_shift);
 
     /*!
      * generate lines within the area of \p in_outline, at regular intervals of \p line_distance
@@ -124,6 +198,19 @@ private:
      * \param extra_shift extra shift of the scanlines in the direction perpendicular to the fill_angle
      */
     void generateLineInfill(Polygons& result, int line_distance, const double& fill_angle, int64_t extra_shift);
+
+    /*!
+     * Generate the lines of Infill::generateLineInfill in several directions at once, with the same result as one call per direction.
+     * 
+     * The outline is offset only once, and each segment of it is crossed with the scanlines of all directions in a single pass.
+     * The crossings of all directions are collected in one ScanlineCrossings, with the scanlines of each direction after those of the previous direction.
+     * 
+     * \param result (output) The resulting lines, in the order of the directions
+     * \param line_distance The distance between two lines which are in the same direction
+     * \param fill_angles The angle of the lines of each direction
+     * \param extra_shifts The extra shift of the scanlines of each direction, see Infill::generateLineInfill
+     */
+    void generateMultiLineInfill(Polygons& result, int line_distance, const std::vector<double>& fill_angles, const std::vector<int64_t>& extra_shifts);
     
     /*!
      * Function for creating linear based infill types (Lines, ZigZag).
@@ -133,6 +220,9 @@ private:
      * 
      * It is called only from Infill::generateLineinfill and Infill::generateZigZagInfill.
      * 
+     * The processor is called for each vertex and each scanline crossing, so its type is a template parameter.
+     * The concrete processors are final, so that these calls are resolved at compile time and the empty ones of NoZigZagConnectorProcessor are inlined away.
+     * 
      * \param outline_offset An offset from the reference polygon (Infill::in_outline) to get the actual outline within which to generate infill
      * \param result (output) The resulting lines
      * \param line_distance The distance between two lines which are in the same direction
@@ -141,7 +231,8 @@ private:
      * \param connected_zigzags Whether to connect the endpiece zigzag segments on both sides to the same infill line
      * \param extra_shift extra shift of the scanlines in the direction perpendicular to the fill_angle
      */
-    void generateLinearBasedInfill(const int outline_offset, Polygons& result, const int line_distance, const PointMatrix& rotation_matrix, ZigzagConnectorProcessor& zigzag_connector_processor, const bool connected_zigzags, int64_t extra_shift);
+    template<class ZigzagProcessor>
+    void generateLinearBasedInfill(const int outline_offset, Polygons& result, const int line_distance, const PointMatrix& rotation_matrix, ZigzagProcessor& zigzag_connector_processor, const bool connected_zigzags, int64_t extra_shift);
 
     /*!
      * 
@@ -0,0 +1,111 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "InfillCache.h"
+
+#include "../utils/logoutput.h"
+#include "../utils/polygonUtils.h"
+
+namespace cura
+{
+
+InfillCache::InfillCache(const char* name)
+: name(name)
+, cached_byte_count(0)
+, hit_count(0)
+, miss_count(0)
+{
+}
+
+bool InfillCache::matches(const Entry& entry, const Infill& infill, uint64_t outline_hash, int64_t layer_shift)
+{
+    return entry.hash == outline_hash
+        && entry.pattern == infill.pattern
+        && entry.outline_offset == infill.outline_offset
+        && entry.infill_line_width == infill.infill_line_width
+        && entry.line_distance == infill.line_distance
+        && entry.infill_overlap == infill.infill_overlap
+        && entry.fill_angle == infill.fill_angle
+        && entry.shift == infill.shift
+        && entry.layer_shift == layer_shift
+        && entry.connected_zigzags == infill.connected_zigzags
+        && entry.use_endpieces == infill.use_endpieces
+        && entry.concentric_from_outline == infill.concentric_from_outline
+        && PolygonUtils::haveSamePoints(entry.outline, infill.in_outline);
+}
+
+size_t InfillCache::getByteCount(const Polygons& polygons)
+{
+    size_t point_count = 0;
+    for (unsigned int poly_idx = 0; poly_idx < polygons.size(); poly_idx++)
+    {
+        point_count += polygons[poly_idx].size();
+    }
+    return point_count * sizeof(Point);
+}
+
+void InfillCache::generate(Infill& infill, Polygons& result_polygons, Polygons& result_lines)
+{
+    if (infill.in_outline.size() == 0 || infill.line_distance == 0)
+    { // nothing is generated
+        return;
+    }
+    const uint64_t outline_hash = PolygonUtils::hashPoints(infill.in_outline);
+    const int64_t layer_shift = infill.getLayerShift();
+    std::unique_lock<std::mutex> lock(mutex);
+    for (std::list<Entry>::iterator entry = entries.begin(); entry != entries.end(); ++entry)
+    {
+        if (matches(*entry, infill, outline_hash, layer_shift))
+        {
+            entries.splice(entries.begin(), entries, entry);
+            hit_count++;
+            result_polygons.add(entry->result_polygons);
+            result_lines.add(entry->result_lines);
+            return;
+        }
+    }
+    miss_count++;
+    lock.unlock();
+    Polygons generated_polygons;
+    Polygons generated_lines;
+    infill.generate(generated_polygons, generated_lines);
+    result_polygons.add(generated_polygons);
+    result_lines.add(generated_lines);
+
+    const size_t byte_count = getByteCount(infill.in_outline) + getByteCount(generated_polygons) + getByteCount(generated_lines);
+    if (byte_count > max_cached_bytes)
+    { // would push everything else out of the cache
+        return;
+    }
+    lock.lock();
+    while (cached_byte_count + byte_count > max_cached_bytes)
+    {
+        cached_byte_count -= entries.back().byte_count;
+        entries.pop_back();
+    }
+    cached_byte_count += byte_count;
+    entries.emplace_front();
+    Entry& entry = entries.front();
+    entry.hash = outline_hash;
+    entry.outline = infill.in_outline;
+    entry.pattern = infill.pattern;
+    entry.outline_offset = infill.outline_offset;
+    entry.infill_line_width = infill.infill_line_width;
+    entry.line_distance = infill.line_distance;
+    entry.infill_overlap = infill.infill_overlap;
+    entry.fill_angle = infill.fill_angle;
+    entry.shift = infill.shift;
+    entry.layer_shift = layer_shift;
+    entry.connected_zigzags = infill.connected_zigzags;
+    entry.use_endpieces = infill.use_endpieces;
+    entry.concentric_from_outline = infill.concentric_from_outline;
+    entry.result_polygons.swap(generated_polygons);
+    entry.result_lines.swap(generated_lines);
+    entry.byte_count = byte_count;
+}
+
+void InfillCache::logStatistics() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    log("Reused the %s of %u of %u areas.\n", name, hit_count, hit_count + miss_count);
+}
+
+}//namespace cura
@@ -0,0 +1,97 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef INFILL_INFILL_CACHE_H
+#define INFILL_INFILL_CACHE_H
+
+#include <list>
+#include <mutex>
+#include <stdint.h>
+
+#include "../infill.h"
+#include "../utils/NoCopy.h"
+#include "../utils/polygon.h"
+
+namespace cura
+{
+
+/*!
+ * The infill generated for the most recently planned infill areas.
+ *
+ * Grid, lines, triangle and concentric infill don't change from layer to layer, so consecutive layers with exactly the same
+ * infill area (as in the prismatic parts of a model) get exactly the same infill, which then doesn't have to be generated again.
+ * Tetrahedral infill repeats with a period of a few layers, and cubic infill shifts on each layer, so that it is rarely reused.
+ * Support keeps the same angle and line distance throughout the print and is often the same on many layers below an overhang,
+ * so the support infill, including its zigzag connectors, is only generated again where the support islands change.
+ *
+ * The infill is identified by the area and all parameters it's generated from, so the result is the same as without the cache.
+ * The cache is bounded by the memory of the areas and infill it keeps.
+ * It may be used by several threads at once; the infill is generated outside of the lock.
+ */
+class InfillCache : NoCopy
+{
+public:
+    /*!
+     * \param name What kind of infill is cached, for the statistics in the log
+     */
+    InfillCache(const char* name);
+
+    /*!
+     * Generate the infill of \p infill, or get it from the cache when the same infill has been generated before.
+     *
+     * \param infill The infill to generate
+     * \param result_polygons (output) The resulting polygons are added to these
+     * \param result_lines (output) The resulting line segments are added to these
+     */
+    void generate(Infill& infill, Polygons& result_polygons, Polygons& result_lines);
+
+    /*!
+     * Log how often infill could be reused.
+     */
+    void logStatistics() const;
+
+private:
+    static constexpr size_t max_cached_bytes = 16 * 1024 * 1024; //!< The memory of the points kept by the cache; only infill of nearby layers is likely to be reused
+
+    /*!
+     * The generated infill with the area and the parameters it's generated from.
+     */
+    struct Entry
+    {
+        uint64_t hash; //!< The hash of \ref Entry::outline
+        Polygons outline;
+        EFillMethod pattern;
+        int outline_offset;
+        int infill_line_width;
+        int line_distance;
+        int infill_overlap;
+        double fill_angle;
+        int64_t shift;
+        int64_t layer_shift; //!< The result of Infill::getLayerShift, which is the only way in which the height of the layer affects the infill
+        bool connected_zigzags;
+        bool use_endpieces;
+        bool concentric_from_outline;
+        Polygons result_polygons;
+        Polygons result_lines;
+        size_t byte_count; //!< The memory of the points of the outline and the results
+    };
+
+    const char* name; //!< What kind of infill is cached
+    std::list<Entry> entries; //!< Most recently used first
+    size_t cached_byte_count; //!< The summed Entry::byte_count of all entries
+    unsigned int hit_count; //!< The number of infill areas for which the infill could be reused
+    unsigned int miss_count; //!< The number of infill areas for which the infill had to be generated
+    mutable std::mutex mutex; //!< Guards the entries and the statistics
+
+    /*!
+     * Whether an entry holds the infill of \p infill.
+     */
+    static bool matches(const Entry& entry, const Infill& infill, uint64_t outline_hash, int64_t layer_shift);
+
+    /*!
+     * The memory of the points of some polygons, in bytes.
+     */
+    static size_t getByteCount(const Polygons& polygons);
+};
+
+}//namespace cura
+
+#endif//INFILL_INFILL_CACHE_H
@@ -8,7 +8,7 @@
 namespace cura
 {
 
-class NoZigZagConnectorProcessor : public ZigzagConnectorProcessor
+class NoZigZagConnectorProcessor final : public ZigzagConnectorProcessor
 {
 public:
     NoZigZagConnectorProcessor(const PointMatrix& rotation_matrix, Polygons& result)
@@ -16,9 +16,16 @@ public:
     {
     }
 
-    void registerVertex(const Point& vertex);
-    void registerScanlineSegmentIntersection(const Point& intersection, bool scanline_is_even);
-    void registerPolyFinished();
+    // lines infill has no connectors; defined here so that the calls of Infill::generateLinearBasedInfill are inlined away
+    void registerVertex(const Point&)
+    {
+    }
+    void registerScanlineSegmentIntersection(const Point&, bool)
+    {
+    }
+    void registerPolyFinished()
+    {
+    }
 };
 
 
@@ -10,7 +10,7 @@ namespace cura
 {
 
 
-class ZigzagConnectorProcessorConnectedEndPieces : public ZigzagConnectorProcessorEndPieces
+class ZigzagConnectorProcessorConnectedEndPieces final : public ZigzagConnectorProcessorEndPieces
 {
 public:
     ZigzagConnectorProcessorConnectedEndPieces(const PointMatrix& rotation_matrix, Polygons& result)
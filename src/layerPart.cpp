@@ -3,6 +3,7 @@
 #include "layerPart.h"
 #include "settings/settings.h"
 #include "progress/Progress.h"
+#include "utils/ThreadPool.h"
 
 #include "utils/SVG.h" // debug output
 
@@ -22,7 +23,7 @@ namespace cura {
 
 void createLayerWithParts(SliceLayer& storageLayer, SlicerLayer* layer, bool union_layers, bool union_all_remove_holes)
 {
-    storageLayer.openPolyLines = layer->openPolylines;
+    storageLayer.openPolyLines.swap(layer->openPolylines);
 
     if (union_all_remove_holes)
     {
@@ -38,19 +39,20 @@ void createLayerWithParts(SliceLayer& storageLayer, SlicerLayer* layer, bool uni
     for(unsigned int i=0; i<result.size(); i++)
     {
         storageLayer.parts.emplace_back();
-        storageLayer.parts[i].outline = result[i];
+        storageLayer.parts[i].outline = std::move(result[i]);
         storageLayer.parts[i].boundaryBox.calculate(storageLayer.parts[i].outline);
     }
+    Polygons().swap(layer->polygons); // the sliced layer is consumed, so free it before the next layer is split into parts
 }
 void createLayerParts(SliceMeshStorage& mesh, Slicer* slicer, bool union_layers, bool union_all_remove_holes)
 {
-    for(unsigned int layer_nr = 0; layer_nr < slicer->layers.size(); layer_nr++)
-    {
-        mesh.layers.push_back(SliceLayer());
+    mesh.layers.resize(slicer->layers.size());
+    ThreadPool::getInstance()->parallelForLayers(0, slicer->layers.size(), [&](int layer_nr)
+    { // each layer is split into parts on its own
         mesh.layers[layer_nr].sliceZ = slicer->layers[layer_nr].z;
         mesh.layers[layer_nr].printZ = slicer->layers[layer_nr].z;
         createLayerWithParts(mesh.layers[layer_nr], &slicer->layers[layer_nr], union_layers, union_all_remove_holes);
-    }
+    });
 }
 
 void layerparts2HTML(SliceDataStorage& storage, const char* filename, bool all_layers, int layer_nr)
@@ -9,14 +9,23 @@
 #include <sys/resource.h>
 #endif
 #include <stddef.h>
+#include <fstream>
+#include <iomanip> // setprecision
+#include <iostream> // cout
 #include <vector>
 
 #include "utils/gettime.h"
 #include "utils/logoutput.h"
 #include "utils/string.h"
+#include "utils/ThreadPool.h"
+#include "utils/Trace.h"
 
 #include "FffProcessor.h"
+#include "progress/ProfilingReport.h"
+#include "progress/SlowLayerCapture.h"
 #include "settings/SettingRegistry.h"
+#include "SliceCache.h"
+#include "SliceDaemon.h"
 
 #include "settings/SettingsToGV.h"
 
@@ -30,11 +39,12 @@ void print_usage()
     cura::logError("CuraEngine help\n");
     cura::logError("\tShow this help message\n");
     cura::logError("\n");
-    cura::logError("CuraEngine connect <host>[:<port>] [-j <settings.def.json>]\n");
+    cura::logError("CuraEngine connect <host>[:<port>] [-j <settings.def.json>] [--no-layer-view]\n");
     cura::logError("  --connect <host>[:<port>]\n\tConnect to <host> via a command socket, \n\tinstead of passing information via the command line\n");
     cura::logError("  -j<settings.def.json>\n\tLoad settings.json file to register all settings and their defaults\n");
+    cura::logError("  --no-layer-view\n\tDon't send the paths of the layers for the layer view, \n\tonly the progress, estimates and gcode.\n");
     cura::logError("\n");
-    cura::logError("CuraEngine slice [-v] [-p] [-j <settings.json>] [-s <settingkey>=<value>] [-g] [-e<extruder_nr>] [-o <output.gcode>] [-l <model.stl>] [--next]\n");
+    cura::logError("CuraEngine slice [-v] [-p] [-j <settings.json>] [-s <settingkey>=<value>] [-g] [-e<extruder_nr>] [-o <output.gcode>] [--target <output.gcode> [-s <settingkey>=<value>]...] [-l <model.stl>] [--next] [--threads <thread_count>] [--low-memory-compression] [--estimate-only] [--area-estimate] [--area-estimate-calibration <time_factor>,<material_factor>] [--layer-range <first_layer>,<last_layer>] [--save-areas <areas_file>] [--load-areas <areas_file>] [--profile <report.json>] [--trace <trace.json>] [--slow-layers <threshold>,<directory>]\n");
     cura::logError("  -v\n\tIncrease the verbose level (show log messages).\n");
     cura::logError("  -p\n\tLog progress information.\n");
     cura::logError("  -j\n\tLoad settings.def.json file to register all settings and their defaults.\n");
@@ -43,13 +53,39 @@ void print_usage()
     cura::logError("  -g\n\tSwitch setting focus to the current mesh group only.\n\tUsed for one-at-a-time printing.\n");
     cura::logError("  -e<extruder_nr>\n\tSwitch setting focus to the extruder train with the given number.\n");
     cura::logError("  --next\n\tGenerate gcode for the previously supplied mesh group and append that to \n\tthe gcode of further models for one-at-a-time printing.\n");
-    cura::logError("  -o <output_file>\n\tSpecify a file to which to write the generated gcode.\n");
+    cura::logError("  -o <output_file>\n\tSpecify a file to which to write the generated gcode.\n\tThe gcode is gzip compressed if the file name ends with .gz.\n");
+    cura::logError("  --target <output_file>\n\tAlso write gcode to another file, from the same sliced data. \n\tThe settings given with -s after this override the global settings \n\tfor that file only, e.g. for another machine variant. \n\tSettings which slicing depends on can't differ between the targets.\n");
+    cura::logError("  --threads <thread_count>\n\tUse the given number of threads for slicing. \n\t0 uses as many threads as there are processor cores.\n");
+    cura::logError("  --low-memory-compression\n\tCompress a .gz output file with a 512 byte window, \n\tso that printers with little memory can decompress it while printing.\n");
+    cura::logError("  --estimate-only\n\tPlan every layer for the print time and material estimates, \n\tbut don't generate any gcode. The estimates are written to \n\tthe standard output as JSON, with the print time in seconds \n\tand the material volume of each extruder in mm^3.\n");
+    cura::logError("  --area-estimate\n\tLike --estimate-only, but estimate from the sliced areas without \n\tplanning any paths. Much faster, but less accurate.\n");
+    cura::logError("  --area-estimate-calibration <time_factor>,<material_factor>\n\tScale the estimates of --area-estimate with the factors fitted by \n\ttests/calibrate_area_estimate.py.\n");
+    cura::logError("  --layer-range <first_layer>,<last_layer>\n\tOnly write the gcode of these layers, between LAYER_RANGE_START \n\tand LAYER_RANGE_END comments, so that tests/distributed_slice.py \n\tcan stitch the ranges written by several processes together. \n\tA last layer of -1 writes up to the top layer.\n");
+    cura::logError("  --save-areas <areas_file>\n\tWrite the sliced areas of each mesh group to a file, \n\tfrom which the gcode can be written without slicing again.\n");
+    cura::logError("  --load-areas <areas_file>\n\tWrite the gcode from the areas saved with --save-areas, \n\tif they were sliced from the same models and settings. \n\tWith --layer-range only the areas of those layers are read.\n");
+    cura::logError("  --profile <report_file>\n\tWrite the wall time, processor time and memory of each stage \n\tand statistics of each mesh to a JSON file. \n\tWhen built with ENABLE_ALLOCATION_COUNTING it includes the allocations of each stage.\n");
+    cura::logError("  --trace <trace_file>\n\tWrite the timeline of the slicing pipeline on each thread to a JSON file \n\tin the Chrome trace format. Only available when built with ENABLE_TRACING.\n");
+    cura::logError("  --slow-layers <threshold>,<directory>\n\tWrite the geometry and the settings of every layer of which the walls, \n\tskin, support, planning or gcode export takes longer than <threshold> seconds \n\tto the existing <directory>, listed in slow_layers.txt. The .polygons files \n\tcan be benchmarked with CuraEngineBenchmarks --layer.\n");
+    cura::logError("\n");
+    cura::logError("CuraEngine precompile <machine.def.json>...\n");
+    cura::logError("\tParse the machine definitions, the definitions they inherit from and their extruder trains\n\tand store them next to each json file in a binary format, which loads much faster.\n\tThe json files are used again when they are changed.\n");
+    cura::logError("\n");
+    cura::logError("CuraEngine serve <port>|<socket> [<max_jobs>]\n");
+    cura::logError("\tRun a daemon which slices the jobs submitted to it on the given port of the loopback interface,\n\tor on a unix domain socket at the given path, which only the current user can access,\n\tkeeping the loaded definitions and models in memory for later jobs.\n\tAt most <max_jobs> jobs are sliced at the same time, one by default.\n");
+    cura::logError("\n");
+    cura::logError("CuraEngine batch <manifest> [<max_jobs> [<memory_limit>]]\n");
+    cura::logError("\tSlice the jobs of a manifest file, which has the arguments of \"CuraEngine slice\" for a job on each line.\n\tThe definitions are loaded only once for all jobs.\n\tAt most <max_jobs> jobs are sliced at the same time, one by default, and no more jobs are started\n\twhile the running jobs use <memory_limit> megabytes of memory together.\n");
+    cura::logError("\n");
+    cura::logError("CuraEngine submit <port>|<socket> [slice arguments]\n");
+    cura::logError("\tLet the daemon on the given port or socket slice a job with the same arguments as \"CuraEngine slice\",\n\tand wait till it's finished.\n");
     cura::logError("\n");
     cura::logError("The settings are appended to the last supplied object:\n");
     cura::logError("CuraEngine slice [general settings] \n\t-g [current group settings] \n\t-e0 [extruder train 0 settings] \n\t-l obj_inheriting_from_last_extruder_train.stl [object settings] \n\t--next [next group settings]\n\t... etc.\n");
     cura::logError("\n");
     cura::logError("In order to load machine definitions from custom locations, you need to create the environment variable CURA_ENGINE_SEARCH_PATH, which should contain all search paths delimited by a (semi-)colon.\n");
     cura::logError("\n");
+    cura::logError("In order to reuse the sliced layers of models across runs, you can set the environment variable CURA_ENGINE_SLICE_CACHE to a directory in which to store them.\n");
+    cura::logError("\n");
 }
 
 //Signal handler for a "floating point exception", which can also be integer division by zero errors.
@@ -81,10 +117,24 @@ void connect(int argc, char **argv)
         port = std::stoi(ip_port.substr(ip_port.find(':') + 1).data());
     }
 
+    bool send_layer_view = true;
     for(int argn = 3; argn < argc; argn++)
     {
         char* str = argv[argn];
-        if (str[0] == '-')
+        if (str[0] == '-' && str[1] == '-')
+        {
+            if (stringcasecompare(str, "--no-layer-view") == 0)
+            {
+                send_layer_view = false;
+            }
+            else
+            {
+                cura::logError("Unknown option: %s\n", str);
+                print_call(argc, argv);
+                print_usage();
+            }
+        }
+        else if (str[0] == '-')
         {
             for(str++; *str; str++)
             {
@@ -110,23 +160,113 @@ void connect(int argc, char **argv)
         }
     }
 
+    // the frontend slices the same models again after every change in the settings
+    SliceCache::getInstance()->setMemoryCacheSize(16);
+    FffProcessor::getInstance()->setReuseSliceData(true);
+
     CommandSocket::instantiate();
+    CommandSocket::getInstance()->setSendLayerView(send_layer_view);
+    FffProcessor::getInstance()->setCommandSocket(CommandSocket::getInstance());
     CommandSocket::getInstance()->connect(ip, port);
 }
 
+/*!
+ * Write the estimated print time in seconds and the material volume of each extruder in mm^3 as JSON, for --estimate-only.
+ */
+void writeEstimatesJSON(std::ostream& stream)
+{
+    FffProcessor* processor = FffProcessor::getInstance();
+    stream << std::fixed << std::setprecision(3);
+    stream << "{\"print_time\": " << processor->getTotalPrintTime() << ", \"material_volume\": [";
+    for (int extruder_nr = 0; extruder_nr < processor->getSettingAsCount(SettingKey::machine_extruder_count); extruder_nr++)
+    {
+        stream << ((extruder_nr > 0) ? ", " : "") << processor->getTotalFilamentUsed(extruder_nr);
+    }
+    stream << "]}\n";
+}
+
+/*!
+ * Find the model files loaded by the -l options of a mesh group, for \ref MeshPrefetch.
+ * 
+ * The options are consumed in the same way as \ref slice does, up to the next --next.
+ * An argument mistaken for a model file only costs loading a file which isn't used.
+ * 
+ * \param argn The first argument of the mesh group
+ */
+std::vector<std::string> findMeshGroupFiles(int argc, char **argv, int argn)
+{
+    std::vector<std::string> filenames;
+    for (; argn < argc; argn++)
+    {
+        const char* str = argv[argn];
+        if (str[0] != '-')
+        {
+            continue;
+        }
+        if (str[1] == '-')
+        {
+            if (stringcasecompare(str, "--next") == 0)
+            {
+                break;
+            }
+            for (const char* option : { "--threads", "--profile", "--slow-layers", "--trace", "--layer-range", "--save-areas", "--load-areas", "--area-estimate-calibration", "--target" })
+            {
+                if (stringcasecompare(str, option) == 0)
+                {
+                    argn++;
+                }
+            }
+            continue;
+        }
+        for (str++; *str && argn < argc; str++)
+        {
+            switch (*str)
+            {
+                case 'l':
+                    argn++;
+                    if (argn < argc)
+                    {
+                        filenames.push_back(argv[argn]);
+                    }
+                    break;
+                case 'e':
+                    if (str[1])
+                    {
+                        str++;
+                    }
+                    break;
+                case 'j':
+                case 'o':
+                case 'g':
+                case 's':
+                    argn++;
+                    break;
+            }
+        }
+    }
+    return filenames;
+}
+
 void slice(int argc, char **argv)
 {   
     FffProcessor::getInstance()->time_keeper.restart();
     
     FMatrix3x3 transformation; // the transformation applied to a model when loaded
+    MeshPrefetch mesh_prefetch; // loads the models of the next mesh group while the current one is sliced
                         
     MeshGroup* meshgroup = new MeshGroup(FffProcessor::getInstance());
+    MeshGroup* previous_meshgroup = nullptr; // the gcode of the previous mesh group may still be written while the next is processed
     
     int extruder_train_nr = 0;
 
     SettingsBase* last_extruder_train = meshgroup->createExtruderTrain(0);
     // extruder defaults cannot be loaded yet cause no json has been parsed
     SettingsBase* last_settings_object = FffProcessor::getInstance();
+    std::string profile_file; // where to write the ProfilingReport, if anywhere
+    std::string trace_file; // where to write the Trace, if anywhere
+    bool estimate_only = false; // whether to write the estimates instead of the gcode
+    bool area_estimate_only = false; // whether the estimates come from the sliced areas only
+    AreaEstimate::Calibration area_estimate_calibration;
     for(int argn = 2; argn < argc; argn++)
     {
         char* str = argv[argn];
@@ -141,7 +281,7 @@ void slice(int argc, char **argv)
                         // Only ClipperLib currently throws exceptions. And only in case that it makes an internal error.
                         log("Loaded from disk in %5.3fs\n", FffProcessor::getInstance()->time_keeper.restart());
                         
-                        for (int extruder_nr = 0; extruder_nr < FffProcessor::getInstance()->getSettingAsCount("machine_extruder_count"); extruder_nr++)
+                        for (int extruder_nr = 0; extruder_nr < FffProcessor::getInstance()->getSettingAsCount(SettingKey::machine_extruder_count); extruder_nr++)
                         { // initialize remaining extruder trains and load the defaults
                             ExtruderTrain* train = meshgroup->createExtruderTrain(extruder_nr); // create new extruder train objects or use already existing ones
                             SettingRegistry::getInstance()->loadExtruderJSONsettings(extruder_nr, train);
@@ -149,12 +289,18 @@ void slice(int argc, char **argv)
 
                         meshgroup->finalize();
 
+                        // the pool is configured before the next models are loaded with it, so that slicing doesn't restart its threads meanwhile
+                        mesh_prefetch.wait();
+                        ThreadPool::getInstance()->setThreadCount(meshgroup->getSettingAsCount(SettingKey::slicing_thread_count), meshgroup->getSettingBoolean(SettingKey::slicing_thread_pinning));
+                        mesh_prefetch.start(findMeshGroupFiles(argc, argv, argn + 1), transformation);
+
                         //start slicing
                         FffProcessor::getInstance()->processMeshGroup(meshgroup);
                         
                         // initialize loading of new meshes
                         FffProcessor::getInstance()->time_keeper.restart();
-                        delete meshgroup;
+                        delete previous_meshgroup;
+                        previous_meshgroup = meshgroup;
                         meshgroup = new MeshGroup(FffProcessor::getInstance());
                         last_extruder_train = meshgroup->createExtruderTrain(0); 
                         last_settings_object = meshgroup;
@@ -164,6 +310,115 @@ void slice(int argc, char **argv)
                         cura::logError("Unknown exception\n");
                         exit(1);
                     }
+                }
+                else if (stringcasecompare(str, "--estimate-only") == 0)
+                {
+                    estimate_only = true;
+                    FffProcessor::getInstance()->setEstimateOnly(true);
+                }
+                else if (stringcasecompare(str, "--area-estimate") == 0)
+                {
+                    estimate_only = true;
+                    area_estimate_only = true;
+                    FffProcessor::getInstance()->setEstimateOnly(true);
+                    FffProcessor::getInstance()->setAreaEstimateOnly(true, area_estimate_calibration);
+                }
+                else if (stringcasecompare(str, "--layer-range") == 0)
+                {
+                    argn++;
+                    int first_layer = 0;
+                    int last_layer = -1;
+                    if (argn >= argc || sscanf(argv[argn], "%d,%d", &first_layer, &last_layer) != 2 || first_layer < 0)
+                    {
+                        cura::logError("Expected <first_layer>,<last_layer> after --layer-range.\n");
+                        print_call(argc, argv);
+                        print_usage();
+                    }
+                    FffProcessor::getInstance()->setLayerRange(first_layer, last_layer);
+                }
+                else if (stringcasecompare(str, "--save-areas") == 0)
+                {
+                    argn++;
+                    if (argn < argc)
+                    {
+                        FffProcessor::getInstance()->setAreaSnapshotOutput(argv[argn]);
+                    }
+                }
+                else if (stringcasecompare(str, "--load-areas") == 0)
+                {
+                    argn++;
+                    if (argn < argc)
+                    {
+                        FffProcessor::getInstance()->setAreaSnapshotInput(argv[argn]);
+                    }
+                }
+                else if (stringcasecompare(str, "--area-estimate-calibration") == 0)
+                {
+                    argn++;
+                    if (argn >= argc || sscanf(argv[argn], "%lf,%lf", &area_estimate_calibration.time_factor, &area_estimate_calibration.material_factor) != 2)
+                    {
+                        cura::logError("Expected <time_factor>,<material_factor> after --area-estimate-calibration.\n");
+                        print_call(argc, argv);
+                        print_usage();
+                    }
+                    FffProcessor::getInstance()->setAreaEstimateOnly(area_estimate_only, area_estimate_calibration);
+                }
+                else if (stringcasecompare(str, "--target") == 0)
+                {
+                    argn++;
+                    SettingsBase* target_settings = (argn < argc)? FffProcessor::getInstance()->addOutputTarget(argv[argn]) : nullptr;
+                    if (!target_settings)
+                    {
+                        cura::logError("Failed to open %s for output.\n", (argn < argc)? argv[argn] : "");
+                        exit(1);
+                    }
+                    last_settings_object = target_settings;
+                }
+                else if (stringcasecompare(str, "--low-memory-compression") == 0)
+                {
+                    FffProcessor::getInstance()->setLowMemoryCompression(true);
+                }
+                else if (stringcasecompare(str, "--threads") == 0)
+                {
+                    argn++;
+                    FffProcessor::getInstance()->setSetting("slicing_thread_count", argv[argn]);
+                }
+                else if (stringcasecompare(str, "--profile") == 0)
+                {
+                    argn++;
+                    if (argn < argc)
+                    {
+                        profile_file = argv[argn];
+                    }
+                }
+                else if (stringcasecompare(str, "--slow-layers") == 0)
+                {
+                    argn++;
+                    double threshold = 0.0;
+                    const char* directory = (argn < argc)? strchr(argv[argn], ',') : nullptr;
+                    if (!directory || sscanf(argv[argn], "%lf,", &threshold) != 1 || directory[1] == '\0')
+                    {
+                        cura::logError("Expected <threshold>,<directory> after --slow-layers.\n");
+                        print_call(argc, argv);
+                        print_usage();
+                    }
+                    SlowLayerCapture::getInstance().start(threshold, directory + 1);
+                }
+                else if (stringcasecompare(str, "--trace") == 0)
+                {
+                    argn++;
+                    if (argn < argc)
+                    {
+                        trace_file = argv[argn];
+                        if (Trace::isAvailable())
+                        {
+                            Trace::getInstance().start();
+                        }
+                        else
+                        {
+                            cura::logError("This CuraEngine was built without ENABLE_TRACING, so no trace is recorded.\n");
+                        }
+                    }
                 }else{
                     cura::logError("Unknown option: %s\n", str);
                 }
@@ -198,7 +453,7 @@ void slice(int argc, char **argv)
                         log("Loading %s from disk...\n", argv[argn]);
                         // transformation = // TODO: get a transformation from somewhere
                         
-                        if (!loadMeshIntoMeshGroup(meshgroup, argv[argn], transformation, last_extruder_train))
+                        if (!mesh_prefetch.load(meshgroup, argv[argn], transformation, last_extruder_train))
                         {
                             logError("Failed to load model: %s\n", argv[argn]);
                         }
@@ -250,7 +505,7 @@ void slice(int argc, char **argv)
         }
     }
 
-    int extruder_count = FffProcessor::getInstance()->getSettingAsCount("machine_extruder_count");
+    int extruder_count = FffProcessor::getInstance()->getSettingAsCount(SettingKey::machine_extruder_count);
     for (extruder_train_nr = 0; extruder_train_nr < extruder_count; extruder_train_nr++)
     { // initialize remaining extruder trains and load the defaults
         ExtruderTrain* train = meshgroup->createExtruderTrain(extruder_train_nr); // create new extruder train objects or use already existing ones
@@ -277,7 +532,37 @@ void slice(int argc, char **argv)
 #endif
     //Finalize the processor, this adds the end.gcode. And reports statistics.
     FffProcessor::getInstance()->finalize();
+    if (estimate_only)
+    {
+        writeEstimatesJSON(std::cout);
+    }
+
+    if (!profile_file.empty())
+    {
+        std::ofstream profile(profile_file);
+        if (profile)
+        {
+            ProfilingReport::getInstance().writeJSON(profile);
+        }
+        else
+        {
+            cura::logError("Failed to open %s for the profiling report.\n", profile_file.c_str());
+        }
+    }
+    if (!trace_file.empty() && Trace::isAvailable())
+    {
+        std::ofstream trace(trace_file);
+        if (trace)
+        {
+            Trace::getInstance().writeJSON(trace);
+        }
+        else
+        {
+            cura::logError("Failed to open %s for the trace.\n", trace_file.c_str());
+        }
+    }
 
+    delete previous_meshgroup;
     delete meshgroup;
 }
 
@@ -332,6 +617,54 @@ int main(int argc, char **argv)
     {
         slice(argc, argv);
     }
+    else if (stringcasecompare(argv[1], "precompile") == 0)
+    {
+        for (int argn = 2; argn < argc; argn++)
+        {
+            SettingsBase definition_settings;
+            if (SettingRegistry::getInstance()->precompileJSONsettings(argv[argn], &definition_settings))
+            {
+                cura::logError("ERROR: Failed to precompile json file: %s\n", argv[argn]);
+                exit(1);
+            }
+        }
+        exit(0);
+    }
+    else if (stringcasecompare(argv[1], "serve") == 0)
+    {
+        if (argc < 3)
+        {
+            print_usage();
+            exit(1);
+        }
+        unsigned int max_jobs = (argc > 3) ? std::max(1, atoi(argv[3])) : 1;
+        SliceDaemon daemon(slice, max_jobs);
+        exit(daemon.serve(argv[2]));
+    }
+    else if (stringcasecompare(argv[1], "batch") == 0)
+    {
+        if (argc < 3)
+        {
+            print_usage();
+            exit(1);
+        }
+        unsigned int max_jobs = (argc > 3) ? std::max(1, atoi(argv[3])) : 1;
+        size_t memory_limit = (argc > 4) ? size_t(std::max(0, atoi(argv[4]))) << 20 : 0;
+        SliceDaemon batch(slice, max_jobs);
+        int failed_job_count = batch.runBatch(argv[2], memory_limit);
+        exit((failed_job_count == 0) ? 0 : 1);
+    }
+    else if (stringcasecompare(argv[1], "submit") == 0)
+    {
+        if (argc < 3)
+        {
+            print_usage();
+            exit(1);
+        }
+        std::vector<std::string> arguments(argv + 3, argv + argc);
+        int exit_status = SliceDaemon::submit(argv[2], arguments);
+        exit((exit_status < 0) ? 1 : exit_status);
+    }
     else if (stringcasecompare(argv[1], "help") == 0)
     {
         print_usage();
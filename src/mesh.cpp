@@ -1,5 +1,10 @@
+#include <algorithm> // min, max, count
+#include <limits> // numeric_limits
+
 #include "mesh.h"
+#include "utils/hugePages.h"
 #include "utils/logoutput.h"
+#include "utils/ThreadPool.h"
 
 namespace cura
 {
@@ -14,6 +19,59 @@ static inline uint32_t pointHash(const Point3& p)
     return ((p.x + vertex_meld_distance/2) / vertex_meld_distance) ^ (((p.y + vertex_meld_distance/2) / vertex_meld_distance) << 10) ^ (((p.z + vertex_meld_distance/2) / vertex_meld_distance) << 20);
 }
 
+/*!
+ * Add the bytes of a 32 bit value to an FNV-1a hash.
+ */
+static inline void hashValue(uint64_t& hash, uint32_t value)
+{
+    for (unsigned int byte_idx = 0; byte_idx < sizeof(value); byte_idx++)
+    {
+        hash ^= (value >> (byte_idx * 8)) & 0xff;
+        hash *= 1099511628211ull;
+    }
+}
+
+/*!
+ * The occurrence of a vertex in a triangle soup, together with the meld cell it falls in.
+ *
+ * The meld cells are the boxes used by pointHash. Vertices within vertex_meld_distance of each other
+ * only get the same hash when they are in the same cell, so melding per cell gives the same result as melding per hash.
+ */
+struct VertexOccurrence
+{
+    int32_t cell_x, cell_y, cell_z; //!< The meld cell
+    uint32_t occurrence_idx; //!< The index of the vertex in the triangle soup
+
+    VertexOccurrence(const Point3& p, uint32_t occurrence_idx)
+    : cell_x(meldCell(p.x))
+    , cell_y(meldCell(p.y))
+    , cell_z(meldCell(p.z))
+    , occurrence_idx(occurrence_idx)
+    {
+    }
+
+    /*!
+     * The coordinate of the meld cell in which a coordinate of a point falls.
+     */
+    static int32_t meldCell(int32_t coordinate)
+    {
+        return (coordinate + vertex_meld_distance/2) / vertex_meld_distance;
+    }
+
+    bool operator<(const VertexOccurrence& other) const
+    {
+        if (cell_x != other.cell_x) return cell_x < other.cell_x;
+        if (cell_y != other.cell_y) return cell_y < other.cell_y;
+        if (cell_z != other.cell_z) return cell_z < other.cell_z;
+        return occurrence_idx < other.occurrence_idx;
+    }
+
+    bool sameCell(const VertexOccurrence& other) const
+    {
+        return cell_x == other.cell_x && cell_y == other.cell_y && cell_z == other.cell_z;
+    }
+};
+
 Mesh::Mesh(SettingsBaseVirtual* parent)
 : SettingsBase(parent)
 {
@@ -32,16 +90,309 @@ void Mesh::addFace(Point3& v0, Point3& v1, Point3& v2)
     face.vertex_index[0] = vi0;
     face.vertex_index[1] = vi1;
     face.vertex_index[2] = vi2;
-    vertices[face.vertex_index[0]].connected_faces.push_back(idx);
-    vertices[face.vertex_index[1]].connected_faces.push_back(idx);
-    vertices[face.vertex_index[2]].connected_faces.push_back(idx);
+}
+
+void Mesh::addFaces(const std::vector<Point3>& triangle_vertices)
+{
+    assert(vertices.empty() && faces.empty());
+    const uint32_t occurrence_count = triangle_vertices.size();
+
+    // for each vertex occurrence, the occurrence it is melded with; later on the index of its vertex
+    std::vector<uint32_t> occurrence_to_vertex;
+    reserveHugePages(occurrence_to_vertex, occurrence_count);
+    occurrence_to_vertex.resize(occurrence_count);
+
+    // Within a cell the occurrences are visited in the order in which addFace would have seen them,
+    // so meld each one with the first earlier unmelded occurrence close enough, just like findIndexOfVertex does.
+    std::vector<uint32_t> cell_vertices; // the occurrences in the current cell which weren't melded with an earlier one
+    auto meldOccurrence = [&](uint32_t occurrence_idx, bool new_cell)
+    {
+        if (new_cell)
+        {
+            cell_vertices.clear();
+        }
+        const Point3& p = triangle_vertices[occurrence_idx];
+        uint32_t melded_with = occurrence_idx;
+        for (uint32_t cell_vertex : cell_vertices)
+        {
+            if ((triangle_vertices[cell_vertex] - p).testLength(vertex_meld_distance))
+            {
+                melded_with = cell_vertex;
+                break;
+            }
+        }
+        if (melded_with == occurrence_idx)
+        {
+            cell_vertices.push_back(melded_with);
+        }
+        occurrence_to_vertex[occurrence_idx] = melded_with;
+    };
+
+    // The cells relative to the lowest cell of the soup usually fit in a single 64 bit sort key together with the occurrence index,
+    // which halves the memory needed for sorting and sorts a lot faster than comparing the cells one coordinate at a time.
+    int32_t min_cell[3] = { std::numeric_limits<int32_t>::max(), std::numeric_limits<int32_t>::max(), std::numeric_limits<int32_t>::max() };
+    int32_t max_cell[3] = { std::numeric_limits<int32_t>::min(), std::numeric_limits<int32_t>::min(), std::numeric_limits<int32_t>::min() };
+    for (const Point3& p : triangle_vertices)
+    {
+        const int32_t cell[3] = { VertexOccurrence::meldCell(p.x), VertexOccurrence::meldCell(p.y), VertexOccurrence::meldCell(p.z) };
+        for (unsigned int axis = 0; axis < 3; axis++)
+        {
+            min_cell[axis] = std::min(min_cell[axis], cell[axis]);
+            max_cell[axis] = std::max(max_cell[axis], cell[axis]);
+        }
+    }
+    auto bitCount = [](uint64_t max_value)
+    {
+        unsigned int bits = 0;
+        while (bits < 64 && (max_value >> bits) != 0)
+        {
+            bits++;
+        }
+        return bits;
+    };
+    unsigned int cell_bits[3];
+    unsigned int key_bits = bitCount(occurrence_count > 0 ? occurrence_count - 1 : 0);
+    for (unsigned int axis = 0; axis < 3; axis++)
+    {
+        cell_bits[axis] = (occurrence_count > 0) ? bitCount(uint64_t(int64_t(max_cell[axis]) - min_cell[axis])) : 0;
+        key_bits += cell_bits[axis];
+    }
+
+    if (key_bits <= 64)
+    {
+        const unsigned int index_bits = key_bits - cell_bits[0] - cell_bits[1] - cell_bits[2];
+        std::vector<uint64_t> keys; // sorted all over, so it misses the TLB a lot with small pages
+        reserveHugePages(keys, occurrence_count);
+        keys.resize(occurrence_count);
+        ThreadPool::getInstance()->parallelFor(0, occurrence_count, [&](int occurrence_idx)
+            {
+                const Point3& p = triangle_vertices[occurrence_idx];
+                uint64_t key = uint64_t(VertexOccurrence::meldCell(p.x) - min_cell[0]);
+                key = (key << cell_bits[1]) | uint64_t(VertexOccurrence::meldCell(p.y) - min_cell[1]);
+                key = (key << cell_bits[2]) | uint64_t(VertexOccurrence::meldCell(p.z) - min_cell[2]);
+                keys[occurrence_idx] = (key << index_bits) | uint64_t(occurrence_idx);
+            }, 1 << 14);
+        ThreadPool::getInstance()->parallelSort(keys.begin(), keys.end());
+        const uint64_t index_mask = (uint64_t(1) << index_bits) - 1;
+        for (uint32_t sorted_idx = 0; sorted_idx < occurrence_count; sorted_idx++)
+        {
+            const bool new_cell = sorted_idx == 0 || (keys[sorted_idx] & ~index_mask) != (keys[sorted_idx - 1] & ~index_mask);
+            meldOccurrence(keys[sorted_idx] & index_mask, new_cell);
+        }
+    }
+    else
+    {
+        std::vector<VertexOccurrence> occurrences;
+        occurrences.reserve(occurrence_count);
+        for (uint32_t occurrence_idx = 0; occurrence_idx < occurrence_count; occurrence_idx++)
+        {
+            occurrences.emplace_back(triangle_vertices[occurrence_idx], occurrence_idx);
+        }
+        ThreadPool::getInstance()->parallelSort(occurrences.begin(), occurrences.end());
+        for (uint32_t sorted_idx = 0; sorted_idx < occurrence_count; sorted_idx++)
+        {
+            const VertexOccurrence& occurrence = occurrences[sorted_idx];
+            meldOccurrence(occurrence.occurrence_idx, sorted_idx == 0 || !occurrence.sameCell(occurrences[sorted_idx - 1]));
+        }
+    }
+    std::vector<uint32_t>().swap(cell_vertices);
+
+    // Number the vertices in order of first occurrence.
+    // An occurrence is always melded with an earlier one, so that one has already been given its vertex index.
+    uint32_t vertex_count = 0;
+    for (uint32_t occurrence_idx = 0; occurrence_idx < occurrence_count; occurrence_idx++)
+    {
+        vertex_count += occurrence_to_vertex[occurrence_idx] == occurrence_idx;
+    }
+    reserveHugePages(vertices, vertex_count);
+    for (uint32_t occurrence_idx = 0; occurrence_idx < occurrence_count; occurrence_idx++)
+    {
+        const uint32_t melded_with = occurrence_to_vertex[occurrence_idx];
+        if (melded_with == occurrence_idx)
+        {
+            occurrence_to_vertex[occurrence_idx] = vertices.size();
+            vertices.emplace_back(triangle_vertices[occurrence_idx]);
+            aabb.include(triangle_vertices[occurrence_idx]);
+        }
+        else
+        {
+            occurrence_to_vertex[occurrence_idx] = occurrence_to_vertex[melded_with];
+        }
+    }
+
+    reserveHugePages(faces, occurrence_count / 3);
+    for (uint32_t occurrence_idx = 0; occurrence_idx + 2 < occurrence_count; occurrence_idx += 3)
+    {
+        const int vi0 = occurrence_to_vertex[occurrence_idx];
+        const int vi1 = occurrence_to_vertex[occurrence_idx + 1];
+        const int vi2 = occurrence_to_vertex[occurrence_idx + 2];
+        if (vi0 == vi1 || vi1 == vi2 || vi0 == vi2) continue; // the face has two vertices which get assigned the same location. Don't add the face.
+
+        int idx = faces.size(); // index of face to be added
+        faces.emplace_back();
+        MeshFace& face = faces[idx];
+        face.vertex_index[0] = vi0;
+        face.vertex_index[1] = vi1;
+        face.vertex_index[2] = vi2;
+    }
+}
+
+void Mesh::addIndexedFaces(const std::vector<Point3>& vertex_positions, const std::vector<uint32_t>& face_vertex_indices)
+{
+    assert(vertices.empty() && faces.empty());
+    const uint32_t unused = std::numeric_limits<uint32_t>::max();
+    auto isDegenerate = [&vertex_positions, &face_vertex_indices](size_t first_corner)
+    {
+        const Point3& p0 = vertex_positions[face_vertex_indices[first_corner]];
+        const Point3& p1 = vertex_positions[face_vertex_indices[first_corner + 1]];
+        const Point3& p2 = vertex_positions[face_vertex_indices[first_corner + 2]];
+        return p0 == p1 || p1 == p2 || p0 == p2;
+    };
+
+    // Keep the used vertices in their original order.
+    std::vector<uint32_t> new_vertex_index(vertex_positions.size(), unused);
+    for (size_t corner_idx = 0; corner_idx + 2 < face_vertex_indices.size(); corner_idx += 3)
+    {
+        if (isDegenerate(corner_idx))
+        {
+            continue;
+        }
+        for (size_t corner = corner_idx; corner < corner_idx + 3; corner++)
+        {
+            new_vertex_index[face_vertex_indices[corner]] = 0;
+        }
+    }
+    reserveHugePages(vertices, vertex_positions.size() - std::count(new_vertex_index.begin(), new_vertex_index.end(), unused));
+    for (uint32_t vertex_idx = 0; vertex_idx < vertex_positions.size(); vertex_idx++)
+    {
+        if (new_vertex_index[vertex_idx] != unused)
+        {
+            new_vertex_index[vertex_idx] = vertices.size();
+            vertices.emplace_back(vertex_positions[vertex_idx]);
+            aabb.include(vertex_positions[vertex_idx]);
+        }
+    }
+
+    reserveHugePages(faces, face_vertex_indices.size() / 3);
+    for (size_t corner_idx = 0; corner_idx + 2 < face_vertex_indices.size(); corner_idx += 3)
+    {
+        if (isDegenerate(corner_idx))
+        {
+            continue;
+        }
+        faces.emplace_back();
+        MeshFace& face = faces.back();
+        for (int corner = 0; corner < 3; corner++)
+        {
+            face.vertex_index[corner] = new_vertex_index[face_vertex_indices[corner_idx + corner]];
+        }
+    }
+}
+
+uint64_t Mesh::getGeometryHash() const
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (const MeshVertex& vertex : vertices)
+    {
+        hashValue(hash, vertex.p.x);
+        hashValue(hash, vertex.p.y);
+        hashValue(hash, vertex.p.z);
+    }
+    for (const MeshFace& face : faces)
+    {
+        for (int vertex_idx : face.vertex_index)
+        {
+            hashValue(hash, vertex_idx);
+        }
+    }
+    return hash;
+}
+
+bool Mesh::isTranslatedCopyOf(const Mesh& other, Point3& offset) const
+{
+    if (vertices.size() != other.vertices.size() || faces.size() != other.faces.size() || vertices.empty())
+    {
+        return false;
+    }
+    offset = vertices[0].p - other.vertices[0].p;
+    if (offset.z != 0)
+    {
+        return false;
+    }
+    for (unsigned int vertex_idx = 1; vertex_idx < vertices.size(); vertex_idx++)
+    {
+        if (vertices[vertex_idx].p - other.vertices[vertex_idx].p != offset)
+        {
+            return false;
+        }
+    }
+    for (unsigned int face_idx = 0; face_idx < faces.size(); face_idx++)
+    {
+        for (unsigned int corner = 0; corner < 3; corner++)
+        {
+            if (faces[face_idx].vertex_index[corner] != other.faces[face_idx].vertex_index[corner])
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void Mesh::setGeometry(std::vector<MeshVertex>&& new_vertices, std::vector<MeshFace>&& new_faces)
+{
+    vertices = std::move(new_vertices);
+    faces = std::move(new_faces);
+    aabb = AABB3D();
+    for (const MeshVertex& vertex : vertices)
+    {
+        aabb.include(vertex.p);
+    }
+    finish();
+}
+
+unsigned int Mesh::removeFacesBelow(int32_t z)
+{
+    std::vector<int32_t> new_vertex_index(vertices.size(), -1);
+    std::vector<MeshVertex> new_vertices;
+    std::vector<MeshFace> new_faces;
+    for (const MeshFace& face : faces)
+    {
+        if (vertices[face.vertex_index[0]].p.z < z && vertices[face.vertex_index[1]].p.z < z && vertices[face.vertex_index[2]].p.z < z)
+        {
+            continue;
+        }
+        new_faces.push_back(face);
+        for (int corner = 0; corner < 3; corner++)
+        {
+            int& vertex_idx = new_faces.back().vertex_index[corner];
+            if (new_vertex_index[vertex_idx] < 0)
+            {
+                new_vertex_index[vertex_idx] = new_vertices.size();
+                new_vertices.push_back(vertices[vertex_idx]);
+            }
+            vertex_idx = new_vertex_index[vertex_idx];
+        }
+    }
+    const unsigned int removed_face_count = faces.size() - new_faces.size();
+    if (removed_face_count == 0)
+    {
+        return 0;
+    }
+    vertices = std::move(new_vertices);
+    faces = std::move(new_faces);
+    finish();
+    return removed_face_count;
 }
 
 void Mesh::clear()
 {
-    faces.clear();
-    vertices.clear();
-    vertex_hash_map.clear();
+    // swap with empty containers, because clear() keeps the memory allocated
+    std::vector<MeshFace>().swap(faces);
+    std::vector<MeshVertex>().swap(vertices);
+    std::unordered_map<uint32_t, std::vector<uint32_t> >().swap(vertex_hash_map);
+    std::vector<uint32_t>().swap(connected_face_start);
+    std::vector<uint32_t>().swap(connected_faces);
 }
 
 void Mesh::finish()
@@ -49,15 +400,41 @@ void Mesh::finish()
     // Finish up the mesh, clear the vertex_hash_map, as it's no longer needed from this point on and uses quite a bit of memory.
     vertex_hash_map.clear();
 
-    // For each face, store which other face is connected with it.
-    for(unsigned int i=0; i<faces.size(); i++)
+    // Store for each vertex which faces are connected to it, by a counting sort of the face corners on vertex index.
+    reserveHugePages(connected_face_start, vertices.size() + 1);
+    connected_face_start.assign(vertices.size() + 1, 0);
+    for (const MeshFace& face : faces)
+    {
+        for (int corner = 0; corner < 3; corner++)
+        {
+            connected_face_start[face.vertex_index[corner] + 1]++;
+        }
+    }
+    for (unsigned int vertex_idx = 0; vertex_idx < vertices.size(); vertex_idx++)
     {
-        MeshFace& face = faces[i];
-        // faces are connected via the outside
-        face.connected_face_index[0] = getFaceIdxWithPoints(face.vertex_index[0], face.vertex_index[1], i, face.vertex_index[2]);
-        face.connected_face_index[1] = getFaceIdxWithPoints(face.vertex_index[1], face.vertex_index[2], i, face.vertex_index[0]);
-        face.connected_face_index[2] = getFaceIdxWithPoints(face.vertex_index[2], face.vertex_index[0], i, face.vertex_index[1]);
+        connected_face_start[vertex_idx + 1] += connected_face_start[vertex_idx];
     }
+    reserveHugePages(connected_faces, connected_face_start.back());
+    connected_faces.resize(connected_face_start.back());
+    std::vector<uint32_t> insert_idx(connected_face_start.begin(), connected_face_start.end() - 1);
+    for (unsigned int face_idx = 0; face_idx < faces.size(); face_idx++)
+    {
+        for (int corner = 0; corner < 3; corner++)
+        {
+            connected_faces[insert_idx[faces[face_idx].vertex_index[corner]]++] = face_idx;
+        }
+    }
+
+    // For each face, store which other face is connected with it.
+    const int faces_per_chunk = 1024;
+    ThreadPool::getInstance()->parallelFor(0, faces.size(), [this](int i)
+        {
+            MeshFace& face = faces[i];
+            // faces are connected via the outside
+            face.connected_face_index[0] = getFaceIdxWithPoints(face.vertex_index[0], face.vertex_index[1], i, face.vertex_index[2]);
+            face.connected_face_index[1] = getFaceIdxWithPoints(face.vertex_index[1], face.vertex_index[2], i, face.vertex_index[0]);
+            face.connected_face_index[2] = getFaceIdxWithPoints(face.vertex_index[2], face.vertex_index[0], i, face.vertex_index[1]);
+        }, faces_per_chunk);
 }
 
 Point3 Mesh::min() const
@@ -120,7 +497,7 @@ See <a href="http://stackoverflow.com/questions/14066933/direct-way-of-computing
 int Mesh::getFaceIdxWithPoints(int idx0, int idx1, int notFaceIdx, int notFaceVertexIdx) const
 {
     std::vector<int> candidateFaces; // in case more than two faces meet at an edge, multiple candidates are generated
-    for(int f : vertices[idx0].connected_faces) // search through all faces connected to the first vertex and find those that are also connected to the second
+    for(int f : getConnectedFaces(idx0)) // search through all faces connected to the first vertex and find those that are also connected to the second
     {
         if (f == notFaceIdx)
         {
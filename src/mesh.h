@@ -9,15 +9,14 @@ namespace cura
 /*!
 Vertex type to be used in a Mesh.
 
-Keeps track of which faces connect to it.
+Which faces connect to a vertex is stored in the Mesh; see Mesh::getConnectedFaces.
 */
 class MeshVertex
 {
 public:
     Point3 p; //!< location of the vertex
-    std::vector<uint32_t> connected_faces; //!< list of the indices of connected faces
 
-    MeshVertex(Point3 p) : p(p) {connected_faces.reserve(8);} //!< doesn't set connected_faces
+    MeshVertex(Point3 p) : p(p) {}
 };
 
 /*! A MeshFace is a 3 dimensional model triangle with 3 points. These points are already converted to integers
@@ -59,15 +58,111 @@ class Mesh : public SettingsBase // inherits settings
     //! The vertex_hash_map stores a index reference of each vertex for the hash of that location. Allows for quick retrieval of points with the same location.
     std::unordered_map<uint32_t, std::vector<uint32_t> > vertex_hash_map;
     AABB3D aabb;
+
+    /*!
+     * For each vertex the position in \ref Mesh::connected_faces of the first face connected to it.
+     * Has one extra element for the end of the faces of the last vertex.
+     */
+    std::vector<uint32_t> connected_face_start;
+
+    /*!
+     * For each vertex the indices of the faces connected to it, in increasing order.
+     * The faces of a vertex are stored consecutively; see \ref Mesh::connected_face_start.
+     */
+    std::vector<uint32_t> connected_faces;
 public:
+    /*!
+     * The indices of the faces connected to a single vertex.
+     */
+    class ConnectedFaces
+    {
+    public:
+        ConnectedFaces(const uint32_t* begin, const uint32_t* end) : begin_(begin), end_(end) {}
+        const uint32_t* begin() const { return begin_; }
+        const uint32_t* end() const { return end_; }
+        size_t size() const { return end_ - begin_; }
+    private:
+        const uint32_t* begin_;
+        const uint32_t* end_;
+    };
+
     std::vector<MeshVertex> vertices;//!< list of all vertices in the mesh
     std::vector<MeshFace> faces; //!< list of all faces in the mesh
 
     Mesh(SettingsBaseVirtual* parent); //!< initializes the settings
 
     void addFace(Point3& v0, Point3& v1, Point3& v2); //!< add a face to the mesh without settings it's connected_faces.
+
+    /*!
+     * Add many faces at once to an empty mesh, without settings their connected_faces.
+     *
+     * Gives the same vertices and faces as calling \ref Mesh::addFace for each face in turn,
+     * but melds the vertices in bulk with a parallel sort, rather than one by one through the vertex_hash_map.
+     *
+     * \param triangle_vertices Three consecutive points for each face (a triangle soup)
+     */
+    void addFaces(const std::vector<Point3>& triangle_vertices);
+
+    /*!
+     * Add the faces of an indexed mesh to an empty mesh, without settings their connected_faces.
+     *
+     * Unlike \ref Mesh::addFace and \ref Mesh::addFaces no vertices are melded: the indices already say which faces share a vertex.
+     * Vertices which aren't used by any face are left out, and faces with two corners at the same location are skipped.
+     *
+     * \param vertex_positions The locations of the vertices
+     * \param face_vertex_indices Three consecutive indices into \p vertex_positions for each face
+     */
+    void addIndexedFaces(const std::vector<Point3>& vertex_positions, const std::vector<uint32_t>& face_vertex_indices);
+    /*!
+     * Replace all vertices and faces of a finished mesh at once, e.g. by a simplified version of the mesh, and finish it again.
+     *
+     * The bounding box is recomputed from the new vertices.
+     *
+     * \param new_vertices The vertices, each of which is used by at least one face
+     * \param new_faces The faces, of which the connected faces are set by \ref Mesh::finish
+     */
+    void setGeometry(std::vector<MeshVertex>&& new_vertices, std::vector<MeshFace>&& new_faces);
+
+    /*!
+     * Remove the faces of a finished mesh which lie entirely below a height, and the vertices used only by them, and finish it again.
+     *
+     * The bounding box is kept that of the whole mesh, so that whatever is placed relative to it stays where it was.
+     *
+     * \param z The height below which faces are removed
+     * \return The number of faces removed
+     */
+    unsigned int removeFacesBelow(int32_t z);
+
     void clear(); //!< clears all data
-    void finish(); //!< complete the model : set the connected_face_index fields of the faces.
+    void finish(); //!< complete the model : build the faces connected to each vertex and set the connected_face_index fields of the faces.
+
+    /*!
+     * Get a hash of the vertex positions and the faces of the mesh.
+     * 
+     * Two meshes with the same hash almost certainly have the same geometry, and are therefore sliced the same way.
+     */
+    uint64_t getGeometryHash() const;
+
+    /*!
+     * Whether this mesh is another mesh moved in the horizontal plane: the same faces, with each vertex at the same offset from the vertex of the other mesh.
+     * 
+     * \param other The mesh to compare with
+     * \param[out] offset The offset of this mesh relative to \p other, when it is a copy
+     * \return Whether this mesh is a translated copy of \p other
+     */
+    bool isTranslatedCopyOf(const Mesh& other, Point3& offset) const;
+
+    /*!
+     * Get the faces connected to a vertex, in increasing order of face index.
+     *
+     * Only available after \ref Mesh::finish.
+     *
+     * \param vertex_idx The index of the vertex
+     */
+    ConnectedFaces getConnectedFaces(uint32_t vertex_idx) const
+    {
+        return ConnectedFaces(connected_faces.data() + connected_face_start[vertex_idx], connected_faces.data() + connected_face_start[vertex_idx + 1]);
+    }
 
     Point3 min() const; //!< min (in x,y and z) vertex of the bounding box
     Point3 max() const; //!< max (in x,y and z) vertex of the bounding box
@@ -1,34 +1,72 @@
 #include "multiVolumes.h"
 
+#include <algorithm> // min
+#include <utility> // pair
+
+#include "utils/ThreadPool.h"
+
 namespace cura 
 {
  
+namespace
+{
+/*!
+ * Compute the bounding box of each layer of each volume, so that volumes which don't touch in a layer can be skipped cheaply.
+ */
+std::vector<std::vector<AABB>> computeLayerBoxes(std::vector<Slicer*> &volumes)
+{
+    std::vector<std::vector<AABB>> layer_boxes(volumes.size());
+    for (unsigned int volume_idx = 0; volume_idx < volumes.size(); volume_idx++)
+    {
+        Slicer& volume = *volumes[volume_idx];
+        layer_boxes[volume_idx].resize(volume.layers.size());
+        ThreadPool::getInstance()->parallelForLayers(0, volume.layers.size(), [&](int layer_nr)
+        {
+            layer_boxes[volume_idx][layer_nr].calculate(volume.layers[layer_nr].polygons);
+        });
+    }
+    return layer_boxes;
+}
+}
+
 void carveMultipleVolumes(std::vector<Slicer*> &volumes)
 {
+    const std::vector<std::vector<AABB>> layer_boxes = computeLayerBoxes(volumes);
     //Go trough all the volumes, and remove the previous volume outlines from our own outline, so we never have overlapped areas.
-    for (unsigned int volume_1_idx = 0; volume_1_idx < volumes.size(); volume_1_idx++)
+    //The previous volumes have already been carved themselves, so each pair of volumes is carved for all layers at once.
+    std::vector<std::pair<const Polygons*, const Polygons*>> operands;
+    std::vector<SlicerLayer*> carved_layers; // the layer carved by each of the operands
+    std::vector<Polygons> results;
+    for (unsigned int volume_1_idx = 1; volume_1_idx < volumes.size(); volume_1_idx++)
     {
         Slicer& volume_1 = *volumes[volume_1_idx];
-        if (volume_1.mesh->getSettingBoolean("infill_mesh"))
+        if (volume_1.mesh->getSettingBoolean(SettingKey::infill_mesh))
         {
             continue;
         }
         for (unsigned int volume_2_idx = 0; volume_2_idx < volume_1_idx; volume_2_idx++)
         {
             Slicer& volume_2 = *volumes[volume_2_idx];
-            if (volume_2.mesh->getSettingBoolean("infill_mesh"))
+            if (volume_2.mesh->getSettingBoolean(SettingKey::infill_mesh))
             {
                 continue;
             }
-            if (!volume_1.mesh->getAABB().hit(volume_2.mesh->getAABB()))
+            operands.clear();
+            carved_layers.clear();
+            const unsigned int layer_count = std::min(volume_1.layers.size(), volume_2.layers.size());
+            for (unsigned int layer_nr = 0; layer_nr < layer_count; layer_nr++)
             {
-                continue;
+                if (!layer_boxes[volume_1_idx][layer_nr].hit(layer_boxes[volume_2_idx][layer_nr]))
+                { // the carved outlines only get smaller, so the boxes from before carving are safe
+                    continue;
+                }
+                operands.emplace_back(&volume_1.layers[layer_nr].polygons, &volume_2.layers[layer_nr].polygons);
+                carved_layers.push_back(&volume_1.layers[layer_nr]);
             }
-            for (unsigned int layerNr = 0; layerNr < volume_1.layers.size(); layerNr++)
+            Polygons::batchOperation(ClipperLib::ctDifference, operands, results);
+            for (unsigned int operand_idx = 0; operand_idx < operands.size(); operand_idx++)
             {
-                SlicerLayer& layer1 = volume_1.layers[layerNr];
-                SlicerLayer& layer2 = volume_2.layers[layerNr];
-                layer1.polygons = layer1.polygons.difference(layer2.polygons);
+                carved_layers[operand_idx]->polygons = std::move(results[operand_idx]);
             }
         }
     }
@@ -44,35 +82,48 @@ void generateMultipleVolumesOverlap(std::vector<Slicer*> &volumes)
     }
 
     int offset_to_merge_other_merged_volumes = 20;
-    for (Slicer* volume : volumes)
+    const std::vector<std::vector<AABB>> layer_boxes = computeLayerBoxes(volumes);
+    for (unsigned int volume_idx = 0; volume_idx < volumes.size(); volume_idx++)
     {
-        int overlap = volume->mesh->getSettingInMicrons("multiple_mesh_overlap");
-        if (volume->mesh->getSettingBoolean("infill_mesh")
+        Slicer* volume = volumes[volume_idx];
+        int overlap = volume->mesh->getSettingInMicrons(SettingKey::multiple_mesh_overlap);
+        if (volume->mesh->getSettingBoolean(SettingKey::infill_mesh)
             || overlap == 0)
         {
             continue;
         }
         AABB3D aabb(volume->mesh->getAABB());
         aabb.expandXY(overlap); // expand to account for the case where two models and their bounding boxes are adjacent along the X or Y-direction
-        for (unsigned int layer_nr = 0; layer_nr < volume->layers.size(); layer_nr++)
+        std::vector<unsigned int> other_volume_indices; // the volumes which may touch this volume at all
+        for (unsigned int other_volume_idx = 0; other_volume_idx < volumes.size(); other_volume_idx++)
         {
+            Slicer* other_volume = volumes[other_volume_idx];
+            if (!other_volume->mesh->getSettingBoolean(SettingKey::infill_mesh)
+                && other_volume->mesh->getAABB().hit(aabb))
+            {
+                other_volume_indices.push_back(other_volume_idx);
+            }
+        }
+        // each layer only depends on the same layer of the other volumes
+        ThreadPool::getInstance()->parallelForLayers(0, volume->layers.size(), [&](int layer_nr)
+        {
+            AABB layer_box = layer_boxes[volume_idx][layer_nr];
+            layer_box.expand(overlap + offset_to_merge_other_merged_volumes);
             Polygons all_other_volumes;
-            for (Slicer* other_volume : volumes)
+            for (unsigned int other_volume_idx : other_volume_indices)
             {
-                if (other_volume->mesh->getSettingBoolean("infill_mesh")
-                    || !other_volume->mesh->getAABB().hit(aabb)
-                )
-                {
+                if (!layer_box.hit(layer_boxes[other_volume_idx][layer_nr]))
+                { // too far away to overlap with the expanded layer
                     continue;
                 }
-                SlicerLayer& other_volume_layer = other_volume->layers[layer_nr];
+                SlicerLayer& other_volume_layer = volumes[other_volume_idx]->layers[layer_nr];
                 all_other_volumes = all_other_volumes.unionPolygons(other_volume_layer.polygons.offset(offset_to_merge_other_merged_volumes));
             }
             all_other_volumes = all_other_volumes.offset(-offset_to_merge_other_merged_volumes);
 
             SlicerLayer& volume_layer = volume->layers[layer_nr];
             volume_layer.polygons.unionPolygons(all_other_volumes.intersection(volume_layer.polygons.offset(overlap / 2)));
-        }
+        });
     }
 }
  
@@ -1,7 +1,10 @@
 /** Copyright (C) 2013 David Braam - Released under terms of the AGPLv3 License */
+#include <cmath> // sqrt
+
 #include "pathOrderOptimizer.h"
 #include "utils/logoutput.h"
 #include "utils/SparseGrid.h"
+#include "utils/AABB.h"
 #include "utils/linearAlg2D.h"
 
 #define INLINE static inline
@@ -13,8 +16,7 @@ namespace cura {
 */
 void PathOrderOptimizer::optimize()
 {
-    bool picked[polygons.size()];
-    memset(picked, false, sizeof(bool) * polygons.size());/// initialized as falses
+    std::vector<bool> picked(polygons.size(), false); /// initialized as falses
     
     for (PolygonRef poly : polygons) /// find closest point to initial starting point within each polygon +initialize picked
     {
@@ -35,6 +37,36 @@ void PathOrderOptimizer::optimize()
         assert(poly.size() != 2);
     }
 
+    // the polygons which can still be picked, so that we don't need to look at picked polygons when searching the whole layer
+    std::vector<unsigned int> unpicked; // skip single-point-polygons
+    std::vector<unsigned int> unpicked_position(polygons.size()); // the index in unpicked of each polygon which is still in it
+    AABB start_points_box;
+    for (unsigned int poly_idx = 0; poly_idx < polygons.size(); poly_idx++)
+    {
+        if (polygons[poly_idx].size() < 1)
+        {
+            continue;
+        }
+        unpicked_position[poly_idx] = unpicked.size();
+        unpicked.push_back(poly_idx);
+        start_points_box.include(polygons[poly_idx][polyStart[poly_idx]]);
+    }
+
+    // when there are many polygons, the closest next polygon is looked up in a grid of the starting points
+    // choose the cells such that there is about one starting point per cell
+    const bool use_grid = unpicked.size() > grid_min_polygon_count;
+    const coord_t grid_cell_size = use_grid ? std::max(coord_t(1), coord_t(std::max(start_points_box.max.X - start_points_box.min.X, start_points_box.max.Y - start_points_box.min.Y) / std::sqrt(unpicked.size()))) : 1;
+    SparseGrid<unsigned int> start_point_grid(grid_cell_size, use_grid ? unpicked.size() : 0);
+    if (use_grid)
+    {
+        std::vector<SparseGrid<unsigned int>::Elem> start_points;
+        start_points.reserve(unpicked.size());
+        for (unsigned int poly_idx : unpicked)
+        {
+            start_points.emplace_back(polygons[poly_idx][polyStart[poly_idx]], poly_idx);
+        }
+        start_point_grid.insertAll(start_points);
+    }
 
     Point prev_point = startPoint;
     for (unsigned int poly_order_idx = 0; poly_order_idx < polygons.size(); poly_order_idx++) /// actual path order optimizer
@@ -42,23 +74,46 @@ void PathOrderOptimizer::optimize()
         int best_poly_idx = -1;
         float bestDist = std::numeric_limits<float>::infinity();
 
-
-        for (unsigned int poly_idx = 0; poly_idx < polygons.size(); poly_idx++)
-        {
-            if (picked[poly_idx] || polygons[poly_idx].size() < 1) /// skip single-point-polygons
+        // pick the lowest index of the closest polygons, independent of the order in which the candidates are checked
+        auto updateBestPoly = [&](unsigned int poly_idx)
             {
-                continue;
-            }
+                if (picked[poly_idx])
+                {
+                    return;
+                }
+                assert (polygons[poly_idx].size() != 2);
 
-            assert (polygons[poly_idx].size() != 2);
+                float dist = vSize2f(polygons[poly_idx][polyStart[poly_idx]] - prev_point);
+                if (dist < bestDist || (dist == bestDist && int(poly_idx) < best_poly_idx))
+                {
+                    best_poly_idx = poly_idx;
+                    bestDist = dist;
+                }
+            };
 
-            float dist = vSize2f(polygons[poly_idx][polyStart[poly_idx]] - prev_point);
-            if (dist < bestDist)
+        coord_t search_radius = grid_cell_size;
+        while (true)
+        {
+            const double cells_per_side = 2.0 * search_radius / grid_cell_size + 1;
+            if (!use_grid || cells_per_side * cells_per_side > unpicked.size())
+            { // looking at all remaining polygons is cheaper than looking in that many cells
+                for (unsigned int poly_idx : unpicked)
+                {
+                    updateBestPoly(poly_idx);
+                }
+                break;
+            }
+            auto process_func = [&updateBestPoly](const SparseGrid<unsigned int>::Elem& elem)
+                {
+                    updateBestPoly(elem.val);
+                };
+            start_point_grid.processNearby(prev_point, search_radius, process_func);
+            // all polygons which can have the same (rounded) distance as the best one lie within the searched radius
+            if (best_poly_idx > -1 && double(search_radius) * search_radius >= double(bestDist) * (1.0 + 1e-6) + 1.0)
             {
-                best_poly_idx = poly_idx;
-                bestDist = dist;
+                break;
             }
-
+            search_radius *= 2;
         }
 
 
@@ -70,6 +125,11 @@ void PathOrderOptimizer::optimize()
 
             picked[best_poly_idx] = true;
             polyOrder.push_back(best_poly_idx);
+
+            const unsigned int moved_poly_idx = unpicked.back();
+            unpicked[unpicked_position[best_poly_idx]] = moved_poly_idx;
+            unpicked_position[moved_poly_idx] = unpicked_position[best_poly_idx];
+            unpicked.pop_back();
         }
         else
         {
@@ -103,23 +163,45 @@ int PathOrderOptimizer::getPolyStart(Point prev_point, int poly_idx)
 int PathOrderOptimizer::getClosestPointInPolygon(Point prev_point, int poly_idx)
 {
     PolygonRef poly = polygons[poly_idx];
+    const unsigned int size = poly.size();
+
+    // start the scan at a point close to prev_point, found among a sample of the points,
+    // so that the best score is soon low enough to skip the angle of most other points
+    unsigned int start_idx = 0;
+    const unsigned int sample_step = std::max(1u, static_cast<unsigned int>(std::sqrt(size)));
+    int64_t closest_sample_dist = std::numeric_limits<int64_t>::max();
+    for (unsigned int point_idx = 0; point_idx < size; point_idx += sample_step)
+    {
+        const int64_t dist = vSize2(poly[point_idx] - prev_point);
+        if (dist < closest_sample_dist)
+        {
+            start_idx = point_idx;
+            closest_sample_dist = dist;
+        }
+    }
 
     int best_point_idx = -1;
     float best_point_score = std::numeric_limits<float>::infinity();
-    Point p0 = poly.back();
-    for (unsigned int point_idx = 0; point_idx < poly.size(); point_idx++)
+    constexpr float max_inside_corner_bonus = 2.01f * 5000 * 5000; // slightly more than the score of the sharpest inside corner
+    for (unsigned int scan_idx = 0; scan_idx < size; scan_idx++)
     {
+        const unsigned int point_idx = (start_idx + scan_idx < size) ? start_idx + scan_idx : start_idx + scan_idx - size;
         Point& p1 = poly[point_idx];
-        Point& p2 = poly[(point_idx + 1) % poly.size()];
         int64_t dist = vSize2(p1 - prev_point);
+        if (dist - max_inside_corner_bonus >= best_point_score)
+        { // too far away to be better even on the sharpest inside corner, so the angle isn't needed
+            continue;
+        }
+        Point& p0 = poly[(point_idx == 0) ? size - 1 : point_idx - 1];
+        Point& p2 = poly[(point_idx + 1 == size) ? 0 : point_idx + 1];
         float is_on_inside_corner_score = -LinearAlg2D::getAngleLeft(p0, p1, p2) / M_PI * 5000 * 5000; // prefer inside corners
         // this score is in the order of 5 mm
-        if (dist + is_on_inside_corner_score < best_point_score)
-        {
+        const float score = dist + is_on_inside_corner_score;
+        if (score < best_point_score || (score == best_point_score && static_cast<int>(point_idx) < best_point_idx))
+        { // of the points with the same score the first one wins, independent of where the scan started
             best_point_idx = point_idx;
-            best_point_score = dist + is_on_inside_corner_score;
+            best_point_score = score;
         }
-        p0 = p1;
     }
     return best_point_idx;
 }
@@ -154,8 +236,9 @@ void LineOrderOptimizer::optimize()
 {
     int gridSize = 5000; // the size of the cells in the hash grid. TODO
     SparseGrid<unsigned int> line_bucket_grid(gridSize);
-    bool picked[polygons.size()];
-    memset(picked, false, sizeof(bool) * polygons.size());/// initialized as falses
+    std::vector<bool> picked(polygons.size(), false); /// initialized as falses
+    std::vector<unsigned int> unpicked; // the lines which can still be picked, so that we don't need to look at picked lines when searching the whole layer
+    std::vector<unsigned int> unpicked_position(polygons.size()); // the index in unpicked of each line which is still in it
     
     for (unsigned int poly_idx = 0; poly_idx < polygons.size(); poly_idx++) /// find closest point to initial starting point within each polygon +initialize picked
     {
@@ -178,6 +261,11 @@ void LineOrderOptimizer::optimize()
         line_bucket_grid.insert(poly[0], poly_idx);
         line_bucket_grid.insert(poly[1], poly_idx);
 
+        if (poly.size() >= 1)
+        {
+            unpicked_position[poly_idx] = unpicked.size();
+            unpicked.push_back(poly_idx);
+        }
     }
 
 
@@ -201,17 +289,43 @@ void LineOrderOptimizer::optimize()
         }
 
         if (best_line_idx == -1) /// if single-line-polygon hasn't been found yet
-        {
-            for (unsigned int poly_idx = 0; poly_idx < polygons.size(); poly_idx++)
+        { // search ever larger areas of the grid for the best line among all remaining lines
+            int best_line_start_point_idx = -1;
+            auto updateBestLineOfAll = [&](unsigned int poly_idx)
+                {
+                    if (!picked[poly_idx])
+                    {
+                        assert(polygons[poly_idx].size() == 2);
+                        updateBestLineIndependentOfOrder(poly_idx, best_line_idx, best_line_start_point_idx, best_score, prev_point, incoming_perpundicular_normal);
+                    }
+                };
+            coord_t search_radius = gridSize * 2;
+            while (true)
             {
-                if (picked[poly_idx] || polygons[poly_idx].size() < 1) /// skip single-point-polygons
+                const double cells_per_side = 2.0 * search_radius / gridSize + 1;
+                if (cells_per_side * cells_per_side > unpicked.size())
+                { // looking at all remaining lines is cheaper than looking in that many cells
+                    for (unsigned int poly_idx : unpicked)
+                    {
+                        updateBestLineOfAll(poly_idx);
+                    }
+                    break;
+                }
+                auto process_func = [&updateBestLineOfAll](const SparseGrid<unsigned int>::Elem& elem)
+                    {
+                        updateBestLineOfAll(elem.val);
+                    };
+                line_bucket_grid.processNearby(prev_point, search_radius, process_func);
+                // all lines which can have a score as good as the best one lie within the searched radius
+                if (best_line_idx > -1 && double(search_radius) * search_radius >= (double(best_score) + max_angle_score) * (1.0 + 1e-6) + 1.0)
                 {
-                    continue;
+                    break;
                 }
-                assert(polygons[poly_idx].size() == 2);
-
-                updateBestLine(poly_idx, best_line_idx, best_score, prev_point, incoming_perpundicular_normal);
-
+                search_radius *= 2;
+            }
+            if (best_line_idx > -1)
+            {
+                polyStart[best_line_idx] = best_line_start_point_idx;
             }
         }
 
@@ -229,6 +343,11 @@ void LineOrderOptimizer::optimize()
 
             picked[best_line_idx] = true;
             polyOrder.push_back(best_line_idx);
+
+            const unsigned int moved_poly_idx = unpicked.back();
+            unpicked[unpicked_position[best_line_idx]] = moved_poly_idx;
+            unpicked_position[moved_poly_idx] = unpicked_position[best_line_idx];
+            unpicked.pop_back();
         }
         else
         {
@@ -262,6 +381,24 @@ inline void LineOrderOptimizer::updateBestLine(unsigned int poly_idx, int& best,
     }
 }
 
+void LineOrderOptimizer::updateBestLineIndependentOfOrder(unsigned int poly_idx, int& best, int& best_start_point_idx, float& best_score, Point prev_point, Point incoming_perpundicular_normal)
+{
+    Point& p0 = polygons[poly_idx][0];
+    Point& p1 = polygons[poly_idx][1];
+    float dot_score = getAngleScore(incoming_perpundicular_normal, p0, p1);
+    for (int point_idx = 0; point_idx < 2; point_idx++)
+    {
+        float score = vSize2f(polygons[poly_idx][point_idx] - prev_point) + dot_score; // prefer 90 degree corners
+        if (score < best_score
+            || (score == best_score && (int(poly_idx) < best || (int(poly_idx) == best && point_idx < best_start_point_idx))))
+        {
+            best = poly_idx;
+            best_start_point_idx = point_idx;
+            best_score = score;
+        }
+    }
+}
+
 float LineOrderOptimizer::getAngleScore(Point incoming_perpundicular_normal, Point p0, Point p1)
 {
     return dot(incoming_perpundicular_normal, normal(p1 - p0, 1000)) * 0.0001f;
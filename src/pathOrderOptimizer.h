@@ -43,6 +43,8 @@ public:
     void optimize(); //!< sets #polyStart and #polyOrder
 
 private:
+    static constexpr unsigned int grid_min_polygon_count = 16; //!< The number of polygons from which on the closest next polygon is looked up in a grid rather than among all polygons
+
     int getPolyStart(Point prev_point, int poly_idx);
     int getClosestPointInPolygon(Point prev, int i_polygon); //!< returns the index of the closest point
     int getFarthestPointInPolygon(int poly_idx); //!< return the index to the point farthest from the front (highest y)
@@ -98,6 +100,23 @@ private:
      */
     void updateBestLine(unsigned int poly_idx, int& best, float& best_score, Point prev_point, Point incoming_perpundicular_normal);
 
+    /*!
+     * Update the best line like LineOrderOptimizer::updateBestLine, but such that the result doesn't depend on the order in which the lines are tested.
+     * 
+     * Of the lines with the same score the one with the lowest index wins, and the first point of a line wins over the second,
+     * which is what LineOrderOptimizer::updateBestLine gives when testing all lines in order.
+     * 
+     * LineOrderOptimizer::polyStart isn't changed; the start point of the best line is returned in \p best_start_point_idx instead.
+     * 
+     * \param poly_idx[in] The index in LineOrderOptimizer::polygons for the current line to test
+     * \param best[in, out] The index of current best line
+     * \param best_start_point_idx[in, out] The index of the point of the current best line at which to start
+     * \param best_score[in, out] The distance score for the current best line
+     * \param prev_point[in] The previous point from which to find the next best line
+     * \param incoming_perpundicular_normal[in] The direction of movement when the print head arrived at \p prev_point, turned 90 degrees CCW
+     */
+    void updateBestLineIndependentOfOrder(unsigned int poly_idx, int& best, int& best_start_point_idx, float& best_score, Point prev_point, Point incoming_perpundicular_normal);
+
     /*!
      * Get a score to modify the distance score for measuring how good two lines follow each other.
      * 
@@ -110,6 +129,8 @@ private:
      * 
      */
     static float getAngleScore(Point incoming_perpundicular_normal, Point from, Point to);
+
+    static constexpr float max_angle_score = 200.0f; //!< An upper bound on the absolute value of LineOrderOptimizer::getAngleScore
 };
 
 }//namespace cura
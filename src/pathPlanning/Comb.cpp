@@ -13,26 +13,28 @@ namespace cura {
 // boundary_outside is only computed when it's needed!
 Polygons& Comb::getBoundaryOutside()
 {
+    boundary_outside_used = true;
     if (!boundary_outside)
     {
-        boundary_outside = new Polygons();
-        *boundary_outside = storage.getLayerOutlines(layer_nr, false).offset(offset_from_outlines_outside); 
+        boundary_outside = storage.comb_boundary_cache.getOutside(storage.getLayerOutlines(layer_nr, false), offset_from_outlines_outside, offset_from_inside_to_outside * 3 / 2);
     }
-    return *boundary_outside;
+    return boundary_outside->polygons;
 }
 
 SparseGrid<PolygonsPointIndex>& Comb::getOutsideLocToLine()
 {
-    Polygons& outside = getBoundaryOutside();
-    if (!outside_loc_to_line)
-    {
-        outside_loc_to_line = PolygonUtils::createLocToLineGrid(outside, offset_from_inside_to_outside * 3 / 2);
-    }
-    return *outside_loc_to_line;
+    getBoundaryOutside();
+    return boundary_outside->getLocToLine();
+}
+
+const PolygonsSegmentIndex& Comb::getOutsideSegmentIndex()
+{
+    getBoundaryOutside();
+    return boundary_outside->getSegmentIndex();
 }
 
   
-Comb::Comb(SliceDataStorage& storage, int layer_nr, Polygons& comb_boundary_inside, int64_t comb_boundary_offset, bool travel_avoid_other_parts, int64_t travel_avoid_distance)
+Comb::Comb(SliceDataStorage& storage, int layer_nr, std::shared_ptr<CombBoundaryInside> comb_boundary_inside, int64_t comb_boundary_offset, bool travel_avoid_other_parts, int64_t travel_avoid_distance)
 : storage(storage)
 , layer_nr(layer_nr)
 , offset_from_outlines(comb_boundary_offset) // between second wall and infill / other walls
@@ -41,33 +43,92 @@ Comb::Comb(SliceDataStorage& storage, int layer_nr, Polygons& comb_boundary_insi
 , offset_from_inside_to_outside(offset_from_outlines + offset_from_outlines_outside)
 , max_crossing_dist2(offset_from_inside_to_outside * offset_from_inside_to_outside * 2) // so max_crossing_dist = offset_from_inside_to_outside * sqrt(2) =approx 1.5 to allow for slightly diagonal crossings and slightly inaccurate crossing computation
 , avoid_other_parts(travel_avoid_other_parts)
+, shortest_paths(storage.getSettingBoolean(SettingKey::travel_comb_shortest_paths))
 // , boundary_inside( boundary.offset(-offset_from_outlines) ) // TODO: make inside boundary configurable?
-, boundary_inside( comb_boundary_inside )
-, boundary_outside(nullptr)
-, outside_loc_to_line(nullptr)
-, partsView_inside( boundary_inside.splitIntoPartsView() ) // !! changes the order of boundary_inside !!
+, shared_boundary_inside(comb_boundary_inside)
+, boundary_inside(comb_boundary_inside->polygons)
+, partsView_inside(comb_boundary_inside->parts_view)
+, boundary_outside_used(false)
+, comb_paths_hit_count(0)
+, comb_paths_miss_count(0)
 {
 }
 
 Comb::~Comb()
 {
-    if (boundary_outside)
+    storage.comb_boundary_cache.addCombPathsStatistics(comb_paths_hit_count, comb_paths_miss_count);
+}
+
+bool Comb::calc(Point startPoint, Point endPoint, CombPaths& combPaths, bool startInside, bool endInside, int64_t max_comb_distance_ignored, bool via_outside_makes_combing_fail, bool fail_on_unavoidable_obstacles)
+{
+    if (shorterThen(endPoint - startPoint, max_comb_distance_ignored))
+    {
+        return true;
+    }
+    if (!combPaths.empty())
+    { // the cached paths can't be appended to other paths
+        return computeCombPaths(startPoint, endPoint, combPaths, startInside, endInside, max_comb_distance_ignored, via_outside_makes_combing_fail, fail_on_unavoidable_obstacles);
+    }
+
+    CombPathsCache::Key key;
+    key.start_point = startPoint;
+    key.end_point = endPoint;
+    key.max_comb_distance_ignored = max_comb_distance_ignored;
+    key.offset_from_outlines = offset_from_outlines;
+    key.offset_from_outlines_outside = offset_from_outlines_outside;
+    key.start_inside = startInside;
+    key.end_inside = endInside;
+    key.via_outside_makes_combing_fail = via_outside_makes_combing_fail;
+    key.fail_on_unavoidable_obstacles = fail_on_unavoidable_obstacles;
+    key.avoid_other_parts = avoid_other_parts;
+    key.shortest_paths = shortest_paths;
+
+    CombPathsCache& cache = shared_boundary_inside->comb_paths_cache;
+    const CombPathsCache::Entry* cached = cache.find(key);
+    if (cached)
     {
-        delete boundary_outside;
+        if (cached->boundary_outside)
+        { // the same travel gets to the outside boundary again, but another layer sharing the inside boundary can have other outlines
+            getBoundaryOutside();
+        }
+        if (cached->boundary_outside == nullptr || cached->boundary_outside == boundary_outside)
+        {
+            comb_paths_hit_count++;
+            combPaths = cached->comb_paths;
+            return cached->succeeded;
+        }
     }
-    if (outside_loc_to_line)
+    comb_paths_miss_count++;
+
+    boundary_outside_used = false;
+    const bool succeeded = computeCombPaths(startPoint, endPoint, combPaths, startInside, endInside, max_comb_distance_ignored, via_outside_makes_combing_fail, fail_on_unavoidable_obstacles);
+    CombPathsCache::Entry entry;
+    entry.key = key;
+    if (boundary_outside_used)
     {
-        delete outside_loc_to_line;
+        entry.boundary_outside = boundary_outside;
     }
+    entry.succeeded = succeeded;
+    entry.comb_paths = combPaths;
+    cache.add(std::move(entry));
+    return succeeded;
 }
 
-bool Comb::calc(Point startPoint, Point endPoint, CombPaths& combPaths, bool _startInside, bool _endInside, int64_t max_comb_distance_ignored, bool via_outside_makes_combing_fail, bool fail_on_unavoidable_obstacles)
+bool Comb::combWithinPart(CombBoundaryPart& part, Point from, Point to, CombPath& comb_path, int64_t max_comb_distance_ignored, bool fail_on_unavoidable_obstacles)
 {
-    if (shorterThen(endPoint - startPoint, max_comb_distance_ignored))
+    if (shortest_paths && !shorterThen(to - from, max_comb_distance_ignored))
     {
-        return true;
+        const CombVisibilityGraph* visibility_graph = part.getVisibilityGraph(offset_dist_to_get_from_on_the_polygon_to_outside);
+        if (visibility_graph && visibility_graph->findPath(from, to, comb_path))
+        {
+            return true;
+        }
     }
+    return LinePolygonsCrossings::comb(part.polygons, part.segment_index, from, to, comb_path, -offset_dist_to_get_from_on_the_polygon_to_outside, max_comb_distance_ignored, fail_on_unavoidable_obstacles);
+}
 
+bool Comb::computeCombPaths(Point startPoint, Point endPoint, CombPaths& combPaths, bool _startInside, bool _endInside, int64_t max_comb_distance_ignored, bool via_outside_makes_combing_fail, bool fail_on_unavoidable_obstacles)
+{
     //Move start and end point inside the comb boundary
     unsigned int start_inside_poly = NO_INDEX;
     const bool startInside = moveInside(_startInside, startPoint, start_inside_poly);
@@ -82,9 +143,9 @@ bool Comb::calc(Point startPoint, Point endPoint, CombPaths& combPaths, bool _st
     
     if (startInside && endInside && start_part_idx == end_part_idx)
     { // normal combing within part
-        PolygonsPart part = partsView_inside.assemblePart(start_part_idx);
+        CombBoundaryPart& part = shared_boundary_inside->getPart(start_part_idx);
         combPaths.emplace_back();
-        return LinePolygonsCrossings::comb(part, startPoint, endPoint, combPaths.back(), -offset_dist_to_get_from_on_the_polygon_to_outside, max_comb_distance_ignored, fail_on_unavoidable_obstacles);
+        return combWithinPart(part, startPoint, endPoint, combPaths.back(), max_comb_distance_ignored, fail_on_unavoidable_obstacles);
     }
     else 
     { // comb inside part to edge (if needed) >> move through air avoiding other parts >> comb inside end part upto the endpoint (if needed) 
@@ -103,8 +164,8 @@ bool Comb::calc(Point startPoint, Point endPoint, CombPaths& combPaths, bool _st
         Crossing end_crossing(endPoint, endInside, end_part_idx, end_part_boundary_poly_idx, boundary_inside);
 
         { // find crossing over the in-between area between inside and outside
-            start_crossing.findCrossingInOrMid(partsView_inside, endPoint);
-            end_crossing.findCrossingInOrMid(partsView_inside, start_crossing.in_or_mid);
+            start_crossing.findCrossingInOrMid(*shared_boundary_inside, endPoint);
+            end_crossing.findCrossingInOrMid(*shared_boundary_inside, start_crossing.in_or_mid);
         }
 
         bool avoid_other_parts_now = avoid_other_parts;
@@ -134,9 +195,9 @@ bool Comb::calc(Point startPoint, Point endPoint, CombPaths& combPaths, bool _st
         if (startInside)
         {
             // start to boundary
-            assert(start_crossing.dest_part.size() > 0 && "The part we start inside when combing should have been computed already!");
+            assert(start_crossing.dest_part != nullptr && start_crossing.dest_part->polygons.size() > 0 && "The part we start inside when combing should have been computed already!");
             combPaths.emplace_back();
-            bool combing_succeeded = LinePolygonsCrossings::comb(start_crossing.dest_part, startPoint, start_crossing.in_or_mid, combPaths.back(), -offset_dist_to_get_from_on_the_polygon_to_outside, max_comb_distance_ignored, fail_on_unavoidable_obstacles);
+            bool combing_succeeded = combWithinPart(*start_crossing.dest_part, startPoint, start_crossing.in_or_mid, combPaths.back(), max_comb_distance_ignored, fail_on_unavoidable_obstacles);
             if (!combing_succeeded)
             { // Couldn't comb between start point and computed crossing from the start part! Happens for very thin parts when the offset_to_get_off_boundary moves points to outside the polygon
                 return false;
@@ -155,7 +216,7 @@ bool Comb::calc(Point startPoint, Point endPoint, CombPaths& combPaths, bool _st
             }
             else
             {
-                bool combing_succeeded = LinePolygonsCrossings::comb(getBoundaryOutside(), start_crossing.out, end_crossing.out, combPaths.back(), offset_dist_to_get_from_on_the_polygon_to_outside, max_comb_distance_ignored, fail_on_unavoidable_obstacles);
+                bool combing_succeeded = LinePolygonsCrossings::comb(getBoundaryOutside(), getOutsideSegmentIndex(), start_crossing.out, end_crossing.out, combPaths.back(), offset_dist_to_get_from_on_the_polygon_to_outside, max_comb_distance_ignored, fail_on_unavoidable_obstacles);
                 if (!combing_succeeded)
                 {
                     return false;
@@ -174,10 +235,10 @@ bool Comb::calc(Point startPoint, Point endPoint, CombPaths& combPaths, bool _st
         if (endInside)
         {
             // boundary to end
-            assert(end_crossing.dest_part.size() > 0 && "The part we end up inside when combing should have been computed already!");
+            assert(end_crossing.dest_part != nullptr && end_crossing.dest_part->polygons.size() > 0 && "The part we end up inside when combing should have been computed already!");
             combPaths.emplace_back();
             
-            bool combing_succeeded = LinePolygonsCrossings::comb(end_crossing.dest_part, end_crossing.in_or_mid, endPoint, combPaths.back(), -offset_dist_to_get_from_on_the_polygon_to_outside, max_comb_distance_ignored, fail_on_unavoidable_obstacles);
+            bool combing_succeeded = combWithinPart(*end_crossing.dest_part, end_crossing.in_or_mid, endPoint, combPaths.back(), max_comb_distance_ignored, fail_on_unavoidable_obstacles);
             if (!combing_succeeded)
             { // Couldn't comb between end point and computed crossing to the end part! Happens for very thin parts when the offset_to_get_off_boundary moves points to outside the polygon
                 return false;
@@ -190,6 +251,7 @@ bool Comb::calc(Point startPoint, Point endPoint, CombPaths& combPaths, bool _st
 
 Comb::Crossing::Crossing(const Point& dest_point, const bool dest_is_inside, const unsigned int dest_part_idx, const unsigned int dest_part_boundary_crossing_poly_idx, const Polygons& boundary_inside)
 : dest_is_inside(dest_is_inside)
+, dest_part(nullptr)
 , dest_crossing_poly(boundary_inside[dest_part_boundary_crossing_poly_idx]) // initialize with most obvious poly, cause mostly a combing move will move outside the part, rather than inside a hole in the part
 , dest_point(dest_point)
 , dest_part_idx(dest_part_idx)
@@ -215,17 +277,17 @@ bool Comb::moveInside(bool is_inside, Point& dest_point, unsigned int& inside_po
     return false;
 }
 
-void Comb::Crossing::findCrossingInOrMid(const PartsView& partsView_inside, const Point close_to)
+void Comb::Crossing::findCrossingInOrMid(CombBoundaryInside& boundary_inside, const Point close_to)
 {
     if (dest_is_inside)
     { // in-case
         // find the point on the start inside-polygon closest to the endpoint, but also kind of close to the start point
         Point _dest_point(dest_point); // copy to local variable for lambda capture
         std::function<int(Point)> close_towards_start_penalty_function([_dest_point](Point candidate){ return vSize2((candidate - _dest_point) / 10); });
-        dest_part = partsView_inside.assemblePart(dest_part_idx);
+        dest_part = &boundary_inside.getPart(dest_part_idx);
         Point result(close_to);
         int64_t max_dist2 = std::numeric_limits<int64_t>::max();
-        ClosestPolygonPoint crossing_1_in_cp = PolygonUtils::ensureInsideOrOutside(dest_part, result, offset_dist_to_get_from_on_the_polygon_to_outside, max_dist2, close_towards_start_penalty_function);
+        ClosestPolygonPoint crossing_1_in_cp = PolygonUtils::ensureInsideOrOutside(dest_part->polygons, result, offset_dist_to_get_from_on_the_polygon_to_outside, max_dist2, close_towards_start_penalty_function);
         if (crossing_1_in_cp.point_idx != NO_INDEX)
         {
             dest_crossing_poly = crossing_1_in_cp.poly;
@@ -245,7 +307,7 @@ void Comb::Crossing::findCrossingInOrMid(const PartsView& partsView_inside, cons
 bool Comb::Crossing::findOutside(const Polygons& outside, const Point close_to, const bool fail_on_unavoidable_obstacles, Comb& comber)
 {
     out = in_or_mid;
-    if (dest_is_inside || outside.inside(in_or_mid, true)) // start in_between
+    if (dest_is_inside || comber.getOutsideSegmentIndex().inside(outside, in_or_mid, true)) // start in_between
     { // move outside
         Point preferred_crossing_1_out = in_or_mid + normal(close_to - in_or_mid, comber.offset_from_inside_to_outside);
         std::function<int(Point)> close_to_penalty_function([preferred_crossing_1_out](Point candidate){ return vSize2((candidate - preferred_crossing_1_out) / 2); });
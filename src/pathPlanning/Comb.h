@@ -6,6 +6,7 @@
 
 #include "../utils/polygon.h"
 #include "../utils/SparseGrid.h"
+#include "CombBoundaryCache.h"
 #include "../utils/polygonUtils.h"
 
 #include "LinePolygonsCrossings.h"
@@ -45,7 +46,7 @@ private:
         bool dest_is_inside; //!< Whether the startPoint or endPoint is inside the inside boundary
         Point in_or_mid; //!< The point on the inside boundary, or in between the inside and outside boundary if the start/end point isn't inside the inside boudary
         Point out; //!< The point on the outside boundary
-        PolygonsPart dest_part; //!< The assembled inside-boundary PolygonsPart in which the dest_point lies. (will only be initialized when Crossing::dest_is_inside holds)
+        CombBoundaryPart* dest_part; //!< The assembled inside-boundary part in which the dest_point lies. (will only be initialized when Crossing::dest_is_inside holds)
         PolygonRef dest_crossing_poly; //!< The polygon of the part in which dest_point lies, which will be crossed (often will be the outside polygon)
 
         /*!
@@ -62,10 +63,10 @@ private:
         /*!
          * Find the not-outside location (Combing::in_or_mid) of the crossing between to the outside boundary
          * 
-         * \param partsView_inside Structured indices onto Comb::boundary_inside which shows which polygons belong to which part. 
+         * \param boundary_inside The inside boundary, of which the part in which the dest_point lies is assembled
          * \param close_to[in] Try to get a crossing close to this point
          */
-        void findCrossingInOrMid(const PartsView& partsView_inside, const Point close_to);
+        void findCrossingInOrMid(CombBoundaryInside& boundary_inside, const Point close_to);
 
         /*!
          * Find the outside location (Combing::out)
@@ -110,11 +111,15 @@ private:
     static const int64_t offset_extra_start_end = 100; //!< Distance to move start point and end point toward eachother to extra avoid collision with the boundaries.
 
     const bool avoid_other_parts; //!< Whether to perform inverse combing a.k.a. avoid parts.
+    const bool shortest_paths; //!< Whether to comb within parts along the shortest path through their visibility graph instead of following the boundary where it's in the way
     
+    std::shared_ptr<CombBoundaryInside> shared_boundary_inside; //!< The inside boundary and its parts, possibly shared with the layer plans of other layers
     Polygons& boundary_inside; //!< The boundary within which to comb.
-    Polygons* boundary_outside; //!< The boundary outside of which to stay to avoid collision with other layer parts. This is a pointer cause we only compute it when we move outside the boundary (so not when there is only a single part in the layer)
-    SparseGrid<PolygonsPointIndex>* outside_loc_to_line; //!< The SparseGrid mapping locations to line segments of the outside boundary.
-    PartsView partsView_inside; //!< Structured indices onto boundary_inside which shows which polygons belong to which part. 
+    std::shared_ptr<CombBoundaryOutside> boundary_outside; //!< The boundary outside of which to stay to avoid collision with other layer parts, possibly shared with other layers. We only get it when we move outside the boundary (so not when there is only a single part in the layer)
+    PartsView& partsView_inside; //!< Structured indices onto boundary_inside which shows which polygons belong to which part. 
+    bool boundary_outside_used; //!< Whether getBoundaryOutside has been called since it was last reset, i.e. whether the travel being computed depends on the outside boundary
+    unsigned int comb_paths_hit_count; //!< The number of travels taken from the CombBoundaryInside::comb_paths_cache
+    unsigned int comb_paths_miss_count; //!< The number of travels which had to be computed
 
     /*!
      * Get the boundary_outside, which is an offset from the outlines of all meshes in the layer. Calculate it when it hasn't been calculated yet.
@@ -126,6 +131,11 @@ private:
      */
     SparseGrid<PolygonsPointIndex>& getOutsideLocToLine();
 
+    /*!
+     * Get the index of the segments of the outside boundary. Calculate it when it hasn't been calculated yet.
+     */
+    const PolygonsSegmentIndex& getOutsideSegmentIndex();
+
     /*!
      * Move the startPoint or endPoint inside when it should be inside
      * \param is_inside[in] Whether the \p dest_point should be inside
@@ -135,23 +145,49 @@ private:
      */
     bool moveInside(bool is_inside, Point& dest_point, unsigned int& start_inside_poly);
 
+    /*!
+     * Comb from one point to another within a single part of the inside boundary.
+     * 
+     * Uses the visibility graph of the part if Comb::shortest_paths is set and the part has one, and LinePolygonsCrossings::comb otherwise.
+     * 
+     * \param part The part within which to comb
+     * \param from Where to start
+     * \param to Where to end up
+     * \param comb_path Output parameter: The path from \p from to \p to
+     * \param max_comb_distance_ignored Travels shorter than this are made in a straight line
+     * \param fail_on_unavoidable_obstacles When moving over other parts is inavoidable, stop calculation early and return false.
+     * \return Whether combing has succeeded
+     */
+    bool combWithinPart(CombBoundaryPart& part, Point from, Point to, CombPath& comb_path, int64_t max_comb_distance_ignored, bool fail_on_unavoidable_obstacles);
+
+    /*!
+     * Compute the comb paths of a travel, see Comb::calc.
+     */
+    bool computeCombPaths(Point startPoint, Point endPoint, CombPaths& combPaths, bool startInside, bool endInside, int64_t max_comb_distance_ignored, bool via_outside_makes_combing_fail, bool fail_on_unavoidable_obstacles);
+
 public:
     /*!
      * Initializes the combing areas for every mesh in the layer (not support)
      * \param storage Where the layer polygon data is stored
      * \param layer_nr The number of the layer for which to generate the combing areas.
-     * \param comb_boundary_inside The comb boundary within which to comb within layer parts.
+     * \param comb_boundary_inside The comb boundary within which to comb within layer parts, split into parts.
      * \param offset_from_outlines The offset from the outline polygon, to create the combing boundary in case there is no second wall.
      * \param travel_avoid_other_parts Whether to avoid other layer parts when traveling through air.
      * \param travel_avoid_distance The distance by which to avoid other layer parts when traveling through air.
      */
-    Comb(SliceDataStorage& storage, int layer_nr, Polygons& comb_boundary_inside, int64_t offset_from_outlines, bool travel_avoid_other_parts, int64_t travel_avoid_distance);
-    
+    Comb(SliceDataStorage& storage, int layer_nr, std::shared_ptr<CombBoundaryInside> comb_boundary_inside, int64_t offset_from_outlines, bool travel_avoid_other_parts, int64_t travel_avoid_distance);
+
+    /*!
+     * Adds how often travels could be reused to the statistics of SliceDataStorage::comb_boundary_cache.
+     */
     ~Comb();
 
     /*!
      * Calculate the comb paths (if any) - one for each polygon combed alternated with travel paths
      * 
+     * Travels which have been computed before within the same inside boundary, on this layer or on another layer which shares it,
+     * are taken from CombBoundaryInside::comb_paths_cache.
+     * 
      * \param startPoint Where to start moving from
      * \param endPoint Where to move to
      * \param combPoints Output parameter: The points along the combing path, excluding the \p startPoint (?) and \p endPoint
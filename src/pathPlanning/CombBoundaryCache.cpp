@@ -0,0 +1,206 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "CombBoundaryCache.h"
+
+#include "../progress/ProfilingReport.h"
+#include "../utils/logoutput.h"
+
+namespace cura
+{
+
+bool CombPathsCache::Key::operator==(const Key& other) const
+{
+    return start_point == other.start_point
+        && end_point == other.end_point
+        && max_comb_distance_ignored == other.max_comb_distance_ignored
+        && offset_from_outlines == other.offset_from_outlines
+        && offset_from_outlines_outside == other.offset_from_outlines_outside
+        && start_inside == other.start_inside
+        && end_inside == other.end_inside
+        && via_outside_makes_combing_fail == other.via_outside_makes_combing_fail
+        && fail_on_unavoidable_obstacles == other.fail_on_unavoidable_obstacles
+        && avoid_other_parts == other.avoid_other_parts
+        && shortest_paths == other.shortest_paths;
+}
+
+size_t CombPathsCache::KeyHash::operator()(const Key& key) const
+{
+    // the parameters are mostly the same for all travels of a layer, so only the points are hashed
+    const std::hash<Point> point_hash;
+    return point_hash(key.start_point) * 31 + point_hash(key.end_point);
+}
+
+const CombPathsCache::Entry* CombPathsCache::find(const Key& key)
+{
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash>::iterator found = entry_per_key.find(key);
+    if (found == entry_per_key.end())
+    {
+        return nullptr;
+    }
+    entries.splice(entries.begin(), entries, found->second);
+    return &entries.front();
+}
+
+void CombPathsCache::add(Entry&& entry)
+{
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash>::iterator found = entry_per_key.find(entry.key);
+    if (found != entry_per_key.end())
+    { // computed before with another outside boundary
+        entries.erase(found->second);
+        entry_per_key.erase(found);
+    }
+    else if (entries.size() >= max_cached_count)
+    {
+        entry_per_key.erase(entries.back().key);
+        entries.pop_back();
+    }
+    entries.push_front(std::move(entry));
+    entry_per_key.emplace(entries.front().key, entries.begin());
+}
+
+CombBoundaryPart::CombBoundaryPart(const PartsView& parts_view, unsigned int part_idx)
+: polygons(parts_view.assemblePart(part_idx))
+, segment_index(polygons)
+, travel_count(0)
+{
+}
+
+const CombVisibilityGraph* CombBoundaryPart::getVisibilityGraph(int64_t offset_inside)
+{
+    if (!visibility_graph)
+    {
+        travel_count++;
+        if (travel_count < travel_count_for_visibility_graph)
+        {
+            return nullptr;
+        }
+        visibility_graph.reset(new CombVisibilityGraph(polygons, segment_index, offset_inside));
+    }
+    return visibility_graph->isValid() ? visibility_graph.get() : nullptr;
+}
+
+CombBoundaryInside::CombBoundaryInside(const Polygons& boundary, const std::vector<unsigned int>& part_starts)
+: polygons(boundary)
+, parts_view(part_starts.empty() ? polygons.splitIntoPartsView() : polygons.splitGroupsIntoPartsView(part_starts)) // !! changes the order of polygons !!
+, parts(parts_view.size() + 1) // the last one is the empty part returned for NO_INDEX
+{
+}
+
+CombBoundaryPart& CombBoundaryInside::getPart(unsigned int part_idx)
+{
+    const unsigned int slot_idx = (part_idx == NO_INDEX) ? parts_view.size() : part_idx;
+    if (!parts[slot_idx])
+    {
+        parts[slot_idx].reset(new CombBoundaryPart(parts_view, part_idx));
+    }
+    return *parts[slot_idx];
+}
+
+CombBoundaryOutside::CombBoundaryOutside(Polygons&& polygons, int grid_cell_size)
+: polygons(std::move(polygons))
+, grid_cell_size(grid_cell_size)
+{
+}
+
+SparseGrid<PolygonsPointIndex>& CombBoundaryOutside::getLocToLine()
+{
+    if (!loc_to_line)
+    {
+        loc_to_line.reset(PolygonUtils::createLocToLineGrid(polygons, grid_cell_size));
+        ProfilingReport::getInstance().recordGrid("comb_outside", *loc_to_line);
+    }
+    return *loc_to_line;
+}
+
+const PolygonsSegmentIndex& CombBoundaryOutside::getSegmentIndex()
+{
+    if (!segment_index)
+    {
+        segment_index.reset(new PolygonsSegmentIndex(polygons));
+    }
+    return *segment_index;
+}
+
+CombBoundaryCache::CombBoundaryCache()
+: inside_hit_count(0)
+, inside_miss_count(0)
+, outside_hit_count(0)
+, outside_miss_count(0)
+, comb_paths_hit_count(0)
+, comb_paths_miss_count(0)
+{
+}
+
+std::shared_ptr<CombBoundaryInside> CombBoundaryCache::getInside(const Polygons& boundary, const std::vector<unsigned int>& part_starts)
+{
+    const uint64_t boundary_hash = PolygonUtils::hashPoints(boundary);
+    std::unique_lock<std::mutex> lock(mutex);
+    for (std::list<InsideEntry>::iterator entry = inside_entries.begin(); entry != inside_entries.end(); ++entry)
+    {
+        if (entry->hash == boundary_hash && PolygonUtils::haveSamePoints(entry->boundary, boundary))
+        {
+            inside_entries.splice(inside_entries.begin(), inside_entries, entry);
+            inside_hit_count++;
+            return entry->result;
+        }
+    }
+    inside_miss_count++;
+    lock.unlock();
+    std::shared_ptr<CombBoundaryInside> result = std::make_shared<CombBoundaryInside>(boundary, part_starts);
+    lock.lock();
+    if (inside_entries.size() >= max_cached_count)
+    {
+        inside_entries.pop_back();
+    }
+    inside_entries.emplace_front();
+    InsideEntry& entry = inside_entries.front();
+    entry.hash = boundary_hash;
+    entry.boundary = boundary;
+    entry.result = result;
+    return result;
+}
+
+std::shared_ptr<CombBoundaryOutside> CombBoundaryCache::getOutside(const Polygons& layer_outlines, int64_t offset, int grid_cell_size)
+{
+    const uint64_t outlines_hash = PolygonUtils::hashPoints(layer_outlines);
+    std::lock_guard<std::mutex> lock(mutex);
+    for (std::list<OutsideEntry>::iterator entry = outside_entries.begin(); entry != outside_entries.end(); ++entry)
+    {
+        if (entry->hash == outlines_hash && entry->offset == offset && entry->grid_cell_size == grid_cell_size && PolygonUtils::haveSamePoints(entry->layer_outlines, layer_outlines))
+        {
+            outside_entries.splice(outside_entries.begin(), outside_entries, entry);
+            outside_hit_count++;
+            return entry->result;
+        }
+    }
+    outside_miss_count++;
+    if (outside_entries.size() >= max_cached_count)
+    {
+        outside_entries.pop_back();
+    }
+    outside_entries.emplace_front();
+    OutsideEntry& entry = outside_entries.front();
+    entry.hash = outlines_hash;
+    entry.layer_outlines = layer_outlines;
+    entry.offset = offset;
+    entry.grid_cell_size = grid_cell_size;
+    entry.result = std::make_shared<CombBoundaryOutside>(layer_outlines.offset(offset), grid_cell_size);
+    return entry.result;
+}
+
+void CombBoundaryCache::addCombPathsStatistics(unsigned int hit_count, unsigned int miss_count)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    comb_paths_hit_count += hit_count;
+    comb_paths_miss_count += miss_count;
+}
+
+void CombBoundaryCache::logStatistics() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    log("Comb boundaries reused: %u of %u inside boundaries, %u of %u outside boundaries.\n"
+        , inside_hit_count, inside_hit_count + inside_miss_count
+        , outside_hit_count, outside_hit_count + outside_miss_count);
+    log("Comb paths reused: %u of %u travels.\n", comb_paths_hit_count, comb_paths_hit_count + comb_paths_miss_count);
+}
+
+}//namespace cura
@@ -0,0 +1,269 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef PATH_PLANNING_COMB_BOUNDARY_CACHE_H
+#define PATH_PLANNING_COMB_BOUNDARY_CACHE_H
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#include "../utils/NoCopy.h"
+#include "../utils/polygon.h"
+#include "../utils/PolygonsSegmentIndex.h"
+#include "../utils/polygonUtils.h"
+#include "../utils/SparseGrid.h"
+#include "CombPaths.h"
+#include "CombVisibilityGraph.h"
+
+namespace cura
+{
+
+/*!
+ * A part of the inside boundary, assembled once for all combing moves within it.
+ */
+class CombBoundaryPart : NoCopy
+{
+public:
+    PolygonsPart polygons; //!< The outline of the part, followed by its holes
+    PolygonsSegmentIndex segment_index; //!< The segments of CombBoundaryPart::polygons
+
+    /*!
+     * \param parts_view The parts of the inside boundary
+     * \param part_idx The index of the part into \p parts_view, or NO_INDEX for an empty part
+     */
+    CombBoundaryPart(const PartsView& parts_view, unsigned int part_idx);
+
+    /*!
+     * Get the visibility graph of the part, once enough travels have asked for it that computing it pays off.
+     *
+     * \param offset_inside How far to move the corners of the part into it, see CombVisibilityGraph
+     * \return The graph, or nullptr while it isn't worth computing or when the part has too many concave corners
+     */
+    const CombVisibilityGraph* getVisibilityGraph(int64_t offset_inside);
+
+private:
+    static constexpr unsigned int travel_count_for_visibility_graph = 8; //!< The number of travels within the part after which its visibility graph is computed
+
+    unsigned int travel_count; //!< The number of travels which have asked for the visibility graph
+    std::unique_ptr<CombVisibilityGraph> visibility_graph; //!< The graph, or nullptr if it hasn't been computed yet
+};
+
+class CombBoundaryOutside;
+
+/*!
+ * The results of Comb::calc for travels within the same inside boundary.
+ *
+ * Prints with copies of the same part or with repeating layers ask for exactly the same travels again and again:
+ * between the same seams, and between the ends of infill lines at the same positions.
+ * The travels are identified by their exact start and end points and the parameters of Comb and Comb::calc,
+ * so a reused result is the same as the one computed again.
+ */
+class CombPathsCache : NoCopy
+{
+public:
+    /*!
+     * Everything except for the boundaries which the result of Comb::calc depends on.
+     */
+    struct Key
+    {
+        Point start_point;
+        Point end_point;
+        int64_t max_comb_distance_ignored;
+        int64_t offset_from_outlines; //!< See Comb::offset_from_outlines
+        int64_t offset_from_outlines_outside; //!< See Comb::offset_from_outlines_outside
+        bool start_inside;
+        bool end_inside;
+        bool via_outside_makes_combing_fail;
+        bool fail_on_unavoidable_obstacles;
+        bool avoid_other_parts; //!< See Comb::avoid_other_parts
+        bool shortest_paths; //!< See Comb::shortest_paths
+
+        bool operator==(const Key& other) const;
+    };
+
+    /*!
+     * A travel computed by Comb::calc.
+     */
+    struct Entry
+    {
+        Key key;
+        std::shared_ptr<CombBoundaryOutside> boundary_outside; //!< The outside boundary the travel was computed with, or nullptr if it didn't need one. Kept alive so that it can be compared by address.
+        bool succeeded; //!< What Comb::calc returned
+        CombPaths comb_paths;
+    };
+
+    /*!
+     * Find the result of a travel and mark it as the most recently used one.
+     *
+     * 
+eturn The travel, or nullptr if it isn't in the cache
+     */
+    const Entry* find(const Key& key);
+
+    /*!
+     * Store the result of a travel, forgetting the least recently used one if the cache is full.
+     */
+    void add(Entry&& entry);
+
+private:
+    static constexpr unsigned int max_cached_count = 4096; //!< Enough for all travels of a couple of layers
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const;
+    };
+
+    std::list<Entry> entries; //!< Most recently used first
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> entry_per_key;
+};
+
+/*!
+ * The boundary within which Comb combs, together with the parts in which it is split.
+ *
+ * Shared between the layer plans which have the same boundary, so it mustn't be changed.
+ */
+class CombBoundaryInside : NoCopy
+{
+public:
+    Polygons polygons; //!< The boundary, in the order given by Polygons::splitIntoPartsView
+    PartsView parts_view; //!< Structured indices onto CombBoundaryInside::polygons which show which polygons belong to which part
+    CombPathsCache comb_paths_cache; //!< The travels combed within this boundary, on any of the layers which share it
+
+    /*!
+     * \param boundary The boundary, before it's split into parts
+     * \param part_starts The index of the first polygon of \p boundary coming from each layer part, see Polygons::splitGroupsIntoPartsView; empty if the polygons aren't grouped per layer part
+     */
+    CombBoundaryInside(const Polygons& boundary, const std::vector<unsigned int>& part_starts);
+
+    /*!
+     * Get a part of the boundary. Assemble it when it hasn't been assembled yet.
+     *
+     * \param part_idx The index of the part into CombBoundaryInside::parts_view, or NO_INDEX to get an empty part
+     */
+    CombBoundaryPart& getPart(unsigned int part_idx);
+
+private:
+    std::vector<std::unique_ptr<CombBoundaryPart>> parts; //!< The assembled parts, or nullptr for the parts which haven't been assembled yet, followed by the empty part
+};
+
+/*!
+ * The boundary outside of which Comb stays to avoid other layer parts, together with a grid to look up its line segments.
+ *
+ * Shared between the layer plans which have the same outlines, so it mustn't be changed.
+ */
+class CombBoundaryOutside : NoCopy
+{
+public:
+    Polygons polygons; //!< The boundary
+
+    /*!
+     * \param polygons The boundary
+     * \param grid_cell_size The cell size of the grid returned by CombBoundaryOutside::getLocToLine
+     */
+    CombBoundaryOutside(Polygons&& polygons, int grid_cell_size);
+
+    /*!
+     * Get the SparseGrid mapping locations to line segments of the boundary. Calculate it when it hasn't been calculated yet.
+     */
+    SparseGrid<PolygonsPointIndex>& getLocToLine();
+
+    /*!
+     * Get the index of the segments of the boundary used to comb through air. Calculate it when it hasn't been calculated yet.
+     */
+    const PolygonsSegmentIndex& getSegmentIndex();
+
+private:
+    int grid_cell_size; //!< The cell size of CombBoundaryOutside::loc_to_line
+    std::unique_ptr<SparseGrid<PolygonsPointIndex>> loc_to_line; //!< The grid, or nullptr if it hasn't been calculated yet
+    std::unique_ptr<PolygonsSegmentIndex> segment_index; //!< The segment index, or nullptr if it hasn't been calculated yet
+};
+
+/*!
+ * The comb boundaries of the most recently planned layers.
+ *
+ * Consecutive layers often have exactly the same outlines, for example in the prismatic parts of a model or in the raft,
+ * in which case they can use the same boundaries instead of splitting the inside boundary into parts
+ * and offsetting the outlines for the outside boundary again.
+ *
+ * The boundaries are identified by the polygons they're computed from, so layers only share boundaries
+ * when the polygons are exactly the same; the result of combing is the same as without the cache.
+ * The inside boundaries of upcoming layers are obtained in parallel, so the boundaries are computed outside of the lock.
+ */
+class CombBoundaryCache : NoCopy
+{
+public:
+    CombBoundaryCache();
+
+    /*!
+     * Get the inside boundary computed from \p boundary.
+     *
+     * \param boundary The boundary within which to comb
+     * \param part_starts The index of the first polygon of \p boundary coming from each layer part, or empty if the polygons aren't grouped per layer part
+     * \return The boundary split into parts
+     */
+    std::shared_ptr<CombBoundaryInside> getInside(const Polygons& boundary, const std::vector<unsigned int>& part_starts);
+
+    /*!
+     * Get the outside boundary computed from the outlines of a layer.
+     *
+     * \param layer_outlines The outlines of all parts in the layer
+     * \param offset The distance by which to stay away from the outlines
+     * \param grid_cell_size The cell size of the grid of the boundary
+     * \return The outlines offset by \p offset
+     */
+    std::shared_ptr<CombBoundaryOutside> getOutside(const Polygons& layer_outlines, int64_t offset, int grid_cell_size);
+
+    /*!
+     * Count how often Comb could reuse the result of a travel from CombBoundaryInside::comb_paths_cache.
+     *
+     * \param hit_count The number of travels which could be reused
+     * \param miss_count The number of travels which had to be computed
+     */
+    void addCombPathsStatistics(unsigned int hit_count, unsigned int miss_count);
+
+    /*!
+     * Log how often boundaries and travels could be reused.
+     */
+    void logStatistics() const;
+
+private:
+    static constexpr unsigned int max_cached_count = 4; //!< The number of boundaries of each type which are kept; only boundaries of nearby layers are likely to be reused
+
+    /*!
+     * An inside boundary with the polygons it's computed from.
+     */
+    struct InsideEntry
+    {
+        uint64_t hash; //!< The hash of \ref InsideEntry::boundary
+        Polygons boundary;
+        std::shared_ptr<CombBoundaryInside> result;
+    };
+
+    /*!
+     * An outside boundary with the polygons and parameters it's computed from.
+     */
+    struct OutsideEntry
+    {
+        uint64_t hash; //!< The hash of \ref OutsideEntry::layer_outlines
+        Polygons layer_outlines;
+        int64_t offset;
+        int grid_cell_size;
+        std::shared_ptr<CombBoundaryOutside> result;
+    };
+
+    std::list<InsideEntry> inside_entries; //!< Most recently used first
+    std::list<OutsideEntry> outside_entries; //!< Most recently used first
+    unsigned int inside_hit_count; //!< The number of inside boundaries which could be reused
+    unsigned int inside_miss_count; //!< The number of inside boundaries which had to be computed
+    unsigned int outside_hit_count; //!< The number of outside boundaries which could be reused
+    unsigned int outside_miss_count; //!< The number of outside boundaries which had to be computed
+    unsigned int comb_paths_hit_count; //!< The number of travels which could be reused
+    unsigned int comb_paths_miss_count; //!< The number of travels which had to be computed
+    mutable std::mutex mutex; //!< Guards the entries and the statistics
+};
+
+}//namespace cura
+
+#endif//PATH_PLANNING_COMB_BOUNDARY_CACHE_H
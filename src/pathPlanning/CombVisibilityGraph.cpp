@@ -0,0 +1,162 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "CombVisibilityGraph.h"
+
+#include <algorithm> // reverse
+#include <functional> // greater
+#include <queue>
+
+#include "../utils/polygonUtils.h"
+#include "LinePolygonsCrossings.h"
+
+namespace cura
+{
+
+CombVisibilityGraph::CombVisibilityGraph(Polygons& boundary, const PolygonsSegmentIndex& segment_index, int64_t offset_inside)
+: boundary(boundary)
+, segment_index(segment_index)
+, valid(false)
+{
+    for (unsigned int poly_idx = 0; poly_idx < boundary.size(); poly_idx++)
+    {
+        PolygonRef poly = boundary[poly_idx];
+        for (unsigned int point_idx = 0; point_idx < poly.size(); point_idx++)
+        {
+            const Point& prev = poly[(point_idx == 0) ? poly.size() - 1 : point_idx - 1];
+            const Point& here = poly[point_idx];
+            const Point& next = poly[(point_idx + 1 == poly.size()) ? 0 : point_idx + 1];
+            const Point in = here - prev;
+            const Point out = next - here;
+            if (in.X * out.Y - in.Y * out.X >= 0)
+            { // turning left or going straight, so the inside of the part is on the outside of the corner, which the shortest path never goes around
+                continue;
+            }
+            if (nodes.size() == max_node_count)
+            {
+                nodes.clear();
+                return;
+            }
+            nodes.push_back(PolygonUtils::getBoundaryPointWithOffset(poly, point_idx, -offset_inside));
+        }
+    }
+
+    edges_per_node.resize(nodes.size());
+    for (unsigned int node_idx = 0; node_idx < nodes.size(); node_idx++)
+    {
+        for (unsigned int other_idx = node_idx + 1; other_idx < nodes.size(); other_idx++)
+        {
+            if (isVisible(nodes[node_idx], nodes[other_idx]))
+            {
+                const int64_t length = vSize(nodes[other_idx] - nodes[node_idx]);
+                edges_per_node[node_idx].push_back(Edge{other_idx, length});
+                edges_per_node[other_idx].push_back(Edge{node_idx, length});
+            }
+        }
+    }
+    valid = true;
+}
+
+bool CombVisibilityGraph::isVisible(Point a, Point b) const
+{
+    if (a == b)
+    {
+        return true;
+    }
+    return !LinePolygonsCrossings::segmentTouchesBoundary(boundary, segment_index, a, b);
+}
+
+std::vector<CombVisibilityGraph::Edge> CombVisibilityGraph::getVisibleNodes(Point point) const
+{
+    std::vector<Edge> result;
+    for (unsigned int node_idx = 0; node_idx < nodes.size(); node_idx++)
+    {
+        if (isVisible(point, nodes[node_idx]))
+        {
+            result.push_back(Edge{node_idx, vSize(nodes[node_idx] - point)});
+        }
+    }
+    return result;
+}
+
+bool CombVisibilityGraph::findPath(Point from, Point to, CombPath& comb_path) const
+{
+    if (isVisible(from, to))
+    {
+        comb_path.push_back(from);
+        comb_path.push_back(to);
+        return true;
+    }
+    const std::vector<Edge> start_edges = getVisibleNodes(from);
+    const std::vector<Edge> end_edges = getVisibleNodes(to);
+    if (start_edges.empty() || end_edges.empty())
+    {
+        return false;
+    }
+    std::vector<int64_t> dist_to_end(nodes.size(), -1);
+    for (const Edge& edge : end_edges)
+    {
+        dist_to_end[edge.node_idx] = edge.length;
+    }
+
+    // A* search from the corners visible from the start, with the straight distance to the end as estimate
+    const unsigned int from_start = nodes.size(); // marks the corners reached directly from the start
+    std::vector<int64_t> dist_from_start(nodes.size(), INT64_MAX);
+    std::vector<unsigned int> previous(nodes.size(), from_start);
+    typedef std::pair<int64_t, unsigned int> QueueItem; // estimated total length and the corner
+    std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>> queue;
+    auto estimate = [&](unsigned int node_idx)
+    {
+        return dist_from_start[node_idx] + vSize(to - nodes[node_idx]);
+    };
+    for (const Edge& edge : start_edges)
+    {
+        dist_from_start[edge.node_idx] = edge.length;
+        queue.emplace(estimate(edge.node_idx), edge.node_idx);
+    }
+    int64_t best_length = INT64_MAX;
+    unsigned int last_node_idx = from_start;
+    while (!queue.empty())
+    {
+        const QueueItem item = queue.top();
+        queue.pop();
+        if (item.first >= best_length)
+        { // no other path can be shorter
+            break;
+        }
+        const unsigned int node_idx = item.second;
+        if (item.first != estimate(node_idx))
+        { // the corner has been reached by a shorter path since this item was queued
+            continue;
+        }
+        if (dist_to_end[node_idx] >= 0 && dist_from_start[node_idx] + dist_to_end[node_idx] < best_length)
+        {
+            best_length = dist_from_start[node_idx] + dist_to_end[node_idx];
+            last_node_idx = node_idx;
+        }
+        for (const Edge& edge : edges_per_node[node_idx])
+        {
+            const int64_t dist = dist_from_start[node_idx] + edge.length;
+            if (dist < dist_from_start[edge.node_idx])
+            {
+                dist_from_start[edge.node_idx] = dist;
+                previous[edge.node_idx] = node_idx;
+                queue.emplace(estimate(edge.node_idx), edge.node_idx);
+            }
+        }
+    }
+    if (last_node_idx == from_start)
+    {
+        return false;
+    }
+
+    const unsigned int path_start_idx = comb_path.size();
+    comb_path.push_back(to);
+    for (unsigned int node_idx = last_node_idx; node_idx != from_start; node_idx = previous[node_idx])
+    {
+        comb_path.push_back(nodes[node_idx]);
+    }
+    comb_path.push_back(from);
+    std::reverse(comb_path.begin() + path_start_idx, comb_path.end());
+    return true;
+}
+
+}//namespace cura
@@ -0,0 +1,86 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef PATH_PLANNING_COMB_VISIBILITY_GRAPH_H
+#define PATH_PLANNING_COMB_VISIBILITY_GRAPH_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "../utils/NoCopy.h"
+#include "../utils/polygon.h"
+#include "../utils/PolygonsSegmentIndex.h"
+#include "CombPath.h"
+
+namespace cura
+{
+
+/*!
+ * The corners of a part of the comb boundary between which the nozzle can move in a straight line, for finding the shortest path through the part.
+ *
+ * LinePolygonsCrossings::comb follows the boundary wherever the straight line to the end point crosses it,
+ * which in very concave parts, such as lattices with many holes, gives long detours around the obstacles.
+ * The shortest path within a polygon only turns at its concave corners, so these are the nodes of the graph,
+ * moved slightly into the part so that the path doesn't touch the boundary.
+ * The graph only depends on the part, so it is computed once for all travels within it.
+ */
+class CombVisibilityGraph : NoCopy
+{
+public:
+    static constexpr unsigned int max_node_count = 200; //!< Above this number of concave corners the graph would take longer to compute than it saves
+
+    /*!
+     * Compute the graph, unless the part has too many concave corners.
+     *
+     * \param boundary The outline of the part with its holes, in the orientation given by Clipper: the inside of the part is to the left of each segment
+     * \param segment_index The segments of \p boundary
+     * \param offset_inside How far to move the corners into the part
+     */
+    CombVisibilityGraph(Polygons& boundary, const PolygonsSegmentIndex& segment_index, int64_t offset_inside);
+
+    /*!
+     * Whether the graph could be computed, i.e. whether the part doesn't have too many concave corners.
+     */
+    bool isValid() const
+    {
+        return valid;
+    }
+
+    /*!
+     * Find the shortest path from one point in the part to another.
+     *
+     * \param from The start of the travel, inside the part
+     * \param to The end of the travel, inside the part
+     * \param comb_path Output parameter: The path from \p from to \p to
+     * \return Whether a path has been found; it isn't when \p from or \p to lies on the boundary or can't see any of the corners
+     */
+    bool findPath(Point from, Point to, CombPath& comb_path) const;
+
+private:
+    /*!
+     * A straight move from a corner to another corner.
+     */
+    struct Edge
+    {
+        unsigned int node_idx; //!< The corner the move goes to
+        int64_t length; //!< The length of the move
+    };
+
+    Polygons& boundary; //!< The outline of the part with its holes
+    const PolygonsSegmentIndex& segment_index; //!< The segments of CombVisibilityGraph::boundary
+    bool valid; //!< Whether the graph has been computed
+    std::vector<Point> nodes; //!< The concave corners of the part, moved into the part
+    std::vector<std::vector<Edge>> edges_per_node; //!< The corners visible from each corner
+
+    /*!
+     * Whether the line segment from \p a to \p b stays inside the part without touching the boundary.
+     */
+    bool isVisible(Point a, Point b) const;
+
+    /*!
+     * Get the straight moves from \p point to the corners visible from it.
+     */
+    std::vector<Edge> getVisibleNodes(Point point) const;
+};
+
+}//namespace cura
+
+#endif//PATH_PLANNING_COMB_VISIBILITY_GRAPH_H
@@ -10,27 +10,49 @@
 namespace cura {
 
 
+constexpr int LinePolygonsCrossings::crossing_rounding_margin;
+
+namespace
+{
+
+thread_local std::vector<unsigned int> near_poly_indices; // the polygons of the boundary near the line segment being checked, reused by the next check on this thread
+
+}//namespace
+
+AABB LinePolygonsCrossings::getLineSegmentBox(Point a, Point b)
+{
+    AABB box;
+    box.include(a);
+    box.include(b);
+    box.expand(crossing_rounding_margin);
+    return box;
+}
+
 bool LinePolygonsCrossings::calcScanlineCrossings(bool fail_on_unavoidable_obstacles)
 {
     
     min_crossing_idx = NO_INDEX;
     max_crossing_idx = NO_INDEX;
 
-    for(unsigned int poly_idx = 0; poly_idx < boundary.size(); poly_idx++)
+    segment_index.findPolygonsNear(scanline_box, near_poly_indices);
+    for (unsigned int poly_idx : near_poly_indices)
     {
         PolyCrossings minMax(poly_idx); 
         PolygonRef poly = boundary[poly_idx];
-        Point p0 = transformation_matrix.apply(poly[poly.size() - 1]);
-        for(unsigned int point_idx = 0; point_idx < poly.size(); point_idx++)
+        segment_index.processSegmentsNear(poly_idx, scanline_box, [this, &minMax, &poly](unsigned int point_idx)
         {
-            Point p1 = transformation_matrix.apply(poly[point_idx]);
+            const Point& untransformed_p0 = poly[(point_idx == 0) ? poly.size() - 1 : point_idx - 1];
+            const Point& untransformed_p1 = poly[point_idx];
+            Point p0(0, transformation_matrix.applyY(untransformed_p0));
+            Point p1(0, transformation_matrix.applyY(untransformed_p1));
             if ((p0.Y >= transformed_startPoint.Y && p1.Y <= transformed_startPoint.Y) || (p1.Y >= transformed_startPoint.Y && p0.Y <= transformed_startPoint.Y))
             { // if line segment crosses the line through the transformed start and end point (aka scanline)
                 if (p1.Y == p0.Y) //Line segment is parallel with the scanline. That means that both endpoints lie on the scanline, so they will have intersected with the adjacent line.
                 {
-                    p0 = p1;
-                    continue;
+                    return true;
                 }
+                p0.X = transformation_matrix.applyX(untransformed_p0);
+                p1.X = transformation_matrix.applyX(untransformed_p1);
                 int64_t x = p0.X + (p1.X - p0.X) * (transformed_startPoint.Y - p0.Y) / (p1.Y - p0.Y); // intersection point between line segment and the scanline
                 
                 if (x >= transformed_startPoint.X && x <= transformed_endPoint.X)
@@ -53,8 +75,8 @@ bool LinePolygonsCrossings::calcScanlineCrossings(bool fail_on_unavoidable_obsta
                     }
                 }
             }
-            p0 = p1;
-        }
+            return true;
+        });
 
         if (fail_on_unavoidable_obstacles && minMax.n_crossings % 2 == 1)
         { // if start area and end area are not the same
@@ -78,21 +100,79 @@ bool LinePolygonsCrossings::lineSegmentCollidesWithBoundary()
     transformation_matrix = PointMatrix(diff);
     transformed_startPoint = transformation_matrix.apply(startPoint);
     transformed_endPoint = transformation_matrix.apply(endPoint);
+    scanline_box = getLineSegmentBox(startPoint, endPoint);
 
-    for(PolygonRef poly : boundary)
+    segment_index.findPolygonsNear(scanline_box, near_poly_indices);
+    for (unsigned int poly_idx : near_poly_indices)
     {
-        Point p0 = transformation_matrix.apply(poly.back());
-        for(Point p1_ : poly)
+        PolygonRef poly = boundary[poly_idx];
+        const bool collides = !segment_index.processSegmentsNear(poly_idx, scanline_box, [this, &poly](unsigned int point_idx)
         {
-            Point p1 = transformation_matrix.apply(p1_);
+            const Point& untransformed_p0 = poly[(point_idx == 0) ? poly.size() - 1 : point_idx - 1];
+            const Point& untransformed_p1 = poly[point_idx];
+            Point p0(0, transformation_matrix.applyY(untransformed_p0));
+            Point p1(0, transformation_matrix.applyY(untransformed_p1));
             if ((p0.Y > transformed_startPoint.Y && p1.Y < transformed_startPoint.Y) || (p1.Y > transformed_startPoint.Y && p0.Y < transformed_startPoint.Y))
             {
+                p0.X = transformation_matrix.applyX(untransformed_p0);
+                p1.X = transformation_matrix.applyX(untransformed_p1);
                 int64_t x = p0.X + (p1.X - p0.X) * (transformed_startPoint.Y - p0.Y) / (p1.Y - p0.Y);
                 
                 if (x > transformed_startPoint.X && x < transformed_endPoint.X)
-                    return true;
+                    return false;
             }
-            p0 = p1;
+            return true;
+        });
+        if (collides)
+        {
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+bool LinePolygonsCrossings::lineSegmentTouchesBoundary(Point from, Point to)
+{
+    Point diff = to - from;
+
+    PointMatrix matrix = PointMatrix(diff);
+    Point transformed_from = matrix.apply(from);
+    Point transformed_to = matrix.apply(to);
+    AABB box = getLineSegmentBox(from, to);
+
+    segment_index.findPolygonsNear(box, near_poly_indices);
+    for (unsigned int poly_idx : near_poly_indices)
+    {
+        PolygonRef poly = boundary[poly_idx];
+        const bool collides = !segment_index.processSegmentsNear(poly_idx, box, [&](unsigned int point_idx)
+        {
+            const Point& untransformed_p0 = poly[(point_idx == 0) ? poly.size() - 1 : point_idx - 1];
+            const Point& untransformed_p1 = poly[point_idx];
+            Point p0(0, matrix.applyY(untransformed_p0));
+            Point p1(0, matrix.applyY(untransformed_p1));
+            if ((p0.Y >= transformed_from.Y && p1.Y <= transformed_from.Y) || (p1.Y >= transformed_from.Y && p0.Y <= transformed_from.Y))
+            {
+                p0.X = matrix.applyX(untransformed_p0);
+                p1.X = matrix.applyX(untransformed_p1);
+                int64_t x;
+                if(p1.Y == p0.Y)
+                {
+                    x = p0.X;
+                }
+                else
+                {
+                    x = p0.X + (p1.X - p0.X) * (transformed_from.Y - p0.Y) / (p1.Y - p0.Y);
+                }
+                
+                if (x >= transformed_from.X && x <= transformed_to.X)
+                    return false;
+            }
+            return true;
+        });
+        if (collides)
+        {
+            return true;
         }
     }
     
@@ -187,9 +267,9 @@ bool LinePolygonsCrossings::optimizePath(CombPath& comb_path, CombPath& optimize
             continue;
         }
         Point& current_point = optimized_comb_path.back();
-        if (PolygonUtils::polygonCollidesWithlineSegment(boundary, current_point, comb_path[point_idx]))
+        if (lineSegmentTouchesBoundary(current_point, comb_path[point_idx]))
         {
-            if (PolygonUtils::polygonCollidesWithlineSegment(boundary, current_point, comb_path[point_idx - 1]))
+            if (lineSegmentTouchesBoundary(current_point, comb_path[point_idx - 1]))
             {
                 comb_path.cross_boundary = true;
             }
@@ -202,7 +282,7 @@ bool LinePolygonsCrossings::optimizePath(CombPath& comb_path, CombPath& optimize
             // TODO: add the below extra optimization? (+/- 7% extra computation time, +/- 2% faster print for Dual_extrusion_support_generation.stl)
             while (optimized_comb_path.size() > 1)
             {
-                if (PolygonUtils::polygonCollidesWithlineSegment(boundary, optimized_comb_path[optimized_comb_path.size() - 2], comb_path[point_idx]))
+                if (lineSegmentTouchesBoundary(optimized_comb_path[optimized_comb_path.size() - 2], comb_path[point_idx]))
                 {
                     break;
                 }
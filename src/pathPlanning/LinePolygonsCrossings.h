@@ -2,7 +2,9 @@
 #ifndef PATH_PLANNING_LINE_POLYGONS_CROSSINGS_H
 #define PATH_PLANNING_LINE_POLYGONS_CROSSINGS_H
 
+#include "../utils/AABB.h"
 #include "../utils/polygon.h"
+#include "../utils/PolygonsSegmentIndex.h"
 
 #include "CombPath.h"
 
@@ -21,6 +23,9 @@ namespace cura
  * The path is offsetted from the polygons, so that it doesn't intersect with them.
  * 
  * Next the basic path is optimized by taking shortcuts where possible. Only shortcuts which skip a single point are considered, in order to reduce computational complexity.
+ * 
+ * Only the line segments of the boundary which are near a line are transformed and checked for crossings with it;
+ * the others are skipped using a PolygonsSegmentIndex of the boundary.
  */
 class LinePolygonsCrossings
 {
@@ -80,6 +85,7 @@ private:
     unsigned int max_crossing_idx; //!< The index into LinePolygonsCrossings::crossings to the crossing with the maximal PolyCrossings::max crossing of all PolyCrossings's.
     
     Polygons& boundary; //!< The boundary not to cross during combing.
+    const PolygonsSegmentIndex& segment_index; //!< The segments of LinePolygonsCrossings::boundary
     Point startPoint; //!< The start point of the scanline.
     Point endPoint; //!< The end point of the scanline.
     
@@ -88,6 +94,19 @@ private:
     PointMatrix transformation_matrix; //!< The transformation which rotates everything such that the scanline is aligned with the x-axis.
     Point transformed_startPoint; //!< The LinePolygonsCrossings::startPoint as transformed by Comb::transformation_matrix such that it has (roughly) the same Y as transformed_endPoint
     Point transformed_endPoint; //!< The LinePolygonsCrossings::endPoint as transformed by Comb::transformation_matrix such that it has (roughly) the same Y as transformed_startPoint
+    AABB scanline_box; //!< The area around the line segment from LinePolygonsCrossings::startPoint to LinePolygonsCrossings::endPoint in which boundary segments may cross it
+
+    /*!
+     * The distance by which the bounding box of a line segment is expanded to find the boundary segments which may cross it.
+     * 
+     * Points are rounded to whole microns when they are transformed, so a crossing found in transformed space may lie slightly outside of the bounding box of the line segment.
+     */
+    static constexpr int crossing_rounding_margin = 10;
+
+    /*!
+     * Get the area around a line segment in which boundary segments may cross it.
+     */
+    static AABB getLineSegmentBox(Point a, Point b);
 
     
     /*!
@@ -155,33 +174,60 @@ private:
      * \return Whether it turns out that the basic comb path already crossed a boundary
      */
     bool optimizePath(CombPath& comb_path, CombPath& optimized_comb_path);
+
+    /*!
+     * Check whether a line segment collides with the boundary, the same way as PolygonUtils::polygonCollidesWithlineSegment,
+     * but only checking the boundary segments near the line segment.
+     * 
+     * \param startPoint The start of the line segment
+     * \param endPoint The end of the line segment
+     * 
+eturn Whether the line segment touches or crosses the boundary
+     */
+    bool lineSegmentTouchesBoundary(Point startPoint, Point endPoint);
     
     /*!
      * Create a LinePolygonsCrossings with minimal initialization.
      * \param boundary The boundary which not to cross during combing
+     * \param segment_index The segments of \p boundary
      * \param start the starting point
      * \param end the end point
      * \param dist_to_move_boundary_point_outside Distance used to move a point from a boundary so that it doesn't intersect with it anymore. (Precision issue)
      */
-    LinePolygonsCrossings(Polygons& boundary, Point& start, Point& end, int64_t dist_to_move_boundary_point_outside)
-    : boundary(boundary), startPoint(start), endPoint(end), dist_to_move_boundary_point_outside(dist_to_move_boundary_point_outside)
+    LinePolygonsCrossings(Polygons& boundary, const PolygonsSegmentIndex& segment_index, Point& start, Point& end, int64_t dist_to_move_boundary_point_outside)
+    : boundary(boundary), segment_index(segment_index), startPoint(start), endPoint(end), dist_to_move_boundary_point_outside(dist_to_move_boundary_point_outside)
     {
     }
     
 public: 
     
+    /*!
+     * Check whether a line segment touches or crosses the boundary, using only the boundary segments near it.
+     * \param boundary The boundary not to cross
+     * \param segment_index The segments of \p boundary
+     * \param from The start of the line segment
+     * \param to The end of the line segment, which should differ from \p from
+     * \return Whether the line segment touches or crosses the boundary
+     */
+    static bool segmentTouchesBoundary(Polygons& boundary, const PolygonsSegmentIndex& segment_index, Point from, Point to)
+    {
+        LinePolygonsCrossings linePolygonsCrossings(boundary, segment_index, from, to, 0);
+        return linePolygonsCrossings.lineSegmentTouchesBoundary(from, to);
+    }
+
     /*!
      * The main function of this class: calculate one combing path within the boundary.
      * \param boundary The polygons to follow when calculating the basic combing path
+     * \param segment_index The segments of \p boundary, which can be reused for all combing moves within the same boundary
      * \param startPoint From where to start the combing move.
      * \param endPoint Where to end the combing move.
      * \param combPath Output parameter: the combing path generated.
      * \param fail_on_unavoidable_obstacles When moving over other parts is inavoidable, stop calculation early and return false.
      * \return Whether combing succeeded, i.e. we didn't cross any gaps/other parts
      */
-    static bool comb(Polygons& boundary, Point startPoint, Point endPoint, CombPath& combPath, int64_t dist_to_move_boundary_point_outside, int64_t max_comb_distance_ignored, bool fail_on_unavoidable_obstacles)
+    static bool comb(Polygons& boundary, const PolygonsSegmentIndex& segment_index, Point startPoint, Point endPoint, CombPath& combPath, int64_t dist_to_move_boundary_point_outside, int64_t max_comb_distance_ignored, bool fail_on_unavoidable_obstacles)
     {
-        LinePolygonsCrossings linePolygonsCrossings(boundary, startPoint, endPoint, dist_to_move_boundary_point_outside);
+        LinePolygonsCrossings linePolygonsCrossings(boundary, segment_index, startPoint, endPoint, dist_to_move_boundary_point_outside);
         return linePolygonsCrossings.getCombingPath(combPath, max_comb_distance_ignored, fail_on_unavoidable_obstacles);
     };
 };
@@ -0,0 +1,56 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "MemoryGovernor.h"
+
+#include "ProfilingReport.h"
+#include "../utils/memoryRelease.h"
+
+namespace cura
+{
+
+MemoryGovernor& MemoryGovernor::getInstance()
+{
+    static MemoryGovernor instance;
+    return instance;
+}
+
+MemoryGovernor::MemoryGovernor()
+: budget(0)
+{
+}
+
+void MemoryGovernor::setBudget(size_t budget)
+{
+    this->budget.store(budget, std::memory_order_relaxed);
+}
+
+bool MemoryGovernor::isUnderPressure(const char* action, bool critical)
+{
+    const size_t budget = getBudget();
+    if (budget == 0)
+    {
+        return false;
+    }
+    const size_t threshold = budget * (critical ? critical_fraction : pressure_fraction);
+    size_t rss = ProfilingReport::getCurrentRSS();
+    if (rss < threshold)
+    {
+        return false;
+    }
+    releaseFreedMemory(); // the allocator keeps much of the memory freed by earlier layers, which isn't needed
+    rss = ProfilingReport::getCurrentRSS();
+    if (rss < threshold)
+    {
+        return false;
+    }
+    ProfilingReport::getInstance().recordThrottle(action, rss);
+    return true;
+}
+
+size_t MemoryGovernor::getHeadroom() const
+{
+    const size_t budget = getBudget();
+    const size_t rss = ProfilingReport::getCurrentRSS();
+    return (rss < budget) ? budget - rss : 0;
+}
+
+}//namespace cura
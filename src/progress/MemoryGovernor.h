@@ -0,0 +1,70 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef PROGRESS_MEMORY_GOVERNOR_H
+#define PROGRESS_MEMORY_GOVERNOR_H
+
+#include <atomic>
+#include <cstddef> // size_t
+
+namespace cura
+{
+
+/*!
+ * Keeps the resident memory of the engine below a budget, by trading speed for memory when it gets close.
+ *
+ * The parts of slicing which keep more data in memory to go faster ask the governor whether they may, see MemoryGovernor::isUnderPressure:
+ * the window of layers of which the path geometry is generated ahead (FffGcodeWriter), the overlap of writing a mesh group with slicing the next one,
+ * and keeping the layer data uncompressed in memory until its gcode is written (FffProcessor).
+ * Each time one of them holds back is recorded in the ProfilingReport.
+ *
+ * Without a budget nothing is held back.
+ */
+class MemoryGovernor
+{
+public:
+    static MemoryGovernor& getInstance();
+
+    /*!
+     * Set the budget of the resident memory of the engine.
+     *
+     * \param budget The number of bytes, or zero for no budget
+     */
+    void setBudget(size_t budget);
+
+    /*!
+     * Get the budget of the resident memory of the engine, in bytes, or zero for no budget.
+     */
+    size_t getBudget() const
+    {
+        return budget.load(std::memory_order_relaxed);
+    }
+
+    /*!
+     * Whether the resident memory has come close enough to the budget to hold back an action which would use more memory.
+     *
+     * Memory which has been freed is first given back to the operating system, so that it isn't counted.
+     * When the action is held back it's recorded into the current mesh group of the ProfilingReport.
+     *
+     * \param action The action which is held back if so, for the ProfilingReport
+     * \param critical Whether to only hold back the action very close to the budget, for actions of which holding back costs much time
+     * \return Whether to hold back the action
+     */
+    bool isUnderPressure(const char* action, bool critical = false);
+
+    /*!
+     * Get the memory which may still be used before reaching the budget, in bytes.
+     *
+     * \return The bytes left, or zero without a budget or when it is reached
+     */
+    size_t getHeadroom() const;
+
+private:
+    static constexpr double pressure_fraction = 0.75; //!< The fraction of the budget from which on actions are held back
+    static constexpr double critical_fraction = 0.9; //!< The fraction of the budget from which on critical actions are held back
+
+    std::atomic<size_t> budget; //!< The budget in bytes, or zero
+
+    MemoryGovernor();
+};
+
+}//namespace cura
+#endif//PROGRESS_MEMORY_GOVERNOR_H
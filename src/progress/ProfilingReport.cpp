@@ -0,0 +1,339 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "ProfilingReport.h"
+
+#include <algorithm> // max, find_if
+#include <cstdio>
+#ifndef __WIN32
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#include "../utils/AllocationCounter.h"
+#include "../utils/gettime.h"
+#include "../utils/ThreadPool.h"
+
+namespace cura
+{
+
+namespace
+{
+thread_local int current_meshgroup_idx = -1; // the mesh group into which the current thread records, or -1 for the last one started
+thread_local double last_cpu_time = 0.0; // the processor time used by the engine when the last stage of the current thread finished or its mesh group started
+thread_local double last_thread_cpu_time = 0.0; // the processor time used by the current thread at that time
+thread_local std::vector<double> last_worker_cpu_times; // the processor time used by each worker thread at that time
+thread_local std::vector<AllocationCounter::Counts> last_allocation_counts; // the allocations of each thread at that time
+}
+
+ProfilingReport::LayerProfile::LayerProfile()
+: vertex_count(0)
+, part_count(0)
+, skin(false)
+, estimated_cost(0.0)
+, inset_time(0.0)
+, skin_time(0.0)
+{
+}
+
+ProfilingReport::MeshProfile::MeshProfile()
+: face_count(0)
+, vertex_count(0)
+, layer_count(0)
+, part_count(0)
+, slice_time(0.0)
+, parts_time(0.0)
+{
+}
+
+ProfilingReport::ProfilingReport()
+{
+}
+
+ProfilingReport& ProfilingReport::getInstance()
+{
+    static ProfilingReport instance;
+    return instance;
+}
+
+unsigned int ProfilingReport::startMeshGroup()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    meshgroups.emplace_back();
+    current_meshgroup_idx = meshgroups.size() - 1;
+    restartCpuTimes();
+    restartAllocationCounts();
+    return current_meshgroup_idx;
+}
+
+void ProfilingReport::continueMeshGroup(unsigned int meshgroup_idx)
+{
+    current_meshgroup_idx = meshgroup_idx;
+    restartCpuTimes();
+    restartAllocationCounts();
+}
+
+ProfilingReport::MeshGroupProfile& ProfilingReport::getCurrentMeshGroup()
+{
+    if (meshgroups.empty())
+    {
+        meshgroups.emplace_back();
+        restartCpuTimes();
+        restartAllocationCounts();
+    }
+    if (current_meshgroup_idx < 0 || current_meshgroup_idx >= int(meshgroups.size()))
+    {
+        return meshgroups.back();
+    }
+    return meshgroups[current_meshgroup_idx];
+}
+
+void ProfilingReport::finishStage(Progress::Stage stage, double wall_time)
+{
+    const double cpu_time = getCpuTime();
+    const size_t rss = getCurrentRSS();
+    const size_t peak_rss = std::max(rss, getPeakRSS()); // the kernel updates the peak lazily
+    const double thread_cpu_time = getThreadCpuTime();
+    const std::vector<double> worker_cpu_times = ThreadPool::getInstance()->getWorkerCpuTimes();
+    StageProfile profile{stage, wall_time, cpu_time - last_cpu_time, rss, peak_rss, 0, 0, 0, {}, thread_cpu_time - last_thread_cpu_time, {}};
+    for (unsigned int worker_idx = 0; worker_idx < worker_cpu_times.size(); worker_idx++)
+    { // workers started since the last stage have used all their time during this stage
+        const double last_worker_cpu_time = (worker_idx < last_worker_cpu_times.size()) ? last_worker_cpu_times[worker_idx] : 0.0;
+        profile.worker_cpu_times.push_back(std::max(0.0, worker_cpu_times[worker_idx] - last_worker_cpu_time));
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<StageProfile>& stages = getCurrentMeshGroup().stages;
+    finishAllocationCounts(profile);
+    stages.push_back(std::move(profile));
+    last_cpu_time = cpu_time;
+    last_thread_cpu_time = thread_cpu_time;
+    last_worker_cpu_times = worker_cpu_times;
+}
+
+ProfilingReport::MeshProfile& ProfilingReport::getMesh(unsigned int mesh_idx)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<MeshProfile>& meshes = getCurrentMeshGroup().meshes;
+    if (mesh_idx >= meshes.size())
+    {
+        meshes.resize(mesh_idx + 1);
+    }
+    return meshes[mesh_idx];
+}
+
+void ProfilingReport::recordGrid(const char* use, size_t element_count, size_t cell_count, size_t max_cell_element_count)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<GridProfile>& grids = getCurrentMeshGroup().grids;
+    auto grid = std::find_if(grids.begin(), grids.end(), [use](const GridProfile& profile) { return profile.use == use; });
+    if (grid == grids.end())
+    {
+        grids.push_back(GridProfile{use, 0, 0, 0, 0});
+        grid = grids.end() - 1;
+    }
+    grid->grid_count++;
+    grid->element_count += element_count;
+    grid->cell_count += cell_count;
+    grid->max_cell_element_count = std::max(grid->max_cell_element_count, max_cell_element_count);
+}
+
+void ProfilingReport::recordThrottle(const char* action, size_t rss)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<ThrottleProfile>& throttles = getCurrentMeshGroup().throttles;
+    auto throttle = std::find_if(throttles.begin(), throttles.end(), [action](const ThrottleProfile& profile) { return profile.action == action; });
+    if (throttle == throttles.end())
+    {
+        throttles.push_back(ThrottleProfile{action, 0, 0});
+        throttle = throttles.end() - 1;
+    }
+    throttle->count++;
+    throttle->max_rss = std::max(throttle->max_rss, rss);
+}
+
+void ProfilingReport::writeJSON(std::ostream& out) const
+{
+    out << "{\n";
+    out << "    \"meshgroups\": [";
+    for (unsigned int meshgroup_idx = 0; meshgroup_idx < meshgroups.size(); meshgroup_idx++)
+    {
+        const MeshGroupProfile& meshgroup = meshgroups[meshgroup_idx];
+        out << ((meshgroup_idx == 0) ? "\n" : ",\n");
+        out << "        {\n";
+        out << "            \"stages\": [";
+        for (unsigned int stage_idx = 0; stage_idx < meshgroup.stages.size(); stage_idx++)
+        {
+            const StageProfile& stage = meshgroup.stages[stage_idx];
+            out << ((stage_idx == 0) ? "\n" : ",\n");
+            out << "                { \"stage\": \"" << Progress::getStageName(stage.stage) << "\""
+                << ", \"wall_time\": " << stage.wall_time
+                << ", \"cpu_time\": " << stage.cpu_time
+                << ", \"rss\": " << stage.rss
+                << ", \"peak_rss\": " << stage.peak_rss;
+            if (AllocationCounter::isAvailable())
+            {
+                out << ", \"allocations\": " << stage.allocation_count
+                    << ", \"allocated_bytes\": " << stage.allocated_bytes
+                    << ", \"peak_live_bytes\": " << stage.peak_live_bytes
+                    << ", \"threads\": [";
+                for (unsigned int thread_idx = 0; thread_idx < stage.threads.size(); thread_idx++)
+                {
+                    const ThreadAllocationProfile& thread = stage.threads[thread_idx];
+                    out << ((thread_idx == 0) ? " " : ", ")
+                        << "{ \"thread\": " << thread.thread_idx
+                        << ", \"allocations\": " << thread.allocation_count
+                        << ", \"allocated_bytes\": " << thread.allocated_bytes << " }";
+                }
+                out << " ]";
+            }
+            out << ", \"thread_cpu_time\": " << stage.thread_cpu_time
+                << ", \"worker_cpu_times\": [";
+            for (unsigned int worker_idx = 0; worker_idx < stage.worker_cpu_times.size(); worker_idx++)
+            {
+                out << ((worker_idx == 0) ? " " : ", ") << stage.worker_cpu_times[worker_idx];
+            }
+            out << (stage.worker_cpu_times.empty() ? "] }" : " ] }");
+        }
+        out << "\n            ],\n";
+        out << "            \"meshes\": [";
+        for (unsigned int mesh_idx = 0; mesh_idx < meshgroup.meshes.size(); mesh_idx++)
+        {
+            const MeshProfile& mesh = meshgroup.meshes[mesh_idx];
+            out << ((mesh_idx == 0) ? "\n" : ",\n");
+            out << "                { \"faces\": " << mesh.face_count
+                << ", \"vertices\": " << mesh.vertex_count
+                << ", \"layers\": " << mesh.layer_count
+                << ", \"parts\": " << mesh.part_count
+                << ", \"slice_time\": " << mesh.slice_time
+                << ", \"parts_time\": " << mesh.parts_time
+                << ", \"layer_costs\": [";
+            for (unsigned int layer_nr = 0; layer_nr < mesh.layers.size(); layer_nr++)
+            {
+                const LayerProfile& layer = mesh.layers[layer_nr];
+                out << ((layer_nr == 0) ? "\n" : ",\n");
+                out << "                    { \"vertices\": " << layer.vertex_count
+                    << ", \"parts\": " << layer.part_count
+                    << ", \"skin\": " << (layer.skin ? "true" : "false")
+                    << ", \"estimated_cost\": " << layer.estimated_cost
+                    << ", \"inset_time\": " << layer.inset_time
+                    << ", \"skin_time\": " << layer.skin_time << " }";
+            }
+            out << (mesh.layers.empty() ? "] }" : "\n                ] }");
+        }
+        out << "\n            ],\n";
+        out << "            \"grids\": [";
+        for (unsigned int grid_idx = 0; grid_idx < meshgroup.grids.size(); grid_idx++)
+        {
+            const GridProfile& grid = meshgroup.grids[grid_idx];
+            out << ((grid_idx == 0) ? "\n" : ",\n");
+            out << "                { \"use\": \"" << grid.use << "\""
+                << ", \"grids\": " << grid.grid_count
+                << ", \"elements\": " << grid.element_count
+                << ", \"cells\": " << grid.cell_count
+                << ", \"mean_occupancy\": " << ((grid.cell_count > 0) ? double(grid.element_count) / grid.cell_count : 0.0)
+                << ", \"max_occupancy\": " << grid.max_cell_element_count << " }";
+        }
+        out << (meshgroup.grids.empty() ? "],\n" : "\n            ],\n");
+        out << "            \"throttles\": [";
+        for (unsigned int throttle_idx = 0; throttle_idx < meshgroup.throttles.size(); throttle_idx++)
+        {
+            const ThrottleProfile& throttle = meshgroup.throttles[throttle_idx];
+            out << ((throttle_idx == 0) ? "\n" : ",\n");
+            out << "                { \"action\": \"" << throttle.action << "\""
+                << ", \"count\": " << throttle.count
+                << ", \"max_rss\": " << throttle.max_rss << " }";
+        }
+        out << (meshgroup.throttles.empty() ? "]\n" : "\n            ]\n");
+        out << "        }";
+    }
+    out << "\n    ]\n";
+    out << "}\n";
+}
+
+double ProfilingReport::getCpuTime()
+{
+#ifdef __WIN32
+    return 0.0;
+#else
+    timespec time;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time) != 0)
+    {
+        return 0.0;
+    }
+    return double(time.tv_sec) + double(time.tv_nsec) / 1000000000.0;
+#endif
+}
+
+void ProfilingReport::restartCpuTimes()
+{
+    last_cpu_time = getCpuTime();
+    last_thread_cpu_time = getThreadCpuTime();
+    last_worker_cpu_times = ThreadPool::getInstance()->getWorkerCpuTimes();
+}
+
+size_t ProfilingReport::getCurrentRSS()
+{
+#ifdef __linux__
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (!statm)
+    {
+        return 0;
+    }
+    long program_pages = 0;
+    long resident_pages = 0;
+    const int read_count = fscanf(statm, "%ld %ld", &program_pages, &resident_pages);
+    fclose(statm);
+    return (read_count == 2) ? size_t(resident_pages) * size_t(sysconf(_SC_PAGESIZE)) : 0;
+#else
+    return 0;
+#endif
+}
+
+size_t ProfilingReport::getPeakRSS()
+{
+#ifdef __WIN32
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return 0;
+    }
+ #if defined(__APPLE__) && defined(__MACH__)
+    return size_t(usage.ru_maxrss); // in bytes on mac
+ #else
+    return size_t(usage.ru_maxrss) * 1024; // in kilobytes on linux
+ #endif
+#endif
+}
+
+void ProfilingReport::restartAllocationCounts()
+{
+    AllocationCounter::getThreadCounts(last_allocation_counts);
+    AllocationCounter::resetPeakLiveBytes();
+}
+
+void ProfilingReport::finishAllocationCounts(StageProfile& stage)
+{
+    std::vector<AllocationCounter::Counts> thread_counts;
+    AllocationCounter::getThreadCounts(thread_counts);
+    for (unsigned int thread_idx = 0; thread_idx < thread_counts.size(); thread_idx++)
+    {
+        AllocationCounter::Counts counts = thread_counts[thread_idx];
+        if (thread_idx < last_allocation_counts.size())
+        {
+            counts.allocation_count -= last_allocation_counts[thread_idx].allocation_count;
+            counts.allocated_bytes -= last_allocation_counts[thread_idx].allocated_bytes;
+        }
+        if (counts.allocation_count == 0)
+        {
+            continue;
+        }
+        stage.threads.push_back(ThreadAllocationProfile{thread_idx, counts.allocation_count, counts.allocated_bytes});
+        stage.allocation_count += counts.allocation_count;
+        stage.allocated_bytes += counts.allocated_bytes;
+    }
+    stage.peak_live_bytes = AllocationCounter::getPeakLiveBytes();
+    last_allocation_counts.swap(thread_counts);
+    AllocationCounter::resetPeakLiveBytes(); // the stages of all threads share the peak, like they share the resident memory
+}
+
+}//namespace cura
@@ -0,0 +1,238 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef PROGRESS_PROFILING_REPORT_H
+#define PROGRESS_PROFILING_REPORT_H
+
+#include <cstddef> // size_t
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Progress.h"
+
+namespace cura
+{
+
+/*!
+ * The time and memory used by each stage of slicing each mesh group, and statistics of each mesh.
+ *
+ * The stages are recorded by Progress::messageProgressStage, with the times of the TimeKeeper which also times the log messages.
+ * The processor time of each worker thread of the ThreadPool shows how well the threads were used during a stage.
+ * The report is written as JSON for the command line, and sent over the CommandSocket after each mesh group.
+ *
+ * Each thread records into the mesh group it has started or continued last, so that the gcode of a mesh group can be
+ * written while the next mesh group is sliced. The processor time and allocations of stages which overlap are counted in both.
+ *
+ * The allocations are only counted when CuraEngine is built with ENABLE_ALLOCATION_COUNTING, see AllocationCounter.
+ * The occupancy of the SparseGrids shows whether their cell sizes fit the elements, see SparseGridInvasive::chooseCellSize.
+ * The actions held back by the MemoryGovernor show where a memory budget costs time.
+ */
+class ProfilingReport
+{
+public:
+    /*!
+     * The memory allocated by a single thread during a stage.
+     */
+    struct ThreadAllocationProfile
+    {
+        unsigned int thread_idx; //!< The thread, numbered in the order in which threads first allocated memory
+        size_t allocation_count; //!< The number of allocations of the thread during the stage
+        size_t allocated_bytes; //!< The number of bytes the thread allocated during the stage
+    };
+
+    /*!
+     * The resources used by a single stage of slicing.
+     */
+    struct StageProfile
+    {
+        Progress::Stage stage; //!< The stage
+        double wall_time; //!< The time the stage took, in seconds
+        double cpu_time; //!< The processor time of all threads of the engine during the stage, in seconds
+        size_t rss; //!< The memory resident at the end of the stage, in bytes
+        size_t peak_rss; //!< The most memory resident up to the end of the stage, in bytes
+        size_t allocation_count; //!< The number of allocations of all threads during the stage
+        size_t allocated_bytes; //!< The number of bytes all threads allocated during the stage
+        size_t peak_live_bytes; //!< The most bytes allocated and not yet freed at once during the stage
+        std::vector<ThreadAllocationProfile> threads; //!< The allocations of each thread which allocated memory during the stage
+        double thread_cpu_time; //!< The processor time of the thread which finished the stage, during the stage, in seconds
+        std::vector<double> worker_cpu_times; //!< The processor time of each worker thread of the ThreadPool during the stage, in seconds, if it can be measured
+    };
+
+    /*!
+     * The estimated and the actual cost of computing the walls, skin and infill of a single layer of a mesh.
+     */
+    struct LayerProfile
+    {
+        size_t vertex_count; //!< The number of vertices of the outlines of the layer
+        size_t part_count; //!< The number of parts of the layer
+        bool skin; //!< Whether the layer is estimated to contain skin
+        double estimated_cost; //!< The cost estimated from the above, see FffPolygonGenerator::estimateLayerCosts
+        double inset_time; //!< The time it took to compute the walls of the layer, in seconds
+        double skin_time; //!< The time it took to compute the skin and infill of the layer, in seconds
+
+        LayerProfile();
+    };
+
+    /*!
+     * What a mesh adds to the work of slicing.
+     */
+    struct MeshProfile
+    {
+        size_t face_count; //!< The number of faces of the mesh
+        size_t vertex_count; //!< The number of vertices of the mesh
+        unsigned int layer_count; //!< The number of layers the mesh is sliced into
+        size_t part_count; //!< The number of layer parts of the mesh, summed over all layers
+        double slice_time; //!< The time it took to slice the mesh, in seconds
+        double parts_time; //!< The time it took to create the layer parts of the mesh, in seconds
+        std::vector<LayerProfile> layers; //!< The cost of each layer, or empty for a copy of another mesh
+
+        MeshProfile();
+    };
+
+    /*!
+     * How full the cells of the SparseGrids built for a single use were, summed over all grids of that use.
+     */
+    struct GridProfile
+    {
+        std::string use; //!< What the grids are built for
+        size_t grid_count; //!< The number of grids built
+        size_t element_count; //!< The number of elements inserted into the grids
+        size_t cell_count; //!< The number of cells which contain any element
+        size_t max_cell_element_count; //!< The most elements in a single cell of any grid
+    };
+
+    /*!
+     * How often the MemoryGovernor held back a single action to stay within the memory budget.
+     */
+    struct ThrottleProfile
+    {
+        std::string action; //!< The action which was held back
+        size_t count; //!< The number of times it was held back
+        size_t max_rss; //!< The most memory resident when it was held back, in bytes
+    };
+
+    /*!
+     * The profile of slicing a single mesh group.
+     */
+    struct MeshGroupProfile
+    {
+        std::vector<StageProfile> stages; //!< The finished stages, in the order in which they were processed
+        std::vector<MeshProfile> meshes; //!< The profile of each mesh of the mesh group
+        std::vector<GridProfile> grids; //!< The occupancy of the grids of each use
+        std::vector<ThrottleProfile> throttles; //!< The actions held back by the MemoryGovernor
+    };
+
+    static ProfilingReport& getInstance();
+
+    /*!
+     * Start the profile of the next mesh group, from which on the processor time of the first stage is counted.
+     *
+     * The stages and meshes recorded by the calling thread are recorded into this mesh group from now on.
+     *
+     * \return The index of the mesh group, for ProfilingReport::continueMeshGroup
+     */
+    unsigned int startMeshGroup();
+
+    /*!
+     * Record the stages and meshes recorded by the calling thread into a mesh group which has been started before.
+     *
+     * \param meshgroup_idx The index returned by ProfilingReport::startMeshGroup
+     */
+    void continueMeshGroup(unsigned int meshgroup_idx);
+
+    /*!
+     * Record that a stage of the current mesh group has finished.
+     *
+     * \param stage The stage which has finished
+     * \param wall_time The time the stage took, in seconds
+     */
+    void finishStage(Progress::Stage stage, double wall_time);
+
+    /*!
+     * Get the profile of a mesh of the current mesh group, to fill in.
+     *
+     * \param mesh_idx The index of the mesh within its mesh group
+     */
+    MeshProfile& getMesh(unsigned int mesh_idx);
+
+    /*!
+     * Record the occupancy of a SparseGrid which has been built for the current mesh group.
+     *
+     * \param use What the grid is built for
+     * \param grid The grid, of which all elements have been inserted
+     */
+    template<class Grid>
+    void recordGrid(const char* use, const Grid& grid)
+    {
+        recordGrid(use, grid.getElemCount(), grid.getOccupiedCellCount(), grid.getMaxCellElemCount());
+    }
+
+    /*!
+     * Record that the MemoryGovernor held back an action during the current mesh group.
+     *
+     * \param action The action which was held back
+     * \param rss The memory resident at the time, in bytes
+     */
+    void recordThrottle(const char* action, size_t rss);
+
+    /*!
+     * Get the profiles of all mesh groups up till now.
+     *
+     * Only to be used while no other thread is recording.
+     */
+    const std::vector<MeshGroupProfile>& getMeshGroups() const
+    {
+        return meshgroups;
+    }
+
+    /*!
+     * Write the profiles of all mesh groups up till now as JSON.
+     */
+    void writeJSON(std::ostream& out) const;
+
+    static size_t getCurrentRSS(); //!< The memory currently resident of the engine, in bytes, or 0 if it can't be determined
+
+private:
+    /*!
+     * Record the occupancy of a SparseGrid which has been built for the current mesh group.
+     *
+     * \param use What the grid is built for
+     * \param element_count The number of elements in the grid
+     * \param cell_count The number of cells which contain any element
+     * \param max_cell_element_count The most elements in a single cell
+     */
+    void recordGrid(const char* use, size_t element_count, size_t cell_count, size_t max_cell_element_count);
+
+    std::vector<MeshGroupProfile> meshgroups; //!< The profile of each mesh group started
+    std::mutex mutex; //!< Guards ProfilingReport::meshgroups
+
+    ProfilingReport();
+
+    /*!
+     * Get the mesh group into which the calling thread records, starting one if none has been started yet.
+     *
+     * The mutex should be locked.
+     */
+    MeshGroupProfile& getCurrentMeshGroup();
+
+    static double getCpuTime(); //!< The processor time used by all threads of the engine up till now, in seconds
+    static size_t getPeakRSS(); //!< The most memory which has been resident of the engine, in bytes, or 0 if it can't be determined
+
+    /*!
+     * Start measuring the processor time of the next stage of the calling thread from now on.
+     */
+    static void restartCpuTimes();
+
+    /*!
+     * Start counting the allocations of the next stage of the calling thread from now on.
+     */
+    static void restartAllocationCounts();
+
+    /*!
+     * Fill in the allocations since the last stage of the calling thread finished, and start counting those of the next stage.
+     */
+    static void finishAllocationCounts(StageProfile& stage);
+};
+
+}//namespace cura
+#endif//PROGRESS_PROFILING_REPORT_H
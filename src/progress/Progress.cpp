@@ -1,6 +1,8 @@
 /** Copyright (C) 2015 Ultimaker - Released under terms of the AGPLv3 License */
 #include "Progress.h"
 
+#include "ProfilingReport.h"
+
 #include "../commandSocket.h"
 #include "../utils/gettime.h"
 
@@ -61,29 +63,36 @@ void Progress::init()
     total_timing = accumulated_time;
 }
 
-void Progress::messageProgress(Progress::Stage stage, int progress_in_stage, int progress_in_stage_max)
+const std::string& Progress::getStageName(Stage stage)
+{
+    return names[(int)stage];
+}
+
+void Progress::messageProgress(Progress::Stage stage, int progress_in_stage, int progress_in_stage_max, CommandSocket* command_socket)
 {
     float percentage = calcOverallProgress(stage, float(progress_in_stage) / float(progress_in_stage_max));
-    if (CommandSocket::getInstance())
+    if (command_socket)
     {
-        CommandSocket::getInstance()->sendProgress(percentage);
+        command_socket->sendProgress(percentage);
     }
     
     logProgress(names[(int)stage].c_str(), progress_in_stage, progress_in_stage_max, percentage);
 }
 
-void Progress::messageProgressStage(Progress::Stage stage, TimeKeeper* time_keeper)
+void Progress::messageProgressStage(Progress::Stage stage, TimeKeeper* time_keeper, CommandSocket* command_socket)
 {
-    if (CommandSocket::getInstance())
+    if (command_socket)
     {
-        CommandSocket::getInstance()->sendProgressStage(stage);
+        command_socket->sendProgressStage(stage);
     }
     
     if (time_keeper)
     {
         if ((int)stage > 0)
         {
-            log("Progress: %s accomplished in %5.3fs\n", names[(int)stage-1].c_str(), time_keeper->restart());
+            const double stage_time = time_keeper->restart();
+            log("Progress: %s accomplished in %5.3fs\n", names[(int)stage-1].c_str(), stage_time);
+            ProfilingReport::getInstance().finishStage(Stage((int)stage - 1), stage_time);
         }
         else
         {
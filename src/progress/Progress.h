@@ -50,21 +50,26 @@ private:
     static float calcOverallProgress(Stage stage, float stage_progress);
 public:
     static void init(); //!< Initialize some values needed in a fast computation of the progress
+    static const std::string& getStageName(Stage stage); //!< The name of a stage as used in the log
     /*!
      * Message progress over the CommandSocket and to the terminal (if the command line arg '-p' is provided).
      * 
      * \param stage The current stage of processing
      * \param progress_in_stage Any number giving the progress within the stage
      * \param progress_in_stage_max The maximal value of \p progress_in_stage
+     * \param command_socket The command socket of the slice, or nullptr if the progress is only logged
      */
-    static void messageProgress(Stage stage, int progress_in_stage, int progress_in_stage_max);
+    static void messageProgress(Stage stage, int progress_in_stage, int progress_in_stage_max, CommandSocket* command_socket);
     /*!
      * Message the progress stage over the command socket.
      * 
+     * When timed, the stage which has finished is recorded in the ProfilingReport.
+     * 
      * \param stage The current stage
      * \param timeKeeper The stapwatch keeping track of the timings for each stage (optional)
+     * \param command_socket The command socket of the slice, or nullptr if the stage is only logged
      */
-    static void messageProgressStage(Stage stage, TimeKeeper* timeKeeper);
+    static void messageProgressStage(Stage stage, TimeKeeper* timeKeeper, CommandSocket* command_socket);
 };
 
 
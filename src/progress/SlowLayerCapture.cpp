@@ -0,0 +1,200 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "SlowLayerCapture.h"
+
+#include <cstring> // memcpy, memcmp
+#include <fstream>
+#include <sstream>
+
+#include "../settings/SettingKeys.h"
+#include "../utils/logoutput.h"
+#include "../utils/SVG.h"
+
+namespace cura
+{
+
+namespace
+{
+
+const char magic[8] = { 'C', 'u', 'r', 'a', 'L', 'a', 'y', 'r' }; // the first bytes of every captured layer
+const uint32_t format_version = 1; // increased whenever the format of the captured layers changes
+const uint32_t max_count = 1 << 28; // larger counts are only found in corrupt files
+
+template<typename T>
+void writeValue(std::ostream& out, T value)
+{
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+bool readValue(std::istream& in, T& value)
+{
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+/*!
+ * Write the value of every known setting as a <key>=<value> line, with the line breaks in the values escaped.
+ */
+bool writeSettings(const SettingsBaseVirtual& settings, const std::string& filename)
+{
+    std::ofstream out(filename);
+    for (unsigned int key_idx = 0; key_idx < setting_key_count; key_idx++)
+    {
+        const char* key = toString(static_cast<SettingKey>(key_idx));
+        const std::string* value = settings.findSettingString(key);
+        if (!value)
+        {
+            continue;
+        }
+        out << key << '=';
+        for (char c : *value)
+        {
+            if (c == '\n')
+            {
+                out << "\\n";
+            }
+            else
+            {
+                out << c;
+            }
+        }
+        out << '\n';
+    }
+    return static_cast<bool>(out);
+}
+
+}
+
+SlowLayerCapture::SlowLayerCapture()
+: enabled(false)
+, threshold(0.0)
+{
+}
+
+SlowLayerCapture& SlowLayerCapture::getInstance()
+{
+    static SlowLayerCapture instance;
+    return instance;
+}
+
+void SlowLayerCapture::start(double threshold, const std::string& directory)
+{
+    std::ofstream index(directory + "/slow_layers.txt");
+    if (!index)
+    {
+        logWarning("Couldn't write to %s, so no slow layers are captured.\n", directory.c_str());
+        return;
+    }
+    index << "# stage mesh_idx layer_nr time_seconds file\n";
+    this->threshold = threshold;
+    this->directory = directory;
+    enabled = true;
+}
+
+void SlowLayerCapture::capture(const char* stage, int mesh_idx, int layer_nr, int64_t z, double time, const Polygons& geometry, const SettingsBaseVirtual& settings)
+{
+    std::ostringstream name;
+    name << stage;
+    if (mesh_idx >= 0)
+    {
+        name << "_mesh" << mesh_idx;
+    }
+    name << "_layer" << layer_nr;
+    const std::string base_filename = directory + "/" + name.str();
+
+    bool success = writePolygons(geometry, z, base_filename + ".polygons");
+    success &= writeSettings(settings, base_filename + ".settings");
+    if (geometry.size() > 0)
+    {
+        SVG svg((base_filename + ".svg").c_str(), AABB(geometry));
+        svg.writeComment(name.str());
+        svg.writeAreas(geometry);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ofstream index(directory + "/slow_layers.txt", std::ios::app);
+    index << stage << ' ' << mesh_idx << ' ' << layer_nr << ' ' << time << ' ' << name.str() << ".polygons\n";
+    if (!success || !index)
+    {
+        logWarning("Couldn't capture the slow %s of layer %i in %s\n", stage, layer_nr, directory.c_str());
+        return;
+    }
+    log("The %s of layer %i took %5.3fs, captured in %s.polygons\n", stage, layer_nr, time, base_filename.c_str());
+}
+
+bool SlowLayerCapture::writePolygons(const Polygons& polygons, int64_t z, const std::string& filename)
+{
+    std::ofstream out(filename, std::ios::binary);
+    out.write(magic, sizeof(magic));
+    writeValue<uint32_t>(out, format_version);
+    writeValue<int64_t>(out, z);
+    writeValue<uint32_t>(out, polygons.size());
+    for (unsigned int poly_idx = 0; poly_idx < polygons.size(); poly_idx++)
+    {
+        writeValue<uint32_t>(out, polygons[poly_idx].size());
+    }
+    for (unsigned int poly_idx = 0; poly_idx < polygons.size(); poly_idx++)
+    {
+        for (const Point& point : polygons[poly_idx])
+        {
+            writeValue<int64_t>(out, point.X);
+        }
+    }
+    for (unsigned int poly_idx = 0; poly_idx < polygons.size(); poly_idx++)
+    {
+        for (const Point& point : polygons[poly_idx])
+        {
+            writeValue<int64_t>(out, point.Y);
+        }
+    }
+    return static_cast<bool>(out);
+}
+
+bool SlowLayerCapture::readPolygons(const std::string& filename, Polygons& polygons, int64_t& z)
+{
+    std::ifstream in(filename, std::ios::binary);
+    char file_magic[sizeof(magic)];
+    uint32_t file_format_version;
+    uint32_t poly_count;
+    if (!in.read(file_magic, sizeof(file_magic)) || std::memcmp(file_magic, magic, sizeof(magic)) != 0
+        || !readValue(in, file_format_version) || file_format_version != format_version
+        || !readValue(in, z) || !readValue(in, poly_count) || poly_count > max_count)
+    {
+        return false;
+    }
+    std::vector<uint32_t> point_counts(poly_count);
+    for (uint32_t& point_count : point_counts)
+    {
+        if (!readValue(in, point_count) || point_count > max_count)
+        {
+            return false;
+        }
+    }
+    polygons.clear();
+    for (uint32_t point_count : point_counts)
+    {
+        PolygonRef poly = polygons.newPoly();
+        poly.reserve(point_count);
+        for (uint32_t point_idx = 0; point_idx < point_count; point_idx++)
+        {
+            int64_t x;
+            if (!readValue(in, x))
+            {
+                return false;
+            }
+            poly.add(Point(x, 0));
+        }
+    }
+    for (unsigned int poly_idx = 0; poly_idx < polygons.size(); poly_idx++)
+    {
+        for (Point& point : polygons[poly_idx])
+        {
+            if (!readValue(in, point.Y))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+} // namespace cura
@@ -0,0 +1,101 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef PROGRESS_SLOW_LAYER_CAPTURE_H
+#define PROGRESS_SLOW_LAYER_CAPTURE_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include "../settings/settings.h"
+#include "../utils/NoCopy.h"
+#include "../utils/polygon.h"
+
+namespace cura
+{
+
+/*!
+ * Saves the input geometry of the layers which take unexpectedly long in one of the stages of slicing,
+ * so that the layers which make a job slow can be reproduced without the models and profiles of the job.
+ *
+ * For every layer of which a stage takes longer than the threshold, three files are written to the capture directory:
+ * - <stage>_mesh<mesh_idx>_layer<layer_nr>.polygons: the geometry in the format of writePolygons, which the benchmarks read with --layer
+ * - <stage>_mesh<mesh_idx>_layer<layer_nr>.svg: the same geometry, to look at
+ * - <stage>_mesh<mesh_idx>_layer<layer_nr>.settings: the value of every known setting, as <key>=<value> lines
+ * and a line is appended to slow_layers.txt in the directory, with the stage, the mesh, the layer and its time.
+ *
+ * The mesh part of the names is left out for the stages which don't apply to a single mesh.
+ * Nothing is timed against the threshold until start has been called, e.g. by the --slow-layers option.
+ */
+class SlowLayerCapture : NoCopy
+{
+public:
+    static SlowLayerCapture& getInstance();
+
+    /*!
+     * Start capturing the layers which take longer than \p threshold seconds in a stage.
+     *
+     * \param threshold The time above which a stage of a layer is slow, in seconds
+     * \param directory The existing directory to write the captured layers to
+     */
+    void start(double threshold, const std::string& directory);
+
+    /*!
+     * Whether the slow layers are captured at all.
+     */
+    bool isEnabled() const
+    {
+        return enabled;
+    }
+
+    /*!
+     * Whether a stage of a layer which took \p time seconds is to be captured.
+     */
+    bool isSlow(double time) const
+    {
+        return enabled && time > threshold;
+    }
+
+    /*!
+     * Write the geometry of a slow layer and the settings it was processed with to the capture directory.
+     *
+     * Can be called from several threads at once.
+     *
+     * \param stage The name of the stage which was slow: "inset", "skin", "support", "planning" or "export"
+     * \param mesh_idx The mesh of which the layer was slow, or -1 if the stage doesn't apply to a single mesh
+     * \param layer_nr The layer which was slow
+     * \param z The height of the layer
+     * \param time The time the stage took for the layer, in seconds
+     * \param geometry The input of the stage for the layer
+     * \param settings The settings with which the stage processed the layer
+     */
+    void capture(const char* stage, int mesh_idx, int layer_nr, int64_t z, double time, const Polygons& geometry, const SettingsBaseVirtual& settings);
+
+    /*!
+     * Write polygons to a compact binary file: the magic bytes CuraLayr, the format version and the height of the layer,
+     * then the number of polygons, the number of points of each polygon, all X and then all Y coordinates, all little endian.
+     *
+     * \return Whether the file could be written
+     */
+    static bool writePolygons(const Polygons& polygons, int64_t z, const std::string& filename);
+
+    /*!
+     * Read polygons written by writePolygons.
+     *
+     * \param[out] polygons The polygons read from the file
+     * \param[out] z The height of the layer of the polygons
+     * \return Whether the file could be read
+     */
+    static bool readPolygons(const std::string& filename, Polygons& polygons, int64_t& z);
+
+private:
+    SlowLayerCapture();
+
+    bool enabled; //!< Whether start has been called
+    double threshold; //!< The time above which a stage of a layer is slow, in seconds
+    std::string directory; //!< The directory to which the slow layers are written
+    std::mutex mutex; //!< Guards the index file, to which slow layers are added from several threads
+};
+
+} // namespace cura
+
+#endif // PROGRESS_SLOW_LAYER_CAPTURE_H
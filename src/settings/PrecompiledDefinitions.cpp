@@ -0,0 +1,241 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "PrecompiledDefinitions.h"
+
+#include <cstdio> // rename, remove
+#include <cstring> // memcmp
+#include <fstream>
+#include <sys/stat.h>
+
+namespace cura
+{
+
+const char PrecompiledDefinitions::magic[8] = { 'C', 'u', 'r', 'a', 'D', 'e', 'f', 's' };
+
+DefinitionOperation::DefinitionOperation(Type type, std::string key)
+: type(type)
+, key(key)
+, is_base_file(false)
+, extruder_nr(0)
+, has_type(false)
+, has_default(false)
+, has_unrecognized_default(false)
+, has_unit(false)
+{
+}
+
+namespace
+{
+
+template<typename T>
+void writeValue(std::ostream& out, T value)
+{
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void writeString(std::ostream& out, const std::string& value)
+{
+    writeValue<uint32_t>(out, value.size());
+    out.write(value.data(), value.size());
+}
+
+template<typename T>
+bool readValue(std::istream& in, T& value)
+{
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+const uint32_t max_string_size = 1 << 24; // larger strings are only found in corrupt files
+
+bool readString(std::istream& in, std::string& value)
+{
+    uint32_t size;
+    if (!readValue(in, size) || size > max_string_size)
+    {
+        return false;
+    }
+    value.resize(size);
+    return size == 0 || static_cast<bool>(in.read(&value[0], size));
+}
+
+// the flags in which the booleans of a DefinitionOperation are stored
+enum : unsigned char
+{
+    IS_BASE_FILE = 1 << 0,
+    HAS_TYPE = 1 << 1,
+    HAS_DEFAULT = 1 << 2,
+    HAS_UNIT = 1 << 3,
+    HAS_UNRECOGNIZED_DEFAULT = 1 << 4
+};
+
+}//namespace
+
+bool PrecompiledDefinitions::getFileState(const std::string& path, SourceFile& result)
+{
+    struct stat file_stat;
+    if (stat(path.c_str(), &file_stat) != 0)
+    {
+        return false;
+    }
+    result.path = path;
+    result.modification_time = file_stat.st_mtime;
+    result.size = file_stat.st_size;
+    return true;
+}
+
+bool PrecompiledDefinitions::addSourceFile(const std::string& path)
+{
+    SourceFile source_file;
+    if (!getFileState(path, source_file))
+    {
+        return false;
+    }
+    source_files.push_back(source_file);
+    return true;
+}
+
+bool PrecompiledDefinitions::sourceFilesUnchanged() const
+{
+    for (const SourceFile& source_file : source_files)
+    {
+        SourceFile current;
+        if (!getFileState(source_file.path, current) || current.modification_time != source_file.modification_time || current.size != source_file.size)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool PrecompiledDefinitions::write(const std::string& filename) const
+{
+    const std::string temporary_filename = filename + ".tmp";
+    {
+        std::ofstream out(temporary_filename, std::ios::binary);
+        if (!out)
+        {
+            return false;
+        }
+        out.write(magic, sizeof(magic));
+        writeValue<uint32_t>(out, format_version);
+
+        writeValue<uint32_t>(out, source_files.size());
+        for (const SourceFile& source_file : source_files)
+        {
+            writeString(out, source_file.path);
+            writeValue<int64_t>(out, source_file.modification_time);
+            writeValue<int64_t>(out, source_file.size);
+        }
+
+        writeValue<uint32_t>(out, inherited_ids.size());
+        for (const std::string& inherited_id : inherited_ids)
+        {
+            writeString(out, inherited_id);
+        }
+
+        writeValue<uint32_t>(out, operations.size());
+        for (const DefinitionOperation& operation : operations)
+        {
+            writeValue<unsigned char>(out, static_cast<unsigned char>(operation.type));
+            unsigned char flags = 0;
+            flags |= operation.is_base_file ? IS_BASE_FILE : 0;
+            flags |= operation.has_type ? HAS_TYPE : 0;
+            flags |= operation.has_default ? HAS_DEFAULT : 0;
+            flags |= operation.has_unit ? HAS_UNIT : 0;
+            flags |= operation.has_unrecognized_default ? HAS_UNRECOGNIZED_DEFAULT : 0;
+            writeValue<unsigned char>(out, flags);
+            writeValue<uint32_t>(out, operation.extruder_nr);
+            writeString(out, operation.key);
+            writeString(out, operation.label);
+            writeString(out, operation.setting_type);
+            writeString(out, operation.default_value);
+            writeString(out, operation.unit);
+        }
+        if (!out)
+        {
+            out.close();
+            std::remove(temporary_filename.c_str());
+            return false;
+        }
+    }
+    return std::rename(temporary_filename.c_str(), filename.c_str()) == 0;
+}
+
+bool PrecompiledDefinitions::read(const std::string& filename)
+{
+    std::ifstream in(filename, std::ios::binary);
+    if (!in)
+    {
+        return false;
+    }
+    char file_magic[sizeof(magic)];
+    uint32_t file_format_version;
+    if (!in.read(file_magic, sizeof(file_magic)) || std::memcmp(file_magic, magic, sizeof(magic)) != 0
+        || !readValue(in, file_format_version) || file_format_version != format_version)
+    {
+        return false;
+    }
+
+    uint32_t count;
+    if (!readValue(in, count))
+    {
+        return false;
+    }
+    source_files.clear();
+    for (uint32_t source_file_idx = 0; source_file_idx < count; source_file_idx++)
+    {
+        source_files.emplace_back();
+        SourceFile& source_file = source_files.back();
+        if (!readString(in, source_file.path) || !readValue(in, source_file.modification_time) || !readValue(in, source_file.size))
+        {
+            return false;
+        }
+    }
+
+    if (!readValue(in, count))
+    {
+        return false;
+    }
+    inherited_ids.clear();
+    for (uint32_t inherited_idx = 0; inherited_idx < count; inherited_idx++)
+    {
+        inherited_ids.emplace_back();
+        if (!readString(in, inherited_ids.back()))
+        {
+            return false;
+        }
+    }
+
+    if (!readValue(in, count))
+    {
+        return false;
+    }
+    operations.clear(); // the counts aren't used to reserve memory, because they can't be trusted before the whole file is read
+    for (uint32_t operation_idx = 0; operation_idx < count; operation_idx++)
+    {
+        unsigned char type;
+        unsigned char flags;
+        if (!readValue(in, type) || type > static_cast<unsigned char>(DefinitionOperation::Type::SET_EXTRUDER_TRAIN_ID) || !readValue(in, flags))
+        {
+            return false;
+        }
+        operations.emplace_back(static_cast<DefinitionOperation::Type>(type), "");
+        DefinitionOperation& operation = operations.back();
+        operation.is_base_file = flags & IS_BASE_FILE;
+        operation.has_type = flags & HAS_TYPE;
+        operation.has_default = flags & HAS_DEFAULT;
+        operation.has_unit = flags & HAS_UNIT;
+        operation.has_unrecognized_default = flags & HAS_UNRECOGNIZED_DEFAULT;
+        if (!readValue(in, operation.extruder_nr)
+            || !readString(in, operation.key)
+            || !readString(in, operation.label)
+            || !readString(in, operation.setting_type)
+            || !readString(in, operation.default_value)
+            || !readString(in, operation.unit))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+}//namespace cura
@@ -0,0 +1,130 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef SETTINGS_PRECOMPILED_DEFINITIONS_H
+#define SETTINGS_PRECOMPILED_DEFINITIONS_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace cura
+{
+
+/*!
+ * A single step in loading a setting definition file into the SettingRegistry and a SettingsBase.
+ *
+ * Parsing a definition file and all the files it inherits from results in a list of these operations,
+ * which don't depend on the json documents anymore and can therefore be stored in a \ref PrecompiledDefinitions file.
+ */
+struct DefinitionOperation
+{
+    enum class Type : unsigned char
+    {
+        ADD_SEARCH_PATH, //!< Add \ref DefinitionOperation::key to the paths in which definition files are searched
+        SET_MACHINE_NAME, //!< Define the machine_name setting with \ref DefinitionOperation::key as value
+        REGISTER_KEY, //!< Register \ref DefinitionOperation::key without a setting config, e.g. for categories
+        DEFINE_SETTING, //!< Create the setting \ref DefinitionOperation::key if it doesn't exist yet, and load its values
+        OVERRIDE_SETTING, //!< Load the values of the existing setting \ref DefinitionOperation::key
+        SET_EXTRUDER_TRAIN_ID //!< Set the definition id of extruder train \ref DefinitionOperation::extruder_nr to \ref DefinitionOperation::key
+    };
+
+    Type type;
+    std::string key; //!< The setting key, or the parameter of the operation as described for its type
+    std::string label; //!< The human readable name of the setting (DEFINE_SETTING only)
+    bool is_base_file; //!< Whether the setting is defined in the base file, the one which doesn't inherit from any other file (DEFINE_SETTING only)
+    unsigned int extruder_nr; //!< The extruder train (SET_EXTRUDER_TRAIN_ID only)
+
+    bool has_type; //!< Whether the definition sets the type of the setting
+    std::string setting_type; //!< The type of the setting, if \ref DefinitionOperation::has_type
+    bool has_default; //!< Whether the definition sets the default value of the setting
+    std::string default_value; //!< The default value of the setting if \ref DefinitionOperation::has_default, or the json type of an unrecognized default value
+    bool has_unrecognized_default; //!< Whether the definition has a default value of a type which can't be converted to a setting value
+    bool has_unit; //!< Whether the definition sets the unit of the setting
+    std::string unit; //!< The unit of the setting, if \ref DefinitionOperation::has_unit
+
+    DefinitionOperation(Type type, std::string key);
+};
+
+/*!
+ * The result of parsing a setting definition file and all the files it inherits from, stored in a compact binary file next to the definition file.
+ *
+ * Loading such a file is much faster than parsing the json files, which matters when the engine is started for every single job.
+ * The file records the modification times and sizes of all json files it was made from and which files they inherit from,
+ * so that it is ignored when any of them has changed or an inherited file would be found elsewhere (see SettingRegistry::isUpToDate).
+ *
+ * The SettingRegistry also keeps the definitions of all json files it has loaded in memory, so that loading them again is fast as well.
+ */
+class PrecompiledDefinitions
+{
+public:
+    /*!
+     * A json file from which the definitions were made.
+     */
+    struct SourceFile
+    {
+        std::string path; //!< The filename of the json file
+        int64_t modification_time; //!< The modification time of the file when the definitions were made
+        int64_t size; //!< The size of the file in bytes when the definitions were made
+    };
+
+    std::vector<SourceFile> source_files; //!< The json files from which the definitions were made: the loaded file followed by the files it inherits from
+    std::vector<std::string> inherited_ids; //!< For each source file but the last, the id of the file it inherits from, which is the next source file
+    std::vector<DefinitionOperation> operations; //!< The operations which load the definitions
+
+    /*!
+     * Get the filename of the precompiled definitions of a definition file.
+     *
+     * \param json_filename The filename of the definition json file
+     * \return The filename of the precompiled definitions
+     */
+    static std::string getFilename(const std::string& json_filename)
+    {
+        return json_filename + ".bin";
+    }
+
+    /*!
+     * Record the current state of a json file from which the definitions are made.
+     *
+     * \param path The filename of the json file
+     * \return Whether the file exists
+     */
+    bool addSourceFile(const std::string& path);
+
+    /*!
+     * Check whether none of the json files from which the definitions were made have changed.
+     */
+    bool sourceFilesUnchanged() const;
+
+    /*!
+     * Write the definitions to a file.
+     *
+     * The file is written under a temporary name first, so that other processes never read a half written file.
+     *
+     * \param filename The file to write
+     * \return Whether the file was written successfully
+     */
+    bool write(const std::string& filename) const;
+
+    /*!
+     * Read definitions from a file.
+     *
+     * \param filename The file to read
+     * \return Whether the file exists and contains precompiled definitions of the current format
+     */
+    bool read(const std::string& filename);
+
+private:
+    static const char magic[8]; //!< The first bytes of every precompiled definitions file
+    static const uint32_t format_version = 2; //!< Increased whenever the format of the file changes
+
+    /*!
+     * Get the modification time and size of a file.
+     *
+     * \param path The filename of the file
+     * \param[out] result Where to store the state of the file
+     * \return Whether the file exists
+     */
+    static bool getFileState(const std::string& path, SourceFile& result);
+};
+
+}//namespace cura
+#endif//SETTINGS_PRECOMPILED_DEFINITIONS_H
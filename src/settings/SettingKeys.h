@@ -0,0 +1,340 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef SETTINGS_SETTING_KEYS_H
+#define SETTINGS_SETTING_KEYS_H
+
+namespace cura
+{
+
+/*!
+ * All setting keys which are read by the engine, in alphabetical order.
+ * 
+ * SETTING_KEYS(SETTING_KEY) expands to SETTING_KEY(key) for each key, from which the SettingKey enum and the names of the keys are generated.
+ * A setting which is newly read by the engine must be added here;
+ * a key which is misspelled in the code then fails to compile instead of being reported as an unregistered setting at runtime.
+ */
+#define SETTING_KEYS(SETTING_KEY) \
+    SETTING_KEY(acceleration_enabled) \
+    SETTING_KEY(acceleration_infill) \
+    SETTING_KEY(acceleration_prime_tower) \
+    SETTING_KEY(acceleration_print_layer_0) \
+    SETTING_KEY(acceleration_skirt_brim) \
+    SETTING_KEY(acceleration_support_infill) \
+    SETTING_KEY(acceleration_support_interface) \
+    SETTING_KEY(acceleration_topbottom) \
+    SETTING_KEY(acceleration_travel) \
+    SETTING_KEY(acceleration_travel_layer_0) \
+    SETTING_KEY(acceleration_wall_0) \
+    SETTING_KEY(acceleration_wall_x) \
+    SETTING_KEY(adhesion_extruder_nr) \
+    SETTING_KEY(adhesion_type) \
+    SETTING_KEY(alternate_extra_perimeter) \
+    SETTING_KEY(bottom_layers) \
+    SETTING_KEY(brim_line_count) \
+    SETTING_KEY(brim_outside_only) \
+    SETTING_KEY(center_object) \
+    SETTING_KEY(coasting_enable) \
+    SETTING_KEY(coasting_min_volume) \
+    SETTING_KEY(coasting_speed) \
+    SETTING_KEY(coasting_volume) \
+    SETTING_KEY(concentric_from_outline) \
+    SETTING_KEY(conical_overhang_angle) \
+    SETTING_KEY(conical_overhang_enabled) \
+    SETTING_KEY(cool_fan_full_layer) \
+    SETTING_KEY(cool_fan_speed_max) \
+    SETTING_KEY(cool_fan_speed_min) \
+    SETTING_KEY(cool_lift_head) \
+    SETTING_KEY(cool_min_layer_time) \
+    SETTING_KEY(cool_min_layer_time_fan_speed_max) \
+    SETTING_KEY(cool_min_speed) \
+    SETTING_KEY(draft_shield_dist) \
+    SETTING_KEY(draft_shield_enabled) \
+    SETTING_KEY(draft_shield_height) \
+    SETTING_KEY(draft_shield_height_limitation) \
+    SETTING_KEY(extruder_nr) \
+    SETTING_KEY(extruder_prime_pos_abs) \
+    SETTING_KEY(extruder_prime_pos_x) \
+    SETTING_KEY(extruder_prime_pos_y) \
+    SETTING_KEY(extruder_prime_pos_z) \
+    SETTING_KEY(gcode_flush_per_layer) \
+    SETTING_KEY(gradual_infill_step_height) \
+    SETTING_KEY(gradual_infill_steps) \
+    SETTING_KEY(infill_before_walls) \
+    SETTING_KEY(infill_line_distance) \
+    SETTING_KEY(infill_line_width) \
+    SETTING_KEY(infill_mesh) \
+    SETTING_KEY(infill_mesh_order) \
+    SETTING_KEY(infill_overlap_mm) \
+    SETTING_KEY(infill_pattern) \
+    SETTING_KEY(infill_sparse_thickness) \
+    SETTING_KEY(infill_wipe_dist) \
+    SETTING_KEY(jerk_enabled) \
+    SETTING_KEY(jerk_infill) \
+    SETTING_KEY(jerk_prime_tower) \
+    SETTING_KEY(jerk_print_layer_0) \
+    SETTING_KEY(jerk_skirt_brim) \
+    SETTING_KEY(jerk_support_infill) \
+    SETTING_KEY(jerk_support_interface) \
+    SETTING_KEY(jerk_topbottom) \
+    SETTING_KEY(jerk_travel) \
+    SETTING_KEY(jerk_travel_layer_0) \
+    SETTING_KEY(jerk_wall_0) \
+    SETTING_KEY(jerk_wall_x) \
+    SETTING_KEY(layer_0_z_overlap) \
+    SETTING_KEY(layer_data_compression) \
+    SETTING_KEY(layer_data_memory_budget) \
+    SETTING_KEY(layer_height) \
+    SETTING_KEY(layer_height_0) \
+    SETTING_KEY(layer_plan_buffer_size) \
+    SETTING_KEY(machine_acceleration) \
+    SETTING_KEY(machine_center_is_zero) \
+    SETTING_KEY(machine_depth) \
+    SETTING_KEY(machine_end_gcode) \
+    SETTING_KEY(machine_extruder_count) \
+    SETTING_KEY(machine_extruder_end_code) \
+    SETTING_KEY(machine_extruder_end_pos_abs) \
+    SETTING_KEY(machine_extruder_end_pos_x) \
+    SETTING_KEY(machine_extruder_end_pos_y) \
+    SETTING_KEY(machine_extruder_start_code) \
+    SETTING_KEY(machine_extruder_start_pos_abs) \
+    SETTING_KEY(machine_extruder_start_pos_x) \
+    SETTING_KEY(machine_extruder_start_pos_y) \
+    SETTING_KEY(machine_gcode_flavor) \
+    SETTING_KEY(machine_heated_bed) \
+    SETTING_KEY(machine_height) \
+    SETTING_KEY(machine_max_acceleration_e) \
+    SETTING_KEY(machine_max_acceleration_x) \
+    SETTING_KEY(machine_max_acceleration_y) \
+    SETTING_KEY(machine_max_acceleration_z) \
+    SETTING_KEY(machine_max_feedrate_e) \
+    SETTING_KEY(machine_max_feedrate_x) \
+    SETTING_KEY(machine_max_feedrate_y) \
+    SETTING_KEY(machine_max_feedrate_z) \
+    SETTING_KEY(machine_max_jerk_e) \
+    SETTING_KEY(machine_max_jerk_xy) \
+    SETTING_KEY(machine_max_jerk_z) \
+    SETTING_KEY(machine_min_cool_heat_time_window) \
+    SETTING_KEY(machine_minimum_feedrate) \
+    SETTING_KEY(machine_name) \
+    SETTING_KEY(machine_nozzle_cool_down_speed) \
+    SETTING_KEY(machine_nozzle_expansion_angle) \
+    SETTING_KEY(machine_nozzle_head_distance) \
+    SETTING_KEY(machine_nozzle_heat_up_speed) \
+    SETTING_KEY(machine_nozzle_offset_x) \
+    SETTING_KEY(machine_nozzle_offset_y) \
+    SETTING_KEY(machine_nozzle_size) \
+    SETTING_KEY(machine_nozzle_tip_outer_diameter) \
+    SETTING_KEY(machine_print_temp_wait) \
+    SETTING_KEY(machine_start_gcode) \
+    SETTING_KEY(machine_use_extruder_offset_to_offset_coords) \
+    SETTING_KEY(machine_width) \
+    SETTING_KEY(magic_fuzzy_skin_enabled) \
+    SETTING_KEY(magic_fuzzy_skin_point_dist) \
+    SETTING_KEY(magic_fuzzy_skin_thickness) \
+    SETTING_KEY(magic_mesh_surface_mode) \
+    SETTING_KEY(magic_spiralize) \
+    SETTING_KEY(material_bed_temp_prepend) \
+    SETTING_KEY(material_bed_temp_wait) \
+    SETTING_KEY(material_bed_temperature) \
+    SETTING_KEY(material_diameter) \
+    SETTING_KEY(material_extrusion_cool_down_speed) \
+    SETTING_KEY(material_flow) \
+    SETTING_KEY(material_flow_dependent_temperature) \
+    SETTING_KEY(material_flow_temp_graph) \
+    SETTING_KEY(material_guid) \
+    SETTING_KEY(material_print_temp_prepend) \
+    SETTING_KEY(material_print_temp_wait) \
+    SETTING_KEY(material_print_temperature) \
+    SETTING_KEY(material_standby_temperature) \
+    SETTING_KEY(max_feedrate_z_override) \
+    SETTING_KEY(memory_budget) \
+    SETTING_KEY(mesh_position_x) \
+    SETTING_KEY(mesh_position_y) \
+    SETTING_KEY(mesh_position_z) \
+    SETTING_KEY(meshfix_decimation_deviation) \
+    SETTING_KEY(meshfix_extensive_stitching) \
+    SETTING_KEY(meshfix_keep_open_polygons) \
+    SETTING_KEY(meshfix_maximum_deviation) \
+    SETTING_KEY(meshfix_union_all) \
+    SETTING_KEY(meshfix_union_all_remove_holes) \
+    SETTING_KEY(multiple_mesh_overlap) \
+    SETTING_KEY(ooze_shield_angle) \
+    SETTING_KEY(ooze_shield_dist) \
+    SETTING_KEY(ooze_shield_enabled) \
+    SETTING_KEY(pipeline_mesh_groups) \
+    SETTING_KEY(polygon_tiling_point_count) \
+    SETTING_KEY(preheat_accurate_time_estimates) \
+    SETTING_KEY(preview_layer_height) \
+    SETTING_KEY(preview_maximum_deviation) \
+    SETTING_KEY(prime_tower_dir_outward) \
+    SETTING_KEY(prime_tower_enable) \
+    SETTING_KEY(prime_tower_flow) \
+    SETTING_KEY(prime_tower_line_width) \
+    SETTING_KEY(prime_tower_position_x) \
+    SETTING_KEY(prime_tower_position_y) \
+    SETTING_KEY(prime_tower_size) \
+    SETTING_KEY(prime_tower_wipe_enabled) \
+    SETTING_KEY(raft_airgap) \
+    SETTING_KEY(raft_base_acceleration) \
+    SETTING_KEY(raft_base_fan_speed) \
+    SETTING_KEY(raft_base_jerk) \
+    SETTING_KEY(raft_base_line_spacing) \
+    SETTING_KEY(raft_base_line_width) \
+    SETTING_KEY(raft_base_speed) \
+    SETTING_KEY(raft_base_thickness) \
+    SETTING_KEY(raft_interface_acceleration) \
+    SETTING_KEY(raft_interface_fan_speed) \
+    SETTING_KEY(raft_interface_jerk) \
+    SETTING_KEY(raft_interface_line_spacing) \
+    SETTING_KEY(raft_interface_line_width) \
+    SETTING_KEY(raft_interface_speed) \
+    SETTING_KEY(raft_interface_thickness) \
+    SETTING_KEY(raft_margin) \
+    SETTING_KEY(raft_surface_acceleration) \
+    SETTING_KEY(raft_surface_fan_speed) \
+    SETTING_KEY(raft_surface_jerk) \
+    SETTING_KEY(raft_surface_layers) \
+    SETTING_KEY(raft_surface_line_spacing) \
+    SETTING_KEY(raft_surface_line_width) \
+    SETTING_KEY(raft_surface_speed) \
+    SETTING_KEY(raft_surface_thickness) \
+    SETTING_KEY(retraction_amount) \
+    SETTING_KEY(retraction_combing) \
+    SETTING_KEY(retraction_count_max) \
+    SETTING_KEY(retraction_enable) \
+    SETTING_KEY(retraction_extra_prime_amount) \
+    SETTING_KEY(retraction_extrusion_window) \
+    SETTING_KEY(retraction_hop) \
+    SETTING_KEY(retraction_hop_after_extruder_switch) \
+    SETTING_KEY(retraction_hop_enabled) \
+    SETTING_KEY(retraction_hop_only_when_collides) \
+    SETTING_KEY(retraction_min_travel) \
+    SETTING_KEY(retraction_prime_speed) \
+    SETTING_KEY(retraction_retract_speed) \
+    SETTING_KEY(skin_alternate_rotation) \
+    SETTING_KEY(skin_line_width) \
+    SETTING_KEY(skin_no_small_gaps_heuristic) \
+    SETTING_KEY(skin_outline_count) \
+    SETTING_KEY(skin_overlap_mm) \
+    SETTING_KEY(skirt_brim_line_width) \
+    SETTING_KEY(skirt_brim_minimal_length) \
+    SETTING_KEY(skirt_brim_speed) \
+    SETTING_KEY(skirt_gap) \
+    SETTING_KEY(skirt_line_count) \
+    SETTING_KEY(slicing_copy_prismatic_layers) \
+    SETTING_KEY(slicing_thread_count) \
+    SETTING_KEY(slicing_thread_pinning) \
+    SETTING_KEY(speed_equalize_flow_enabled) \
+    SETTING_KEY(speed_equalize_flow_max) \
+    SETTING_KEY(speed_infill) \
+    SETTING_KEY(speed_prime_tower) \
+    SETTING_KEY(speed_print_layer_0) \
+    SETTING_KEY(speed_slowdown_layers) \
+    SETTING_KEY(speed_support_infill) \
+    SETTING_KEY(speed_support_interface) \
+    SETTING_KEY(speed_topbottom) \
+    SETTING_KEY(speed_travel) \
+    SETTING_KEY(speed_travel_layer_0) \
+    SETTING_KEY(speed_wall_0) \
+    SETTING_KEY(speed_wall_x) \
+    SETTING_KEY(support_angle) \
+    SETTING_KEY(support_area_smoothing) \
+    SETTING_KEY(support_bottom_distance) \
+    SETTING_KEY(support_bottom_height) \
+    SETTING_KEY(support_bottom_stair_step_height) \
+    SETTING_KEY(support_conical_angle) \
+    SETTING_KEY(support_conical_enabled) \
+    SETTING_KEY(support_conical_min_width) \
+    SETTING_KEY(support_connect_zigzags) \
+    SETTING_KEY(support_enable) \
+    SETTING_KEY(support_extruder_nr_layer_0) \
+    SETTING_KEY(support_infill_extruder_nr) \
+    SETTING_KEY(support_interface_enable) \
+    SETTING_KEY(support_interface_extruder_nr) \
+    SETTING_KEY(support_interface_line_distance) \
+    SETTING_KEY(support_interface_line_width) \
+    SETTING_KEY(support_interface_pattern) \
+    SETTING_KEY(support_join_distance) \
+    SETTING_KEY(support_line_distance) \
+    SETTING_KEY(support_line_width) \
+    SETTING_KEY(support_minimal_diameter) \
+    SETTING_KEY(support_offset) \
+    SETTING_KEY(support_pattern) \
+    SETTING_KEY(support_raster_resolution) \
+    SETTING_KEY(support_roof_height) \
+    SETTING_KEY(support_top_distance) \
+    SETTING_KEY(support_tower_diameter) \
+    SETTING_KEY(support_tower_roof_angle) \
+    SETTING_KEY(support_type) \
+    SETTING_KEY(support_xy_distance) \
+    SETTING_KEY(support_xy_distance_overhang) \
+    SETTING_KEY(support_xy_overrides_z) \
+    SETTING_KEY(switch_extruder_prime_speed) \
+    SETTING_KEY(switch_extruder_retraction_amount) \
+    SETTING_KEY(switch_extruder_retraction_speed) \
+    SETTING_KEY(top_bottom_pattern) \
+    SETTING_KEY(top_layers) \
+    SETTING_KEY(travel_avoid_distance) \
+    SETTING_KEY(travel_avoid_other_parts) \
+    SETTING_KEY(travel_comb_shortest_paths) \
+    SETTING_KEY(travel_compensate_overlapping_walls_0_enabled) \
+    SETTING_KEY(travel_compensate_overlapping_walls_x_enabled) \
+    SETTING_KEY(wall_0_inset) \
+    SETTING_KEY(wall_insets_from_outline) \
+    SETTING_KEY(wall_line_count) \
+    SETTING_KEY(wall_line_width_0) \
+    SETTING_KEY(wall_line_width_x) \
+    SETTING_KEY(wireframe_bottom_delay) \
+    SETTING_KEY(wireframe_drag_along) \
+    SETTING_KEY(wireframe_enabled) \
+    SETTING_KEY(wireframe_fall_down) \
+    SETTING_KEY(wireframe_flat_delay) \
+    SETTING_KEY(wireframe_flow_connection) \
+    SETTING_KEY(wireframe_flow_flat) \
+    SETTING_KEY(wireframe_height) \
+    SETTING_KEY(wireframe_nozzle_clearance) \
+    SETTING_KEY(wireframe_printspeed_bottom) \
+    SETTING_KEY(wireframe_printspeed_down) \
+    SETTING_KEY(wireframe_printspeed_flat) \
+    SETTING_KEY(wireframe_printspeed_up) \
+    SETTING_KEY(wireframe_roof_drag_along) \
+    SETTING_KEY(wireframe_roof_fall_down) \
+    SETTING_KEY(wireframe_roof_inset) \
+    SETTING_KEY(wireframe_roof_outer_delay) \
+    SETTING_KEY(wireframe_straight_before_down) \
+    SETTING_KEY(wireframe_strategy) \
+    SETTING_KEY(wireframe_top_delay) \
+    SETTING_KEY(wireframe_top_jump) \
+    SETTING_KEY(wireframe_up_half_speed) \
+    SETTING_KEY(xy_offset) \
+    SETTING_KEY(z_seam_type)
+
+/*!
+ * The key of a setting which is read by the engine, known at compile time.
+ * 
+ * The SettingRegistry reserves the first setting indices for these keys in this order,
+ * so that the value of a SettingKey is also the index of the setting in a SettingsCache and can be looked up without hashing the key.
+ */
+enum class SettingKey : unsigned int
+{
+#define SETTING_KEY_ENUM_VALUE(key) key,
+    SETTING_KEYS(SETTING_KEY_ENUM_VALUE)
+#undef SETTING_KEY_ENUM_VALUE
+};
+
+#define SETTING_KEY_PLUS_ONE(key) + 1
+constexpr unsigned int setting_key_count = 0 SETTING_KEYS(SETTING_KEY_PLUS_ONE); //!< The number of values of SettingKey
+#undef SETTING_KEY_PLUS_ONE
+
+/*!
+ * Get the key of a setting as it occurs in the settings json files.
+ */
+inline const char* toString(SettingKey key)
+{
+#define SETTING_KEY_NAME(key) #key,
+    static const char* const names[] = { SETTING_KEYS(SETTING_KEY_NAME) };
+#undef SETTING_KEY_NAME
+    return names[static_cast<unsigned int>(key)];
+}
+
+}//namespace cura
+#endif//SETTINGS_SETTING_KEYS_H
@@ -4,9 +4,10 @@
 #include <sstream>
 #include <iostream> // debug IO
 #include <libgen.h> // dirname
+#include <stdlib.h> // realpath
 #include <string>
 #include <cstring> // strtok (split string using delimiters) strcpy
-#include <fstream> // ifstream (to see if file exists)
+#include <sys/stat.h> // stat (to see if file exists)
 
 #include "rapidjson/rapidjson.h"
 #include "rapidjson/document.h"
@@ -19,6 +20,26 @@ namespace cura
     
 SettingRegistry SettingRegistry::instance; // define settingRegistry
 
+const std::string* SettingRegistry::getEngineSettingDefault(const std::string& key)
+{
+    // the same defaults as in command_line_settings.def.json
+    static const std::unordered_map<std::string, std::string> engine_setting_defaults = {
+        { "concentric_from_outline", "false" },
+        { "gcode_flush_per_layer", "false" },
+        { "meshfix_maximum_deviation", "0" },
+        { "slicing_copy_prismatic_layers", "false" },
+        { "support_raster_resolution", "0" },
+        { "travel_comb_shortest_paths", "false" },
+        { "wall_insets_from_outline", "false" },
+    };
+    auto default_it = engine_setting_defaults.find(key);
+    if (default_it == engine_setting_defaults.end())
+    {
+        return nullptr;
+    }
+    return &default_it->second;
+}
+
 std::string SettingRegistry::toString(rapidjson::Type type)
 {
     switch (type)
@@ -57,6 +78,14 @@ SettingConfig* SettingRegistry::getSettingConfig(std::string key) const
 SettingRegistry::SettingRegistry()
 : setting_definitions("settings", "Settings")
 {
+    // reserve the first setting indices for the compile time keys, so that the value of a SettingKey is the index of its setting
+    for (unsigned int setting_idx = 0; setting_idx < setting_key_count; setting_idx++)
+    {
+        const std::string key = cura::toString(static_cast<SettingKey>(setting_idx));
+        setting_key_to_index.emplace(key, setting_idx);
+        setting_keys.push_back(key);
+    }
+
     // load search paths from environment variable CURA_ENGINE_SEARCH_PATH
     char* paths = getenv("CURA_ENGINE_SEARCH_PATH");
     if (paths)
@@ -98,20 +127,60 @@ int SettingRegistry::loadJSON(std::string filename, rapidjson::Document& json_do
 
 /*!
  * Check whether a file exists.
- * from https://techoverflow.net/blog/2013/01/11/cpp-check-if-file-exists/
+ * 
+ * The file isn't opened, since the definition files are looked up again each time an extruder train is loaded from memory,
+ * and opening a file costs a round trip to the server on a network file system where a cached stat doesn't.
  * 
  * \param filename The path to a filename to check if it exists
  * \return Whether the file exists.
  */
 bool fexists(const char *filename)
 {
-    std::ifstream ifile(filename);
-    return (bool)ifile;
+    struct stat file_stat;
+    return stat(filename, &file_stat) == 0 && !S_ISDIR(file_stat.st_mode);
+}
+
+/*!
+ * Get the absolute path of a file, so that files are identified in the same way regardless of the working directory.
+ * 
+ * \param filename The (relative) path of a file
+ * \return The absolute path, or \p filename if it couldn't be determined
+ */
+std::string getAbsolutePath(const std::string& filename)
+{
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+    char* absolute_path = realpath(filename.c_str(), nullptr);
+    if (absolute_path)
+    {
+        std::string result(absolute_path);
+        free(absolute_path);
+        return result;
+    }
+#endif
+    return filename;
+}
+
+/*!
+ * Get the folder which contains a file.
+ * 
+ * \param filename The path of a file
+ * \return The folder part of \p filename
+ */
+std::string getFolder(const std::string& filename)
+{
+    std::vector<char> filename_cstr(filename.begin(), filename.end());
+    filename_cstr.push_back('\0'); // copy the string because dirname(.) changes the input string!!!
+    return std::string(dirname(filename_cstr.data()));
 }
 
 bool SettingRegistry::getDefinitionFile(const std::string machine_id, std::string& result)
 {
-    for (const std::string& search_path : search_paths)
+    return findDefinitionFile(search_paths, machine_id, result);
+}
+
+bool SettingRegistry::findDefinitionFile(const std::unordered_set<std::string>& paths, const std::string& machine_id, std::string& result)
+{
+    for (const std::string& search_path : paths)
     {
         result = search_path + std::string("/") + machine_id + std::string(".def.json");
         if (fexists(result.c_str()))
@@ -122,6 +191,26 @@ bool SettingRegistry::getDefinitionFile(const std::string machine_id, std::strin
     return false;
 }
 
+bool SettingRegistry::isUpToDate(const PrecompiledDefinitions& definitions) const
+{
+    if (definitions.source_files.size() != definitions.inherited_ids.size() + 1 || !definitions.sourceFilesUnchanged())
+    {
+        return false;
+    }
+    // search the inherited files in the same way as parsing would do now, including the folders which are added to the search paths along the way
+    std::unordered_set<std::string> paths = search_paths;
+    for (unsigned int file_idx = 0; file_idx < definitions.inherited_ids.size(); file_idx++)
+    {
+        paths.emplace(getFolder(definitions.source_files[file_idx].path));
+        std::string inherited_file;
+        if (!findDefinitionFile(paths, definitions.inherited_ids[file_idx], inherited_file) || getAbsolutePath(inherited_file) != definitions.source_files[file_idx + 1].path)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
 
 int SettingRegistry::loadExtruderJSONsettings(unsigned int extruder_nr, SettingsBase* settings_base)
 {
@@ -141,21 +230,123 @@ int SettingRegistry::loadExtruderJSONsettings(unsigned int extruder_nr, Settings
 }
 
 int SettingRegistry::loadJSONsettings(std::string filename, SettingsBase* settings_base, bool warn_base_file_duplicates)
+{
+    const std::string absolute_filename = getAbsolutePath(filename);
+    auto loaded = loaded_definitions.find(absolute_filename);
+    if (loaded != loaded_definitions.end() && isUpToDate(loaded->second))
+    {
+        log("Loading %s from memory...\n", filename.c_str());
+        bool warn_duplicates = false; // the settings were already defined when the file was loaded before
+        applyDefinitionOperations(loaded->second.operations, settings_base, warn_duplicates);
+        return 0;
+    }
+
+    PrecompiledDefinitions definitions;
+    if (definitions.read(PrecompiledDefinitions::getFilename(filename)) && isUpToDate(definitions))
+    {
+        log("Loading %s from precompiled definitions...\n", filename.c_str());
+        applyDefinitionOperations(definitions.operations, settings_base, warn_base_file_duplicates);
+        loaded_definitions[absolute_filename] = std::move(definitions);
+        return 0;
+    }
+
+    definitions = PrecompiledDefinitions();
+    int err = parseJSONsettings(filename, definitions);
+    applyDefinitionOperations(definitions.operations, settings_base, warn_base_file_duplicates); // also when parsing failed halfway, so that the files loaded before the error are still used
+    if (!err)
+    {
+        loaded_definitions[absolute_filename] = std::move(definitions);
+    }
+    return err;
+}
+
+int SettingRegistry::precompileJSONsettings(std::string filename, SettingsBase* settings_base)
+{
+    int err = precompileDefinitionFile(filename, settings_base, true);
+    if (err)
+    {
+        return err;
+    }
+    // precompile the extruder trains in the same order as they are loaded when slicing, so that their inherited files are found in the same folders
+    for (unsigned int extruder_nr = 0; extruder_nr < extruder_train_ids.size(); extruder_nr++)
+    {
+        std::string definition_file;
+        if (!getDefinitionFile(extruder_train_ids[extruder_nr], definition_file))
+        {
+            continue;
+        }
+        SettingsBase extruder_train_settings;
+        err = precompileDefinitionFile(definition_file, &extruder_train_settings, false);
+        if (err)
+        {
+            return err;
+        }
+    }
+    return 0;
+}
+
+int SettingRegistry::precompileDefinitionFile(std::string filename, SettingsBase* settings_base, bool warn_base_file_duplicates)
+{
+    PrecompiledDefinitions definitions;
+    int err = parseJSONsettings(filename, definitions);
+    applyDefinitionOperations(definitions.operations, settings_base, warn_base_file_duplicates);
+    if (err)
+    {
+        return err;
+    }
+    const std::string precompiled_filename = PrecompiledDefinitions::getFilename(filename);
+    if (!definitions.write(precompiled_filename))
+    {
+        cura::logError("Couldn't write precompiled definitions to %s\n", precompiled_filename.c_str());
+        return -1;
+    }
+    log("Written precompiled definitions to %s\n", precompiled_filename.c_str());
+    return 0;
+}
+
+int SettingRegistry::parseJSONsettings(std::string filename, PrecompiledDefinitions& definitions)
 {
     rapidjson::Document json_document;
     
+    filename = getAbsolutePath(filename); // so that the search paths and source files don't depend on the working directory
     log("Loading %s...\n", filename.c_str());
 
+    if (!definitions.addSourceFile(filename)) // recorded before reading, so that a change while reading makes the definitions outdated
+    {
+        cura::logError("Couldn't open JSON file.\n");
+        return 1;
+    }
     int err = loadJSON(filename, json_document);
     if (err) { return err; }
 
     { // add parent folder to search paths
-        char filename_cstr[filename.size()];
-        std::strcpy(filename_cstr, filename.c_str()); // copy the string because dirname(.) changes the input string!!!
-        std::string folder_name = std::string(dirname(filename_cstr));
+        std::string folder_name = getFolder(filename);
         search_paths.emplace(folder_name);
+        definitions.operations.emplace_back(DefinitionOperation::Type::ADD_SEARCH_PATH, folder_name);
+    }
+
+    return parseJSONdefinition(json_document, definitions);
+}
+
+int SettingRegistry::loadJSONsettingsFromMemory(const char* json, size_t size, SettingsBase* settings_base)
+{
+    const std::string json_text(json, size); // rapidjson needs a null terminated string
+    rapidjson::Document json_document;
+    json_document.Parse(json_text.c_str());
+    if (json_document.HasParseError())
+    {
+        cura::logError("Error parsing JSON(offset %u): %s\n", (unsigned)json_document.GetErrorOffset(), GetParseError_En(json_document.GetParseError()));
+        return 2;
     }
+    PrecompiledDefinitions definitions;
+    int err = parseJSONdefinition(json_document, definitions);
+    applyDefinitionOperations(definitions.operations, settings_base, true);
+    return err;
+}
 
+int SettingRegistry::parseJSONdefinition(rapidjson::Document& json_document, PrecompiledDefinitions& definitions)
+{
+    int err = 0;
     if (json_document.HasMember("inherits") && json_document["inherits"].IsString())
     {
         std::string child_filename;
@@ -165,16 +356,17 @@ int SettingRegistry::loadJSONsettings(std::string filename, SettingsBase* settin
             cura::logError("Inherited JSON file \"%s\" not found\n", json_document["inherits"].GetString());
             return -1;
         }
-        err = loadJSONsettings(child_filename, settings_base, warn_base_file_duplicates); // load child first
+        definitions.inherited_ids.push_back(json_document["inherits"].GetString());
+        err = parseJSONsettings(child_filename, definitions); // load child first
         if (err)
         {
             return err;
         }
-        err = loadJSONsettingsFromDoc(json_document, settings_base, false);
+        err = parseJSONsettingsFromDoc(json_document, definitions.operations, false);
     }
     else 
     {
-        err = loadJSONsettingsFromDoc(json_document, settings_base, warn_base_file_duplicates);
+        err = parseJSONsettingsFromDoc(json_document, definitions.operations, true);
     }
 
     if (json_document.HasMember("metadata") && json_document["metadata"].IsObject())
@@ -195,12 +387,8 @@ int SettingRegistry::loadJSONsettings(std::string filename, SettingsBase* settin
                 {
                     continue;
                 }
-                const char* id = json_id.GetString();
-                if (extruder_train_nr >= (int) extruder_train_ids.size())
-                {
-                    extruder_train_ids.resize(extruder_train_nr + 1);
-                }
-                extruder_train_ids[extruder_train_nr] = std::string(id);
+                definitions.operations.emplace_back(DefinitionOperation::Type::SET_EXTRUDER_TRAIN_ID, json_id.GetString());
+                definitions.operations.back().extruder_nr = extruder_train_nr;
             }
         }
     }
@@ -208,7 +396,7 @@ int SettingRegistry::loadJSONsettings(std::string filename, SettingsBase* settin
     return err;
 }
 
-int SettingRegistry::loadJSONsettingsFromDoc(rapidjson::Document& json_document, SettingsBase* settings_base, bool warn_duplicates)
+int SettingRegistry::parseJSONsettingsFromDoc(rapidjson::Document& json_document, std::vector<DefinitionOperation>& operations, bool is_base_file)
 {
     
     if (!json_document.IsObject())
@@ -227,16 +415,13 @@ int SettingRegistry::loadJSONsettingsFromDoc(rapidjson::Document& json_document,
                 machine_name = machine_name_field.GetString();
             }
         }
-        SettingConfig& machine_name_setting = addSetting("machine_name", "Machine Name");
-        machine_name_setting.setDefault(machine_name);
-        machine_name_setting.setType("string");
-        settings_base->_setSetting(machine_name_setting.getKey(), machine_name_setting.getDefaultValue());
+        operations.emplace_back(DefinitionOperation::Type::SET_MACHINE_NAME, machine_name);
     }
 
     if (json_document.HasMember("settings"))
     {
         std::list<std::string> path;
-        handleChildren(json_document["settings"], path, settings_base, warn_duplicates);
+        handleChildren(json_document["settings"], path, operations, is_base_file);
     }
     
     if (json_document.HasMember("overrides"))
@@ -244,21 +429,15 @@ int SettingRegistry::loadJSONsettingsFromDoc(rapidjson::Document& json_document,
         const rapidjson::Value& json_object_container = json_document["overrides"];
         for (rapidjson::Value::ConstMemberIterator override_iterator = json_object_container.MemberBegin(); override_iterator != json_object_container.MemberEnd(); ++override_iterator)
         {
-            std::string setting = override_iterator->name.GetString();
-            SettingConfig* conf = getSettingConfig(setting);
-            if (!conf) //Setting could not be found.
-            {
-                logWarning("Trying to override unknown setting %s.\n", setting.c_str());
-                continue;
-            }
-            _loadSettingValues(conf, override_iterator, settings_base);
+            operations.emplace_back(DefinitionOperation::Type::OVERRIDE_SETTING, override_iterator->name.GetString());
+            _loadSettingValues(operations.back(), override_iterator);
         }
     }
     
     return 0;
 }
 
-void SettingRegistry::handleChildren(const rapidjson::Value& settings_list, std::list<std::string>& path, SettingsBase* settings_base, bool warn_duplicates)
+void SettingRegistry::handleChildren(const rapidjson::Value& settings_list, std::list<std::string>& path, std::vector<DefinitionOperation>& operations, bool is_base_file)
 {
     if (!settings_list.IsObject())
     {
@@ -267,12 +446,12 @@ void SettingRegistry::handleChildren(const rapidjson::Value& settings_list, std:
     }
     for (rapidjson::Value::ConstMemberIterator setting_iterator = settings_list.MemberBegin(); setting_iterator != settings_list.MemberEnd(); ++setting_iterator)
     {
-        handleSetting(setting_iterator, path, settings_base, warn_duplicates);
+        handleSetting(setting_iterator, path, operations, is_base_file);
         if (setting_iterator->value.HasMember("children"))
         {
             std::list<std::string> path_here = path;
             path_here.push_back(setting_iterator->name.GetString());
-            handleChildren(setting_iterator->value["children"], path_here, settings_base, warn_duplicates);
+            handleChildren(setting_iterator->value["children"], path_here, operations, is_base_file);
         }
     }
 }
@@ -290,7 +469,7 @@ bool SettingRegistry::settingIsUsedByEngine(const rapidjson::Value& setting)
 }
 
 
-void SettingRegistry::handleSetting(const rapidjson::Value::ConstMemberIterator& json_setting_it, std::list<std::string>& path, SettingsBase* settings_base, bool warn_duplicates)
+void SettingRegistry::handleSetting(const rapidjson::Value::ConstMemberIterator& json_setting_it, std::list<std::string>& path, std::vector<DefinitionOperation>& operations, bool is_base_file)
 {
     const rapidjson::Value& json_setting = json_setting_it->value;
     if (!json_setting.IsObject())
@@ -301,7 +480,7 @@ void SettingRegistry::handleSetting(const rapidjson::Value::ConstMemberIterator&
     std::string name = json_setting_it->name.GetString();
     if (json_setting.HasMember("type") && json_setting["type"].IsString() && json_setting["type"].GetString() == std::string("category"))
     { // skip category objects
-        setting_key_to_config[name] = nullptr; // add the category name to the mapping, but don't instantiate a setting config for it.
+        operations.emplace_back(DefinitionOperation::Type::REGISTER_KEY, name); // add the category name to the mapping, but don't instantiate a setting config for it.
         return;
     }
     if (settingIsUsedByEngine(json_setting))
@@ -311,22 +490,71 @@ void SettingRegistry::handleSetting(const rapidjson::Value::ConstMemberIterator&
             logError("ERROR: json setting \"%s\" has no label!\n", name.c_str());
             return;
         }
-        std::string label = json_setting["label"].GetString();
-        
-        SettingConfig* setting = getSettingConfig(name);
-        if (warn_duplicates && setting)
-        {
-            cura::logError("Duplicate definition of setting: %s a.k.a. \"%s\" was already claimed by \"%s\"\n", name.c_str(), label.c_str(), getSettingConfig(name)->getLabel().c_str());
-        }
-        if (!setting)
-        {
-            setting = &addSetting(name, label);
-        }
-        _loadSettingValues(setting, json_setting_it, settings_base);
+        operations.emplace_back(DefinitionOperation::Type::DEFINE_SETTING, name);
+        DefinitionOperation& operation = operations.back();
+        operation.label = json_setting["label"].GetString();
+        operation.is_base_file = is_base_file;
+        _loadSettingValues(operation, json_setting_it);
     }
     else
     {
-        setting_key_to_config[name] = nullptr; // add the setting name to the mapping, but don't instantiate a setting config for it.
+        operations.emplace_back(DefinitionOperation::Type::REGISTER_KEY, name); // add the setting name to the mapping, but don't instantiate a setting config for it.
+    }
+}
+
+void SettingRegistry::applyDefinitionOperations(const std::vector<DefinitionOperation>& operations, SettingsBase* settings_base, bool warn_base_file_duplicates)
+{
+    for (const DefinitionOperation& operation : operations)
+    {
+        switch (operation.type)
+        {
+            case DefinitionOperation::Type::ADD_SEARCH_PATH:
+                search_paths.emplace(operation.key);
+                break;
+            case DefinitionOperation::Type::SET_MACHINE_NAME:
+            {
+                SettingConfig& machine_name_setting = addSetting("machine_name", "Machine Name");
+                machine_name_setting.setDefault(operation.key);
+                machine_name_setting.setType("string");
+                settings_base->_setSetting(machine_name_setting.getKey(), machine_name_setting.getDefaultValue());
+                break;
+            }
+            case DefinitionOperation::Type::REGISTER_KEY:
+                registerSettingKey(operation.key, nullptr);
+                break;
+            case DefinitionOperation::Type::DEFINE_SETTING:
+            {
+                SettingConfig* setting = getSettingConfig(operation.key);
+                if (warn_base_file_duplicates && operation.is_base_file && setting)
+                {
+                    cura::logError("Duplicate definition of setting: %s a.k.a. \"%s\" was already claimed by \"%s\"\n", operation.key.c_str(), operation.label.c_str(), setting->getLabel().c_str());
+                }
+                if (!setting)
+                {
+                    setting = &addSetting(operation.key, operation.label);
+                }
+                _applySettingValues(setting, operation, settings_base);
+                break;
+            }
+            case DefinitionOperation::Type::OVERRIDE_SETTING:
+            {
+                SettingConfig* setting = getSettingConfig(operation.key);
+                if (!setting) //Setting could not be found.
+                {
+                    logWarning("Trying to override unknown setting %s.\n", operation.key.c_str());
+                    break;
+                }
+                _applySettingValues(setting, operation, settings_base);
+                break;
+            }
+            case DefinitionOperation::Type::SET_EXTRUDER_TRAIN_ID:
+                if (operation.extruder_nr >= extruder_train_ids.size())
+                {
+                    extruder_train_ids.resize(operation.extruder_nr + 1);
+                }
+                extruder_train_ids[operation.extruder_nr] = operation.key;
+                break;
+        }
     }
 }
 
@@ -334,62 +562,99 @@ SettingConfig& SettingRegistry::addSetting(std::string name, std::string label)
 {
     SettingConfig* config = setting_definitions.addChild(name, label);
 
-    setting_key_to_config[name] = config;
+    registerSettingKey(name, config);
 
     return *config;
 }
 
-void SettingRegistry::loadDefault(const rapidjson::GenericValue< rapidjson::UTF8< char > >::ConstMemberIterator& json_object_it, SettingConfig* config)
+void SettingRegistry::registerSettingKey(const std::string& name, SettingConfig* config)
+{
+    setting_key_to_config[name] = config;
+    if (setting_key_to_index.emplace(name, setting_keys.size()).second)
+    {
+        setting_keys.push_back(name);
+        SettingsCache::invalidateAll(); // caches don't have a value for the new setting yet
+    }
+}
+
+void SettingRegistry::loadDefault(const rapidjson::GenericValue< rapidjson::UTF8< char > >::ConstMemberIterator& json_object_it, DefinitionOperation& operation)
 {
     const rapidjson::Value& setting_content = json_object_it->value;
     if (setting_content.HasMember("default_value"))
     {
         const rapidjson::Value& dflt = setting_content["default_value"];
+        operation.has_default = true;
         if (dflt.IsString())
         {
-            config->setDefault(dflt.GetString());
+            operation.default_value = dflt.GetString();
         }
         else if (dflt.IsTrue())
         {
-            config->setDefault("true");
+            operation.default_value = "true";
         }
         else if (dflt.IsFalse())
         {
-            config->setDefault("false");
+            operation.default_value = "false";
         }
         else if (dflt.IsNumber())
         {
             std::ostringstream ss;
             ss << dflt.GetDouble();
-            config->setDefault(ss.str());
+            operation.default_value = ss.str();
         } // arrays are ignored because machine_extruder_trains needs to be handled separately
         else 
-        {
-            logWarning("WARNING: Unrecognized data type in JSON: %s has type %s\n", json_object_it->name.GetString(), toString(dflt.GetType()).c_str());
+        { // only reported when the values are applied, because the default of a polygon setting is ignored anyway
+            operation.has_default = false;
+            operation.has_unrecognized_default = true;
+            operation.default_value = toString(dflt.GetType());
         }
     }
 }
 
 
-void SettingRegistry::_loadSettingValues(SettingConfig* config, const rapidjson::GenericValue< rapidjson::UTF8< char > >::ConstMemberIterator& json_object_it, SettingsBase* settings_base)
+void SettingRegistry::_loadSettingValues(DefinitionOperation& operation, const rapidjson::GenericValue< rapidjson::UTF8< char > >::ConstMemberIterator& json_object_it)
 {
     const rapidjson::Value& data = json_object_it->value;
-    /// Fill the setting config object with data we have in the json file.
+    /// Fill the operation with data we have in the json file.
     if (data.HasMember("type") && data["type"].IsString())
     {
-        config->setType(data["type"].GetString());
+        operation.has_type = true;
+        operation.setting_type = data["type"].GetString();
+    }
+
+    loadDefault(json_object_it, operation);
+
+    if (data.HasMember("unit") && data["unit"].IsString())
+    {
+        operation.has_unit = true;
+        operation.unit = data["unit"].GetString();
+    }
+}
+
+void SettingRegistry::_applySettingValues(SettingConfig* config, const DefinitionOperation& operation, SettingsBase* settings_base)
+{
+    if (operation.has_type)
+    {
+        config->setType(operation.setting_type);
     }
     if (config->getType() == std::string("polygon") || config->getType() == std::string("polygons"))
     { // skip polygon settings : not implemented yet and not used yet (TODO)
-//         logWarning("WARNING: Loading polygon setting %s not implemented...\n", json_object_it->name.GetString());
+//         logWarning("WARNING: Loading polygon setting %s not implemented...\n", operation.key.c_str());
         return;
     }
 
-    loadDefault(json_object_it, config);
+    if (operation.has_default)
+    {
+        config->setDefault(operation.default_value);
+    }
+    else if (operation.has_unrecognized_default)
+    {
+        logWarning("WARNING: Unrecognized data type in JSON: %s has type %s\n", operation.key.c_str(), operation.default_value.c_str());
+    }
 
-    if (data.HasMember("unit") && data["unit"].IsString())
+    if (operation.has_unit)
     {
-        config->setUnit(data["unit"].GetString());
+        config->setUnit(operation.unit);
     }
 
     settings_base->_setSetting(config->getKey(), config->getDefaultValue());
@@ -11,6 +11,7 @@
 
 #include "SettingConfig.h"
 #include "SettingContainer.h"
+#include "PrecompiledDefinitions.h"
 
 #include "../utils/NoCopy.h"
 #include "rapidjson/document.h"
@@ -33,12 +34,16 @@ private:
     SettingRegistry();
     
     std::unordered_map<std::string, SettingConfig*> setting_key_to_config; //!< Mapping from setting keys to their configurations
+    std::unordered_map<std::string, unsigned int> setting_key_to_index; //!< Mapping from setting keys to their index in \ref SettingRegistry::setting_keys
+    std::vector<std::string> setting_keys; //!< All keys of SettingKey followed by all other keys in \ref SettingRegistry::setting_key_to_config, in the order in which they were registered
 
     SettingContainer setting_definitions; //!< All setting configurations (A flat list)
     
     std::vector<std::string> extruder_train_ids; //!< The internal id's of each extruder (the filename without the extension)
 
     std::unordered_set<std::string> search_paths; //!< The paths to search for json files.
+
+    std::unordered_map<std::string, PrecompiledDefinitions> loaded_definitions; //!< The json files loaded so far by their absolute path, so that loading them again doesn't need to parse them
 public:
     /*!
      * Get the SettingRegistry.
@@ -64,6 +69,42 @@ public:
      * \return the setting definition values
      */
     SettingConfig* getSettingConfig(std::string key) const;
+
+    /*!
+     * Get the index of a setting, which is used to look up its value in a SettingsCache.
+     * 
+     * \param key The internal key for the setting
+     * \return The index of the setting, or -1 if it isn't registered
+     */
+    int getSettingIndex(const std::string& key) const
+    {
+        auto it = setting_key_to_index.find(key);
+        if (it == setting_key_to_index.end())
+        {
+            return -1;
+        }
+        return it->second;
+    }
+
+    /*!
+     * Get the default value of a setting which only the engine defines, for when no settings base has a value for it.
+     * 
+     * The front-end only sends the settings of its own definitions, so the settings which are only defined in
+     * command_line_settings.def.json have no value when slicing for the front-end, while they're read by many threads at once.
+     * These defaults are fixed at compile time, so that any thread can read them.
+     * 
+     * \param key The internal key for the setting
+     * \return The default value, or nullptr if the setting isn't an engine setting
+     */
+    static const std::string* getEngineSettingDefault(const std::string& key);
+
+    /*!
+     * Get the keys of all registered settings, ordered by their index.
+     */
+    const std::vector<std::string>& getSettingKeys() const
+    {
+        return setting_keys;
+    }
 protected:
     /*!
      * Whether this json settings object is a definition of a CuraEngine setting,
@@ -84,19 +125,40 @@ protected:
      * \return Whether we found the file.
      */
     bool getDefinitionFile(const std::string machine_id, std::string& result);
+
+    /*!
+     * Get the filename for the machine definition with the given id, searching in the given directories.
+     * 
+     * \param paths The directories to search in
+     * \param machine_id The id and base filename (without extensions) of the machine definition to search for.
+     * \param result The filename of the machine definition
+     * \return Whether we found the file.
+     */
+    static bool findDefinitionFile(const std::unordered_set<std::string>& paths, const std::string& machine_id, std::string& result);
+
+    /*!
+     * Check whether parsed definitions are still the same as parsing their json files now would give.
+     * 
+     * That is the case when none of the json files have changed and each inherited file would still be found in the same place.
+     * 
+     * \param definitions The parsed definitions
+     * \return Whether the definitions are up to date
+     */
+    bool isUpToDate(const PrecompiledDefinitions& definitions) const;
     
     /*!
      * Get the default value of a json setting object in the format used internally (c style).
      * 
      * \param[in] json_object_it An iterator for a given setting json object
-     * \param[out] config Where the default value is stored
+     * \param[out] operation Where the default value is stored
      */
-    static void loadDefault(const rapidjson::GenericValue< rapidjson::UTF8< char > >::ConstMemberIterator& json_object_it, SettingConfig* config);
+    static void loadDefault(const rapidjson::GenericValue< rapidjson::UTF8< char > >::ConstMemberIterator& json_object_it, DefinitionOperation& operation);
 public:
     /*!
      * Load settings from a json file and all the parents it inherits from.
      * 
-     * Uses recursion to load the parent json file.
+     * If the file has been loaded before, or if there are up to date precompiled definitions of the file (see \ref SettingRegistry::precompileJSONsettings),
+     * the settings are loaded from those instead of parsing the json files again.
      * 
      * \param filename The filename of the json file to parse
      * \param settings_base The settings base where to store the default values.
@@ -104,6 +166,31 @@ public:
      * \return an error code or zero of succeeded
      */
     int loadJSONsettings(std::string filename, SettingsBase* settings_base, bool warn_base_file_duplicates = true);
+
+    /*!
+     * Parse a json file and all the parents it inherits from, as well as the extruder trains it refers to,
+     * and store the result next to each of those json files as \ref PrecompiledDefinitions,
+     * from which \ref SettingRegistry::loadJSONsettings loads them much faster.
+     * 
+     * The settings are also loaded, as if loaded with \ref SettingRegistry::loadJSONsettings.
+     * 
+     * \param filename The filename of the machine json file to precompile
+     * \param settings_base The settings base where to store the default values.
+     * \return an error code or zero of succeeded
+     */
+    int precompileJSONsettings(std::string filename, SettingsBase* settings_base);
+
+    /*!
+     * Load settings from a json document in memory, and all the parents it inherits from, which are looked up as files in the search paths.
+     * 
+     * The settings of the document itself are parsed every time, since there is no file to check whether it changed.
+     * 
+     * \param json The json text, which doesn't need to end with a null character
+     * \param size The number of characters of \p json
+     * \param settings_base The settings base where to store the default values.
+     * \return an error code or zero of succeeded
+     */
+    int loadJSONsettingsFromMemory(const char* json, size_t size, SettingsBase* settings_base);
     
     void debugOutputAllSettings() const
     {
@@ -139,14 +226,53 @@ public:
     static int loadJSON(std::string filename, rapidjson::Document& json_document);
 private:
     /*!
-     * Load settings from a single json file.
+     * Precompile a single json file and all the parents it inherits from, and load the settings.
      * 
-     * \param filename The filename of the json file to parse
+     * \param filename The filename of the json file to precompile
      * \param settings_base The settings base where to store the default values.
-     * \param warn_duplicates whether to warn for duplicate definitions
+     * \param warn_base_file_duplicates Whether to warn if there are duplicate definitions in the base file (the .def.json which has no inherits).
      * \return an error code or zero of succeeded
      */
-    int loadJSONsettingsFromDoc(rapidjson::Document& json_document, SettingsBase* settings_base, bool warn_duplicates);
+    int precompileDefinitionFile(std::string filename, SettingsBase* settings_base, bool warn_base_file_duplicates);
+
+    /*!
+     * Parse a json file and all the parents it inherits from into the operations which load its settings.
+     * 
+     * Uses recursion to parse the parent json file.
+     * 
+     * \param filename The filename of the json file to parse
+     * \param[out] definitions Where to store the operations, the parsed json files and the inherited ids
+     * \return an error code or zero of succeeded
+     */
+    int parseJSONsettings(std::string filename, PrecompiledDefinitions& definitions);
+
+    /*!
+     * Parse a json document and all the parents it inherits from into the operations which load its settings.
+     * 
+     * \param json_document The json document to parse
+     * \param[out] definitions Where to store the operations, the parsed json files and the inherited ids
+     * \return an error code or zero of succeeded
+     */
+    int parseJSONdefinition(rapidjson::Document& json_document, PrecompiledDefinitions& definitions);
+
+    /*!
+     * Parse the settings of a single json file.
+     * 
+     * \param json_document The json document to parse
+     * \param[out] operations The operations to which to append those of the json document
+     * \param is_base_file Whether the json document is the base file, which doesn't inherit from any other file
+     * \return an error code or zero of succeeded
+     */
+    int parseJSONsettingsFromDoc(rapidjson::Document& json_document, std::vector<DefinitionOperation>& operations, bool is_base_file);
+
+    /*!
+     * Load parsed settings into the registry and a settings base.
+     * 
+     * \param operations The operations resulting from parsing the json files
+     * \param settings_base The settings base where to store the default values.
+     * \param warn_base_file_duplicates Whether to warn if there are duplicate definitions in the base file (the .def.json which has no inherits).
+     */
+    void applyDefinitionOperations(const std::vector<DefinitionOperation>& operations, SettingsBase* settings_base, bool warn_base_file_duplicates);
 
     /*!
      * Create a new SettingConfig and add it to the registry.
@@ -157,34 +283,50 @@ private:
      */
     SettingConfig& addSetting(std::string name, std::string label);
 
+    /*!
+     * Record a setting key in \ref SettingRegistry::setting_key_to_config and give it an index if it doesn't have one yet.
+     * 
+     * \param name The internal key of the setting
+     * \param config The configuration of the setting, or nullptr if the engine doesn't use it
+     */
+    void registerSettingKey(const std::string& name, SettingConfig* config);
+
     /*!
      * Load inessential data about the setting, like its type and unit.
      * 
-     * \param[out] config Where to store the data
+     * \param[out] operation Where to store the data
      * \param[in] json_object_it Iterator to a setting json object
+     */
+    void _loadSettingValues(DefinitionOperation& operation, const rapidjson::Value::ConstMemberIterator& json_object_it);
+
+    /*!
+     * Store the data about the setting loaded by \ref SettingRegistry::_loadSettingValues in its config and its default value in a settings base.
+     * 
+     * \param[out] config Where to store the data
+     * \param[in] operation The data about the setting
      * \param[out] settings_base The settings base where to store the default values.
      */
-    void _loadSettingValues(SettingConfig* config, const rapidjson::Value::ConstMemberIterator& json_object_it, SettingsBase* settings_base);
+    void _applySettingValues(SettingConfig* config, const DefinitionOperation& operation, SettingsBase* settings_base);
 
     /*!
      * Handle a json object which contains a list of settings.
      * 
      * \param settings_list The object containing one or more setting definitions
      * \param path The path of (internal) setting names traversed to get to this object
-     * \param settings_base The settings base where to store the default values.
-     * \param warn_duplicates whether to warn for duplicate setting definitions
+     * \param[out] operations The operations to which to append those of the settings
+     * \param is_base_file Whether the setting is in the base file, which doesn't inherit from any other file
      */
-    void handleChildren(const rapidjson::Value& settings_list, std::list<std::string>& path, SettingsBase* settings_base, bool warn_duplicates);
+    void handleChildren(const rapidjson::Value& settings_list, std::list<std::string>& path, std::vector<DefinitionOperation>& operations, bool is_base_file);
     
     /*!
      * Handle a json object for a setting.
      * 
      * \param json_setting_it Iterator for the setting which contains the key (setting name) and attributes info
      * \param path The path of (internal) setting names traversed to get to this object
-     * \param settings_base The settings base where to store the default values.
-     * \param warn_duplicates whether to warn for duplicate setting definitions
+     * \param[out] operations The operations to which to append those of the setting
+     * \param is_base_file Whether the setting is in the base file, which doesn't inherit from any other file
      */
-    void handleSetting(const rapidjson::Value::ConstMemberIterator& json_setting_it, std::list<std::string>& path, SettingsBase* settings_base, bool warn_duplicates);
+    void handleSetting(const rapidjson::Value::ConstMemberIterator& json_setting_it, std::list<std::string>& path, std::vector<DefinitionOperation>& operations, bool is_base_file);
 };
 
 }//namespace cura
@@ -1,4 +1,5 @@
 /** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include <algorithm> // find
 #include <cctype>
 #include <fstream>
 #include <stdio.h>
@@ -39,6 +40,64 @@ std::string toString(EGCodeFlavor flavor)
     }
 }
 
+std::atomic<unsigned int> SettingsCache::current_generation(0);
+
+std::atomic<bool> SettingReadRecorder::recording(false);
+std::vector<std::atomic<bool>> SettingReadRecorder::read_registered;
+std::mutex SettingReadRecorder::unregistered_mutex;
+std::unordered_set<std::string> SettingReadRecorder::read_unregistered;
+
+void SettingReadRecorder::start()
+{
+    read_registered = std::vector<std::atomic<bool>>(SettingRegistry::getInstance()->getSettingKeys().size());
+    for (std::atomic<bool>& read : read_registered)
+    {
+        read = false;
+    }
+    read_unregistered.clear();
+    recording = true;
+}
+
+std::vector<std::string> SettingReadRecorder::stop()
+{
+    recording = false;
+    const std::vector<std::string>& keys = SettingRegistry::getInstance()->getSettingKeys();
+    std::vector<std::string> result(read_unregistered.begin(), read_unregistered.end());
+    for (unsigned int setting_idx = 0; setting_idx < read_registered.size(); setting_idx++)
+    {
+        if (read_registered[setting_idx])
+        {
+            result.push_back(keys[setting_idx]);
+        }
+    }
+    return result;
+}
+
+void SettingReadRecorder::recordIndex(unsigned int setting_idx)
+{
+    if (setting_idx < read_registered.size())
+    {
+        if (!read_registered[setting_idx].load(std::memory_order_relaxed))
+        {
+            read_registered[setting_idx].store(true, std::memory_order_relaxed);
+        }
+        return;
+    }
+    recordKey(SettingRegistry::getInstance()->getSettingKeys()[setting_idx]);
+}
+
+void SettingReadRecorder::recordKey(const std::string& key)
+{
+    const int setting_idx = SettingRegistry::getInstance()->getSettingIndex(key);
+    if (setting_idx >= 0 && setting_idx < int(read_registered.size()))
+    {
+        recordIndex(setting_idx);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(unregistered_mutex);
+    read_unregistered.insert(key);
+}
+
 SettingsBaseVirtual::SettingsBaseVirtual()
 : parent(NULL)
 {
@@ -51,11 +110,13 @@ SettingsBaseVirtual::SettingsBaseVirtual(SettingsBaseVirtual* parent)
 
 SettingsBase::SettingsBase()
 : SettingsBaseVirtual(NULL)
+, setting_values(std::make_shared<std::unordered_map<std::string, std::string>>())
 {
 }
 
 SettingsBase::SettingsBase(SettingsBaseVirtual* parent)
 : SettingsBaseVirtual(parent)
+, setting_values(std::make_shared<std::unordered_map<std::string, std::string>>())
 {
 }
 
@@ -66,7 +127,17 @@ SettingsMessenger::SettingsMessenger(SettingsBaseVirtual* parent)
 
 void SettingsBase::_setSetting(std::string key, std::string value)
 {
-    setting_values[key] = value;
+    getSettingValuesForChange()[key] = value;
+    SettingsCache::invalidateAll();
+}
+
+std::unordered_map<std::string, std::string>& SettingsBase::getSettingValuesForChange()
+{
+    if (setting_values.use_count() > 1)
+    { // the other settings bases keep the settings as they were
+        setting_values = std::make_shared<std::unordered_map<std::string, std::string>>(*setting_values);
+    }
+    return *setting_values;
 }
 
 
@@ -86,135 +157,200 @@ void SettingsBase::setSetting(std::string key, std::string value)
 void SettingsBase::setSettingInheritBase(std::string key, const SettingsBaseVirtual& parent)
 {
     setting_inherit_base.emplace(key, &parent);
+    SettingsCache::invalidateAll();
 }
 
 
-std::string SettingsBase::getSettingString(std::string key) const
+std::string SettingsBase::getSettingString(const std::string& key) const
 {
-    if (setting_values.find(key) != setting_values.end())
+    const SettingsCache::Value* cached = getCachedSetting(key);
+    if (cached)
     {
-        return setting_values.at(key);
+        return cached->string;
     }
-    if (setting_inherit_base.find(key) != setting_inherit_base.end())
+    const std::string* value = findSettingString(key);
+    if (value)
     {
-        return setting_inherit_base.at(key)->getSettingString(key);
+        return *value;
     }
-    if (parent)
+
+    // settings are read by many threads at once, so a missing setting isn't stored, but only reported the first time
+    static std::mutex missing_keys_mutex;
+    static std::unordered_set<std::string> missing_keys;
+    std::lock_guard<std::mutex> lock(missing_keys_mutex);
+    if (missing_keys.insert(key).second)
     {
-        return parent->getSettingString(key);
+        cura::logError("Unregistered setting %s\n", key.c_str());
     }
-
-    const_cast<SettingsBase&>(*this).setting_values[key] = "";
-    cura::logError("Unregistered setting %s\n", key.c_str());
     return "";
 }
 
-void SettingsMessenger::setSetting(std::string key, std::string value)
+bool SettingsBase::hasSameSettings(const SettingsBase& other, const std::vector<std::string>& ignored_keys) const
 {
-    parent->setSetting(key, value);
+    if (parent != other.parent || setting_inherit_base != other.setting_inherit_base)
+    {
+        return false;
+    }
+    if (setting_values == other.setting_values)
+    { // shared
+        return true;
+    }
+    auto is_ignored = [&ignored_keys](const std::string& key)
+    {
+        return std::find(ignored_keys.begin(), ignored_keys.end(), key) != ignored_keys.end();
+    };
+    for (const std::pair<const std::string, std::string>& key_and_value : *setting_values)
+    {
+        if (is_ignored(key_and_value.first))
+        {
+            continue;
+        }
+        auto other_value_it = other.setting_values->find(key_and_value.first);
+        if (other_value_it == other.setting_values->end() || other_value_it->second != key_and_value.second)
+        {
+            return false;
+        }
+    }
+    for (const std::pair<const std::string, std::string>& key_and_value : *other.setting_values)
+    { // the settings of both are already compared, so only the presence of the other's settings needs checking
+        if (!is_ignored(key_and_value.first) && setting_values->find(key_and_value.first) == setting_values->end())
+        {
+            return false;
+        }
+    }
+    return true;
 }
 
-void SettingsMessenger::setSettingInheritBase(std::string key, const SettingsBaseVirtual& new_parent)
+void SettingsBase::shareSettings(const SettingsBase& other)
 {
-    parent->setSettingInheritBase(key, new_parent);
+    setting_values = other.setting_values;
+    settings_cache = other.settings_cache;
 }
 
-
-std::string SettingsMessenger::getSettingString(std::string key) const
+const std::string* SettingsBase::findSettingString(const std::string& key) const
 {
-    return parent->getSettingString(key);
+    auto value_it = setting_values->find(key);
+    if (value_it != setting_values->end())
+    {
+        return &value_it->second;
+    }
+    auto inherit_base_it = setting_inherit_base.find(key);
+    if (inherit_base_it != setting_inherit_base.end())
+    {
+        return inherit_base_it->second->findSettingString(key);
+    }
+    if (parent)
+    {
+        return parent->findSettingString(key);
+    }
+    return SettingRegistry::getEngineSettingDefault(key); // the root of the settings
 }
 
-int SettingsBaseVirtual::getSettingAsIndex(std::string key) const
+const SettingsCache* SettingsBase::getSettingsCache() const
 {
-    std::string value = getSettingString(key);
-    return atoi(value.c_str());
+    return settings_cache.get();
 }
 
-int SettingsBaseVirtual::getSettingAsCount(std::string key) const
+void SettingsBase::buildSettingsCache()
 {
-    std::string value = getSettingString(key);
-    return atoi(value.c_str());
+    std::shared_ptr<SettingsCache> cache = std::make_shared<SettingsCache>();
+    cache->generation = SettingsCache::current_generation;
+    const std::vector<std::string>& keys = SettingRegistry::getInstance()->getSettingKeys();
+    cache->values.resize(keys.size());
+    for (unsigned int setting_idx = 0; setting_idx < keys.size(); setting_idx++)
+    {
+        SettingsCache::Value& cached = cache->values[setting_idx];
+        const std::string* value = findSettingString(keys[setting_idx]);
+        cached.is_set = value != nullptr;
+        if (!value)
+        {
+            continue;
+        }
+        // convert in exactly the same way as the getters do
+        cached.string = *value;
+        cached.integer = atoi(value->c_str());
+        cached.number = atof(value->c_str());
+        cached.microns = cached.number * 1000.0;
+        cached.radians = cached.number / 180.0 * M_PI;
+        cached.boolean = parseBoolean(*value);
+    }
+    settings_cache = cache;
 }
 
-double SettingsBaseVirtual::getSettingInMillimeters(std::string key) const
+const SettingsCache::Value* SettingsBaseVirtual::getCachedSetting(const std::string& key) const
 {
-    std::string value = getSettingString(key);
-    return atof(value.c_str());
+    SettingReadRecorder::record(key);
+    const SettingsCache* cache = getSettingsCache();
+    if (!cache || cache->generation != SettingsCache::current_generation)
+    {
+        return nullptr;
+    }
+    const int setting_idx = SettingRegistry::getInstance()->getSettingIndex(key);
+    if (setting_idx < 0 || setting_idx >= int(cache->values.size()) || !cache->values[setting_idx].is_set)
+    {
+        return nullptr;
+    }
+    return &cache->values[setting_idx];
 }
 
-int SettingsBaseVirtual::getSettingInMicrons(std::string key) const
+const SettingsCache::Value* SettingsBaseVirtual::getCachedSetting(SettingKey key) const
 {
-    return getSettingInMillimeters(key) * 1000.0;
+    SettingReadRecorder::record(static_cast<unsigned int>(key));
+    const SettingsCache* cache = getSettingsCache();
+    if (!cache || cache->generation != SettingsCache::current_generation)
+    {
+        return nullptr;
+    }
+    const unsigned int setting_idx = static_cast<unsigned int>(key); // the registry reserves the first indices for the compile time keys
+    if (setting_idx >= cache->values.size() || !cache->values[setting_idx].is_set)
+    {
+        return nullptr;
+    }
+    return &cache->values[setting_idx];
 }
 
-double SettingsBaseVirtual::getSettingInAngleRadians(std::string key) const
+std::string SettingsBaseVirtual::getSettingString(SettingKey key) const
 {
-    std::string value = getSettingString(key);
-    return atof(value.c_str()) / 180.0 * M_PI;
+    const SettingsCache::Value* cached = getCachedSetting(key);
+    if (cached)
+    {
+        return cached->string;
+    }
+    return getSettingString(toString(key));
 }
 
-bool SettingsBaseVirtual::getSettingBoolean(std::string key) const
+void SettingsMessenger::setSetting(std::string key, std::string value)
 {
-    std::string value = getSettingString(key);
-    if (value == "on")
-        return true;
-    if (value == "yes")
-        return true;
-    if (value == "true" or value == "True") //Python uses "True"
-        return true;
-    int num = atoi(value.c_str());
-    return num != 0;
+    parent->setSetting(key, value);
 }
 
-double SettingsBaseVirtual::getSettingInDegreeCelsius(std::string key) const
+void SettingsMessenger::setSettingInheritBase(std::string key, const SettingsBaseVirtual& new_parent)
 {
-    std::string value = getSettingString(key);
-    return atof(value.c_str());
+    parent->setSettingInheritBase(key, new_parent);
 }
 
-double SettingsBaseVirtual::getSettingInMillimetersPerSecond(std::string key) const
-{
-    std::string value = getSettingString(key);
-    return std::max(0.0, atof(value.c_str()));
-}
 
-double SettingsBaseVirtual::getSettingInCubicMillimeters(std::string key) const
+std::string SettingsMessenger::getSettingString(const std::string& key) const
 {
-    std::string value = getSettingString(key);
-    return std::max(0.0, atof(value.c_str()));
+    return parent->getSettingString(key);
 }
 
-double SettingsBaseVirtual::getSettingInPercentage(std::string key) const
+const std::string* SettingsMessenger::findSettingString(const std::string& key) const
 {
-    std::string value = getSettingString(key);
-    return std::max(0.0, atof(value.c_str()));
+    return parent->findSettingString(key);
 }
 
-double SettingsBaseVirtual::getSettingInSeconds(std::string key) const
+const SettingsCache* SettingsMessenger::getSettingsCache() const
 {
-    std::string value = getSettingString(key);
-    return std::max(0.0, atof(value.c_str()));
+    return parent->getSettingsCache();
 }
 
-DraftShieldHeightLimitation SettingsBaseVirtual::getSettingAsDraftShieldHeightLimitation(const std::string key) const
+namespace
 {
-    const std::string value = getSettingString(key);
-    if (value == "full")
-    {
-        return DraftShieldHeightLimitation::FULL;
-    }
-    else if (value == "limited")
-    {
-        return DraftShieldHeightLimitation::LIMITED;
-    }
-    return DraftShieldHeightLimitation::FULL; //Default.
-}
 
-FlowTempGraph SettingsBaseVirtual::getSettingAsFlowTempGraph(std::string key) const
+FlowTempGraph parseFlowTempGraph(std::string value_string, const std::string& key)
 {
     FlowTempGraph ret;
-    std::string value_string = getSettingString(key);
     if (value_string.empty())
     {
         return ret; //Empty at this point.
@@ -252,13 +388,26 @@ FlowTempGraph SettingsBaseVirtual::getSettingAsFlowTempGraph(std::string key) co
             logError("Couldn't read 2D graph element [%s,%s] in setting '%s'. Ignored.\n", first_substring.c_str(), second_substring.c_str(), key.c_str());
         }
     }
+    // FlowTempGraph::getTemp looks up the flow by binary search
+    std::stable_sort(ret.data.begin(), ret.data.end(), [](const FlowTempGraph::Datum& a, const FlowTempGraph::Datum& b) { return a.flow < b.flow; });
     return ret;
 }
 
+DraftShieldHeightLimitation parseDraftShieldHeightLimitation(const std::string& value)
+{
+    if (value == "full")
+    {
+        return DraftShieldHeightLimitation::FULL;
+    }
+    else if (value == "limited")
+    {
+        return DraftShieldHeightLimitation::LIMITED;
+    }
+    return DraftShieldHeightLimitation::FULL; //Default.
+}
 
-EGCodeFlavor SettingsBaseVirtual::getSettingAsGCodeFlavor(std::string key) const
+EGCodeFlavor parseGCodeFlavor(const std::string& value)
 {
-    std::string value = getSettingString(key);
     if (value == "Griffin")
         return EGCodeFlavor::GRIFFIN;
     else if (value == "UltiGCode")
@@ -274,9 +423,8 @@ EGCodeFlavor SettingsBaseVirtual::getSettingAsGCodeFlavor(std::string key) const
     return EGCodeFlavor::REPRAP;
 }
 
-EFillMethod SettingsBaseVirtual::getSettingAsFillMethod(std::string key) const
+EFillMethod parseFillMethod(const std::string& value)
 {
-    std::string value = getSettingString(key);
     if (value == "lines")
         return EFillMethod::LINES;
     if (value == "grid")
@@ -294,9 +442,8 @@ EFillMethod SettingsBaseVirtual::getSettingAsFillMethod(std::string key) const
     return EFillMethod::NONE;
 }
 
-EPlatformAdhesion SettingsBaseVirtual::getSettingAsPlatformAdhesion(std::string key) const
+EPlatformAdhesion parsePlatformAdhesion(const std::string& value)
 {
-    std::string value = getSettingString(key);
     if (value == "brim")
         return EPlatformAdhesion::BRIM;
     if (value == "raft")
@@ -304,9 +451,8 @@ EPlatformAdhesion SettingsBaseVirtual::getSettingAsPlatformAdhesion(std::string
     return EPlatformAdhesion::SKIRT;
 }
 
-ESupportType SettingsBaseVirtual::getSettingAsSupportType(std::string key) const
+ESupportType parseSupportType(const std::string& value)
 {
-    std::string value = getSettingString(key);
     if (value == "everywhere")
         return ESupportType::EVERYWHERE;
     if (value == "buildplate")
@@ -314,9 +460,8 @@ ESupportType SettingsBaseVirtual::getSettingAsSupportType(std::string key) const
     return ESupportType::NONE;
 }
 
-EZSeamType SettingsBaseVirtual::getSettingAsZSeamType(std::string key) const
+EZSeamType parseZSeamType(const std::string& value)
 {
-    std::string value = getSettingString(key);
     if (value == "random")
         return EZSeamType::RANDOM;
     if (value == "shortest")
@@ -326,9 +471,8 @@ EZSeamType SettingsBaseVirtual::getSettingAsZSeamType(std::string key) const
     return EZSeamType::SHORTEST;
 }
 
-ESurfaceMode SettingsBaseVirtual::getSettingAsSurfaceMode(std::string key) const
+ESurfaceMode parseSurfaceMode(const std::string& value)
 {
-    std::string value = getSettingString(key);
     if (value == "normal")
         return ESurfaceMode::NORMAL;
     if (value == "surface")
@@ -338,9 +482,8 @@ ESurfaceMode SettingsBaseVirtual::getSettingAsSurfaceMode(std::string key) const
     return ESurfaceMode::NORMAL;
 }
 
-CombingMode SettingsBaseVirtual::getSettingAsCombingMode(std::string key)
+CombingMode parseCombingMode(const std::string& value)
 {
-    std::string value = getSettingString(key);
     if (value == "off")
     {
         return CombingMode::OFF;
@@ -356,9 +499,8 @@ CombingMode SettingsBaseVirtual::getSettingAsCombingMode(std::string key)
     return CombingMode::ALL;
 }
 
-SupportDistPriority SettingsBaseVirtual::getSettingAsSupportDistPriority(std::string key)
+SupportDistPriority parseSupportDistPriority(const std::string& value)
 {
-    std::string value = getSettingString(key);
     if (value == "xy_overrides_z")
     {
         return SupportDistPriority::XY_OVERRIDES_Z;
@@ -370,6 +512,303 @@ SupportDistPriority SettingsBaseVirtual::getSettingAsSupportDistPriority(std::st
     return SupportDistPriority::XY_OVERRIDES_Z;
 }
 
+}//namespace
+
+int SettingsBaseVirtual::getSettingAsIndex(const std::string& key) const
+{
+    const SettingsCache::Value* cached = getCachedSetting(key);
+    if (cached)
+    {
+        return cached->integer;
+    }
+    std::string value = getSettingString(key);
+    return atoi(value.c_str());
+}
+
+int SettingsBaseVirtual::getSettingAsIndex(SettingKey key) const
+{
+    const SettingsCache::Value* cached = getCachedSetting(key);
+    if (cached)
+    {
+        return cached->integer;
+    }
+    return getSettingAsIndex(toString(key));
+}
+
+int SettingsBaseVirtual::getSettingAsCount(const std::string& key) const
+{
+    const SettingsCache::Value* cached = getCachedSetting(key);
+    if (cached)
+    {
+        return cached->integer;
+    }
+    std::string value = getSettingString(key);
+    return atoi(value.c_str());
+}
+
+int SettingsBaseVirtual::getSettingAsCount(SettingKey key) const
+{
+    const SettingsCache::Value* cached = getCachedSetting(key);
+    if (cached)
+    {
+        return cached->integer;
+    }
+    return getSettingAsCount(toString(key));
+}
+
+double SettingsBaseVirtual::getSettingInMillimeters(const std::string& key) const
+{
+    return getSettingAsNumber(key);
+}
+
+double SettingsBaseVirtual::getSettingInMillimeters(SettingKey key) const
+{
+    return getSettingAsNumber(key);
+}
+
+double SettingsBaseVirtual::getSettingAsNumber(const std::string& key) const
+{
+    const SettingsCache::Value* cached = getCachedSetting(key);
+    if (cached)
+    {
+        return cached->number;
+    }
+    std::string value = getSettingString(key);
+    return atof(value.c_str());
+}
+
+double SettingsBaseVirtual::getSettingAsNumber(SettingKey key) const
+{
+    const SettingsCache::Value* cached = getCachedSetting(key);
+    if (cached)
+    {
+        return cached->number;
+    }
+    return getSettingAsNumber(toString(key));
+}
+
+int SettingsBaseVirtual::getSettingInMicrons(const std::string& key) const
+{
+    const SettingsCache::Value* cached = getCachedSetting(key);
+    if (cached)
+    {
+        return cached->microns;
+    }
+    return getSettingInMillimeters(key) * 1000.0;
+}
+
+int SettingsBaseVirtual::getSettingInMicrons(SettingKey key) const
+{
+    const SettingsCache::Value* cached = getCachedSetting(key);
+    if (cached)
+    {
+        return cached->microns;
+    }
+    return getSettingInMicrons(toString(key));
+}
+
+double SettingsBaseVirtual::getSettingInAngleRadians(const std::string& key) const
+{
+    const SettingsCache::Value* cached = getCachedSetting(key);
+    if (cached)
+    {
+        return cached->radians;
+    }
+    std::string value = getSettingString(key);
+    return atof(value.c_str()) / 180.0 * M_PI;
+}
+
+double SettingsBaseVirtual::getSettingInAngleRadians(SettingKey key) const
+{
+    const SettingsCache::Value* cached = getCachedSetting(key);
+    if (cached)
+    {
+        return cached->radians;
+    }
+    return getSettingInAngleRadians(toString(key));
+}
+
+bool SettingsBaseVirtual::getSettingBoolean(const std::string& key) const
+{
+    const SettingsCache::Value* cached = getCachedSetting(key);
+    if (cached)
+    {
+        return cached->boolean;
+    }
+    return parseBoolean(getSettingString(key));
+}
+
+bool SettingsBaseVirtual::getSettingBoolean(SettingKey key) const
+{
+    const SettingsCache::Value* cached = getCachedSetting(key);
+    if (cached)
+    {
+        return cached->boolean;
+    }
+    return getSettingBoolean(toString(key));
+}
+
+bool SettingsBaseVirtual::parseBoolean(const std::string& value)
+{
+    if (value == "on")
+        return true;
+    if (value == "yes")
+        return true;
+    if (value == "true" or value == "True") //Python uses "True"
+        return true;
+    int num = atoi(value.c_str());
+    return num != 0;
+}
+
+double SettingsBaseVirtual::getSettingInDegreeCelsius(const std::string& key) const
+{
+    return getSettingAsNumber(key);
+}
+
+double SettingsBaseVirtual::getSettingInDegreeCelsius(SettingKey key) const
+{
+    return getSettingAsNumber(key);
+}
+
+double SettingsBaseVirtual::getSettingInMillimetersPerSecond(const std::string& key) const
+{
+    return std::max(0.0, getSettingAsNumber(key));
+}
+
+double SettingsBaseVirtual::getSettingInMillimetersPerSecond(SettingKey key) const
+{
+    return std::max(0.0, getSettingAsNumber(key));
+}
+
+double SettingsBaseVirtual::getSettingInCubicMillimeters(const std::string& key) const
+{
+    return std::max(0.0, getSettingAsNumber(key));
+}
+
+double SettingsBaseVirtual::getSettingInCubicMillimeters(SettingKey key) const
+{
+    return std::max(0.0, getSettingAsNumber(key));
+}
+
+double SettingsBaseVirtual::getSettingInPercentage(const std::string& key) const
+{
+    return std::max(0.0, getSettingAsNumber(key));
+}
+
+double SettingsBaseVirtual::getSettingInPercentage(SettingKey key) const
+{
+    return std::max(0.0, getSettingAsNumber(key));
+}
+
+double SettingsBaseVirtual::getSettingInSeconds(const std::string& key) const
+{
+    return std::max(0.0, getSettingAsNumber(key));
+}
+
+double SettingsBaseVirtual::getSettingInSeconds(SettingKey key) const
+{
+    return std::max(0.0, getSettingAsNumber(key));
+}
+
+FlowTempGraph SettingsBaseVirtual::getSettingAsFlowTempGraph(const std::string& key) const
+{
+    return parseFlowTempGraph(getSettingString(key), key);
+}
+
+FlowTempGraph SettingsBaseVirtual::getSettingAsFlowTempGraph(SettingKey key) const
+{
+    return parseFlowTempGraph(getSettingString(key), toString(key));
+}
+
+DraftShieldHeightLimitation SettingsBaseVirtual::getSettingAsDraftShieldHeightLimitation(const std::string& key) const
+{
+    return parseDraftShieldHeightLimitation(getSettingString(key));
+}
+
+DraftShieldHeightLimitation SettingsBaseVirtual::getSettingAsDraftShieldHeightLimitation(SettingKey key) const
+{
+    return parseDraftShieldHeightLimitation(getSettingString(key));
+}
+
+EGCodeFlavor SettingsBaseVirtual::getSettingAsGCodeFlavor(const std::string& key) const
+{
+    return parseGCodeFlavor(getSettingString(key));
+}
+
+EGCodeFlavor SettingsBaseVirtual::getSettingAsGCodeFlavor(SettingKey key) const
+{
+    return parseGCodeFlavor(getSettingString(key));
+}
+
+EFillMethod SettingsBaseVirtual::getSettingAsFillMethod(const std::string& key) const
+{
+    return parseFillMethod(getSettingString(key));
+}
+
+EFillMethod SettingsBaseVirtual::getSettingAsFillMethod(SettingKey key) const
+{
+    return parseFillMethod(getSettingString(key));
+}
+
+EPlatformAdhesion SettingsBaseVirtual::getSettingAsPlatformAdhesion(const std::string& key) const
+{
+    return parsePlatformAdhesion(getSettingString(key));
+}
+
+EPlatformAdhesion SettingsBaseVirtual::getSettingAsPlatformAdhesion(SettingKey key) const
+{
+    return parsePlatformAdhesion(getSettingString(key));
+}
+
+ESupportType SettingsBaseVirtual::getSettingAsSupportType(const std::string& key) const
+{
+    return parseSupportType(getSettingString(key));
+}
+
+ESupportType SettingsBaseVirtual::getSettingAsSupportType(SettingKey key) const
+{
+    return parseSupportType(getSettingString(key));
+}
+
+EZSeamType SettingsBaseVirtual::getSettingAsZSeamType(const std::string& key) const
+{
+    return parseZSeamType(getSettingString(key));
+}
+
+EZSeamType SettingsBaseVirtual::getSettingAsZSeamType(SettingKey key) const
+{
+    return parseZSeamType(getSettingString(key));
+}
+
+ESurfaceMode SettingsBaseVirtual::getSettingAsSurfaceMode(const std::string& key) const
+{
+    return parseSurfaceMode(getSettingString(key));
+}
+
+ESurfaceMode SettingsBaseVirtual::getSettingAsSurfaceMode(SettingKey key) const
+{
+    return parseSurfaceMode(getSettingString(key));
+}
+
+CombingMode SettingsBaseVirtual::getSettingAsCombingMode(const std::string& key) const
+{
+    return parseCombingMode(getSettingString(key));
+}
+
+CombingMode SettingsBaseVirtual::getSettingAsCombingMode(SettingKey key) const
+{
+    return parseCombingMode(getSettingString(key));
+}
+
+SupportDistPriority SettingsBaseVirtual::getSettingAsSupportDistPriority(const std::string& key) const
+{
+    return parseSupportDistPriority(getSettingString(key));
+}
+
+SupportDistPriority SettingsBaseVirtual::getSettingAsSupportDistPriority(SettingKey key) const
+{
+    return parseSupportDistPriority(getSettingString(key));
+}
 
 }//namespace cura
 
@@ -2,14 +2,19 @@
 #ifndef SETTINGS_SETTINGS_H
 #define SETTINGS_SETTINGS_H
 
+#include <atomic>
+#include <memory> // shared_ptr
 #include <vector>
 #include <map>
+#include <mutex>
 #include <unordered_map>
+#include <unordered_set>
 #include <sstream>
 
 #include "../utils/floatpoint.h"
 
 #include "../FlowTempGraph.h"
+#include "SettingKeys.h"
 
 namespace cura
 {
@@ -173,6 +178,96 @@ enum class SupportDistPriority
     
 class SettingsBase;
 
+/*!
+ * The values of all registered settings as seen from a single SettingsBase, resolved through its ancestors and already converted to the types in which they are requested.
+ * 
+ * The values are stored by the index of the setting in the SettingRegistry, so that a lookup doesn't need to walk the tree of settings bases.
+ * 
+ * Changing any setting anywhere invalidates all caches, after which the settings are looked up the normal way again until the caches are rebuilt.
+ */
+struct SettingsCache
+{
+    /*!
+     * The value of a single setting, converted in the same way as the getters of SettingsBaseVirtual would.
+     */
+    struct Value
+    {
+        bool is_set; //!< Whether the setting had a value anywhere in the tree of settings bases. If not, all other members are invalid.
+        std::string string; //!< The value as given
+        int integer; //!< The value parsed as an integer
+        double number; //!< The value parsed as a floating point number
+        int microns; //!< The value converted from millimeters to microns
+        double radians; //!< The value converted from degrees to radians
+        bool boolean; //!< The value parsed as a boolean
+    };
+
+    std::vector<Value> values; //!< The values of the settings by setting index (see SettingRegistry::getSettingIndex)
+    unsigned int generation; //!< The value of SettingsCache::current_generation at the time the cache was made
+
+    static std::atomic<unsigned int> current_generation; //!< Increased whenever a setting changes anywhere, which invalidates all caches
+
+    /*!
+     * Invalidate all settings caches.
+     */
+    static void invalidateAll()
+    {
+        current_generation++;
+    }
+};
+
+/*!
+ * Records which settings are read while recording, so that it's known which settings the result of a computation depends on.
+ * 
+ * All reads go through SettingsBaseVirtual::getCachedSetting, which records the key when recording is active.
+ * Checking whether recording is active is a single relaxed atomic load, so the recording doesn't slow down reading settings otherwise.
+ */
+class SettingReadRecorder
+{
+public:
+    /*!
+     * Start recording, forgetting the settings recorded before.
+     */
+    static void start();
+
+    /*!
+     * Stop recording.
+     * 
+     * \return The keys of all settings which were read since SettingReadRecorder::start
+     */
+    static std::vector<std::string> stop();
+
+    /*!
+     * Record reading the setting with a given index in the SettingRegistry, if recording.
+     */
+    static void record(unsigned int setting_idx)
+    {
+        if (recording.load(std::memory_order_relaxed))
+        {
+            recordIndex(setting_idx);
+        }
+    }
+
+    /*!
+     * Record reading the setting with a given key, if recording.
+     */
+    static void record(const std::string& key)
+    {
+        if (recording.load(std::memory_order_relaxed))
+        {
+            recordKey(key);
+        }
+    }
+
+private:
+    static std::atomic<bool> recording; //!< Whether settings are being recorded
+    static std::vector<std::atomic<bool>> read_registered; //!< Whether each setting of the SettingRegistry was read, by setting index
+    static std::mutex unregistered_mutex; //!< Guards SettingReadRecorder::read_unregistered
+    static std::unordered_set<std::string> read_unregistered; //!< The keys read of settings which weren't registered yet when recording started
+
+    static void recordIndex(unsigned int setting_idx);
+    static void recordKey(const std::string& key);
+};
+
 /*!
  * An abstract class for classes that can provide setting values.
  * These are: SettingsBase, which contains setting information 
@@ -183,7 +278,15 @@ class SettingsBaseVirtual
 protected:
     SettingsBaseVirtual* parent;
 public:
-    virtual std::string getSettingString(std::string key) const = 0;
+    virtual std::string getSettingString(const std::string& key) const = 0;
+
+    /*!
+     * Get a setting by its compile time key, which is looked up in the settings cache without hashing the key.
+     * 
+     * \param key The setting to look up
+     * \return The value of the setting
+     */
+    std::string getSettingString(SettingKey key) const;
     
     virtual void setSetting(std::string key, std::string value) = 0;
 
@@ -201,33 +304,97 @@ public:
     SettingsBaseVirtual(); //!< SettingsBaseVirtual without a parent settings object
     SettingsBaseVirtual(SettingsBaseVirtual* parent); //!< construct a SettingsBaseVirtual with a parent settings object
     
-    void setParent(SettingsBaseVirtual* parent) { this->parent = parent; }
+    void setParent(SettingsBaseVirtual* parent) { this->parent = parent; SettingsCache::invalidateAll(); }
     SettingsBaseVirtual* getParent() { return parent; }
     
-    int getSettingAsIndex(std::string key) const;
-    int getSettingAsCount(std::string key) const;
+    int getSettingAsIndex(const std::string& key) const;
+    int getSettingAsIndex(SettingKey key) const;
+    int getSettingAsCount(const std::string& key) const;
+    int getSettingAsCount(SettingKey key) const;
+    
+    double getSettingInAngleRadians(const std::string& key) const;
+    double getSettingInAngleRadians(SettingKey key) const;
+    double getSettingInMillimeters(const std::string& key) const;
+    double getSettingInMillimeters(SettingKey key) const;
+    int getSettingInMicrons(const std::string& key) const;
+    int getSettingInMicrons(SettingKey key) const;
+    bool getSettingBoolean(const std::string& key) const;
+    bool getSettingBoolean(SettingKey key) const;
+    double getSettingInDegreeCelsius(const std::string& key) const;
+    double getSettingInDegreeCelsius(SettingKey key) const;
+    double getSettingInMillimetersPerSecond(const std::string& key) const;
+    double getSettingInMillimetersPerSecond(SettingKey key) const;
+    double getSettingInCubicMillimeters(const std::string& key) const;
+    double getSettingInCubicMillimeters(SettingKey key) const;
+    double getSettingInPercentage(const std::string& key) const;
+    double getSettingInPercentage(SettingKey key) const;
+    double getSettingInSeconds(const std::string& key) const;
+    double getSettingInSeconds(SettingKey key) const;
+    
+    FlowTempGraph getSettingAsFlowTempGraph(const std::string& key) const;
+    FlowTempGraph getSettingAsFlowTempGraph(SettingKey key) const;
     
-    double getSettingInAngleRadians(std::string key) const;
-    double getSettingInMillimeters(std::string key) const;
-    int getSettingInMicrons(std::string key) const;
-    bool getSettingBoolean(std::string key) const;
-    double getSettingInDegreeCelsius(std::string key) const;
-    double getSettingInMillimetersPerSecond(std::string key) const;
-    double getSettingInCubicMillimeters(std::string key) const;
-    double getSettingInPercentage(std::string key) const;
-    double getSettingInSeconds(std::string key) const;
-
-    FlowTempGraph getSettingAsFlowTempGraph(std::string key) const;
-
-    DraftShieldHeightLimitation getSettingAsDraftShieldHeightLimitation(const std::string key) const;
-    EGCodeFlavor getSettingAsGCodeFlavor(std::string key) const;
-    EFillMethod getSettingAsFillMethod(std::string key) const;
-    EPlatformAdhesion getSettingAsPlatformAdhesion(std::string key) const;
-    ESupportType getSettingAsSupportType(std::string key) const;
-    EZSeamType getSettingAsZSeamType(std::string key) const;
-    ESurfaceMode getSettingAsSurfaceMode(std::string key) const;
-    CombingMode getSettingAsCombingMode(std::string key);
-    SupportDistPriority getSettingAsSupportDistPriority(std::string key);
+    DraftShieldHeightLimitation getSettingAsDraftShieldHeightLimitation(const std::string& key) const;
+    DraftShieldHeightLimitation getSettingAsDraftShieldHeightLimitation(SettingKey key) const;
+    EGCodeFlavor getSettingAsGCodeFlavor(const std::string& key) const;
+    EGCodeFlavor getSettingAsGCodeFlavor(SettingKey key) const;
+    EFillMethod getSettingAsFillMethod(const std::string& key) const;
+    EFillMethod getSettingAsFillMethod(SettingKey key) const;
+    EPlatformAdhesion getSettingAsPlatformAdhesion(const std::string& key) const;
+    EPlatformAdhesion getSettingAsPlatformAdhesion(SettingKey key) const;
+    ESupportType getSettingAsSupportType(const std::string& key) const;
+    ESupportType getSettingAsSupportType(SettingKey key) const;
+    EZSeamType getSettingAsZSeamType(const std::string& key) const;
+    EZSeamType getSettingAsZSeamType(SettingKey key) const;
+    ESurfaceMode getSettingAsSurfaceMode(const std::string& key) const;
+    ESurfaceMode getSettingAsSurfaceMode(SettingKey key) const;
+    CombingMode getSettingAsCombingMode(const std::string& key) const;
+    CombingMode getSettingAsCombingMode(SettingKey key) const;
+    SupportDistPriority getSettingAsSupportDistPriority(const std::string& key) const;
+    SupportDistPriority getSettingAsSupportDistPriority(SettingKey key) const;
+
+    /*!
+     * Find the value of a setting in this settings base or any ancestral settings base, without reporting unregistered settings.
+     * 
+     * \param key The setting to look up
+     * \return The value of the setting, or nullptr if no settings base has a value for it
+     */
+    virtual const std::string* findSettingString(const std::string& key) const = 0;
+
+    /*!
+     * Get the cache of the settings base where this object gets its settings from.
+     * 
+     * \return The settings cache, or nullptr if there is none
+     */
+    virtual const SettingsCache* getSettingsCache() const = 0;
+
+    /*!
+     * Get the cached value of a setting, if the cache of the settings base is up to date and the setting has a value.
+     * 
+     * \param key The setting to look up
+     * \return The cached value, or nullptr if the setting needs to be looked up the normal way
+     */
+    const SettingsCache::Value* getCachedSetting(const std::string& key) const;
+
+    /*!
+     * Get the cached value of a setting by its compile time key, which is directly the index of the setting in the cache.
+     * 
+     * \param key The setting to look up
+     * \return The cached value, or nullptr if the setting needs to be looked up the normal way
+     */
+    const SettingsCache::Value* getCachedSetting(SettingKey key) const;
+
+protected:
+    /*!
+     * Get a setting parsed as a floating point number, on which most unit conversions are based.
+     */
+    double getSettingAsNumber(const std::string& key) const;
+    double getSettingAsNumber(SettingKey key) const; //!< See \ref SettingsBaseVirtual::getSettingAsNumber
+
+    /*!
+     * Parse the value of a boolean setting.
+     */
+    static bool parseBoolean(const std::string& value);
 };
 
 class SettingRegistry;
@@ -242,12 +409,18 @@ class SettingsBase : public SettingsBaseVirtual
 {
     friend class SettingRegistry;
 private:
-    std::unordered_map<std::string, std::string> setting_values;
+    /*!
+     * The settings set on this settings base, shared with the settings bases with the same settings (see SettingsBase::shareSettings)
+     * and with copies of this settings base, until any of them changes a setting.
+     */
+    std::shared_ptr<std::unordered_map<std::string, std::string>> setting_values;
 
     /*!
      * Mapping for each setting which must inherit from a different setting base than \ref SettingsBaseVirtual::parent
      */
     std::unordered_map<std::string, const SettingsBaseVirtual*> setting_inherit_base;
+
+    std::shared_ptr<const SettingsCache> settings_cache; //!< The resolved values of all registered settings. See \ref SettingsBase::buildSettingsCache
 public:
     SettingsBase(); //!< SettingsBase without a parent settings object
     SettingsBase(SettingsBaseVirtual* parent); //!< construct a SettingsBase with a parent settings object
@@ -259,12 +432,22 @@ public:
      */
     void setSetting(std::string key, std::string value);
     void setSettingInheritBase(std::string key, const SettingsBaseVirtual& parent); //!< See \ref SettingsBaseVirtual::setSettingInheritBase
-    std::string getSettingString(std::string key) const; //!< Get a setting from this SettingsBase (or any ancestral SettingsBase)
+    using SettingsBaseVirtual::getSettingString;
+    std::string getSettingString(const std::string& key) const; //!< Get a setting from this SettingsBase (or any ancestral SettingsBase)
+
+    /*!
+     * Resolve all registered settings as seen from this settings base and store them in a cache,
+     * which is used by the getters of this settings base and of all settings messengers which get their settings from it.
+     * 
+     * The cache stays valid until any setting is changed, after which settings are looked up the normal way until this is called again.
+     * This must not be called while other threads are getting settings from this settings base.
+     */
+    void buildSettingsCache();
     
     std::string getAllLocalSettingsString() const
     {
         std::stringstream sstream;
-        for (auto pair : setting_values)
+        for (auto pair : *setting_values)
         {
             if (!pair.second.empty())
             {
@@ -276,9 +459,31 @@ public:
     
     void debugOutputAllLocalSettings()  const
     {
-        for (auto pair : setting_values)
+        for (auto pair : *setting_values)
             std::cerr << pair.first << " : " << pair.second << std::endl;
     }
+    const std::string* findSettingString(const std::string& key) const; //!< See \ref SettingsBaseVirtual::findSettingString
+    const SettingsCache* getSettingsCache() const; //!< See \ref SettingsBaseVirtual::getSettingsCache
+
+    /*!
+     * Whether another settings base gives the same value for every setting as this one,
+     * because it has the same local settings and gets the other settings from the same parents.
+     * 
+     * \param other The settings base to compare with
+     * \param ignored_keys The local settings which may differ
+     */
+    bool hasSameSettings(const SettingsBase& other, const std::vector<std::string>& ignored_keys) const;
+
+    /*!
+     * Use the local settings and the settings cache of another settings base which has the same settings (see SettingsBase::hasSameSettings)
+     * instead of an equal copy of them, so that many objects with the same settings keep them in memory and resolve them only once.
+     * 
+     * The local settings are copied again as soon as either settings base changes a setting.
+     * 
+     * \param other The settings base with the same settings
+     */
+    void shareSettings(const SettingsBase& other);
+
 protected:
     /*!
      * Set a setting without checking if it's registered.
@@ -286,6 +491,12 @@ protected:
      * Used in SettingsRegistry
      */
     void _setSetting(std::string key, std::string value);
+
+private:
+    /*!
+     * Get the local settings in order to change them, which copies them first if they're shared with other settings bases.
+     */
+    std::unordered_map<std::string, std::string>& getSettingValuesForChange();
 };
 
 /*!
@@ -300,7 +511,10 @@ public:
     
     void setSetting(std::string key, std::string value); //!< Set a setting of the parent SettingsBase to a given value
     void setSettingInheritBase(std::string key, const SettingsBaseVirtual& parent); //!< See \ref SettingsBaseVirtual::setSettingInheritBase
-    std::string getSettingString(std::string key) const; //!< Get a setting from the parent SettingsBase (or any further ancestral SettingsBase)
+    using SettingsBaseVirtual::getSettingString;
+    std::string getSettingString(const std::string& key) const; //!< Get a setting from the parent SettingsBase (or any further ancestral SettingsBase)
+    const std::string* findSettingString(const std::string& key) const; //!< See \ref SettingsBaseVirtual::findSettingString
+    const SettingsCache* getSettingsCache() const; //!< See \ref SettingsBaseVirtual::getSettingsCache
 };
 
 
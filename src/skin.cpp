@@ -4,6 +4,7 @@
 #include "skin.h"
 #include "utils/math.h"
 #include "utils/polygonUtils.h"
+#include "utils/ThreadPool.h"
 
 #define MIN_AREA_SIZE (0.4 * 0.4) 
 
@@ -16,11 +17,62 @@ void generateSkins(int layerNr, SliceMeshStorage& mesh, int downSkinCount, int u
     generateSkinAreas(layerNr, mesh, innermost_wall_line_width, downSkinCount, upSkinCount, wall_line_count, no_small_gaps_heuristic);
 
     SliceLayer* layer = &mesh.layers[layerNr];
-    for(unsigned int partNr=0; partNr<layer->parts.size(); partNr++)
+    ThreadPool::getInstance()->parallelFor(0, layer->parts.size(), [&](int partNr)
     {
         SliceLayerPart* part = &layer->parts[partNr];
         generateSkinInsets(part, innermost_wall_line_width, insetCount);
+    });
+}
+
+/*!
+ * The area which is within the innermost walls on each of a range of layers.
+ * 
+ * \param mesh The mesh of the layers
+ * \param first_layer_nr The layer with which the intersection starts
+ * \param begin_layer_nr The first of the other layers to intersect with
+ * \param end_layer_nr One past the last of the other layers to intersect with
+ * \param wall_line_count The number of walls of the mesh
+ * \param[out] boxes The bounding box of each of the resulting polygons
+ * \return The area which isn't air on all of the layers
+ */
+static Polygons getNotAir(SliceMeshStorage& mesh, int first_layer_nr, int begin_layer_nr, int end_layer_nr, int wall_line_count, std::vector<AABB>& boxes)
+{
+    Polygons not_air = mesh.layers[first_layer_nr].getInsideArea(wall_line_count);
+    for (int layer_nr = begin_layer_nr; layer_nr < end_layer_nr; layer_nr++)
+    {
+        not_air.intersectWith(mesh.layers[layer_nr].getInsideArea(wall_line_count));
     }
+    boxes.resize(not_air.size());
+    for (unsigned int poly_idx = 0; poly_idx < not_air.size(); poly_idx++)
+    {
+        for (const Point& p : not_air[poly_idx])
+        {
+            boxes[poly_idx].include(p);
+        }
+    }
+    return not_air;
+}
+
+/*!
+ * The polygons of which the bounding box overlaps with a given box.
+ * 
+ * Since a hole lies within its outline, this doesn't change the area within the box.
+ * 
+ * \param polygons The polygons to select from
+ * \param boxes The bounding box of each of the \p polygons
+ * \param box The box with which the selected polygons overlap
+ */
+static Polygons getPolygonsHitting(const Polygons& polygons, const std::vector<AABB>& boxes, const AABB& box)
+{
+    Polygons result;
+    for (unsigned int poly_idx = 0; poly_idx < polygons.size(); poly_idx++)
+    {
+        if (boxes[poly_idx].hit(box))
+        {
+            result.add(polygons[poly_idx]);
+        }
+    }
+    return result;
 }
 
 void generateSkinAreas(int layer_nr, SliceMeshStorage& mesh, const int innermost_wall_line_width, int downSkinCount, int upSkinCount, int wall_line_count, bool no_small_gaps_heuristic)
@@ -31,30 +83,41 @@ void generateSkinAreas(int layer_nr, SliceMeshStorage& mesh, const int innermost
     {
         return;
     }
+
+    // without the heuristic the walls of all layers within the skin distance are intersected, which is the same for all parts of the layer
+    const bool has_not_air_below = !no_small_gaps_heuristic && layer_nr >= downSkinCount && downSkinCount > 0;
+    // a layer within the bottom skin distance is downskin all over, which covers any upskin, so the layers above it aren't needed; e.g. the bottom of a spiralized print
+    const bool is_all_downskin = downSkinCount > 0 && layer_nr < downSkinCount;
+    const bool has_not_air_above = !no_small_gaps_heuristic && layer_nr < static_cast<int>(mesh.layers.size()) - 1 - upSkinCount && upSkinCount > 0 && !is_all_downskin;
+    std::vector<AABB> not_air_below_boxes;
+    std::vector<AABB> not_air_above_boxes;
+    const Polygons not_air_below = has_not_air_below ? getNotAir(mesh, layer_nr - 1, layer_nr - downSkinCount, layer_nr - 1, wall_line_count, not_air_below_boxes) : Polygons();
+    const Polygons not_air_above = has_not_air_above ? getNotAir(mesh, layer_nr + 1, layer_nr + 2, layer_nr + upSkinCount + 1, wall_line_count, not_air_above_boxes) : Polygons();
     
-    for(unsigned int partNr = 0; partNr < layer.parts.size(); partNr++)
+    // each part only reads the insets of the other layers, so the parts of a layer with many islands can be computed in parallel
+    ThreadPool::getInstance()->parallelFor(0, layer.parts.size(), [&](int partNr)
     {
         SliceLayerPart& part = layer.parts[partNr];
 
         if (int(part.insets.size()) < wall_line_count)
         {
-            continue; // the last wall is not present, the part should only get inter perimeter gaps, but no skin.
+            return; // the last wall is not present, the part should only get inter perimeter gaps, but no skin.
         }
 
         Polygons upskin = part.insets.back().offset(-innermost_wall_line_width / 2);
         Polygons downskin = (downSkinCount == 0) ? Polygons() : upskin;
         if (upSkinCount == 0) upskin = Polygons();
 
-        auto getInsidePolygons = [&part, wall_line_count](SliceLayer& layer2)
+        std::vector<unsigned int> part2_indices;
+        auto getInsidePolygons = [&part, &part2_indices, wall_line_count](SliceLayer& layer2)
             {
                 Polygons result;
-                for(SliceLayerPart& part2 : layer2.parts)
+                layer2.findPartsHitting(part.boundaryBox, part2_indices);
+                for (unsigned int part2_idx : part2_indices)
                 {
-                    if (part.boundaryBox.hit(part2.boundaryBox))
-                    {
-                        unsigned int wall_idx = std::max(0, std::min(wall_line_count, (int) part2.insets.size()) - 1);
-                        result.add(part2.insets[wall_idx]);
-                    }
+                    SliceLayerPart& part2 = layer2.parts[part2_idx];
+                    unsigned int wall_idx = std::max(0, std::min(wall_line_count, (int) part2.insets.size()) - 1);
+                    result.add(part2.insets[wall_idx]);
                 }
                 return result;
             };
@@ -63,34 +126,24 @@ void generateSkinAreas(int layer_nr, SliceMeshStorage& mesh, const int innermost
         {
             if (static_cast<int>(layer_nr - downSkinCount) >= 0)
             {
-                downskin = downskin.difference(getInsidePolygons(mesh.layers[layer_nr - downSkinCount])); // skin overlaps with the walls
+                downskin.differenceWith(getInsidePolygons(mesh.layers[layer_nr - downSkinCount])); // skin overlaps with the walls
             }
             
-            if (static_cast<int>(layer_nr + upSkinCount) < static_cast<int>(mesh.layers.size()))
+            if (static_cast<int>(layer_nr + upSkinCount) < static_cast<int>(mesh.layers.size()) && !is_all_downskin)
             {
-                upskin = upskin.difference(getInsidePolygons(mesh.layers[layer_nr + upSkinCount])); // skin overlaps with the walls
+                upskin.differenceWith(getInsidePolygons(mesh.layers[layer_nr + upSkinCount])); // skin overlaps with the walls
             }
         }
         else 
         {
-            if (layer_nr >= downSkinCount && downSkinCount > 0)
+            if (has_not_air_below)
             {
-                Polygons not_air = getInsidePolygons(mesh.layers[layer_nr - 1]);
-                for (int downskin_layer_nr = layer_nr - downSkinCount; downskin_layer_nr < layer_nr - 1; downskin_layer_nr++)
-                {
-                    not_air = not_air.intersection(getInsidePolygons(mesh.layers[downskin_layer_nr]));
-                }
-                downskin = downskin.difference(not_air); // skin overlaps with the walls
+                downskin.differenceWith(getPolygonsHitting(not_air_below, not_air_below_boxes, part.boundaryBox)); // skin overlaps with the walls
             }
             
-            if (layer_nr < static_cast<int>(mesh.layers.size()) - 1 - upSkinCount && upSkinCount > 0)
+            if (has_not_air_above)
             {
-                Polygons not_air = getInsidePolygons(mesh.layers[layer_nr + 1]);
-                for (int upskin_layer_nr = layer_nr + 2; upskin_layer_nr < layer_nr + upSkinCount + 1; upskin_layer_nr++)
-                {
-                    not_air = not_air.intersection(getInsidePolygons(mesh.layers[upskin_layer_nr]));
-                }
-                upskin = upskin.difference(not_air); // skin overlaps with the walls
+                upskin.differenceWith(getPolygonsHitting(not_air_above, not_air_above_boxes, part.boundaryBox)); // skin overlaps with the walls
             }
         }
         
@@ -103,7 +156,7 @@ void generateSkinAreas(int layer_nr, SliceMeshStorage& mesh, const int innermost
             part.skin_parts.emplace_back();
             part.skin_parts.back().outline = skin_area_part;
         }
-    }
+    });
 }
 
 
@@ -143,89 +196,124 @@ void generateInfill(int layerNr, SliceMeshStorage& mesh, const int innermost_wal
 {
     SliceLayer& layer = mesh.layers[layerNr];
 
-    for(SliceLayerPart& part : layer.parts)
+    ThreadPool::getInstance()->parallelFor(0, layer.parts.size(), [&](int part_idx)
     {
+        SliceLayerPart& part = layer.parts[part_idx];
         if (int(part.insets.size()) < wall_line_count)
         {
-            continue; // the last wall is not present, the part should only get inter preimeter gaps, but no infill.
+            return; // the last wall is not present, the part should only get inter preimeter gaps, but no infill.
         }
         Polygons infill = part.insets.back().offset(-innermost_wall_line_width / 2 - infill_skin_overlap);
 
-        for(SliceLayerPart& part2 : layer.parts)
+        std::vector<unsigned int> part2_indices;
+        layer.findPartsHitting(part.boundaryBox, part2_indices);
+        for (unsigned int part2_idx : part2_indices)
         {
-            if (part.boundaryBox.hit(part2.boundaryBox))
+            for(SkinPart& skin_part : layer.parts[part2_idx].skin_parts)
             {
-                for(SkinPart& skin_part : part2.skin_parts)
-                {
-                    infill = infill.difference(skin_part.outline);
-                }
+                infill.differenceWith(skin_part.outline);
             }
         }
         infill.removeSmallAreas(MIN_AREA_SIZE);
         
         part.infill_area = infill.offset(infill_skin_overlap);
-    }
+    });
 }
 
 void SkinInfillAreaComputation::generateGradualInfill(SliceMeshStorage& mesh, unsigned int gradual_infill_step_height, unsigned int max_infill_steps)
 {
     // no early-out for this function; it needs to initialize the [infill_area_per_combine_per_density]
     float layer_skip_count = 8; // skip every so many layers as to ignore small gaps in the model making computation more easy
-    if (!mesh.getSettingBoolean("skin_no_small_gaps_heuristic"))
+    if (!mesh.getSettingBoolean(SettingKey::skin_no_small_gaps_heuristic))
     {
         layer_skip_count = 1;
     }
-    unsigned int gradual_infill_step_layer_count = round_divide(gradual_infill_step_height, mesh.getSettingInMicrons("layer_height")); // The difference in layer count between consecutive density infill areas
+    unsigned int gradual_infill_step_layer_count = round_divide(gradual_infill_step_height, mesh.getSettingInMicrons(SettingKey::layer_height)); // The difference in layer count between consecutive density infill areas
 
     // make gradual_infill_step_height divisable by layer_skip_count
     float n_skip_steps_per_gradual_step = std::max(1.0f, std::ceil(gradual_infill_step_layer_count / layer_skip_count)); // only decrease layer_skip_count to make it a divisor of gradual_infill_step_layer_count
     layer_skip_count = gradual_infill_step_layer_count / n_skip_steps_per_gradual_step;
 
 
-    size_t min_layer = mesh.getSettingAsCount("bottom_layers");
-    size_t max_layer = mesh.layers.size() - 1 - mesh.getSettingAsCount("top_layers");
+    size_t min_layer = mesh.getSettingAsCount(SettingKey::bottom_layers);
+    size_t max_layer = mesh.layers.size() - 1 - mesh.getSettingAsCount(SettingKey::top_layers);
+
+    // For each part the part of its own infill area which is infill in all layers of the first infill step above it.
+    // The next steps of a part then take the windows of the parts in the layer where the step starts,
+    // so each step is a single intersection instead of recomputing the overlapping windows layer by layer.
+    // Empty if the step sticks out above the top of the mesh.
+    std::vector<std::vector<Polygons>> step_infill_areas(mesh.layers.size());
+    ThreadPool::getInstance()->parallelForLayers(min_layer, mesh.layers.size(), [&](int layer_idx)
+    {
+        SliceLayer& layer = mesh.layers[layer_idx];
+        std::vector<Polygons>& step_infill_area_per_part = step_infill_areas[layer_idx];
+        step_infill_area_per_part.resize(layer.parts.size());
+        std::vector<unsigned int> upper_part_indices;
+        for (unsigned int part_idx = 0; part_idx < layer.parts.size(); part_idx++)
+        {
+            SliceLayerPart& part = layer.parts[part_idx];
+            Polygons step_infill_area = part.getOwnInfillArea();
+            const size_t min_layer = layer_idx + layer_skip_count;
+            const size_t max_layer = layer_idx + gradual_infill_step_layer_count;
+            for (float upper_layer_idx = min_layer; static_cast<unsigned int>(upper_layer_idx) <= max_layer && step_infill_area.size() > 0; upper_layer_idx += layer_skip_count)
+            {
+                if (static_cast<unsigned int>(upper_layer_idx) >= mesh.layers.size())
+                {
+                    step_infill_area.clear();
+                    break;
+                }
+                SliceLayer& upper_layer = mesh.layers[static_cast<unsigned int>(upper_layer_idx)];
+                Polygons relevent_upper_polygons;
+                upper_layer.findPartsHitting(part.boundaryBox, upper_part_indices);
+                for (unsigned int upper_part_idx : upper_part_indices)
+                {
+                    relevent_upper_polygons.add(upper_layer.parts[upper_part_idx].getOwnInfillArea());
+                }
+                step_infill_area.intersectWith(relevent_upper_polygons);
+            }
+            step_infill_area_per_part[part_idx] = std::move(step_infill_area);
+        }
+    });
 
-    for (size_t layer_idx = 0; layer_idx < mesh.layers.size(); layer_idx++)
+    // each layer only reads the windows of the layers above it, so all layers can be computed in parallel
+    // as long as the own infill areas are only cleared once all layers are done
+    ThreadPool::getInstance()->parallelForLayers(0, mesh.layers.size(), [&](int layer_idx)
     { // loop also over layers which don't contain infill cause of bottom_ and top_layer to initialize their infill_area_per_combine_per_density
         SliceLayer& layer = mesh.layers[layer_idx];
+        std::vector<unsigned int> upper_part_indices;
 
-        for (SliceLayerPart& part : layer.parts)
+        for (unsigned int part_idx = 0; part_idx < layer.parts.size(); part_idx++)
         {
+            SliceLayerPart& part = layer.parts[part_idx];
             assert(part.infill_area_per_combine_per_density.size() == 0 && "infill_area_per_combine_per_density is supposed to be uninitialized");
 
             const Polygons& infill_area = part.getOwnInfillArea();
 
-            if (infill_area.size() == 0 || layer_idx < min_layer || layer_idx > max_layer)
+            if (infill_area.size() == 0 || static_cast<size_t>(layer_idx) < min_layer || static_cast<size_t>(layer_idx) > max_layer)
             { // initialize infill_area_per_combine_per_density empty
                 part.infill_area_per_combine_per_density.emplace_back(); // create a new infill_area_per_combine
                 part.infill_area_per_combine_per_density.back().emplace_back(); // put empty infill area in the newly constructed infill_area_per_combine
                 // note: no need to copy part.infill_area, cause it's the empty vector anyway
                 continue;
             }
-            Polygons less_dense_infill = infill_area; // one step less dense with each infill_step
+            Polygons less_dense_infill = step_infill_areas[layer_idx][part_idx]; // one step less dense with each infill_step
             for (unsigned int infill_step = 0; infill_step < max_infill_steps; infill_step++)
             {
-                size_t min_layer = layer_idx + infill_step * gradual_infill_step_layer_count + layer_skip_count;
-                size_t max_layer = layer_idx + (infill_step + 1) * gradual_infill_step_layer_count;
-
-                for (float upper_layer_idx = min_layer; static_cast<unsigned int>(upper_layer_idx) <= max_layer; upper_layer_idx += layer_skip_count)
+                if (infill_step > 0)
                 {
-                    if (static_cast<unsigned int>(upper_layer_idx) >= mesh.layers.size())
+                    const size_t step_layer_idx = layer_idx + infill_step * gradual_infill_step_layer_count;
+                    if (step_layer_idx >= mesh.layers.size())
                     {
-                        less_dense_infill.clear();
                         break;
                     }
-                    SliceLayer& upper_layer = mesh.layers[static_cast<unsigned int>(upper_layer_idx)];
-                    Polygons relevent_upper_polygons;
-                    for (SliceLayerPart& upper_layer_part : upper_layer.parts)
+                    const SliceLayer& step_layer = mesh.layers[step_layer_idx];
+                    Polygons relevent_step_polygons;
+                    step_layer.findPartsHitting(part.boundaryBox, upper_part_indices);
+                    for (unsigned int step_part_idx : upper_part_indices)
                     {
-                        if (!upper_layer_part.boundaryBox.hit(part.boundaryBox))
-                        {
-                            continue;
-                        }
-                        relevent_upper_polygons.add(upper_layer_part.getOwnInfillArea());
+                        relevent_step_polygons.add(step_infill_areas[step_layer_idx][step_part_idx]);
                     }
-                    less_dense_infill = less_dense_infill.intersection(relevent_upper_polygons);
+                    less_dense_infill.intersectWith(relevent_step_polygons);
                 }
                 if (less_dense_infill.size() == 0)
                 {
@@ -236,24 +324,34 @@ void SkinInfillAreaComputation::generateGradualInfill(SliceMeshStorage& mesh, un
                 std::vector<Polygons>& infill_area_per_combine_current_density = part.infill_area_per_combine_per_density.back();
                 const Polygons more_dense_infill = infill_area.difference(less_dense_infill);
                 infill_area_per_combine_current_density.push_back(more_dense_infill);
-
-                if (less_dense_infill.size() == 0)
-                {
-                    break;
-                }
             }
             part.infill_area_per_combine_per_density.emplace_back();
             std::vector<Polygons>& infill_area_per_combine_current_density = part.infill_area_per_combine_per_density.back();
             infill_area_per_combine_current_density.push_back(infill_area);
-            part.infill_area_own = nullptr; // clear infill_area_own, it's not needed any more.
             assert(part.infill_area_per_combine_per_density.size() != 0 && "infill_area_per_combine_per_density is now initialized");
         }
-    }
+    });
+    std::vector<std::vector<Polygons>>().swap(step_infill_areas);
+
+    ThreadPool::getInstance()->parallelForLayers(0, mesh.layers.size(), [&](int layer_idx)
+    {
+        if (static_cast<size_t>(layer_idx) < min_layer || static_cast<size_t>(layer_idx) > max_layer)
+        {
+            return;
+        }
+        for (SliceLayerPart& part : mesh.layers[layer_idx].parts)
+        {
+            if (part.getOwnInfillArea().size() > 0)
+            {
+                part.infill_area_own = nullptr; // clear infill_area_own, it's not needed any more.
+            }
+        }
+    });
 }
 
 void combineInfillLayers(SliceMeshStorage& mesh, unsigned int amount)
 {
-    if (mesh.layers.empty() || mesh.layers.size() - 1 < static_cast<size_t>(mesh.getSettingAsCount("top_layers")) || mesh.getSettingAsCount("infill_line_distance") <= 0) //No infill is even generated.
+    if (mesh.layers.empty() || mesh.layers.size() - 1 < static_cast<size_t>(mesh.getSettingAsCount(SettingKey::top_layers)) || mesh.getSettingAsCount(SettingKey::infill_line_distance) <= 0) //No infill is even generated.
     {
         return;
     }
@@ -265,13 +363,20 @@ void combineInfillLayers(SliceMeshStorage& mesh, unsigned int amount)
     divisible index. Otherwise we get some parts that have infill at divisible
     layers and some at non-divisible layers. Those layers would then miss each
     other. */
-    size_t min_layer = mesh.getSettingAsCount("bottom_layers") + amount - 1;
+    size_t min_layer = mesh.getSettingAsCount(SettingKey::bottom_layers) + amount - 1;
     min_layer -= min_layer % amount; //Round upwards to the nearest layer divisible by infill_sparse_combine.
-    size_t max_layer = mesh.layers.size() - 1 - mesh.getSettingAsCount("top_layers");
+    size_t max_layer = mesh.layers.size() - 1 - mesh.getSettingAsCount(SettingKey::top_layers);
     max_layer -= max_layer % amount; //Round downwards to the nearest layer divisible by infill_sparse_combine.
-    for(size_t layer_idx = min_layer;layer_idx <= max_layer;layer_idx += amount) //Skip every few layers, but extrude more.
+    if (min_layer > max_layer)
+    {
+        return;
+    }
+    // each combined layer only changes itself and the layers below it down to the previous combined layer, so they can be computed in parallel
+    ThreadPool::getInstance()->parallelFor(0, (max_layer - min_layer) / amount + 1, [&](int combine_idx) //Skip every few layers, but extrude more.
     {
+        const size_t layer_idx = min_layer + combine_idx * amount;
         SliceLayer* layer = &mesh.layers[layer_idx];
+        std::vector<unsigned int> lower_part_indices;
         for(unsigned int combine_count_here = 1; combine_count_here < amount; combine_count_here++)
         {
             if(layer_idx < combine_count_here)
@@ -287,34 +392,46 @@ void combineInfillLayers(SliceMeshStorage& mesh, unsigned int amount)
             SliceLayer* lower_layer = &mesh.layers[lower_layer_idx];
             for (SliceLayerPart& part : layer->parts)
             {
+                lower_layer->findPartsHitting(part.boundaryBox, lower_part_indices);
                 for (unsigned int density_idx = 0; density_idx < part.infill_area_per_combine_per_density.size(); density_idx++)
                 { // go over each density of gradual infill (these density areas overlap!)
                     std::vector<Polygons>& infill_area_per_combine = part.infill_area_per_combine_per_density[density_idx];
                     Polygons result;
-                    for (SliceLayerPart& lower_layer_part : lower_layer->parts)
+                    if (infill_area_per_combine[combine_count_here - 1].size() == 0)
+                    { // nothing left to thicken, e.g. the lower densities of gradual infill near the top
+                        infill_area_per_combine.push_back(result);
+                        continue;
+                    }
+                    for (unsigned int lower_part_idx : lower_part_indices)
                     {
-                        if (part.boundaryBox.hit(lower_layer_part.boundaryBox))
+                        SliceLayerPart& lower_layer_part = lower_layer->parts[lower_part_idx];
+                        // The lower parts don't overlap, so removing the area thickened on one of them doesn't change the area over the others:
+                        // all of them are intersected with the same area, which is then reduced only once.
+                        Polygons intersection = infill_area_per_combine[combine_count_here - 1].intersection(lower_layer_part.infill_area).offset(-200).offset(200);
+                        if (intersection.size() == 0)
                         {
-
-                            Polygons intersection = infill_area_per_combine[combine_count_here - 1].intersection(lower_layer_part.infill_area).offset(-200).offset(200);
-                            result.add(intersection); // add area to be thickened
-                            infill_area_per_combine[combine_count_here - 1] = infill_area_per_combine[combine_count_here - 1].difference(intersection); // remove thickened area from less thick layer here
-                            if (density_idx < lower_layer_part.infill_area_per_combine_per_density.size())
-                            { // only remove from *same density* areas on layer below
-                                // If there are no same density areas, then it's ok to print them anyway
-                                // Don't remove other density areas
-                                unsigned int lower_density_idx = density_idx;
-                                std::vector<Polygons>& lower_infill_area_per_combine = lower_layer_part.infill_area_per_combine_per_density[lower_density_idx];
-                                lower_infill_area_per_combine[0] = lower_infill_area_per_combine[0].difference(intersection); // remove thickened area from lower (thickened) layer
-                            }
+                            continue;
                         }
+                        result.add(intersection); // add area to be thickened
+                        if (density_idx < lower_layer_part.infill_area_per_combine_per_density.size())
+                        { // only remove from *same density* areas on layer below
+                            // If there are no same density areas, then it's ok to print them anyway
+                            // Don't remove other density areas
+                            unsigned int lower_density_idx = density_idx;
+                            std::vector<Polygons>& lower_infill_area_per_combine = lower_layer_part.infill_area_per_combine_per_density[lower_density_idx];
+                            lower_infill_area_per_combine[0].differenceWith(intersection); // remove thickened area from lower (thickened) layer
+                        }
+                    }
+                    if (result.size() > 0)
+                    {
+                        infill_area_per_combine[combine_count_here - 1].differenceWith(result); // remove thickened area from less thick layer here
                     }
 
                     infill_area_per_combine.push_back(result);
                 }
             }
         }
-    }
+    });
 }
 
 
@@ -1,10 +1,87 @@
 #include "sliceDataStorage.h"
 
+#include <algorithm> // copy
+#include <atomic>
+#include <cassert>
+#include <cstdio> // remove
+#include <cstdlib> // getenv
+#include <fstream>
+
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+#include <unistd.h> // getpid
+#endif
+
 #include "FffProcessor.h" //To create a mesh group with if none is provided.
+#include "utils/logoutput.h"
+#include "utils/ThreadPool.h"
+#include "utils/VarintCoder.h"
 
 namespace cura
 {
 
+namespace
+{
+
+void compressPart(VarintEncoder& out, const SliceLayerPart& part)
+{
+    for (const Point& corner : { part.boundaryBox.min, part.boundaryBox.max })
+    { // the box of a part without outline is left at the extreme values
+        out.value(corner.X);
+        out.value(corner.Y);
+    }
+    out.polygons(part.outline);
+    out.polygons(part.print_outline);
+    out.polygonsList(part.insets);
+    out.count(part.skin_parts.size());
+    for (const SkinPart& skin_part : part.skin_parts)
+    {
+        out.polygons(skin_part.outline);
+        out.polygonsList(skin_part.insets);
+    }
+    out.polygons(part.infill_area);
+    out.count(static_cast<bool>(part.infill_area_own));
+    if (part.infill_area_own)
+    {
+        out.polygons(*part.infill_area_own);
+    }
+    out.count(part.infill_area_per_combine_per_density.size());
+    for (const std::vector<Polygons>& infill_area_per_combine : part.infill_area_per_combine_per_density)
+    {
+        out.polygonsList(infill_area_per_combine);
+    }
+}
+
+void decompressPart(VarintDecoder& in, SliceLayerPart& part)
+{
+    for (Point* corner : { &part.boundaryBox.min, &part.boundaryBox.max })
+    {
+        corner->X = in.value();
+        corner->Y = in.value();
+    }
+    in.polygons(part.outline);
+    in.polygons(part.print_outline);
+    in.polygonsList(part.insets);
+    part.skin_parts.resize(in.count());
+    for (SkinPart& skin_part : part.skin_parts)
+    {
+        in.polygons(skin_part.outline);
+        in.polygonsList(skin_part.insets);
+    }
+    in.polygons(part.infill_area);
+    if (in.count())
+    {
+        part.infill_area_own.emplace();
+        in.polygons(*part.infill_area_own);
+    }
+    part.infill_area_per_combine_per_density.resize(in.count());
+    for (std::vector<Polygons>& infill_area_per_combine : part.infill_area_per_combine_per_density)
+    {
+        in.polygonsList(infill_area_per_combine);
+    }
+}
+
+}//namespace
+
 Polygons& SliceLayerPart::getOwnInfillArea()
 {
     if (infill_area_own)
@@ -17,6 +94,59 @@ Polygons& SliceLayerPart::getOwnInfillArea()
     }
 }
 
+void SliceLayerPart::releasePathGeometry()
+{
+    std::vector<Polygons>().swap(infill_polygons_per_combine);
+    std::vector<Polygons>().swap(infill_lines_per_combine);
+    for (SkinPart& skin_part : skin_parts)
+    {
+        Polygons().swap(skin_part.fill_polygons);
+        Polygons().swap(skin_part.fill_lines);
+    }
+}
+
+void SliceLayerPart::translate(Point offset)
+{
+    boundaryBox.min += offset;
+    boundaryBox.max += offset;
+    outline.translate(offset);
+    print_outline.translate(offset);
+    for (Polygons& inset : insets)
+    {
+        inset.translate(offset);
+    }
+    for (SkinPart& skin_part : skin_parts)
+    {
+        skin_part.outline.translate(offset);
+        for (Polygons& inset : skin_part.insets)
+        {
+            inset.translate(offset);
+        }
+        skin_part.fill_polygons.translate(offset);
+        skin_part.fill_lines.translate(offset);
+    }
+    infill_area.translate(offset);
+    if (infill_area_own)
+    {
+        infill_area_own->translate(offset);
+    }
+    for (std::vector<Polygons>& infill_area_per_density : infill_area_per_combine_per_density)
+    {
+        for (Polygons& area : infill_area_per_density)
+        {
+            area.translate(offset);
+        }
+    }
+    for (Polygons& infill_polygons : infill_polygons_per_combine)
+    {
+        infill_polygons.translate(offset);
+    }
+    for (Polygons& infill_lines : infill_lines_per_combine)
+    {
+        infill_lines.translate(offset);
+    }
+}
+
 Polygons SliceLayer::getOutlines(bool external_polys_only) const
 {
     Polygons ret;
@@ -46,10 +176,14 @@ Polygons SliceLayer::getSecondOrInnermostWalls() const
     return ret;
 }
 
-void SliceLayer::getSecondOrInnermostWalls(Polygons& layer_walls) const
+void SliceLayer::getSecondOrInnermostWalls(Polygons& layer_walls, std::vector<unsigned int>* part_starts) const
 {
     for (const SliceLayerPart& part : parts)
     {
+        if (part_starts)
+        {
+            part_starts->push_back(layer_walls.size());
+        }
         // we want the 2nd inner walls
         if (part.insets.size() >= 2) {
             layer_walls.add(const_cast<SliceLayerPart&>(part).insets[1]); // TODO const cast!
@@ -67,6 +201,66 @@ void SliceLayer::getSecondOrInnermostWalls(Polygons& layer_walls) const
     }
 }
 
+void SliceLayer::indexParts()
+{
+    std::vector<AABB> boxes;
+    boxes.reserve(parts.size());
+    for (const SliceLayerPart& part : parts)
+    {
+        boxes.push_back(part.boundaryBox);
+    }
+    part_index.build(boxes);
+    inside_area = std::make_shared<InsideArea>();
+}
+
+void SliceLayer::copyTranslated(const SliceLayer& source, Point offset)
+{
+    parts = source.parts;
+    for (SliceLayerPart& part : parts)
+    {
+        part.translate(offset);
+    }
+    openPolyLines = source.openPolyLines;
+    openPolyLines.translate(offset);
+    indexParts();
+}
+
+const Polygons& SliceLayer::getInsideArea(int wall_line_count)
+{
+    assert(inside_area && "the inside area is only available for final parts");
+    std::call_once(inside_area->computed, [this, wall_line_count]()
+        {
+            for (SliceLayerPart& part : parts)
+            {
+                unsigned int wall_idx = std::max(0, std::min(wall_line_count, (int) part.insets.size()) - 1);
+                inside_area->area.add(part.insets[wall_idx]);
+            }
+        });
+    return inside_area->area;
+}
+
+void SliceLayer::releaseInsideArea()
+{
+    inside_area = nullptr;
+}
+
+void SliceLayer::findPartsHitting(const AABB& box, std::vector<unsigned int>& part_indices) const
+{
+    if (part_index.size() == parts.size())
+    {
+        part_index.findHits(box, part_indices);
+        return;
+    }
+    part_indices.clear();
+    for (unsigned int part_idx = 0; part_idx < parts.size(); part_idx++)
+    {
+        if (parts[part_idx].boundaryBox.hit(box))
+        {
+            part_indices.push_back(part_idx);
+        }
+    }
+}
+
 std::vector<RetractionConfig> SliceDataStorage::initializeRetractionConfigs()
 {
     std::vector<RetractionConfig> ret;
@@ -99,16 +293,33 @@ SliceDataStorage::SliceDataStorage(MeshGroup* meshgroup) : SettingsMessenger(mes
     retraction_config_per_extruder(initializeRetractionConfigs()),
     extruder_switch_retraction_config_per_extruder(initializeRetractionConfigs()),
     travel_config_per_extruder(initializeTravelConfigs()),
+    travel_policy_per_extruder(this->meshgroup->getExtruderCount()),
     skirt_brim_config(initializeSkirtBrimConfigs()),
     raft_base_config(PrintFeatureType::Support),
     raft_interface_config(PrintFeatureType::Support),
     raft_surface_config(PrintFeatureType::Support),
     support_config(PrintFeatureType::Support),
     support_skin_config(PrintFeatureType::Skin),
-    max_object_height_second_to_last_extruder(-1)
+    max_object_height_second_to_last_extruder(-1),
+    infill_cache("infill"),
+    support_infill_cache("support infill")
 {
 }
 
+void SliceDataStorage::setMeshGroup(MeshGroup* new_meshgroup)
+{
+    meshgroup = new_meshgroup;
+    setParent(new_meshgroup);
+    for (unsigned int mesh_idx = 0; mesh_idx < meshes.size(); mesh_idx++)
+    {
+        meshes[mesh_idx].setParent(&new_meshgroup->meshes[mesh_idx]);
+    }
+    // assign the configs element by element, because the path configs point to the retraction configs
+    std::vector<RetractionConfig> retraction_configs = initializeRetractionConfigs();
+    std::copy(retraction_configs.begin(), retraction_configs.end(), retraction_config_per_extruder.begin());
+    std::copy(retraction_configs.begin(), retraction_configs.end(), extruder_switch_retraction_config_per_extruder.begin());
+}
+
 Polygons SliceDataStorage::getLayerOutlines(int layer_nr, bool include_helper_parts, bool external_polys_only) const
 {
     if (layer_nr < 0)
@@ -137,20 +348,9 @@ Polygons SliceDataStorage::getLayerOutlines(int layer_nr, bool include_helper_pa
     }
     else 
     {
-        Polygons total;
-        for (const SliceMeshStorage& mesh : meshes)
-        {
-            if (mesh.getSettingBoolean("infill_mesh"))
-            {
-                continue;
-            }
-            const SliceLayer& layer = mesh.layers[layer_nr];
-            layer.getOutlines(total, external_polys_only);
-            if (const_cast<SliceMeshStorage&>(mesh).getSettingAsSurfaceMode("magic_mesh_surface_mode") != ESurfaceMode::NORMAL) // TODO: make all getSetting functions const??
-            {
-                total = total.unionPolygons(layer.openPolyLines.offsetPolyLine(100));
-            }
-        }
+        Polygons total = (!external_polys_only && static_cast<unsigned int>(layer_nr) < cached_layer_outlines.size())
+            ? cached_layer_outlines[layer_nr]
+            : computeLayerOutlines(layer_nr, external_polys_only);
         if (include_helper_parts)
         {
             if (support.generated) 
@@ -164,6 +364,51 @@ Polygons SliceDataStorage::getLayerOutlines(int layer_nr, bool include_helper_pa
     }
 }
 
+Polygons SliceDataStorage::computeLayerOutlines(int layer_nr, bool external_polys_only) const
+{
+    Polygons total;
+    for (const SliceMeshStorage& mesh : meshes)
+    {
+        if (mesh.getSettingBoolean(SettingKey::infill_mesh))
+        {
+            continue;
+        }
+        const SliceLayer& layer = mesh.layers[layer_nr];
+        layer.getOutlines(total, external_polys_only);
+        if (const_cast<SliceMeshStorage&>(mesh).getSettingAsSurfaceMode(SettingKey::magic_mesh_surface_mode) != ESurfaceMode::NORMAL) // TODO: make all getSetting functions const??
+        {
+            total = total.unionPolygons(layer.openPolyLines.offsetPolyLine(100));
+        }
+    }
+    return total;
+}
+
+void SliceDataStorage::cacheLayerOutlines(unsigned int layer_count)
+{
+    std::vector<Polygons> layer_outlines(layer_count);
+    ThreadPool::getInstance()->parallelForLayers(0, layer_count, [&](int layer_nr)
+    {
+        layer_outlines[layer_nr] = computeLayerOutlines(layer_nr, false);
+    });
+    cached_layer_outlines.swap(layer_outlines);
+}
+
+void SliceDataStorage::invalidateLayerOutlines()
+{
+    std::vector<Polygons>().swap(cached_layer_outlines);
+}
+
+const Polygons& SliceDataStorage::getCachedLayerOutlines(int layer_nr) const
+{
+    static const Polygons no_outlines;
+    if (layer_nr < 0)
+    { // the raft has no model
+        return no_outlines;
+    }
+    assert(static_cast<unsigned int>(layer_nr) < cached_layer_outlines.size() && "the outlines of the layer should have been cached");
+    return cached_layer_outlines[layer_nr];
+}
+
 Polygons SliceDataStorage::getLayerSecondOrInnermostWalls(int layer_nr, bool include_helper_parts) const
 {
     if (layer_nr < 0)
@@ -184,7 +429,7 @@ Polygons SliceDataStorage::getLayerSecondOrInnermostWalls(int layer_nr, bool inc
         {
             const SliceLayer& layer = mesh.layers[layer_nr];
             layer.getSecondOrInnermostWalls(total);
-            if (const_cast<SliceMeshStorage&>(mesh).getSettingAsSurfaceMode("magic_mesh_surface_mode") != ESurfaceMode::NORMAL) // TODO: make getSetting const? make settings.setting_values mapping mutable??
+            if (const_cast<SliceMeshStorage&>(mesh).getSettingAsSurfaceMode(SettingKey::magic_mesh_surface_mode) != ESurfaceMode::NORMAL) // TODO: make getSetting const? make settings.setting_values mapping mutable??
             {
                 total = total.unionPolygons(layer.openPolyLines.offsetPolyLine(100));
             }
@@ -203,13 +448,223 @@ Polygons SliceDataStorage::getLayerSecondOrInnermostWalls(int layer_nr, bool inc
 
 }
 
+void SliceDataStorage::releaseLayer(unsigned int layer_nr)
+{
+    releaseLayerAreas(layer_nr);
+    if (layer_nr < compressed_layers.size())
+    {
+        CompressedLayer& compressed_layer = compressed_layers[layer_nr];
+        std::string().swap(compressed_layer.data);
+        compressed_layer.spill_size = 0;
+    }
+}
+
+void SliceDataStorage::releaseLayerAreas(unsigned int layer_nr)
+{
+    // swap with empty containers, because clear() keeps the memory allocated
+    for (SliceMeshStorage& mesh : meshes)
+    {
+        if (layer_nr < mesh.layers.size())
+        {
+            SliceLayer& layer = mesh.layers[layer_nr];
+            std::vector<SliceLayerPart>().swap(layer.parts);
+            layer.part_index.clear();
+            layer.releaseInsideArea();
+            Polygons().swap(layer.openPolyLines);
+        }
+    }
+    if (layer_nr < support.supportLayers.size())
+    {
+        SupportLayer& support_layer = support.supportLayers[layer_nr];
+        Polygons().swap(support_layer.supportAreas);
+        Polygons().swap(support_layer.skin);
+    }
+    if (layer_nr < oozeShield.size())
+    {
+        Polygons().swap(oozeShield[layer_nr]);
+    }
+    if (layer_nr < cached_layer_outlines.size())
+    {
+        Polygons().swap(cached_layer_outlines[layer_nr]);
+    }
+}
+
+void SliceDataStorage::compressLayers(size_t memory_budget)
+{
+    if (!compressed_layers.empty())
+    {
+        return;
+    }
+    size_t layer_count = std::max(support.supportLayers.size(), std::max(oozeShield.size(), cached_layer_outlines.size()));
+    for (const SliceMeshStorage& mesh : meshes)
+    {
+        layer_count = std::max(layer_count, mesh.layers.size());
+    }
+    compressed_layers.resize(layer_count);
+    ThreadPool::getInstance()->parallelForLayers(0, layer_count, [&](int layer_nr)
+        {
+            VarintEncoder out;
+            for (const SliceMeshStorage& mesh : meshes)
+            {
+                if (static_cast<size_t>(layer_nr) >= mesh.layers.size())
+                {
+                    continue;
+                }
+                const SliceLayer& layer = mesh.layers[layer_nr];
+                out.count(layer.parts.size());
+                for (const SliceLayerPart& part : layer.parts)
+                {
+                    compressPart(out, part);
+                }
+                out.polygons(layer.openPolyLines);
+            }
+            if (static_cast<size_t>(layer_nr) < support.supportLayers.size())
+            {
+                out.polygons(support.supportLayers[layer_nr].supportAreas);
+                out.polygons(support.supportLayers[layer_nr].skin);
+            }
+            if (static_cast<size_t>(layer_nr) < oozeShield.size())
+            {
+                out.polygons(oozeShield[layer_nr]);
+            }
+            if (static_cast<size_t>(layer_nr) < cached_layer_outlines.size())
+            {
+                out.polygons(cached_layer_outlines[layer_nr]);
+            }
+            out.data.shrink_to_fit();
+            compressed_layers[layer_nr].data = std::move(out.data);
+            releaseLayerAreas(layer_nr);
+        }, layer_count);
+
+    size_t compressed_size = 0;
+    unsigned int first_spilled_layer = layer_count; // the layers below it fit in the memory budget
+    for (unsigned int layer_nr = 0; layer_nr < layer_count; layer_nr++)
+    {
+        compressed_size += compressed_layers[layer_nr].data.size();
+        if (memory_budget > 0 && compressed_size > memory_budget && first_spilled_layer == layer_count)
+        {
+            first_spilled_layer = layer_nr;
+        }
+    }
+    log("Compressed the areas of %i layers into %5.1f MB.\n", static_cast<int>(layer_count), compressed_size / (1024.0 * 1024.0));
+    if (first_spilled_layer < layer_count)
+    {
+        spillLayers(first_spilled_layer);
+    }
+}
+
+void SliceDataStorage::spillLayers(unsigned int first_layer)
+{
+    static std::atomic<unsigned int> spill_file_count(0); // the storages of two mesh groups may be spilled at the same time
+    const char* directory = std::getenv("TMPDIR");
+    if (!directory)
+    {
+        directory = std::getenv("TEMP");
+    }
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+    const std::string filename = std::string(directory ? directory : "/tmp") + "/cura_engine_layers_" + std::to_string(getpid()) + "_" + std::to_string(spill_file_count++) + ".tmp";
+#else
+    const std::string filename = std::string(directory ? directory : ".") + "/cura_engine_layers_" + std::to_string(spill_file_count++) + ".tmp";
+#endif
+    {
+        std::ofstream out(filename, std::ios::binary);
+        for (unsigned int layer_nr = first_layer; layer_nr < compressed_layers.size(); layer_nr++)
+        {
+            const std::string& data = compressed_layers[layer_nr].data;
+            out.write(data.data(), data.size());
+        }
+        if (!out)
+        {
+            out.close();
+            std::remove(filename.c_str());
+            logWarning("Couldn't spill the layers beyond the memory budget to %s, so they're kept in memory.\n", filename.c_str());
+            return;
+        }
+    }
+    spill_file.reset(new MappedFile(filename.c_str()));
+    std::remove(filename.c_str()); // a mapped file stays readable until it's unmapped, and otherwise it has been read into memory
+    if (!spill_file->isValid())
+    {
+        spill_file.reset();
+        logWarning("Couldn't map the layers spilled to %s, so they're kept in memory.\n", filename.c_str());
+        return;
+    }
+    size_t offset = 0;
+    for (unsigned int layer_nr = first_layer; layer_nr < compressed_layers.size(); layer_nr++)
+    {
+        CompressedLayer& compressed_layer = compressed_layers[layer_nr];
+        compressed_layer.spill_offset = offset;
+        compressed_layer.spill_size = compressed_layer.data.size();
+        offset += compressed_layer.spill_size;
+        std::string().swap(compressed_layer.data);
+    }
+    log("Spilled the areas of layers %u to %u, %5.1f MB, to a temporary file to stay within the memory budget.\n", first_layer, static_cast<unsigned int>(compressed_layers.size()) - 1, offset / (1024.0 * 1024.0));
+}
+
+void SliceDataStorage::decompressLayer(unsigned int layer_nr)
+{
+    if (layer_nr >= compressed_layers.size() || compressed_layers[layer_nr].decompressed || !compressed_layers[layer_nr].isAvailable())
+    {
+        return;
+    }
+    const CompressedLayer& compressed_layer = compressed_layers[layer_nr];
+    VarintDecoder in = (compressed_layer.spill_size > 0)
+        ? VarintDecoder(spill_file->getData() + compressed_layer.spill_offset, compressed_layer.spill_size)
+        : VarintDecoder(compressed_layer.data.data(), compressed_layer.data.size());
+    for (SliceMeshStorage& mesh : meshes)
+    {
+        if (layer_nr >= mesh.layers.size())
+        {
+            continue;
+        }
+        SliceLayer& layer = mesh.layers[layer_nr];
+        layer.parts.resize(in.count());
+        for (SliceLayerPart& part : layer.parts)
+        {
+            decompressPart(in, part);
+        }
+        in.polygons(layer.openPolyLines);
+        layer.indexParts();
+        layer.releaseInsideArea(); // it was released before the layer was compressed as well
+    }
+    if (layer_nr < support.supportLayers.size())
+    {
+        in.polygons(support.supportLayers[layer_nr].supportAreas);
+        in.polygons(support.supportLayers[layer_nr].skin);
+    }
+    if (layer_nr < oozeShield.size())
+    {
+        in.polygons(oozeShield[layer_nr]);
+    }
+    if (layer_nr < cached_layer_outlines.size())
+    {
+        in.polygons(cached_layer_outlines[layer_nr]);
+    }
+    assert(in.ok && in.atEnd() && "the compressed layer is decompressed in the order in which it was compressed");
+    if (compressed_layer.spill_size > 0)
+    { // the layers are read in order, so this one won't be read again soon
+        spill_file->releasePages(compressed_layer.spill_offset, compressed_layer.spill_size);
+    }
+    compressed_layers[layer_nr].decompressed = true;
+}
+
+void SliceDataStorage::releaseDecompressedLayer(unsigned int layer_nr)
+{
+    if (layer_nr >= compressed_layers.size() || !compressed_layers[layer_nr].decompressed || !compressed_layers[layer_nr].isAvailable())
+    {
+        return;
+    }
+    releaseLayerAreas(layer_nr);
+    compressed_layers[layer_nr].decompressed = false;
+}
+
 std::vector< bool > SliceDataStorage::getExtrudersUsed()
 {
 
     std::vector<bool> ret;
     ret.resize(meshgroup->getExtruderCount(), false);
 
-    ret[getSettingAsIndex("adhesion_extruder_nr")] = true; 
+    ret[getSettingAsIndex(SettingKey::adhesion_extruder_nr)] = true; 
     { // process brim/skirt
         for (int extr_nr = 0; extr_nr < meshgroup->getExtruderCount(); extr_nr++)
         {
@@ -225,14 +680,14 @@ std::vector< bool > SliceDataStorage::getExtrudersUsed()
 
     // support
     // support is presupposed to be present...
-    ret[getSettingAsIndex("support_extruder_nr_layer_0")] = true;
-    ret[getSettingAsIndex("support_infill_extruder_nr")] = true;
-    ret[getSettingAsIndex("support_interface_extruder_nr")] = true;
+    ret[getSettingAsIndex(SettingKey::support_extruder_nr_layer_0)] = true;
+    ret[getSettingAsIndex(SettingKey::support_infill_extruder_nr)] = true;
+    ret[getSettingAsIndex(SettingKey::support_interface_extruder_nr)] = true;
 
     // all meshes are presupposed to actually have content
     for (SliceMeshStorage& mesh : meshes)
     {
-        ret[mesh.getSettingAsIndex("extruder_nr")] = true;
+        ret[mesh.getSettingAsIndex(SettingKey::extruder_nr)] = true;
     }
     return ret;
 }
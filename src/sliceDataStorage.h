@@ -2,16 +2,25 @@
 #ifndef SLICE_DATA_STORAGE_H
 #define SLICE_DATA_STORAGE_H
 
+#include <memory>
+#include <mutex>
+#include <string>
+
 #include "utils/intpoint.h"
 #include "utils/optional.h"
 #include "utils/polygon.h"
 #include "utils/NoCopy.h"
 #include "utils/AABB.h"
+#include "utils/AABBIndex.h"
+#include "utils/MappedFile.h"
 #include "mesh.h"
 #include "gcodePlanner.h"
 #include "MeshGroup.h"
 #include "PrimeTower.h"
 #include "GCodePathConfig.h"
+#include "TravelConfig.h"
+#include "pathPlanning/CombBoundaryCache.h"
+#include "infill/InfillCache.h"
 
 namespace cura 
 {
@@ -25,6 +34,10 @@ class SkinPart
 public:
     PolygonsPart outline;           //!< The skinOutline is the area which needs to be 100% filled to generate a proper top&bottom filling. It's filled by the "skin" module.
     std::vector<Polygons> insets;   //!< The skin can have perimeters so that the skin lines always start at a perimeter instead of in the middle of an infill cell.
+
+    EFillMethod fill_pattern = EFillMethod::NONE; //!< The pattern of the skin lines, which is the lines pattern when the skin is bridging
+    Polygons fill_polygons; //!< The skin polygons (of concentric skin), generated shortly before the layer is planned
+    Polygons fill_lines; //!< The skin lines, generated shortly before the layer is planned
 };
 /*!
     The SliceLayerPart is a single enclosed printable area for a single layer. (Also known as islands)
@@ -68,12 +81,31 @@ public:
      */
     std::vector<std::vector<Polygons>> infill_area_per_combine_per_density;
 
+    /*!
+     * The infill polygons (of concentric infill) and lines in the areas of SliceLayerPart::infill_area_per_combine_per_density, for each thickness.
+     * Generated shortly before the layer is planned, and released once they have been added to the layer plan.
+     */
+    std::vector<Polygons> infill_polygons_per_combine;
+    std::vector<Polygons> infill_lines_per_combine; //!< \see SliceLayerPart::infill_polygons_per_combine
+
     /*!
      * Get the infill_area_own (or when it's not instantiated: the normal infill_area)
      * \see SliceLayerPart::infill_area_own
      * \return the own infill area
      */
     Polygons& getOwnInfillArea();
+
+    /*!
+     * Release the generated infill and skin paths of this part.
+     */
+    void releasePathGeometry();
+
+    /*!
+     * Move all areas and paths of this part in the horizontal plane, e.g. to turn a copy of a part of one mesh into the part of a translated copy of that mesh.
+     * 
+     * \param offset The direction in which to move the part
+     */
+    void translate(Point offset);
 };
 
 /*!
@@ -87,6 +119,52 @@ public:
     int printZ;     //!< The height at which this layer needs to be printed. Can differ from sliceZ due to the raft.
     std::vector<SliceLayerPart> parts;  //!< An array of LayerParts which contain the actual data. The parts are printed one at a time to minimize travel outside of the 3D model.
     Polygons openPolyLines; //!< A list of lines which were never hooked up into a 2D polygon. (Currently unused in normal operation)
+    AABBIndex part_index; //!< The index of the SliceLayerPart::boundaryBox of each part, built once the parts are final
+    uint64_t outline_hash = 0; //!< The PolygonUtils::hashPoints of the outlines of the parts before their insets were generated, to find layers with the same outlines
+
+    /*!
+     * Index the bounding boxes of the parts, so that SliceLayer::findPartsHitting doesn't need to check all parts.
+     * 
+     * Should be called once the parts don't change anymore, i.e. after the insets have been generated.
+     */
+    void indexParts();
+
+    /*!
+     * Find the parts whose bounding box overlaps with a given box.
+     * 
+     * Uses SliceLayer::part_index if it's up to date and checks all parts otherwise.
+     * 
+     * \param box The box with which to find the overlapping parts, e.g. the SliceLayerPart::boundaryBox of a part in another layer
+     * \param[out] part_indices Replaced with the indices of the overlapping parts, in increasing order
+     */
+    void findPartsHitting(const AABB& box, std::vector<unsigned int>& part_indices) const;
+
+    /*!
+     * Make this layer the copy of a layer of another mesh, moved in the horizontal plane.
+     * 
+     * The parts are copied with all their walls, skin and infill areas, after which they are indexed as by SliceLayer::indexParts.
+     * The heights of this layer are kept.
+     * 
+     * \param source The layer to copy
+     * \param offset The offset of this layer relative to \p source
+     */
+    void copyTranslated(const SliceLayer& source, Point offset);
+
+    /*!
+     * Get the area within the innermost wall of each part, which the skin of the layers above and below doesn't need to cover.
+     * 
+     * The area is computed on first use, which may be from several threads at once, and is kept until SliceLayer::releaseInsideArea.
+     * Only available once SliceLayer::indexParts has been called.
+     * 
+     * \param wall_line_count The number of walls of the mesh; the parts with fewer walls contribute their innermost wall
+     * \return The innermost walls of all parts
+     */
+    const Polygons& getInsideArea(int wall_line_count);
+
+    /*!
+     * Release the area computed by SliceLayer::getInsideArea, once the skin of all layers has been computed.
+     */
+    void releaseInsideArea();
 
     /*!
      * Get the all outlines of all layer parts in this layer.
@@ -115,8 +193,20 @@ public:
      * Collects the second wall of every part, or the outer wall if it has no second, or the outline, if it has no outer wall.
      * Add those polygons to @p result.
      * \param result The result: the collection of all polygons thus obtained
+     * \param part_starts Optional output parameter: the index into \p result of the first polygon added for each part
+     */
+    void getSecondOrInnermostWalls(Polygons& result, std::vector<unsigned int>* part_starts = nullptr) const;
+
+private:
+    /*!
+     * The lazily computed result of SliceLayer::getInsideArea, created with the index of the parts.
      */
-    void getSecondOrInnermostWalls(Polygons& result) const;
+    struct InsideArea
+    {
+        std::once_flag computed; //!< Whether InsideArea::area has been computed
+        Polygons area; //!< The innermost walls of all parts
+    };
+    std::shared_ptr<InsideArea> inside_area; //!< The area returned by SliceLayer::getInsideArea, or nullptr when the parts aren't final or it has been released
 };
 
 /******************/
@@ -148,6 +238,9 @@ public:
 
     int layer_nr_max_filled_layer; //!< the layer number of the uppermost layer with content (modified while infill meshes are processed)
 
+    int copy_of_mesh_idx; //!< The mesh of which this mesh is a copy moved in the horizontal plane, whose walls, skin and infill are copied instead of computed again, or -1 when this mesh is computed by itself
+    Point copy_offset; //!< The offset of this mesh relative to the mesh of SliceMeshStorage::copy_of_mesh_idx
+
     GCodePathConfig inset0_config;
     GCodePathConfig insetX_config;
     GCodePathConfig skin_config;
@@ -156,6 +249,8 @@ public:
     SliceMeshStorage(SettingsBaseVirtual* settings, unsigned int slice_layer_count)
     : SettingsMessenger(settings)
     , layer_nr_max_filled_layer(0)
+    , copy_of_mesh_idx(-1)
+    , copy_offset(0, 0)
     , inset0_config(PrintFeatureType::OuterWall)
     , insetX_config(PrintFeatureType::InnerWall)
     , skin_config(PrintFeatureType::Skin)
@@ -169,6 +264,7 @@ public:
 
 class SliceDataStorage : public SettingsMessenger, NoCopy
 {
+    friend class SliceDataSnapshot; // stores and restores the cached layer outlines
 public:
     MeshGroup* meshgroup; // needed to pass on the per extruder settings.. (TODO: put this somewhere else? Put the per object settings here directly, or a pointer only to the per object settings.)
 
@@ -179,6 +275,7 @@ public:
     std::vector<RetractionConfig> extruder_switch_retraction_config_per_extruder; //!< Retraction config per extruder for when performing an extruder switch
 
     std::vector<GCodePathConfig> travel_config_per_extruder; //!< The config used for travel moves (only speed is set!)
+    std::vector<TravelConfig> travel_policy_per_extruder; //!< How the travel moves of each extruder are planned
 
     std::vector<GCodePathConfig> skirt_brim_config; //!< Configuration for skirt and brim per extruder.
     std::vector<CoastingConfig> coasting_config; //!< coasting config per extruder
@@ -202,6 +299,21 @@ public:
     Polygons draft_protection_shield; //!< The polygons for a heightened skirt which protects from warping by gusts of wind and acts as a heated chamber.
     Point wipePoint;
 
+    /*!
+     * The height and thickness of a layer, as reported to the frontend while generating the areas.
+     */
+    struct LayerInfo
+    {
+        int layer_nr;
+        int32_t z;
+        int32_t thickness;
+    };
+    std::vector<LayerInfo> layer_infos; //!< The layers reported to the frontend, kept to report them again when the sliced data is reused
+
+    CombBoundaryCache comb_boundary_cache; //!< The comb boundaries of the most recently planned layers, shared between layers with the same outlines
+    InfillCache infill_cache; //!< The infill generated for the most recently planned infill areas, reused by layers with the same infill areas
+    InfillCache support_infill_cache; //!< The support infill generated for the most recently planned support islands, reused by layers with the same support islands
+
     /*!
      * Construct the initial retraction_config_per_extruder
      */
@@ -229,6 +341,15 @@ public:
      */
     SliceDataStorage(MeshGroup* meshgroup);
 
+    /*!
+     * Let the sliced data of a previous mesh group be used for a new mesh group with the same meshes.
+     * 
+     * Points all settings to the new mesh group and its meshes and resets the configurations made in the constructor.
+     * 
+     * \param meshgroup The new mesh group, which has as many meshes as the old one
+     */
+    void setMeshGroup(MeshGroup* meshgroup);
+
     ~SliceDataStorage()
     {
     }
@@ -242,6 +363,29 @@ public:
      */
     Polygons getLayerOutlines(int layer_nr, bool include_helper_parts, bool external_polys_only = false) const;
 
+    /*!
+     * Compute the outlines of the model in the layers [0, \p layer_count) at once, in parallel,
+     * after which getLayerOutlines and getCachedLayerOutlines take them from the cache instead of joining the outlines of all meshes again.
+     * 
+     * The cache is only valid as long as the print outlines of the layer parts don't change;
+     * it has to be computed again or invalidated when they do.
+     * 
+     * \param layer_count The number of layers for which to compute the outlines
+     */
+    void cacheLayerOutlines(unsigned int layer_count);
+
+    /*!
+     * Forget the outlines computed by cacheLayerOutlines, so that getLayerOutlines computes them from the layer parts again.
+     */
+    void invalidateLayerOutlines();
+
+    /*!
+     * Get the outlines of the model within a given layer, without helper parts, from the cache computed by cacheLayerOutlines.
+     * 
+     * \param layer_nr the index of the layer for which to get the outlines; below zero no outlines are returned
+     */
+    const Polygons& getCachedLayerOutlines(int layer_nr) const;
+
     /*!
      * Collects the second wall of every part, or the outer wall if it has no second, or the outline, if it has no outer wall.
      * 
@@ -252,12 +396,95 @@ public:
      */
     Polygons getLayerSecondOrInnermostWalls(int layer_nr, bool include_helper_parts) const;
 
+    /*!
+     * Free the areas of a layer of all meshes, its support and its ooze shield, once no gcode is planned from them anymore.
+     * 
+     * The layer itself and its heights are kept, so that the other layers keep their layer numbers.
+     * 
+     * \param layer_nr The index of the layer to release
+     */
+    void releaseLayer(unsigned int layer_nr);
+
+    /*!
+     * Compress the areas of every layer of all meshes, its support, its ooze shield and its cached outlines, and free the uncompressed areas.
+     * 
+     * This keeps the sliced data in a fraction of the memory while it waits for its gcode to be written.
+     * The heights of the layers and the data of the whole print, like the skirt, brim and raft, aren't compressed.
+     * Nothing is done when the layers are compressed already, e.g. when the storage is reused.
+     * 
+     * When the compressed layers take more memory than \p memory_budget, the layers above those which fit are spilled to a temporary file,
+     * which is memory-mapped to decompress them from. The gcode writer reads the layers bottom up, so the file is read ahead sequentially.
+     * 
+     * \param memory_budget The number of bytes the compressed layers may take in memory, or zero to keep them all in memory
+     */
+    void compressLayers(size_t memory_budget = 0);
+
+    /*!
+     * Restore the areas of a layer compressed by compressLayers, before its gcode is planned.
+     * 
+     * Nothing is done when the layer isn't compressed or has been decompressed already.
+     * Different layers can be decompressed from several threads at once.
+     * 
+     * \param layer_nr The index of the layer to decompress
+     */
+    void decompressLayer(unsigned int layer_nr);
+
+    /*!
+     * Free the areas of a layer once no gcode is planned from them anymore, as long as they can be decompressed again.
+     * 
+     * Unlike releaseLayer this keeps the compressed areas, so that the storage can be written again.
+     * 
+     * \param layer_nr The index of the layer of which to free the uncompressed areas
+     */
+    void releaseDecompressedLayer(unsigned int layer_nr);
+
     /*!
      * Get the extruders used.
      * 
      * \return a vector of bools indicating whether the extruder with corresponding index is used in this layer.
      */
     std::vector<bool> getExtrudersUsed();
+
+private:
+    std::vector<Polygons> cached_layer_outlines; //!< The outlines of the model per layer, without helper parts, as computed by cacheLayerOutlines; empty when there's no cache
+
+    /*!
+     * The areas of a layer as compressed by compressLayers.
+     */
+    struct CompressedLayer
+    {
+        std::string data; //!< The compressed areas, unless they have been spilled to SliceDataStorage::spill_file
+        size_t spill_offset = 0; //!< Where the compressed areas start in SliceDataStorage::spill_file, if they have been spilled
+        size_t spill_size = 0; //!< The number of bytes of the compressed areas in SliceDataStorage::spill_file, or zero when they're kept in CompressedLayer::data
+        bool decompressed = false; //!< Whether the areas have been restored by decompressLayer
+
+        /*!
+         * Whether the compressed areas are still available, i.e. the layer hasn't been released.
+         */
+        bool isAvailable() const
+        {
+            return !data.empty() || spill_size > 0;
+        }
+    };
+    std::vector<CompressedLayer> compressed_layers; //!< The compressed areas per layer; empty when the layers aren't compressed
+    std::unique_ptr<MappedFile> spill_file; //!< The temporary file to which the compressed areas of the layers beyond the memory budget are spilled, if any
+
+    /*!
+     * Move the compressed areas of the layers from \p first_layer on to a temporary file and map it.
+     * 
+     * The layers stay in memory when the file can't be written.
+     */
+    void spillLayers(unsigned int first_layer);
+
+    /*!
+     * Free the areas of a layer of all meshes, its support, its ooze shield and its cached outlines.
+     */
+    void releaseLayerAreas(unsigned int layer_nr);
+
+    /*!
+     * Join the outlines of the model of all meshes within a given layer, without helper parts.
+     */
+    Polygons computeLayerOutlines(int layer_nr, bool external_polys_only) const;
 };
 
 }//namespace cura
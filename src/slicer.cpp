@@ -1,12 +1,19 @@
 /** Copyright (C) 2013 David Braam - Released under terms of the AGPLv3 License */
 #include <stdio.h>
 
-#include <algorithm> // remove_if
+#include <algorithm> // remove_if, lower_bound, sort
+#include <atomic>
+#include <numeric> // iota
 
+#include "utils/AABB.h"
 #include "utils/gettime.h"
+#include "utils/hugePages.h"
 #include "utils/logoutput.h"
 #include "utils/SparseGrid.h"
+#include "utils/ThreadPool.h"
+#include "utils/Trace.h"
 
+#include "progress/ProfilingReport.h"
 #include "slicer.h"
 
 
@@ -25,8 +32,8 @@ void SlicerLayer::makeBasicPolygonLoops(const Mesh* mesh, Polygons& open_polylin
             makeBasicPolygonLoop(mesh, open_polylines, start_segment_idx);
         }
     }
-    //Clear the segmentList to save memory, it is no longer needed after this point.
-    segments.clear();
+    //Free the segmentList to save memory, it is no longer needed after this point.
+    std::vector<SlicerSegment>().swap(segments);
 }
 
 void SlicerLayer::makeBasicPolygonLoop(const Mesh* mesh, Polygons& open_polylines, unsigned int start_segment_idx)
@@ -53,12 +60,10 @@ void SlicerLayer::makeBasicPolygonLoop(const Mesh* mesh, Polygons& open_polyline
 
 int SlicerLayer::tryFaceNextSegmentIdx(const Mesh* mesh, const SlicerSegment& segment, int face_idx, unsigned int start_segment_idx) const
 {
-    decltype(face_idx_to_segment_idx.begin()) it;
-    auto it_end = face_idx_to_segment_idx.end();
-    it = face_idx_to_segment_idx.find(face_idx);
-    if (it != it_end)
+    auto it = std::lower_bound(segments.begin(), segments.end(), face_idx, [](const SlicerSegment& segment, int face_idx) { return segment.faceIndex < face_idx; });
+    if (it != segments.end() && it->faceIndex == face_idx)
     {
-        int segment_idx = (*it).second;
+        int segment_idx = it - segments.begin();
         Point p1 = segments[segment_idx].start;
         Point diff = segment.end - p1;
         if (shorterThen(diff, largest_neglected_gap_first_phase))
@@ -82,7 +87,7 @@ int SlicerLayer::getNextSegmentIdx(const Mesh* mesh, const SlicerSegment& segmen
 {
     int next_segment_idx = -1;
 
-    bool segment_ended_at_edge = segment.endVertex == nullptr;
+    bool segment_ended_at_edge = segment.endVertexIdx == -1;
     if (segment_ended_at_edge)
     {
         int face_to_try = segment.endOtherFaceIdx;
@@ -96,8 +101,7 @@ int SlicerLayer::getNextSegmentIdx(const Mesh* mesh, const SlicerSegment& segmen
     {
         // segment ended at vertex
 
-        const std::vector<uint32_t> &faces_to_try = segment.endVertex->connected_faces;
-        for (int face_to_try : faces_to_try)
+        for (int face_to_try : mesh->getConnectedFaces(segment.endVertexIdx))
         {
             int result_segment_idx =
                 tryFaceNextSegmentIdx(mesh,segment,face_to_try,start_segment_idx);
@@ -119,16 +123,13 @@ int SlicerLayer::getNextSegmentIdx(const Mesh* mesh, const SlicerSegment& segmen
 void SlicerLayer::connectOpenPolylines(Polygons& open_polylines)
 {
     bool allow_reverse = false;
-    // Search a bit fewer cells but at cost of covering more area.
-    // Since acceptance area is small to start with, the extra is unlikely to hurt much.
-    coord_t cell_size = largest_neglected_gap_first_phase * 2;
-    connectOpenPolylinesImpl(open_polylines, largest_neglected_gap_second_phase, cell_size, allow_reverse);
+    connectOpenPolylinesImpl(open_polylines, largest_neglected_gap_second_phase, allow_reverse);
 }
 
 void SlicerLayer::stitch(Polygons& open_polylines)
 {
     bool allow_reverse = true;
-    connectOpenPolylinesImpl(open_polylines, max_stitch1, max_stitch1, allow_reverse);
+    connectOpenPolylinesImpl(open_polylines, max_stitch1, allow_reverse);
 }
 
 const SlicerLayer::Terminus SlicerLayer::Terminus::INVALID_TERMINUS{~static_cast<Index>(0U)};
@@ -180,7 +181,7 @@ bool SlicerLayer::PossibleStitch::operator<(const PossibleStitch& other) const
 std::priority_queue<SlicerLayer::PossibleStitch>
 SlicerLayer::findPossibleStitches(
     const Polygons& open_polylines,
-    coord_t max_dist, coord_t cell_size,
+    coord_t max_dist,
     bool allow_reverse) const
 {
     std::priority_queue<PossibleStitch> stitch_queue;
@@ -205,15 +206,36 @@ SlicerLayer::findPossibleStitches(
         }
     };
 
+    using StitchGrid = SparseGridInvasive<StitchGridVal,StitchGridValLocator>;
+
+    // Aim for about two terminal points per cell, the number of polylines
+    // varies from a few in a coarse layer to many thousands in a detailed
+    // one.  The cells are kept small enough that a query doesn't visit
+    // more than 2x2 cells of needless elements, and large enough that it
+    // doesn't visit more than 9x9 cells.
+    AABB termini_box;
+    for (unsigned int polyline_idx = 0; polyline_idx < open_polylines.size(); polyline_idx++)
+    {
+        const PolygonRef polyline = open_polylines[polyline_idx];
+        if (polyline.size() > 0)
+        {
+            termini_box.include(polyline[0]);
+            termini_box.include(polyline.back());
+        }
+    }
+    const coord_t cell_size = StitchGrid::chooseCellSize(termini_box.min, termini_box.max, open_polylines.size(), 2.0, std::max(coord_t(1), max_dist / 4), max_dist * 2);
+
     // Used to find nearby end points within a fixed maximum radius
-    SparseGridInvasive<StitchGridVal,StitchGridValLocator> grid_ends(cell_size);
+    StitchGrid grid_ends(cell_size);
     // Used to find nearby start points within a fixed maximum radius
-    SparseGridInvasive<StitchGridVal,StitchGridValLocator> grid_starts(cell_size);
+    StitchGrid grid_starts(cell_size);
 
     // populate grids
 
     // Inserts the ends of all polylines into the grid (does not
     //   insert the starts of the polylines).
+    std::vector<StitchGridVal> grid_vals;
+    grid_vals.reserve(open_polylines.size());
     for(unsigned int polyline_0_idx = 0; polyline_0_idx < open_polylines.size(); polyline_0_idx++)
     {
         const PolygonRef polyline_0 = open_polylines[polyline_0_idx];
@@ -223,12 +245,18 @@ SlicerLayer::findPossibleStitches(
         StitchGridVal grid_val;
         grid_val.polyline_idx = polyline_0_idx;
         grid_val.polyline_term_pt = polyline_0.back();
-        grid_ends.insert(grid_val);
+        grid_vals.push_back(grid_val);
+    }
+    grid_ends.insertAll(grid_vals);
+    if (!grid_vals.empty())
+    {
+        ProfilingReport::getInstance().recordGrid("polyline_stitch", grid_ends);
     }
 
     // Inserts the start of all polylines into the grid.
     if (allow_reverse)
     {
+        grid_vals.clear();
         for(unsigned int polyline_0_idx = 0; polyline_0_idx < open_polylines.size(); polyline_0_idx++)
         {
             const PolygonRef polyline_0 = open_polylines[polyline_0_idx];
@@ -238,7 +266,12 @@ SlicerLayer::findPossibleStitches(
             StitchGridVal grid_val;
             grid_val.polyline_idx = polyline_0_idx;
             grid_val.polyline_term_pt = polyline_0[0];
-            grid_starts.insert(grid_val);
+            grid_vals.push_back(grid_val);
+        }
+        grid_starts.insertAll(grid_vals);
+        if (!grid_vals.empty())
+        {
+            ProfilingReport::getInstance().recordGrid("polyline_stitch", grid_starts);
         }
     }
 
@@ -444,12 +477,12 @@ void SlicerLayer::TerminusTrackingMap::updateMap(
     }
 }
 
-void SlicerLayer::connectOpenPolylinesImpl(Polygons& open_polylines, coord_t max_dist, coord_t cell_size, bool allow_reverse)
+void SlicerLayer::connectOpenPolylinesImpl(Polygons& open_polylines, coord_t max_dist, bool allow_reverse)
 {
     // below code closes smallest gaps first
 
     std::priority_queue<PossibleStitch> stitch_queue =
-        findPossibleStitches(open_polylines, max_dist, cell_size, allow_reverse);
+        findPossibleStitches(open_polylines, max_dist, allow_reverse);
 
     static const Terminus INVALID_TERMINUS = Terminus::INVALID_TERMINUS;
     Terminus::Index terminus_end_idx = Terminus::endIndexFromPolylineEndIndex(open_polylines.size());
@@ -543,6 +576,21 @@ void SlicerLayer::stitch_extensive(Polygons& open_polylines)
     // And generate a path over this shortest bit to link up the 2 open polygons.
     // (If these 2 open polygons are the same polygon, then the final result is a closed polyon)
 
+    // Polygons are only ever added to the closed polygons while stitching, so the segments of the polygons we start with are indexed only once
+    // and where the polylines touch the polygons only has to be found again for the polylines which change.
+    const PolygonsSegmentIndex segment_index(polygons);
+    std::vector<ClosePolygonResult> start_on_polygon(open_polylines.size()); // Where the start of each polyline touches the polygons
+    std::vector<ClosePolygonResult> end_on_polygon(open_polylines.size()); // Where the end of each polyline touches the polygons
+    for (unsigned int polyline_idx = 0; polyline_idx < open_polylines.size(); polyline_idx++)
+    {
+        const PolygonRef polyline = open_polylines[polyline_idx];
+        if (polyline.size() < 1) continue;
+        start_on_polygon[polyline_idx] = findPolygonPointClosestTo(polyline[0], segment_index, 0);
+        end_on_polygon[polyline_idx] = findPolygonPointClosestTo(polyline.back(), segment_index, 0);
+    }
+    std::vector<std::pair<int, unsigned int>> ends_by_polygon; // The polygon and the polyline of each polyline end touching a polygon, ordered by polygon
+    std::vector<std::vector<int64_t>> lengths_along_polygons(polygons.size()); // For each polygon, once needed, the lengths along it up to each of its points
+
     while(1)
     {
         unsigned int best_polyline_1_idx = -1;
@@ -553,13 +601,29 @@ void SlicerLayer::stitch_extensive(Polygons& open_polylines)
         best_result.pointIdxA = -1;
         best_result.pointIdxB = -1;
 
+        ends_by_polygon.clear();
+        for (unsigned int polyline_idx = 0; polyline_idx < open_polylines.size(); polyline_idx++)
+        {
+            if (end_on_polygon[polyline_idx].polygonIdx >= 0)
+            {
+                ends_by_polygon.emplace_back(end_on_polygon[polyline_idx].polygonIdx, polyline_idx);
+            }
+        }
+        std::sort(ends_by_polygon.begin(), ends_by_polygon.end());
+
         for(unsigned int polyline_1_idx = 0; polyline_1_idx < open_polylines.size(); polyline_1_idx++)
         {
             PolygonRef polyline_1 = open_polylines[polyline_1_idx];
-            if (polyline_1.size() < 1) continue;
+            const ClosePolygonResult& start_1 = start_on_polygon[polyline_1_idx];
+            if (polyline_1.size() < 1 || start_1.polygonIdx < 0) continue;
+            std::vector<int64_t>& lengths_along_polygon = lengths_along_polygons[start_1.polygonIdx];
+            if (lengths_along_polygon.empty())
+            {
+                getLengthsAlongPolygon(polygons[start_1.polygonIdx], lengths_along_polygon);
+            }
 
             {
-                GapCloserResult res = findPolygonGapCloser(polyline_1[0], polyline_1.back());
+                GapCloserResult res = findPolygonGapCloser(polyline_1[0], polyline_1.back(), start_1, end_on_polygon[polyline_1_idx], lengths_along_polygon);
                 if (res.len > 0 && res.len < best_result.len)
                 {
                     best_polyline_1_idx = polyline_1_idx;
@@ -568,12 +632,15 @@ void SlicerLayer::stitch_extensive(Polygons& open_polylines)
                 }
             }
 
-            for(unsigned int polyline_2_idx = 0; polyline_2_idx < open_polylines.size(); polyline_2_idx++)
+            // Only the polylines ending on the same polygon can be connected; they are still tried in order of index.
+            for (auto end_it = std::lower_bound(ends_by_polygon.begin(), ends_by_polygon.end(), std::make_pair(start_1.polygonIdx, 0u));
+                end_it != ends_by_polygon.end() && end_it->first == start_1.polygonIdx; ++end_it)
             {
+                unsigned int polyline_2_idx = end_it->second;
+                if (polyline_1_idx == polyline_2_idx) continue;
                 PolygonRef polyline_2 = open_polylines[polyline_2_idx];
-                if (polyline_2.size() < 1 || polyline_1_idx == polyline_2_idx) continue;
 
-                GapCloserResult res = findPolygonGapCloser(polyline_1[0], polyline_2.back());
+                GapCloserResult res = findPolygonGapCloser(polyline_1[0], polyline_2.back(), start_1, end_on_polygon[polyline_2_idx], lengths_along_polygon);
                 if (res.len > 0 && res.len < best_result.len)
                 {
                     best_polyline_1_idx = polyline_1_idx;
@@ -638,6 +705,31 @@ void SlicerLayer::stitch_extensive(Polygons& open_polylines)
                     open_polylines[best_polyline_1_idx].clear();
                 }
             }
+
+            start_on_polygon[best_polyline_1_idx] = ClosePolygonResult();
+            end_on_polygon[best_polyline_1_idx] = ClosePolygonResult();
+            if (best_polyline_1_idx == best_polyline_2_idx)
+            { // a polygon has been added, which only matters to the polyline ends which didn't touch any of the polygons before it
+                const unsigned int new_poly_idx = polygons.size() - 1;
+                lengths_along_polygons.resize(polygons.size());
+                for (unsigned int polyline_idx = 0; polyline_idx < open_polylines.size(); polyline_idx++)
+                {
+                    const PolygonRef polyline = open_polylines[polyline_idx];
+                    if (polyline.size() < 1) continue;
+                    if (start_on_polygon[polyline_idx].polygonIdx < 0)
+                    {
+                        start_on_polygon[polyline_idx] = findPolygonPointClosestTo(polyline[0], segment_index, new_poly_idx);
+                    }
+                    if (end_on_polygon[polyline_idx].polygonIdx < 0)
+                    {
+                        end_on_polygon[polyline_idx] = findPolygonPointClosestTo(polyline.back(), segment_index, new_poly_idx);
+                    }
+                }
+            }
+            else
+            { // only the end of polyline 2 has changed
+                end_on_polygon[best_polyline_2_idx] = findPolygonPointClosestTo(open_polylines[best_polyline_2_idx].back(), segment_index, 0);
+            }
         }
         else
         {
@@ -646,11 +738,9 @@ void SlicerLayer::stitch_extensive(Polygons& open_polylines)
     }
 }
 
-GapCloserResult SlicerLayer::findPolygonGapCloser(Point ip0, Point ip1)
+GapCloserResult SlicerLayer::findPolygonGapCloser(Point ip0, Point ip1, const ClosePolygonResult& c1, const ClosePolygonResult& c2, const std::vector<int64_t>& lengths_along_polygon) const
 {
     GapCloserResult ret;
-    ClosePolygonResult c1 = findPolygonPointClosestTo(ip0);
-    ClosePolygonResult c2 = findPolygonPointClosestTo(ip1);
     if (c1.polygonIdx < 0 || c1.polygonIdx != c2.polygonIdx)
     {
         ret.len = -1;
@@ -667,25 +757,19 @@ GapCloserResult SlicerLayer::findPolygonGapCloser(Point ip0, Point ip1)
         ret.len = vSize(ip0 - ip1);
     }else{
         //Find out if we have should go from A to B or the other way around.
-        Point p0 = polygons[ret.polygonIdx][ret.pointIdxA];
-        int64_t lenA = vSize(p0 - ip0);
-        for(unsigned int i = ret.pointIdxA; i != ret.pointIdxB; i = (i + 1) % polygons[ret.polygonIdx].size())
-        {
-            Point p1 = polygons[ret.polygonIdx][i];
-            lenA += vSize(p0 - p1);
-            p0 = p1;
-        }
-        lenA += vSize(p0 - ip1);
-
-        p0 = polygons[ret.polygonIdx][ret.pointIdxB];
-        int64_t lenB = vSize(p0 - ip1);
-        for(unsigned int i = ret.pointIdxB; i != ret.pointIdxA; i = (i + 1) % polygons[ret.polygonIdx].size())
+        const PolygonRef poly = polygons[ret.polygonIdx];
+        const int64_t circumference = lengths_along_polygon.back() + vSize(poly[0] - poly.back());
+        // the length along the polygon going forward from one of its points to another
+        auto length_along = [&](unsigned int from, unsigned int to)
         {
-            Point p1 = polygons[ret.polygonIdx][i];
-            lenB += vSize(p0 - p1);
-            p0 = p1;
-        }
-        lenB += vSize(p0 - ip0);
+            const int64_t length = lengths_along_polygon[to] - lengths_along_polygon[from];
+            return (to < from) ? length + circumference : length;
+        };
+        // the way goes up to the start of the line segment on which the other point lies
+        const unsigned int before_A = (ret.pointIdxA == 0) ? poly.size() - 1 : ret.pointIdxA - 1;
+        const unsigned int before_B = (ret.pointIdxB == 0) ? poly.size() - 1 : ret.pointIdxB - 1;
+        const int64_t lenA = vSize(poly[ret.pointIdxA] - ip0) + length_along(ret.pointIdxA, before_B) + vSize(poly[before_B] - ip1);
+        const int64_t lenB = vSize(poly[ret.pointIdxB] - ip1) + length_along(ret.pointIdxB, before_A) + vSize(poly[before_A] - ip0);
 
         if (lenA < lenB)
         {
@@ -699,15 +783,34 @@ GapCloserResult SlicerLayer::findPolygonGapCloser(Point ip0, Point ip1)
     return ret;
 }
 
-ClosePolygonResult SlicerLayer::findPolygonPointClosestTo(Point input)
+void SlicerLayer::getLengthsAlongPolygon(const PolygonRef poly, std::vector<int64_t>& lengths_along_polygon)
+{
+    lengths_along_polygon.resize(poly.size());
+    int64_t length = 0;
+    for (unsigned int point_idx = 0; point_idx < poly.size(); point_idx++)
+    {
+        if (point_idx > 0)
+        {
+            length += vSize(poly[point_idx] - poly[point_idx - 1]);
+        }
+        lengths_along_polygon[point_idx] = length;
+    }
+}
+
+ClosePolygonResult SlicerLayer::findPolygonPointClosestTo(Point input, const PolygonsSegmentIndex& segment_index, unsigned int start_poly_idx) const
 {
     ClosePolygonResult ret;
-    for(unsigned int n=0; n<polygons.size(); n++)
+    Point box_min = input - Point(100, 100);
+    Point box_max = input + Point(100, 100);
+    const AABB box(box_min, box_max); // the point on the segment lies within the bounding box of the segment
+    for(unsigned int n = start_poly_idx; n < polygons.size(); n++)
     {
-        Point p0 = polygons[n][polygons[n].size()-1];
-        for(unsigned int i=0; i<polygons[n].size(); i++)
+        const PolygonRef poly = polygons[n];
+        // returns whether to continue with the next segment
+        auto check_segment = [&](unsigned int i)
         {
-            Point p1 = polygons[n][i];
+            Point p0 = poly[(i == 0) ? poly.size() - 1 : i - 1];
+            Point p1 = poly[i];
 
             //Q = A + Normal( B - A ) * ((( B - A ) dot ( P - A )) / VSize( A - B ));
             Point pDiff = p1 - p0;
@@ -723,18 +826,35 @@ ClosePolygonResult SlicerLayer::findPolygonPointClosestTo(Point input)
                         ret.intersectionPoint = q;
                         ret.polygonIdx = n;
                         ret.pointIdx = i;
-                        return ret;
+                        return false;
                     }
                 }
             }
-            p0 = p1;
+            return true;
+        };
+        if (n < segment_index.getPolygonCount())
+        {
+            if (!segment_index.processSegmentsNear(n, box, check_segment))
+            {
+                return ret;
+            }
+        }
+        else
+        {
+            for(unsigned int i=0; i<poly.size(); i++)
+            {
+                if (!check_segment(i))
+                {
+                    return ret;
+                }
+            }
         }
     }
     ret.polygonIdx = -1;
     return ret;
 }
 
-void SlicerLayer::makePolygons(const Mesh* mesh, bool keep_none_closed, bool extensive_stitching)
+unsigned int SlicerLayer::makePolygons(const Mesh* mesh, bool keep_none_closed, bool extensive_stitching)
 {
     Polygons open_polylines;
 
@@ -744,7 +864,7 @@ void SlicerLayer::makePolygons(const Mesh* mesh, bool keep_none_closed, bool ext
 
     // TODO: (?) for mesh surface mode: connect open polygons. Maybe the above algorithm can create two open polygons which are actually connected when the starting segment is in the middle between the two open polygons.
 
-    if (mesh->getSettingAsSurfaceMode("magic_mesh_surface_mode") == ESurfaceMode::NORMAL)
+    if (mesh->getSettingAsSurfaceMode(SettingKey::magic_mesh_surface_mode) == ESurfaceMode::NORMAL)
     { // don't stitch when using (any) mesh surface mode, i.e. also don't stitch when using mixed mesh surface and closed polygons, because then polylines which are supposed to be open will be closed
         stitch(open_polylines);
     }
@@ -777,121 +897,296 @@ void SlicerLayer::makePolygons(const Mesh* mesh, bool keep_none_closed, bool ext
     //Finally optimize all the polygons. Every point removed saves time in the long run.
     polygons.simplify();
 
+    unsigned int removed_point_count = 0;
+    const int max_deviation = mesh->getSettingInMicrons(SettingKey::meshfix_maximum_deviation);
+    if (max_deviation > 0)
+    { // finely tessellated meshes give many more points than the accuracy of the print needs
+        removed_point_count = polygons.simplifyWithinDeviation(max_deviation);
+    }
+
     polygons.removeDegenerateVerts(); // remove verts connected to overlapping line segments
 
-    int xy_offset = mesh->getSettingInMicrons("xy_offset");
+    int xy_offset = mesh->getSettingInMicrons(SettingKey::xy_offset);
     if (xy_offset != 0)
     {
         polygons = polygons.offset(xy_offset);
     }
+    return removed_point_count;
 }
 
 
-Slicer::Slicer(const Mesh* mesh, int initial, int thickness, int slice_layer_count, bool keep_none_closed, bool extensive_stitching)
+Slicer::Slicer(const Mesh* mesh, int initial, int thickness, int slice_layer_count, bool keep_none_closed, bool extensive_stitching, const std::atomic<bool>* cancelled)
+: Slicer(mesh, initial, thickness, slice_layer_count, keep_none_closed, extensive_stitching, 0, slice_layer_count - 1, cancelled)
+{
+}
+
+Slicer::Slicer(const Mesh* mesh, int initial, int thickness, int slice_layer_count, bool keep_none_closed, bool extensive_stitching, int first_layer, int last_layer, const std::atomic<bool>* cancelled)
 : mesh(mesh)
+, initial(initial)
+, thickness(thickness)
+, keep_none_closed(keep_none_closed)
+, extensive_stitching(extensive_stitching)
+, cancelled(cancelled)
 {
     assert(slice_layer_count > 0);
 
-    TimeKeeper slice_timer;
-
     layers.resize(slice_layer_count);
-
-
     for(int32_t layer_nr = 0; layer_nr < slice_layer_count; layer_nr++)
     {
         layers[layer_nr].z = initial + thickness * layer_nr;
     }
 
-    for(unsigned int mesh_idx = 0; mesh_idx < mesh->faces.size(); mesh_idx++)
-    {
-        const MeshFace& face = mesh->faces[mesh_idx];
-        const MeshVertex& v0 = mesh->vertices[face.vertex_index[0]];
-        const MeshVertex& v1 = mesh->vertices[face.vertex_index[1]];
-        const MeshVertex& v2 = mesh->vertices[face.vertex_index[2]];
-        Point3 p0 = v0.p;
-        Point3 p1 = v1.p;
-        Point3 p2 = v2.p;
-        int32_t minZ = p0.z;
-        int32_t maxZ = p0.z;
-        if (p1.z < minZ) minZ = p1.z;
-        if (p2.z < minZ) minZ = p2.z;
-        if (p1.z > maxZ) maxZ = p1.z;
-        if (p2.z > maxZ) maxZ = p2.z;
-        int32_t layer_max = (maxZ - initial) / thickness;
-        for(int32_t layer_nr = (minZ - initial) / thickness; layer_nr <= layer_max; layer_nr++)
-        {
-            int32_t z = layer_nr * thickness + initial;
-            if (z < minZ) continue;
-            if (layer_nr < 0) continue;
-
-            SlicerSegment s;
-            s.endVertex = nullptr;
-            int end_edge_idx = -1;
-            if (p0.z < z && p1.z >= z && p2.z >= z)
-            {
-                s = project2D(p0, p2, p1, z);
-                end_edge_idx = 0;
-                if (p1.z == z)
-                {
-                    s.endVertex = &v1;
-                }
-            }
-            else if (p0.z > z && p1.z < z && p2.z < z)
-            {
-                s = project2D(p0, p1, p2, z);
-                end_edge_idx = 2;
+    sliceLayers(first_layer, last_layer);
+}
 
-            }
+void Slicer::sliceLayers(int first_layer, int last_layer)
+{
+    first_layer = std::max(0, first_layer);
+    last_layer = std::min(static_cast<int>(layers.size()) - 1, last_layer);
+    if (first_layer > last_layer)
+    {
+        return;
+    }
+    TRACE_SCOPE("Slicer::sliceLayers", -1, -1);
 
-            else if (p1.z < z && p0.z >= z && p2.z >= z)
-            {
-                s = project2D(p1, p0, p2, z);
-                end_edge_idx = 1;
-                if (p2.z == z)
-                {
-                    s.endVertex = &v2;
-                }
-            }
-            else if (p1.z > z && p0.z < z && p2.z < z)
-            {
-                s = project2D(p1, p2, p0, z);
-                end_edge_idx = 0;
+    TimeKeeper slice_timer;
 
-            }
+    buildLayerFaceIndex(first_layer, last_layer);
+    const unsigned int prismatic_layer_count = findPrismaticLayers(first_layer, last_layer);
 
-            else if (p2.z < z && p1.z >= z && p0.z >= z)
-            {
-                s = project2D(p2, p1, p0, z);
-                end_edge_idx = 2;
-                if (p0.z == z)
-                {
-                    s.endVertex = &v0;
-                }
-            }
-            else if (p2.z > z && p1.z < z && p0.z < z)
+    // each layer is turned into polygons right after it is sliced, so only the layers being processed hold their segments at the same time
+    ThreadPool* thread_pool = ThreadPool::getInstance();
+    std::atomic<unsigned int> simplified_point_count(0);
+    thread_pool->parallelForLayers(first_layer, last_layer + 1, [&](int layer_nr)
+        {
+            if (outline_source_layer[layer_nr] != static_cast<unsigned int>(layer_nr) || (cancelled && cancelled->load(std::memory_order_relaxed)))
             {
-                s = project2D(p2, p0, p1, z);
-                end_edge_idx = 1;
+                return;
             }
-            else
+            sliceLayer(layer_nr);
+            simplified_point_count += layers[layer_nr].makePolygons(mesh, keep_none_closed, extensive_stitching);
+        });
+    if (prismatic_layer_count > 0)
+    {
+        thread_pool->parallelFor(first_layer, last_layer + 1, [&](int layer_nr)
             {
-                //Not all cases create a segment, because a point of a face could create just a dot, and two touching faces
-                //  on the slice would create two segments
-                continue;
-            }
-            layers[layer_nr].face_idx_to_segment_idx.insert(std::make_pair(mesh_idx, layers[layer_nr].segments.size()));
-            s.faceIndex = mesh_idx;
-            s.endOtherFaceIdx = face.connected_face_index[end_edge_idx];
-            s.addedToPolygon = false;
-            layers[layer_nr].segments.push_back(s);
+                const unsigned int source_layer_nr = outline_source_layer[layer_nr];
+                if (source_layer_nr != static_cast<unsigned int>(layer_nr))
+                {
+                    layers[layer_nr].polygons = layers[source_layer_nr].polygons;
+                    layers[layer_nr].openPolylines = layers[source_layer_nr].openPolylines;
+                }
+            });
+    }
+    // the index is no longer needed and can be quite large
+    std::vector<SliceFace>().swap(slice_faces);
+    std::vector<unsigned int>().swap(layer_face_start);
+    std::vector<unsigned int>().swap(layer_faces);
+    std::vector<unsigned int>().swap(outline_source_layer);
+
+    log("slice of mesh and making polygons took %.3f seconds\n",slice_timer.restart());
+    if (prismatic_layer_count > 0)
+    {
+        log("copied the outlines of %u layers in prismatic parts of the mesh\n", prismatic_layer_count);
+    }
+    if (mesh->getSettingInMicrons(SettingKey::meshfix_maximum_deviation) > 0)
+    {
+        log("simplifying the slices removed %u points\n", simplified_point_count.load());
+    }
+}
+
+void Slicer::buildLayerFaceIndex(int first_layer, int last_layer)
+{
+    const int32_t layer_count = layers.size();
+    const unsigned int face_count = mesh->faces.size();
+
+    // The range of layers crossed by each face, computed once and used in both passes below
+    std::vector<std::pair<int32_t, int32_t>> face_layer_ranges(face_count);
+    layer_face_start.assign(layer_count + 1, 0);
+    reserveHugePages(slice_faces, face_count); // the faces of each layer are looked up all over it
+    slice_faces.resize(face_count);
+    for (unsigned int face_idx = 0; face_idx < face_count; face_idx++)
+    {
+        const MeshFace& face = mesh->faces[face_idx];
+        SliceFace& slice_face = slice_faces[face_idx];
+        for (unsigned int corner_idx = 0; corner_idx < 3; corner_idx++)
+        {
+            slice_face.p[corner_idx] = mesh->vertices[face.vertex_index[corner_idx]].p;
+            slice_face.vertex_index[corner_idx] = face.vertex_index[corner_idx];
+            slice_face.connected_face_index[corner_idx] = face.connected_face_index[corner_idx];
+        }
+        const int32_t p0_z = slice_face.p[0].z;
+        const int32_t p1_z = slice_face.p[1].z;
+        const int32_t p2_z = slice_face.p[2].z;
+        const int32_t minZ = std::min(p0_z, std::min(p1_z, p2_z));
+        const int32_t maxZ = std::max(p0_z, std::max(p1_z, p2_z));
+        int32_t layer_min = std::max(0, (minZ - initial) / thickness);
+        if (layer_min * thickness + initial < minZ)
+        { // the layer below minZ doesn't cross the face
+            layer_min++;
+        }
+        // only the layers being sliced get the face; faces outside the range get an empty range
+        layer_min = std::max(first_layer, layer_min);
+        const int32_t layer_max = std::min(last_layer, (maxZ - initial) / thickness);
+        face_layer_ranges[face_idx] = std::make_pair(layer_min, layer_max);
+        for (int32_t layer_nr = layer_min; layer_nr <= layer_max; layer_nr++)
+        {
+            layer_face_start[layer_nr + 1]++;
+        }
+    }
+    for (int32_t layer_nr = 0; layer_nr < layer_count; layer_nr++)
+    {
+        layer_face_start[layer_nr + 1] += layer_face_start[layer_nr];
+    }
+
+    // Faces are inserted in order of face index, so each layer ends up with an ordered list of faces.
+    reserveHugePages(layer_faces, layer_face_start.back());
+    layer_faces.resize(layer_face_start.back());
+    std::vector<unsigned int> insert_idx(layer_face_start.begin(), layer_face_start.end() - 1);
+    for (unsigned int face_idx = 0; face_idx < face_count; face_idx++)
+    {
+        const std::pair<int32_t, int32_t>& layer_range = face_layer_ranges[face_idx];
+        for (int32_t layer_nr = layer_range.first; layer_nr <= layer_range.second; layer_nr++)
+        {
+            layer_faces[insert_idx[layer_nr]++] = face_idx;
+        }
+    }
+}
+
+unsigned int Slicer::findPrismaticLayers(unsigned int first_layer, unsigned int last_layer)
+{
+    outline_source_layer.resize(layers.size());
+    if (!mesh->getSettingBoolean(SettingKey::slicing_copy_prismatic_layers))
+    { // the copied outlines differ slightly from those of slicing the layers, so all layers are sliced unless asked otherwise
+        std::iota(outline_source_layer.begin() + first_layer, outline_source_layer.begin() + last_layer + 1, first_layer);
+        return 0;
+    }
+    outline_source_layer[first_layer] = first_layer;
+
+    // whether each face is vertical, and its range of heights, computed once for all the layers crossing it
+    const unsigned int face_count = mesh->faces.size();
+    std::vector<bool> face_is_vertical(face_count);
+    std::vector<std::pair<int32_t, int32_t>> face_z_ranges(face_count);
+    for (unsigned int face_idx = 0; face_idx < face_count; face_idx++)
+    {
+        const SliceFace& face = slice_faces[face_idx];
+        const Point3& p0 = face.p[0];
+        const Point3& p1 = face.p[1];
+        const Point3& p2 = face.p[2];
+        const int64_t cross_z = (int64_t(p1.x) - p0.x) * (int64_t(p2.y) - p0.y) - (int64_t(p1.y) - p0.y) * (int64_t(p2.x) - p0.x);
+        face_is_vertical[face_idx] = cross_z == 0;
+        face_z_ranges[face_idx] = std::make_pair(std::min(p0.z, std::min(p1.z, p2.z)), std::max(p0.z, std::max(p1.z, p2.z)));
+    }
+
+    unsigned int prismatic_layer_count = 0;
+    for (unsigned int layer_nr = first_layer + 1; layer_nr <= last_layer; layer_nr++)
+    {
+        outline_source_layer[layer_nr] = layer_nr;
+        const unsigned int start = layer_face_start[layer_nr];
+        const unsigned int end = layer_face_start[layer_nr + 1];
+        const unsigned int below_start = layer_face_start[layer_nr - 1];
+        if (start == end || end - start != start - below_start
+            || !std::equal(layer_faces.begin() + start, layer_faces.begin() + end, layer_faces.begin() + below_start))
+        {
+            continue;
+        }
+        const int32_t z_below = layers[layer_nr - 1].z;
+        const int32_t z = layers[layer_nr].z;
+        bool is_prismatic = true;
+        for (unsigned int face_list_idx = start; face_list_idx < end && is_prismatic; face_list_idx++)
+        {
+            const unsigned int face_idx = layer_faces[face_list_idx];
+            is_prismatic = face_is_vertical[face_idx] && face_z_ranges[face_idx].first < z_below && face_z_ranges[face_idx].second > z;
+        }
+        if (is_prismatic)
+        {
+            outline_source_layer[layer_nr] = outline_source_layer[layer_nr - 1];
+            prismatic_layer_count++;
+        }
+    }
+    return prismatic_layer_count;
+}
+
+void Slicer::sliceLayer(unsigned int layer_nr)
+{
+    SlicerLayer& layer = layers[layer_nr];
+    layer.segments.reserve(layer_face_start[layer_nr + 1] - layer_face_start[layer_nr]);
+    for (unsigned int face_list_idx = layer_face_start[layer_nr]; face_list_idx < layer_face_start[layer_nr + 1]; face_list_idx++)
+    {
+        const unsigned int face_idx = layer_faces[face_list_idx];
+        SlicerSegment segment;
+        if (sliceFace(face_idx, layer.z, segment))
+        {
+            layer.segments.push_back(segment);
+        }
+    }
+}
+
+bool Slicer::sliceFace(unsigned int face_idx, int32_t z, SlicerSegment& s) const
+{
+    const SliceFace& face = slice_faces[face_idx];
+    Point3 p0 = face.p[0];
+    Point3 p1 = face.p[1];
+    Point3 p2 = face.p[2];
+
+    s.endVertexIdx = -1;
+    int end_edge_idx = -1;
+    if (p0.z < z && p1.z >= z && p2.z >= z)
+    {
+        s = project2D(p0, p2, p1, z);
+        end_edge_idx = 0;
+        if (p1.z == z)
+        {
+            s.endVertexIdx = face.vertex_index[1];
         }
     }
-    log("slice of mesh took %.3f seconds\n",slice_timer.restart());
-    for(unsigned int layer_nr=0; layer_nr<layers.size(); layer_nr++)
+    else if (p0.z > z && p1.z < z && p2.z < z)
     {
-        layers[layer_nr].makePolygons(mesh, keep_none_closed, extensive_stitching);
+        s = project2D(p0, p1, p2, z);
+        end_edge_idx = 2;
+
+    }
+
+    else if (p1.z < z && p0.z >= z && p2.z >= z)
+    {
+        s = project2D(p1, p0, p2, z);
+        end_edge_idx = 1;
+        if (p2.z == z)
+        {
+            s.endVertexIdx = face.vertex_index[2];
+        }
+    }
+    else if (p1.z > z && p0.z < z && p2.z < z)
+    {
+        s = project2D(p1, p2, p0, z);
+        end_edge_idx = 0;
+
+    }
+
+    else if (p2.z < z && p1.z >= z && p0.z >= z)
+    {
+        s = project2D(p2, p1, p0, z);
+        end_edge_idx = 2;
+        if (p0.z == z)
+        {
+            s.endVertexIdx = face.vertex_index[0];
+        }
+    }
+    else if (p2.z > z && p1.z < z && p0.z < z)
+    {
+        s = project2D(p2, p0, p1, z);
+        end_edge_idx = 1;
+    }
+    else
+    {
+        //Not all cases create a segment, because a point of a face could create just a dot, and two touching faces
+        //  on the slice would create two segments
+        return false;
     }
-    log("slice make polygons took %.3f seconds\n",slice_timer.restart());
+    s.faceIndex = face_idx;
+    s.endOtherFaceIdx = face.connected_face_index[end_edge_idx];
+    s.addedToPolygon = false;
+    return true;
 }
 
 }//namespace cura
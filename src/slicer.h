@@ -2,10 +2,12 @@
 #ifndef SLICER_H
 #define SLICER_H
 
+#include <atomic>
 #include <queue>
 
 #include "mesh.h"
 #include "utils/polygon.h"
+#include "utils/PolygonsSegmentIndex.h"
 /*
     The Slicer creates layers of polygons from an optimized 3D model.
     The result of the Slicer is a list of polygons without any order or structure.
@@ -20,8 +22,8 @@ public:
     // The index of the other face connected via the edge that created end
     int endOtherFaceIdx = -1;
     // If end corresponds to a vertex of the mesh, then this is populated
-    // with the vertex that it ended on.
-    const MeshVertex *endVertex = nullptr;
+    // with the index of the vertex that it ended on.
+    int endVertexIdx = -1;
     bool addedToPolygon = false;
 };
 
@@ -46,8 +48,14 @@ public:
 class SlicerLayer
 {
 public:
+    /*!
+     * The segments of this layer, ordered by SlicerSegment::faceIndex.
+     *
+     * A face crosses a layer at most once, so there is at most one segment per face.
+     * Together with SlicerSegment::endOtherFaceIdx this ordering is the topology used to chain segments into polygons:
+     * the segment of a given face is found by binary search.
+     */
     std::vector<SlicerSegment> segments;
-    std::unordered_map<int, int> face_idx_to_segment_idx; // topology
 
     int z = -1;
     Polygons polygons;
@@ -59,8 +67,9 @@ public:
      * \param[in] mesh The mesh data for which we are connecting sliced segments (The face data is used)
      * \param keepNoneClosed Whether to throw away the data for segments which we couldn't stitch into a polygon
      * \param extensiveStitching Whether to perform extra work to try and close polylines into polygons when there are large gaps
+     * \return The number of points removed from the polygons by the simplification within the meshfix_maximum_deviation
      */
-    void makePolygons(const Mesh* mesh, bool keepNoneClosed, bool extensiveStitching);
+    unsigned int makePolygons(const Mesh* mesh, bool keepNoneClosed, bool extensiveStitching);
 
 protected:
     /*!
@@ -110,9 +119,35 @@ protected:
      */
     void stitch(Polygons& open_polylines);
 
-    GapCloserResult findPolygonGapCloser(Point ip0, Point ip1);
+    /*!
+     * Find the shortest way along one of SlicerLayer::polygons from one point to another.
+     *
+     * \param ip0 The point to start from
+     * \param ip1 The point to go to
+     * \param c1 Where \p ip0 lies on SlicerLayer::polygons, as found by findPolygonPointClosestTo
+     * \param c2 Where \p ip1 lies on SlicerLayer::polygons, as found by findPolygonPointClosestTo
+     * \param lengths_along_polygon For each point of the polygon on which \p ip0 lies the length along the polygon from its first point, as computed by getLengthsAlongPolygon
+     * \return The way along the polygon, or a negative GapCloserResult::len if the points don't lie on the same polygon
+     */
+    GapCloserResult findPolygonGapCloser(Point ip0, Point ip1, const ClosePolygonResult& c1, const ClosePolygonResult& c2, const std::vector<int64_t>& lengths_along_polygon) const;
+
+    /*!
+     * Compute for each point of a polygon the length along the polygon from its first point.
+     *
+     * \param poly The polygon
+     * \param[out] lengths_along_polygon The lengths for each point of \p poly
+     */
+    static void getLengthsAlongPolygon(const PolygonRef poly, std::vector<int64_t>& lengths_along_polygon);
 
-    ClosePolygonResult findPolygonPointClosestTo(Point input);
+    /*!
+     * Find the first line segment of SlicerLayer::polygons, in order, which lies within 100 micron of a point.
+     *
+     * \param input The point
+     * \param segment_index The line segments of the first polygons; polygons added after the index was made are checked segment by segment
+     * \param start_poly_idx The first polygon to check
+     * \return The line segment and the point on it, or a negative ClosePolygonResult::polygonIdx if no segment is close enough
+     */
+    ClosePolygonResult findPolygonPointClosestTo(Point input, const PolygonsSegmentIndex& segment_index, unsigned int start_poly_idx) const;
 
     /*!
      * Try to close up polylines into polygons while they have large gaps in them.
@@ -410,15 +445,12 @@ private:
      * \param open_polylines The polylines to try to stitch together.
      * \param max_dist The maximum distance between end points for an
      *     allowed stitch.
-     * \param cell_size The cell size to use for the SparseGrid.  This
-     *     affects speed, but does not otherwise affect the results.
-     *     This value should generally be close to max_dist.
      * \param allow_reverse Whether stitches are allowed that reverse
      *     the order of a polyline.
      * \return The stitches that are allowed in order from best to worst.
      */
     std::priority_queue<PossibleStitch> findPossibleStitches(
-        const Polygons& open_polylines, coord_t max_dist, coord_t cell_size,
+        const Polygons& open_polylines, coord_t max_dist,
         bool allow_reverse) const;
 
     /*! Plans the best way to perform a stitch.
@@ -473,13 +505,11 @@ private:
      *    closed into a loop
      * \param[in] max_dist The maximum distance that polyline ends can
      *     be separated and still be joined.
-     * \param[in] cell_size The cell size to use internally in the
-     *     grid.  This affects speed but not results.
      * \param[in] allow_reverse If true, then this function is allowed
      *     to reverse edge directions to merge polylines.
      */
     void connectOpenPolylinesImpl(Polygons& open_polylines,
-                                  coord_t max_dist, coord_t cell_size,
+                                  coord_t max_dist,
                                   bool allow_reverse);
 };
 
@@ -490,7 +520,52 @@ public:
 
     const Mesh* mesh = nullptr; //!< The sliced mesh
 
-    Slicer(const Mesh* mesh, int initial, int thickness, int slice_layer_count, bool keepNoneClosed, bool extensiveStitching);
+    /*!
+     * Slice a mesh into layers at the given heights.
+     *
+     * \param cancelled When set, the remaining layers are skipped, so that the layers are incomplete (optional)
+     */
+    Slicer(const Mesh* mesh, int initial, int thickness, int slice_layer_count, bool keepNoneClosed, bool extensiveStitching, const std::atomic<bool>* cancelled = nullptr);
+
+    /*!
+     * Slice only a range of the layers of a mesh, e.g. to redo the layers which went missing, or to slice the layers given to this process.
+     *
+     * All layers get their height, but the layers outside the range stay empty until they are sliced with \ref Slicer::sliceLayers.
+     *
+     * \param first_layer The first layer to slice
+     * \param last_layer The last layer to slice
+     * \param cancelled When set, the remaining layers are skipped, so that the layers are incomplete (optional)
+     */
+    Slicer(const Mesh* mesh, int initial, int thickness, int slice_layer_count, bool keepNoneClosed, bool extensiveStitching, int first_layer, int last_layer, const std::atomic<bool>* cancelled = nullptr);
+
+    /*!
+     * Slice a range of layers which haven't been sliced yet.
+     *
+     * Only the faces crossing the range are indexed, so slicing a few layers of a large mesh is cheap.
+     * The outlines of prismatic parts are only copied within the range.
+     * Not available for a slicer created from the layers of the SliceCache.
+     *
+     * \param first_layer The first layer to slice
+     * \param last_layer The last layer to slice; layers beyond the top layer are ignored
+     */
+    void sliceLayers(int first_layer, int last_layer);
+
+    /*!
+     * Create a slicer with layers which were sliced before, see SliceCache.
+     *
+     * \param mesh The sliced mesh
+     * \param layers The layers of the mesh
+     */
+    Slicer(const Mesh* mesh, std::vector<SlicerLayer>&& layers)
+    : layers(std::move(layers))
+    , mesh(mesh)
+    , initial(0)
+    , thickness(0)
+    , keep_none_closed(false)
+    , extensive_stitching(false)
+    , cancelled(nullptr)
+    {
+    }
 
     /*!
      * Linear interpolation
@@ -519,6 +594,101 @@ public:
     }
 
     void dumpSegmentsToHTML(const char* filename);
+
+private:
+    int initial; //!< The z coordinate of the first layer
+    int thickness; //!< The distance between two layers
+    bool keep_none_closed; //!< See SlicerLayer::makePolygons
+    bool extensive_stitching; //!< See SlicerLayer::makePolygons
+    const std::atomic<bool>* cancelled; //!< When set, the remaining layers are skipped, or nullptr
+
+    /*!
+     * A face with everything needed to slice it, so that slicing a layer reads one contiguous record per face
+     * instead of gathering the vertices of the face from the mesh.
+     */
+    struct SliceFace
+    {
+        Point3 p[3]; //!< The vertices of the face, in the order of MeshFace::vertex_index
+        int vertex_index[3]; //!< See MeshFace::vertex_index
+        int connected_face_index[3]; //!< See MeshFace::connected_face_index
+    };
+
+    /*!
+     * The faces of the mesh in the order of the mesh, as compact records. Built by \ref Slicer::buildLayerFaceIndex.
+     */
+    std::vector<SliceFace> slice_faces;
+
+    /*!
+     * For each layer, the position in \ref Slicer::layer_faces of the first face which crosses that layer.
+     * Has one extra element for the end of the faces of the last layer.
+     */
+    std::vector<unsigned int> layer_face_start;
+
+    /*!
+     * For each layer the indices of the faces which cross it, ordered by face index.
+     * The faces of a layer are stored consecutively; see \ref Slicer::layer_face_start.
+     */
+    std::vector<unsigned int> layer_faces;
+
+    /*!
+     * For each layer, the layer from which it copies its polygons because the mesh is prismatic in between, or the layer itself.
+     * See \ref Slicer::findPrismaticLayers.
+     */
+    std::vector<unsigned int> outline_source_layer;
+
+    /*!
+     * Build the index from layers to the faces which cross them.
+     *
+     * Afterwards each layer can be sliced by a single sweep over just the faces crossing it,
+     * independently of all other layers. Also fills \ref Slicer::slice_faces.
+     * The ranges of layers of the faces are clipped to the layers being sliced, so the other layers have no faces.
+     *
+     * \param first_layer The first layer being sliced
+     * \param last_layer The last layer being sliced
+     */
+    void buildLayerFaceIndex(int first_layer, int last_layer);
+
+    /*!
+     * Find the runs of layers which have the same outline, so that only the first layer of each run needs to be sliced.
+     *
+     * A layer is given the outline of the layer below it when exactly the same faces cross both,
+     * all of those faces are vertical and none of them has a vertex at the height of either layer.
+     * The faces then form a prism between the layers: the points where they cross non-vertical edges lie on a straight line
+     * between the points on the vertical edges, which are at the same place in both layers.
+     * The outline isn't exactly that of slicing the layer though: the points on the non-vertical edges move with the height,
+     * and are rounded to different positions on that line, which can change the simplified outline and the seams.
+     * Therefore layers are only copied when the setting slicing_copy_prismatic_layers is enabled.
+     *
+     * Requires the index built by \ref Slicer::buildLayerFaceIndex. Fills \ref Slicer::outline_source_layer for the layers being sliced.
+     *
+     * \param first_layer The first layer being sliced, which is always sliced itself
+     * \param last_layer The last layer being sliced
+     * \return The number of layers which copy the outline of a layer below them
+     */
+    unsigned int findPrismaticLayers(unsigned int first_layer, unsigned int last_layer);
+
+    /*!
+     * Compute the segments of a single layer from the faces crossing it.
+     *
+     * Each face is sliced on its own, without reading any state shared with the other faces,
+     * so the segments of all faces of a layer could just as well be computed in bulk on a vector unit.
+     *
+     * Requires the index built by \ref Slicer::buildLayerFaceIndex.
+     * The segments are added in order of face index, as required by \ref SlicerLayer::segments.
+     *
+     * \param layer_nr The index of the layer to slice
+     */
+    void sliceLayer(unsigned int layer_nr);
+
+    /*!
+     * Slice a single face at height \p z.
+     *
+     * \param face_idx The index of the face to slice
+     * \param z The height at which to slice
+     * \param[out] segment The segment where the face crosses the plane at height \p z
+     * \return Whether the face produced a segment at this height
+     */
+    bool sliceFace(unsigned int face_idx, int32_t z, SlicerSegment& segment) const;
 };
 
 }//namespace cura
@@ -1,11 +1,15 @@
 /** Copyright (C) 2013 David Braam - Released under terms of the AGPLv3 License */
 #include <cmath> // sqrt
 #include <utility> // pair
-#include <deque>
 #include "support.h"
 
 #include "utils/math.h"
+#include "utils/AABBIndex.h"
+#include "utils/gettime.h"
+#include "utils/ThreadPool.h"
+#include "utils/Trace.h"
 #include "progress/Progress.h"
+#include "progress/SlowLayerCapture.h"
 
 namespace cura 
 {
@@ -18,18 +22,18 @@ Polygons AreaSupport::join(Polygons& supportLayer_up, Polygons& supportLayer_thi
     {
         Polygons insetted = supportLayer_up.offset(-conical_smallest_breadth/2);
         Polygons small_parts = supportLayer_up.difference(insetted.offset(conical_smallest_breadth/2+20));
-        joined = supportLayer_this.unionPolygons(supportLayer_up.offset(conical_support_offset))
-                                .unionPolygons(small_parts);
+        supportLayer_this.unionPolygons(supportLayer_up.offset(conical_support_offset), joined);
+        joined.unionWith(small_parts);
     }
     else 
     {
-        joined = supportLayer_this.unionPolygons(supportLayer_up);
+        supportLayer_this.unionPolygons(supportLayer_up, joined);
     }
     // join different parts
     if (supportJoinDistance > 0)
     {
-        joined = joined.offset(supportJoinDistance)
-                        .offset(-supportJoinDistance);
+        joined.offsetInPlace(supportJoinDistance);
+        joined.offsetInPlace(-supportJoinDistance);
     }
     if (smoothing_distance > 0)
         joined = joined.smooth(smoothing_distance, min_smoothing_area);
@@ -37,24 +41,81 @@ Polygons AreaSupport::join(Polygons& supportLayer_up, Polygons& supportLayer_thi
     return joined;
 }
 
-void AreaSupport::generateSupportAreas(SliceDataStorage& storage, unsigned int layer_count)
+Bitmap AreaSupport::join(const Bitmap& supportLayer_up, Bitmap& supportLayer_this, int64_t supportJoinDistance, bool conical_support, int64_t conical_support_offset, int64_t conical_smallest_breadth)
+{
+    Bitmap joined = std::move(supportLayer_this);
+    if (conical_support)
+    {
+        Bitmap small_parts = supportLayer_up;
+        small_parts.differenceWith(supportLayer_up.offset(-conical_smallest_breadth / 2).offset(conical_smallest_breadth / 2));
+        joined.unionWith(supportLayer_up.offset(conical_support_offset));
+        joined.unionWith(small_parts);
+    }
+    else
+    {
+        joined.unionWith(supportLayer_up);
+    }
+    // join different parts
+    if (supportJoinDistance > 0)
+    {
+        joined = joined.offset(supportJoinDistance).offset(-supportJoinDistance);
+    }
+    return joined;
+}
+
+void AreaSupport::generateSupportAreas(SliceDataStorage& storage, unsigned int layer_count, const SliceContext& context)
 {
     // initialization of supportAreasPerLayer
     for (unsigned int layer_idx = 0; layer_idx < layer_count ; layer_idx++)
         storage.support.supportLayers.emplace_back();
     
+    // the support areas of a single mesh don't overlap, so the support areas of a layer only need to be unioned
+    // when the support areas of several meshes come close to each other
+    struct SupportLayerBox
+    {
+        AABB box; //!< The bounding box of the support areas of all meshes processed so far
+        bool has_support = false;
+        bool needs_union = false;
+    };
+    std::vector<SupportLayerBox> support_boxes(layer_count);
+
     for(unsigned int mesh_idx = 0; mesh_idx < storage.meshes.size(); mesh_idx++)
     {
         SliceMeshStorage& mesh = storage.meshes[mesh_idx];
-        if (mesh.getSettingBoolean("infill_mesh"))
+        if (mesh.getSettingBoolean(SettingKey::infill_mesh))
         {
             continue;
         }
         std::vector<Polygons> supportAreas;
         supportAreas.resize(layer_count, Polygons());
-        generateSupportAreas(storage, mesh_idx, layer_count, supportAreas);
+        generateSupportAreas(storage, mesh_idx, layer_count, supportAreas, context);
+        if (context.isCancelled())
+        {
+            return;
+        }
+
+        ThreadPool::getInstance()->parallelForLayers(0, layer_count, [&](int layer_idx)
+        {
+            if (supportAreas[layer_idx].size() == 0)
+            {
+                return;
+            }
+            const AABB mesh_support_box(supportAreas[layer_idx]);
+            SupportLayerBox& support_box = support_boxes[layer_idx];
+            if (support_box.has_support)
+            {
+                support_box.needs_union |= support_box.box.hit(mesh_support_box);
+                support_box.box.include(mesh_support_box.min);
+                support_box.box.include(mesh_support_box.max);
+            }
+            else
+            {
+                support_box.box = mesh_support_box;
+                support_box.has_support = true;
+            }
+        });
         
-        if (mesh.getSettingBoolean("support_interface_enable"))
+        if (mesh.getSettingBoolean(SettingKey::support_interface_enable))
         {
             generateSupportInterface(storage, mesh, supportAreas, layer_count);
         }
@@ -67,10 +128,13 @@ void AreaSupport::generateSupportAreas(SliceDataStorage& storage, unsigned int l
         }
     }
     
-    for (unsigned int layer_idx = 0; layer_idx < layer_count ; layer_idx++)
+    ThreadPool::getInstance()->parallelForLayers(0, layer_count, [&](int layer_idx)
     {
-        storage.support.supportLayers[layer_idx].supportAreas = storage.support.supportLayers[layer_idx].supportAreas.unionPolygons();
-    }
+        if (support_boxes[layer_idx].needs_union)
+        {
+            storage.support.supportLayers[layer_idx].supportAreas = storage.support.supportLayers[layer_idx].supportAreas.unionPolygons();
+        }
+    });
     
     storage.support.generated = true;
 }
@@ -86,44 +150,47 @@ void AreaSupport::generateSupportAreas(SliceDataStorage& storage, unsigned int l
  * 
  * for support buildplate only: purge all support not connected to buildplate
  */
-void AreaSupport::generateSupportAreas(SliceDataStorage& storage, unsigned int mesh_idx, unsigned int layer_count, std::vector<Polygons>& supportAreas)
+void AreaSupport::generateSupportAreas(SliceDataStorage& storage, unsigned int mesh_idx, unsigned int layer_count, std::vector<Polygons>& supportAreas, const SliceContext& context)
 {
+    TRACE_SCOPE("AreaSupport::generateSupportAreas", mesh_idx, -1);
     SliceMeshStorage& mesh = storage.meshes[mesh_idx];
         
     // given settings
-    ESupportType support_type = storage.getSettingAsSupportType("support_type");
+    ESupportType support_type = storage.getSettingAsSupportType(SettingKey::support_type);
     
-    if (!mesh.getSettingBoolean("support_enable"))
+    if (!mesh.getSettingBoolean(SettingKey::support_enable))
         return;
     if (support_type == ESupportType::NONE)
         return;
     
-    const double supportAngle = mesh.getSettingInAngleRadians("support_angle");
+    const double supportAngle = mesh.getSettingInAngleRadians(SettingKey::support_angle);
     const bool supportOnBuildplateOnly = support_type == ESupportType::PLATFORM_ONLY;
-    const int supportZDistanceBottom = mesh.getSettingInMicrons("support_bottom_distance");
-    const int supportZDistanceTop = mesh.getSettingInMicrons("support_top_distance");
-    const int join_distance = mesh.getSettingInMicrons("support_join_distance");
-    const int support_bottom_stair_step_height = mesh.getSettingInMicrons("support_bottom_stair_step_height");
-    const int smoothing_distance = mesh.getSettingInMicrons("support_area_smoothing"); 
+    const int supportZDistanceBottom = mesh.getSettingInMicrons(SettingKey::support_bottom_distance);
+    const int supportZDistanceTop = mesh.getSettingInMicrons(SettingKey::support_top_distance);
+    const int join_distance = mesh.getSettingInMicrons(SettingKey::support_join_distance);
+    const int support_bottom_stair_step_height = mesh.getSettingInMicrons(SettingKey::support_bottom_stair_step_height);
+    const int smoothing_distance = mesh.getSettingInMicrons(SettingKey::support_area_smoothing); 
 
-    const int extension_offset = mesh.getSettingInMicrons("support_offset");
+    const int extension_offset = mesh.getSettingInMicrons(SettingKey::support_offset);
 
-    const int supportTowerDiameter = mesh.getSettingInMicrons("support_tower_diameter");
-    const int supportMinAreaSqrt = mesh.getSettingInMicrons("support_minimal_diameter");
-    const double supportTowerRoofAngle = mesh.getSettingInAngleRadians("support_tower_roof_angle");
+    const int supportTowerDiameter = mesh.getSettingInMicrons(SettingKey::support_tower_diameter);
+    const int supportMinAreaSqrt = mesh.getSettingInMicrons(SettingKey::support_minimal_diameter);
+    const double supportTowerRoofAngle = mesh.getSettingInAngleRadians(SettingKey::support_tower_roof_angle);
 
     const int min_smoothing_area = 100 * 100; // minimal area for which to perform smoothing
     const int z_layer_distance_tower = 1; // start tower directly below overhang point
 
-    const int layerThickness = storage.getSettingInMicrons("layer_height");
-    const int supportXYDistance = mesh.getSettingInMicrons("support_xy_distance");
-    const int support_xy_distance_overhang = mesh.getSettingInMicrons("support_xy_distance_overhang");
+    const int layerThickness = storage.getSettingInMicrons(SettingKey::layer_height);
+    const int supportXYDistance = mesh.getSettingInMicrons(SettingKey::support_xy_distance);
+    const int support_xy_distance_overhang = mesh.getSettingInMicrons(SettingKey::support_xy_distance_overhang);
 
-    const bool use_support_xy_distance_overhang = mesh.getSettingAsSupportDistPriority("support_xy_overrides_z") == SupportDistPriority::Z_OVERRIDES_XY; // whether to use a different xy distance at overhangs
+    const coord_t raster_resolution = mesh.getSettingInMicrons(SettingKey::support_raster_resolution); // zero to compute the support areas with polygons
 
-    const double conical_support_angle = mesh.getSettingInAngleRadians("support_conical_angle");
-    const bool conical_support = mesh.getSettingBoolean("support_conical_enabled") && conical_support_angle != 0;
-    const int64_t conical_smallest_breadth = mesh.getSettingInMicrons("support_conical_min_width");
+    const bool use_support_xy_distance_overhang = mesh.getSettingAsSupportDistPriority(SettingKey::support_xy_overrides_z) == SupportDistPriority::Z_OVERRIDES_XY; // whether to use a different xy distance at overhangs
+
+    const double conical_support_angle = mesh.getSettingInAngleRadians(SettingKey::support_conical_angle);
+    const bool conical_support = mesh.getSettingBoolean(SettingKey::support_conical_enabled) && conical_support_angle != 0;
+    const int64_t conical_smallest_breadth = mesh.getSettingInMicrons(SettingKey::support_conical_min_width);
     
     // derived settings:
     
@@ -167,33 +234,60 @@ void AreaSupport::generateSupportAreas(SliceDataStorage& storage, unsigned int m
     std::vector<std::pair<int, std::vector<Polygons>>> overhang_points; // stores overhang_points along with the layer index at which the overhang point occurs
     AreaSupport::detectOverhangPoints(storage, mesh, overhang_points, layer_count, supportMinAreaSqrt);
 
-    std::deque<std::pair<Polygons, Polygons>> basic_and_full_overhang_above;
-    for (unsigned int layer_idx = support_layer_count - 1; layer_idx != support_layer_count - 1 - layerZdistanceTop ; layer_idx--)
+    const unsigned int top_support_layer_idx = support_layer_count - 1 - layerZdistanceTop;
+
+    // the overhang and the areas too close to the model only depend on the layer itself and the layer below,
+    // so they are computed for all layers in parallel; only the joining with the support from the layer above is serial
+    std::vector<std::pair<Polygons, Polygons>> basic_and_full_overhang(support_layer_count);
+    std::vector<Polygons> xy_disallowed(top_support_layer_idx + 1); // the areas too close to the model in X/Y
+    ThreadPool::getInstance()->parallelForLayers(0, support_layer_count, [&](int layer_idx)
     {
-        basic_and_full_overhang_above.push_front(computeBasicAndFullOverhang(storage, mesh, layer_idx, max_dist_from_lower_layer));
-    }
+        TimeKeeper layer_timer;
+        basic_and_full_overhang[layer_idx] = computeBasicAndFullOverhang(storage, mesh, layer_idx, max_dist_from_lower_layer, raster_resolution);
+        const Polygons& outlines = storage.getCachedLayerOutlines(layer_idx);
+        if (static_cast<unsigned int>(layer_idx) <= top_support_layer_idx && raster_resolution == 0)
+        { // the rasterized areas too close to the model are computed along with the X/Y distance inset
+            if (use_support_xy_distance_overhang)
+            {
+                const Polygons& basic_overhang = basic_and_full_overhang[layer_idx].first;
+                Polygons xy_overhang_disallowed = basic_overhang.offset(supportZDistanceTop * tanAngle);
+                Polygons xy_non_overhang_disallowed = outlines.difference(basic_overhang.offset(supportXYDistance)).offset(supportXYDistance);
+
+                xy_disallowed[layer_idx] = xy_overhang_disallowed.unionPolygons(xy_non_overhang_disallowed.unionPolygons(outlines.offset(support_xy_distance_overhang)));
+            }
+            else
+            {
+                xy_disallowed[layer_idx] = outlines.offset(supportXYDistance);
+            }
+        }
+        const double layer_time = layer_timer.restart();
+        if (SlowLayerCapture::getInstance().isSlow(layer_time))
+        {
+            SlowLayerCapture::getInstance().capture("support", mesh_idx, layer_idx, mesh.layers[layer_idx].printZ, layer_time, outlines, mesh);
+        }
+    });
 
-    bool still_in_upper_empty_layers = true;
     int overhang_points_pos = overhang_points.size() - 1;
     Polygons supportLayer_last;
+    Bitmap support_bitmap_last(raster_resolution);
+    double conical_offset_total = 0; // the conical offsets so far, in pixels
+    int64_t conical_offset_pixels = 0; // the conical offsets so far, rounded to whole pixels
     std::vector<Polygons> towerRoofs;
 
-    for (unsigned int layer_idx = support_layer_count - 1 - layerZdistanceTop; layer_idx != (unsigned int) -1 ; layer_idx--)
+    for (unsigned int layer_idx = top_support_layer_idx; layer_idx != (unsigned int) -1 ; layer_idx--)
     {
-        basic_and_full_overhang_above.push_front(computeBasicAndFullOverhang(storage, mesh, layer_idx, max_dist_from_lower_layer));
-        
-        Polygons overhang;
+        if (context.isCancelled())
         {
-            // compute basic overhang and put in right layer ([layerZdistanceTOp] layers below)
-            overhang = basic_and_full_overhang_above.back().second;
-            basic_and_full_overhang_above.pop_back();
+            return;
         }
+        // the overhang is supported [layerZdistanceTop] layers below
+        Polygons overhang = std::move(basic_and_full_overhang[layer_idx + layerZdistanceTop].second);
 
         Polygons& supportLayer_this = overhang; 
         
         if (extension_offset)
         {
-            supportLayer_this = supportLayer_this.offset(extension_offset);
+            supportLayer_this.offsetInPlace(extension_offset);
         }
         
         supportLayer_this.simplify(50); // TODO: hardcoded value!
@@ -206,66 +300,152 @@ void AreaSupport::generateSupportAreas(SliceDataStorage& storage, unsigned int m
             AreaSupport::handleTowers(supportLayer_this, towerRoofs, overhang_points, overhang_points_pos, layer_idx, towerRoofExpansionDistance, supportTowerDiameter, supportMinAreaSqrt, layer_count, z_layer_distance_tower);
         }
     
-        if (layer_idx+1 < support_layer_count)
-        { // join with support from layer up                
-            supportLayer_this = AreaSupport::join(supportLayer_last, supportLayer_this, join_distance, smoothing_distance, min_smoothing_area, conical_support, conical_support_offset, conical_smallest_breadth);
-        }
-        
-        
-        // move up from model
-        if (layerZdistanceBottom > 0 && layer_idx >= layerZdistanceBottom)
+        if (raster_resolution > 0)
         {
-            int stepHeight = support_bottom_stair_step_height / supportLayerThickness + 1;
-            int bottomLayer = ((layer_idx - layerZdistanceBottom) / stepHeight) * stepHeight;
-            supportLayer_this = supportLayer_this.difference(storage.getLayerOutlines(bottomLayer, false));
+            Bitmap support_bitmap = Bitmap::rasterize(supportLayer_this, raster_resolution);
+            if (layer_idx+1 < support_layer_count)
+            { // join with support from layer up, with the conical offsets rounded to pixels in total rather than per layer
+                conical_offset_total += static_cast<double>(conical_support_offset) / raster_resolution;
+                const int64_t conical_offset_step = std::llround(conical_offset_total) - conical_offset_pixels;
+                conical_offset_pixels += conical_offset_step;
+                support_bitmap = AreaSupport::join(support_bitmap_last, support_bitmap, join_distance, conical_support, conical_offset_step * raster_resolution, conical_smallest_breadth);
+            }
+
+            // move up from model
+            if (layerZdistanceBottom > 0 && layer_idx >= layerZdistanceBottom)
+            {
+                int stepHeight = support_bottom_stair_step_height / supportLayerThickness + 1;
+                int bottomLayer = ((layer_idx - layerZdistanceBottom) / stepHeight) * stepHeight;
+                support_bitmap.differenceWith(Bitmap::rasterize(storage.getCachedLayerOutlines(bottomLayer), raster_resolution));
+            }
+
+            supportAreas[layer_idx] = support_bitmap.toPolygons();
+            support_bitmap_last = std::move(support_bitmap);
         }
-        
-        
-        supportLayer_last = supportLayer_this;
-        
-        
-        // inset using X/Y distance
-        if (supportLayer_this.size() > 0)
+        else
         {
-            Polygons& basic_overhang = basic_and_full_overhang_above.front().first; // basic overhang on this layer
-            Polygons outlines = storage.getLayerOutlines(layer_idx, false);
+            if (layer_idx+1 < support_layer_count)
+            { // join with support from layer up                
+                supportLayer_this = AreaSupport::join(supportLayer_last, supportLayer_this, join_distance, smoothing_distance, min_smoothing_area, conical_support, conical_support_offset, conical_smallest_breadth);
+            }
+            
+            
+            // move up from model
+            if (layerZdistanceBottom > 0 && layer_idx >= layerZdistanceBottom)
+            {
+                int stepHeight = support_bottom_stair_step_height / supportLayerThickness + 1;
+                int bottomLayer = ((layer_idx - layerZdistanceBottom) / stepHeight) * stepHeight;
+                supportLayer_this.differenceWith(storage.getCachedLayerOutlines(bottomLayer));
+            }
+            
+            
+            supportLayer_last = supportLayer_this;
+
+            // the inset using X/Y distance doesn't affect the layers below, so it's done for all layers at once afterwards
+            supportAreas[layer_idx] = supportLayer_this;
+        }
+
+        Progress::messageProgress(Progress::Stage::SUPPORT, storage.meshes.size() * mesh_idx + support_layer_count - layer_idx, support_layer_count * storage.meshes.size(), context.command_socket);
+    }
 
+    // inset using X/Y distance
+    if (raster_resolution > 0)
+    {
+        ThreadPool::getInstance()->parallelForLayers(0, top_support_layer_idx + 1, [&](int layer_idx)
+        {
+            if (supportAreas[layer_idx].size() == 0)
+            {
+                return;
+            }
+            // the support areas run through the middle of the pixel edges, so they are rasterized to the same pixels again
+            Bitmap support_bitmap = Bitmap::rasterize(supportAreas[layer_idx], raster_resolution);
+            const Bitmap outlines = Bitmap::rasterize(storage.getCachedLayerOutlines(layer_idx), raster_resolution);
             if (use_support_xy_distance_overhang)
             {
-                Polygons xy_overhang_disallowed = basic_overhang.offset(supportZDistanceTop * tanAngle);
-                Polygons xy_non_overhang_disallowed = outlines.difference(basic_overhang.offset(supportXYDistance)).offset(supportXYDistance);
-
-                Polygons xy_disallowed = xy_overhang_disallowed.unionPolygons(xy_non_overhang_disallowed.unionPolygons(outlines.offset(support_xy_distance_overhang)));
-                supportLayer_this = supportLayer_this.difference(xy_disallowed);
+                const Bitmap basic_overhang = Bitmap::rasterize(basic_and_full_overhang[layer_idx].first, raster_resolution);
+                Bitmap xy_non_overhang_disallowed = outlines;
+                xy_non_overhang_disallowed.differenceWith(basic_overhang.offset(supportXYDistance));
+                support_bitmap.differenceWith(basic_overhang.offset(supportZDistanceTop * tanAngle));
+                support_bitmap.differenceWith(xy_non_overhang_disallowed.offset(supportXYDistance));
+                support_bitmap.differenceWith(outlines.offset(support_xy_distance_overhang));
             }
             else
             {
-                supportLayer_this = supportLayer_this.difference(storage.getLayerOutlines(layer_idx, false).offset(supportXYDistance));
+                support_bitmap.differenceWith(outlines.offset(supportXYDistance));
             }
+            supportAreas[layer_idx] = support_bitmap.toPolygons();
+        });
+    }
+    std::vector<std::pair<const Polygons*, const Polygons*>> xy_operands;
+    std::vector<unsigned int> xy_layer_indices; // the layer of each of the xy_operands
+    for (unsigned int layer_idx = 0; layer_idx <= top_support_layer_idx && raster_resolution == 0; layer_idx++)
+    {
+        if (supportAreas[layer_idx].size() > 0)
+        {
+            xy_operands.emplace_back(&supportAreas[layer_idx], &xy_disallowed[layer_idx]);
+            xy_layer_indices.push_back(layer_idx);
         }
-
-        supportAreas[layer_idx] = supportLayer_this;
-
-        if (still_in_upper_empty_layers && supportLayer_this.size() > 0)
+    }
+    std::vector<Polygons> xy_inset_areas;
+    Polygons::batchOperation(ClipperLib::ctDifference, xy_operands, xy_inset_areas);
+    for (unsigned int operand_idx = 0; operand_idx < xy_operands.size(); operand_idx++)
+    {
+        supportAreas[xy_layer_indices[operand_idx]] = std::move(xy_inset_areas[operand_idx]);
+    }
+    bool still_in_upper_empty_layers = true;
+    for (unsigned int layer_idx = top_support_layer_idx; layer_idx != (unsigned int) -1 && still_in_upper_empty_layers; layer_idx--)
+    {
+        if (supportAreas[layer_idx].size() > 0)
         {
             storage.support.layer_nr_max_filled_layer = std::max(storage.support.layer_nr_max_filled_layer, (int)layer_idx);
             still_in_upper_empty_layers = false;
         }
-        
-        Progress::messageProgress(Progress::Stage::SUPPORT, storage.meshes.size() * mesh_idx + support_layer_count - layer_idx, support_layer_count * storage.meshes.size());
     }
     
     // do stuff for when support on buildplate only
     if (supportOnBuildplateOnly)
     {
-        Polygons touching_buildplate = supportAreas[0]; // TODO: not working for conical support!
-        for (unsigned int layer_idx = 1 ; layer_idx < storage.support.supportLayers.size() ; layer_idx++)
+        removeSupportNotOnBuildplate(supportAreas, conical_support, conical_support_offset); // TODO: not working for conical support!
+    }
+}
+
+
+void AreaSupport::removeSupportNotOnBuildplate(std::vector<Polygons>& support_areas, bool conical_support, int64_t conical_support_offset)
+{
+    if (support_areas.size() < 2)
+    {
+        return;
+    }
+    // index the support polygons of each layer, so that each island only needs to be intersected with the polygons near it
+    std::vector<std::vector<AABB>> polygon_boxes_per_layer(support_areas.size());
+    std::vector<AABBIndex> polygon_index_per_layer(support_areas.size());
+    ThreadPool::getInstance()->parallelForLayers(1, support_areas.size(), [&](int layer_idx)
+    {
+        std::vector<AABB>& polygon_boxes = polygon_boxes_per_layer[layer_idx];
+        polygon_boxes.resize(support_areas[layer_idx].size());
+        for (unsigned int poly_idx = 0; poly_idx < support_areas[layer_idx].size(); poly_idx++)
+        {
+            for (const Point& p : support_areas[layer_idx][poly_idx])
+            {
+                polygon_boxes[poly_idx].include(p);
+            }
+        }
+        polygon_index_per_layer[layer_idx].build(polygon_boxes);
+    });
+
+    // the intersection distributes over the islands, so the islands are followed upward independently
+    std::vector<PolygonsPart> islands = support_areas[0].splitIntoParts();
+    std::vector<std::vector<Polygons>> touching_buildplate_per_island(islands.size()); // for each island the support resting on it in the layers above the first
+    ThreadPool::getInstance()->parallelFor(0, islands.size(), [&](int island_idx)
+    {
+        std::vector<Polygons>& touching_buildplate_per_layer = touching_buildplate_per_island[island_idx];
+        Polygons touching_buildplate = islands[island_idx];
+        std::vector<unsigned int> poly_indices;
+        for (unsigned int layer_idx = 1; layer_idx < support_areas.size() && touching_buildplate.size() > 0; layer_idx++)
         {
-            Polygons& supportLayer = supportAreas[layer_idx];
-            
             if (conical_support)
             { // with conical support the next layer is allowed to be larger than the previous
-                touching_buildplate = touching_buildplate.offset(std::abs(conical_support_offset) + 10, ClipperLib::jtMiter, 10); 
+                touching_buildplate.offsetInPlace(std::abs(conical_support_offset) + 10, ClipperLib::jtMiter, 10); 
                 // + 10 and larger miter limit cause performing an outward offset after an inward offset can disregard sharp corners
                 //
                 // conical support can make
@@ -280,16 +460,40 @@ void AreaSupport::generateSupportAreas(SliceDataStorage& storage, unsigned int m
                 //  | :..    <==    : |__
                 //  .\___           :....
                 //
-                
             }
-            
-            touching_buildplate = supportLayer.intersection(touching_buildplate); // from bottom to top, support areas can only decrease!
-            
-            supportAreas[layer_idx] = touching_buildplate;
+
+            polygon_index_per_layer[layer_idx].findHits(AABB(touching_buildplate), poly_indices);
+            Polygons nearby_support;
+            for (unsigned int poly_idx : poly_indices)
+            {
+                nearby_support.add(support_areas[layer_idx][poly_idx]);
+            }
+            touching_buildplate = nearby_support.intersection(touching_buildplate); // from bottom to top, support areas can only decrease!
+            touching_buildplate_per_layer.push_back(touching_buildplate);
         }
-    }
-}
+    });
 
+    ThreadPool::getInstance()->parallelForLayers(1, support_areas.size(), [&](int layer_idx)
+    {
+        Polygons touching_buildplate;
+        AABB touching_box;
+        bool needs_union = false; // only when the support resting on several islands meets
+        for (const std::vector<Polygons>& touching_buildplate_per_layer : touching_buildplate_per_island)
+        {
+            if (touching_buildplate_per_layer.size() < static_cast<unsigned int>(layer_idx) || touching_buildplate_per_layer[layer_idx - 1].size() == 0)
+            {
+                continue;
+            }
+            const Polygons& island_support = touching_buildplate_per_layer[layer_idx - 1];
+            const AABB island_box(island_support);
+            needs_union |= touching_buildplate.size() > 0 && touching_box.hit(island_box);
+            touching_box.include(island_box.min);
+            touching_box.include(island_box.max);
+            touching_buildplate.add(island_support);
+        }
+        support_areas[layer_idx] = needs_union ? touching_buildplate.unionPolygons() : std::move(touching_buildplate);
+    });
+}
 
 /*            layer 2
  * layer 1 ______________|
@@ -302,10 +506,22 @@ void AreaSupport::generateSupportAreas(SliceDataStorage& storage, unsigned int m
  *         ^^^^^^^^^      overhang extensions
  *         ^^^^^^^^^^^^^^ overhang
  */
-std::pair<Polygons, Polygons> AreaSupport::computeBasicAndFullOverhang(const SliceDataStorage& storage, const SliceMeshStorage& mesh, const unsigned int layer_idx, const int64_t max_dist_from_lower_layer)
+std::pair<Polygons, Polygons> AreaSupport::computeBasicAndFullOverhang(const SliceDataStorage& storage, const SliceMeshStorage& mesh, const unsigned int layer_idx, const int64_t max_dist_from_lower_layer, const coord_t raster_resolution)
 {
+    if (raster_resolution > 0)
+    {
+        const Bitmap supportee = Bitmap::rasterize(mesh.layers[layer_idx].getOutlines(), raster_resolution);
+        Bitmap supported = Bitmap::rasterize(storage.getCachedLayerOutlines(layer_idx - 1), raster_resolution).offset(max_dist_from_lower_layer);
+        Bitmap basic_overhang = supportee;
+        basic_overhang.differenceWith(supported);
+        Bitmap full_overhang = basic_overhang.offset(max_dist_from_lower_layer + 100); // +100 for easier joining with support from layer above
+        supported.unionWith(supportee);
+        full_overhang.intersectWith(supported);
+        return std::make_pair(basic_overhang.toPolygons(), full_overhang.toPolygons());
+    }
+
     Polygons supportLayer_supportee = mesh.layers[layer_idx].getOutlines();
-    Polygons supportLayer_supporter = storage.getLayerOutlines(layer_idx-1, false);
+    const Polygons& supportLayer_supporter = storage.getCachedLayerOutlines(layer_idx - 1);
 
     Polygons supportLayer_supported =  supportLayer_supporter.offset(max_dist_from_lower_layer);
     Polygons basic_overhang = supportLayer_supportee.difference(supportLayer_supported);
@@ -331,9 +547,10 @@ void AreaSupport::detectOverhangPoints(
     int supportMinAreaSqrt
 )
 {
-    ExtruderTrain* infill_extr = storage.meshgroup->getExtruderTrain(storage.getSettingAsIndex("support_infill_extruder_nr"));
-    const unsigned int support_line_width = infill_extr->getSettingInMicrons("support_line_width");
-    for (int layer_idx = 0; layer_idx < layer_count; layer_idx++)
+    ExtruderTrain* infill_extr = storage.meshgroup->getExtruderTrain(storage.getSettingAsIndex(SettingKey::support_infill_extruder_nr));
+    const unsigned int support_line_width = infill_extr->getSettingInMicrons(SettingKey::support_line_width);
+    std::vector<std::vector<Polygons>> small_part_polys_per_layer(layer_count);
+    ThreadPool::getInstance()->parallelForLayers(0, layer_count, [&](int layer_idx)
     {
         SliceLayer& layer = mesh.layers[layer_idx];
         for (SliceLayerPart& part : layer.parts)
@@ -349,18 +566,18 @@ void AreaSupport::detectOverhangPoints(
                 
                 if (part_poly.size() > 0)
                 {
-                    if (overhang_points.size() > 0 && overhang_points.back().first == layer_idx)
-                        overhang_points.back().second.push_back(part_poly);
-                    else 
-                    {
-                        std::vector<Polygons> small_part_polys;
-                        small_part_polys.push_back(part_poly);
-                        overhang_points.emplace_back<std::pair<int, std::vector<Polygons>>>(std::make_pair(layer_idx, small_part_polys));
-                    }
+                    small_part_polys_per_layer[layer_idx].push_back(part_poly);
                 }
                 
             }
         }
+    });
+    for (int layer_idx = 0; layer_idx < layer_count; layer_idx++)
+    {
+        if (small_part_polys_per_layer[layer_idx].size() > 0)
+        {
+            overhang_points.emplace_back(layer_idx, std::move(small_part_polys_per_layer[layer_idx]));
+        }
     }
 }
 
@@ -389,11 +606,25 @@ void AreaSupport::handleTowers(
             if (overhang_points_pos > 0 && overhang_points[overhang_points_pos - 1].first == layer_overhang_point - 1)
             {
                 std::vector<Polygons>& overhang_points_below = overhang_points[overhang_points_pos - 1].second;
+                // expand the points below only once and index them, so that each point here is only compared to the points below near it
+                std::vector<Polygons> expanded_points_below;
+                std::vector<AABB> boxes_below;
+                expanded_points_below.reserve(overhang_points_below.size());
+                boxes_below.reserve(overhang_points_below.size());
+                for (Polygons& poly_below : overhang_points_below)
+                {
+                    expanded_points_below.push_back(poly_below.offset(supportMinAreaSqrt*2));
+                    boxes_below.emplace_back(expanded_points_below.back());
+                }
+                AABBIndex index_below;
+                index_below.build(boxes_below);
+                std::vector<unsigned int> below_indices;
                 for (Polygons& poly_here : overhang_points_here)
                 {
-                    for (Polygons& poly_below : overhang_points_below)
+                    index_below.findHits(AABB(poly_here), below_indices);
+                    for (unsigned int below_idx : below_indices)
                     {
-                        poly_here = poly_here.difference(poly_below.offset(supportMinAreaSqrt*2));
+                        poly_here.differenceWith(expanded_points_below[below_idx]);
                     }
                 }
             }
@@ -405,17 +636,20 @@ void AreaSupport::handleTowers(
     }
     
     // make tower roofs
-    //for (Polygons& tower_roof : towerRoofs)
-    for (unsigned int r = 0; r < towerRoofs.size(); r++)
+    Polygons tower_roofs_here; // all towers are added to the support at once, rather than with a union per tower
+    for (Polygons& tower_roof : towerRoofs)
     {
-        supportLayer_this = supportLayer_this.unionPolygons(towerRoofs[r]);
+        tower_roofs_here.add(tower_roof);
         
-        Polygons& tower_roof = towerRoofs[r];
         if (tower_roof.size() > 0 && tower_roof[0].area() < supportTowerDiameter * supportTowerDiameter)
         {
-            towerRoofs[r] = tower_roof.offset(towerRoofExpansionDistance);
+            tower_roof.offsetInPlace(towerRoofExpansionDistance);
         }
     }
+    if (tower_roofs_here.size() > 0)
+    {
+        supportLayer_this.unionWith(tower_roofs_here);
+    }
 }
 
 void AreaSupport::handleWallStruts(
@@ -424,6 +658,7 @@ void AreaSupport::handleWallStruts(
     int supportTowerDiameter
     )
 {
+    Polygons struts; // added to the support at once after all walls are found
     for (unsigned int p = 0; p < supportLayer_this.size(); p++)
     {
         PolygonRef poly = supportLayer_this[p];
@@ -447,34 +682,37 @@ void AreaSupport::handleWallStruts(
                 
             
             // an estimate of the width of the area
-            int width = sqrt( poly.area() * poly.area() / best_length2 ); // sqrt (a^2 / l^2) instead of a / sqrt(l^2)
+            const double area = poly.area();
+            int width = sqrt( area * area / best_length2 ); // sqrt (a^2 / l^2) instead of a / sqrt(l^2)
             
             // add square tower (strut) in the middle of the wall
             if (width < supportMinAreaSqrt)
             {
                 Point mid = (poly[best] + poly[(best+1) % poly.size()] ) / 2;
-                Polygons struts;
                 PolygonRef strut = struts.newPoly();
                 strut.add(mid + Point( supportTowerDiameter/2,  supportTowerDiameter/2));
                 strut.add(mid + Point(-supportTowerDiameter/2,  supportTowerDiameter/2));
                 strut.add(mid + Point(-supportTowerDiameter/2, -supportTowerDiameter/2));
                 strut.add(mid + Point( supportTowerDiameter/2, -supportTowerDiameter/2));
-                supportLayer_this = supportLayer_this.unionPolygons(struts);
             }
         }
     }
+    if (struts.size() > 0)
+    {
+        supportLayer_this.unionWith(struts);
+    }
 }
 
 
 void AreaSupport::generateSupportInterface(SliceDataStorage& storage, const SliceMeshStorage& mesh, std::vector<Polygons>& support_areas, const unsigned int layer_count)
 {
-    const unsigned int roof_layer_count = round_divide(mesh.getSettingInMicrons("support_roof_height"), storage.getSettingInMicrons("layer_height"));
-    const unsigned int bottom_layer_count = round_divide(mesh.getSettingInMicrons("support_bottom_height"), storage.getSettingInMicrons("layer_height"));
-    const unsigned int z_distance_bottom = round_up_divide(mesh.getSettingInMicrons("support_bottom_distance"), storage.getSettingInMicrons("layer_height"));
-    const unsigned int z_distance_top = round_up_divide(mesh.getSettingInMicrons("support_top_distance"), storage.getSettingInMicrons("layer_height"));
+    const unsigned int roof_layer_count = round_divide(mesh.getSettingInMicrons(SettingKey::support_roof_height), storage.getSettingInMicrons(SettingKey::layer_height));
+    const unsigned int bottom_layer_count = round_divide(mesh.getSettingInMicrons(SettingKey::support_bottom_height), storage.getSettingInMicrons(SettingKey::layer_height));
+    const unsigned int z_distance_bottom = round_up_divide(mesh.getSettingInMicrons(SettingKey::support_bottom_distance), storage.getSettingInMicrons(SettingKey::layer_height));
+    const unsigned int z_distance_top = round_up_divide(mesh.getSettingInMicrons(SettingKey::support_top_distance), storage.getSettingInMicrons(SettingKey::layer_height));
 
     std::vector<SupportLayer>& supportLayers = storage.support.supportLayers;
-    for (unsigned int layer_idx = 0; layer_idx < layer_count; layer_idx++)
+    ThreadPool::getInstance()->parallelForLayers(0, layer_count, [&](int layer_idx)
     {
         SupportLayer& layer = supportLayers[layer_idx];
 
@@ -482,17 +720,36 @@ void AreaSupport::generateSupportInterface(SliceDataStorage& storage, const Slic
         const unsigned int layer_idx_below = std::max(0, int(layer_idx) - int(bottom_layer_count) - int(z_distance_bottom));
         if (layer_idx_above < supportLayers.size())
         {
+            if (support_areas[layer_idx].size() == 0)
+            { // no interface to be found, and nothing to subtract it from
+                return;
+            }
+            const AABB support_box(support_areas[layer_idx]);
+            std::vector<unsigned int> part_indices;
+            // only the parts hitting the support can contribute to its intersection with the outlines of a layer
+            auto intersectOutlines = [&](const SliceLayer& outline_layer)
+            {
+                outline_layer.findPartsHitting(support_box, part_indices);
+                Polygons outlines;
+                for (unsigned int part_idx : part_indices)
+                {
+                    outlines.add(outline_layer.parts[part_idx].print_outline);
+                }
+                if (outlines.size() == 0)
+                {
+                    return Polygons();
+                }
+                return support_areas[layer_idx].intersection(outlines);
+            };
             Polygons roofs;
             if (roof_layer_count > 0)
             {
-                const Polygons outlines_above = mesh.layers[layer_idx_above].getOutlines();
-                roofs = support_areas[layer_idx].intersection(outlines_above);
+                roofs = intersectOutlines(mesh.layers[layer_idx_above]);
             }
             Polygons bottoms;
             if (bottom_layer_count > 0)
             {
-                const Polygons outlines_below = mesh.layers[layer_idx_below].getOutlines();
-                bottoms = support_areas[layer_idx].intersection(outlines_below);
+                bottoms = intersectOutlines(mesh.layers[layer_idx_below]);
             }
             Polygons skin = roofs.unionPolygons(bottoms);
             skin.removeSmallAreas(1.0);
@@ -503,7 +760,7 @@ void AreaSupport::generateSupportInterface(SliceDataStorage& storage, const Slic
         {
             layer.skin.add(layer.supportAreas);
         }
-    }
+    });
 }
 
 
@@ -5,6 +5,8 @@
 #include "sliceDataStorage.h"
 #include "MeshGroup.h"
 #include "commandSocket.h"
+#include "SliceContext.h"
+#include "utils/Bitmap.h"
 
 namespace cura {
 
@@ -13,10 +15,14 @@ public:
 
     /*!
      * Generate the support areas and support skin areas for all models.
+     * 
+     * The outlines of the layers must have been cached with SliceDataStorage::cacheLayerOutlines.
+     * 
      * \param storage data storage containing the input layer outline data and containing the output support storage per layer
      * \param layer_count total number of layers
+     * \param context Where to send the progress to and whether to stop early
      */
-    static void generateSupportAreas(SliceDataStorage& storage, unsigned int layer_count);
+    static void generateSupportAreas(SliceDataStorage& storage, unsigned int layer_count, const SliceContext& context);
         
 private:
     /*!
@@ -27,8 +33,9 @@ private:
      * \param storage data storage containing the input layer outline data
      * \param mesh_idx The index of the object for which to generate support areas
      * \param layer_count total number of layers
+     * \param context Where to send the progress to and whether to stop early
      */
-    static void generateSupportAreas(SliceDataStorage& storage, unsigned int mesh_idx, unsigned int layer_count, std::vector<Polygons>& supportAreas);
+    static void generateSupportAreas(SliceDataStorage& storage, unsigned int mesh_idx, unsigned int layer_count, std::vector<Polygons>& supportAreas, const SliceContext& context);
 
 
 
@@ -58,6 +65,35 @@ private:
      */
     static Polygons join(Polygons& supportLayer_up, Polygons& supportLayer_this, int64_t supportJoinDistance, int64_t smoothing_distance, int min_smoothing_area, bool conical_support, int64_t conical_support_offset, int64_t conical_smallest_breadth);
 
+    /*!
+     * Join the current rasterized support layer with the support of the layer above, like the join of polygons.
+     * 
+     * There is no smoothing, since the pixels don't have the small details which it removes.
+     * 
+     * \param supportLayer_up The support areas the layer above
+     * \param supportLayer_this The overhang areas of the current layer at hand, which are moved into the result
+     * \param supportJoinDistance The distance to be filled between two support areas
+     * \param conical_support Whether the support should be conical instead of cylindrical
+     * \param conical_support_offset The offset determining the angle of the conical support, in whole pixels so that it isn't rounded in every layer
+     * \param conical_smallest_breadth The breadth of the smallest support area which is not to be reduced to a smaller size due to conical support.
+     * 
+     * \return The joined support areas for this layer.
+     */
+    static Bitmap join(const Bitmap& supportLayer_up, Bitmap& supportLayer_this, int64_t supportJoinDistance, bool conical_support, int64_t conical_support_offset, int64_t conical_smallest_breadth);
+
+    /*!
+     * Remove the support which doesn't rest on the build plate, for support on the build plate only.
+     * 
+     * From the bottom up, the support of each layer is limited to the support below it which touches the build plate.
+     * That only depends on the island of the first layer on which the support rests,
+     * so each island is followed upward on its own and is only intersected with the support polygons near it.
+     * 
+     * \param[in,out] support_areas The support areas of each layer
+     * \param conical_support Whether the support is conical, so that a layer may be larger than the layer below
+     * \param conical_support_offset The offset determining the angle of the conical support
+     */
+    static void removeSupportNotOnBuildplate(std::vector<Polygons>& support_areas, bool conical_support, int64_t conical_support_offset);
+
     /*!
      * Joins the layerpart outlines of all meshes and collects the overhang points (small areas).
      * \param storage input layer outline information
@@ -87,9 +123,10 @@ private:
      * \param mesh The mesh for which to compute the basic overhangs
      * \param layer_idx The layer for which to compute the overhang
      * \param max_dist_from_lower_layer The outward distance from the layer below which can be supported by it
+     * \param raster_resolution The size of the pixels in which to compute the overhang, or zero to compute it with polygons
      * \return a pair of basic overhang and full overhang
      */
-    static std::pair<Polygons, Polygons> computeBasicAndFullOverhang(const SliceDataStorage& storage, const SliceMeshStorage& mesh, const unsigned int layer_idx, const int64_t max_dist_from_lower_layer);
+    static std::pair<Polygons, Polygons> computeBasicAndFullOverhang(const SliceDataStorage& storage, const SliceMeshStorage& mesh, const unsigned int layer_idx, const int64_t max_dist_from_lower_layer, const coord_t raster_resolution);
     
     /*!
      * Adds tower pieces to the current support layer.
@@ -14,19 +14,19 @@ namespace cura
 
 void TimeEstimateCalculator::setFirmwareDefaults(const SettingsBaseVirtual* settings_base)
 {
-    max_feedrate[X_AXIS] = settings_base->getSettingInMillimetersPerSecond("machine_max_feedrate_x");
-    max_feedrate[Y_AXIS] = settings_base->getSettingInMillimetersPerSecond("machine_max_feedrate_y");
-    max_feedrate[Z_AXIS] = settings_base->getSettingInMillimetersPerSecond("machine_max_feedrate_z");
-    max_feedrate[E_AXIS] = settings_base->getSettingInMillimetersPerSecond("machine_max_feedrate_e");
-    max_acceleration[X_AXIS] = settings_base->getSettingInMillimetersPerSecond("machine_max_acceleration_x");
-    max_acceleration[Y_AXIS] = settings_base->getSettingInMillimetersPerSecond("machine_max_acceleration_y");
-    max_acceleration[Z_AXIS] = settings_base->getSettingInMillimetersPerSecond("machine_max_acceleration_z");
-    max_acceleration[E_AXIS] = settings_base->getSettingInMillimetersPerSecond("machine_max_acceleration_e");
-    max_xy_jerk = settings_base->getSettingInMillimetersPerSecond("machine_max_jerk_xy");
-    max_z_jerk = settings_base->getSettingInMillimetersPerSecond("machine_max_jerk_z");
-    max_e_jerk = settings_base->getSettingInMillimetersPerSecond("machine_max_jerk_e");
-    minimumfeedrate = settings_base->getSettingInMillimetersPerSecond("machine_minimum_feedrate");
-    acceleration = settings_base->getSettingInMillimetersPerSecond("machine_acceleration");
+    max_feedrate[X_AXIS] = settings_base->getSettingInMillimetersPerSecond(SettingKey::machine_max_feedrate_x);
+    max_feedrate[Y_AXIS] = settings_base->getSettingInMillimetersPerSecond(SettingKey::machine_max_feedrate_y);
+    max_feedrate[Z_AXIS] = settings_base->getSettingInMillimetersPerSecond(SettingKey::machine_max_feedrate_z);
+    max_feedrate[E_AXIS] = settings_base->getSettingInMillimetersPerSecond(SettingKey::machine_max_feedrate_e);
+    max_acceleration[X_AXIS] = settings_base->getSettingInMillimetersPerSecond(SettingKey::machine_max_acceleration_x);
+    max_acceleration[Y_AXIS] = settings_base->getSettingInMillimetersPerSecond(SettingKey::machine_max_acceleration_y);
+    max_acceleration[Z_AXIS] = settings_base->getSettingInMillimetersPerSecond(SettingKey::machine_max_acceleration_z);
+    max_acceleration[E_AXIS] = settings_base->getSettingInMillimetersPerSecond(SettingKey::machine_max_acceleration_e);
+    max_xy_jerk = settings_base->getSettingInMillimetersPerSecond(SettingKey::machine_max_jerk_xy);
+    max_z_jerk = settings_base->getSettingInMillimetersPerSecond(SettingKey::machine_max_jerk_z);
+    max_e_jerk = settings_base->getSettingInMillimetersPerSecond(SettingKey::machine_max_jerk_e);
+    minimumfeedrate = settings_base->getSettingInMillimetersPerSecond(SettingKey::machine_minimum_feedrate);
+    acceleration = settings_base->getSettingInMillimetersPerSecond(SettingKey::machine_acceleration);
 }
 
 
@@ -58,7 +58,9 @@ void TimeEstimateCalculator::setMaxZFeedrate(double max_z_feedrate)
 void TimeEstimateCalculator::reset()
 {
     extra_time = 0.0;
-    blocks.clear();
+    first_block_idx = 0;
+    block_count = 0;
+    finalized_time = 0.0;
 }
 
 // Calculates the maximum allowable speed at this point when you must be able to reach target_velocity using the 
@@ -97,6 +99,16 @@ static inline double acceleration_time_from_distance(double initial_feedrate, do
     return (-initial_feedrate + sqrt(discriminant)) / acceleration;
 }
     
+// Adds the time it takes to move along a block of which the trapezoid has been calculated to time.
+static inline void add_block_time(const TimeEstimateCalculator::Block& block, double& time)
+{
+    double plateau_distance = block.decelerate_after - block.accelerate_until;
+
+    time += acceleration_time_from_distance(block.initial_feedrate, block.accelerate_until, block.acceleration);
+    time += plateau_distance / block.nominal_feedrate;
+    time += acceleration_time_from_distance(block.final_feedrate, (block.distance - block.decelerate_after), block.acceleration);
+}
+
 // Calculates trapezoid parameters so that the entry- and exit-speed is compensated by the provided factors.
 void TimeEstimateCalculator::calculate_trapezoid_for_block(Block *block, double entry_factor, double exit_factor)
 {
@@ -184,9 +196,8 @@ void TimeEstimateCalculator::plan(Position newPos, double feedrate)
     if(current_abs_feedrate[E_AXIS] > max_e_jerk/2)
         vmax_junction = std::min(vmax_junction, max_e_jerk/2);
     vmax_junction = std::min(vmax_junction, block.nominal_feedrate);
-    double safe_speed = vmax_junction;
     
-    if ((blocks.size() > 0) && (previous_nominal_feedrate > 0.0001))
+    if ((block_count > 0) && (previous_nominal_feedrate > 0.0001))
     {
         double xy_jerk = sqrt(square(current_feedrate[X_AXIS]-previous_feedrate[X_AXIS])+square(current_feedrate[Y_AXIS]-previous_feedrate[Y_AXIS]));
         vmax_junction = block.nominal_feedrate;
@@ -206,49 +217,52 @@ void TimeEstimateCalculator::plan(Position newPos, double feedrate)
 
     double v_allowable = max_allowable_speed(-block.acceleration, MINIMUM_PLANNER_SPEED, block.distance);
     block.entry_speed = std::min(vmax_junction, v_allowable);
+    block.unplanned_entry_speed = block.entry_speed;
     block.nominal_length_flag = block.nominal_feedrate <= v_allowable;
-    block.recalculate_flag = true; // Always calculate trapezoid for new block
 
     previous_feedrate = current_feedrate;
     previous_nominal_feedrate = block.nominal_feedrate;
 
     currentPosition = newPos;
 
-    calculate_trapezoid_for_block(&block, block.entry_speed/block.nominal_feedrate, safe_speed/block.nominal_feedrate);
-    
-    blocks.push_back(block);
+    if (blocks.empty())
+    {
+        blocks.resize(lookahead_size);
+    }
+    if (block_count == lookahead_size)
+    { // none of the blocks in the window is final yet; finalize the oldest ones with the speeds planned so far
+        finalize_blocks(lookahead_size / 2);
+    }
+    getBlock(block_count) = block;
+    block_count++;
+
+    // The entry speed of a block which enters at its maximum entry speed isn't changed by later blocks,
+    // and neither are the speeds of the blocks before it, so those are final.
+    finalize_blocks(reverse_pass());
 }
 
 double TimeEstimateCalculator::calculate()
 {
-    reverse_pass();
-    forward_pass();
-    recalculate_trapezoids();
-    
-    double totalTime = extra_time;
-    for(unsigned int n=0; n<blocks.size(); n++)
+    if (block_count == 0)
     {
-        Block& block = blocks[n];
-        double plateau_distance = block.decelerate_after - block.accelerate_until;
-        
-        totalTime += acceleration_time_from_distance(block.initial_feedrate, block.accelerate_until, block.acceleration);
-        totalTime += plateau_distance / block.nominal_feedrate;
-        totalTime += acceleration_time_from_distance(block.final_feedrate, (block.distance - block.decelerate_after), block.acceleration);
+        return extra_time + finalized_time;
     }
-    return totalTime;
+    finalize_blocks(block_count - 1);
+    double totalTime = finalized_time;
+    // Last/newest block in buffer. Exit speed is set with MINIMUM_PLANNER_SPEED.
+    Block& newest = getBlock(0);
+    calculate_trapezoid_for_block(&newest, newest.entry_speed/newest.nominal_feedrate, MINIMUM_PLANNER_SPEED/newest.nominal_feedrate);
+    add_block_time(newest, totalTime);
+    return extra_time + totalTime;
 }
 
-// The kernel called by accelerationPlanner::calculate() when scanning the plan from last to first entry.
-void TimeEstimateCalculator::planner_reverse_pass_kernel(Block *previous, Block *current, Block *next)
+// The kernel called by reverse_pass() when scanning the plan from the newest block back.
+void TimeEstimateCalculator::planner_reverse_pass_kernel(Block *current, Block *next)
 {
-    (void)previous;
-    if(!current || !next)
-        return;
-
     // If entry speed is already at the maximum entry speed, no need to recheck. Block is cruising.
     // If not, block in state of acceleration or deceleration. Reset entry speed to maximum and
     // check for maximum allowable speed reductions to ensure maximum possible planned speed.
-    if (current->entry_speed != current->max_entry_speed)
+    if (current->unplanned_entry_speed != current->max_entry_speed)
     {
         // If nominal length true, max junction speed is guaranteed to be reached. Only compute
         // for max allowable speed if block is decelerating and nominal length is false.
@@ -258,29 +272,38 @@ void TimeEstimateCalculator::planner_reverse_pass_kernel(Block *previous, Block
         } else {
             current->entry_speed = current->max_entry_speed;
         }
-        current->recalculate_flag = true;
     }
 }
 
-void TimeEstimateCalculator::reverse_pass()
+unsigned int TimeEstimateCalculator::reverse_pass()
 {
-    Block* block[3] = {nullptr, nullptr, nullptr};
-    for(unsigned int n=blocks.size()-1; int(n)>=0; n--)
+    unsigned int max_entry_speed_idx = 0;
+    const Block& newest = getBlock(block_count - 1);
+    if (newest.entry_speed == newest.max_entry_speed)
     {
-        block[2]= block[1];
-        block[1]= block[0];
-        block[0] = &blocks[n];
-        planner_reverse_pass_kernel(block[0], block[1], block[2]);
+        max_entry_speed_idx = block_count - 1;
     }
+    // the oldest block of the window is never changed: its entry speed is already final
+    for (unsigned int next_idx = block_count - 1; next_idx > 1; next_idx--)
+    {
+        Block& current = getBlock(next_idx - 1);
+        const double old_entry_speed = current.entry_speed;
+        planner_reverse_pass_kernel(&current, &getBlock(next_idx));
+        if (max_entry_speed_idx == 0 && current.entry_speed == current.max_entry_speed)
+        {
+            max_entry_speed_idx = next_idx - 1;
+        }
+        if (current.entry_speed == old_entry_speed)
+        { // the blocks before it have already been planned from this entry speed
+            break;
+        }
+    }
+    return max_entry_speed_idx;
 }
 
-// The kernel called by accelerationPlanner::calculate() when scanning the plan from first to last entry.
-void TimeEstimateCalculator::planner_forward_pass_kernel(Block *previous, Block *current, Block *next)
+// The kernel called by finalize_blocks() when scanning the plan from first to last entry.
+void TimeEstimateCalculator::planner_forward_pass_kernel(Block *previous, Block *current)
 {
-    (void)next;
-    if(!previous)
-        return;
-
     // If the previous block is an acceleration block, but it is not long enough to complete the
     // full speed change within the block, we need to adjust the entry speed accordingly. Entry
     // speeds have already been reset, maximized, and reverse planned by reverse planner.
@@ -289,60 +312,28 @@ void TimeEstimateCalculator::planner_forward_pass_kernel(Block *previous, Block
     {
         if (previous->entry_speed < current->entry_speed)
         {
-            double entry_speed = std::min(current->entry_speed, max_allowable_speed(-previous->acceleration,previous->entry_speed,previous->distance) );
-
-            // Check for junction speed change
-            if (current->entry_speed != entry_speed)
-            {
-                current->entry_speed = entry_speed;
-                current->recalculate_flag = true;
-            }
+            current->entry_speed = std::min(current->entry_speed, max_allowable_speed(-previous->acceleration,previous->entry_speed,previous->distance) );
         }
     }
 }
 
-void TimeEstimateCalculator::forward_pass()
+void TimeEstimateCalculator::finalize_blocks(unsigned int finalized_block_count)
 {
-    Block* block[3] = {nullptr, nullptr, nullptr};
-    for(unsigned int n=0; n<blocks.size(); n++)
+    for (unsigned int idx = 1; idx <= finalized_block_count; idx++)
     {
-        block[0]= block[1];
-        block[1]= block[2];
-        block[2] = &blocks[n];
-        planner_forward_pass_kernel(block[0], block[1], block[2]);
-    }
-    planner_forward_pass_kernel(block[1], block[2], nullptr);
-}
-
-// Recalculates the trapezoid speed profiles for all blocks in the plan according to the 
-// entry_factor for each junction. Must be called by planner_recalculate() after 
-// updating the blocks.
-void TimeEstimateCalculator::recalculate_trapezoids()
-{
-    Block *current;
-    Block *next = nullptr;
-
-    for(unsigned int n=0; n<blocks.size(); n++)
-    {
-        current = next;
-        next = &blocks[n];
-        if (current)
-        {
-            // Recalculate if current block entry or exit junction speed has changed.
-            if (current->recalculate_flag || next->recalculate_flag)
-            {
-                // NOTE: Entry and exit factors always > 0 by all previous logic operations.
-                calculate_trapezoid_for_block(current, current->entry_speed/current->nominal_feedrate, next->entry_speed/current->nominal_feedrate);
-                current->recalculate_flag = false; // Reset current only to ensure next trapezoid is computed
-            }
-        }
+        planner_forward_pass_kernel(&getBlock(idx - 1), &getBlock(idx));
     }
-    // Last/newest block in buffer. Exit speed is set with MINIMUM_PLANNER_SPEED. Always recalculated.
-    if(next != nullptr)
+    // Recalculate the trapezoid speed profiles of the blocks according to the entry speed of each junction.
+    for (unsigned int idx = 0; idx < finalized_block_count; idx++)
     {
-        calculate_trapezoid_for_block(next, next->entry_speed/next->nominal_feedrate, MINIMUM_PLANNER_SPEED/next->nominal_feedrate);
-        next->recalculate_flag = false;
+        Block& current = getBlock(idx);
+        const Block& next = getBlock(idx + 1);
+        // NOTE: Entry and exit factors always > 0 by all previous logic operations.
+        calculate_trapezoid_for_block(&current, current.entry_speed/current.nominal_feedrate, next.entry_speed/current.nominal_feedrate);
+        add_block_time(current, finalized_time);
     }
+    first_block_idx = (first_block_idx + finalized_block_count) & (lookahead_size - 1);
+    block_count -= finalized_block_count;
 }
 
-}//namespace cura
\ No newline at end of file
+}//namespace cura
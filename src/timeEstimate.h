@@ -12,6 +12,12 @@ class SettingsBaseVirtual;
 /*!
  *  The TimeEstimateCalculator class generates a estimate of printing time calculated with acceleration in mind.
  *  Some of this code has been adapted from the Marlin sources.
+ *
+ *  Like the planner of the firmware, it only keeps a bounded lookahead window of blocks.
+ *  Blocks are finalized as soon as later moves can no longer change their speeds,
+ *  which is the case before any block which has been planned to enter at its maximum entry speed:
+ *  later moves only raise the entry speeds (unless a move can't even be entered at MINIMUM_PLANNER_SPEED).
+ *  Only when the window fills up without such a block, the oldest blocks are finalized early, which may make the estimate slightly longer.
  */
 
 class TimeEstimateCalculator
@@ -37,14 +43,13 @@ public:
     class Block
     {
     public:
-        bool recalculate_flag;
-        
         double accelerate_until;
         double decelerate_after;
         double initial_feedrate;
         double final_feedrate;
 
         double entry_speed;
+        double unplanned_entry_speed; //!< The entry speed from which the reverse pass starts: limited only by stopping within this block
         double max_entry_speed;
         bool nominal_length_flag;
         
@@ -71,7 +76,12 @@ private:
 
     Position currentPosition;
 
-    std::vector<Block> blocks;
+    const static unsigned int lookahead_size = 256; //!< The maximum number of blocks in the lookahead window; a power of two
+
+    std::vector<Block> blocks; //!< Ring buffer of the blocks in the lookahead window
+    unsigned int first_block_idx = 0; //!< The index into TimeEstimateCalculator::blocks of the oldest block in the window, of which the entry speed is final
+    unsigned int block_count = 0; //!< The number of blocks in the window
+    double finalized_time = 0.0; //!< The summed time of the blocks which have left the window since the last reset
 public:
     /*!
      * Set the movement configuration of the firmware.
@@ -90,13 +100,35 @@ public:
     
     double calculate();
 private:
-    void reverse_pass();
-    void forward_pass();
-    void recalculate_trapezoids();
-    
+    /*!
+     * Get a block in the lookahead window.
+     * 
+     * \param idx The index of the block in the window, where zero is the oldest block
+     */
+    Block& getBlock(unsigned int idx)
+    {
+        return blocks[(first_block_idx + idx) & (lookahead_size - 1)];
+    }
+
+    /*!
+     * Propagate the entry speed of the newest block back through the window, up to the first block of which the entry speed doesn't change.
+     * 
+     * \return The index of the newest block which now enters at its maximum entry speed, or zero if there is none
+     */
+    unsigned int reverse_pass();
+
+    /*!
+     * Finalize the oldest blocks of the window: plan their entry speeds forward, compute their trapezoids and add their time.
+     * 
+     * The entry speed of the block after them is planned forward as well, so that it becomes the oldest block of the window.
+     * 
+     * \param finalized_block_count The number of blocks to finalize; less than the number of blocks in the window
+     */
+    void finalize_blocks(unsigned int finalized_block_count);
+
     void calculate_trapezoid_for_block(Block *block, double entry_factor, double exit_factor);
-    void planner_reverse_pass_kernel(Block *previous, Block *current, Block *next);
-    void planner_forward_pass_kernel(Block *previous, Block *current, Block *next);
+    void planner_reverse_pass_kernel(Block *current, Block *next);
+    void planner_forward_pass_kernel(Block *previous, Block *current);
 };
 
 }//namespace cura
@@ -0,0 +1,66 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "AABBIndex.h"
+
+#include <algorithm> // sort, lower_bound, max
+
+namespace cura
+{
+
+AABBIndex::AABBIndex()
+: max_width(0)
+{
+}
+
+void AABBIndex::build(const std::vector<AABB>& boxes)
+{
+    std::vector<unsigned int> order(boxes.size());
+    for (unsigned int box_idx = 0; box_idx < boxes.size(); box_idx++)
+    {
+        order[box_idx] = box_idx;
+    }
+    std::sort(order.begin(), order.end(), [&boxes](unsigned int a, unsigned int b)
+        {
+            return boxes[a].min.X < boxes[b].min.X || (boxes[a].min.X == boxes[b].min.X && a < b);
+        });
+    sorted_boxes.clear();
+    sorted_boxes.reserve(boxes.size());
+    max_width = 0;
+    for (unsigned int box_idx : order)
+    {
+        sorted_boxes.push_back(boxes[box_idx]);
+        max_width = std::max(max_width, int64_t(boxes[box_idx].max.X - boxes[box_idx].min.X)); // empty boxes have a negative width
+    }
+    sorted_box_indices.swap(order);
+}
+
+void AABBIndex::clear()
+{
+    std::vector<AABB>().swap(sorted_boxes);
+    std::vector<unsigned int>().swap(sorted_box_indices);
+    max_width = 0;
+}
+
+void AABBIndex::findHits(const AABB& box, std::vector<unsigned int>& box_indices) const
+{
+    box_indices.clear();
+    if (box.max.X < box.min.X)
+    { // an empty box doesn't hit anything
+        return;
+    }
+    // a box starting more than max_width left of the query box also ends left of it
+    const int64_t first_min_x = box.min.X - max_width;
+    std::vector<AABB>::const_iterator first = std::lower_bound(sorted_boxes.begin(), sorted_boxes.end(), first_min_x, [](const AABB& sorted_box, int64_t min_x)
+        {
+            return sorted_box.min.X < min_x;
+        });
+    for (std::vector<AABB>::const_iterator it = first; it != sorted_boxes.end() && it->min.X <= box.max.X; ++it)
+    {
+        if (it->hit(box))
+        {
+            box_indices.push_back(sorted_box_indices[it - sorted_boxes.begin()]);
+        }
+    }
+    std::sort(box_indices.begin(), box_indices.end());
+}
+
+}//namespace cura
@@ -0,0 +1,60 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef UTILS_AABB_INDEX_H
+#define UTILS_AABB_INDEX_H
+
+#include <vector>
+
+#include "AABB.h"
+
+namespace cura
+{
+
+/*!
+ * An index over some bounding boxes, to quickly find the boxes which overlap with a given box, e.g. the parts of another layer near a part.
+ *
+ * The boxes are sorted by their minimal X, so that only the boxes starting within the widest box width left of a query box need to be tested.
+ * For plates full of small islands that's a narrow strip of the plate, rather than all of it.
+ *
+ * The index keeps copies of the boxes, so it stays valid as long as the indexed objects don't change.
+ */
+class AABBIndex
+{
+public:
+    AABBIndex();
+
+    /*!
+     * Index some boxes, replacing the boxes indexed before.
+     *
+     * \param boxes The boxes to index; a box is identified by its index in this vector
+     */
+    void build(const std::vector<AABB>& boxes);
+
+    /*!
+     * Remove all boxes from the index.
+     */
+    void clear();
+
+    /*!
+     * The number of indexed boxes.
+     */
+    unsigned int size() const
+    {
+        return sorted_boxes.size();
+    }
+
+    /*!
+     * Find the boxes which overlap with a given box, as in AABB::hit.
+     *
+     * \param box The box with which to find the overlapping boxes
+     * \param[out] box_indices Replaced with the indices of the overlapping boxes, in increasing order
+     */
+    void findHits(const AABB& box, std::vector<unsigned int>& box_indices) const;
+
+private:
+    std::vector<AABB> sorted_boxes; //!< The indexed boxes, ordered by their minimal X
+    std::vector<unsigned int> sorted_box_indices; //!< For each box in AABBIndex::sorted_boxes the index with which it was given
+    int64_t max_width; //!< The largest width of the indexed boxes
+};
+
+}//namespace cura
+#endif//UTILS_AABB_INDEX_H
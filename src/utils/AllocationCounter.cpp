@@ -0,0 +1,202 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "AllocationCounter.h"
+
+#include <algorithm> // min
+#include <cstdlib> // malloc, free
+#include <new>
+#ifdef ALLOCATION_COUNTING
+#include <atomic>
+#endif
+
+namespace cura
+{
+
+constexpr unsigned int AllocationCounter::max_thread_count;
+
+#ifdef ALLOCATION_COUNTING
+
+namespace
+{
+
+constexpr size_t header_size = 16; // each allocation is preceded by its size, keeping the alignment malloc provides
+
+struct ThreadCounts
+{
+    std::atomic<size_t> allocation_count;
+    std::atomic<size_t> allocated_bytes;
+};
+
+// static storage, so that the counts are zero before any constructor runs and never allocate themselves
+ThreadCounts thread_counts[AllocationCounter::max_thread_count];
+std::atomic<unsigned int> thread_count(0); // the number of threads which have allocated memory
+thread_local int thread_idx = -1; // the number of the current thread, or -1 if it hasn't allocated memory yet
+std::atomic<size_t> live_bytes(0);
+std::atomic<size_t> peak_live_bytes(0);
+
+}//namespace
+
+bool AllocationCounter::isAvailable()
+{
+    return true;
+}
+
+void AllocationCounter::getThreadCounts(std::vector<Counts>& counts)
+{
+    const unsigned int count = std::min(thread_count.load(std::memory_order_relaxed), max_thread_count);
+    counts.resize(count);
+    for (unsigned int idx = 0; idx < count; idx++)
+    {
+        counts[idx].allocation_count = thread_counts[idx].allocation_count.load(std::memory_order_relaxed);
+        counts[idx].allocated_bytes = thread_counts[idx].allocated_bytes.load(std::memory_order_relaxed);
+    }
+}
+
+size_t AllocationCounter::getLiveBytes()
+{
+    return live_bytes.load(std::memory_order_relaxed);
+}
+
+size_t AllocationCounter::getPeakLiveBytes()
+{
+    return peak_live_bytes.load(std::memory_order_relaxed);
+}
+
+void AllocationCounter::resetPeakLiveBytes()
+{
+    peak_live_bytes.store(live_bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+void* AllocationCounter::allocate(size_t size)
+{
+    char* block = static_cast<char*>(std::malloc(header_size + size));
+    if (block == nullptr)
+    {
+        return nullptr;
+    }
+    *reinterpret_cast<size_t*>(block) = size;
+
+    if (thread_idx < 0)
+    {
+        thread_idx = std::min(thread_count.fetch_add(1, std::memory_order_relaxed), max_thread_count - 1);
+    }
+    ThreadCounts& counts = thread_counts[thread_idx];
+    counts.allocation_count.fetch_add(1, std::memory_order_relaxed);
+    counts.allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+
+    const size_t live = live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+    size_t peak = peak_live_bytes.load(std::memory_order_relaxed);
+    while (live > peak && !peak_live_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+    {
+    }
+    return block + header_size;
+}
+
+void AllocationCounter::deallocate(void* memory)
+{
+    if (memory == nullptr)
+    {
+        return;
+    }
+    char* block = static_cast<char*>(memory) - header_size;
+    live_bytes.fetch_sub(*reinterpret_cast<size_t*>(block), std::memory_order_relaxed);
+    std::free(block);
+}
+
+#else // ALLOCATION_COUNTING
+
+bool AllocationCounter::isAvailable()
+{
+    return false;
+}
+
+void AllocationCounter::getThreadCounts(std::vector<Counts>& counts)
+{
+    counts.clear();
+}
+
+size_t AllocationCounter::getLiveBytes()
+{
+    return 0;
+}
+
+size_t AllocationCounter::getPeakLiveBytes()
+{
+    return 0;
+}
+
+void AllocationCounter::resetPeakLiveBytes()
+{
+}
+
+void* AllocationCounter::allocate(size_t size)
+{
+    return std::malloc(size);
+}
+
+void AllocationCounter::deallocate(void* memory)
+{
+    std::free(memory);
+}
+
+#endif // ALLOCATION_COUNTING
+
+}//namespace cura
+
+#ifdef ALLOCATION_COUNTING
+
+void* operator new(std::size_t size)
+{
+    void* memory = cura::AllocationCounter::allocate(size);
+    if (memory == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return cura::AllocationCounter::allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return cura::AllocationCounter::allocate(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+    cura::AllocationCounter::deallocate(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+    cura::AllocationCounter::deallocate(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept
+{
+    cura::AllocationCounter::deallocate(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept
+{
+    cura::AllocationCounter::deallocate(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+    cura::AllocationCounter::deallocate(memory);
+}
+
+void operator delete[](void* memory, std::size_t) noexcept
+{
+    cura::AllocationCounter::deallocate(memory);
+}
+
+#endif // ALLOCATION_COUNTING
@@ -0,0 +1,81 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef UTILS_ALLOCATION_COUNTER_H
+#define UTILS_ALLOCATION_COUNTER_H
+
+#include <cstddef> // size_t
+#include <vector>
+
+namespace cura
+{
+
+/*!
+ * Counts the memory allocated with operator new: the number of allocations and bytes of each thread, and the bytes live in total.
+ *
+ * The counts are recorded into the ProfilingReport at the end of each stage, to find the stages which cause the most allocation churn.
+ *
+ * The counter replaces the global operator new and delete, so it's only compiled in when CuraEngine is built with ENABLE_ALLOCATION_COUNTING.
+ * Otherwise all counts stay zero.
+ */
+class AllocationCounter
+{
+public:
+    /*!
+     * The allocations made by a single thread, since it started.
+     */
+    struct Counts
+    {
+        size_t allocation_count; //!< The number of allocations
+        size_t allocated_bytes; //!< The number of bytes allocated, including those which have been freed again
+    };
+
+    /*!
+     * The number of threads counted separately; the allocations of any later threads are counted together with the last one.
+     */
+    static constexpr unsigned int max_thread_count = 256;
+
+    /*!
+     * Whether this build of CuraEngine counts allocations.
+     */
+    static bool isAvailable();
+
+    /*!
+     * Get the allocations of each thread up till now, numbered in the order in which the threads first allocated memory.
+     *
+     * \param[out] thread_counts The counts of each thread which has allocated memory
+     */
+    static void getThreadCounts(std::vector<Counts>& thread_counts);
+
+    /*!
+     * The number of bytes allocated and not freed yet, by all threads.
+     */
+    static size_t getLiveBytes();
+
+    /*!
+     * The most bytes which were live at once since the start or since AllocationCounter::resetPeakLiveBytes.
+     */
+    static size_t getPeakLiveBytes();
+
+    /*!
+     * Start tracking the peak of the live bytes anew from the bytes which are live now.
+     */
+    static void resetPeakLiveBytes();
+
+    /*!
+     * Allocate memory with malloc and count it for the current thread.
+     *
+     * Used by the replaced operator new.
+     *
+     * \return The memory, or nullptr if it couldn't be allocated
+     */
+    static void* allocate(size_t size);
+
+    /*!
+     * Free memory allocated by AllocationCounter::allocate, from any thread.
+     *
+     * Used by the replaced operator delete.
+     */
+    static void deallocate(void* memory);
+};
+
+}//namespace cura
+#endif//UTILS_ALLOCATION_COUNTER_H
@@ -0,0 +1,545 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "Bitmap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring> // memset
+#include <unordered_map>
+
+namespace cura
+{
+
+namespace
+{
+
+int64_t floorDivide(int64_t dividend, int64_t divisor)
+{
+    const int64_t quotient = dividend / divisor;
+    return (dividend % divisor != 0 && (dividend < 0) != (divisor < 0)) ? quotient - 1 : quotient;
+}
+
+/*!
+ * Shift the pixels of a row of \p word_count words by \p shift pixels toward higher pixel indices, or lower ones for a negative shift.
+ * The pixels shifted in are unset.
+ */
+void shiftRow(const uint64_t* row, uint64_t* shifted, int64_t word_count, int64_t shift)
+{
+    const int64_t word_shift = std::abs(shift) / 64;
+    const int bit_shift = std::abs(shift) % 64;
+    for (int64_t word_idx = 0; word_idx < word_count; word_idx++)
+    {
+        uint64_t word = 0;
+        if (shift >= 0)
+        {
+            const int64_t source = word_idx - word_shift;
+            if (source >= 0)
+            {
+                word = row[source] << bit_shift;
+            }
+            if (bit_shift > 0 && source - 1 >= 0)
+            {
+                word |= row[source - 1] >> (64 - bit_shift);
+            }
+        }
+        else
+        {
+            const int64_t source = word_idx + word_shift;
+            if (source < word_count)
+            {
+                word = row[source] >> bit_shift;
+            }
+            if (bit_shift > 0 && source + 1 < word_count)
+            {
+                word |= row[source + 1] << (64 - bit_shift);
+            }
+        }
+        shifted[word_idx] = word;
+    }
+}
+
+/*!
+ * Dilate or erode all rows horizontally from \p radius pixels to \p target_radius pixels.
+ *
+ * A row dilated by r pixels is dilated by another s <= 2r + 1 pixels by combining it with itself shifted s pixels both ways,
+ * so the radius grows exponentially with the number of shifts.
+ */
+void growRows(std::vector<uint64_t>& words, int64_t word_count, int64_t& radius, int64_t target_radius, bool erode)
+{
+    std::vector<uint64_t> shifted_left(word_count);
+    std::vector<uint64_t> shifted_right(word_count);
+    while (radius < target_radius)
+    {
+        const int64_t shift = std::min(2 * radius + 1, target_radius - radius);
+        for (size_t row_start = 0; row_start < words.size(); row_start += word_count)
+        {
+            uint64_t* row = &words[row_start];
+            if (shift < 64)
+            { // the usual small step, shifting the bits in from the neighboring words directly
+                uint64_t previous = 0;
+                for (int64_t word_idx = 0; word_idx < word_count; word_idx++)
+                {
+                    const uint64_t word = row[word_idx];
+                    const uint64_t next = word_idx + 1 < word_count ? row[word_idx + 1] : 0;
+                    const uint64_t left = (word << shift) | (previous >> (64 - shift));
+                    const uint64_t right = (word >> shift) | (next << (64 - shift));
+                    row[word_idx] = erode ? (word & left & right) : (word | left | right);
+                    previous = word;
+                }
+                continue;
+            }
+            shiftRow(row, shifted_left.data(), word_count, shift);
+            shiftRow(row, shifted_right.data(), word_count, -shift);
+            for (int64_t word_idx = 0; word_idx < word_count; word_idx++)
+            {
+                if (erode)
+                {
+                    row[word_idx] &= shifted_left[word_idx] & shifted_right[word_idx];
+                }
+                else
+                {
+                    row[word_idx] |= shifted_left[word_idx] | shifted_right[word_idx];
+                }
+            }
+        }
+        radius += shift;
+    }
+}
+
+/*!
+ * The half width of the row \p dy rows from the center of a disk of \p radius pixels.
+ */
+int64_t diskHalfWidth(int64_t radius, int64_t dy)
+{
+    int64_t half_width = std::sqrt(static_cast<double>(radius * radius - dy * dy));
+    while (half_width * half_width + dy * dy > radius * radius)
+    {
+        half_width--;
+    }
+    while ((half_width + 1) * (half_width + 1) + dy * dy <= radius * radius)
+    {
+        half_width++;
+    }
+    return half_width;
+}
+
+/*!
+ * The directions of the pixel edges: +x, +y, -x and -y.
+ */
+const int64_t direction_x[4] = { 1, 0, -1, 0 };
+const int64_t direction_y[4] = { 0, 1, 0, -1 };
+
+uint64_t vertexKey(int64_t x, int64_t y)
+{
+    return (static_cast<uint64_t>(static_cast<uint32_t>(y)) << 32) | static_cast<uint32_t>(x);
+}
+
+bool isCollinear(const Point& a, const Point& b, const Point& c)
+{
+    return (b.X - a.X) * (c.Y - b.Y) == (b.Y - a.Y) * (c.X - b.X);
+}
+
+}
+
+Bitmap::Bitmap(coord_t resolution)
+: resolution(resolution)
+, min_row(0)
+, row_count(0)
+, min_word(0)
+, word_count(0)
+{
+}
+
+Bitmap Bitmap::rasterize(const Polygons& polygons, coord_t resolution)
+{
+    struct Crossing
+    {
+        int64_t row;
+        int64_t first_pixel; //!< The first pixel of which the center lies to the right of the crossing
+        int winding; //!< +1 for an upward edge, -1 for a downward one
+        bool operator<(const Crossing& other) const
+        {
+            return row < other.row || (row == other.row && first_pixel < other.first_pixel);
+        }
+    };
+    std::vector<Crossing> crossings;
+    const double pixels_per_unit = 1.0 / resolution;
+    for (unsigned int poly_idx = 0; poly_idx < polygons.size(); poly_idx++)
+    {
+        const PolygonRef poly = polygons[poly_idx];
+        if (poly.size() == 0)
+        {
+            continue;
+        }
+        Point p0 = poly.back();
+        for (const Point& p1 : poly)
+        {
+            if (p0.Y != p1.Y)
+            { // the rows of which the center lies in [min y, max y)
+                const Point& low = p0.Y < p1.Y ? p0 : p1;
+                const Point& high = p0.Y < p1.Y ? p1 : p0;
+                const int64_t first_row = std::ceil(low.Y * pixels_per_unit - 0.5);
+                const int64_t end_row = std::ceil(high.Y * pixels_per_unit - 0.5);
+                const double dx_dy = static_cast<double>(high.X - low.X) / (high.Y - low.Y);
+                for (int64_t y = first_row; y < end_row; y++)
+                {
+                    const double x = low.X + ((y + 0.5) * resolution - low.Y) * dx_dy;
+                    crossings.push_back(Crossing{y, static_cast<int64_t>(std::ceil(x * pixels_per_unit - 0.5)), p1.Y > p0.Y ? 1 : -1});
+                }
+            }
+            p0 = p1;
+        }
+    }
+    std::sort(crossings.begin(), crossings.end());
+
+    struct Span
+    {
+        int64_t row;
+        int64_t begin;
+        int64_t end;
+    };
+    std::vector<Span> spans;
+    int winding = 0;
+    for (const Crossing& crossing : crossings)
+    {
+        const int new_winding = winding + crossing.winding;
+        if (winding == 0 && new_winding != 0)
+        {
+            spans.push_back(Span{crossing.row, crossing.first_pixel, crossing.first_pixel});
+        }
+        else if (winding != 0 && new_winding == 0)
+        {
+            spans.back().end = crossing.first_pixel;
+            if (spans.back().end <= spans.back().begin)
+            {
+                spans.pop_back();
+            }
+        }
+        winding = new_winding;
+    }
+
+    Bitmap result(resolution);
+    if (spans.empty())
+    {
+        return result;
+    }
+    int64_t first_pixel = spans.front().begin;
+    int64_t end_pixel = spans.front().end;
+    for (const Span& span : spans)
+    {
+        first_pixel = std::min(first_pixel, span.begin);
+        end_pixel = std::max(end_pixel, span.end);
+    }
+    const int64_t first_word = floorDivide(first_pixel, 64);
+    result.setBox(spans.front().row, spans.back().row - spans.front().row + 1, first_word, floorDivide(end_pixel - 1, 64) - first_word + 1);
+    for (const Span& span : spans)
+    {
+        uint64_t* row = result.row(span.row);
+        for (int64_t x = span.begin; x < span.end; )
+        {
+            const int64_t word = floorDivide(x, 64);
+            const int64_t bit = x - word * 64;
+            const int64_t end = std::min(span.end, (word + 1) * 64);
+            const int64_t count = end - x;
+            row[word - first_word] |= (count == 64 ? ~uint64_t(0) : ((uint64_t(1) << count) - 1)) << bit;
+            x = end;
+        }
+    }
+    return result;
+}
+
+Polygons Bitmap::toPolygons() const
+{
+    // the pixel edges between set and unset pixels, directed with the set pixel on the left,
+    // as the directions in which they leave each pixel corner; the upper 4 bits mark the edges already followed
+    std::unordered_map<uint64_t, uint8_t> edges;
+    struct Edge
+    {
+        int64_t x;
+        int64_t y;
+        int direction;
+    };
+    std::vector<Edge> edge_list;
+    auto addEdges = [&](uint64_t mask, int64_t word, int64_t x_offset, int64_t y, int direction)
+    {
+        while (mask)
+        {
+            const int bit = __builtin_ctzll(mask);
+            mask &= mask - 1;
+            const int64_t x = (min_word + word) * 64 + bit + x_offset;
+            edges[vertexKey(x, y)] |= 1 << direction;
+            edge_list.push_back(Edge{x, y, direction});
+        }
+    };
+    const std::vector<uint64_t> empty_row(word_count, 0);
+    for (int64_t y = min_row; y <= min_row + row_count; y++)
+    {
+        const uint64_t* here = y < min_row + row_count ? row(y) : empty_row.data();
+        const uint64_t* below = y > min_row ? row(y - 1) : empty_row.data();
+        for (int64_t word = 0; word < word_count; word++)
+        {
+            addEdges(here[word] & ~below[word], word, 0, y, 0); // the bottom of a pixel of this row
+            addEdges(below[word] & ~here[word], word, 1, y, 2); // the top of a pixel of the row below
+            const uint64_t left = (here[word] << 1) | (word > 0 ? here[word - 1] >> 63 : 0);
+            const uint64_t right = (here[word] >> 1) | (word + 1 < word_count ? here[word + 1] << 63 : 0);
+            addEdges(here[word] & ~left, word, 0, y + 1, 3);
+            addEdges(here[word] & ~right, word, 1, y, 1);
+        }
+    }
+
+    Polygons result;
+    std::vector<Point> half_pixel_points; // the middles of the pixel edges, in half pixels
+    for (const Edge& start : edge_list)
+    {
+        if (edges[vertexKey(start.x, start.y)] & (16 << start.direction))
+        {
+            continue;
+        }
+        half_pixel_points.clear();
+        int64_t x = start.x;
+        int64_t y = start.y;
+        int direction = start.direction;
+        while (true)
+        {
+            edges[vertexKey(x, y)] |= 16 << direction;
+            const Point middle(2 * x + direction_x[direction], 2 * y + direction_y[direction]);
+            while (half_pixel_points.size() >= 2 && isCollinear(half_pixel_points[half_pixel_points.size() - 2], half_pixel_points.back(), middle))
+            {
+                half_pixel_points.pop_back();
+            }
+            half_pixel_points.push_back(middle);
+            x += direction_x[direction];
+            y += direction_y[direction];
+            // at a corner where two set pixels touch diagonally, turn left to stay around the same pixel
+            const uint8_t next_edges = edges[vertexKey(x, y)];
+            int next_direction = direction;
+            for (int turn : { 1, 0, 3 })
+            {
+                if (next_edges & (1 << ((direction + turn) & 3)))
+                {
+                    next_direction = (direction + turn) & 3;
+                    break;
+                }
+            }
+            if (next_edges & (16 << next_direction))
+            {
+                break;
+            }
+            direction = next_direction;
+        }
+        size_t first = 0;
+        size_t end = half_pixel_points.size();
+        while (end - first >= 3 && isCollinear(half_pixel_points[end - 2], half_pixel_points[end - 1], half_pixel_points[first]))
+        {
+            end--;
+        }
+        while (end - first >= 3 && isCollinear(half_pixel_points[end - 1], half_pixel_points[first], half_pixel_points[first + 1]))
+        {
+            first++;
+        }
+        if (end - first < 3)
+        {
+            continue;
+        }
+        PolygonRef poly = result.newPoly();
+        poly.reserve(end - first);
+        for (size_t point_idx = first; point_idx < end; point_idx++)
+        {
+            poly.add(Point(half_pixel_points[point_idx].X * resolution / 2, half_pixel_points[point_idx].Y * resolution / 2));
+        }
+    }
+    return result;
+}
+
+void Bitmap::unionWith(const Bitmap& other)
+{
+    if (other.empty())
+    {
+        return;
+    }
+    if (empty())
+    {
+        *this = other;
+        return;
+    }
+    const int64_t new_min_row = std::min(min_row, other.min_row);
+    const int64_t new_end_row = std::max(min_row + row_count, other.min_row + other.row_count);
+    const int64_t new_min_word = std::min(min_word, other.min_word);
+    const int64_t new_end_word = std::max(min_word + word_count, other.min_word + other.word_count);
+    if (new_min_row != min_row || new_end_row != min_row + row_count || new_min_word != min_word || new_end_word != min_word + word_count)
+    {
+        setBox(new_min_row, new_end_row - new_min_row, new_min_word, new_end_word - new_min_word);
+    }
+    for (int64_t y = other.min_row; y < other.min_row + other.row_count; y++)
+    {
+        uint64_t* here = row(y) + (other.min_word - min_word);
+        const uint64_t* there = other.row(y);
+        for (int64_t word = 0; word < other.word_count; word++)
+        {
+            here[word] |= there[word];
+        }
+    }
+}
+
+void Bitmap::differenceWith(const Bitmap& other)
+{
+    const int64_t first_row = std::max(min_row, other.min_row);
+    const int64_t end_row = std::min(min_row + row_count, other.min_row + other.row_count);
+    const int64_t first_word = std::max(min_word, other.min_word);
+    const int64_t end_word = std::min(min_word + word_count, other.min_word + other.word_count);
+    if (first_row >= end_row || first_word >= end_word)
+    {
+        return;
+    }
+    for (int64_t y = first_row; y < end_row; y++)
+    {
+        uint64_t* here = row(y) + (first_word - min_word);
+        const uint64_t* there = other.row(y) + (first_word - other.min_word);
+        for (int64_t word = 0; word < end_word - first_word; word++)
+        {
+            here[word] &= ~there[word];
+        }
+    }
+    trim();
+}
+
+void Bitmap::intersectWith(const Bitmap& other)
+{
+    const int64_t first_row = std::max(min_row, other.min_row);
+    const int64_t end_row = std::min(min_row + row_count, other.min_row + other.row_count);
+    const int64_t first_word = std::max(min_word, other.min_word);
+    const int64_t end_word = std::min(min_word + word_count, other.min_word + other.word_count);
+    if (first_row >= end_row || first_word >= end_word)
+    {
+        *this = Bitmap(resolution);
+        return;
+    }
+    setBox(first_row, end_row - first_row, first_word, end_word - first_word);
+    for (int64_t y = first_row; y < end_row; y++)
+    {
+        uint64_t* here = row(y);
+        const uint64_t* there = other.row(y) + (first_word - other.min_word);
+        for (int64_t word = 0; word < word_count; word++)
+        {
+            here[word] &= there[word];
+        }
+    }
+    trim();
+}
+
+Bitmap Bitmap::offset(coord_t distance) const
+{
+    const int64_t radius = std::llround(static_cast<double>(std::abs(distance)) / resolution);
+    if (radius == 0 || empty())
+    {
+        return *this;
+    }
+    return distance > 0 ? dilate(radius) : erode(radius);
+}
+
+void Bitmap::setBox(int64_t new_min_row, int64_t new_row_count, int64_t new_min_word, int64_t new_word_count)
+{
+    std::vector<uint64_t> new_words(new_row_count * new_word_count, 0);
+    const int64_t first_row = std::max(min_row, new_min_row);
+    const int64_t end_row = std::min(min_row + row_count, new_min_row + new_row_count);
+    const int64_t first_word = std::max(min_word, new_min_word);
+    const int64_t end_word = std::min(min_word + word_count, new_min_word + new_word_count);
+    for (int64_t y = first_row; y < end_row; y++)
+    {
+        for (int64_t word = first_word; word < end_word; word++)
+        {
+            new_words[(y - new_min_row) * new_word_count + word - new_min_word] = words[(y - min_row) * word_count + word - min_word];
+        }
+    }
+    words = std::move(new_words);
+    min_row = new_min_row;
+    row_count = new_row_count;
+    min_word = new_min_word;
+    word_count = new_word_count;
+}
+
+void Bitmap::trim()
+{
+    int64_t first_row = min_row + row_count;
+    int64_t end_row = min_row;
+    int64_t first_word = min_word + word_count;
+    int64_t end_word = min_word;
+    for (int64_t y = min_row; y < min_row + row_count; y++)
+    {
+        const uint64_t* here = row(y);
+        for (int64_t word = 0; word < word_count; word++)
+        {
+            if (here[word])
+            {
+                first_row = std::min(first_row, y);
+                end_row = y + 1;
+                first_word = std::min(first_word, min_word + word);
+                end_word = std::max(end_word, min_word + word + 1);
+            }
+        }
+    }
+    if (first_row >= end_row)
+    {
+        *this = Bitmap(resolution);
+    }
+    else if (first_row != min_row || end_row != min_row + row_count || first_word != min_word || end_word != min_word + word_count)
+    {
+        setBox(first_row, end_row - first_row, first_word, end_word - first_word);
+    }
+}
+
+Bitmap Bitmap::dilate(int64_t radius) const
+{
+    // the union of the rows within the radius, each dilated horizontally by the half width of the disk at its distance
+    const int64_t margin_words = (radius + 63) / 64;
+    Bitmap spread = *this;
+    spread.setBox(min_row, row_count, min_word - margin_words, word_count + 2 * margin_words);
+    Bitmap result(resolution);
+    result.setBox(min_row - radius, row_count + 2 * radius, spread.min_word, spread.word_count);
+    int64_t spread_radius = 0;
+    for (int64_t dy = radius; dy >= 0; dy--)
+    {
+        growRows(spread.words, spread.word_count, spread_radius, diskHalfWidth(radius, dy), false);
+        // the rows of both bitmaps have the same words, so all rows are combined in a single loop
+        const uint64_t* source = spread.words.data();
+        uint64_t* above = result.row(min_row + dy);
+        uint64_t* below = result.row(min_row - dy);
+        for (size_t word = 0; word < spread.words.size(); word++)
+        {
+            above[word] |= source[word];
+            below[word] |= source[word];
+        }
+    }
+    result.trim();
+    return result;
+}
+
+Bitmap Bitmap::erode(int64_t radius) const
+{
+    // the intersection of the rows within the radius, each eroded horizontally by the half width of the disk at its distance
+    Bitmap shrunk = *this;
+    Bitmap result = *this;
+    int64_t shrunk_radius = 0;
+    for (int64_t dy = radius; dy >= 0; dy--)
+    {
+        growRows(shrunk.words, shrunk.word_count, shrunk_radius, diskHalfWidth(radius, dy), true);
+        if (2 * dy >= row_count)
+        { // every row has a row outside the box within the radius, and those are unset
+            return Bitmap(resolution);
+        }
+        // the rows of both bitmaps have the same words, so all rows with both rows at this distance inside the box are combined in a single loop
+        std::memset(result.words.data(), 0, dy * word_count * sizeof(uint64_t));
+        std::memset(result.row(min_row + row_count - dy), 0, dy * word_count * sizeof(uint64_t));
+        uint64_t* target = result.row(min_row + dy);
+        const uint64_t* above = shrunk.row(min_row + 2 * dy);
+        const uint64_t* below = shrunk.words.data();
+        const size_t combined_word_count = (row_count - 2 * dy) * word_count;
+        for (size_t word = 0; word < combined_word_count; word++)
+        {
+            target[word] &= above[word] & below[word];
+        }
+    }
+    result.trim();
+    return result;
+}
+
+}//namespace cura
@@ -0,0 +1,112 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef UTILS_BITMAP_H
+#define UTILS_BITMAP_H
+
+#include <cstdint>
+#include <vector>
+
+#include "intpoint.h"
+#include "polygon.h"
+
+namespace cura
+{
+
+/*!
+ * Areas as the pixels of a grid with square pixels of a fixed size, for operations which don't need the precision of polygons.
+ *
+ * Pixel (x, y) covers [x * resolution, (x + 1) * resolution) in both directions, and is set when its center lies inside the area.
+ * All bitmaps of the same resolution share that grid, so booleans between them are bitwise operations on whole words of 64 pixels.
+ * Only the rows and words of the bounding box of the set pixels are stored.
+ *
+ * The outlines of a bitmap run through the middle of the pixel edges between set and unset pixels,
+ * so areas which are rasterized and converted back to polygons deviate at most half a pixel diagonal from the original.
+ */
+class Bitmap
+{
+public:
+    /*!
+     * An empty bitmap.
+     */
+    Bitmap(coord_t resolution);
+
+    /*!
+     * Set the pixels of which the center lies inside \p polygons, by the nonzero rule.
+     */
+    static Bitmap rasterize(const Polygons& polygons, coord_t resolution);
+
+    /*!
+     * The outlines of the set pixels, as polygons running through the middle of the pixel edges,
+     * oriented like the results of clipper: outlines counterclockwise and holes clockwise.
+     *
+     * Pixels which only touch diagonally are separate polygons.
+     */
+    Polygons toPolygons() const;
+
+    bool empty() const
+    {
+        return words.empty();
+    }
+
+    /*!
+     * Set all pixels set in \p other as well.
+     */
+    void unionWith(const Bitmap& other);
+
+    /*!
+     * Unset all pixels set in \p other.
+     */
+    void differenceWith(const Bitmap& other);
+
+    /*!
+     * Unset all pixels not set in \p other.
+     */
+    void intersectWith(const Bitmap& other);
+
+    /*!
+     * Dilate the pixels by a disk of the radius \p distance for a positive distance, or erode them for a negative one.
+     *
+     * The distance is rounded to whole pixels.
+     */
+    Bitmap offset(coord_t distance) const;
+
+private:
+    coord_t resolution; //!< The size of a pixel
+    int64_t min_row; //!< The first stored row
+    int64_t row_count; //!< The number of stored rows
+    int64_t min_word; //!< The first stored word of each row, where word w holds the pixels [64 * w, 64 * w + 64)
+    int64_t word_count; //!< The number of stored words of each row
+    std::vector<uint64_t> words; //!< The stored words, row by row
+
+    uint64_t* row(int64_t y)
+    {
+        return &words[(y - min_row) * word_count];
+    }
+
+    const uint64_t* row(int64_t y) const
+    {
+        return &words[(y - min_row) * word_count];
+    }
+
+    /*!
+     * Store the given box of rows and words, keeping the pixels inside both the old and the new box.
+     */
+    void setBox(int64_t new_min_row, int64_t new_row_count, int64_t new_min_word, int64_t new_word_count);
+
+    /*!
+     * Shrink the box to the rows and words with set pixels.
+     */
+    void trim();
+
+    /*!
+     * Dilate the pixels by a disk of \p radius pixels.
+     */
+    Bitmap dilate(int64_t radius) const;
+
+    /*!
+     * Erode the pixels by a disk of \p radius pixels.
+     */
+    Bitmap erode(int64_t radius) const;
+};
+
+}//namespace cura
+#endif//UTILS_BITMAP_H
@@ -0,0 +1,68 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef UTILS_COUNTER_RANDOM_H
+#define UTILS_COUNTER_RANDOM_H
+
+#include <initializer_list>
+#include <stdint.h>
+
+namespace cura
+{
+
+/*!
+ * A stream of pseudo random numbers, of which the n-th number is a hash of the key of the stream and n.
+ *
+ * Unlike rand() there's no global state: a stream only depends on its key.
+ * Streams with different keys can therefore be used by different threads at once,
+ * and the numbers drawn don't depend on the order in which the streams are used.
+ */
+class CounterRandom
+{
+public:
+    /*!
+     * \param key What identifies the stream, e.g. the indices of the mesh, layer and polygon for which the numbers are drawn
+     */
+    CounterRandom(std::initializer_list<uint64_t> key)
+    : key(0)
+    , counter(0)
+    {
+        for (uint64_t key_part : key)
+        {
+            this->key = mix(this->key ^ key_part);
+        }
+    }
+
+    /*!
+     * Get the next number of the stream.
+     */
+    uint64_t next()
+    {
+        return mix(key + (++counter) * golden_gamma);
+    }
+
+    /*!
+     * Get the next number of the stream, in the range [0, \p n) for a positive \p n.
+     */
+    int64_t next(int64_t n)
+    {
+        return static_cast<int64_t>(next() % static_cast<uint64_t>(n));
+    }
+
+private:
+    static constexpr uint64_t golden_gamma = 0x9e3779b97f4a7c15ull; //!< The odd increment of SplitMix64
+
+    uint64_t key; //!< The hash of the key of the stream
+    uint64_t counter; //!< The number of numbers drawn so far
+
+    /*!
+     * The finalizer of SplitMix64, which maps consecutive inputs to well distributed outputs.
+     */
+    static uint64_t mix(uint64_t x)
+    {
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+};
+
+}//namespace cura
+#endif//UTILS_COUNTER_RANDOM_H
@@ -0,0 +1,268 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "LayerArena.h"
+
+#include <cstdlib> // malloc, free
+#include <new>
+#ifdef LAYER_ARENA
+#include <atomic>
+#endif
+
+namespace cura
+{
+
+#ifdef LAYER_ARENA
+
+namespace
+{
+
+constexpr std::size_t alignment = 16; // the alignment malloc provides, which operator new has to provide as well
+constexpr std::size_t header_size = alignment; // each allocation is preceded by a pointer to its chunk, or nullptr for memory from malloc
+constexpr std::size_t chunk_size = 1 << 20;
+constexpr std::size_t max_arena_allocation_size = chunk_size / 4; // larger allocations are rare, and would leave much of a chunk unused
+
+thread_local LayerArena* current_arena = nullptr;
+thread_local unsigned int temporaries_depth = 0; // the number of LayerArena::Temporaries scopes of this thread
+thread_local unsigned int suspended_depth = 0; // the number of times allocating from the arena is suspended
+
+std::size_t roundUp(std::size_t size)
+{
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+}//namespace
+
+struct LayerArena::Chunk
+{
+    std::atomic<std::size_t> reference_count; //!< The number of live allocations in this chunk, plus one while memory is allocated from it
+    std::size_t used_size; //!< The number of bytes from the start of the chunk which are in use
+};
+
+LayerArena::Temporaries::Temporaries()
+: uses_arena(current_arena != nullptr)
+{
+    temporaries_depth++;
+}
+
+LayerArena::Temporaries::~Temporaries()
+{
+    temporaries_depth--;
+    if (temporaries_depth == 0 && current_arena && current_arena->current_chunk)
+    {
+        Chunk* chunk = current_arena->current_chunk;
+        if (chunk->reference_count.load(std::memory_order_acquire) == 1)
+        { // only the reference of the arena itself is left
+            chunk->used_size = roundUp(sizeof(Chunk));
+        }
+    }
+}
+
+void LayerArena::Temporaries::suspend()
+{
+    suspended_depth++;
+}
+
+void LayerArena::Temporaries::resume()
+{
+    suspended_depth--;
+}
+
+LayerArena::LayerArena()
+: current_chunk(nullptr)
+, enclosing_arena(current_arena)
+{
+    current_arena = this;
+}
+
+LayerArena::~LayerArena()
+{
+    if (current_chunk)
+    {
+        retire(current_chunk);
+    }
+    current_arena = enclosing_arena;
+}
+
+bool LayerArena::isSupported()
+{
+    return true;
+}
+
+void* LayerArena::allocate(std::size_t size)
+{
+    LayerArena* arena = current_arena;
+    if (arena == nullptr || temporaries_depth == 0 || suspended_depth > 0 || size > max_arena_allocation_size)
+    {
+        char* block = static_cast<char*>(std::malloc(header_size + size));
+        if (block == nullptr)
+        {
+            return nullptr;
+        }
+        *reinterpret_cast<Chunk**>(block) = nullptr;
+        return block + header_size;
+    }
+    const std::size_t block_size = header_size + roundUp(size);
+    Chunk* chunk = arena->current_chunk;
+    if (chunk == nullptr || chunk->used_size + block_size > chunk_size)
+    {
+        void* memory = std::malloc(chunk_size);
+        if (memory == nullptr)
+        {
+            return nullptr;
+        }
+        Chunk* new_chunk = new (memory) Chunk;
+        new_chunk->reference_count.store(1, std::memory_order_relaxed);
+        new_chunk->used_size = roundUp(sizeof(Chunk));
+        if (chunk)
+        {
+            retire(chunk);
+        }
+        arena->current_chunk = chunk = new_chunk;
+    }
+    char* block = reinterpret_cast<char*>(chunk) + chunk->used_size;
+    chunk->used_size += block_size;
+    chunk->reference_count.fetch_add(1, std::memory_order_relaxed);
+    *reinterpret_cast<Chunk**>(block) = chunk;
+    return block + header_size;
+}
+
+void LayerArena::deallocate(void* memory)
+{
+    if (memory == nullptr)
+    {
+        return;
+    }
+    char* block = static_cast<char*>(memory) - header_size;
+    Chunk* chunk = *reinterpret_cast<Chunk**>(block);
+    if (chunk == nullptr)
+    {
+        std::free(block);
+    }
+    else
+    {
+        retire(chunk);
+    }
+}
+
+void LayerArena::retire(Chunk* chunk)
+{
+    if (chunk->reference_count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        chunk->~Chunk();
+        std::free(chunk);
+    }
+}
+
+#else // LAYER_ARENA
+
+struct LayerArena::Chunk
+{
+};
+
+LayerArena::Temporaries::Temporaries()
+: uses_arena(false)
+{
+}
+
+LayerArena::Temporaries::~Temporaries()
+{
+}
+
+void LayerArena::Temporaries::suspend()
+{
+}
+
+void LayerArena::Temporaries::resume()
+{
+}
+
+LayerArena::LayerArena()
+: current_chunk(nullptr)
+, enclosing_arena(nullptr)
+{
+}
+
+LayerArena::~LayerArena()
+{
+}
+
+bool LayerArena::isSupported()
+{
+    return false;
+}
+
+void* LayerArena::allocate(std::size_t size)
+{
+    return std::malloc(size);
+}
+
+void LayerArena::deallocate(void* memory)
+{
+    std::free(memory);
+}
+
+void LayerArena::retire(Chunk*)
+{
+}
+
+#endif // LAYER_ARENA
+
+}//namespace cura
+
+#ifdef LAYER_ARENA
+
+void* operator new(std::size_t size)
+{
+    void* memory = cura::LayerArena::allocate(size);
+    if (memory == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return cura::LayerArena::allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return cura::LayerArena::allocate(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+    cura::LayerArena::deallocate(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+    cura::LayerArena::deallocate(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept
+{
+    cura::LayerArena::deallocate(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept
+{
+    cura::LayerArena::deallocate(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+    cura::LayerArena::deallocate(memory);
+}
+
+void operator delete[](void* memory, std::size_t) noexcept
+{
+    cura::LayerArena::deallocate(memory);
+}
+
+#endif // LAYER_ARENA
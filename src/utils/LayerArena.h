@@ -0,0 +1,110 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef UTILS_LAYER_ARENA_H
+#define UTILS_LAYER_ARENA_H
+
+#include <cstddef> // size_t
+
+#include "NoCopy.h"
+
+namespace cura
+{
+
+/*!
+ * Scoped handle which gives the thread which creates it a monotonic arena for the temporaries of processing a single layer.
+ *
+ * Only the memory allocated within a LayerArena::Temporaries scope comes from the arena, by bumping a pointer in the current chunk.
+ * The operations on Polygons open such a scope around the work of Clipper, which allocates the edges and output points of each operation one by one,
+ * and copy their results out of the arena, so nothing allocated in the arena outlives the operation.
+ * When nothing in the current chunk is live anymore at the end of a scope the chunk is reused from its start,
+ * and when the handle is destroyed the chunks are released.
+ *
+ * Memory from the arena which does outlive its scope stays valid and may be freed by any thread;
+ * it keeps its chunk alive until the last of it is freed.
+ *
+ * The arena replaces the global operator new and delete, so it's only compiled in when CuraEngine is built with ENABLE_LAYER_ARENA.
+ * Otherwise the handle does nothing.
+ */
+class LayerArena : NoCopy
+{
+public:
+    /*!
+     * Scope within which the memory allocated by the current thread comes from the arena of the thread, if it has one.
+     */
+    class Temporaries : NoCopy
+    {
+    public:
+        Temporaries();
+
+        /*!
+         * Reuse the current chunk of the arena if nothing in it is live anymore.
+         */
+        ~Temporaries();
+
+        /*!
+         * Move a temporary result out of the arena: copy it outside of the arena, or just swap it when the arena isn't used.
+         *
+         * \param temporary The result computed within this scope
+         * \param[out] result Where to store the result; what it held before is replaced, reusing its memory when the result is copied
+         */
+        template<typename T>
+        void keep(T& temporary, T& result)
+        {
+            if (!uses_arena)
+            {
+                result.swap(temporary);
+                return;
+            }
+            suspend();
+            result = temporary;
+            resume();
+        }
+
+    private:
+        bool uses_arena; //!< Whether the memory allocated within this scope comes from an arena
+
+        void suspend(); //!< Allocate the memory of this thread outside of the arena until LayerArena::Temporaries::resume is called
+        void resume(); //!< Allocate the memory of this thread from the arena again
+    };
+
+    LayerArena();
+
+    /*!
+     * Release the chunks without live allocations and continue with the arena of the enclosing handle, if any.
+     */
+    ~LayerArena();
+
+    /*!
+     * Whether this build of CuraEngine has the arena, i.e. whether LayerArena has any effect.
+     */
+    static bool isSupported();
+
+    /*!
+     * Allocate memory from the arena of the current thread when within a LayerArena::Temporaries scope, or with malloc otherwise.
+     *
+     * Used by the replaced operator new.
+     *
+     * \return The memory, or nullptr if it couldn't be allocated
+     */
+    static void* allocate(std::size_t size);
+
+    /*!
+     * Free memory allocated by LayerArena::allocate, from any thread.
+     *
+     * Used by the replaced operator delete.
+     */
+    static void deallocate(void* memory);
+
+private:
+    struct Chunk;
+
+    Chunk* current_chunk; //!< The chunk from which memory is allocated, or nullptr if none has been allocated yet
+    LayerArena* enclosing_arena; //!< The arena this thread used before this one was created, or nullptr
+
+    /*!
+     * Stop allocating from a chunk, and release it if nothing in it is live anymore.
+     */
+    static void retire(Chunk* chunk);
+};
+
+}//namespace cura
+#endif//UTILS_LAYER_ARENA_H
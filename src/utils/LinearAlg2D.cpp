@@ -2,12 +2,38 @@
 #include "linearAlg2D.h"
 
 #include <cmath> // atan2
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "intpoint.h" // dot
 
 namespace cura 
 {
 
+void LinearAlg2D::getSegmentLengthsMM(Point start, const Point* points, unsigned int point_count, double* lengths)
+{
+    Point prev = start;
+    unsigned int point_idx = 0;
+#ifdef __SSE2__
+    const __m128d microns_per_mm = _mm_set1_pd(1000.0);
+    for (; point_idx + 1 < point_count; point_idx += 2)
+    { // the same operations as INT2MM and vSizeMM, so that the lengths are exactly the same
+        const Point a = prev - points[point_idx];
+        const Point b = points[point_idx] - points[point_idx + 1];
+        const __m128d x = _mm_div_pd(_mm_set_pd(double(b.X), double(a.X)), microns_per_mm);
+        const __m128d y = _mm_div_pd(_mm_set_pd(double(b.Y), double(a.Y)), microns_per_mm);
+        _mm_storeu_pd(lengths + point_idx, _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(x, x), _mm_mul_pd(y, y))));
+        prev = points[point_idx + 1];
+    }
+#endif
+    for (; point_idx < point_count; point_idx++)
+    {
+        lengths[point_idx] = vSizeMM(prev - points[point_idx]);
+        prev = points[point_idx];
+    }
+}
+
 float LinearAlg2D::getAngleLeft(const Point& a, const Point& b, const Point& c)
 {
     Point ba = a - b;
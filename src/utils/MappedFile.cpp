@@ -0,0 +1,97 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "MappedFile.h"
+
+#include <algorithm> // min
+#include <stdio.h>
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HAVE_MMAP
+#endif
+
+namespace cura
+{
+
+MappedFile::MappedFile(const char* filename)
+: valid(false)
+, data(nullptr)
+, size(0)
+, mapped(false)
+{
+#ifdef HAVE_MMAP
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        return;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0)
+    {
+        void* mapping = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED)
+        {
+            madvise(mapping, file_stat.st_size, MADV_SEQUENTIAL);
+            data = static_cast<const char*>(mapping);
+            size = file_stat.st_size;
+            mapped = true;
+            valid = true;
+        }
+    }
+    close(fd);
+    if (valid)
+    {
+        return;
+    }
+#endif
+    // fall back to reading the whole file
+    FILE* f = fopen(filename, "rb");
+    if (f == nullptr)
+    {
+        return;
+    }
+    fseek(f, 0L, SEEK_END);
+    long file_size = ftell(f);
+    rewind(f);
+    if (file_size >= 0)
+    {
+        buffer.resize(file_size);
+        if (file_size == 0 || fread(buffer.data(), file_size, 1, f) == 1)
+        {
+            data = buffer.data();
+            size = file_size;
+            valid = true;
+        }
+    }
+    fclose(f);
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef HAVE_MMAP
+    if (mapped)
+    {
+        munmap(const_cast<char*>(data), size);
+    }
+#endif
+}
+
+void MappedFile::releasePages(size_t offset, size_t length) const
+{
+#ifdef HAVE_MMAP
+    if (!mapped || offset >= size)
+    {
+        return;
+    }
+    const size_t page_size = sysconf(_SC_PAGESIZE);
+    const size_t begin = (offset + page_size - 1) / page_size * page_size;
+    const size_t end = std::min(size, offset + length) / page_size * page_size;
+    if (begin < end)
+    {
+        madvise(const_cast<char*>(data) + begin, end - begin, MADV_DONTNEED);
+    }
+#endif
+}
+
+}//namespace cura
@@ -0,0 +1,75 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef UTILS_MAPPED_FILE_H
+#define UTILS_MAPPED_FILE_H
+
+#include <cstddef> // size_t
+#include <vector>
+
+#include "NoCopy.h"
+
+namespace cura
+{
+
+/*!
+ * Read-only view on the whole contents of a file.
+ *
+ * Where the platform supports it the file is memory-mapped, so that the contents are read directly from the page cache
+ * without copying them into a buffer first. Otherwise the whole file is read into memory.
+ */
+class MappedFile : NoCopy
+{
+public:
+    /*!
+     * Open and map the file.
+     *
+     * \param filename The file to open
+     */
+    MappedFile(const char* filename);
+
+    ~MappedFile();
+
+    /*!
+     * Whether the file could be opened and mapped.
+     */
+    bool isValid() const
+    {
+        return valid;
+    }
+
+    /*!
+     * The contents of the file. Only valid if \ref MappedFile::isValid.
+     */
+    const char* getData() const
+    {
+        return data;
+    }
+
+    /*!
+     * The size of the file in bytes.
+     */
+    size_t getSize() const
+    {
+        return size;
+    }
+
+    /*!
+     * Let the operating system drop the pages of a range of the file from memory, once that range won't be read for a while.
+     * 
+     * The range stays readable; its pages are read from the file again when it is.
+     * Only the pages which lie completely within the range are dropped, and nothing is dropped when the file isn't memory-mapped.
+     * 
+     * \param offset The start of the range, in bytes from the start of the file
+     * \param length The number of bytes of the range
+     */
+    void releasePages(size_t offset, size_t length) const;
+
+private:
+    bool valid; //!< Whether the file was opened successfully
+    const char* data; //!< The contents of the file
+    size_t size; //!< The number of bytes in the file
+    bool mapped; //!< Whether \ref MappedFile::data is a memory mapping, rather than pointing into \ref MappedFile::buffer
+    std::vector<char> buffer; //!< The contents of the file in case it couldn't be memory-mapped
+};
+
+}//namespace cura
+#endif//UTILS_MAPPED_FILE_H
@@ -0,0 +1,418 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "OutputBuffer.h"
+
+#include <algorithm> // max
+#include <cstring> // memcpy
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#define HAVE_WRITEV
+#endif
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "logoutput.h"
+
+namespace cura
+{
+
+FileOutputBuffer::FileOutputBuffer(size_t block_size)
+: block_size(std::max(block_size, size_t(1)))
+#ifdef HAVE_WRITEV
+, fd(-1)
+#else
+, file(nullptr)
+#endif
+{
+    setp(nullptr, nullptr);
+}
+
+FileOutputBuffer::~FileOutputBuffer()
+{
+    close();
+}
+
+bool FileOutputBuffer::open(const char* filename)
+{
+    close();
+    buffer.resize(block_size); // only allocated when it's used
+    setp(buffer.data(), buffer.data() + buffer.size());
+#ifdef HAVE_WRITEV
+    fd = ::open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    return fd >= 0;
+#else
+    file = fopen(filename, "wb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    setvbuf(file, nullptr, _IONBF, 0); // the blocks are buffered here already
+    return true;
+#endif
+}
+
+bool FileOutputBuffer::close()
+{
+    bool success = writeBuffer();
+#ifdef HAVE_WRITEV
+    if (fd < 0)
+    {
+        return true;
+    }
+    success = ::close(fd) == 0 && success;
+    fd = -1;
+#else
+    if (file == nullptr)
+    {
+        return true;
+    }
+    success = fclose(file) == 0 && success;
+    file = nullptr;
+#endif
+    return success;
+}
+
+bool FileOutputBuffer::writeBuffer(const char* data, size_t size)
+{
+    const size_t buffered_size = pptr() - pbase();
+    setp(buffer.data(), buffer.data() + buffer.size());
+#ifdef HAVE_WRITEV
+    if (fd < 0)
+    {
+        return false;
+    }
+    iovec parts[2];
+    parts[0].iov_base = buffer.data();
+    parts[0].iov_len = buffered_size;
+    parts[1].iov_base = const_cast<char*>(data);
+    parts[1].iov_len = size;
+    unsigned int part_idx = 0;
+    while (part_idx < 2)
+    {
+        if (parts[part_idx].iov_len == 0)
+        {
+            part_idx++;
+            continue;
+        }
+        ssize_t written = writev(fd, parts + part_idx, 2 - part_idx);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        for (; part_idx < 2 && size_t(written) >= parts[part_idx].iov_len; part_idx++)
+        { // skip the parts which are completely written
+            written -= parts[part_idx].iov_len;
+            parts[part_idx].iov_len = 0;
+        }
+        if (part_idx < 2)
+        {
+            parts[part_idx].iov_base = static_cast<char*>(parts[part_idx].iov_base) + written;
+            parts[part_idx].iov_len -= written;
+        }
+    }
+    return true;
+#else
+    if (file == nullptr)
+    {
+        return false;
+    }
+    return fwrite(buffer.data(), 1, buffered_size, file) == buffered_size
+        && (size == 0 || fwrite(data, 1, size, file) == size);
+#endif
+}
+
+FileOutputBuffer::int_type FileOutputBuffer::overflow(int_type c)
+{
+    if (!writeBuffer())
+    {
+        return traits_type::eof();
+    }
+    if (!traits_type::eq_int_type(c, traits_type::eof()))
+    {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+std::streamsize FileOutputBuffer::xsputn(const char* characters, std::streamsize size)
+{
+    if (size <= epptr() - pptr())
+    {
+        std::memcpy(pptr(), characters, size);
+        pbump(size);
+        return size;
+    }
+    // write the buffer and the characters in one go, instead of copying them into the buffer first
+    return writeBuffer(characters, size) ? size : 0;
+}
+
+int FileOutputBuffer::sync()
+{
+    return writeBuffer() ? 0 : -1;
+}
+
+constexpr int GzipOutputBuffer::default_window_bits;
+constexpr int GzipOutputBuffer::low_memory_window_bits;
+
+GzipOutputBuffer::GzipOutputBuffer(size_t block_size)
+: block_size(std::max(block_size, size_t(1)))
+, window_bits(default_window_bits)
+, is_open(false)
+, closing(false)
+, failed(false)
+{
+    setp(nullptr, nullptr);
+}
+
+GzipOutputBuffer::~GzipOutputBuffer()
+{
+    close();
+}
+
+bool GzipOutputBuffer::isSupported()
+{
+#ifdef HAVE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+}
+
+void GzipOutputBuffer::setWindowBits(int window_bits)
+{
+    this->window_bits = std::max(low_memory_window_bits, std::min(default_window_bits, window_bits));
+}
+
+bool GzipOutputBuffer::open(const char* filename)
+{
+    close();
+    if (!isSupported())
+    {
+        logError("This build of CuraEngine can't write gzip compressed files.\n");
+        return false;
+    }
+    if (!file.open(filename))
+    {
+        return false;
+    }
+    block.resize(block_size);
+    setp(block.data(), block.data() + block.size());
+    is_open = true;
+    closing = false;
+    failed = false;
+    return true;
+}
+
+bool GzipOutputBuffer::close()
+{
+    if (!is_open)
+    {
+        return true;
+    }
+    handOff();
+    if (!compressor.joinable())
+    { // nothing was written, but the file still needs a gzip header and trailer
+        compressor = std::thread(&GzipOutputBuffer::compress, this);
+    }
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        closing = true;
+    }
+    queue_changed.notify_all();
+    compressor.join();
+    setp(nullptr, nullptr);
+    is_open = false;
+    return file.close() && !failed;
+}
+
+bool GzipOutputBuffer::handOff()
+{
+    const size_t used_size = pptr() - pbase();
+    if (used_size > 0 && !compressor.joinable())
+    { // started only now, so that the window size can still be changed after opening the file
+        compressor = std::thread(&GzipOutputBuffer::compress, this);
+    }
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    if (used_size > 0)
+    {
+        queue_changed.wait(lock, [this]() { return queue.size() < max_queued_blocks; });
+        block.resize(used_size);
+        queue.push_back(std::move(block));
+        if (spare_blocks.empty())
+        {
+            block = std::vector<char>();
+        }
+        else
+        {
+            block = std::move(spare_blocks.back());
+            spare_blocks.pop_back();
+        }
+        block.resize(block_size);
+        setp(block.data(), block.data() + block.size());
+        queue_changed.notify_all();
+    }
+    return !failed;
+}
+
+GzipOutputBuffer::int_type GzipOutputBuffer::overflow(int_type c)
+{
+    if (!handOff() || pptr() == epptr())
+    {
+        return traits_type::eof();
+    }
+    if (!traits_type::eq_int_type(c, traits_type::eof()))
+    {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+std::streamsize GzipOutputBuffer::xsputn(const char* characters, std::streamsize size)
+{
+    std::streamsize written_size = 0;
+    while (written_size < size)
+    {
+        if (pptr() == epptr() && (!handOff() || pptr() == epptr()))
+        {
+            break;
+        }
+        const std::streamsize part_size = std::min(size - written_size, std::streamsize(epptr() - pptr()));
+        std::memcpy(pptr(), characters + written_size, part_size);
+        pbump(part_size);
+        written_size += part_size;
+    }
+    return written_size;
+}
+
+int GzipOutputBuffer::sync()
+{
+    return handOff() ? 0 : -1; // the compressed data is only completed when closing, because flushing the compressor worsens the compression
+}
+
+void GzipOutputBuffer::compress()
+{
+#ifdef HAVE_ZLIB
+    z_stream stream;
+    stream.zalloc = Z_NULL;
+    stream.zfree = Z_NULL;
+    stream.opaque = Z_NULL;
+    const int gzip_wrapper = 16; // added to the window bits to write a gzip header and trailer instead of a zlib wrapper
+    const int memory_level = (window_bits < default_window_bits) ? 1 : 8; // a small window is meant for low memory, so the compressor state is kept small as well
+    const bool initialized = deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, window_bits + gzip_wrapper, memory_level, Z_DEFAULT_STRATEGY) == Z_OK;
+    bool success = initialized;
+    std::vector<char> output(1 << 16);
+    auto deflateInto = [&stream, &output, this](int flush)
+    {
+        int result;
+        do
+        {
+            stream.next_out = reinterpret_cast<Bytef*>(output.data());
+            stream.avail_out = output.size();
+            result = deflate(&stream, flush);
+            if (result == Z_STREAM_ERROR)
+            {
+                return false;
+            }
+            const std::streamsize compressed_size = output.size() - stream.avail_out;
+            if (file.sputn(output.data(), compressed_size) != compressed_size)
+            {
+                return false;
+            }
+        } while (stream.avail_out == 0 || (flush == Z_FINISH && result != Z_STREAM_END));
+        return true;
+    };
+
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    while (true)
+    {
+        queue_changed.wait(lock, [this]() { return !queue.empty() || closing; });
+        if (queue.empty())
+        {
+            break;
+        }
+        std::vector<char> input = std::move(queue.front());
+        queue.pop_front();
+        queue_changed.notify_all();
+        lock.unlock();
+        if (success)
+        {
+            stream.next_in = reinterpret_cast<Bytef*>(input.data());
+            stream.avail_in = input.size();
+            success = deflateInto(Z_NO_FLUSH);
+        }
+        lock.lock();
+        spare_blocks.push_back(std::move(input));
+        failed = !success;
+    }
+    lock.unlock();
+    if (success)
+    {
+        success = deflateInto(Z_FINISH);
+    }
+    if (initialized)
+    {
+        deflateEnd(&stream);
+    }
+    lock.lock();
+    failed = !success;
+#endif // HAVE_ZLIB
+}
+
+StringOutputBuffer::StringOutputBuffer(size_t initial_size)
+: initial_size(initial_size)
+{
+    data.resize(initial_size);
+    setp(&data[0], &data[0] + data.size());
+}
+
+void StringOutputBuffer::take(std::string& target)
+{
+    data.resize(pptr() - pbase());
+    target.swap(data);
+    data.clear(); // reuses the memory of the previous contents of target, if it had any
+    data.resize(initial_size);
+    setp(&data[0], &data[0] + data.size());
+}
+
+void StringOutputBuffer::reserve(size_t extra_size)
+{
+    if (size_t(epptr() - pptr()) >= extra_size)
+    {
+        return;
+    }
+    const size_t used_size = pptr() - pbase();
+    data.resize(std::max(data.size() * 2, used_size + extra_size));
+    setp(&data[0], &data[0] + data.size());
+    pbump(used_size);
+}
+
+StringOutputBuffer::int_type StringOutputBuffer::overflow(int_type c)
+{
+    if (traits_type::eq_int_type(c, traits_type::eof()))
+    {
+        return traits_type::not_eof(c);
+    }
+    reserve(1);
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+    return c;
+}
+
+std::streamsize StringOutputBuffer::xsputn(const char* characters, std::streamsize size)
+{
+    reserve(size);
+    std::memcpy(pptr(), characters, size);
+    pbump(size);
+    return size;
+}
+
+}//namespace cura
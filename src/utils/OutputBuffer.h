@@ -0,0 +1,206 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef UTILS_OUTPUT_BUFFER_H
+#define UTILS_OUTPUT_BUFFER_H
+
+#include <condition_variable>
+#include <cstddef> // size_t
+#include <cstdio> // FILE
+#include <deque>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "NoCopy.h"
+
+namespace cura
+{
+
+/*!
+ * Stream buffer which writes to a file in large blocks.
+ *
+ * Where the platform supports it the blocks are written with direct system calls on the file descriptor,
+ * and data which doesn't fit in the buffer is written together with the buffered data in a single writev call,
+ * without copying it into the buffer first. Otherwise the blocks are written with unbuffered stdio.
+ *
+ * Use it through an std::ostream constructed with a pointer to this buffer.
+ */
+class FileOutputBuffer : public std::streambuf, NoCopy
+{
+public:
+    /*!
+     * \param block_size The size of the buffer, which is allocated once when a file is opened
+     */
+    FileOutputBuffer(size_t block_size = 1 << 20);
+
+    /*!
+     * Write the remaining data and close the file.
+     */
+    ~FileOutputBuffer();
+
+    /*!
+     * Create or truncate a file to write to. A file which was open before is closed first.
+     *
+     * \param filename The file to write to
+     * \return Whether the file could be opened
+     */
+    bool open(const char* filename);
+
+    /*!
+     * Write the remaining data and close the file.
+     *
+     * \return Whether all data could be written
+     */
+    bool close();
+
+protected:
+    int_type overflow(int_type c) override;
+    std::streamsize xsputn(const char* characters, std::streamsize size) override;
+    int sync() override;
+
+private:
+    size_t block_size; //!< The size of FileOutputBuffer::buffer
+    std::vector<char> buffer; //!< The put area of the stream buffer
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+    int fd; //!< The file descriptor, or -1 if no file is open
+#else
+    FILE* file; //!< The file, or nullptr if no file is open
+#endif
+
+    /*!
+     * Write the buffered data followed by \p size bytes of \p data to the file and empty the buffer.
+     *
+     * \return Whether everything could be written
+     */
+    bool writeBuffer(const char* data = nullptr, size_t size = 0);
+};
+
+/*!
+ * Stream buffer which writes a gzip compressed file.
+ *
+ * The data is collected in blocks, which are compressed and written to the file on a separate thread,
+ * so that compressing doesn't slow down the thread producing the data.
+ *
+ * The window size of the compression can be reduced, so that printer firmware with little memory can decompress the file while reading it;
+ * the decompressor only needs a buffer of the size of the window.
+ */
+class GzipOutputBuffer : public std::streambuf, NoCopy
+{
+public:
+    static constexpr int default_window_bits = 15; //!< The largest window zlib supports: 32 KiB
+    static constexpr int low_memory_window_bits = 9; //!< The smallest window zlib supports for gzip files: 512 bytes
+
+    /*!
+     * \param block_size The size of the blocks handed to the compressing thread
+     */
+    GzipOutputBuffer(size_t block_size = 1 << 20);
+
+    /*!
+     * Compress the remaining data and close the file.
+     */
+    ~GzipOutputBuffer();
+
+    /*!
+     * Whether gzip compression is available in this build.
+     */
+    static bool isSupported();
+
+    /*!
+     * Set the size of the compression window.
+     *
+     * Has to be called before any data is written to the file.
+     *
+     * \param window_bits The base two logarithm of the window size, from GzipOutputBuffer::low_memory_window_bits to GzipOutputBuffer::default_window_bits
+     */
+    void setWindowBits(int window_bits);
+
+    /*!
+     * Create or truncate a file to write to. A file which was open before is closed first.
+     *
+     * The compressing thread is started when the first block is handed over to it.
+     *
+     * \param filename The file to write to
+     * \return Whether the file could be opened
+     */
+    bool open(const char* filename);
+
+    /*!
+     * Compress the remaining data, close the file and stop the compressing thread.
+     *
+     * \return Whether all data could be compressed and written
+     */
+    bool close();
+
+protected:
+    int_type overflow(int_type c) override;
+    std::streamsize xsputn(const char* characters, std::streamsize size) override;
+    int sync() override;
+
+private:
+    static constexpr unsigned int max_queued_blocks = 4; //!< The maximum number of blocks waiting to be compressed, so that the producer can't run far ahead
+
+    size_t block_size; //!< The size of GzipOutputBuffer::block
+    int window_bits; //!< The base two logarithm of the window size
+    FileOutputBuffer file; //!< The compressed file, only written by the compressing thread while it runs
+    std::vector<char> block; //!< The put area of the stream buffer
+    bool is_open; //!< Whether a file is open
+
+    std::thread compressor; //!< The thread compressing the queued blocks
+    std::mutex queue_mutex; //!< Guards the queue, the spare blocks, GzipOutputBuffer::closing and GzipOutputBuffer::failed
+    std::condition_variable queue_changed; //!< Notified when a block is added to or removed from the queue, or when closing
+    std::deque<std::vector<char>> queue; //!< The full blocks waiting to be compressed
+    std::vector<std::vector<char>> spare_blocks; //!< Compressed blocks, kept to reuse their memory
+    bool closing; //!< Whether no more blocks will be added to the queue
+    bool failed; //!< Whether compressing or writing has failed
+
+    /*!
+     * Hand the data in the put area over to the compressing thread and start a new block.
+     *
+     * \return Whether nothing has failed so far
+     */
+    bool handOff();
+
+    /*!
+     * The main loop of the compressing thread: compress the queued blocks until the buffer is closed.
+     */
+    void compress();
+};
+
+/*!
+ * Stream buffer which collects its data directly in a string, so that the string can be handed off without copying it.
+ *
+ * This is used for the gcode sent to the front-end: each layer of gcode is swapped into the message which is sent,
+ * instead of being copied out of an std::ostringstream.
+ */
+class StringOutputBuffer : public std::streambuf, NoCopy
+{
+public:
+    /*!
+     * \param initial_size The number of characters for which memory is reserved whenever a new string is started
+     */
+    StringOutputBuffer(size_t initial_size = 1 << 16);
+
+    /*!
+     * Move the collected data into a string and start collecting in an empty string.
+     *
+     * \param[out] target The string which receives the data. Its previous contents are discarded.
+     */
+    void take(std::string& target);
+
+protected:
+    int_type overflow(int_type c) override;
+    std::streamsize xsputn(const char* characters, std::streamsize size) override;
+
+private:
+    size_t initial_size; //!< The number of characters allocated at the start of each new string
+    std::string data; //!< The collected data, followed by the unused part of the put area
+
+    /*!
+     * Make sure at least \p extra_size more characters fit in the put area.
+     */
+    void reserve(size_t extra_size);
+};
+
+}//namespace cura
+#endif//UTILS_OUTPUT_BUFFER_H
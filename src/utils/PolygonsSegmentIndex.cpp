@@ -0,0 +1,79 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "PolygonsSegmentIndex.h"
+
+#include "linearAlg2D.h" // pointLiesOnTheRightOfLine
+
+namespace cura
+{
+
+constexpr unsigned int PolygonsSegmentIndex::segments_per_chunk;
+
+PolygonsSegmentIndex::PolygonsSegmentIndex(const Polygons& polygons)
+{
+    polygon_boxes.resize(polygons.size());
+    polygon_segment_counts.resize(polygons.size());
+    polygon_first_chunk_idx.resize(polygons.size());
+    polygon_first_group_idx.resize(polygons.size());
+    for (unsigned int poly_idx = 0; poly_idx < polygons.size(); poly_idx++)
+    {
+        const PolygonRef poly = polygons[poly_idx];
+        polygon_segment_counts[poly_idx] = poly.size();
+        polygon_first_chunk_idx[poly_idx] = chunk_boxes.size();
+        polygon_first_group_idx[poly_idx] = group_boxes.size();
+        if (poly.size() == 0)
+        {
+            continue;
+        }
+        for (unsigned int point_idx = 0; point_idx < poly.size(); point_idx++)
+        {
+            if (point_idx % segments_per_chunk == 0)
+            {
+                if (point_idx % (segments_per_chunk * segments_per_chunk) == 0)
+                {
+                    group_boxes.emplace_back();
+                }
+                chunk_boxes.emplace_back();
+                chunk_boxes.back().include(poly[(point_idx == 0) ? poly.size() - 1 : point_idx - 1]); // the start of the segment
+            }
+            chunk_boxes.back().include(poly[point_idx]);
+            group_boxes.back().include(chunk_boxes.back().min);
+            group_boxes.back().include(chunk_boxes.back().max);
+        }
+        for (unsigned int group_idx = polygon_first_group_idx[poly_idx]; group_idx < group_boxes.size(); group_idx++)
+        {
+            polygon_boxes[poly_idx].include(group_boxes[group_idx].min);
+            polygon_boxes[poly_idx].include(group_boxes[group_idx].max);
+        }
+    }
+    polygon_index.build(polygon_boxes);
+}
+
+bool PolygonsSegmentIndex::inside(const Polygons& polygons, Point p, bool border_result) const
+{
+    // the segments which can be crossed by the ray from p in the positive X direction, or on which p can lie
+    Point ray_start = p;
+    Point ray_end(POINT_MAX, p.Y);
+    const AABB ray(ray_start, ray_end);
+    unsigned int crossings = 0;
+    for (unsigned int poly_idx = 0; poly_idx < polygons.size(); poly_idx++)
+    {
+        const PolygonRef poly = polygons[poly_idx];
+        const bool on_border = !processSegmentsNear(poly_idx, ray, [&](unsigned int point_idx)
+            {
+                const Point p0 = poly[(point_idx == 0) ? poly.size() - 1 : point_idx - 1];
+                const short comp = LinearAlg2D::pointLiesOnTheRightOfLine(p, p0, poly[point_idx]);
+                if (comp == 1)
+                {
+                    crossings++;
+                }
+                return comp != 0;
+            });
+        if (on_border)
+        {
+            return border_result;
+        }
+    }
+    return (crossings % 2) == 1;
+}
+
+}//namespace cura
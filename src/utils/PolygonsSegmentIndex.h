@@ -0,0 +1,133 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef UTILS_POLYGONS_SEGMENT_INDEX_H
+#define UTILS_POLYGONS_SEGMENT_INDEX_H
+
+#include <algorithm> // min
+#include <vector>
+
+#include "AABB.h"
+#include "AABBIndex.h"
+#include "polygon.h"
+
+namespace cura
+{
+
+/*!
+ * A bounding volume hierarchy over the line segments of some polygons, to quickly find the segments near a line.
+ *
+ * The hierarchy has three levels: each polygon, groups of segments_per_chunk chunks within a polygon, and chunks of segments_per_chunk consecutive segments.
+ * Segment \p point_idx is the line segment from the point before \p point_idx to the point at \p point_idx, as in LinePolygonsCrossings.
+ *
+ * The index only stores bounding boxes, so it stays valid as long as the points of the polygons aren't changed.
+ */
+class PolygonsSegmentIndex
+{
+public:
+    static constexpr unsigned int segments_per_chunk = 16; //!< The number of segments in a chunk, and the number of chunks in a group
+
+    /*!
+     * \param polygons The polygons whose segments to index
+     */
+    PolygonsSegmentIndex(const Polygons& polygons);
+
+    /*!
+     * The number of indexed polygons.
+     */
+    unsigned int getPolygonCount() const
+    {
+        return polygon_boxes.size();
+    }
+
+    /*!
+     * Whether any segment of a polygon may lie within a box.
+     *
+     * \param poly_idx The index of the polygon
+     * \param box The area in which to look
+     */
+    bool polygonIsNear(unsigned int poly_idx, const AABB& box) const
+    {
+        return polygon_boxes[poly_idx].hit(box);
+    }
+
+    /*!
+     * Find the polygons which may have segments within a box, i.e. those for which PolygonsSegmentIndex::polygonIsNear holds,
+     * without testing the box of each polygon.
+     *
+     * \param box The area in which to look
+     * \param[out] poly_indices Replaced with the indices of the polygons near the box, in increasing order
+     */
+    void findPolygonsNear(const AABB& box, std::vector<unsigned int>& poly_indices) const
+    {
+        polygon_index.findHits(box, poly_indices);
+    }
+
+    /*!
+     * Call \p function for the segments of a polygon which may lie within a box, in increasing order of point index.
+     *
+     * Segments are skipped in whole chunks, so \p function is also called for some segments which don't lie within the box.
+     *
+     * \param poly_idx The index of the polygon
+     * \param box The area in which to look
+     * \param function Called with the index of the end point of each segment; returns whether to continue with the next segment
+     * \return Whether all segments near the box were processed, i.e. \p function never returned false
+     */
+    template<typename Function>
+    bool processSegmentsNear(unsigned int poly_idx, const AABB& box, Function function) const
+    {
+        if (!polygonIsNear(poly_idx, box))
+        {
+            return true;
+        }
+        const unsigned int segment_count = polygon_segment_counts[poly_idx];
+        const unsigned int chunk_count = (segment_count + segments_per_chunk - 1) / segments_per_chunk;
+        const unsigned int first_chunk_idx = polygon_first_chunk_idx[poly_idx];
+        const unsigned int first_group_idx = polygon_first_group_idx[poly_idx];
+        for (unsigned int group_idx = 0; group_idx * segments_per_chunk < chunk_count; group_idx++)
+        {
+            if (!group_boxes[first_group_idx + group_idx].hit(box))
+            {
+                continue;
+            }
+            const unsigned int chunk_end = std::min(chunk_count, (group_idx + 1) * segments_per_chunk);
+            for (unsigned int chunk_idx = group_idx * segments_per_chunk; chunk_idx < chunk_end; chunk_idx++)
+            {
+                if (!chunk_boxes[first_chunk_idx + chunk_idx].hit(box))
+                {
+                    continue;
+                }
+                const unsigned int point_end = std::min(segment_count, (chunk_idx + 1) * segments_per_chunk);
+                for (unsigned int point_idx = chunk_idx * segments_per_chunk; point_idx < point_end; point_idx++)
+                {
+                    if (!function(point_idx))
+                    {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    /*!
+     * Whether a point is inside the polygons, with the same result as Polygons::inside.
+     *
+     * Only the segments whose bounding boxes reach from the point to the right, at the height of the point, are checked.
+     *
+     * \param polygons The indexed polygons
+     * \param p The point for which to check whether it is inside
+     * \param border_result What to return when the point is exactly on the border
+     */
+    bool inside(const Polygons& polygons, Point p, bool border_result = false) const;
+
+private:
+    std::vector<AABB> polygon_boxes; //!< The bounding box of each polygon
+    AABBIndex polygon_index; //!< The index over PolygonsSegmentIndex::polygon_boxes
+    std::vector<unsigned int> polygon_segment_counts; //!< The number of segments of each polygon, which is its number of points
+    std::vector<unsigned int> polygon_first_chunk_idx; //!< For each polygon the index into PolygonsSegmentIndex::chunk_boxes of its first chunk
+    std::vector<unsigned int> polygon_first_group_idx; //!< For each polygon the index into PolygonsSegmentIndex::group_boxes of its first group
+    std::vector<AABB> chunk_boxes; //!< The bounding box of each chunk of segments
+    std::vector<AABB> group_boxes; //!< The bounding box of each group of chunks
+};
+
+}//namespace cura
+#endif//UTILS_POLYGONS_SEGMENT_INDEX_H
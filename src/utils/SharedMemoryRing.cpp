@@ -0,0 +1,178 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "SharedMemoryRing.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring> // memcpy
+#include <new> // placement new
+
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HAVE_SHARED_MEMORY
+#endif
+
+namespace cura
+{
+
+struct SharedMemoryRing::Header
+{
+    char magic[8]; //!< "CuraRing"
+    uint64_t capacity; //!< The size of the buffer after the header
+    std::atomic<uint64_t> write_position; //!< The end of the last committed block
+    std::atomic<uint64_t> read_position; //!< The end of the last released block
+    char padding[32];
+};
+
+namespace
+{
+
+const char ring_magic[8] = {'C', 'u', 'r', 'a', 'R', 'i', 'n', 'g'};
+
+}//namespace
+
+SharedMemoryRing::SharedMemoryRing(const std::string& name, uint64_t capacity)
+: name(name)
+, created(capacity > 0)
+, header(nullptr)
+, buffer(nullptr)
+, capacity(0)
+{
+    static_assert(sizeof(Header) == 64, "The header of the ring is part of the protocol with the other process");
+    static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "The positions are shared between processes, which requires lock-free atomics");
+#ifdef HAVE_SHARED_MEMORY
+    int fd;
+    if (created)
+    {
+        fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0 && errno == EEXIST)
+        { // left behind by a process with the same name which crashed
+            shm_unlink(name.c_str());
+            fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        }
+        if (fd < 0)
+        {
+            return;
+        }
+        if (ftruncate(fd, sizeof(Header) + capacity) != 0)
+        {
+            close(fd);
+            shm_unlink(name.c_str());
+            return;
+        }
+    }
+    else
+    {
+        fd = shm_open(name.c_str(), O_RDWR, 0);
+        if (fd < 0)
+        {
+            return;
+        }
+        struct stat shared_memory_stat;
+        if (fstat(fd, &shared_memory_stat) != 0 || uint64_t(shared_memory_stat.st_size) < sizeof(Header))
+        {
+            close(fd);
+            return;
+        }
+        capacity = shared_memory_stat.st_size - sizeof(Header);
+    }
+    void* mapping = mmap(nullptr, sizeof(Header) + capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); // the mapping keeps the shared memory object open
+    if (mapping == MAP_FAILED)
+    {
+        if (created)
+        {
+            shm_unlink(name.c_str());
+        }
+        return;
+    }
+    Header* mapped_header = static_cast<Header*>(mapping);
+    if (created)
+    {
+        new (mapped_header) Header();
+        memcpy(mapped_header->magic, ring_magic, sizeof(ring_magic));
+        mapped_header->capacity = capacity;
+        mapped_header->write_position.store(0, std::memory_order_relaxed);
+        mapped_header->read_position.store(0, std::memory_order_release);
+    }
+    else if (memcmp(mapped_header->magic, ring_magic, sizeof(ring_magic)) != 0 || mapped_header->capacity != capacity)
+    { // not a ring, or one of which the size doesn't match the shared memory object
+        munmap(mapping, sizeof(Header) + capacity);
+        return;
+    }
+    header = mapped_header;
+    buffer = static_cast<char*>(mapping) + sizeof(Header);
+    this->capacity = capacity;
+#else
+    (void)capacity;
+#endif
+}
+
+SharedMemoryRing::~SharedMemoryRing()
+{
+#ifdef HAVE_SHARED_MEMORY
+    if (!header)
+    {
+        return;
+    }
+    munmap(header, sizeof(Header) + capacity);
+    if (created)
+    {
+        shm_unlink(name.c_str());
+    }
+#endif
+}
+
+bool SharedMemoryRing::reserve(uint64_t size, uint64_t& position, char*& data)
+{
+    if (!header || size == 0 || size > capacity)
+    {
+        return false;
+    }
+    const uint64_t write_position = header->write_position.load(std::memory_order_relaxed); // only written by this process
+    const uint64_t read_position = header->read_position.load(std::memory_order_acquire);
+    position = write_position;
+    if (position % capacity + size > capacity)
+    { // the rest of the buffer is skipped, so that the block is contiguous
+        position += capacity - position % capacity;
+    }
+    if (position + size - read_position > capacity)
+    { // the reader is still using the space
+        return false;
+    }
+    data = buffer + position % capacity;
+    return true;
+}
+
+void SharedMemoryRing::commit(uint64_t position, uint64_t size)
+{
+    header->write_position.store(position + size, std::memory_order_release);
+}
+
+const char* SharedMemoryRing::getBlock(uint64_t position, uint64_t size) const
+{
+    if (!header || size == 0 || size > capacity)
+    {
+        return nullptr;
+    }
+    const uint64_t read_position = header->read_position.load(std::memory_order_relaxed); // only written by this process
+    const uint64_t write_position = header->write_position.load(std::memory_order_acquire);
+    if (position < read_position || position + size > write_position || position % capacity + size > capacity)
+    {
+        return nullptr;
+    }
+    return buffer + position % capacity;
+}
+
+void SharedMemoryRing::release(uint64_t position, uint64_t size)
+{
+    if (!header || position + size <= header->read_position.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+    header->read_position.store(position + size, std::memory_order_release);
+}
+
+}//namespace cura
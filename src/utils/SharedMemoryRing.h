@@ -0,0 +1,120 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef UTILS_SHARED_MEMORY_RING_H
+#define UTILS_SHARED_MEMORY_RING_H
+
+#include <stdint.h>
+#include <string>
+
+#include "NoCopy.h"
+
+namespace cura
+{
+
+/*!
+ * A ring buffer in POSIX shared memory, through which one process hands blocks of data to another process on the same machine
+ * without copying them through a socket.
+ *
+ * Only the data goes through the ring; the writer tells the reader where each block is through another channel, like the socket of the CommandSocket.
+ * A block is always contiguous in memory, so that the reader can parse it in place.
+ * Positions count the bytes written to the ring since it was created; a block at position p starts at byte p modulo the capacity of the buffer.
+ * A block which doesn't fit before the end of the buffer starts at the beginning of the buffer instead.
+ *
+ * The shared memory object starts with a header of 64 bytes:
+ *     uint64 magic "CuraRing"
+ *     uint64 capacity: the size of the buffer which follows the header
+ *     uint64 write position: the end of the last block committed by the writer, written atomically
+ *     uint64 read position: the end of the last block released by the reader, written atomically
+ * All blocks between the read and the write position are still in use by the reader.
+ * The reader releases the blocks in the order in which they were written, by setting the read position to the end of the block.
+ *
+ * The ring is unlinked when the process which created it destroys it; the other process can keep using its mapping until it lets go of it.
+ * Shared memory is only supported on Linux and Mac OS; elsewhere a ring is never valid.
+ */
+class SharedMemoryRing : NoCopy
+{
+public:
+    /*!
+     * Create a new ring, or open the ring created by another process.
+     *
+     * \param name The name of the shared memory object, as given to shm_open, e.g. "/cura_engine_1234"
+     * \param capacity The size of the buffer of a new ring in bytes, or zero to open an existing ring
+     */
+    SharedMemoryRing(const std::string& name, uint64_t capacity = 0);
+
+    ~SharedMemoryRing();
+
+    /*!
+     * Whether the ring could be created or opened and mapped.
+     */
+    bool isValid() const
+    {
+        return header != nullptr;
+    }
+
+    /*!
+     * The name of the shared memory object.
+     */
+    const std::string& getName() const
+    {
+        return name;
+    }
+
+    /*!
+     * The size of the buffer in bytes. Only valid if \ref SharedMemoryRing::isValid.
+     */
+    uint64_t getCapacity() const
+    {
+        return capacity;
+    }
+
+    /*!
+     * Claim space for the next block, without waiting for the reader to release any.
+     *
+     * The block is only visible to the reader after \ref SharedMemoryRing::commit.
+     *
+     * \param size The size of the block in bytes
+     * \param[out] position The position of the block
+     * \param[out] data Where to write the data of the block
+     * \return Whether there was enough space which the reader isn't using
+     */
+    bool reserve(uint64_t size, uint64_t& position, char*& data);
+
+    /*!
+     * Hand a block written after \ref SharedMemoryRing::reserve to the reader.
+     *
+     * \param position The position of the block
+     * \param size The size of the block in bytes
+     */
+    void commit(uint64_t position, uint64_t size);
+
+    /*!
+     * Get the data of a block written by the other process.
+     *
+     * The position and size come from the other process, so they are checked against the part of the ring in use.
+     *
+     * \param position The position of the block
+     * \param size The size of the block in bytes
+     * \return The data of the block, or nullptr if there is no such block in the ring
+     */
+    const char* getBlock(uint64_t position, uint64_t size) const;
+
+    /*!
+     * Let the writer reuse the space of a block and of all blocks before it.
+     *
+     * \param position The position of the block
+     * \param size The size of the block in bytes
+     */
+    void release(uint64_t position, uint64_t size);
+
+private:
+    struct Header;
+
+    std::string name; //!< The name of the shared memory object
+    bool created; //!< Whether this process created the shared memory object, and unlinks it
+    Header* header; //!< The start of the mapping, or nullptr if the ring isn't valid
+    char* buffer; //!< The buffer after the header
+    uint64_t capacity; //!< The size of the buffer in bytes
+};
+
+}//namespace cura
+#endif//UTILS_SHARED_MEMORY_RING_H
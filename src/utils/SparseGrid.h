@@ -5,13 +5,23 @@
 
 #include "intpoint.h"
 
+#include <algorithm>
 #include <cassert>
-#include <unordered_map>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <stdint.h>
 #include <vector>
 
 namespace cura {
 
 /*! \brief Sparse grid which can locate spatially nearby elements efficiently.
+ *
+ * The cells are kept in an open addressing hash table, and the elements in a
+ * single vector in which the elements of each cell are linked to each other.
+ * Elements inserted with \ref insertAll() lie next to the other elements of
+ * their cell.  Within a cell the elements are processed from the last
+ * inserted to the first.
  *
  * \tparam ElemT The element type to store.
  * \tparam Locator The functor to get the location from ElemT.  Locator
@@ -29,16 +39,48 @@ public:
      * \param[in] cell_size The size to use for a cell (square) in the grid.
      *    Typical values would be around 0.5-2x of expected query radius.
      * \param[in] elem_reserve Number of elements to research space for.
-     * \param[in] max_load_factor Maximum average load factor before rehashing.
+     * \param[in] max_load_factor Maximum fraction of the cell table in use
+     *    before it grows.  At most 0.5 is used, since the table is
+     *    probed linearly.
      */
     SparseGridInvasive(coord_t cell_size, size_t elem_reserve=0U, float max_load_factor=1.0f);
 
+    /*! \brief Chooses the cell size for a grid of elements from their
+     * number and their bounding box, rather than from a fixed heuristic.
+     *
+     * The elements are assumed to be spread evenly over the box, or along
+     * it when the box is too narrow for a cell of that size, and the cell
+     * size is chosen such that the cells which contain any element contain
+     * about \p target_occupancy elements.
+     *
+     * \param[in] min_loc The minimum corner of the bounding box.
+     * \param[in] max_loc The maximum corner of the bounding box.
+     * \param[in] elem_count The number of elements to insert.
+     * \param[in] target_occupancy The aimed for number of elements per cell.
+     * \param[in] min_cell_size The smallest cell size to return, e.g. to
+     *    limit the number of cells a query of a certain radius visits.
+     * \param[in] max_cell_size The largest cell size to return.
+     * \return The cell size.
+     */
+    static coord_t chooseCellSize(const Point &min_loc, const Point &max_loc, size_t elem_count,
+                                  double target_occupancy, coord_t min_cell_size, coord_t max_cell_size);
+
     /*! \brief Inserts elem into the sparse grid.
      *
      * \param[in] elem The element to be inserted.
      */
     void insert(const Elem &elem);
 
+    /*! \brief Inserts many elements into the sparse grid at once.
+     *
+     * The elements are sorted by cell once, so that the elements of each
+     * cell are stored next to each other.  The result is the same as
+     * inserting the elements one by one in the given order.
+     *
+     * \param[in] elems The elements to be inserted.
+     */
+    void insertAll(const std::vector<Elem> &elems);
+
     /*! \brief Returns all data within radius of query_pt.
      *
      * Finds all elements with location within radius of \p query_pt.  May
@@ -68,8 +110,19 @@ public:
      *    to be considered for output
      * \return True if and only if an object has been found within the radius.
      */
+    template<class Precondition>
     bool getNearest(const Point &query_pt, coord_t radius, Elem &elem_nearest,
-                    const std::function<bool(const Elem& elem)> precondition = no_precondition) const;
+                    const Precondition &precondition) const;
+
+    /*!
+     * Find the nearest element to a given \p query_pt within \p radius.
+     *
+     * \param[in] query_pt The point for which to find the nearest object.
+     * \param[in] radius The search radius.
+     * \param[out] elem_nearest the nearest element. Only valid if function returns true.
+     * \return True if and only if an object has been found within the radius.
+     */
+    bool getNearest(const Point &query_pt, coord_t radius, Elem &elem_nearest) const;
 
     /*! \brief Process elements from cells that might contain sought after points.
      *
@@ -89,9 +142,33 @@ public:
 
     coord_t getCellSize() const;
 
+    /*! \brief The number of elements in the grid. */
+    size_t getElemCount() const;
+
+    /*! \brief The number of cells which contain any element. */
+    size_t getOccupiedCellCount() const;
+
+    /*! \brief The most elements in a single cell. */
+    size_t getMaxCellElemCount() const;
+
 private:
     using GridPoint = Point;
-    using GridMap = std::unordered_multimap<GridPoint, Elem>;
+
+    static constexpr unsigned int no_node = std::numeric_limits<unsigned int>::max();
+
+    /*! \brief An element together with the next element in its cell. */
+    struct Node
+    {
+        Elem elem;
+        unsigned int next; //!< Index of the next node in the same cell, or no_node
+    };
+
+    /*! \brief A slot of the cell table. */
+    struct Cell
+    {
+        GridPoint grid_pt;
+        unsigned int first_node; //!< Index of the last inserted node of the cell, or no_node if the slot is empty
+    };
 
     /*! \brief Process elements from the cell indicated by \p grid_pt.
      *
@@ -110,8 +187,27 @@ private:
      */
     GridPoint toGridPoint(const Point &point) const;
 
-    /*! \brief Map from grid locations (GridPoint) to elements (Elem). */
-    GridMap m_grid;
+    /*! \brief Hash of the grid coordinates of a cell. */
+    static size_t hashGridPoint(const GridPoint &grid_pt);
+
+    /*! \brief Find the slot of a cell in the cell table.
+     *
+     * \return The slot of the cell or, if the cell isn't in the table, the
+     *    empty slot where it should be added.
+     */
+    size_t findSlot(const GridPoint &grid_pt) const;
+
+    /*! \brief Make room in the cell table for \p extra_cell_count more cells. */
+    void reserveCells(size_t extra_cell_count);
+
+    /*! \brief The cell table, of which the size is a power of two. */
+    std::vector<Cell> m_cells;
+    /*! \brief The number of slots in use in the cell table. */
+    size_t m_cell_count;
+    /*! \brief All elements. */
+    std::vector<Node> m_nodes;
+    /*! \brief The maximum fraction of slots in use in the cell table. */
+    float m_max_load_factor;
     /*! \brief Accessor for getting locations from elements. */
     Locator m_locator;
     /*! \brief The cell (square) size. */
@@ -196,17 +292,85 @@ public:
 #define SGI_TEMPLATE template<class ElemT, class Locator>
 #define SGI_THIS SparseGridInvasive<ElemT, Locator>
 
+SGI_TEMPLATE
+constexpr unsigned int SGI_THIS::no_node;
+
 SGI_TEMPLATE
 SGI_THIS::SparseGridInvasive(coord_t cell_size, size_t elem_reserve, float max_load_factor)
 {
     assert(cell_size > 0U);
 
     m_cell_size = cell_size;
+    m_cell_count = 0U;
 
     // Must be before the reserve call.
-    m_grid.max_load_factor(max_load_factor);
-    if (elem_reserve != 0U) {
-        m_grid.reserve(elem_reserve);
+    m_max_load_factor = std::max(0.1f, std::min(0.5f, max_load_factor));
+    m_nodes.reserve(elem_reserve);
+    reserveCells(std::max(size_t(8U), elem_reserve));
+}
+
+SGI_TEMPLATE
+coord_t SGI_THIS::chooseCellSize(const Point &min_loc, const Point &max_loc, size_t elem_count,
+                                 double target_occupancy, coord_t min_cell_size, coord_t max_cell_size)
+{
+    if (elem_count == 0)
+    {
+        return min_cell_size;
+    }
+    const double width = std::max(coord_t(1), max_loc.X - min_loc.X);
+    const double height = std::max(coord_t(1), max_loc.Y - min_loc.Y);
+    // elements spread over the box occupy width * height / cell_size^2 cells
+    double cell_size = std::sqrt(target_occupancy * width * height / elem_count);
+    if (cell_size > std::min(width, height))
+    { // elements spread along the box occupy only max(width, height) / cell_size cells
+        cell_size = target_occupancy * std::max(width, height) / elem_count;
+    }
+    return std::max(min_cell_size, std::min(max_cell_size, static_cast<coord_t>(cell_size)));
+}
+
+SGI_TEMPLATE
+size_t SGI_THIS::hashGridPoint(const GridPoint &grid_pt)
+{
+    uint64_t hash = static_cast<uint64_t>(grid_pt.X) * 0x9E3779B97F4A7C15ull
+        ^ static_cast<uint64_t>(grid_pt.Y) * 0xC2B2AE3D27D4EB4Full;
+    return hash ^ (hash >> 29);
+}
+
+SGI_TEMPLATE
+size_t SGI_THIS::findSlot(const GridPoint &grid_pt) const
+{
+    const size_t mask = m_cells.size() - 1;
+    for (size_t slot = hashGridPoint(grid_pt) & mask; ; slot = (slot + 1) & mask)
+    {
+        const Cell &cell = m_cells[slot];
+        if (cell.first_node == no_node || cell.grid_pt == grid_pt)
+        {
+            return slot;
+        }
+    }
+}
+
+SGI_TEMPLATE
+void SGI_THIS::reserveCells(size_t extra_cell_count)
+{
+    const size_t needed_cell_count = m_cell_count + extra_cell_count;
+    if (!m_cells.empty() && needed_cell_count <= m_cells.size() * m_max_load_factor)
+    {
+        return;
+    }
+    size_t slot_count = std::max(size_t(16U), m_cells.size());
+    while (needed_cell_count > slot_count * m_max_load_factor)
+    {
+        slot_count *= 2;
+    }
+    std::vector<Cell> old_cells(slot_count, Cell{GridPoint(), no_node});
+    m_cells.swap(old_cells);
+    for (const Cell &cell : old_cells)
+    {
+        if (cell.first_node != no_node)
+        {
+            m_cells[findSlot(cell.grid_pt)] = cell;
+        }
     }
 }
 
@@ -228,7 +392,74 @@ void SGI_THIS::insert(const Elem &elem)
     Point loc = m_locator(elem);
     GridPoint grid_loc = toGridPoint(loc);
 
-    m_grid.emplace(grid_loc,elem);
+    reserveCells(1U);
+    Cell &cell = m_cells[findSlot(grid_loc)];
+    if (cell.first_node == no_node)
+    {
+        cell.grid_pt = grid_loc;
+        m_cell_count++;
+    }
+    m_nodes.push_back(Node{elem, cell.first_node});
+    cell.first_node = m_nodes.size() - 1;
+}
+
+SGI_TEMPLATE
+void SGI_THIS::insertAll(const std::vector<Elem> &elems)
+{
+    std::vector<std::pair<GridPoint, unsigned int>> grid_locs; // cell and index into elems of each element
+    grid_locs.reserve(elems.size());
+    for (unsigned int elem_idx = 0; elem_idx < elems.size(); elem_idx++)
+    {
+        grid_locs.emplace_back(toGridPoint(m_locator(elems[elem_idx])), elem_idx);
+    }
+    // sort by cell; within a cell the last inserted element comes first
+    std::sort(grid_locs.begin(), grid_locs.end(),
+        [](const std::pair<GridPoint, unsigned int> &a, const std::pair<GridPoint, unsigned int> &b)
+        {
+            if (a.first.Y != b.first.Y)
+            {
+                return a.first.Y < b.first.Y;
+            }
+            if (a.first.X != b.first.X)
+            {
+                return a.first.X < b.first.X;
+            }
+            return a.second > b.second;
+        });
+
+    size_t new_cell_count = 0; // at most, since some cells may be in the grid already
+    for (size_t loc_idx = 0; loc_idx < grid_locs.size(); loc_idx++)
+    {
+        if (loc_idx == 0 || grid_locs[loc_idx].first != grid_locs[loc_idx - 1].first)
+        {
+            new_cell_count++;
+        }
+    }
+    reserveCells(new_cell_count);
+    m_nodes.reserve(m_nodes.size() + elems.size());
+    for (size_t group_start = 0; group_start < grid_locs.size(); )
+    {
+        const GridPoint &grid_loc = grid_locs[group_start].first;
+        size_t group_end = group_start + 1;
+        while (group_end < grid_locs.size() && grid_locs[group_end].first == grid_loc)
+        {
+            group_end++;
+        }
+        Cell &cell = m_cells[findSlot(grid_loc)];
+        if (cell.first_node == no_node)
+        {
+            cell.grid_pt = grid_loc;
+            m_cell_count++;
+        }
+        const unsigned int first_node = m_nodes.size();
+        for (size_t loc_idx = group_start; loc_idx < group_end; loc_idx++)
+        {
+            const bool is_last = loc_idx + 1 == group_end;
+            m_nodes.push_back(Node{elems[grid_locs[loc_idx].second], is_last ? cell.first_node : static_cast<unsigned int>(m_nodes.size() + 1)});
+        }
+        cell.first_node = first_node;
+        group_start = group_end;
+    }
 }
 
 SGI_TEMPLATE
@@ -237,12 +468,11 @@ void SGI_THIS::processFromCell(
     const GridPoint &grid_pt,
     ProcessFunc &process_func) const
 {
-    auto grid_range = m_grid.equal_range(grid_pt);
-    for (auto iter = grid_range.first; iter != grid_range.second; ++iter)
+    const Cell &cell = m_cells[findSlot(grid_pt)];
+    for (unsigned int node_idx = cell.first_node; node_idx != no_node; node_idx = m_nodes[node_idx].next)
     {
-        process_func(iter->second);
+        process_func(m_nodes[node_idx].elem);
     }
-
 }
 
 SGI_TEMPLATE
@@ -288,9 +518,10 @@ const std::function<bool(const typename SGI_THIS::Elem &)>
     };
 
 SGI_TEMPLATE
+template<class Precondition>
 bool SGI_THIS::getNearest(
     const Point &query_pt, coord_t radius, Elem &elem_nearest,
-    const std::function<bool(const Elem& elem)> precondition) const
+    const Precondition &precondition) const
 {
     bool found = false;
     int64_t best_dist2 = static_cast<int64_t>(radius) * radius;
@@ -313,12 +544,50 @@ bool SGI_THIS::getNearest(
     return found;
 }
 
+SGI_TEMPLATE
+bool SGI_THIS::getNearest(const Point &query_pt, coord_t radius, Elem &elem_nearest) const
+{
+    return getNearest(query_pt, radius, elem_nearest,
+        [](const Elem &)
+        {
+            return true;
+        });
+}
+
 SGI_TEMPLATE
 coord_t SGI_THIS::getCellSize() const
 {
     return m_cell_size;
 }
 
+SGI_TEMPLATE
+size_t SGI_THIS::getElemCount() const
+{
+    return m_nodes.size();
+}
+
+SGI_TEMPLATE
+size_t SGI_THIS::getOccupiedCellCount() const
+{
+    return m_cell_count;
+}
+
+SGI_TEMPLATE
+size_t SGI_THIS::getMaxCellElemCount() const
+{
+    size_t max_count = 0;
+    for (const Cell &cell : m_cells)
+    {
+        size_t count = 0;
+        for (unsigned int node_idx = cell.first_node; node_idx != no_node; node_idx = m_nodes[node_idx].next)
+        {
+            count++;
+        }
+        max_count = std::max(max_count, count);
+    }
+    return max_count;
+}
+
 #undef SGI_TEMPLATE
 #undef SGI_THIS
 
@@ -0,0 +1,118 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "TaskGraph.h"
+
+#include <algorithm> // stable_sort
+#include <atomic>
+#include <cassert>
+#include <exception>
+#include <mutex>
+
+#include "ThreadPool.h"
+
+namespace cura
+{
+
+TaskGraph::TaskIdx TaskGraph::addTask(const std::function<void()>& function, const std::vector<TaskIdx>& dependencies, int thread_idx, double cost)
+{
+    const TaskIdx task_idx = tasks.size();
+    tasks.emplace_back();
+    Task& task = tasks.back();
+    task.function = function;
+    task.unfinished_dependency_count = dependencies.size();
+    task.thread_idx = thread_idx;
+    task.cost = cost;
+    for (TaskIdx dependency : dependencies)
+    {
+        assert(dependency < task_idx && "a task can only depend on tasks which were added before it");
+        tasks[dependency].dependents.push_back(task_idx);
+    }
+    return task_idx;
+}
+
+void TaskGraph::run()
+{
+    ThreadPool* thread_pool = ThreadPool::getInstance();
+
+    std::mutex mutex; // guards the exception and the unfinished_dependency_count of the tasks
+    std::exception_ptr exception;
+    // a task is counted as finished only after the tasks it made ready are counted as scheduled,
+    // so that all tasks are finished once the counts are equal
+    std::atomic<unsigned int> scheduled_task_count(0);
+    std::atomic<unsigned int> finished_task_count(0);
+
+    // each task is handed to the thread pool as soon as its dependencies are finished
+    std::function<void(TaskIdx)> run_task = [&](TaskIdx task_idx)
+        {
+            std::vector<TaskIdx> ready_tasks;
+            bool failed;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                failed = bool(exception);
+            }
+            if (!failed)
+            { // after an exception no more tasks are started
+                try
+                {
+                    tasks[task_idx].function();
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!exception)
+                    {
+                        exception = std::current_exception();
+                    }
+                    failed = true;
+                }
+            }
+            if (!failed)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (TaskIdx dependent : tasks[task_idx].dependents)
+                {
+                    tasks[dependent].unfinished_dependency_count--;
+                    if (tasks[dependent].unfinished_dependency_count == 0)
+                    {
+                        ready_tasks.push_back(dependent);
+                    }
+                }
+            }
+            scheduled_task_count += ready_tasks.size();
+            schedule(ready_tasks, run_task);
+            finished_task_count++;
+        };
+
+    std::vector<TaskIdx> initial_tasks; // collected before any task is started, which would make more tasks ready
+    for (TaskIdx task_idx = 0; task_idx < tasks.size(); task_idx++)
+    {
+        if (tasks[task_idx].unfinished_dependency_count == 0)
+        {
+            initial_tasks.push_back(task_idx);
+        }
+    }
+    scheduled_task_count = initial_tasks.size();
+    schedule(initial_tasks, run_task);
+    thread_pool->workUntil([&]()
+        {
+            const unsigned int finished = finished_task_count; // read before the scheduled count, which can only have grown since
+            return finished == scheduled_task_count;
+        });
+
+    tasks.clear();
+    if (exception)
+    {
+        std::rethrow_exception(exception);
+    }
+}
+
+void TaskGraph::schedule(std::vector<TaskIdx>& ready_tasks, const std::function<void(TaskIdx)>& run_task)
+{
+    // the tasks of each thread are taken in the order in which they are scheduled, also when another thread takes them over
+    std::stable_sort(ready_tasks.begin(), ready_tasks.end(), [this](TaskIdx a, TaskIdx b) { return tasks[a].cost > tasks[b].cost; });
+    for (TaskIdx task_idx : ready_tasks)
+    {
+        ThreadPool::getInstance()->schedule([&run_task, task_idx]() { run_task(task_idx); }, tasks[task_idx].thread_idx);
+    }
+}
+
+}//namespace cura
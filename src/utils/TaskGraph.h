@@ -0,0 +1,82 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef UTILS_TASK_GRAPH_H
+#define UTILS_TASK_GRAPH_H
+
+#include <functional>
+#include <vector>
+
+#include "NoCopy.h"
+
+namespace cura
+{
+
+/*!
+ * A set of tasks with dependencies between them, which are computed by the threads of the \ref ThreadPool.
+ *
+ * A task is started as soon as all the tasks it depends on are finished,
+ * so that independent tasks, like the walls of different meshes or the support and the gradual infill, are computed at the same time.
+ *
+ * A task can only depend on tasks which have been added before it, so the graph can never contain a cycle.
+ *
+ * The tasks share the threads of the pool with the work of a \ref ThreadPool::parallelFor called from a task,
+ * so big tasks can spread their own work over the threads left idle by the graph.
+ * Tasks should still be small enough for there to be more of them than there are threads, e.g. a range of layers of a single mesh.
+ *
+ * Tasks which become ready at the same time are handed to the pool in the order of their estimated cost, the most expensive first,
+ * so that a thread which runs out of work takes over the long tasks of other threads before the short ones.
+ */
+class TaskGraph : NoCopy
+{
+public:
+    typedef unsigned int TaskIdx; //!< The index of a task in the graph, as returned by \ref TaskGraph::addTask
+
+    /*!
+     * Add a task to the graph.
+     *
+     * \param function The computation of the task
+     * \param dependencies The tasks which need to be finished before this task can be started
+     * \param thread_idx The thread of the pool which should preferably compute the task, e.g. the thread of its layers (see ThreadPool::getLayerThread), or -1 for any thread
+     * \param cost The estimated cost of the task, in any unit as long as it's the same for all tasks of the graph
+     * \return The index of the new task, with which later tasks can depend on it
+     */
+    TaskIdx addTask(const std::function<void()>& function, const std::vector<TaskIdx>& dependencies = std::vector<TaskIdx>(), int thread_idx = -1, double cost = 0.0);
+
+    /*!
+     * Get the number of tasks in the graph.
+     */
+    unsigned int size() const
+    {
+        return tasks.size();
+    }
+
+    /*!
+     * Compute all tasks and return when they are all finished.
+     *
+     * If a task throws an exception, no more tasks are started and the exception is rethrown once the running tasks are finished.
+     * The graph is emptied afterwards, so that it can be filled again.
+     */
+    void run();
+
+private:
+    struct Task
+    {
+        std::function<void()> function; //!< The computation of the task
+        std::vector<TaskIdx> dependents; //!< The tasks which depend on this task
+        unsigned int unfinished_dependency_count; //!< The number of tasks which still need to finish before this task can be started
+        int thread_idx; //!< The thread which should preferably compute the task, or -1
+        double cost; //!< The estimated cost of the task
+    };
+
+    /*!
+     * Hand tasks which have become ready to the thread pool, the most expensive first.
+     *
+     * \param ready_tasks The tasks, which are reordered
+     * \param run_task The function which computes a task and schedules the tasks it makes ready
+     */
+    void schedule(std::vector<TaskIdx>& ready_tasks, const std::function<void(TaskIdx)>& run_task);
+
+    std::vector<Task> tasks; //!< All tasks, in the order in which they were added
+};
+
+}//namespace cura
+#endif//UTILS_TASK_GRAPH_H
@@ -0,0 +1,449 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "ThreadPool.h"
+
+#include <algorithm> // min
+#include <cstdio> // sscanf
+#include <fstream>
+#include <iterator> // back_inserter
+#include <sstream>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <time.h> // clock_gettime
+#endif
+
+#include "allocatorTuning.h"
+#include "logoutput.h"
+
+namespace cura
+{
+
+ThreadPool ThreadPool::instance; // definition must be in cpp
+
+thread_local bool ThreadPool::in_parallel_region = false;
+thread_local unsigned int ThreadPool::thread_idx = 0;
+
+namespace
+{
+
+#ifdef __linux__
+/*!
+ * Read the processor cores in a list like "0-15,32-47", as in the cpulist files of the NUMA nodes.
+ */
+std::vector<int> readCoreList(const std::string& filename)
+{
+    std::vector<int> cores;
+    std::ifstream in(filename);
+    std::string list;
+    if (!std::getline(in, list))
+    {
+        return cores;
+    }
+    std::istringstream ranges(list);
+    std::string range;
+    while (std::getline(ranges, range, ','))
+    {
+        int first;
+        int last;
+        const int field_count = std::sscanf(range.c_str(), "%d-%d", &first, &last);
+        if (field_count < 1)
+        {
+            continue;
+        }
+        if (field_count == 1)
+        {
+            last = first;
+        }
+        for (int core = first; core <= last; core++)
+        {
+            cores.push_back(core);
+        }
+    }
+    return cores;
+}
+
+/*!
+ * Get the processor cores which the process may use, those of the first NUMA node first, then those of the next node, etc.
+ */
+std::vector<int> findCores()
+{
+    std::vector<int> cores;
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    {
+        return cores;
+    }
+    std::vector<bool> added(CPU_SETSIZE, false);
+    for (int node = 0; ; node++)
+    {
+        std::ostringstream node_filename;
+        node_filename << "/sys/devices/system/node/node" << node << "/cpulist";
+        if (!std::ifstream(node_filename.str()))
+        { // the nodes are numbered consecutively
+            break;
+        }
+        for (int core : readCoreList(node_filename.str()))
+        {
+            if (core >= 0 && core < CPU_SETSIZE && CPU_ISSET(core, &allowed) && !added[core])
+            {
+                cores.push_back(core);
+                added[core] = true;
+            }
+        }
+    }
+    for (int core = 0; core < CPU_SETSIZE; core++)
+    { // cores which aren't in any node, e.g. when the kernel has no NUMA support
+        if (CPU_ISSET(core, &allowed) && !added[core])
+        {
+            cores.push_back(core);
+        }
+    }
+    return cores;
+}
+#endif
+
+}//namespace
+
+ThreadPool::ThreadPool()
+: thread_count(1)
+, queued_task_count(0)
+, stopping(false)
+, configured(false)
+, pinned(false)
+{
+}
+
+ThreadPool::~ThreadPool()
+{
+    stopWorkers();
+}
+
+void ThreadPool::setThreadCount(unsigned int thread_count, bool pinned)
+{
+    if (thread_count == 0)
+    {
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    std::lock_guard<std::mutex> workers_lock(workers_mutex);
+    const bool was_configured = configured;
+    configured = true;
+    if (was_configured && thread_count == getThreadCount() && pinned == this->pinned)
+    {
+        return;
+    }
+    tuneAllocator(thread_count);
+    stopWorkers();
+    {
+        std::lock_guard<std::mutex> lock(tasks_mutex);
+        stopping = false;
+        for (unsigned int removed_thread_idx = thread_count; removed_thread_idx < tasks_per_thread.size(); removed_thread_idx++)
+        { // tasks queued for a thread which no longer exists since the workers stopped are computed by any thread
+            std::move(tasks_per_thread[removed_thread_idx].begin(), tasks_per_thread[removed_thread_idx].end(), std::back_inserter(tasks));
+        }
+        tasks_per_thread.resize(thread_count);
+    }
+    if (pinned || this->pinned)
+    { // the calling thread is pinned to the first core, or given all cores back
+        pinThread(0, pinned);
+    }
+    this->pinned = pinned;
+    for (unsigned int worker_idx = 0; worker_idx + 1 < thread_count; worker_idx++)
+    {
+        workers.emplace_back(&ThreadPool::workerLoop, this, worker_idx + 1);
+    }
+    this->thread_count = thread_count;
+    if (pinned)
+    {
+        log("Using %u threads, pinned to the processor cores.\n", thread_count);
+    }
+    else
+    {
+        log("Using %u threads.\n", thread_count);
+    }
+}
+
+std::vector<double> ThreadPool::getWorkerCpuTimes()
+{
+    std::vector<double> cpu_times;
+#ifdef __linux__
+    std::lock_guard<std::mutex> workers_lock(workers_mutex);
+    for (std::thread& worker : workers)
+    {
+        clockid_t clock;
+        timespec time;
+        if (pthread_getcpuclockid(worker.native_handle(), &clock) != 0 || clock_gettime(clock, &time) != 0)
+        {
+            return std::vector<double>();
+        }
+        cpu_times.push_back(double(time.tv_sec) + double(time.tv_nsec) / 1000000000.0);
+    }
+#endif
+    return cpu_times;
+}
+
+void ThreadPool::pinThread(unsigned int thread_idx, bool pinned)
+{
+#ifdef __linux__
+    if (cores.empty())
+    {
+        cores = findCores();
+        if (cores.empty())
+        {
+            return;
+        }
+    }
+    cpu_set_t core_set;
+    CPU_ZERO(&core_set);
+    if (pinned)
+    {
+        CPU_SET(cores[thread_idx % cores.size()], &core_set);
+    }
+    else
+    {
+        for (int core : cores)
+        {
+            CPU_SET(core, &core_set);
+        }
+    }
+    if (pthread_setaffinity_np(pthread_self(), sizeof(core_set), &core_set) != 0)
+    {
+        logWarning("Couldn't pin thread %u to a processor core.\n", thread_idx);
+    }
+#else
+    (void)thread_idx;
+    (void)pinned;
+#endif
+}
+
+void ThreadPool::stopWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(tasks_mutex);
+        stopping = true;
+    }
+    tasks_condition.notify_all();
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+    workers.clear();
+    thread_count = 1; // until new workers are started, the tasks are only computed by the threads waiting for them
+}
+
+void ThreadPool::workerLoop(unsigned int thread_idx)
+{
+    ThreadPool::thread_idx = thread_idx;
+    if (pinned)
+    { // before the allocator gives the thread its memory, so that that is allocated on the node of the thread
+        pinThread(thread_idx, true);
+    }
+    tuneAllocatorForThread();
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(tasks_mutex);
+            tasks_condition.wait(lock, [this]() { return stopping || queued_task_count > 0; });
+            if (!takeTask(thread_idx, task))
+            { // only stop once all tasks are done, otherwise a parallelFor could wait forever
+                return;
+            }
+        }
+        task();
+        notifyTaskFinished();
+    }
+}
+
+void ThreadPool::notifyTaskFinished()
+{
+    {
+        // a thread which has just found its condition false is either still holding the lock, or already waiting for the notification
+        std::lock_guard<std::mutex> lock(tasks_mutex);
+    }
+    tasks_condition.notify_all();
+}
+
+bool ThreadPool::takeTask(unsigned int thread_idx, std::function<void()>& task)
+{
+    if (queued_task_count == 0)
+    {
+        return false;
+    }
+    std::deque<std::function<void()>>* queue = &tasks;
+    if (thread_idx < tasks_per_thread.size() && !tasks_per_thread[thread_idx].empty())
+    {
+        queue = &tasks_per_thread[thread_idx];
+    }
+    for (unsigned int other_idx = 1; queue->empty() && other_idx < tasks_per_thread.size(); other_idx++)
+    { // the other threads are busy with other work, so their tasks are taken over
+        queue = &tasks_per_thread[(thread_idx + other_idx) % tasks_per_thread.size()];
+    }
+    task = std::move(queue->front());
+    queue->pop_front();
+    queued_task_count--;
+    return true;
+}
+
+void ThreadPool::schedule(std::function<void()> task, int thread_idx)
+{
+    if (!in_parallel_region && !configured)
+    {
+        setThreadCount(0);
+    }
+    {
+        std::lock_guard<std::mutex> lock(tasks_mutex);
+        if (thread_idx >= 0 && static_cast<unsigned int>(thread_idx) < tasks_per_thread.size())
+        {
+            tasks_per_thread[thread_idx].push_back(std::move(task));
+        }
+        else
+        {
+            tasks.push_back(std::move(task));
+        }
+        queued_task_count++;
+    }
+    tasks_condition.notify_all();
+}
+
+void ThreadPool::workUntil(const std::function<bool()>& done)
+{
+    const bool was_in_parallel_region = in_parallel_region;
+    in_parallel_region = true;
+    std::unique_lock<std::mutex> lock(tasks_mutex);
+    while (!done())
+    {
+        std::function<void()> task;
+        if (!takeTask(thread_idx, task))
+        {
+            tasks_condition.wait(lock);
+            continue;
+        }
+        lock.unlock();
+        task();
+        lock.lock();
+        tasks_condition.notify_all();
+    }
+    in_parallel_region = was_in_parallel_region;
+}
+
+ThreadPool::Job::Job(int first, int last, int chunk_size, const std::function<void(int)>& body, unsigned int thread_count, int layer_count)
+: next_idx(first)
+, last_idx(last)
+, chunk_size(std::max(1, chunk_size))
+, body(body)
+, next_layer_per_thread(layer_count < 0 ? 0 : thread_count)
+, active_helpers(0)
+{
+    if (layer_count < 0)
+    {
+        return;
+    }
+    end_layer_per_thread.resize(thread_count);
+    for (unsigned int layer_thread_idx = 0; layer_thread_idx < thread_count; layer_thread_idx++)
+    { // the layers of thread t are those for which layer_nr * thread_count / layer_count == t, see getLayerThread
+        const int start = (int64_t(layer_thread_idx) * layer_count + thread_count - 1) / thread_count;
+        const int end = (int64_t(layer_thread_idx + 1) * layer_count + thread_count - 1) / thread_count;
+        next_layer_per_thread[layer_thread_idx] = std::min(last, std::max(first, start));
+        end_layer_per_thread[layer_thread_idx] = std::max(first, std::min(last, layer_thread_idx + 1 == thread_count ? last : end));
+    }
+}
+
+bool ThreadPool::Job::claim(int& chunk_start, int& chunk_end)
+{
+    if (next_layer_per_thread.empty())
+    {
+        chunk_start = next_idx.fetch_add(chunk_size);
+        chunk_end = std::min(last_idx, chunk_start + chunk_size);
+        return chunk_start < last_idx;
+    }
+    const unsigned int thread_count = next_layer_per_thread.size();
+    for (unsigned int other_idx = 0; other_idx < thread_count; other_idx++)
+    { // first the layers of this thread, then those of the threads after it
+        const unsigned int layer_thread_idx = (thread_idx + other_idx) % thread_count;
+        if (next_layer_per_thread[layer_thread_idx].load(std::memory_order_relaxed) >= end_layer_per_thread[layer_thread_idx])
+        {
+            continue;
+        }
+        chunk_start = next_layer_per_thread[layer_thread_idx].fetch_add(1);
+        if (chunk_start < end_layer_per_thread[layer_thread_idx])
+        {
+            chunk_end = chunk_start + 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::Job::process(int chunk_start, int chunk_end)
+{
+    try
+    {
+        for (int idx = chunk_start; idx < chunk_end; idx++)
+        {
+            body(idx);
+        }
+    }
+    catch (...)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!exception)
+        {
+            exception = std::current_exception();
+        }
+        // skip all remaining work
+        next_idx = last_idx;
+        for (unsigned int layer_thread_idx = 0; layer_thread_idx < next_layer_per_thread.size(); layer_thread_idx++)
+        {
+            next_layer_per_thread[layer_thread_idx] = end_layer_per_thread[layer_thread_idx];
+        }
+    }
+}
+
+void ThreadPool::Job::work()
+{
+    const bool was_in_parallel_region = in_parallel_region;
+    in_parallel_region = true;
+    int chunk_start;
+    int chunk_end;
+    while (claim(chunk_start, chunk_end))
+    {
+        process(chunk_start, chunk_end);
+    }
+    in_parallel_region = was_in_parallel_region;
+}
+
+void ThreadPool::parallelForImpl(int first, int last, const std::function<void(int)>& body, int chunk_size, int layer_count)
+{
+    const unsigned int thread_count = getThreadCount(); // read once, since another thread may change it meanwhile
+    Job job(first, last, chunk_size, body, thread_count, layer_count);
+
+    const int chunk_count = (last - first + job.chunk_size - 1) / job.chunk_size;
+    const unsigned int helper_count = std::min<unsigned int>(thread_count - 1, chunk_count - 1);
+    job.active_helpers = helper_count;
+    {
+        std::lock_guard<std::mutex> lock(tasks_mutex);
+        for (unsigned int helper_idx = 0; helper_idx < helper_count; helper_idx++)
+        {
+            tasks.emplace_back([&job]()
+                {
+                    job.work();
+                    job.active_helpers--;
+                });
+        }
+        queued_task_count += helper_count;
+    }
+    tasks_condition.notify_all();
+
+    job.work();
+
+    // helpers which haven't been started yet may be queued behind other tasks, which this thread computes in the meantime
+    workUntil([&job]() { return job.active_helpers == 0; });
+    if (job.exception)
+    {
+        std::rethrow_exception(job.exception);
+    }
+}
+
+}//namespace cura
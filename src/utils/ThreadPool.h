@@ -0,0 +1,366 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef UTILS_THREAD_POOL_H
+#define UTILS_THREAD_POOL_H
+
+#include <algorithm> // sort, inplace_merge
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iterator> // iterator_traits
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#include "NoCopy.h"
+
+namespace cura
+{
+
+/*!
+ * A pool of worker threads which is shared by all stages of the engine which can be computed in parallel.
+ *
+ * The pool is a singleton so that the threads are started only once and are reused for every stage and every meshgroup.
+ *
+ * Work is handed to the pool through \ref ThreadPool::parallelFor, which blocks until all work is done.
+ * The calling thread takes part in the computation, so a pool with a thread count of 1 doesn't start any worker threads at all
+ * and simply computes everything serially on the calling thread.
+ *
+ * A parallelFor called from within the body of another parallelFor, or from a task, is handed to the pool as well.
+ * A thread which waits for the rest of its own parallelFor to finish computes other work of the pool in the meantime,
+ * so the threads are kept busy without ever waiting for each other in a cycle.
+ *
+ * The stages which process all layers divide the layers the same way over the threads, see \ref ThreadPool::parallelForLayers,
+ * so that each stage finds the layers its thread works on in the caches of the thread which built them in the stage before.
+ * The threads can also be pinned to the processor cores, in the order of their NUMA nodes:
+ * the threads of a node then work on a contiguous range of layers, of which the memory is allocated on that node when the threads first write to it.
+ */
+class ThreadPool : NoCopy
+{
+private:
+    static ThreadPool instance; //!< The instance of this singleton
+
+    ThreadPool();
+public:
+    ~ThreadPool();
+
+    /*!
+     * Get the instance
+     * \return The instance
+     */
+    static ThreadPool* getInstance()
+    {
+        return &instance;
+    }
+
+    /*!
+     * Set the number of threads which compute a parallelFor, including the calling thread.
+     *
+     * Worker threads are only stopped and started when the thread count actually changes.
+     * Until this is called, the pool uses as many threads as there are processor cores.
+     *
+     * Other threads may use the pool meanwhile, e.g. to write the gcode of the previous mesh group:
+     * the old worker threads finish all queued tasks before they stop, and tasks queued while the threads are replaced
+     * are computed by the new worker threads or by the threads waiting for them.
+     *
+     * \param thread_count The number of threads to use, or zero to use as many threads as there are processor cores.
+     * \param pinned Whether to pin each thread to a processor core, see \ref ThreadPool::pinThread
+     */
+    void setThreadCount(unsigned int thread_count, bool pinned = false);
+
+    /*!
+     * Get the number of threads which compute a parallelFor, including the calling thread.
+     */
+    unsigned int getThreadCount() const
+    {
+        return thread_count;
+    }
+
+    /*!
+     * Get the processor time used so far by each worker thread, i.e. by the threads with index 1 and up, in seconds.
+     *
+     * \return The processor time of each worker thread, or nothing where the time of other threads can't be measured
+     */
+    std::vector<double> getWorkerCpuTimes();
+
+    /*!
+     * Get the index of the current thread in the pool: 0 for the thread which calls the parallel stages, and 1 and up for the worker threads.
+     */
+    static unsigned int getThreadIndex()
+    {
+        return thread_idx;
+    }
+
+    /*!
+     * Get the thread which works on layer \p layer_nr in all stages which process the layers of a print,
+     * by dividing the layers into one contiguous range of layers per thread.
+     *
+     * \param layer_nr The layer
+     * \param layer_count The number of layers of the print
+     * \return The index of the thread, see \ref ThreadPool::getThreadIndex
+     */
+    unsigned int getLayerThread(int layer_nr, int layer_count) const
+    {
+        if (layer_count <= 0)
+        {
+            return 0;
+        }
+        return std::min<int64_t>(getThreadCount() - 1, std::max(0, layer_nr) * int64_t(getThreadCount()) / layer_count);
+    }
+
+    /*!
+     * Compute \p body for each index in the range [\p first, \p last).
+     *
+     * Returns when \p body has been computed for all indices.
+     * The order in which the indices are processed is undefined;
+     * the caller should make sure that the result of the computation doesn't depend on it.
+     *
+     * If \p body throws an exception, the remaining indices are skipped and the exception is rethrown on the calling thread.
+     *
+     * \param first The first index to process
+     * \param last One past the last index to process
+     * \param body The function to compute for each index; a function of the form void(int index)
+     * \param chunk_size The number of consecutive indices a thread claims at once. Use larger chunks when \p body is cheap.
+     */
+    template<typename F>
+    void parallelFor(int first, int last, const F& body, int chunk_size = 1)
+    {
+        if (!in_parallel_region && !configured)
+        {
+            setThreadCount(0);
+        }
+        if (last - first <= 1 || getThreadCount() <= 1)
+        {
+            for (int idx = first; idx < last; idx++)
+            {
+                body(idx);
+            }
+            return;
+        }
+        parallelForImpl(first, last, std::function<void(int)>(body), chunk_size);
+    }
+
+    /*!
+     * Compute \p body for each layer in the range [\p first, \p last), starting each thread on its own layers, see \ref ThreadPool::getLayerThread.
+     *
+     * A thread which is done with its own layers takes over layers of the other threads,
+     * so that a thread which is busy with other work doesn't hold up the rest.
+     * Otherwise this is the same as \ref ThreadPool::parallelFor.
+     *
+     * \param first The first layer to process
+     * \param last One past the last layer to process
+     * \param body The function to compute for each layer; a function of the form void(int layer_nr)
+     * \param layer_count The number of layers of the print, if the range doesn't cover all layers
+     */
+    template<typename F>
+    void parallelForLayers(int first, int last, const F& body, int layer_count = -1)
+    {
+        if (!in_parallel_region && !configured)
+        {
+            setThreadCount(0);
+        }
+        if (last - first <= 1 || getThreadCount() <= 1)
+        {
+            for (int idx = first; idx < last; idx++)
+            {
+                body(idx);
+            }
+            return;
+        }
+        parallelForImpl(first, last, std::function<void(int)>(body), 1, layer_count < 0 ? last : layer_count);
+    }
+
+    /*!
+     * Sort the range [\p first, \p last) using all threads.
+     *
+     * The range is split into chunks which are sorted in parallel and then merged pairwise.
+     * Like std::sort this isn't stable, so it gives the same result as std::sort only if \p comp is a total order.
+     *
+     * \param first The start of the range to sort
+     * \param last The end of the range to sort
+     * \param comp The comparison function object, as for std::sort
+     */
+    template<typename RandomIt, typename Compare>
+    void parallelSort(RandomIt first, RandomIt last, Compare comp)
+    {
+        if (!in_parallel_region && !configured)
+        {
+            setThreadCount(0);
+        }
+        const int min_chunk_size = 1 << 14; // smaller chunks aren't worth the overhead of merging
+        const int size = last - first;
+        int chunk_count = 1;
+        while (chunk_count * 2 <= int(getThreadCount()) && size / (chunk_count * 2) >= min_chunk_size)
+        {
+            chunk_count *= 2;
+        }
+        if (chunk_count == 1)
+        {
+            std::sort(first, last, comp);
+            return;
+        }
+        std::vector<RandomIt> boundaries;
+        for (int chunk_idx = 0; chunk_idx <= chunk_count; chunk_idx++)
+        {
+            boundaries.push_back(first + int64_t(size) * chunk_idx / chunk_count);
+        }
+        parallelFor(0, chunk_count, [&](int chunk_idx)
+            {
+                std::sort(boundaries[chunk_idx], boundaries[chunk_idx + 1], comp);
+            });
+        for (int merge_width = 1; merge_width < chunk_count; merge_width *= 2)
+        {
+            parallelFor(0, chunk_count / (merge_width * 2), [&](int merge_idx)
+                {
+                    const int chunk_idx = merge_idx * merge_width * 2;
+                    std::inplace_merge(boundaries[chunk_idx], boundaries[chunk_idx + merge_width], boundaries[chunk_idx + merge_width * 2], comp);
+                });
+        }
+    }
+
+    /*!
+     * Sort the range [\p first, \p last) using all threads, ordered by operator<.
+     *
+     * \param first The start of the range to sort
+     * \param last The end of the range to sort
+     */
+    template<typename RandomIt>
+    void parallelSort(RandomIt first, RandomIt last)
+    {
+        parallelSort(first, last, std::less<typename std::iterator_traits<RandomIt>::value_type>());
+    }
+
+    /*!
+     * Add a task which is computed by one of the threads of the pool.
+     *
+     * The task is only guaranteed to be computed while some thread waits in \ref ThreadPool::workUntil,
+     * since without worker threads it's computed by the waiting thread.
+     * The task shouldn't throw.
+     *
+     * \param task The task to compute
+     * \param thread_idx The thread which should preferably compute the task, or -1 for any thread.
+     * Another thread takes over the task if it has nothing else to do.
+     */
+    void schedule(std::function<void()> task, int thread_idx = -1);
+
+    /*!
+     * Compute tasks of the pool on the calling thread until \p done returns true.
+     *
+     * \p done is called with the tasks of the pool locked, whenever it may have become true: initially and each time a task is finished.
+     * It should therefore be cheap and not use the pool itself.
+     *
+     * \param done The condition to wait for; it should only become true by finishing a task, or the wait may miss it
+     */
+    void workUntil(const std::function<bool()>& done);
+
+private:
+    /*!
+     * The administration of a single call to parallelFor, shared between all threads which take part in it.
+     */
+    struct Job
+    {
+        std::atomic<int> next_idx; //!< The first index which hasn't been claimed by any thread yet
+        int last_idx; //!< One past the last index of the range
+        int chunk_size; //!< The number of indices claimed at once
+        const std::function<void(int)>& body; //!< The function to compute for each index
+
+        /*!
+         * For a ThreadPool::parallelForLayers, the first layer of each thread which hasn't been claimed yet, followed by the end of the layers of the last thread.
+         * Empty for a plain parallelFor, of which the indices are claimed through Job::next_idx.
+         */
+        std::vector<std::atomic<int>> next_layer_per_thread;
+        std::vector<int> end_layer_per_thread; //!< One past the last layer of each thread
+
+        std::atomic<unsigned int> active_helpers; //!< The number of helper tasks which still need to finish, whether they've been started or not
+
+        std::mutex mutex; //!< Guards the member below
+        std::exception_ptr exception; //!< The first exception thrown by \ref Job::body
+
+        Job(int first, int last, int chunk_size, const std::function<void(int)>& body, unsigned int thread_count, int layer_count);
+
+        /*!
+         * Claim and process chunks of indices until none are left.
+         */
+        void work();
+
+        /*!
+         * Claim a chunk of indices.
+         *
+         * \param[out] chunk_start The first index of the chunk
+         * \param[out] chunk_end One past the last index of the chunk
+         * \return Whether there was any index left to claim
+         */
+        bool claim(int& chunk_start, int& chunk_end);
+
+        /*!
+         * Compute the function for a chunk of indices.
+         */
+        void process(int chunk_start, int chunk_end);
+    };
+
+    /*!
+     * Hand the job to the worker threads, work on it from the calling thread and wait till it's finished.
+     */
+    void parallelForImpl(int first, int last, const std::function<void(int)>& body, int chunk_size, int layer_count = -1);
+
+    /*!
+     * The main loop of a worker thread: process tasks until the pool is stopped.
+     *
+     * \param thread_idx The index of the worker thread in the pool, see \ref ThreadPool::getThreadIndex
+     */
+    void workerLoop(unsigned int thread_idx);
+
+    /*!
+     * Stop and join all worker threads.
+     */
+    void stopWorkers();
+
+    /*!
+     * Take the next task to compute on a thread: its own tasks first, then the tasks for any thread and finally the tasks of other threads.
+     *
+     * Requires \ref ThreadPool::tasks_mutex to be locked.
+     *
+     * \param thread_idx The thread which will compute the task
+     * \param[out] task The task
+     * \return Whether there was any task
+     */
+    bool takeTask(unsigned int thread_idx, std::function<void()>& task);
+
+    /*!
+     * Pin the current thread to a processor core, or unpin it.
+     *
+     * Thread \p thread_idx of the pool is pinned to the core at that index when the cores are ordered by NUMA node,
+     * so that consecutive threads, and therefore consecutive layers, stay on the same node.
+     * This is only supported on Linux; elsewhere it does nothing.
+     *
+     * \param thread_idx The index of the current thread in the pool
+     * \param pinned Whether to pin the thread, or to allow it to run on all cores which the process may use
+     */
+    void pinThread(unsigned int thread_idx, bool pinned);
+
+    /*!
+     * Notify the threads waiting in \ref ThreadPool::workUntil that a task is finished.
+     */
+    void notifyTaskFinished();
+
+    std::vector<std::thread> workers; //!< The worker threads (excluding the calling thread)
+    std::atomic<unsigned int> thread_count; //!< The number of worker threads plus the calling thread, which is read without locking
+    std::mutex workers_mutex; //!< Guards \ref ThreadPool::workers and \ref ThreadPool::pinned, which are changed while other threads may use the pool
+    std::deque<std::function<void()>> tasks; //!< Tasks which still have to be picked up by a worker thread
+    std::vector<std::deque<std::function<void()>>> tasks_per_thread; //!< Tasks which should preferably be computed by a specific thread
+    unsigned int queued_task_count; //!< The number of tasks in \ref ThreadPool::tasks and \ref ThreadPool::tasks_per_thread
+    std::mutex tasks_mutex; //!< Guards the tasks, \ref ThreadPool::queued_task_count and \ref ThreadPool::stopping
+    std::condition_variable tasks_condition; //!< Notified when a task is added or finished, or when the workers should stop
+    bool stopping; //!< Whether the worker threads should stop
+    std::atomic<bool> configured; //!< Whether the thread count has been set
+    bool pinned; //!< Whether the threads are pinned to the processor cores
+    std::vector<int> cores; //!< The processor cores which the process may use, ordered by NUMA node
+
+    static thread_local bool in_parallel_region; //!< Whether the current thread is computing (part of) a parallelFor
+    static thread_local unsigned int thread_idx; //!< The index of the current thread in the pool, see \ref ThreadPool::getThreadIndex
+};
+
+}//namespace cura
+#endif//UTILS_THREAD_POOL_H
@@ -0,0 +1,79 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "Trace.h"
+
+#include <iomanip>
+
+namespace cura
+{
+
+namespace
+{
+std::atomic<unsigned int> thread_count(0); // the number of threads which have recorded an event
+thread_local int thread_idx = -1; // the number of the current thread in the trace, or -1 if it hasn't recorded an event yet
+}
+
+Trace::Trace()
+: recording(false)
+{
+}
+
+Trace& Trace::getInstance()
+{
+    static Trace instance;
+    return instance;
+}
+
+bool Trace::isAvailable()
+{
+#ifdef TRACING
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Trace::start()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    events.clear();
+    start_time = std::chrono::steady_clock::now();
+    recording = true;
+}
+
+void Trace::record(const char* name, int mesh_idx, int layer_nr, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+    if (!recording)
+    {
+        return;
+    }
+    if (thread_idx < 0)
+    {
+        thread_idx = thread_count++;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    const double start_us = std::chrono::duration<double, std::micro>(start - start_time).count();
+    const double duration_us = std::chrono::duration<double, std::micro>(end - start).count();
+    events.push_back(Event{name, static_cast<unsigned int>(thread_idx), mesh_idx, layer_nr, start_us, duration_us});
+}
+
+void Trace::writeJSON(std::ostream& out)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    out << std::fixed << std::setprecision(3);
+    out << "{\n";
+    out << "    \"displayTimeUnit\": \"ms\",\n";
+    out << "    \"traceEvents\": [";
+    for (unsigned int event_idx = 0; event_idx < events.size(); event_idx++)
+    {
+        const Event& event = events[event_idx];
+        out << ((event_idx == 0) ? "\n" : ",\n");
+        out << "        { \"name\": \"" << event.name << "\", \"cat\": \"cura\", \"ph\": \"X\""
+            << ", \"pid\": 1, \"tid\": " << event.thread_idx
+            << ", \"ts\": " << event.start << ", \"dur\": " << event.duration
+            << ", \"args\": { \"mesh\": " << event.mesh_idx << ", \"layer\": " << event.layer_nr << " } }";
+    }
+    out << "\n    ]\n";
+    out << "}\n";
+}
+
+}//namespace cura
@@ -0,0 +1,111 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef UTILS_TRACE_H
+#define UTILS_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include "NoCopy.h"
+
+namespace cura
+{
+
+/*!
+ * The timeline of the scoped events which happened on each thread while slicing, to be viewed in chrome://tracing or Perfetto.
+ *
+ * Events are only recorded when CuraEngine is built with ENABLE_TRACING, after the trace has been started.
+ * Otherwise the TRACE_SCOPE macro compiles to nothing, so that it can be left in the hot parts of the engine.
+ */
+class Trace : NoCopy
+{
+public:
+    /*!
+     * A scoped event: the time between the start and the end of a scope on a single thread.
+     */
+    struct Event
+    {
+        const char* name; //!< The name of the event; a string literal
+        unsigned int thread_idx; //!< The thread on which the event happened, numbered in the order in which threads first recorded an event
+        int mesh_idx; //!< The mesh to which the event applies, or -1 if it doesn't apply to a single mesh
+        int layer_nr; //!< The layer to which the event applies, or -1 if it doesn't apply to a single layer
+        double start; //!< The time at which the event started, in microseconds since the trace started
+        double duration; //!< The time the event took, in microseconds
+    };
+
+    /*!
+     * Records the event of the scope in which it lives, when it goes out of scope.
+     */
+    class Scope : NoCopy
+    {
+    public:
+        Scope(const char* name, int mesh_idx, int layer_nr)
+        : name(name)
+        , mesh_idx(mesh_idx)
+        , layer_nr(layer_nr)
+        , start(std::chrono::steady_clock::now())
+        {
+        }
+
+        ~Scope()
+        {
+            Trace::getInstance().record(name, mesh_idx, layer_nr, start, std::chrono::steady_clock::now());
+        }
+    private:
+        const char* name;
+        int mesh_idx;
+        int layer_nr;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    static Trace& getInstance();
+
+    /*!
+     * Whether the engine has been built with tracing, so that it can record events.
+     */
+    static bool isAvailable();
+
+    /*!
+     * Start recording events, from which time on the times of the events are counted.
+     */
+    void start();
+
+    /*!
+     * Record an event, if the trace has been started.
+     */
+    void record(const char* name, int mesh_idx, int layer_nr, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+
+    /*!
+     * Write the events recorded up till now in the Chrome JSON trace format.
+     */
+    void writeJSON(std::ostream& out);
+
+private:
+    std::atomic<bool> recording; //!< Whether Trace::start has been called
+    std::chrono::steady_clock::time_point start_time; //!< When the trace started
+    std::vector<Event> events; //!< The events in the order in which they ended
+    std::mutex mutex; //!< Guards Trace::events, to which all threads record
+
+    Trace();
+};
+
+}//namespace cura
+
+#ifdef TRACING
+ #define TRACE_SCOPE_CONCAT_(a, b) a##b
+ #define TRACE_SCOPE_CONCAT(a, b) TRACE_SCOPE_CONCAT_(a, b)
+ /*!
+  * Record the time from here until the end of the enclosing scope as a trace event.
+  *
+  * \param name The name of the event; a string literal
+  * \param mesh_idx The mesh to which the event applies, or -1
+  * \param layer_nr The layer to which the event applies, or -1
+  */
+ #define TRACE_SCOPE(name, mesh_idx, layer_nr) ::cura::Trace::Scope TRACE_SCOPE_CONCAT(trace_scope_, __LINE__)(name, mesh_idx, layer_nr)
+#else
+ #define TRACE_SCOPE(name, mesh_idx, layer_nr) do {} while (0)
+#endif
+
+#endif//UTILS_TRACE_H
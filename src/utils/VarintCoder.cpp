@@ -0,0 +1,134 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "VarintCoder.h"
+
+namespace cura
+{
+
+void VarintEncoder::count(uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        data.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    data.push_back(static_cast<char>(value));
+}
+
+void VarintEncoder::value(int64_t value)
+{
+    count((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+void VarintEncoder::polygons(const Polygons& polygons)
+{
+    count(polygons.size());
+    for (unsigned int poly_idx = 0; poly_idx < polygons.size(); poly_idx++)
+    {
+        count(polygons[poly_idx].size());
+    }
+    Point previous(0, 0);
+    for (unsigned int poly_idx = 0; poly_idx < polygons.size(); poly_idx++)
+    {
+        for (const Point& point : polygons[poly_idx])
+        {
+            value(point.X - previous.X);
+            value(point.Y - previous.Y);
+            previous = point;
+        }
+    }
+}
+
+void VarintEncoder::polygonsList(const std::vector<Polygons>& polygons_list)
+{
+    count(polygons_list.size());
+    for (const Polygons& polygons : polygons_list)
+    {
+        this->polygons(polygons);
+    }
+}
+
+VarintDecoder::VarintDecoder(const char* data, size_t size)
+: data(data)
+, size(size)
+, pos(0)
+{
+}
+
+uint64_t VarintDecoder::count()
+{
+    uint64_t result = 0;
+    for (unsigned int shift = 0; ok && shift < 64; shift += 7)
+    {
+        if (pos >= size)
+        {
+            break;
+        }
+        const uint8_t byte = data[pos++];
+        result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            return result;
+        }
+    }
+    ok = false;
+    return 0;
+}
+
+int64_t VarintDecoder::value()
+{
+    const uint64_t zigzag = count();
+    return static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1);
+}
+
+void VarintDecoder::polygons(Polygons& polygons)
+{
+    const uint64_t poly_count = count();
+    if (!ok || poly_count > size - pos)
+    { // every count takes at least a byte
+        ok = false;
+        return;
+    }
+    std::vector<uint64_t> point_counts(poly_count);
+    for (uint64_t& point_count : point_counts)
+    {
+        point_count = count();
+        if (point_count > size - pos)
+        { // every point takes at least two bytes
+            ok = false;
+        }
+    }
+    if (!ok)
+    {
+        return;
+    }
+    polygons.reserve(polygons.size() + poly_count);
+    Point previous(0, 0);
+    for (uint64_t point_count : point_counts)
+    {
+        ClipperLib::Path& path = *polygons.newPoly();
+        path.resize(point_count);
+        for (ClipperLib::IntPoint& point : path)
+        {
+            point.X = previous.X + value();
+            point.Y = previous.Y + value();
+            previous = point;
+        }
+    }
+}
+
+void VarintDecoder::polygonsList(std::vector<Polygons>& polygons_list)
+{
+    const uint64_t list_size = count();
+    if (!ok || list_size > size - pos)
+    {
+        ok = false;
+        return;
+    }
+    polygons_list.assign(list_size, Polygons());
+    for (Polygons& polygons : polygons_list)
+    {
+        this->polygons(polygons);
+    }
+}
+
+}//namespace cura
@@ -0,0 +1,97 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef UTILS_VARINT_CODER_H
+#define UTILS_VARINT_CODER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "polygon.h"
+
+namespace cura
+{
+
+/*!
+ * Writes counts and polygons compactly to a buffer, as variable length integers of 7 bits per byte.
+ *
+ * The points of polygons are stored as the difference with the previous point, zigzag encoded so that small negative differences are small as well.
+ * The points of walls, skin and infill areas are mostly close to each other, so most coordinates take one or two bytes instead of eight.
+ */
+class VarintEncoder
+{
+public:
+    std::string data; //!< The encoded values
+
+    /*!
+     * Write a non-negative number.
+     */
+    void count(uint64_t value);
+
+    /*!
+     * Write any number, zigzag encoded.
+     */
+    void value(int64_t value);
+
+    /*!
+     * Write polygons as their number of polygons, the number of points of each polygon and the difference of each point with the point before it.
+     */
+    void polygons(const Polygons& polygons);
+
+    /*!
+     * Write a list of polygons as its size and each of the polygons.
+     */
+    void polygonsList(const std::vector<Polygons>& polygons_list);
+};
+
+/*!
+ * Reads the values written by a VarintEncoder.
+ *
+ * Every read checks the end of the data; once one fails, VarintDecoder::ok is false and all further reads return zeroes.
+ */
+class VarintDecoder
+{
+public:
+    bool ok = true;
+
+    /*!
+     * \param data The encoded values
+     * \param size The number of bytes of \p data
+     */
+    VarintDecoder(const char* data, size_t size);
+
+    /*!
+     * Read a number written by VarintEncoder::count.
+     */
+    uint64_t count();
+
+    /*!
+     * Read a number written by VarintEncoder::value.
+     */
+    int64_t value();
+
+    /*!
+     * Read polygons written by VarintEncoder::polygons and add them to \p polygons.
+     */
+    void polygons(Polygons& polygons);
+
+    /*!
+     * Read a list of polygons written by VarintEncoder::polygonsList, replacing \p polygons_list.
+     */
+    void polygonsList(std::vector<Polygons>& polygons_list);
+
+    /*!
+     * Whether all data has been read.
+     */
+    bool atEnd() const
+    {
+        return pos == size;
+    }
+
+private:
+    const char* data;
+    size_t size;
+    size_t pos;
+};
+
+}//namespace cura
+#endif//UTILS_VARINT_CODER_H
@@ -0,0 +1,180 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "ZipArchive.h"
+
+#include <stdint.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "logoutput.h"
+#include "string.h"
+
+namespace cura
+{
+
+namespace
+{
+
+const uint32_t end_of_central_directory_signature = 0x06054b50;
+const uint32_t central_directory_header_signature = 0x02014b50;
+const uint32_t local_header_signature = 0x04034b50;
+const size_t end_of_central_directory_size = 22; //!< The size of the end of central directory record, without the comment
+const size_t central_directory_header_size = 46; //!< The size of a central directory header, without the name, extra field and comment
+const size_t local_header_size = 30; //!< The size of a local header, without the name and extra field
+const size_t max_comment_size = 0xffff;
+
+/*!
+ * Read a little endian number of \p byte_count bytes.
+ */
+uint32_t readLittleEndian(const char* data, unsigned int byte_count)
+{
+    uint32_t result = 0;
+    for (unsigned int byte_idx = 0; byte_idx < byte_count; byte_idx++)
+    {
+        result |= uint32_t(static_cast<unsigned char>(data[byte_idx])) << (byte_idx * 8);
+    }
+    return result;
+}
+
+} // anonymous namespace
+
+ZipArchive::ZipArchive(const char* data, size_t size)
+: data(data)
+, size(size)
+, valid(false)
+{
+    if (size < end_of_central_directory_size)
+    {
+        return;
+    }
+    // The end of central directory record is at the end of the archive, followed only by a comment.
+    size_t end_record = size - end_of_central_directory_size;
+    const size_t search_end = (end_record > max_comment_size) ? end_record - max_comment_size : 0;
+    while (readLittleEndian(data + end_record, 4) != end_of_central_directory_signature)
+    {
+        if (end_record == search_end)
+        {
+            return;
+        }
+        end_record--;
+    }
+    const size_t entry_count = readLittleEndian(data + end_record + 10, 2);
+    size_t header = readLittleEndian(data + end_record + 16, 4);
+
+    entries.reserve(entry_count);
+    for (size_t entry_idx = 0; entry_idx < entry_count; entry_idx++)
+    {
+        if (header + central_directory_header_size > size || readLittleEndian(data + header, 4) != central_directory_header_signature)
+        {
+            entries.clear();
+            return;
+        }
+        const size_t name_size = readLittleEndian(data + header + 28, 2);
+        const size_t extra_size = readLittleEndian(data + header + 30, 2);
+        const size_t comment_size = readLittleEndian(data + header + 32, 2);
+        if (header + central_directory_header_size + name_size > size)
+        {
+            entries.clear();
+            return;
+        }
+        Entry entry;
+        entry.name.assign(data + header + central_directory_header_size, name_size);
+        entry.compression_method = readLittleEndian(data + header + 10, 2);
+        entry.compressed_size = readLittleEndian(data + header + 20, 4);
+        entry.uncompressed_size = readLittleEndian(data + header + 24, 4);
+        entry.local_header_offset = readLittleEndian(data + header + 42, 4);
+        entries.push_back(std::move(entry));
+        header += central_directory_header_size + name_size + extra_size + comment_size;
+    }
+    valid = true;
+}
+
+const ZipArchive::Entry* ZipArchive::findEntry(const std::string& name) const
+{
+    const char* path = name.c_str();
+    while (*path == '/')
+    {
+        path++;
+    }
+    for (const Entry& entry : entries)
+    {
+        if (stringcasecompare(entry.name.c_str(), path) == 0) // package part names are case insensitive
+        {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+bool ZipArchive::hasEntry(const std::string& name) const
+{
+    return findEntry(name) != nullptr;
+}
+
+bool ZipArchive::getEntry(const std::string& name, std::vector<char>& buffer, const char*& entry_data, size_t& entry_size) const
+{
+    const Entry* entry = findEntry(name);
+    if (!entry)
+    {
+        return false;
+    }
+    const size_t header = entry->local_header_offset;
+    if (header + local_header_size > size || readLittleEndian(data + header, 4) != local_header_signature)
+    {
+        return false;
+    }
+    // The sizes in the local header may have been left out in favour of a data descriptor, so only its name and extra field sizes are used.
+    const size_t start = header + local_header_size + readLittleEndian(data + header + 26, 2) + readLittleEndian(data + header + 28, 2);
+    if (start > size || entry->compressed_size > size - start)
+    {
+        return false;
+    }
+
+    switch (entry->compression_method)
+    {
+    case 0: // stored
+        if (entry->compressed_size != entry->uncompressed_size)
+        {
+            return false;
+        }
+        entry_data = data + start;
+        entry_size = entry->compressed_size;
+        return true;
+    case 8: // deflated
+    {
+#ifdef HAVE_ZLIB
+        buffer.resize(entry->uncompressed_size);
+        z_stream stream;
+        stream.zalloc = Z_NULL;
+        stream.zfree = Z_NULL;
+        stream.opaque = Z_NULL;
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data + start));
+        stream.avail_in = entry->compressed_size;
+        if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) // negative window bits for raw deflate data without a zlib wrapper
+        {
+            return false;
+        }
+        stream.next_out = reinterpret_cast<Bytef*>(buffer.data());
+        stream.avail_out = buffer.size();
+        const int result = inflate(&stream, Z_FINISH);
+        const bool success = result == Z_STREAM_END && stream.total_out == entry->uncompressed_size;
+        inflateEnd(&stream);
+        if (!success)
+        {
+            return false;
+        }
+        entry_data = buffer.data();
+        entry_size = buffer.size();
+        return true;
+#else
+        logError("Cannot read the compressed entry %s: this build doesn't have zlib.\n", entry->name.c_str());
+        return false;
+#endif // HAVE_ZLIB
+    }
+    default:
+        logError("Unsupported compression method %u of entry %s.\n", entry->compression_method, entry->name.c_str());
+        return false;
+    }
+}
+
+}//namespace cura
@@ -0,0 +1,82 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef UTILS_ZIP_ARCHIVE_H
+#define UTILS_ZIP_ARCHIVE_H
+
+#include <cstddef> // size_t
+#include <string>
+#include <vector>
+
+#include "NoCopy.h"
+
+namespace cura
+{
+
+/*!
+ * Read-only access to the entries of a zip archive in memory, such as a 3MF package.
+ *
+ * Only stored and deflated entries are supported, and deflated entries only when building with zlib.
+ * Zip64 archives, which are only needed for entries of over 4 GB, aren't supported.
+ */
+class ZipArchive : NoCopy
+{
+public:
+    /*!
+     * Read the central directory of the archive.
+     *
+     * \param data The contents of the archive, which should outlive this object
+     * \param size The number of bytes in \p data
+     */
+    ZipArchive(const char* data, size_t size);
+
+    /*!
+     * Whether the central directory could be read.
+     */
+    bool isValid() const
+    {
+        return valid;
+    }
+
+    /*!
+     * Whether the archive has an entry with the given name.
+     */
+    bool hasEntry(const std::string& name) const;
+
+    /*!
+     * Get the contents of an entry.
+     *
+     * A stored entry is returned directly from the archive data, a deflated one is decompressed into \p buffer.
+     *
+     * \param name The full path of the entry in the archive, without a leading slash
+     * \param buffer Where to decompress the entry to, if needed
+     * \param[out] entry_data The contents of the entry
+     * \param[out] entry_size The number of bytes in \p entry_data
+     * \return Whether the entry exists and could be read
+     */
+    bool getEntry(const std::string& name, std::vector<char>& buffer, const char*& entry_data, size_t& entry_size) const;
+
+private:
+    /*!
+     * The location of an entry in the archive.
+     */
+    struct Entry
+    {
+        std::string name; //!< The full path of the entry
+        unsigned int compression_method; //!< 0 for stored, 8 for deflated
+        size_t compressed_size; //!< The number of bytes of the entry in the archive
+        size_t uncompressed_size; //!< The number of bytes of the contents of the entry
+        size_t local_header_offset; //!< Where the local header preceding the entry data starts
+    };
+
+    const char* data; //!< The contents of the archive
+    size_t size; //!< The number of bytes in \ref ZipArchive::data
+    bool valid; //!< Whether the central directory could be read
+    std::vector<Entry> entries; //!< The entries in the central directory
+
+    /*!
+     * Find an entry by name, or return nullptr.
+     */
+    const Entry* findEntry(const std::string& name) const;
+};
+
+}//namespace cura
+#endif//UTILS_ZIP_ARCHIVE_H
@@ -0,0 +1,124 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "allocatorTuning.h"
+
+#if defined(ALLOCATOR_JEMALLOC)
+#include <mutex>
+#include <vector>
+#include <jemalloc/jemalloc.h>
+#elif defined(ALLOCATOR_MIMALLOC)
+#include <mimalloc.h>
+#elif defined(ALLOCATOR_TCMALLOC)
+#include <cstddef> // size_t
+#include <gperftools/malloc_extension.h>
+#endif
+
+#define ALLOCATOR_STRINGIFY_(value) #value
+#define ALLOCATOR_STRINGIFY(value) ALLOCATOR_STRINGIFY_(value)
+
+#ifdef ALLOCATOR_JEMALLOC
+// read by jemalloc when it initializes, before main; the MALLOC_CONF environment variable still overrides it
+const char* malloc_conf = "background_thread:true,dirty_decay_ms:" ALLOCATOR_STRINGIFY(ALLOCATOR_DECAY_MS) ",muzzy_decay_ms:" ALLOCATOR_STRINGIFY(ALLOCATOR_DECAY_MS);
+#endif
+
+namespace cura {
+
+#ifdef ALLOCATOR_JEMALLOC
+namespace
+{
+
+/*!
+ * The arenas created for worker threads which have exited since.
+ */
+struct FreeArenas
+{
+    std::mutex mutex;
+    std::vector<unsigned int> arena_indices;
+};
+
+FreeArenas& getFreeArenas()
+{
+    static FreeArenas* free_arenas = new FreeArenas(); // never destroyed, since the workers of the static ThreadPool exit after static destruction has started
+    return *free_arenas;
+}
+
+/*!
+ * The arena of a worker thread, which is handed back for reuse when the thread exits.
+ */
+struct ThreadArena
+{
+    bool assigned = false;
+    unsigned int arena_idx = 0;
+
+    ~ThreadArena()
+    {
+        if (assigned)
+        {
+            FreeArenas& free_arenas = getFreeArenas();
+            std::lock_guard<std::mutex> lock(free_arenas.mutex);
+            free_arenas.arena_indices.push_back(arena_idx);
+        }
+    }
+};
+
+thread_local ThreadArena thread_arena;
+
+}//namespace
+#endif
+
+const char* getAllocatorName()
+{
+#if defined(ALLOCATOR_JEMALLOC)
+    return "jemalloc";
+#elif defined(ALLOCATOR_MIMALLOC)
+    return "mimalloc";
+#elif defined(ALLOCATOR_TCMALLOC)
+    return "tcmalloc";
+#else
+    return "system";
+#endif
+}
+
+void tuneAllocator(unsigned int thread_count)
+{
+#if defined(ALLOCATOR_MIMALLOC)
+    (void)thread_count; // mimalloc has a heap per thread
+    mi_option_set(mi_option_reset_delay, ALLOCATOR_DECAY_MS);
+#elif defined(ALLOCATOR_TCMALLOC)
+    constexpr size_t thread_cache_bytes = 16 << 20; // the default total of 32MB is too little for many threads churning through small paths
+    MallocExtension::instance()->SetNumericProperty("tcmalloc.max_total_thread_cache_bytes", thread_count * thread_cache_bytes);
+#else
+    (void)thread_count;
+#endif
+}
+
+void tuneAllocatorForThread()
+{
+#ifdef ALLOCATOR_JEMALLOC
+    if (thread_arena.assigned)
+    {
+        return;
+    }
+    {
+        FreeArenas& free_arenas = getFreeArenas();
+        std::lock_guard<std::mutex> lock(free_arenas.mutex);
+        if (!free_arenas.arena_indices.empty())
+        {
+            thread_arena.arena_idx = free_arenas.arena_indices.back();
+            free_arenas.arena_indices.pop_back();
+            thread_arena.assigned = true;
+        }
+    }
+    if (!thread_arena.assigned)
+    {
+        size_t size = sizeof(thread_arena.arena_idx);
+        if (mallctl("arenas.create", &thread_arena.arena_idx, &size, nullptr, 0) != 0)
+        {
+            return; // keep using the arenas jemalloc assigns
+        }
+        thread_arena.assigned = true;
+    }
+    mallctl("thread.arena", nullptr, nullptr, &thread_arena.arena_idx, sizeof(thread_arena.arena_idx));
+#endif
+}
+
+}//namespace cura
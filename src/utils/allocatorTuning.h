@@ -0,0 +1,34 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef UTILS_ALLOCATOR_TUNING_H
+#define UTILS_ALLOCATOR_TUNING_H
+
+namespace cura {
+
+/*!
+ * The malloc implementation CuraEngine is linked with, as chosen with the ALLOCATOR CMake option: "system", "jemalloc", "mimalloc" or "tcmalloc".
+ */
+const char* getAllocatorName();
+
+/*!
+ * Tune the allocator for the number of threads computing in parallel.
+ *
+ * With tcmalloc this sizes the thread caches together, so that each thread keeps an equal share.
+ * jemalloc gets its decay time and background purging from the compiled in malloc_conf, and mimalloc its delay before purging from here.
+ * Has no effect with the system allocator.
+ *
+ * \param thread_count The number of threads of the ThreadPool, including the calling thread
+ */
+void tuneAllocator(unsigned int thread_count);
+
+/*!
+ * Tune the allocator for the calling worker thread, before it allocates anything.
+ *
+ * With jemalloc this gives the thread an arena of its own, so that the threads don't contend for the same arenas.
+ * The arena is handed to the next worker thread when this one exits.
+ * The other allocators already keep their memory per thread.
+ */
+void tuneAllocatorForThread();
+
+}//namespace cura
+
+#endif//UTILS_ALLOCATOR_TUNING_H
@@ -5,14 +5,15 @@ namespace cura
 {
     
 TimeKeeper::TimeKeeper()
+: startTime(getTime())
 {
-    restart();
 }
 
 double TimeKeeper::restart()
 {
-    double ret = getTime() - startTime;
-    startTime = getTime();
+    const double now = getTime();
+    const double ret = now - startTime;
+    startTime = now;
     return ret;
 }
 
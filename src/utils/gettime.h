@@ -2,39 +2,41 @@
 #ifndef GETTIME_H
 #define GETTIME_H
 
-#ifdef __WIN32
-    #include <windows.h>
-#else
-    #ifdef USE_CPU_TIME
-    #include <sys/resource.h>
-#endif
-
-#include <sys/time.h>
-#include <stddef.h>
-#include <cassert>
-#endif
+#include <chrono>
+#include <time.h> // clock_gettime
 
 namespace cura
 {
+/*!
+ * The time in seconds since some fixed moment, from a monotonic high resolution clock,
+ * or the processor time used by the engine when built with USE_CPU_TIME.
+ */
 static inline double getTime()
 {
+#if USE_CPU_TIME && !defined(__WIN32)
+    timespec time;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+    return double(time.tv_sec) + double(time.tv_nsec) / 1000000000.0;
+#else
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/*!
+ * The processor time used by the calling thread, in seconds, or zero where it can't be measured.
+ */
+static inline double getThreadCpuTime()
+{
 #ifdef __WIN32
-    return double(GetTickCount()) / 1000.0;
-#else // not __WIN32
- #if USE_CPU_TIME // Use cpu usage time if available, otherwise wall clock time
-    int ret;
-    struct rusage usage;
-    ret = getrusage(RUSAGE_SELF,&usage);
-    assert(ret==0);
-    double user_time =  double(usage.ru_utime.tv_sec) + double(usage.ru_utime.tv_usec) / 1000000.0;
-    double sys_time  =  double(usage.ru_stime.tv_sec) + double(usage.ru_stime.tv_usec) / 1000000.0;
-    return user_time + sys_time;
- #else // not USE_CPU_TIME
-    struct timeval tv;
-    gettimeofday(&tv, nullptr);
-    return double(tv.tv_sec) + double(tv.tv_usec) / 1000000.0;
- #endif // USE_CPU_TIME
-#endif // __WIN32
+    return 0.0;
+#else
+    timespec time;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0)
+    {
+        return 0.0;
+    }
+    return double(time.tv_sec) + double(time.tv_nsec) / 1000000000.0;
+#endif
 }
 
 class TimeKeeper
@@ -0,0 +1,60 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "hugePages.h"
+
+#include <cstdint> // uintptr_t
+#include <cstdlib> // getenv
+#include <cstring> // strcmp
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace cura {
+
+namespace
+{
+constexpr size_t huge_page_size = 2 << 20; // the size of a huge page on x86-64 and on most configurations of ARM64
+}
+
+bool useHugePages()
+{
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    static const bool use_huge_pages = []()
+        {
+            const char* setting = std::getenv("CURA_ENGINE_HUGE_PAGES");
+            return setting && std::strcmp(setting, "1") == 0;
+        }();
+    return use_huge_pages;
+#else
+    return false;
+#endif
+}
+
+void adviseHugePages(void* data, size_t size)
+{
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if (!useHugePages() || size < huge_page_size)
+    {
+        return;
+    }
+    // madvise only applies to whole pages, and huge pages only to the aligned blocks of huge page size
+    const uintptr_t begin = (reinterpret_cast<uintptr_t>(data) + huge_page_size - 1) & ~uintptr_t(huge_page_size - 1);
+    const uintptr_t end = (reinterpret_cast<uintptr_t>(data) + size) & ~uintptr_t(huge_page_size - 1);
+    if (begin >= end)
+    {
+        return;
+    }
+    if (madvise(reinterpret_cast<void*>(begin), end - begin, MADV_HUGEPAGE) != 0)
+    { // transparent huge pages are disabled, so normal pages are used
+        return;
+    }
+ #ifdef MADV_POPULATE_WRITE
+    madvise(reinterpret_cast<void*>(begin), end - begin, MADV_POPULATE_WRITE); // before linux 5.14 the pages are faulted in when they're filled
+ #endif
+#else
+    (void)data;
+    (void)size;
+#endif
+}
+
+}//namespace cura
@@ -0,0 +1,47 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef UTILS_HUGE_PAGES_H
+#define UTILS_HUGE_PAGES_H
+
+#include <cstddef> // size_t
+#include <vector>
+
+namespace cura {
+
+/*!
+ * Whether the large arrays of meshes and of the slicer are backed by transparent huge pages.
+ *
+ * The slicer looks up the vertices of the faces and the faces of the layers all over arrays of many megabytes,
+ * which on large meshes misses the TLB for nearly every lookup with pages of 4 kB.
+ * Enabled by setting the environment variable CURA_ENGINE_HUGE_PAGES to 1, since huge pages may take more memory
+ * and the kernel may spend time on compacting memory to find them.
+ */
+bool useHugePages();
+
+/*!
+ * Ask the kernel to back the whole huge pages within a buffer with huge pages and fault them in right away,
+ * so that filling the buffer front to back doesn't fault on every page. Does nothing if huge pages aren't used,
+ * and falls back to normal pages where the kernel doesn't support huge pages or has none available.
+ *
+ * Only the pages which haven't been touched yet are given huge pages right away, so it should be called on fresh memory.
+ *
+ * \param data The start of the buffer
+ * \param size The size of the buffer in bytes
+ */
+void adviseHugePages(void* data, size_t size);
+
+/*!
+ * Reserve the memory of an empty vector backed by huge pages, see adviseHugePages.
+ *
+ * \param vector The vector, which shouldn't have any memory yet
+ * \param capacity The number of elements to reserve
+ */
+template<typename T>
+void reserveHugePages(std::vector<T>& vector, size_t capacity)
+{
+    vector.reserve(capacity);
+    adviseHugePages(vector.data(), vector.capacity() * sizeof(T));
+}
+
+}//namespace cura
+
+#endif//UTILS_HUGE_PAGES_H
@@ -277,6 +277,25 @@ public:
         return Point(p.X * matrix[0] + p.Y * matrix[1], p.X * matrix[2] + p.Y * matrix[3]);
     }
 
+    /*!
+     * The x-coordinate of PointMatrix::apply(p).
+     */
+    int64_t applyX(const Point p) const
+    {
+        return p.X * matrix[0] + p.Y * matrix[1];
+    }
+
+    /*!
+     * The y-coordinate of PointMatrix::apply(p).
+     * 
+     * Testing whether a segment crosses a scanline only needs the y-coordinates of its end points,
+     * so the x-coordinates only need to be transformed for the segments which do cross it.
+     */
+    int64_t applyY(const Point p) const
+    {
+        return p.X * matrix[2] + p.Y * matrix[3];
+    }
+
     Point unapply(const Point p) const
     {
         return Point(p.X * matrix[0] + p.Y * matrix[2], p.X * matrix[1] + p.Y * matrix[3]);
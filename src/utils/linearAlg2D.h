@@ -209,6 +209,18 @@ public:
      * \return the angle in radians between 0 and 2 * pi of the corner in \p b
      */
     static float getAngleLeft(const Point& a, const Point& b, const Point& c);
+
+    /*!
+     * Compute the lengths of the line segments of a polyline, in millimeters.
+     * 
+     * Gives the same lengths as vSizeMM for each segment, but computes two segments at a time where SSE2 is available.
+     * 
+     * \param start The point from which the first segment starts
+     * \param points The end points of the segments
+     * \param point_count The number of segments
+     * \param lengths (output) The lengths of the segments, one for each point
+     */
+    static void getSegmentLengthsMM(Point start, const Point* points, unsigned int point_count, double* lengths);
 };
 
 
@@ -1,6 +1,14 @@
 /** Copyright (C) 2013 David Braam - Released under terms of the AGPLv3 License */
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
+#include <algorithm> // min
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "logoutput.h"
 
@@ -9,6 +17,131 @@ namespace cura {
 static int verbose_level;
 static bool progressLogging;
 
+namespace
+{
+
+/*!
+ * Writes the log messages to stderr.
+ *
+ * Informational messages are written by a background thread, so that the threads which log them don't wait for the terminal.
+ * Errors and warnings are written right away, after the informational messages logged before them.
+ */
+class LogWriter
+{
+public:
+    static LogWriter& getInstance()
+    {
+        static LogWriter instance;
+        return instance;
+    }
+
+    /*!
+     * Write a message to stderr.
+     *
+     * \param message The complete message
+     * \param length The number of characters of \p message
+     * \param synchronous Whether the message has to be written before returning
+     */
+    void write(const char* message, size_t length, bool synchronous)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        pending.append(message, length);
+        if (!synchronous && pending.size() < max_pending_size)
+        {
+            if (!thread.joinable())
+            {
+                thread = std::thread(&LogWriter::run, this);
+            }
+            has_pending.notify_one();
+            return;
+        }
+        batch_written.wait(lock, [this]() { return !writing; }); // the batch being written was logged before this message
+        fwrite(pending.data(), 1, pending.size(), stderr);
+        fflush(stderr);
+        pending.clear();
+    }
+
+    ~LogWriter()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        has_pending.notify_one();
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+
+private:
+    static constexpr size_t max_pending_size = 1 << 20; //!< When more is pending the loggers wait for the terminal after all, rather than using ever more memory
+
+    std::mutex mutex;
+    std::condition_variable has_pending; //!< Notified when a message is added to LogWriter::pending or when stopping
+    std::condition_variable batch_written; //!< Notified when the background thread has written a batch of messages
+    std::string pending; //!< The messages which have been logged but not yet written
+    bool writing = false; //!< Whether the background thread is writing a batch of messages
+    bool stopping = false; //!< Whether the background thread should stop once nothing is pending
+    std::thread thread; //!< The background thread, started when the first informational message is logged
+
+    void run()
+    {
+        std::string batch;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            has_pending.wait(lock, [this]() { return !pending.empty() || stopping; });
+            if (pending.empty())
+            {
+                return;
+            }
+            batch.swap(pending);
+            writing = true;
+            lock.unlock();
+            fwrite(batch.data(), 1, batch.size(), stderr);
+            fflush(stderr);
+            batch.clear();
+            lock.lock();
+            writing = false;
+            batch_written.notify_all();
+        }
+    }
+};
+
+/*!
+ * Format a message and write it to stderr in one go, so that the messages of different threads don't interleave.
+ *
+ * \param prefix What to write before the formatted message
+ * \param synchronous Whether the message has to be written before returning
+ */
+void logMessage(const char* prefix, bool synchronous, const char* fmt, va_list args)
+{
+    thread_local std::vector<char> buffer(256); // reused by the next message formatted on this thread
+    const size_t prefix_length = strlen(prefix);
+    if (buffer.size() <= prefix_length)
+    {
+        buffer.resize(prefix_length + 256);
+    }
+    memcpy(buffer.data(), prefix, prefix_length);
+    va_list args_copy;
+    va_copy(args_copy, args);
+    int length = vsnprintf(buffer.data() + prefix_length, buffer.size() - prefix_length, fmt, args_copy);
+    va_end(args_copy);
+    if (length < 0)
+    {
+        return;
+    }
+    if (prefix_length + length >= buffer.size())
+    {
+        buffer.resize(prefix_length + length + 1);
+        vsnprintf(buffer.data() + prefix_length, buffer.size() - prefix_length, fmt, args);
+    }
+    LogWriter::getInstance().write(buffer.data(), prefix_length + length, synchronous);
+}
+
+}//namespace
+
 void increaseVerboseLevel()
 {
     verbose_level++;
@@ -23,29 +156,24 @@ void logError(const char* fmt, ...)
 {
     va_list args;
     va_start(args, fmt);
-    fprintf(stderr, "[ERROR] ");
-    vfprintf(stderr, fmt, args);
+    logMessage("[ERROR] ", true, fmt, args);
     va_end(args);
-    fflush(stderr);
 }
 
 void logWarning(const char* fmt, ...)
 {
     va_list args;
     va_start(args, fmt);
-    fprintf(stderr, "[WARNING] ");
-    vfprintf(stderr, fmt, args);
+    logMessage("[WARNING] ", true, fmt, args);
     va_end(args);
-    fflush(stderr);
 }
 
 void logCopyright(const char* fmt, ...)
 {
     va_list args;
     va_start(args, fmt);
-    vfprintf(stderr, fmt, args);
+    logMessage("", true, fmt, args);
     va_end(args);
-    fflush(stderr);
 }
 
 void log(const char* fmt, ...)
@@ -55,9 +183,8 @@ void log(const char* fmt, ...)
 
     va_list args;
     va_start(args, fmt);
-    vfprintf(stderr, fmt, args);
+    logMessage("", false, fmt, args);
     va_end(args);
-    fflush(stderr);
 }
 
 void logDebug(const char* fmt, ...)
@@ -68,10 +195,8 @@ void logDebug(const char* fmt, ...)
     }
     va_list args;
     va_start(args, fmt);
-    fprintf(stderr, "[DEBUG] ");
-    vfprintf(stderr, fmt, args);
+    logMessage("[DEBUG] ", false, fmt, args);
     va_end(args);
-    fflush(stderr);
 }
 
 void logProgress(const char* type, int value, int maxValue, float percent)
@@ -79,8 +204,30 @@ void logProgress(const char* type, int value, int maxValue, float percent)
     if (!progressLogging)
         return;
 
-    fprintf(stderr, "Progress:%s:%i:%i \t%f%%\n", type, value, maxValue, percent);
-    fflush(stderr);
+    // Progress is reported for every layer of every stage, far more often than it can be shown.
+    // Only report it when a stage starts or ends, or when the last report is a while ago.
+    constexpr std::chrono::milliseconds min_interval(100);
+    static std::mutex progress_mutex;
+    static std::string last_type;
+    static std::chrono::steady_clock::time_point last_time;
+    {
+        std::lock_guard<std::mutex> lock(progress_mutex);
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (value < maxValue && last_type == type && now - last_time < min_interval)
+        {
+            return;
+        }
+        last_type = type;
+        last_time = now;
+    }
+
+    char message[256];
+    int length = snprintf(message, sizeof(message), "Progress:%s:%i:%i \t%f%%\n", type, value, maxValue, percent);
+    if (length < 0)
+    {
+        return;
+    }
+    LogWriter::getInstance().write(message, std::min(size_t(length), sizeof(message) - 1), false);
 }
 
 }//namespace cura
@@ -0,0 +1,33 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include "memoryRelease.h"
+
+#include <cstdlib> // defines __GLIBC__ when built with glibc
+#if defined(ALLOCATOR_JEMALLOC)
+#include <cstdio> // snprintf
+#include <jemalloc/jemalloc.h>
+#elif defined(ALLOCATOR_MIMALLOC)
+#include <mimalloc.h>
+#elif defined(ALLOCATOR_TCMALLOC)
+#include <gperftools/malloc_extension.h>
+#elif defined(__GLIBC__)
+#include <malloc.h> // malloc_trim
+#endif
+
+namespace cura {
+
+void releaseFreedMemory()
+{
+#if defined(ALLOCATOR_JEMALLOC)
+    char purge_all_arenas[32];
+    std::snprintf(purge_all_arenas, sizeof(purge_all_arenas), "arena.%u.purge", static_cast<unsigned int>(MALLCTL_ARENAS_ALL));
+    mallctl(purge_all_arenas, nullptr, nullptr, nullptr, 0);
+#elif defined(ALLOCATOR_MIMALLOC)
+    mi_collect(true);
+#elif defined(ALLOCATOR_TCMALLOC)
+    MallocExtension::instance()->ReleaseFreeMemory();
+#elif defined(__GLIBC__)
+    malloc_trim(0);
+#endif
+}
+
+}//namespace cura
@@ -0,0 +1,19 @@
+/** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef UTILS_MEMORY_RELEASE_H
+#define UTILS_MEMORY_RELEASE_H
+
+namespace cura {
+
+/*!
+ * Give the memory which has been freed back to the operating system, as far as the allocator allows it.
+ *
+ * The sliced data consists of millions of small allocations, which the allocator keeps for reuse after they are freed,
+ * so without this the resident memory stays at its peak long after the layers or the whole mesh group have been released.
+ * Purges jemalloc, mimalloc or tcmalloc when CuraEngine is linked with one of them, and trims the heap of glibc otherwise,
+ * which can also release the pages of free memory in between allocations which are still live.
+ */
+void releaseFreedMemory();
+
+}//namespace cura
+
+#endif//UTILS_MEMORY_RELEASE_H
@@ -1,11 +1,165 @@
 /** Copyright (C) 2015 Ultimaker - Released under terms of the AGPLv3 License */
 #include "polygon.h"
 
+#include <iterator> // make_move_iterator
+#include <limits>
+#include <unordered_map>
+
 #include "linearAlg2D.h" // pointLiesOnTheRightOfLine
+#include "math.h" // round_up_divide
+#include "ThreadPool.h"
 
 namespace cura 
 {
 
+namespace
+{
+
+/*!
+ * Hashes the cells of a grid, given as the coordinates of the cell.
+ */
+struct CellHash
+{
+    size_t operator()(const std::pair<int64_t, int64_t>& cell) const
+    {
+        return std::hash<int64_t>()(cell.first * 73856093 ^ cell.second * 19349663);
+    }
+};
+
+/*!
+ * The coordinate of the cell of size \p cell_size which contains \p coordinate, rounding down for negative coordinates too.
+ */
+int64_t cellCoordinate(int64_t coordinate, int64_t cell_size)
+{
+    return (coordinate >= 0) ? coordinate / cell_size : -((-coordinate - 1) / cell_size) - 1;
+}
+
+constexpr unsigned int max_tiling_depth = 12; // at most 4096 tiles, so that a dense cluster of points doesn't split the plane endlessly
+
+/*!
+ * A rectangular tile of the plane, see Polygons::tiledOperation.
+ */
+struct Tile
+{
+    ClipperLib::cInt min_x, min_y, max_x, max_y;
+
+    Tile expanded(ClipperLib::cInt margin) const
+    {
+        return Tile{min_x - margin, min_y - margin, max_x + margin, max_y + margin};
+    }
+
+    ClipperLib::Path path() const
+    {
+        return { ClipperLib::IntPoint(min_x, min_y), ClipperLib::IntPoint(max_x, min_y), ClipperLib::IntPoint(max_x, max_y), ClipperLib::IntPoint(min_x, max_y) };
+    }
+};
+
+size_t countPoints(const ClipperLib::Paths& paths)
+{
+    size_t point_count = 0;
+    for (const ClipperLib::Path& path : paths)
+    {
+        point_count += path.size();
+    }
+    return point_count;
+}
+
+Tile boundingTile(const ClipperLib::Paths& paths)
+{
+    Tile tile{std::numeric_limits<ClipperLib::cInt>::max(), std::numeric_limits<ClipperLib::cInt>::max(), std::numeric_limits<ClipperLib::cInt>::min(), std::numeric_limits<ClipperLib::cInt>::min()};
+    for (const ClipperLib::Path& path : paths)
+    {
+        for (const ClipperLib::IntPoint& point : path)
+        {
+            tile.min_x = std::min(tile.min_x, point.X);
+            tile.min_y = std::min(tile.min_y, point.Y);
+            tile.max_x = std::max(tile.max_x, point.X);
+            tile.max_y = std::max(tile.max_y, point.Y);
+        }
+    }
+    return tile;
+}
+
+void clipToTile(const ClipperLib::Paths& paths, const Tile& tile, ClipperLib::Paths& result)
+{
+    ClipperLib::Clipper clipper(clipper_init);
+    clipper.AddPaths(paths, ClipperLib::ptSubject, true);
+    clipper.AddPath(tile.path(), ClipperLib::ptClip, true);
+    clipper.Execute(ClipperLib::ctIntersection, result);
+}
+
+/*!
+ * Split a tile in halves until the polygons within each tile have few enough points, and apply an operation to the polygons within each tile.
+ *
+ * \param subject The subject polygons within the tile and its margin
+ * \param clip The clip polygons within the tile and its margin
+ * \param tile The tile
+ * \param margin The distance around a tile of which the polygons are needed to compute the operation within the tile
+ * \param max_tile_point_count The number of points up to which a tile is computed at once
+ * \param depth The number of times the plane has been split to get to this tile
+ * \param operation Computes the result of the subject and clip polygons, which is clipped to the tile if there is a margin
+ * \param[out] tile_results The results of the tiles are added to this, in the order of the tiles, so that the result doesn't depend on the threads
+ */
+template<typename Operation>
+void computeTiles(const ClipperLib::Paths& subject, const ClipperLib::Paths& clip, const Tile& tile, ClipperLib::cInt margin, size_t max_tile_point_count, unsigned int depth, const Operation& operation, ClipperLib::Paths& tile_results)
+{
+    const ClipperLib::cInt width = tile.max_x - tile.min_x;
+    const ClipperLib::cInt height = tile.max_y - tile.min_y;
+    if (countPoints(subject) + countPoints(clip) <= max_tile_point_count || depth >= max_tiling_depth || std::max(width, height) < 4 * margin + 2)
+    {
+        ClipperLib::Paths result;
+        operation(subject, clip, result);
+        if (margin > 0)
+        {
+            ClipperLib::Paths clipped;
+            clipToTile(result, tile, clipped);
+            result.swap(clipped);
+        }
+        tile_results.insert(tile_results.end(), std::make_move_iterator(result.begin()), std::make_move_iterator(result.end()));
+        return;
+    }
+    Tile halves[2] = { tile, tile };
+    if (width >= height)
+    {
+        halves[0].max_x = halves[1].min_x = tile.min_x + width / 2;
+    }
+    else
+    {
+        halves[0].max_y = halves[1].min_y = tile.min_y + height / 2;
+    }
+    ClipperLib::Paths half_results[2];
+    ThreadPool::getInstance()->parallelFor(0, 2, [&](int half_idx)
+        {
+            const Tile with_margin = halves[half_idx].expanded(margin);
+            ClipperLib::Paths half_subject;
+            ClipperLib::Paths half_clip;
+            clipToTile(subject, with_margin, half_subject);
+            if (!clip.empty())
+            {
+                clipToTile(clip, with_margin, half_clip);
+            }
+            computeTiles(half_subject, half_clip, halves[half_idx], margin, max_tile_point_count, depth + 1, operation, half_results[half_idx]);
+        });
+    for (ClipperLib::Paths& half_result : half_results)
+    {
+        tile_results.insert(tile_results.end(), std::make_move_iterator(half_result.begin()), std::make_move_iterator(half_result.end()));
+    }
+}
+
+/*!
+ * Unite the results of the tiles along the seams between them.
+ */
+void uniteTiles(const ClipperLib::Paths& tile_results, ClipperLib::Paths& result)
+{
+    ClipperLib::Clipper clipper(clipper_init);
+    clipper.AddPaths(tile_results, ClipperLib::ptSubject, true);
+    clipper.Execute(ClipperLib::ctUnion, result, ClipperLib::pftNonZero, ClipperLib::pftNonZero);
+}
+
+}
+
+size_t Polygons::tiling_point_count = 0;
+
 bool PolygonRef::shorterThan(int64_t check_length) const
 {
     const PolygonRef& polygon = *this;
@@ -147,13 +301,146 @@ unsigned int Polygons::findInside(Point p, bool border_result)
 Polygons PolygonRef::offset(int distance, ClipperLib::JoinType joinType, double miter_limit) const
 {
     Polygons ret;
+    LayerArena::Temporaries temporaries;
     ClipperLib::ClipperOffset clipper(miter_limit, 10.0);
+    CLIPPER_RANGE_ASSERT(*path, std::abs(distance));
     clipper.AddPath(*path, joinType, ClipperLib::etClosedPolygon);
     clipper.MiterLimit = miter_limit;
-    clipper.Execute(ret.paths, distance);
+    ClipperLib::Paths result;
+    clipper.Execute(result, distance);
+    temporaries.keep(result, ret.paths);
     return ret;
 }
 
+void Polygons::offsetMulti(const std::vector<int>& distances, std::vector<Polygons>& results, ClipperLib::JoinType joinType, double miter_limit) const
+{
+    results.reserve(results.size() + distances.size()); // outside of the arena
+    LayerArena::Temporaries temporaries;
+    ClipperLib::ClipperOffset clipper(miter_limit, 10.0);
+#ifdef ASSERT_CLIPPER_LOW_RANGE
+    for (int distance : distances)
+    {
+        CLIPPER_RANGE_ASSERT(paths, std::abs(distance));
+    }
+#endif
+    clipper.AddPaths(paths, joinType, ClipperLib::etClosedPolygon);
+    clipper.MiterLimit = miter_limit;
+    ClipperLib::Paths result;
+    for (int distance : distances)
+    {
+        clipper.Execute(result, distance);
+        if (result.empty())
+        {
+            break;
+        }
+        results.emplace_back();
+        temporaries.keep(result, results.back().paths);
+        result.clear();
+    }
+}
+
+bool Polygons::inClipperLowRange(const ClipperLib::Paths& paths, int64_t margin)
+{
+    for (const ClipperLib::Path& path : paths)
+    {
+        if (!inClipperLowRange(path, margin))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Polygons::inClipperLowRange(const ClipperLib::Path& path, int64_t margin)
+{
+    const ClipperLib::cInt limit = clipper_low_range - margin;
+    for (const Point& p : path)
+    {
+        if (p.X > limit || p.X < -limit || p.Y > limit || p.Y < -limit)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Polygons::batchOperation(ClipperLib::ClipType operation, const std::vector<std::pair<const Polygons*, const Polygons*>>& operands, std::vector<Polygons>& results)
+{
+    results.clear();
+    results.resize(operands.size());
+    if (operands.empty())
+    {
+        return;
+    }
+    ThreadPool* pool = ThreadPool::getInstance();
+    const unsigned int block_size = round_up_divide(operands.size(), pool->getThreadCount() * 4); // a few blocks per thread, to balance the load
+    const unsigned int block_count = round_up_divide(operands.size(), block_size);
+    const ClipperLib::PolyType clip_type = (operation == ClipperLib::ctUnion) ? ClipperLib::ptSubject : ClipperLib::ptClip;
+    const ClipperLib::PolyFillType fill_type = (operation == ClipperLib::ctUnion) ? ClipperLib::pftNonZero : ClipperLib::pftEvenOdd;
+    pool->parallelFor(0, block_count, [&](int block_idx)
+    {
+        // the Clipper keeps the buffers of its work lists from pair to pair, so the scope covers the whole block
+        LayerArena::Temporaries temporaries;
+        ClipperLib::Clipper clipper(clipper_init);
+        ClipperLib::Paths result;
+        const unsigned int block_end = std::min<unsigned int>((block_idx + 1) * block_size, operands.size());
+        for (unsigned int pair_idx = block_idx * block_size; pair_idx < block_end; pair_idx++)
+        {
+            CLIPPER_RANGE_ASSERT(operands[pair_idx].first->paths, 0);
+            CLIPPER_RANGE_ASSERT(operands[pair_idx].second->paths, 0);
+            clipper.AddPaths(operands[pair_idx].first->paths, ClipperLib::ptSubject, true);
+            clipper.AddPaths(operands[pair_idx].second->paths, clip_type, true);
+            clipper.Execute(operation, result, fill_type, fill_type);
+            temporaries.keep(result, results[pair_idx].paths);
+            result.clear();
+            clipper.Clear();
+        }
+    });
+}
+
+void Polygons::tiledOperation(ClipperLib::ClipType operation, const Polygons& other, Polygons& result, size_t max_tile_point_count) const
+{
+    CLIPPER_RANGE_ASSERT(paths, 0);
+    CLIPPER_RANGE_ASSERT(other.paths, 0);
+    ClipperLib::Paths tile_results;
+    if (!paths.empty())
+    { // the result lies within these polygons for both operations
+        computeTiles(paths, other.paths, boundingTile(paths), 0, std::max<size_t>(1, max_tile_point_count), 0,
+            [operation](const ClipperLib::Paths& subject, const ClipperLib::Paths& clip, ClipperLib::Paths& tile_result)
+            {
+                ClipperLib::Clipper clipper(clipper_init);
+                clipper.AddPaths(subject, ClipperLib::ptSubject, true);
+                clipper.AddPaths(clip, ClipperLib::ptClip, true);
+                clipper.Execute(operation, tile_result);
+            }, tile_results);
+    }
+    ClipperLib::Paths united;
+    uniteTiles(tile_results, united);
+    result.paths.swap(united);
+}
+
+void Polygons::tiledOffset(int distance, Polygons& result, size_t max_tile_point_count, ClipperLib::JoinType joinType, double miter_limit) const
+{
+    CLIPPER_RANGE_ASSERT(paths, std::abs(distance));
+    // the corners of the offset reach at most the miter limit times the distance from the polygons, or the square root of two for square joins
+    const ClipperLib::cInt margin = std::llround(std::abs(distance) * std::max(2.0, miter_limit)) + 10;
+    ClipperLib::Paths tile_results;
+    if (!paths.empty())
+    {
+        computeTiles(paths, ClipperLib::Paths(), boundingTile(paths).expanded(margin), margin, std::max<size_t>(1, max_tile_point_count), 0,
+            [distance, joinType, miter_limit](const ClipperLib::Paths& subject, const ClipperLib::Paths&, ClipperLib::Paths& tile_result)
+            {
+                ClipperLib::ClipperOffset clipper(miter_limit, 10.0);
+                clipper.AddPaths(subject, joinType, ClipperLib::etClosedPolygon);
+                clipper.MiterLimit = miter_limit;
+                clipper.Execute(tile_result, distance);
+            }, tile_results);
+    }
+    ClipperLib::Paths united;
+    uniteTiles(tile_results, united);
+    result.paths.swap(united);
+}
+
 Polygon Polygons::convexHull() const
 {
     // Implements Andrew's monotone chain convex hull algorithm
@@ -240,6 +527,88 @@ Polygon Polygons::convexHull() const
     return hull_poly;
 }
 
+unsigned int PolygonRef::simplifyWithinDeviation(int max_deviation)
+{
+    PolygonRef& thiss = *this;
+    const unsigned int point_count = size();
+    if (point_count < 4)
+    {
+        return 0;
+    }
+    const int64_t max_deviation2 = int64_t(max_deviation) * max_deviation;
+
+    unsigned int far_idx = 0;
+    int64_t far_dist2 = -1;
+    for (unsigned int point_idx = 1; point_idx < point_count; point_idx++)
+    {
+        const int64_t dist2 = vSize2(thiss[point_idx] - thiss[0]);
+        if (dist2 > far_dist2)
+        {
+            far_idx = point_idx;
+            far_dist2 = dist2;
+        }
+    }
+
+    std::vector<bool> keep(point_count, false);
+    keep[0] = true;
+    keep[far_idx] = true;
+    std::vector<std::pair<unsigned int, unsigned int>> ranges; // polylines still to simplify, from the first to the last point; the index point_count is the first point again
+    ranges.emplace_back(0, far_idx);
+    ranges.emplace_back(far_idx, point_count);
+    while (!ranges.empty())
+    {
+        const unsigned int start_idx = ranges.back().first;
+        const unsigned int end_idx = ranges.back().second;
+        ranges.pop_back();
+        const Point& start = thiss[start_idx];
+        const Point& end = thiss[end_idx % point_count];
+        unsigned int worst_idx = 0;
+        int64_t worst_dist2 = max_deviation2;
+        for (unsigned int point_idx = start_idx + 1; point_idx < end_idx; point_idx++)
+        {
+            const int64_t dist2 = LinearAlg2D::getDist2FromLineSegment(start, thiss[point_idx], end);
+            if (dist2 > worst_dist2)
+            {
+                worst_idx = point_idx;
+                worst_dist2 = dist2;
+            }
+        }
+        if (worst_idx != 0)
+        {
+            keep[worst_idx] = true;
+            ranges.emplace_back(start_idx, worst_idx);
+            ranges.emplace_back(worst_idx, end_idx);
+        }
+    }
+
+    unsigned int writing_idx = 0;
+    for (unsigned int point_idx = 0; point_idx < point_count; point_idx++)
+    {
+        if (keep[point_idx])
+        {
+            thiss[writing_idx] = thiss[point_idx];
+            writing_idx++;
+        }
+    }
+    path->erase(path->begin() + writing_idx, path->end());
+    return point_count - writing_idx;
+}
+
+unsigned int Polygons::simplifyWithinDeviation(int max_deviation)
+{
+    unsigned int removed_count = 0;
+    for (ClipperLib::Path& path : paths)
+    {
+        removed_count += PolygonRef(path).simplifyWithinDeviation(max_deviation);
+        if (path.size() < 3)
+        {
+            removed_count += path.size();
+        }
+    }
+    paths.erase(std::remove_if(paths.begin(), paths.end(), [](const ClipperLib::Path& path) { return path.size() < 3; }), paths.end());
+    return removed_count;
+}
+
 void PolygonRef::simplify(int smallest_line_segment_squared, int allowed_error_distance_squared){
     PolygonRef& thiss = *this;
     
@@ -342,6 +711,7 @@ Polygons Polygons::getOutsidePolygons() const
     ClipperLib::Clipper clipper(clipper_init);
     ClipperLib::PolyTree poly_tree;
     constexpr bool paths_are_closed_polys = true;
+    CLIPPER_RANGE_ASSERT(paths, 0);
     clipper.AddPaths(paths, ClipperLib::ptSubject, paths_are_closed_polys);
     clipper.Execute(ClipperLib::ctUnion, poly_tree);
 
@@ -359,6 +729,7 @@ Polygons Polygons::removeEmptyHoles() const
     ClipperLib::Clipper clipper(clipper_init);
     ClipperLib::PolyTree poly_tree;
     constexpr bool paths_are_closed_polys = true;
+    CLIPPER_RANGE_ASSERT(paths, 0);
     clipper.AddPaths(paths, ClipperLib::ptSubject, paths_are_closed_polys);
     clipper.Execute(ClipperLib::ctUnion, poly_tree);
 
@@ -389,6 +760,7 @@ std::vector<PolygonsPart> Polygons::splitIntoParts(bool unionAll) const
     std::vector<PolygonsPart> ret;
     ClipperLib::Clipper clipper(clipper_init);
     ClipperLib::PolyTree resultPolyTree;
+    CLIPPER_RANGE_ASSERT(paths, 0);
     clipper.AddPaths(paths, ClipperLib::ptSubject, true);
     if (unionAll)
         clipper.Execute(ClipperLib::ctUnion, resultPolyTree, ClipperLib::pftNonZero, ClipperLib::pftNonZero);
@@ -463,6 +835,7 @@ PartsView Polygons::splitIntoPartsView(bool unionAll)
     PartsView partsView(*this);
     ClipperLib::Clipper clipper(clipper_init);
     ClipperLib::PolyTree resultPolyTree;
+    CLIPPER_RANGE_ASSERT(paths, 0);
     clipper.AddPaths(paths, ClipperLib::ptSubject, true);
     if (unionAll)
         clipper.Execute(ClipperLib::ctUnion, resultPolyTree, ClipperLib::pftNonZero, ClipperLib::pftNonZero);
@@ -475,6 +848,62 @@ PartsView Polygons::splitIntoPartsView(bool unionAll)
     return partsView;
 }
 
+PartsView Polygons::splitGroupsIntoPartsView(const std::vector<unsigned int>& group_starts)
+{
+    Polygons reordered;
+    PartsView partsView(*this);
+    for (unsigned int group_idx = 0; group_idx < group_starts.size(); group_idx++)
+    {
+        const unsigned int group_start = group_starts[group_idx];
+        const unsigned int group_end = (group_idx + 1 < group_starts.size()) ? group_starts[group_idx + 1] : size();
+        unsigned int outline_count = 0;
+        unsigned int outline_idx = group_start;
+        bool has_degenerate = false;
+        for (unsigned int poly_idx = group_start; poly_idx < group_end; poly_idx++)
+        {
+            const double area = ClipperLib::Area(paths[poly_idx]);
+            if (area > 0)
+            {
+                outline_count++;
+                outline_idx = poly_idx;
+            }
+            has_degenerate |= area == 0;
+        }
+        if (outline_count == 1 && !has_degenerate)
+        { // all other polygons are holes of the single outline
+            partsView.emplace_back();
+            std::vector<unsigned int>& part = partsView.back();
+            part.push_back(reordered.size());
+            reordered.paths.emplace_back(std::move(paths[outline_idx]));
+            for (unsigned int poly_idx = group_start; poly_idx < group_end; poly_idx++)
+            {
+                if (poly_idx != outline_idx)
+                {
+                    part.push_back(reordered.size());
+                    reordered.paths.emplace_back(std::move(paths[poly_idx]));
+                }
+            }
+            continue;
+        }
+        Polygons group;
+        group.paths.assign(std::make_move_iterator(paths.begin() + group_start), std::make_move_iterator(paths.begin() + group_end));
+        const PartsView group_parts = group.splitIntoPartsView();
+        for (const std::vector<unsigned int>& group_part : group_parts)
+        {
+            partsView.emplace_back();
+            std::vector<unsigned int>& part = partsView.back();
+            for (unsigned int group_poly_idx : group_part)
+            {
+                part.push_back(reordered.size());
+                reordered.paths.emplace_back(std::move(group.paths[group_poly_idx]));
+            }
+        }
+    }
+
+    (*this) = reordered;
+    return partsView;
+}
+
 void Polygons::splitIntoPartsView_processPolyTreeNode(PartsView& partsView, Polygons& reordered, ClipperLib::PolyNode* node) const
 {
     for(int n=0; n<node->ChildCount(); n++)
@@ -495,4 +924,95 @@ void Polygons::splitIntoPartsView_processPolyTreeNode(PartsView& partsView, Poly
 
 
 
+Polygons Polygons::remove(const Polygons& to_be_removed, int same_distance) const
+{
+    // the points of the polygons to be removed, in cells at least as large as same_distance,
+    // so that all points within same_distance of a point lie in its own cell or the cells around it
+    const int64_t cell_size = std::max(1, same_distance);
+    const int64_t same_distance2 = int64_t(same_distance) * same_distance;
+    std::unordered_multimap<std::pair<int64_t, int64_t>, unsigned int, CellHash> rem_points;
+    for (unsigned int poly_rem_idx = 0; poly_rem_idx < to_be_removed.size(); poly_rem_idx++)
+    {
+        for (const Point& point : to_be_removed.paths[poly_rem_idx])
+        {
+            rem_points.emplace(std::make_pair(cellCoordinate(point.X, cell_size), cellCoordinate(point.Y, cell_size)), poly_rem_idx);
+        }
+    }
+    const int64_t search_radius = (same_distance > 0) ? 1 : 0; // in cells
+    std::vector<unsigned int> compared_with(to_be_removed.size(), 0); // for each polygon to be removed the last kept polygon it was compared to, plus one
+
+    // whether a polygon to be removed is the same as the kept polygon
+    auto isSame = [&](const ClipperLib::Path& poly_keep, const ClipperLib::Path& poly_rem)
+    {
+        // find closest point, supposing this point aligns the two shapes in the best way
+        unsigned int closest_point_idx = 0;
+        int64_t smallest_dist2 = -1;
+        for (unsigned int point_rem_idx = 0; point_rem_idx < poly_rem.size(); point_rem_idx++)
+        {
+            const int64_t dist2 = vSize2(poly_rem[point_rem_idx] - poly_keep[0]);
+            if (dist2 < smallest_dist2 || smallest_dist2 < 0)
+            {
+                smallest_dist2 = dist2;
+                closest_point_idx = point_rem_idx;
+            }
+        }
+        if (smallest_dist2 > same_distance2)
+        {
+            return false;
+        }
+        // compare the two polygons on all points
+        for (unsigned int point_idx = 0; point_idx < poly_rem.size(); point_idx++)
+        {
+            if (vSize2(poly_rem[(closest_point_idx + point_idx) % poly_rem.size()] - poly_keep[point_idx]) > same_distance2)
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+    // whether any polygon to be removed is the same as the kept polygon, comparing only those with a point close to its first point
+    auto shouldBeRemoved = [&](unsigned int poly_keep_idx)
+    {
+        const ClipperLib::Path& poly_keep = paths[poly_keep_idx];
+        if (poly_keep.empty())
+        {
+            return false;
+        }
+        const int64_t cell_x = cellCoordinate(poly_keep[0].X, cell_size);
+        const int64_t cell_y = cellCoordinate(poly_keep[0].Y, cell_size);
+        for (int64_t dx = -search_radius; dx <= search_radius; dx++)
+        {
+            for (int64_t dy = -search_radius; dy <= search_radius; dy++)
+            {
+                auto range = rem_points.equal_range(std::make_pair(cell_x + dx, cell_y + dy));
+                for (auto rem_it = range.first; rem_it != range.second; ++rem_it)
+                {
+                    const unsigned int poly_rem_idx = rem_it->second;
+                    const ClipperLib::Path& poly_rem = to_be_removed.paths[poly_rem_idx];
+                    if (poly_rem.size() != poly_keep.size() || compared_with[poly_rem_idx] == poly_keep_idx + 1)
+                    {
+                        continue;
+                    }
+                    compared_with[poly_rem_idx] = poly_keep_idx + 1;
+                    if (isSame(poly_keep, poly_rem))
+                    {
+                        return true;
+                    }
+                }
+            }
+        }
+        return false;
+    };
+
+    Polygons result;
+    for (unsigned int poly_keep_idx = 0; poly_keep_idx < size(); poly_keep_idx++)
+    {
+        if (!shouldBeRemoved(poly_keep_idx))
+        {
+            result.paths.push_back(paths[poly_keep_idx]);
+        }
+    }
+    return result;
+}
+
 }//namespace cura
@@ -9,8 +9,10 @@
 #include <algorithm>    // std::reverse, fill_n array
 #include <cmath> // fabs
 #include <limits> // int64_t.min
+#include <utility> // pair
 
 #include "intpoint.h"
+#include "LayerArena.h"
 
 //#define CHECK_POLY_ACCESS
 #ifdef CHECK_POLY_ACCESS
@@ -19,6 +21,13 @@
 #define POLY_ASSERT(e) do {} while(0)
 #endif
 
+// Built with ENABLE_CLIPPER_RANGE_CHECK: assert that Clipper never takes its 128 bit path
+#ifdef ASSERT_CLIPPER_LOW_RANGE
+#define CLIPPER_RANGE_ASSERT(paths, margin) assert(Polygons::inClipperLowRange(paths, margin))
+#else
+#define CLIPPER_RANGE_ASSERT(paths, margin) do {} while(0)
+#endif
+
 namespace cura {
 
 
@@ -26,6 +35,13 @@ class PartsView;
 class Polygons;
 
 const static int clipper_init = (0);
+
+/*!
+ * The largest coordinate for which Clipper computes with 64 bit integers (its loRange).
+ * A single point beyond it makes Clipper compute the slopes of all edges of that operation with 128 bit integers, which is several times slower.
+ * Meshes are kept well within it, see MeshGroup::inClipperLowRange.
+ */
+constexpr ClipperLib::cInt clipper_low_range = 0x3FFFFFFF;
 #define NO_INDEX (std::numeric_limits<unsigned int>::max())
 
 class PolygonRef
@@ -65,6 +81,14 @@ public:
         path->push_back(p);
     }
 
+    /*!
+     * Allocate the memory for at least \p min_size points at once, so that adding up to that many points doesn't reallocate.
+     */
+    void reserve(unsigned int min_size)
+    {
+        path->reserve(min_size);
+    }
+
     PolygonRef& operator=(const PolygonRef& other) { path = other.path; return *this; }
 
     bool operator==(const PolygonRef& other) const =delete;
@@ -277,6 +301,16 @@ public:
      */
     void simplify(int smallest_line_segment_squared = 100, int allowed_error_distance_squared = 25);
 
+    /*!
+     * Remove points with the Douglas-Peucker algorithm, such that no removed point is farther than \p max_deviation from the simplified polygon.
+     *
+     * The polygon is split into two polylines at its first point and the point farthest away from it, which are always kept.
+     *
+     * \param max_deviation The maximal distance of a removed point to the line segment which replaces it
+     * \return The number of points removed
+     */
+    unsigned int simplifyWithinDeviation(int max_deviation);
+
     void pop_back()
     { 
         path->pop_back();
@@ -379,6 +413,13 @@ public:
     {
         paths.clear();
     }
+    /*!
+     * Exchange the polygons with those of \p other, without copying them.
+     */
+    void swap(Polygons& other)
+    {
+        paths.swap(other.paths);
+    }
     void add(const PolygonRef& poly)
     {
         paths.push_back(*poly.path);
@@ -399,11 +440,28 @@ public:
         paths.emplace_back(args...);
     }
 
+    /*!
+     * Allocate the memory for at least \p min_size polygons at once, so that adding up to that many polygons doesn't reallocate.
+     */
+    void reserve(unsigned int min_size)
+    {
+        paths.reserve(min_size);
+    }
+
     PolygonRef newPoly()
     {
         paths.emplace_back();
         return PolygonRef(paths.back());
     }
+    /*!
+     * Add a line segment as a polygon of two points.
+     *
+     * The points are allocated at once, instead of growing an empty polygon point by point.
+     */
+    void addLine(const Point from, const Point to)
+    {
+        paths.push_back({from, to});
+    }
     PolygonRef back()
     {
         return PolygonRef(paths.back());
@@ -412,27 +470,65 @@ public:
     Polygons() {}
 
     Polygons(const Polygons& other) { paths = other.paths; }
+    Polygons(Polygons&& other) noexcept : paths(std::move(other.paths)) {}
     Polygons& operator=(const Polygons& other) { paths = other.paths; return *this; }
+    Polygons& operator=(Polygons&& other) noexcept { paths = std::move(other.paths); return *this; }
 
     bool operator==(const Polygons& other) const =delete;
 
+    /*!
+     * The boolean operations come in three forms: returning a new result,
+     * storing the result in \p result, which reuses the memory of the polygons it held before,
+     * and changing these polygons themselves, such as differenceWith, which reuses their memory too.
+     */
     Polygons difference(const Polygons& other) const
     {
         Polygons ret;
+        difference(other, ret);
+        return ret;
+    }
+    void difference(const Polygons& other, Polygons& result) const
+    {
+        if (isTiled(other))
+        {
+            tiledOperation(ClipperLib::ctDifference, other, result, tiling_point_count);
+            return;
+        }
+        LayerArena::Temporaries temporaries; // Clipper allocates its edges and output points one by one
         ClipperLib::Clipper clipper(clipper_init);
+        CLIPPER_RANGE_ASSERT(paths, 0);
+        CLIPPER_RANGE_ASSERT(other.paths, 0);
         clipper.AddPaths(paths, ClipperLib::ptSubject, true);
         clipper.AddPaths(other.paths, ClipperLib::ptClip, true);
-        clipper.Execute(ClipperLib::ctDifference, ret.paths);
-        return ret;
+        ClipperLib::Paths clipper_result;
+        clipper.Execute(ClipperLib::ctDifference, clipper_result);
+        temporaries.keep(clipper_result, result.paths);
+    }
+    void differenceWith(const Polygons& other)
+    {
+        difference(other, *this);
     }
     Polygons unionPolygons(const Polygons& other) const
     {
         Polygons ret;
+        unionPolygons(other, ret);
+        return ret;
+    }
+    void unionPolygons(const Polygons& other, Polygons& result) const
+    {
+        LayerArena::Temporaries temporaries;
         ClipperLib::Clipper clipper(clipper_init);
+        CLIPPER_RANGE_ASSERT(paths, 0);
+        CLIPPER_RANGE_ASSERT(other.paths, 0);
         clipper.AddPaths(paths, ClipperLib::ptSubject, true);
         clipper.AddPaths(other.paths, ClipperLib::ptSubject, true);
-        clipper.Execute(ClipperLib::ctUnion, ret.paths, ClipperLib::pftNonZero, ClipperLib::pftNonZero);
-        return ret;
+        ClipperLib::Paths clipper_result;
+        clipper.Execute(ClipperLib::ctUnion, clipper_result, ClipperLib::pftNonZero, ClipperLib::pftNonZero);
+        temporaries.keep(clipper_result, result.paths);
+    }
+    void unionWith(const Polygons& other)
+    {
+        unionPolygons(other, *this);
     }
     /*!
      * Union all polygons with each other (When polygons.add(polygon) has been called for overlapping polygons)
@@ -444,39 +540,157 @@ public:
     Polygons intersection(const Polygons& other) const
     {
         Polygons ret;
+        intersection(other, ret);
+        return ret;
+    }
+    void intersection(const Polygons& other, Polygons& result) const
+    {
+        if (isTiled(other))
+        {
+            tiledOperation(ClipperLib::ctIntersection, other, result, tiling_point_count);
+            return;
+        }
+        LayerArena::Temporaries temporaries;
         ClipperLib::Clipper clipper(clipper_init);
+        CLIPPER_RANGE_ASSERT(paths, 0);
+        CLIPPER_RANGE_ASSERT(other.paths, 0);
         clipper.AddPaths(paths, ClipperLib::ptSubject, true);
         clipper.AddPaths(other.paths, ClipperLib::ptClip, true);
-        clipper.Execute(ClipperLib::ctIntersection, ret.paths);
-        return ret;
+        ClipperLib::Paths clipper_result;
+        clipper.Execute(ClipperLib::ctIntersection, clipper_result);
+        temporaries.keep(clipper_result, result.paths);
+    }
+    void intersectWith(const Polygons& other)
+    {
+        intersection(other, *this);
     }
     Polygons xorPolygons(const Polygons& other) const
     {
         Polygons ret;
+        LayerArena::Temporaries temporaries;
         ClipperLib::Clipper clipper(clipper_init);
+        CLIPPER_RANGE_ASSERT(paths, 0);
+        CLIPPER_RANGE_ASSERT(other.paths, 0);
         clipper.AddPaths(paths, ClipperLib::ptSubject, true);
         clipper.AddPaths(other.paths, ClipperLib::ptClip, true);
-        clipper.Execute(ClipperLib::ctXor, ret.paths);
+        ClipperLib::Paths result;
+        clipper.Execute(ClipperLib::ctXor, result);
+        temporaries.keep(result, ret.paths);
         return ret;
     }
+
+    /*!
+     * Let difference, intersection and offset split polygons with more than \p point_count points in tiles, see tiledOperation.
+     *
+     * Should be set before the polygons of a mesh group are processed, not while other threads use the operations.
+     *
+     * \param point_count The number of points above which the operations are tiled, and the number of points up to which a tile is computed at once, or zero to never tile
+     */
+    static void setTilingPointCount(size_t point_count)
+    {
+        tiling_point_count = point_count;
+    }
+
+    /*!
+     * Compute a boolean operation on tiles of the plane in parallel, for polygons with so many points that a single Clipper operation would take long.
+     *
+     * The plane is split in two halves along the longer side of the bounding box, again and again, until each tile has at most \p max_tile_point_count points.
+     * The polygons are clipped to both halves of each split in parallel, the operation is applied to the polygons within each tile
+     * and the results of all tiles are united again along the seams between the tiles.
+     * The result is the same as that of the operation on the whole polygons, except that the points where the polygons cross a seam are rounded.
+     *
+     * \param operation ClipperLib::ctDifference or ClipperLib::ctIntersection; a union would only be split to be united again
+     * \param other The clip polygons
+     * \param[out] result The result of the operation
+     * \param max_tile_point_count The number of points up to which a tile is computed at once
+     */
+    void tiledOperation(ClipperLib::ClipType operation, const Polygons& other, Polygons& result, size_t max_tile_point_count) const;
+
+    /*!
+     * Offset the polygons on tiles of the plane in parallel, as tiledOperation.
+     *
+     * Each tile offsets the polygons within the tile and a margin around it, which is wide enough for the corners of the offset,
+     * so that the offset within the tile is the same as that of the whole polygons.
+     */
+    void tiledOffset(int distance, Polygons& result, size_t max_tile_point_count, ClipperLib::JoinType joinType = ClipperLib::jtMiter, double miter_limit = 1.2) const;
+
+    /*!
+     * Apply the same boolean operation to many pairs of polygons, such as to each layer of a stack of layers.
+     *
+     * The pairs are divided in blocks over the threads of the ThreadPool, and a single Clipper is reused for all pairs of a block.
+     * The result of each pair is the same as that of the operation on the pair itself:
+     * difference, intersection or xorPolygons, or unionPolygons(const Polygons&) for ClipperLib::ctUnion.
+     *
+     * \param operation The boolean operation to apply
+     * \param operands For each pair the subject and the clip polygons; these shouldn't point into \p results
+     * \param[out] results The result of each pair
+     */
+    static void batchOperation(ClipperLib::ClipType operation, const std::vector<std::pair<const Polygons*, const Polygons*>>& operands, std::vector<Polygons>& results);
+
+    /*!
+     * Check whether Clipper can process these paths with 64 bit integers, even after they have been moved outward by \p margin.
+     *
+     * Used by CLIPPER_RANGE_ASSERT before each Clipper operation.
+     *
+     * \param paths The paths given to Clipper
+     * \param margin The distance by which the paths may grow in the operation, such as the offset distance
+     * \return Whether all coordinates stay within \ref clipper_low_range
+     */
+    static bool inClipperLowRange(const ClipperLib::Paths& paths, int64_t margin = 0);
+    static bool inClipperLowRange(const ClipperLib::Path& path, int64_t margin = 0);
     Polygons offset(int distance, ClipperLib::JoinType joinType = ClipperLib::jtMiter, double miter_limit = 1.2) const
     {
         Polygons ret;
+        offset(distance, ret, joinType, miter_limit);
+        return ret;
+    }
+    /*!
+     * Offset the polygons into \p result, reusing the memory of the polygons it held before.
+     */
+    void offset(int distance, Polygons& result, ClipperLib::JoinType joinType = ClipperLib::jtMiter, double miter_limit = 1.2) const
+    {
+        if (isTiled(Polygons()))
+        {
+            tiledOffset(distance, result, tiling_point_count, joinType, miter_limit);
+            return;
+        }
+        LayerArena::Temporaries temporaries;
         ClipperLib::ClipperOffset clipper(miter_limit, 10.0);
+        CLIPPER_RANGE_ASSERT(paths, std::abs(distance));
         clipper.AddPaths(paths, joinType, ClipperLib::etClosedPolygon);
         clipper.MiterLimit = miter_limit;
-        clipper.Execute(ret.paths, distance);
-        return ret;
+        ClipperLib::Paths clipper_result;
+        clipper.Execute(clipper_result, distance);
+        temporaries.keep(clipper_result, result.paths);
+    }
+    void offsetInPlace(int distance, ClipperLib::JoinType joinType = ClipperLib::jtMiter, double miter_limit = 1.2)
+    {
+        offset(distance, *this, joinType, miter_limit);
     }
     
+    /*!
+     * Offset the polygons by several distances at once, preparing the offset only once.
+     *
+     * Each result is the offset of these polygons themselves, not of the previous result.
+     * The results stop at the first empty one, so that the distances should be ordered such that all results after an empty one would be empty too.
+     *
+     * \param distances The distances by which to offset the polygons
+     * \param[out] results The offset polygons for each distance are added to these
+     */
+    void offsetMulti(const std::vector<int>& distances, std::vector<Polygons>& results, ClipperLib::JoinType joinType = ClipperLib::jtMiter, double miter_limit = 1.2) const;
+
     Polygons offsetPolyLine(int distance, ClipperLib::JoinType joinType = ClipperLib::jtMiter) const
     {
         Polygons ret;
+        LayerArena::Temporaries temporaries;
         double miterLimit = 1.2;
         ClipperLib::ClipperOffset clipper(miterLimit, 10.0);
+        CLIPPER_RANGE_ASSERT(paths, std::abs(distance));
         clipper.AddPaths(paths, joinType, ClipperLib::etOpenSquare);
         clipper.MiterLimit = miterLimit;
-        clipper.Execute(ret.paths, distance);
+        ClipperLib::Paths result;
+        clipper.Execute(result, distance);
+        temporaries.keep(result, ret.paths);
         return ret;
     }
     
@@ -536,6 +750,14 @@ public:
     Polygons smooth(int remove_length, int min_area) //!< removes points connected to small lines
     {
         Polygons ret;
+        smooth(remove_length, min_area, ret);
+        return ret;
+    }
+    /*!
+     * Remove the points connected to small lines, adding the smoothed polygons to \p ret, which shouldn't be these polygons themselves.
+     */
+    void smooth(int remove_length, int min_area, Polygons& ret)
+    {
         for (unsigned int p = 0; p < size(); p++)
         {
             PolygonRef poly(paths[p]);
@@ -554,7 +776,6 @@ public:
             
 
         }
-        return ret;
     }
     
     /*!
@@ -563,6 +784,14 @@ public:
      * \param smallest_line_segment_squared maximal squared length of removed line segments
      * \param allowed_error_distance_squared The square of the distance of the middle point to the line segment of the consecutive and previous point for which the middle point is removed
      */
+    /*!
+     * Simplify each polygon with PolygonRef::simplifyWithinDeviation, and remove the polygons which don't keep any area.
+     *
+     * \param max_deviation The maximal distance of a removed point to the line segment which replaces it
+     * \return The number of points removed, including those of the removed polygons
+     */
+    unsigned int simplifyWithinDeviation(int max_deviation);
+
     void simplify(int smallest_line_segment = 10, int allowed_error_distance = 5) 
     {
         int allowed_error_distance_squared = allowed_error_distance * allowed_error_distance;
@@ -613,24 +842,55 @@ public:
      * \warning Note that this function reorders the polygons!
      */
     PartsView splitIntoPartsView(bool unionAll = false);
+
+    /*!
+     * Split up the polygons into groups like Polygons::splitIntoPartsView, for polygons already grouped per part of which the structure is known.
+     *
+     * A group of polygons with a single outline is a part by itself, with its holes in the given order, so that no PolyTree needs to be built for it.
+     * Only the groups with several outlines are split up with Polygons::splitIntoPartsView.
+     *
+     * \warning Note that this function reorders the polygons!
+     * \warning The groups mustn't overlap, like the areas of the parts of a layer.
+     *
+     * \param group_starts The index of the first polygon of each group, in increasing order
+     */
+    PartsView splitGroupsIntoPartsView(const std::vector<unsigned int>& group_starts);
 private:
     void splitIntoPartsView_processPolyTreeNode(PartsView& partsView, Polygons& reordered, ClipperLib::PolyNode* node) const;
-public:
+
+    static size_t tiling_point_count; //!< The number of points above which difference, intersection and offset are tiled, see setTilingPointCount
+
     /*!
-     * Removes polygons with area smaller than \p minAreaSize (note that minAreaSize is in mm^2, not in micron^2).
+     * Whether an operation on these polygons and \p other is to be tiled, see setTilingPointCount.
      */
-    void removeSmallAreas(double minAreaSize)
-    {               
-        Polygons& thiss = *this;
-        for(unsigned int i=0; i<size(); i++)
+    bool isTiled(const Polygons& other) const
+    {
+        if (tiling_point_count == 0)
         {
-            double area = INT2MM(INT2MM(fabs(thiss[i].area())));
-            if (area < minAreaSize) // Only create an up/down skin if the area is large enough. So you do not create tiny blobs of "trying to fill"
+            return false;
+        }
+        size_t point_count = 0;
+        for (const Polygons* polygons : { this, &other })
+        {
+            for (const ClipperLib::Path& path : polygons->paths)
             {
-                remove(i);
-                i -= 1;
+                point_count += path.size();
             }
         }
+        return point_count > tiling_point_count;
+    }
+public:
+    /*!
+     * Removes polygons with area smaller than \p minAreaSize (note that minAreaSize is in mm^2, not in micron^2).
+     */
+    void removeSmallAreas(double minAreaSize)
+    {
+        // the polygons are kept in order and moved forward at once, instead of erasing each small one separately
+        paths.erase(std::remove_if(paths.begin(), paths.end(), [minAreaSize](const ClipperLib::Path& poly)
+            {
+                double area = INT2MM(INT2MM(fabs(ClipperLib::Area(poly))));
+                return area < minAreaSize; // Only create an up/down skin if the area is large enough. So you do not create tiny blobs of "trying to fill"
+            }), paths.end());
     }
     /*!
      * Removes overlapping consecutive line segments which don't delimit a positive area.
@@ -687,65 +947,22 @@ public:
     /*!
      * Removes the same polygons from this set (and also empty polygons).
      * Polygons are considered the same if all points lie within [same_distance] of their counterparts.
+     *
+     * The points of \p to_be_removed are hashed by location, so that each polygon is only compared to the polygons
+     * of the same size which have a point close to its first point.
      */
-    Polygons remove(Polygons& to_be_removed, int same_distance = 0)
-    {
-        Polygons result;
-        for (unsigned int poly_keep_idx = 0; poly_keep_idx < size(); poly_keep_idx++)
-        {
-            PolygonRef poly_keep = (*this)[poly_keep_idx];
-            bool should_be_removed = false;
-            if (poly_keep.size() > 0) 
-//             for (int hole_poly_idx = 0; hole_poly_idx < to_be_removed.size(); hole_poly_idx++)
-            for (PolygonRef poly_rem : to_be_removed)
-            {
-//                 PolygonRef poly_rem = to_be_removed[hole_poly_idx];
-                if (poly_rem.size() != poly_keep.size() || poly_rem.size() == 0) continue;
-                
-                // find closest point, supposing this point aligns the two shapes in the best way
-                int closest_point_idx = 0;
-                int smallestDist2 = -1;
-                for (unsigned int point_rem_idx = 0; point_rem_idx < poly_rem.size(); point_rem_idx++)
-                {
-                    int dist2 = vSize2(poly_rem[point_rem_idx] - poly_keep[0]);
-                    if (dist2 < smallestDist2 || smallestDist2 < 0)
-                    {
-                        smallestDist2 = dist2;
-                        closest_point_idx = point_rem_idx;
-                    }
-                }
-                bool poly_rem_is_poly_keep = true;
-                // compare the two polygons on all points
-                if (smallestDist2 > same_distance * same_distance)
-                    continue;
-                for (unsigned int point_idx = 0; point_idx < poly_rem.size(); point_idx++)
-                {
-                    int dist2 = vSize2(poly_rem[(closest_point_idx + point_idx) % poly_rem.size()] - poly_keep[point_idx]);
-                    if (dist2 > same_distance * same_distance)
-                    {
-                        poly_rem_is_poly_keep = false;
-                        break;
-                    }
-                }
-                if (poly_rem_is_poly_keep)
-                {
-                    should_be_removed = true;
-                    break;
-                }
-            }
-            if (!should_be_removed)
-                result.add(poly_keep);
-            
-        }
-        return result;
-    }
+    Polygons remove(const Polygons& to_be_removed, int same_distance = 0) const;
 
     Polygons processEvenOdd() const
     {
         Polygons ret;
+        LayerArena::Temporaries temporaries;
         ClipperLib::Clipper clipper(clipper_init);
+        CLIPPER_RANGE_ASSERT(paths, 0);
         clipper.AddPaths(paths, ClipperLib::ptSubject, true);
-        clipper.Execute(ClipperLib::ctUnion, ret.paths);
+        ClipperLib::Paths result;
+        clipper.Execute(ClipperLib::ctUnion, result);
+        temporaries.keep(result, ret.paths);
         return ret;
     }
 
@@ -803,6 +1020,22 @@ public:
             }
         }
     }
+
+    /*!
+     * Translate all polygons in some direction.
+     * 
+     * \param translation The direction in which to move the polygons
+     */
+    void translate(Point translation)
+    {
+        for (ClipperLib::Path& path : paths)
+        {
+            for (Point& p : path)
+            {
+                p += translation;
+            }
+        }
+    }
 };
 
 /*!
@@ -516,7 +516,9 @@ ClosestPolygonPoint PolygonUtils::findClosest(Point from, const PolygonRef polyg
 
     int64_t closestDist2_score = vSize2(from - best) + penalty_function(best);
     int bestPos = 0;
-//
+    // without a penalty the score is the squared distance itself, which is at least that to the bounding box of a line segment
+    const bool has_penalty = &penalty_function != &no_penalty_function;
+
     for (unsigned int p = 0; p<polygon.size(); p++)
     {
         Point& p1 = polygon[p];
@@ -525,6 +527,16 @@ ClosestPolygonPoint PolygonUtils::findClosest(Point from, const PolygonRef polyg
         if (p2_idx >= polygon.size()) p2_idx = 0;
         Point& p2 = polygon[p2_idx];
 
+        if (!has_penalty)
+        {
+            const int64_t box_dist_x = std::max<int64_t>(std::max(std::min(p1.X, p2.X) - from.X, from.X - std::max(p1.X, p2.X)), 0);
+            const int64_t box_dist_y = std::max<int64_t>(std::max(std::min(p1.Y, p2.Y) - from.Y, from.Y - std::max(p1.Y, p2.Y)), 0);
+            if (box_dist_x * box_dist_x + box_dist_y * box_dist_y >= closestDist2_score)
+            { // the segment can't have a closer point
+                continue;
+            }
+        }
+
         Point closest_here = LinearAlg2D::getClosestOnLineSegment(from, p1 ,p2);
         int64_t dist2_score = vSize2(from - closest_here) + penalty_function(closest_here);
         if (dist2_score < closestDist2_score)
@@ -548,6 +560,8 @@ SparseGrid<PolygonsPointIndex>* PolygonUtils::createLocToLineGrid(const Polygons
 
     SparseGrid<PolygonsPointIndex>* ret = new SparseGrid<PolygonsPointIndex>(square_size, n_points);
 
+    std::vector<SparseGrid<PolygonsPointIndex>::Elem> elems;
+    elems.reserve(n_points);
     for (unsigned int poly_idx = 0; poly_idx < polygons.size(); poly_idx++)
     {
         const PolygonRef poly = polygons[poly_idx];
@@ -556,18 +570,19 @@ SparseGrid<PolygonsPointIndex>* PolygonUtils::createLocToLineGrid(const Polygons
             Point& p1 = poly[point_idx];
             Point& p2 = poly[(point_idx + 1) % poly.size()];
             
-            ret->insert(p1, PolygonsPointIndex(poly_idx, point_idx));
+            elems.emplace_back(p1, PolygonsPointIndex(poly_idx, point_idx));
             Point vec = p2 - p1;
             int64_t vec_length = vSize(vec);
             for (int64_t dist_along_line = square_size; dist_along_line < vec_length; dist_along_line += square_size)
             {
                 Point point_along_line = p1 + vec * dist_along_line / vec_length;
                 
-                ret->insert(point_along_line, PolygonsPointIndex(poly_idx, point_idx));
+                elems.emplace_back(point_along_line, PolygonsPointIndex(poly_idx, point_idx));
             }
         }
         
     }
+    ret->insertAll(elems);
     
     
     
@@ -741,12 +756,16 @@ bool PolygonUtils::getNextPointWithDistance(Point from, int64_t dist, const Poly
 
 bool PolygonUtils::polygonCollidesWithlineSegment(const PolygonRef poly, Point& transformed_startPoint, Point& transformed_endPoint, PointMatrix transformation_matrix)
 {
-    Point p0 = transformation_matrix.apply(poly.back());
-    for(Point p1_ : poly)
+    // only the y-coordinates are needed to test whether a segment crosses the line, so the x-coordinates are only transformed for the segments which do
+    Point untransformed_p0 = poly.back();
+    int64_t p0_y = transformation_matrix.applyY(untransformed_p0);
+    for(Point untransformed_p1 : poly)
     {
-        Point p1 = transformation_matrix.apply(p1_);
-        if ((p0.Y >= transformed_startPoint.Y && p1.Y <= transformed_startPoint.Y) || (p1.Y >= transformed_startPoint.Y && p0.Y <= transformed_startPoint.Y))
+        const int64_t p1_y = transformation_matrix.applyY(untransformed_p1);
+        if ((p0_y >= transformed_startPoint.Y && p1_y <= transformed_startPoint.Y) || (p1_y >= transformed_startPoint.Y && p0_y <= transformed_startPoint.Y))
         {
+            const Point p0(transformation_matrix.applyX(untransformed_p0), p0_y);
+            const Point p1(transformation_matrix.applyX(untransformed_p1), p1_y);
             int64_t x;
             if(p1.Y == p0.Y)
             {
@@ -760,7 +779,8 @@ bool PolygonUtils::polygonCollidesWithlineSegment(const PolygonRef poly, Point&
             if (x >= transformed_startPoint.X && x <= transformed_endPoint.X)
                 return true;
         }
-        p0 = p1;
+        untransformed_p0 = untransformed_p1;
+        p0_y = p1_y;
     }
     return false;
 }
@@ -802,5 +822,51 @@ bool PolygonUtils::polygonCollidesWithlineSegment(const Polygons& polys, Point&
     return polygonCollidesWithlineSegment(polys, transformed_startPoint, transformed_endPoint, transformation_matrix);
 }
 
+uint64_t PolygonUtils::hashPoints(const Polygons& polygons)
+{
+    uint64_t result = 14695981039346656037ull; // FNV-1a
+    auto hashValue = [&result](uint64_t value)
+    {
+        result ^= value;
+        result *= 1099511628211ull;
+    };
+    hashValue(polygons.size());
+    for (unsigned int poly_idx = 0; poly_idx < polygons.size(); poly_idx++)
+    {
+        const PolygonRef polygon = polygons[poly_idx];
+        hashValue(polygon.size());
+        for (const Point& point : polygon)
+        {
+            hashValue(point.X);
+            hashValue(point.Y);
+        }
+    }
+    return result;
+}
+
+bool PolygonUtils::haveSamePoints(const Polygons& a, const Polygons& b)
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+    for (unsigned int poly_idx = 0; poly_idx < a.size(); poly_idx++)
+    {
+        const PolygonRef poly_a = a[poly_idx];
+        const PolygonRef poly_b = b[poly_idx];
+        if (poly_a.size() != poly_b.size())
+        {
+            return false;
+        }
+        for (unsigned int point_idx = 0; point_idx < poly_a.size(); point_idx++)
+        {
+            if (poly_a[point_idx] != poly_b[point_idx])
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
 
 }//namespace cura
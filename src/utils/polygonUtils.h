@@ -230,6 +230,9 @@ public:
      * Create a SparseGrid mapping from locations to line segments occurring in the \p polygons
      * 
      * \warning The caller of this function is responsible for deleting the returned object
+     *
+     * The cell size is also the distance within which \ref PolygonUtils::findClose looks for line segments,
+     * so unlike most grids it can't be chosen from the density of the segments by SparseGridInvasive::chooseCellSize.
      * 
      * \param polygons The polygons for which to create the mapping
      * \param square_size The cell size used to bundle line segments (also used to chop up lines so that multiple cells contain the same long line)
@@ -354,6 +357,16 @@ public:
      */
     static bool polygonCollidesWithlineSegment(const Polygons& polys, Point& startPoint, Point& endPoint);
 
+    /*!
+     * Compute a hash of all points of some polygons, to quickly rule out most polygons which aren't the same.
+     */
+    static uint64_t hashPoints(const Polygons& polygons);
+
+    /*!
+     * Whether two collections of polygons consist of the same points in the same order.
+     */
+    static bool haveSamePoints(const Polygons& a, const Polygons& b);
+
 private:
     /*!
      * Helper function for PolygonUtils::moveInside2: moves a point \p from which was moved onto \p closest_polygon_point towards inside/outside when it's not already inside/outside by enough distance.
@@ -1,64 +1,74 @@
 #include "wallOverlap.h"
 
+#include <algorithm> // min
 #include <cmath> // isfinite
 #include <sstream>
 
-#include "utils/AABB.h" // for debug output svg html
 #include "utils/SVG.h"
 
-namespace cura 
+namespace cura
 {
 
+constexpr unsigned int WallOverlapComputation::no_index;
+
 WallOverlapComputation::WallOverlapComputation(Polygons& polygons, int lineWidth)
  : polygons(polygons)
- , line_width(lineWidth) 
-{ 
+ , line_width(lineWidth)
+{
     unsigned int n_points = 0;
     for (PolygonRef poly : polygons)
     {
         n_points += poly.size();
     }
 
-    // reserve enough elements so that iterators don't get invalidated
-    overlap_point_links.reserve(n_points * 2); // generally enough, unless there are a lot of 3-way intersections in the model
-    overlap_point_links_endings.reserve(n_points * 2); // any point can at most introduce two endings
+    links.reserve(n_points);
+    point_to_link.reserve(n_points * 2);
+
+    // the line segments near a point are looked up among the original segments. The inserted points lie on those, so the index stays valid.
+    const PolygonsSegmentIndex segment_index(polygons);
 
-    // convert to list polygons for insertion of points
-    convertPolygonsToLists(polygons, list_polygons); 
+    // convert to linked nodes for insertion of points
+    convertPolygonsToNodes();
 
-    findOverlapPoints();
+    findOverlapPoints(segment_index);
     addOverlapEndings();
     // TODO: add sharp corners
 
-    // convert list polygons back
-    convertListPolygonsToPolygons(list_polygons, polygons);
+    // convert the nodes back
+    convertNodesToPolygons();
 //     wallOverlaps2HTML("output/output.html");
-//     list_polygons.clear(); // clear up some space! (unneccesary? it's just for the time the gcode is being generated...)
 }
 
 
-void WallOverlapComputation::findOverlapPoints()
+void WallOverlapComputation::findOverlapPoints(const PolygonsSegmentIndex& segment_index)
 {
-    for (unsigned int poly_idx = 0; poly_idx < list_polygons.size(); poly_idx++)
+    std::vector<unsigned int> segment_ends;
+    for (unsigned int poly_idx = 0; poly_idx < polygon_last_nodes.size(); poly_idx++)
     {
-        ListPolygon& poly = list_polygons[poly_idx];
+        const unsigned int last_node = polygon_last_nodes[poly_idx];
+        if (last_node == no_index)
+        {
+            continue;
+        }
+        AABB near_box;
+        for (const Point& p : polygons[poly_idx])
+        {
+            near_box.include(p);
+        }
+        near_box.expand(line_width + 10);
         for (unsigned int poly2_idx = 0; poly2_idx <= poly_idx; poly2_idx++)
         {
-            for (ListPolygon::iterator it = poly.begin(); it != poly.end(); ++it)
+            if (polygon_last_nodes[poly2_idx] == no_index || !segment_index.polygonIsNear(poly2_idx, near_box))
+            { // no line segment of the other polygon is close enough to have overlap
+                continue;
+            }
+            // points inserted into this polygon while checking it against itself are checked as well
+            for (unsigned int node_idx = nodes[last_node].next; ; node_idx = nodes[node_idx].next)
             {
-                ListPolyIt lpi(poly, it);
-                if (poly_idx == poly2_idx)
+                findOverlapPoints(node_idx, poly2_idx, segment_index, segment_ends);
+                if (node_idx == last_node)
                 {
-//                     ListPolygon::iterator it2(it);
-//                     ++it2;
-//                     if (it2 != poly.end())
-                    {
-                        findOverlapPoints(lpi, poly2_idx, it);
-                    }
-                }
-                else 
-                {
-                    findOverlapPoints(lpi, poly2_idx);
+                    break;
                 }
             }
         }
@@ -66,175 +76,223 @@ void WallOverlapComputation::findOverlapPoints()
 }
 
 
-    
-void WallOverlapComputation::convertPolygonsToLists(Polygons& polys, ListPolygons& result)
+
+void WallOverlapComputation::convertPolygonsToNodes()
 {
-    for (PolygonRef poly : polys)
+    unsigned int n_points = 0;
+    for (PolygonRef poly : polygons)
     {
-        result.emplace_back();
-        for (Point& p : poly) 
-        {
-            result.back().push_back(p);
-        }
+        n_points += poly.size();
     }
-}    
-
-void WallOverlapComputation::convertListPolygonsToPolygons(ListPolygons& list_polygons, Polygons& polygons)
-{
+    nodes.reserve(n_points * 2);
     for (unsigned int poly_idx = 0; poly_idx < polygons.size(); poly_idx++)
     {
-        polygons[poly_idx].clear();
-        for (Point& p : list_polygons[poly_idx])
+        PolygonRef poly = polygons[poly_idx];
+        if (poly.size() == 0)
+        {
+            polygon_last_nodes.push_back(no_index);
+            continue;
+        }
+        const unsigned int first_node = nodes.size();
+        for (unsigned int point_idx = 0; point_idx < poly.size(); point_idx++)
         {
-            polygons[poly_idx].add(p);
+            const unsigned int node_idx = nodes.size();
+            const unsigned int prev = (point_idx == 0) ? first_node + poly.size() - 1 : node_idx - 1;
+            const unsigned int next = (point_idx + 1 == poly.size()) ? first_node : node_idx + 1;
+            nodes.push_back(Node{poly[point_idx], prev, next, poly_idx, point_idx, no_index});
         }
+        polygon_last_nodes.push_back(nodes.size() - 1);
     }
 }
-    
-void WallOverlapComputation::findOverlapPoints(ListPolyIt from, unsigned int to_list_poly_idx)
-{
-    findOverlapPoints(from, to_list_poly_idx, list_polygons[to_list_poly_idx].begin());
-}
 
-void WallOverlapComputation::findOverlapPoints(ListPolyIt from_it, unsigned int to_list_poly_idx, const ListPolygon::iterator start)
+void WallOverlapComputation::convertNodesToPolygons()
 {
-    ListPolygon& to_list_poly = list_polygons[to_list_poly_idx];
-    Point& from = from_it.p();
-    ListPolygon::iterator last_it = to_list_poly.end();
-    last_it--;
-    for (ListPolygon::iterator it = start; it != to_list_poly.end(); ++it)
+    for (unsigned int poly_idx = 0; poly_idx < polygons.size(); poly_idx++)
     {
-        Point& last_point = *last_it;
-        Point& point = *it;
-        
-        if (&from_it.poly == &to_list_poly 
-            && (
-                (from_it.it == last_it || from_it.it == it) // we currently consider a linesegment directly connected to [from]
-                || (from_it.prev().it == it || from_it.next().it == last_it) // line segment from [last_point] to [point] is connected to line segment of which [from] is the other end
-                ) 
-           )
-        { 
-            last_it = it;
-            continue;
-        }
-        Point closest = LinearAlg2D::getClosestOnLineSegment(from, last_point, point);
-        
-        int64_t dist2 = vSize2(closest - from);
-        
-        if (dist2 > line_width * line_width
-            || (&from_it.poly == &to_list_poly 
-                && dot(from_it.next().p() - from, point - last_point) > 0 
-                && dot(from - from_it.prev().p(), point - last_point) > 0  ) // line segments are likely connected, because the winding order is in the same general direction
-        )
-        { // line segment too far away to have overlap
-            last_it = it;
-            continue;
-        }
-        
-        int64_t dist = sqrt(dist2);
-        
-        if (shorterThen(closest - last_point, 10))
-        {
-            addOverlapPoint(from_it, ListPolyIt(to_list_poly, last_it), dist);
-        }
-        else if (shorterThen(closest - point, 10))
+        PolygonRef poly = polygons[poly_idx];
+        poly.clear();
+        const unsigned int last_node = polygon_last_nodes[poly_idx];
+        if (last_node == no_index)
         {
-            addOverlapPoint(from_it, ListPolyIt(to_list_poly, it), dist);
+            continue;
         }
-        else 
+        for (unsigned int node_idx = nodes[last_node].next; ; node_idx = nodes[node_idx].next)
         {
-            ListPolygon::iterator new_it = to_list_poly.insert(it, closest);
-            addOverlapPoint(from_it, ListPolyIt(to_list_poly, new_it), dist);
+            poly.add(nodes[node_idx].p);
+            if (node_idx == last_node)
+            {
+                break;
+            }
         }
-        
-        last_it = it;
     }
-    
 }
 
+unsigned int WallOverlapComputation::insertNode(unsigned int before, Point p)
+{
+    const unsigned int node_idx = nodes.size();
+    const Node& next = nodes[before];
+    nodes.push_back(Node{p, next.prev, before, next.poly_idx, next.segment_idx, no_index});
+    nodes[nodes[node_idx].prev].next = node_idx;
+    nodes[before].prev = node_idx;
+    return node_idx;
+}
+
+void WallOverlapComputation::findOverlapPoints(unsigned int from_idx, unsigned int to_poly_idx, const PolygonsSegmentIndex& segment_index, std::vector<unsigned int>& segment_ends)
+{
+    const bool same_poly = nodes[from_idx].poly_idx == to_poly_idx;
+    const unsigned int from_segment_idx = nodes[from_idx].segment_idx;
+    const unsigned int to_point_count = polygons[to_poly_idx].size();
+    const unsigned int to_first_node = polygon_last_nodes[to_poly_idx] + 1 - to_point_count;
+    AABB near_box;
+    near_box.include(nodes[from_idx].p);
+    near_box.expand(line_width + 10);
+    auto check_segment = [this, from_idx, same_poly, from_segment_idx, to_point_count, to_first_node, &segment_ends](unsigned int segment_end_idx)
+        {
+            if (same_poly && segment_end_idx < from_segment_idx)
+            { // only the segments after [from] are checked
+                return true;
+            }
+            // the points inserted on the original line segment split it into several segments
+            const unsigned int segment_start = to_first_node + (segment_end_idx + to_point_count - 1) % to_point_count;
+            segment_ends.clear();
+            unsigned int node_idx = to_first_node + segment_end_idx;
+            do
+            {
+                if (node_idx == from_idx)
+                {
+                    break;
+                }
+                segment_ends.push_back(node_idx);
+                node_idx = nodes[node_idx].prev;
+            } while (node_idx != segment_start);
+            for (std::vector<unsigned int>::reverse_iterator it = segment_ends.rbegin(); it != segment_ends.rend(); ++it)
+            {
+                findOverlapPoint(from_idx, *it, same_poly);
+            }
+            return true;
+        };
+    segment_index.processSegmentsNear(to_poly_idx, near_box, check_segment);
+}
 
-bool WallOverlapComputation::addOverlapPoint(ListPolyIt from, ListPolyIt to, int64_t dist)
+void WallOverlapComputation::findOverlapPoint(unsigned int from_idx, unsigned int it, bool same_poly)
 {
-    WallOverlapPointLink link(from, to);
-    WallOverlapPointLinkAttributes attr(dist, false);
-    std::pair<WallOverlapPointLinks::iterator, bool> result =
-        overlap_point_links.emplace(link, attr);
-        
-    if (! result.second)
-    { // we already have the link
-//         DEBUG_PRINTLN("couldn't emplace in overlap_point_links! : ");
-        result.first->second = attr;
+    const Point from = nodes[from_idx].p;
+    const unsigned int last_it = nodes[it].prev;
+    const Point last_point = nodes[last_it].p;
+    const Point point = nodes[it].p;
+
+    if (same_poly
+        && (
+            (from_idx == last_it || from_idx == it) // we currently consider a linesegment directly connected to [from]
+            || (nodes[from_idx].prev == it || nodes[from_idx].next == last_it) // line segment from [last_point] to [point] is connected to line segment of which [from] is the other end
+            )
+       )
+    {
+        return;
+    }
+    Point closest = LinearAlg2D::getClosestOnLineSegment(from, last_point, point);
+
+    int64_t dist2 = vSize2(closest - from);
+
+    if (dist2 > line_width * line_width
+        || (same_poly
+            && dot(nodes[nodes[from_idx].next].p - from, point - last_point) > 0
+            && dot(from - nodes[nodes[from_idx].prev].p, point - last_point) > 0  ) // line segments are likely connected, because the winding order is in the same general direction
+    )
+    { // line segment too far away to have overlap
+        return;
+    }
+
+    int64_t dist = sqrt(dist2);
+
+    if (shorterThen(closest - last_point, 10))
+    {
+        addOverlapPoint(from_idx, last_it, dist, false);
+    }
+    else if (shorterThen(closest - point, 10))
+    {
+        addOverlapPoint(from_idx, it, dist, false);
+    }
+    else
+    {
+        const unsigned int new_it = insertNode(it, closest);
+        addOverlapPoint(from_idx, new_it, dist, false);
     }
-    
-    WallOverlapPointLinks::iterator it = result.first;
-    addToPoint2LinkMap(*it->first.a.it, it);
-    addToPoint2LinkMap(*it->first.b.it, it);
-    
-    
-    return result.second;
 }
 
-bool WallOverlapComputation::addOverlapPoint_endings(ListPolyIt from, ListPolyIt to, int64_t dist)
+
+bool WallOverlapComputation::addOverlapPoint(unsigned int from, unsigned int to, int64_t dist, bool ending)
 {
-    WallOverlapPointLink link(from, to);
-    WallOverlapPointLinkAttributes attr(dist, false);
-    std::pair<WallOverlapPointLinks::iterator, bool> result =
-        overlap_point_links_endings.emplace(link, attr);
-        
-    if (! result.second)
+    unsigned int link_idx = nodes[from].first_link;
+    while (link_idx != no_index)
     {
-//         DEBUG_PRINTLN("couldn't emplace in overlap_point_links! : ");
-        result.first->second = attr;
+        const Link& link = links[link_idx];
+        if (link.ending == ending && (link.a == to || link.b == to))
+        {
+            break;
+        }
+        link_idx = (link.a == from) ? link.next_link_of_a : link.next_link_of_b;
+    }
+
+    const bool added = link_idx == no_index;
+    if (added)
+    {
+        link_idx = links.size();
+        links.push_back(Link{from, to, int(dist), false, ending, nodes[from].first_link, nodes[to].first_link});
+        nodes[from].first_link = link_idx;
+        nodes[to].first_link = link_idx;
+    }
+    else
+    { // we already have the link
+        links[link_idx].dist = dist;
+        links[link_idx].passed = false;
     }
-    
-    WallOverlapPointLinks::iterator it = result.first;
-    addToPoint2LinkMap(*it->first.a.it, it);
-    addToPoint2LinkMap(*it->first.b.it, it);
-    
-    
-    return result.second;
+
+    const Link& link = links[link_idx];
+    addToPoint2LinkMap(nodes[link.a].p, link_idx);
+    addToPoint2LinkMap(nodes[link.b].p, link_idx);
+
+    return added;
 }
 
 void WallOverlapComputation::addOverlapEndings()
 {
-    for (std::pair<WallOverlapPointLink, WallOverlapPointLinkAttributes> link_pair : overlap_point_links)
+    const unsigned int link_count = links.size(); // the links of the endings are added after these
+    for (unsigned int link_idx = 0; link_idx < link_count; link_idx++)
     {
+        const Link link = links[link_idx]; // copy, because adding links may reallocate them
 
-        if (link_pair.second.dist == line_width)
+        if (link.dist == line_width)
         { // its ending itself
             continue;
         }
-        WallOverlapPointLink& link = link_pair.first;
-        const ListPolyIt& a_1 = link.a;
-        const ListPolyIt& b_1 = link.b;
         // an overlap segment can be an ending in two directions
-        { 
-            ListPolyIt a_2 = a_1.next();
-            ListPolyIt b_2 = b_1.prev();
-            addOverlapEnding(link_pair, a_2, b_2, a_2, b_1);
+        {
+            const unsigned int a_2 = nodes[link.a].next;
+            const unsigned int b_2 = nodes[link.b].prev;
+            addOverlapEnding(link, a_2, b_2, a_2, link.b);
         }
-        { 
-            ListPolyIt a_2 = a_1.prev();
-            ListPolyIt b_2 = b_1.next();
-            addOverlapEnding(link_pair, a_2, b_2, a_1, b_2);
+        {
+            const unsigned int a_2 = nodes[link.a].prev;
+            const unsigned int b_2 = nodes[link.b].next;
+            addOverlapEnding(link, a_2, b_2, link.a, b_2);
         }
     }
 }
 
-void WallOverlapComputation::addOverlapEnding(std::pair<WallOverlapPointLink, WallOverlapPointLinkAttributes> link_pair, const ListPolyIt& a2_it, const ListPolyIt& b2_it, const ListPolyIt& a_after_middle, const ListPolyIt& b_after_middle)
+void WallOverlapComputation::addOverlapEnding(const Link& link, unsigned int a2_idx, unsigned int b2_idx, unsigned int a_after_middle, unsigned int b_after_middle)
 {
-    WallOverlapPointLink& link = link_pair.first;
-    Point& a1 = link.a.p();
-    Point& a2 = a2_it.p();
-    Point& b1 = link.b.p();
-    Point& b2 = b2_it.p();
+    Point a1 = nodes[link.a].p;
+    Point a2 = nodes[a2_idx].p;
+    Point b1 = nodes[link.b].p;
+    Point b2 = nodes[b2_idx].p;
     Point a = a2-a1;
     Point b = b2-b1;
 
-    if (point_to_link.find(a2_it.p()) == point_to_link.end() 
-        || point_to_link.find(b2_it.p()) == point_to_link.end())
+    if (point_to_link.find(a2) == point_to_link.end()
+        || point_to_link.find(b2) == point_to_link.end())
     {
-        int64_t dist = overlapEndingDistance(a1, a2, b1, b2, link_pair.second.dist);
+        int64_t dist = overlapEndingDistance(a1, a2, b1, b2, link.dist);
         if (dist < 0) { return; }
         int64_t a_length2 = vSize2(a);
         int64_t b_length2 = vSize2(b);
@@ -245,31 +303,31 @@ void WallOverlapComputation::addOverlapEnding(std::pair<WallOverlapPointLink, Wa
             if (a_length2 < b_length2)
             {
                 Point b_p = b1 + normal(b, dist);
-                ListPolygon::iterator new_b = link.b.poly.insert(b_after_middle.it, b_p);
-                addOverlapPoint_endings(a2_it, ListPolyIt(link.b.poly, new_b), line_width);
+                const unsigned int new_b = insertNode(b_after_middle, b_p);
+                addOverlapPoint(a2_idx, new_b, line_width, true);
             }
             else if (b_length2 < a_length2)
             {
                 Point a_p = a1 + normal(a, dist);
-                ListPolygon::iterator new_a = link.a.poly.insert(a_after_middle.it, a_p);
-                addOverlapPoint_endings(ListPolyIt(link.a.poly, new_a), b2_it, line_width);
+                const unsigned int new_a = insertNode(a_after_middle, a_p);
+                addOverlapPoint(new_a, b2_idx, line_width, true);
             }
             else // equal
             {
-                addOverlapPoint_endings(a2_it, b2_it, line_width);
+                addOverlapPoint(a2_idx, b2_idx, line_width, true);
             }
         }
         if (dist > 0)
         {
             Point a_p = a1 + normal(a, dist);
-            ListPolygon::iterator new_a = link.a.poly.insert(a_after_middle.it, a_p);
+            const unsigned int new_a = insertNode(a_after_middle, a_p);
             Point b_p = b1 + normal(b, dist);
-            ListPolygon::iterator new_b = link.b.poly.insert(b_after_middle.it, b_p);
-            addOverlapPoint_endings(ListPolyIt(link.a.poly, new_a), ListPolyIt(link.b.poly, new_b), line_width);
+            const unsigned int new_b = insertNode(b_after_middle, b_p);
+            addOverlapPoint(new_a, new_b, line_width, true);
         }
         else if (dist == 0)
         {
-            addOverlapPoint_endings(link.a, link.b, line_width);
+            addOverlapPoint(link.a, link.b, line_width, true);
         }
     }
 }
@@ -280,9 +338,9 @@ int64_t WallOverlapComputation::overlapEndingDistance(Point& a1, Point& a2, Poin
     Point a = a2-a1;
     Point b = b2-b1;
     double cos_angle = INT2MM2(dot(a, b)) / vSizeMM(a) / vSizeMM(b);
-    // result == .5*overlap / tan(.5*angle) == .5*overlap / tan(.5*acos(cos_angle)) 
+    // result == .5*overlap / tan(.5*angle) == .5*overlap / tan(.5*acos(cos_angle))
     // [wolfram alpha] == 0.5*overlap * sqrt(cos_angle+1)/sqrt(1-cos_angle)
-    // [assuming positive x] == 0.5*overlap / sqrt( 2 / (cos_angle + 1) - 1 ) 
+    // [assuming positive x] == 0.5*overlap / sqrt( 2 / (cos_angle + 1) - 1 )
     if (cos_angle <= 0
         || ! std::isfinite(cos_angle) )
     {
@@ -292,22 +350,22 @@ int64_t WallOverlapComputation::overlapEndingDistance(Point& a1, Point& a2, Poin
     {
         return std::min(vSize(b), vSize(a));
     }
-    else 
+    else
     {
         int64_t dist = overlap * double ( 1.0 / (2.0 * sqrt(2.0 / (cos_angle+1.0) - 1.0)) );
         return dist;
     }
-    
+
 }
 
 void WallOverlapComputation::addSharpCorners()
 {
-    
+
 }
-    
-void WallOverlapComputation::addToPoint2LinkMap(Point p, WallOverlapPointLinks::iterator it)
+
+void WallOverlapComputation::addToPoint2LinkMap(Point p, unsigned int link_idx)
 {
-    point_to_link.emplace(p, it);
+    point_to_link.emplace(p, link_idx);
     // TODO: what to do if the map already contained a link? > three-way overlap
 }
 
@@ -315,31 +373,29 @@ float WallOverlapComputation::getFlow(Point& from, Point& to)
 {
     Point2Link::iterator from_link_pair = point_to_link.find(from);
     if (from_link_pair == point_to_link.end()) { return 1; }
-    WallOverlapPointLinks::iterator from_link = from_link_pair->second;
-    WallOverlapPointLinkAttributes& from_attr = from_link->second;
+    Link& from_link = links[from_link_pair->second];
 
     Point2Link::iterator to_link_pair = point_to_link.find(to);
     if (to_link_pair == point_to_link.end()) { return 1; }
-    WallOverlapPointLinks::iterator to_link = to_link_pair->second;
-    WallOverlapPointLinkAttributes& to_attr = to_link->second;
+    Link& to_link = links[to_link_pair->second];
 
-    if (!from_attr.passed || !to_attr.passed)
+    if (!from_link.passed || !to_link.passed)
     {
-        from_attr.passed = true;
-        to_attr.passed = true;
+        from_link.passed = true;
+        to_link.passed = true;
         return 1;
     }
-    from_attr.passed = true;
-    to_attr.passed = true;
+    from_link.passed = true;
+    to_link.passed = true;
 
     // both points have already been passed
 
-    float avg_link_dist = 0.5 * ( INT2MM(from_link->second.dist) + INT2MM(to_link->second.dist) );
+    float avg_link_dist = 0.5 * ( INT2MM(from_link.dist) + INT2MM(to_link.dist) );
 
     float ratio = avg_link_dist / INT2MM(line_width);
 
     if (ratio > 1.0) { return 1.0; }
-    
+
     return ratio;
 }
 
@@ -347,91 +403,81 @@ float WallOverlapComputation::getFlow(Point& from, Point& to)
 
 void WallOverlapComputation::debugCheck()
 {
-    for (std::pair<WallOverlapPointLink, WallOverlapPointLinkAttributes> pair : overlap_point_links)
+    for (const Link& link : links)
     {
-        if (std::abs(vSize( pair.first.a.p() - pair.first.b.p()) - pair.second.dist) > 10)
-            std::cerr << vSize( pair.first.a.p() - pair.first.b.p())<<" != " << pair.second.dist << "\n";
-        
+        if (link.ending)
+        {
+            continue;
+        }
+        if (std::abs(vSize(nodes[link.a].p - nodes[link.b].p) - link.dist) > 10)
+            std::cerr << vSize(nodes[link.a].p - nodes[link.b].p)<<" != " << link.dist << "\n";
+
     }
 }
 
 void WallOverlapComputation::debugCheckNonePassedYet()
 {
-    for (std::pair<WallOverlapPointLink, WallOverlapPointLinkAttributes> pair : overlap_point_links)
+    for (const Link& link : links)
     {
-        if (pair.second.passed)
+        if (!link.ending && link.passed)
         {
             logError("ERROR: WallOverlapComputation link passed just after contruction!!!\n");
         }
-        
+
     }
 }
 
 
 
 void WallOverlapComputation::wallOverlaps2HTML(const char* filename) const
-{   
-    
+{
+
     WallOverlapComputation copy = *this; // copy, cause getFlow might change the state of the overlap computation!
-    
+
     AABB aabb(copy.polygons);
-    
+
     aabb.expand(200);
-    
+
     SVG svg(filename, aabb, Point(1024 * 2, 1024 * 2));
-    
-    
+
+
     svg.writeAreas(copy.polygons);
-    
+
     { // output points and coords
-        for (ListPolygon poly : copy.list_polygons)
+        for (const Node& node : copy.nodes)
         {
-            for (Point& p : poly)
-            {
-                svg.writePoint(p, true);
-            }
+            svg.writePoint(node.p, true);
         }
     }
 
-    { // output links
-        // output normal links
-        for (std::pair<WallOverlapPointLink , WallOverlapPointLinkAttributes> link_pair : copy.overlap_point_links)
+    { // output links, both normal links and ending links
+        for (const Link& link : copy.links)
         {
-            WallOverlapPointLink& link = link_pair.first;
-            Point a = svg.transform(link.a.p());
-            Point b = svg.transform(link.b.p());
-            svg.printf("<line x1=\"%lli\" y1=\"%lli\" x2=\"%lli\" y2=\"%lli\" style=\"stroke:rgb(%d,%d,0);stroke-width:1\" />", a.X, a.Y, b.X, b.Y, link_pair.second.dist == line_width? 0 : 255, link_pair.second.dist==line_width? 255 : 0);
-        }
-        
-        // output ending links
-        for (std::pair<WallOverlapPointLink , WallOverlapPointLinkAttributes> link_pair : copy.overlap_point_links_endings)
-        {
-            WallOverlapPointLink& link = link_pair.first;
-            Point a = svg.transform(link.a.p());
-            Point b = svg.transform(link.b.p());
-            svg.printf("<line x1=\"%lli\" y1=\"%lli\" x2=\"%lli\" y2=\"%lli\" style=\"stroke:rgb(%d,%d,0);stroke-width:1\" />", a.X, a.Y, b.X, b.Y, link_pair.second.dist == line_width? 0 : 255, link_pair.second.dist==line_width? 255 : 0);
+            Point a = svg.transform(copy.nodes[link.a].p);
+            Point b = svg.transform(copy.nodes[link.b].p);
+            svg.printf("<line x1=\"%lli\" y1=\"%lli\" x2=\"%lli\" y2=\"%lli\" style=\"stroke:rgb(%d,%d,0);stroke-width:1\" />", a.X, a.Y, b.X, b.Y, link.dist == line_width? 0 : 255, link.dist==line_width? 255 : 0);
         }
     }
 
     { // output flow
-        for (ListPolygon poly : copy.list_polygons)
+        for (PolygonRef poly : copy.polygons)
         {
             Point p0 = poly.back();
             svg.writePoint(p0, false, 5, SVG::Color::BLUE); // make start points of each poly blue
             for (Point& p1 : poly)
             {
                 Point middle = (p0 + p1) / 2;
-                
+
                 float flow = copy.getFlow(p0, p1);
-                
+
                 std::stringstream oss;
                 oss << "flow: " << flow;
                 svg.writeText(middle, oss.str());
-                
+
                 p0 = p1;
             }
         }
     }
 }
-    
-}//namespace cura 
+
+}//namespace cura
@@ -3,16 +3,16 @@
 
 #include <vector>
 #include <unordered_map>
-#include <unordered_set>
-#include <list>
+#include <limits>
 
 #include <functional> // hash function object
 
 #include "utils/intpoint.h"
 #include "utils/polygon.h"
 #include "utils/linearAlg2D.h"
+#include "utils/PolygonsSegmentIndex.h"
 
-namespace cura 
+namespace cura
 {
 
 /*!
@@ -20,243 +20,202 @@ namespace cura
  * The overlapping area is approximated with connected trapzoids.
  * All places where the wall is closer than the nozzle width to another piece of wall are recorded.
  * The area of a trapezoid is then the length between two such locations multiplied by the average overlap at the two locations.
- * 
+ *
  * The amount of overlap between two locations is recorded in a link, so that we can look up the overlap at a given point in the polygon.
  * A link always occurs between a point already on a polygon and either another point of a polygon or a point on a line segment of a polygon.
  * In the latter case we insert the point into the polygon so that we can later look up by how much to reduce the extrusion at the corresponding line segment.
- * This is the reason that the polygons are converted to linked lists before the wall overlap compensation computation takes place, after which they are converted back.
- * 
+ * This is the reason that the polygons are converted to linked lists of nodes before the wall overlap compensation computation takes place, after which they are converted back.
+ * The nodes of all polygons are kept in a single vector and linked by index, so that inserted points don't need an allocation each.
+ *
  * At the end of a sequence of trapezoids the overlap area generally ends with a residual triangle.
  * Therefore points are introduced on the line segments involved and a link is created with overlap zero.
- * 
- * We end up with a mapping from each link to a boolean value representing whether the trapezoid is already compensated for.
- * Each point on the polygons then maps to a link (and its corresponding boolean), so that we can easily look up which links corresponds 
+ *
+ * We end up with a boolean value for each link representing whether the trapezoid is already compensated for.
+ * Each point on the polygons then maps to a link (and its corresponding boolean), so that we can easily look up which links corresponds
  * to the current line segment being produced when producing gcode.
- * 
+ *
  * When producing gcode, the first line crossing the overlap area is laid down normally and the second line is reduced by the overlap amount.
  * For this reason the function WallOverlapComputation::getFlow changes the internal state of this WallOverlapComputation.
- * 
+ *
  * The main functionality of this class is performed by the constructor.
  * The adjustment during gcode generation is made with the help of WallOverlapComputation::getFlow
  */
 class WallOverlapComputation
 {
-    
-    typedef std::list<Point> ListPolygon; //!< A polygon represented by a linked list instead of a vector
-    typedef std::vector<ListPolygon> ListPolygons; //!< Polygons represented by a vector of linked lists instead of a vector of vectors
-        
-    /*!
-     * Convert Polygons to ListPolygons
-     * 
-     * \param polys The polygons to convert
-     * \param result The converted polygons
-     */
-    static void convertPolygonsToLists(Polygons& polys, ListPolygons& result);
-    /*!
-     * Convert ListPolygons to Polygons
-     * 
-     * \param list_polygons The polygons to convert
-     * \param polygons The converted polygons
-     */
-    static void convertListPolygonsToPolygons(ListPolygons& list_polygons, Polygons& polygons);
-    
-    
+    static constexpr unsigned int no_index = std::numeric_limits<unsigned int>::max(); //!< The index of no node or no link
+
     /*!
-     * A wrapper class for a ListPolygon::iterator and a reference to the containing ListPolygon
+     * A point of a polygon, linked to the points before and after it in its polygon.
+     *
+     * The polygons are stored as circular doubly linked lists of nodes in WallOverlapComputation::nodes.
+     * The original points of all polygons come first, in order, and inserted points are added at the end.
+     *
+     * Points are only inserted on line segments, so that each node lies on one of the original line segments.
+     * The nodes on the original line segment ending in original point \p i come right before that point in the polygon.
+     * The polygon therefore starts with the nodes inserted on the segment ending in its first original point.
      */
-    struct ListPolyIt
+    struct Node
     {
-        ListPolygon& poly; //!< The polygon
-        ListPolygon::iterator it; //!< The iterator into ListPolyIt::poly
-        ListPolyIt(const ListPolyIt& other)
-        : poly(other.poly), it(other.it) { }
-        ListPolyIt(ListPolygon& poly, ListPolygon::iterator it)
-        : poly(poly), it(it) { }
-        Point& p() const { return *it; }
-        /*!
-         * Test whether two iterators refer to the same polygon in the same polygon list.
-         * 
-         * \param other The ListPolyIt to test for equality
-         * \return Wether the right argument refers to the same polygon in the same ListPolygon as the left argument.
-         */
-        bool operator==(const ListPolyIt& other) const
-        {
-            return &poly == &other.poly && it == other.it;
-        }
-        void operator=(const ListPolyIt& other) { poly = other.poly; it = other.it; }
-        //!< move the iterator forward (and wrap around at the end)
-        ListPolyIt& operator++() 
-        { 
-            ++it; 
-            if (it == poly.end()) { it = poly.begin(); }
-            return *this; 
-        }
-        //!< move the iterator backward (and wrap around at the beginning)
-        ListPolyIt& operator--() 
-        { 
-            if (it == poly.begin()) { it = poly.end(); }
-            --it; 
-            return *this; 
-        }
-        ListPolyIt next() const 
-        {
-            ListPolyIt ret(*this);
-            ++ret;
-            return ret;
-        }
-        ListPolyIt prev() const 
-        {
-            ListPolyIt ret(*this);
-            --ret;
-            return ret;
-        }
+        Point p; //!< The location
+        unsigned int prev; //!< The node before this one in its polygon
+        unsigned int next; //!< The node after this one in its polygon
+        unsigned int poly_idx; //!< The polygon the node is in
+        unsigned int segment_idx; //!< The original point at which the original line segment on which this node lies ends
+        unsigned int first_link; //!< The last added link of this node in WallOverlapComputation::links, or no_index
     };
+
     /*!
-     * A class recording the amount of overlap implicitly by recording the distance between two points on two different polygons or one and the same polygon.
+     * A link recording the amount of overlap implicitly by recording the distance between two points on two different polygons or one and the same polygon.
      * The order of the two points doesn't matter.
      */
-    struct WallOverlapPointLink
-    {
-        const ListPolyIt a; //!< the one point (invalidated after list_polygons have been cleared!)
-        const ListPolyIt b; //!< the other point (invalidated after list_polygons have been cleared!)
-        WallOverlapPointLink(const ListPolyIt a, const ListPolyIt b) : a(a), b(b) { }
-        bool operator==(const WallOverlapPointLink& other) const { return (a == other.a && b == other.b) || (a == other.b && b == other.a); }
-    };
-    
-    /*!
-     * The hash function object for WallOverlapPointLink
-     */
-    struct WallOverlapPointLink_Hasher
-    {
-        std::size_t operator()(const WallOverlapPointLink& pp) const
-        {
-            return std::hash<Point>()(*pp.a.it) + std::hash<Point>()(*pp.b.it);
-        }
-    };
-
-    struct WallOverlapPointLinkAttributes
+    struct Link
     {
+        unsigned int a; //!< The node of the one point
+        unsigned int b; //!< The node of the other point
         int dist; //!< The distance between the two points
         bool passed; //!< Whether this point has been passed while writing gcode
-        WallOverlapPointLinkAttributes(int dist, bool passed) : dist(dist), passed(passed) { }
+        bool ending; //!< Whether it's the link of the ending of an overlap region (which has a distance equal to WallOverlapComputation::line_width)
+        unsigned int next_link_of_a; //!< The link of node \ref Link::a added before this one, or no_index
+        unsigned int next_link_of_b; //!< The link of node \ref Link::b added before this one, or no_index
     };
-    
-    typedef std::unordered_map<WallOverlapPointLink, WallOverlapPointLinkAttributes, WallOverlapPointLink_Hasher> WallOverlapPointLinks; //!< The type of WallOverlapComputation::overlap_point_links
-    typedef std::unordered_map<Point, WallOverlapPointLinks::iterator> Point2Link; //!< The type of WallOverlapComputation::point_to_link \warning mapping to iterators which might get invalidated!
-    
-    
+
+    typedef std::unordered_map<Point, unsigned int> Point2Link; //!< The type of WallOverlapComputation::point_to_link
+
     /////////////////////////////////////////////////////////////////////////////////////////////
-    
-    
+
+
     Polygons& polygons; //!< The polygons for which to compensate overlapping walls for
-    ListPolygons list_polygons; //!< The WallOverlapComputation::polygons converted
-    
+    std::vector<Node> nodes; //!< The WallOverlapComputation::polygons converted
+    std::vector<unsigned int> polygon_last_nodes; //!< For each polygon its original last point, after which its list ends, or no_index if the polygon is empty
+
     int line_width; //!< The line width of the walls
-    
-    WallOverlapPointLinks overlap_point_links; //!< mapping from each link to its attributes
-    WallOverlapPointLinks overlap_point_links_endings; //!< mapping from each ending link to its attributes (which has a distance field equal to WallOverlapComputation::line_width). Note that this is a separate map from WallOverlapComputation::overlap_point_links, because that magically solved a bug .
-    
-    Point2Link point_to_link; //!< mapping from each point to the/a corresponding link (collisions are ignored as of yet) \warning mapping to iterators which might get invalidated!
 
-    void findOverlapPoints(); //!< find the basic overlap links (for trapezoids) and record them into WallOverlapComputation::overlap_point_links
+    std::vector<Link> links; //!< All links: first those of the trapezoids, then those of the endings
+
+    Point2Link point_to_link; //!< mapping from each point to the/a corresponding link (collisions are ignored as of yet)
+
     /*!
-     * find the basic overlap links (for trapezoids) between a given point and a polygon and record them into WallOverlapComputation::overlap_point_links
-     * 
-     * \param from The point from which to check for overlap
-     * \param to_list_poly_idx The index into WallOverlapComputation::list_polygons for the polygon to check
+     * Convert WallOverlapComputation::polygons to linked nodes
      */
-    void findOverlapPoints(ListPolyIt from, unsigned int to_list_poly_idx);
+    void convertPolygonsToNodes();
+
     /*!
-     * Find the basic overlap links (for trapezoids) between a given point and a polygon up from a particular index and record them into WallOverlapComputation::overlap_point_links
-     * 
-     * This function is used for finding overlaps within a single polygon. It then uses a \p start different from the first point in the polygon.
-     * 
-     * \param from The point from which to check for overlap
-     * \param to_list_poly_idx The index into WallOverlapComputation::list_polygons for the polygon to check
-     * \param start Where to start looking into the polygon with index \p to_list_poly_idx
+     * Convert the linked nodes back to WallOverlapComputation::polygons
      */
-    void findOverlapPoints(ListPolyIt from, unsigned int to_list_poly_idx, const ListPolygon::iterator start);
-    
+    void convertNodesToPolygons();
+
     /*!
-     * Add a link between \p from and \p to to WallOverlapComputation::overlap_point_links and add the appropriate mappings to WallOverlapComputation::point_to_link
-     * 
-     * \param from The one point of the link
-     * \param to The other point of the link
-     * \param dist The distance between the two points
-     * \return Whether the point has been added
+     * Insert a point into a polygon.
+     *
+     * \param before The node before which to insert the point; it lies on the line segment ending in this node
+     * \param p The point to insert
+     * \return The node of the inserted point
+     */
+    unsigned int insertNode(unsigned int before, Point p);
+
+    /*!
+     * find the basic overlap links (for trapezoids) and record them into WallOverlapComputation::links
+     *
+     * \param segment_index The original line segments of WallOverlapComputation::polygons
+     */
+    void findOverlapPoints(const PolygonsSegmentIndex& segment_index);
+
+    /*!
+     * find the basic overlap links (for trapezoids) between a given point and a polygon and record them into WallOverlapComputation::links
+     *
+     * The line segments are checked in the order of the polygon.
+     * For a point on the polygon itself, only the line segments after the point are checked.
+     *
+     * \param from The node from which to check for overlap
+     * \param to_poly_idx The index of the polygon to check
+     * \param segment_index The original line segments of WallOverlapComputation::polygons
+     * \param segment_ends Buffer for the ends of the segments into which an original line segment has been split
+     */
+    void findOverlapPoints(unsigned int from, unsigned int to_poly_idx, const PolygonsSegmentIndex& segment_index, std::vector<unsigned int>& segment_ends);
+
+    /*!
+     * Find the basic overlap link (for a trapezoid) between a given point and a line segment and record it into WallOverlapComputation::links
+     *
+     * \param from The node from which to check for overlap
+     * \param to The node at which the line segment ends; it starts at the node before it
+     * \param same_poly Whether \p from and \p to are in the same polygon
      */
-    bool addOverlapPoint(ListPolyIt from, ListPolyIt to, int64_t dist);
+    void findOverlapPoint(unsigned int from, unsigned int to, bool same_poly);
+
     /*!
-     * Add a link between \p from and \p to to WallOverlapComputation::overlap_point_links_endings and add the appropriate mappings to WallOverlapComputation::point_to_link
-     * 
+     * Add a link between \p from and \p to to WallOverlapComputation::links, or update the same link if it was already added, and add the appropriate mappings to WallOverlapComputation::point_to_link
+     *
+     * Links of endings are kept apart from the other links, even if they connect the same points.
+     *
      * \param from The one point of the link
      * \param to The other point of the link
      * \param dist The distance between the two points
-     * \return Whether the point has been added
+     * \param ending Whether it's the link of an overlap ending
+     * \return Whether the link has been added
      */
-    bool addOverlapPoint_endings(ListPolyIt from, ListPolyIt to, int64_t dist);
-    
+    bool addOverlapPoint(unsigned int from, unsigned int to, int64_t dist, bool ending);
+
     /*!
      * Add links for the ending points of overlap regions, supporting the residual triangles.
      */
     void addOverlapEndings();
-    
+
     /*!
      * Add a link for the ending point of a given overlap region, if it is an ending.
-     * 
-     * \param link_pair The link which might be an ending
-     * \param a_next The next point from ListPolyIt::a of \p link 
-     * \param b_next The next point from ListPolyIt::b of \p link (in the opposite direction of \p a_next)
-     * \param a_before_middle Where to insert a new point for a if this is indeed en ending
-     * \param b_before_middle Where to insert a new point for b if this is indeed en ending
-     */
-    void addOverlapEnding(std::pair<WallOverlapPointLink, WallOverlapPointLinkAttributes> link_pair, const ListPolyIt& a_next, const ListPolyIt& b_next, const ListPolyIt& a_before_middle, const ListPolyIt& b_before_middle);
-    
+     *
+     * \param link The link which might be an ending
+     * \param a2 The next point from Link::a of \p link
+     * \param b2 The next point from Link::b of \p link (in the opposite direction of \p a2)
+     * \param a_after_middle Before which node to insert a new point for a if this is indeed en ending
+     * \param b_after_middle Before which node to insert a new point for b if this is indeed en ending
+     */
+    void addOverlapEnding(const Link& link, unsigned int a2, unsigned int b2, unsigned int a_after_middle, unsigned int b_after_middle);
+
     /*!
      * Compute the distance between the points of the last link and the points introduced to account for the overlap endings.
      */
     int64_t overlapEndingDistance(Point& a1, Point& a2, Point& b1, Point& b2, int a1b1_dist);
-    
-    
+
+
     /*!
      * Add overlap links for sharp corners, so that the overlap of two consecutive line segments is compensated for.
-     * 
+     *
      * Currently UNIMPLEMENTED.
      */
     void addSharpCorners();
-        
+
     /*!
      * Map a point to a link in WallOverlapComputation::point_to_link
-     * 
+     *
      * \param p The key
-     * \param it The value
+     * \param link_idx The value
      */
-    void addToPoint2LinkMap(Point p, WallOverlapPointLinks::iterator it);
-    
+    void addToPoint2LinkMap(Point p, unsigned int link_idx);
+
 public:
     /*!
      * Compute the flow for a given line segment in the wall.
-     * 
+     *
      * \warning the first time this function is called it returns a different thing than the second, because the second time it thinks it already passed this segment once.
-     * 
+     *
      * \param from The beginning of the line segment
      * \param to The ending of the line segment
      * \return a value between zero and one representing the reduced flow of the line segment
      */
     float getFlow(Point& from, Point& to);
-    
+
     void debugCheck(); //!< debug
 
     void debugCheckNonePassedYet(); //!< check whether no link has passed set to true
-    
+
     void wallOverlaps2HTML(const char* filename) const; //!< debug
-    
+
     /*!
      * Computes the neccesary priliminaries in order to efficiently compute the flow when generatign gcode paths.
      * \param polygons The wall polygons for which to compute the overlaps
      */
     WallOverlapComputation(Polygons& polygons, int lineWidth);
-    
+
 };
 
 
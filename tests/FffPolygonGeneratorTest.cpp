@@ -0,0 +1,129 @@
+//Copyright (c) 2016 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "FffPolygonGeneratorTest.h"
+
+#include <sstream>
+
+namespace cura
+{
+
+CPPUNIT_TEST_SUITE_REGISTRATION(FffPolygonGeneratorTest);
+
+void FffPolygonGeneratorTest::setUp()
+{
+    slice = cura_slice_create();
+
+    //No definitions are loaded, so every setting the slice reads is set here.
+    const char* settings[][2] = {
+        {"machine_width", "300"}, {"machine_depth", "300"}, {"machine_height", "300"},
+        {"machine_extruder_count", "1"}, {"machine_gcode_flavor", "RepRap (Marlin/Sprinter)"},
+        {"machine_nozzle_size", "0.4"}, {"machine_nozzle_tip_outer_diameter", "1"},
+        {"material_diameter", "2.85"}, {"material_flow", "100"}, {"material_print_temperature", "210"},
+        {"layer_height", "0.2"}, {"layer_height_0", "0.3"},
+        {"line_width", "0.4"}, {"wall_line_width_0", "0.4"}, {"wall_line_width_x", "0.4"},
+        {"skin_line_width", "0.4"}, {"infill_line_width", "0.4"}, {"skirt_brim_line_width", "0.4"},
+        {"wall_line_count", "2"}, {"wall_thickness", "0.8"},
+        {"top_layers", "4"}, {"bottom_layers", "4"}, {"top_bottom_thickness", "0.8"},
+        {"infill_sparse_density", "20"}, {"infill_line_distance", "4"}, {"infill_pattern", "grid"},
+        {"infill_sparse_thickness", "0.2"}, {"skin_angles", "[]"}, {"infill_angles", "[]"},
+        {"skin_overlap_mm", "0.04"}, {"infill_overlap_mm", "0.04"}, {"infill_wipe_dist", "0"},
+        {"gradual_infill_steps", "0"}, {"gradual_infill_step_height", "5"},
+        {"speed_print", "50"}, {"speed_wall_0", "30"}, {"speed_wall_x", "40"}, {"speed_infill", "60"},
+        {"speed_topbottom", "30"}, {"speed_travel", "150"}, {"speed_layer_0", "20"},
+        {"speed_print_layer_0", "20"}, {"speed_travel_layer_0", "100"}, {"skirt_brim_speed", "20"},
+        {"retraction_amount", "4"}, {"retraction_retract_speed", "25"}, {"retraction_prime_speed", "25"},
+        {"retraction_min_travel", "1.5"}, {"retraction_count_max", "90"}, {"retraction_extrusion_window", "4"},
+        {"travel_avoid_distance", "0.5"},
+        {"cool_fan_speed_max", "100"}, {"cool_fan_speed_min", "100"}, {"cool_min_layer_time", "5"}, {"cool_min_speed", "10"},
+        {"jerk_enabled", "false"}, {"acceleration_enabled", "false"},
+        {"adhesion_type", "none"}, {"support_enable", "false"}, {"support_type", "everywhere"},
+        {"draft_shield_enabled", "false"}, {"ooze_shield_enabled", "false"}, {"prime_tower_enable", "false"},
+        {"xy_offset", "0"}, {"meshfix_maximum_deviation", "0"}, {"magic_mesh_surface_mode", "normal"},
+    };
+    for (const auto& setting : settings)
+    {
+        cura_slice_set_setting(slice, -1, setting[0], setting[1]);
+    }
+}
+
+void FffPolygonGeneratorTest::tearDown()
+{
+    cura_slice_destroy(slice);
+}
+
+void FffPolygonGeneratorTest::wallsPerLayerTest()
+{
+    //A pyramid, of which every layer is smaller than the one below. Layers are
+    //processed in ranges, so layers of the same range mustn't get the walls of
+    //another layer.
+    const float vertices[] = {
+        140, 140, 0,
+        160, 140, 0,
+        160, 160, 0,
+        140, 160, 0,
+        150, 150, 10,
+    };
+    const uint32_t indices[] = {
+        0, 1, 4,
+        1, 2, 4,
+        2, 3, 4,
+        3, 0, 4,
+        0, 2, 1,
+        0, 3, 2,
+    };
+    CPPUNIT_ASSERT_MESSAGE("The pyramid couldn't be added to the slice!", cura_slice_add_mesh(slice, vertices, 5, indices, 18, 0) == 0);
+
+    const std::vector<std::vector<std::string>> walls = sliceOuterWalls();
+
+    CPPUNIT_ASSERT_MESSAGE("The pyramid should've been sliced into about 50 layers!", walls.size() > 40);
+    for (unsigned int layer_nr = 1; layer_nr < walls.size(); layer_nr++)
+    {
+        if (walls[layer_nr].empty())
+        { //Only the tip, which is too small for a wall.
+            continue;
+        }
+        std::stringstream ss;
+        ss << "The outer wall of layer " << layer_nr << " is the same as that of the layer below, while the pyramid gets smaller!";
+        CPPUNIT_ASSERT_MESSAGE(ss.str(), walls[layer_nr] != walls[layer_nr - 1]);
+    }
+}
+
+std::vector<std::vector<std::string>> FffPolygonGeneratorTest::sliceOuterWalls()
+{
+    std::string gcode;
+    const int result = cura_slice_run(slice,
+        [](const char* data, size_t size, void* user_data)
+        {
+            static_cast<std::string*>(user_data)->append(data, size);
+        }, &gcode);
+    CPPUNIT_ASSERT_MESSAGE("Slicing failed!", result == 0);
+
+    std::vector<std::vector<std::string>> walls;
+    bool in_outer_wall = false;
+    std::istringstream lines(gcode);
+    std::string line;
+    while (std::getline(lines, line))
+    {
+        if (line.compare(0, 7, ";LAYER:") == 0)
+        {
+            walls.emplace_back();
+            in_outer_wall = false;
+        }
+        else if (line.compare(0, 6, ";TYPE:") == 0)
+        {
+            in_outer_wall = line == ";TYPE:WALL-OUTER";
+        }
+        else if (in_outer_wall && line.compare(0, 3, "G1 ") == 0)
+        {
+            const size_t x_pos = line.find(" X");
+            if (x_pos != std::string::npos)
+            {
+                walls.back().push_back(line.substr(x_pos, line.find(" E") - x_pos)); //Without the extrusion, which adds up over the layers.
+            }
+        }
+    }
+    return walls;
+}
+
+}
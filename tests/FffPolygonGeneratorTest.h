@@ -0,0 +1,60 @@
+//Copyright (c) 2016 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef FFF_POLYGON_GENERATOR_TEST_H
+#define FFF_POLYGON_GENERATOR_TEST_H
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <string>
+#include <vector>
+
+#include "../src/api/cura_engine.h"
+
+namespace cura
+{
+
+class FffPolygonGeneratorTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(FffPolygonGeneratorTest);
+    CPPUNIT_TEST(wallsPerLayerTest);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    /*!
+     * \brief Sets up the test suite to prepare for testing.
+     *
+     * This creates a slice with the settings of a simple single extruder
+     * printer, to which the tests add their meshes.
+     */
+    void setUp();
+
+    /*!
+     * \brief Tears down the test suite when testing is done.
+     *
+     * This destroys the slice.
+     */
+    void tearDown();
+
+    //The actual test cases.
+    void wallsPerLayerTest();
+
+private:
+    /*!
+     * \brief The slice to which the meshes of a test are added.
+     */
+    CuraSlice* slice;
+
+    /*!
+     * \brief Runs the slice and gets the outer wall of each layer.
+     *
+     * \return For each layer, the coordinates of the moves which print its
+     * outer wall, as they are written in the g-code.
+     */
+    std::vector<std::vector<std::string>> sliceOuterWalls();
+};
+
+}
+
+#endif // FFF_POLYGON_GENERATOR_TEST_H
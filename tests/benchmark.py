@@ -0,0 +1,272 @@
+#!/usr/bin/python3
+
+## benchmark.py
+# The benchmark.py script times slicing a corpus of models with the CuraEngine command line interface.
+# For each model it records:
+# * The wall time of each stage of the slicing process, as logged by the engine
+# * The peak resident memory of the engine
+# * The size of the g-code
+# * The number of allocations of each stage, when the engine is built with ENABLE_ALLOCATION_COUNTING
+# The results can be stored as a baseline, to which the results of later runs are compared.
+# A run fails when any stage of any model got slower or made more allocations than the baseline by more than a threshold.
+#
+# The models of the corpus are generated by this script, except for the small part, which is tests/testModel.stl.
+
+import argparse
+import itertools
+import json
+import math
+import os
+import re
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+
+## Write triangles to a binary STL file.
+#
+#   The triangles are written as they are generated, so that this script stays small in memory:
+#   on Linux the peak memory of a child process is at least that of its parent when it was started.
+#
+#   \param filename The file to write.
+#   \param triangles An iterable of triangles, each a tuple of three (x, y, z) vertices in millimeters.
+def writeBinarySTL(filename, triangles):
+    with open(filename, "wb") as f:
+        f.write(b"CuraEngine benchmark corpus".ljust(80, b" "))
+        f.write(struct.pack("<I", 0))
+        triangle_count = 0
+        for triangle in triangles:
+            f.write(struct.pack("<12fH", 0, 0, 0, *(triangle[0] + triangle[1] + triangle[2] + (0,))))
+            triangle_count += 1
+        f.seek(80)
+        f.write(struct.pack("<I", triangle_count))
+
+
+## Generate the triangles of a sphere standing on the build plate.
+def sphere(center_x, center_y, radius, segment_count):
+    ring_count = segment_count // 2
+    def vertex(ring_idx, segment_idx):
+        polar = math.pi * ring_idx / ring_count
+        azimuth = 2 * math.pi * segment_idx / segment_count
+        return (center_x + radius * math.sin(polar) * math.cos(azimuth), center_y + radius * math.sin(polar) * math.sin(azimuth), radius - radius * math.cos(polar))
+    for ring_idx in range(ring_count):
+        for segment_idx in range(segment_count):
+            p00, p01 = vertex(ring_idx, segment_idx), vertex(ring_idx, segment_idx + 1)
+            p10, p11 = vertex(ring_idx + 1, segment_idx), vertex(ring_idx + 1, segment_idx + 1)
+            if ring_idx > 0: # the top ring is a fan of triangles
+                yield (p00, p10, p01)
+            if ring_idx + 1 < ring_count: # and so is the bottom ring
+                yield (p01, p10, p11)
+
+
+## Generate the triangles of a vertical cylinder.
+def cylinder(center_x, center_y, radius, bottom_z, top_z, segment_count):
+    bottom_center = (center_x, center_y, bottom_z)
+    top_center = (center_x, center_y, top_z)
+    for segment_idx in range(segment_count):
+        angle_a = 2 * math.pi * segment_idx / segment_count
+        angle_b = 2 * math.pi * (segment_idx + 1) / segment_count
+        bottom_a = (center_x + radius * math.cos(angle_a), center_y + radius * math.sin(angle_a), bottom_z)
+        bottom_b = (center_x + radius * math.cos(angle_b), center_y + radius * math.sin(angle_b), bottom_z)
+        top_a = (bottom_a[0], bottom_a[1], top_z)
+        top_b = (bottom_b[0], bottom_b[1], top_z)
+        yield (bottom_center, bottom_b, bottom_a)
+        yield (top_center, top_a, top_b)
+        yield (bottom_a, bottom_b, top_b)
+        yield (bottom_a, top_b, top_a)
+
+
+## A model of the corpus: how to slice it with the engine.
+class BenchmarkCase:
+    ##  \param name The name under which the results are reported.
+    #   \param settings The global settings, as a list of (key, value) pairs.
+    #   \param meshes The meshes, as a list of (extruder_nr, filename, mesh settings) tuples.
+    def __init__(self, name, settings, meshes):
+        self.name = name
+        self.settings = settings
+        self.meshes = meshes
+
+    ##  The command line which slices this case.
+    def getCommand(self, engine, definition, output_filename):
+        cmd = [engine, "slice", "-v", "-j", definition]
+        for key, value in self.settings:
+            cmd += ["-s", "%s=%s" % (key, value)]
+        current_extruder_nr = 0
+        for extruder_nr, filename, mesh_settings in self.meshes:
+            if extruder_nr != current_extruder_nr:
+                cmd += ["-e%d" % extruder_nr]
+                current_extruder_nr = extruder_nr
+            cmd += ["-l", filename]
+            for key, value in mesh_settings:
+                cmd += ["-s", "%s=%s" % (key, value)]
+        return cmd + ["-o", output_filename]
+
+
+##  Generate the meshes of the corpus into a directory, if they aren't there yet, and return the cases of the corpus.
+def createCorpus(corpus_path):
+    def generated(filename, generate):
+        path = os.path.join(corpus_path, filename)
+        if not os.path.exists(path):
+            writeBinarySTL(path, generate())
+        return path
+
+    small_part = os.path.join(os.path.dirname(os.path.abspath(__file__)), "testModel.stl")
+    huge_mesh = generated("huge_sphere.stl", lambda: sphere(0, 0, 40, 768))
+    def islands():
+        for row_idx in range(12):
+            for column_idx in range(12):
+                yield from cylinder((column_idx - 5.5) * 6, (row_idx - 5.5) * 6, 1.5, 0, 10, 16)
+    many_islands = generated("islands.stl", islands)
+    dual_sphere = generated("dual_sphere.stl", lambda: sphere(0, 0, 15, 96))
+    dual_cylinder = generated("dual_cylinder.stl", lambda: cylinder(0, 0, 12, 0, 30, 64))
+    mushroom = generated("mushroom.stl", lambda: itertools.chain(cylinder(0, 0, 3, 0, 20, 32), cylinder(0, 0, 30, 20, 23, 128)))
+
+    return [
+        BenchmarkCase("small_part", [], [(0, small_part, [])]),
+        BenchmarkCase("huge_mesh", [], [(0, huge_mesh, [])]),
+        BenchmarkCase("many_islands", [], [(0, many_islands, [])]),
+        BenchmarkCase("dual_extrusion", [("machine_extruder_count", 2), ("prime_tower_enable", "true"), ("prime_tower_position_x", 180), ("prime_tower_position_y", 180)],
+            [(0, dual_sphere, [("mesh_position_x", -25)]), (1, dual_cylinder, [("mesh_position_x", 25)])]),
+        BenchmarkCase("support_heavy", [("support_enable", "true"), ("support_interface_enable", "true")], [(0, mushroom, [])]),
+    ]
+
+
+##  Slice a case once.
+#
+#   \return A dictionary with the time and allocations of each stage, the total time, the peak memory and the g-code size, or None if the engine failed.
+def runCase(engine, definition, case, output_path):
+    output_filename = os.path.join(output_path, case.name + ".gcode")
+    profile_filename = os.path.join(output_path, case.name + ".profile.json")
+    with tempfile.TemporaryFile() as log_file:
+        start_time = time.time()
+        p = subprocess.Popen(case.getCommand(engine, definition, output_filename) + ["--profile", profile_filename], stdin=subprocess.DEVNULL, stdout=subprocess.DEVNULL, stderr=log_file)
+        if hasattr(os, "wait4"):
+            _, status, usage = os.wait4(p.pid, 0)
+            p.returncode = os.WEXITSTATUS(status) if os.WIFEXITED(status) else -1
+            peak_rss_kb = usage.ru_maxrss # in kilobytes on Linux
+        else:
+            p.wait()
+            peak_rss_kb = None
+        total_time = time.time() - start_time
+        log_file.seek(0)
+        log = log_file.read().decode("utf-8", "replace")
+    if p.returncode != 0:
+        print("Engine failed on %s:" % case.name)
+        print("\n".join(log.split("\n")[-5:]))
+        return None
+    stages = {}
+    for match in re.finditer(r"Progress: (\S+) accomplished in ([0-9.]+)s", log):
+        stages[match.group(1)] = stages.get(match.group(1), 0) + float(match.group(2))
+    allocations = {}
+    with open(profile_filename) as f:
+        for meshgroup in json.load(f)["meshgroups"]:
+            for stage in meshgroup["stages"]:
+                if "allocations" in stage: # only counted when the engine is built with ENABLE_ALLOCATION_COUNTING
+                    allocations[stage["stage"]] = allocations.get(stage["stage"], 0) + stage["allocations"]
+    return {"stages": stages, "allocations": allocations, "total_time": total_time, "peak_rss_kb": peak_rss_kb, "output_size": os.path.getsize(output_filename)}
+
+
+##  Slice a case a number of times, and keep the fastest time of each stage, which is the least disturbed by the rest of the system.
+def measureCase(engine, definition, case, output_path, repetitions):
+    result = None
+    for repetition in range(repetitions):
+        run = runCase(engine, definition, case, output_path)
+        if run is None:
+            return None
+        if result is None:
+            result = run
+            continue
+        for stage, stage_time in run["stages"].items():
+            result["stages"][stage] = min(result["stages"].get(stage, stage_time), stage_time)
+        for stage, allocation_count in run["allocations"].items():
+            result["allocations"][stage] = min(result["allocations"].get(stage, allocation_count), allocation_count)
+        result["total_time"] = min(result["total_time"], run["total_time"])
+        if run["peak_rss_kb"] is not None:
+            result["peak_rss_kb"] = max(result["peak_rss_kb"], run["peak_rss_kb"])
+    return result
+
+
+##  Compare results to a baseline.
+#
+#   Stages which took less than \p min_stage_time in the baseline are too noisy to compare.
+#
+#   \return A list of messages about the stages which got slower or made more allocations by more than \p threshold percent.
+def findRegressions(results, baseline, threshold, min_stage_time):
+    regressions = []
+    for name, result in results.items():
+        if name not in baseline:
+            continue
+        for stage, baseline_time in baseline[name]["stages"].items():
+            if baseline_time < min_stage_time or stage not in result["stages"]:
+                continue
+            stage_time = result["stages"][stage]
+            if stage_time > baseline_time * (1 + threshold / 100):
+                regressions.append("%s: %s took %.3fs instead of %.3fs (%+.1f%%)" % (name, stage, stage_time, baseline_time, (stage_time / baseline_time - 1) * 100))
+        for stage, baseline_count in baseline[name].get("allocations", {}).items():
+            if baseline_count == 0 or stage not in result.get("allocations", {}):
+                continue
+            allocation_count = result["allocations"][stage]
+            if allocation_count > baseline_count * (1 + threshold / 100):
+                regressions.append("%s: %s made %d allocations instead of %d (%+.1f%%)" % (name, stage, allocation_count, baseline_count, (allocation_count / baseline_count - 1) * 100))
+    return regressions
+
+
+def printResults(results, baseline):
+    for name, result in results.items():
+        print("%s: %.3fs, peak memory %s kB, %d bytes of g-code" % (name, result["total_time"], result["peak_rss_kb"], result["output_size"]))
+        for stage, stage_time in result["stages"].items():
+            if name in baseline and stage in baseline[name]["stages"] and baseline[name]["stages"][stage] > 0:
+                print("    %-12s %8.3fs (baseline %.3fs, %+.1f%%)" % (stage, stage_time, baseline[name]["stages"][stage], (stage_time / baseline[name]["stages"][stage] - 1) * 100))
+            else:
+                print("    %-12s %8.3fs" % (stage, stage_time))
+        for stage, allocation_count in result["allocations"].items():
+            print("    %-12s %8d allocations" % (stage, allocation_count))
+
+
+def main(args):
+    corpus_path = args.corpus if args.corpus else tempfile.mkdtemp(prefix="cura_benchmark_corpus_")
+    os.makedirs(corpus_path, exist_ok=True)
+    output_path = tempfile.mkdtemp(prefix="cura_benchmark_output_")
+    cases = createCorpus(corpus_path)
+    if args.cases:
+        cases = [case for case in cases if case.name in args.cases]
+
+    results = {}
+    failed = False
+    for case in cases:
+        print("Slicing: %s (%d/%d)" % (case.name, cases.index(case) + 1, len(cases)))
+        result = measureCase(args.engine, args.json, case, output_path, args.repetitions)
+        if result is None:
+            failed = True
+        else:
+            results[case.name] = result
+
+    baseline = {}
+    if args.baseline and os.path.exists(args.baseline):
+        with open(args.baseline) as f:
+            baseline = json.load(f)["cases"]
+    printResults(results, baseline)
+    if args.save:
+        with open(args.save, "w") as f:
+            json.dump({"cases": results}, f, indent = 4, sort_keys = True)
+
+    regressions = findRegressions(results, baseline, args.threshold, args.min_stage_time)
+    for regression in regressions:
+        print("Regression: %s" % regression)
+    if failed or regressions:
+        sys.exit(1)
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="CuraEngine end-to-end benchmark")
+    parser.add_argument("json", type=str, help="Machine JSON file to use")
+    parser.add_argument("engine", type=str, help="Engine executable")
+    parser.add_argument("--corpus", type=str, help="Directory in which to keep the generated models; a temporary directory by default")
+    parser.add_argument("--cases", type=str, nargs="+", help="Only slice these models of the corpus")
+    parser.add_argument("--repetitions", type=int, default=3, help="How many times to slice each model")
+    parser.add_argument("--baseline", type=str, help="Results of an earlier run to compare to")
+    parser.add_argument("--save", type=str, help="File to write the results to, to be used as a baseline later")
+    parser.add_argument("--threshold", type=float, default=10, help="Percentage by which a stage may be slower or make more allocations than the baseline")
+    parser.add_argument("--min-stage-time", type=float, default=0.05, help="Seconds a stage should take in the baseline to be compared")
+    main(parser.parse_args())
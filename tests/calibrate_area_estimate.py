@@ -0,0 +1,92 @@
+#!/usr/bin/python3
+
+## calibrate_area_estimate.py
+# The calibrate_area_estimate.py script fits the correction factors of the area estimate (CuraEngine slice --area-estimate)
+# to the full estimate of the planned layers (CuraEngine slice --estimate-only) over the corpus of benchmark.py.
+# For each model it reports the relative error of the print time and the material of the uncalibrated and the calibrated area estimate.
+# The fitted factors are printed in the format of the --area-estimate-calibration option.
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+from benchmark import createCorpus
+
+
+##  Slice a case with extra options of the engine and read the estimates it writes to the standard output.
+#
+#   \return A tuple of the estimates, as a dictionary with the print time and the material volume of each extruder, and the wall time the engine took,
+#       or None if the engine failed.
+def runEstimate(engine, definition, case, options):
+    start_time = time.time()
+    p = subprocess.run(case.getCommand(engine, definition, os.devnull) + options, stdin=subprocess.DEVNULL, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    wall_time = time.time() - start_time
+    if p.returncode != 0:
+        print("Engine failed on %s:" % case.name)
+        print("\n".join(p.stderr.decode("utf-8", "replace").split("\n")[-5:]))
+        return None
+    return json.loads(p.stdout.decode("utf-8").strip().split("\n")[-1]), wall_time
+
+
+##  The factor which minimizes the sum of the squared relative errors of factor * estimate against the reference.
+def fitFactor(pairs):
+    pairs = [(estimate, reference) for estimate, reference in pairs if estimate > 0 and reference > 0]
+    if not pairs:
+        return 1.0
+    ratios = [estimate / reference for estimate, reference in pairs]
+    return sum(ratios) / sum(ratio * ratio for ratio in ratios)
+
+
+def relativeError(estimate, reference):
+    return (estimate / reference - 1) * 100 if reference > 0 else 0
+
+
+def main(args):
+    corpus_path = args.corpus if args.corpus else tempfile.mkdtemp(prefix="cura_benchmark_corpus_")
+    os.makedirs(corpus_path, exist_ok=True)
+    cases = createCorpus(corpus_path)
+    if args.cases:
+        cases = [case for case in cases if case.name in args.cases]
+
+    results = {}
+    failed = False
+    for case in cases:
+        print("Estimating: %s (%d/%d)" % (case.name, cases.index(case) + 1, len(cases)))
+        full = runEstimate(args.engine, args.json, case, ["--estimate-only"])
+        area = runEstimate(args.engine, args.json, case, ["--area-estimate"])
+        if full is None or area is None:
+            failed = True
+            continue
+        results[case.name] = {"full": full[0], "full_wall_time": full[1], "area": area[0], "area_wall_time": area[1]}
+
+    time_factor = fitFactor([(result["area"]["print_time"], result["full"]["print_time"]) for result in results.values()])
+    material_factor = fitFactor([(sum(result["area"]["material_volume"]), sum(result["full"]["material_volume"])) for result in results.values()])
+
+    for name, result in results.items():
+        full_time = result["full"]["print_time"]
+        area_time = result["area"]["print_time"]
+        full_material = sum(result["full"]["material_volume"])
+        area_material = sum(result["area"]["material_volume"])
+        print("%s: estimated in %.3fs instead of %.3fs" % (name, result["area_wall_time"], result["full_wall_time"]))
+        print("    print time %10.1fs: %+6.1f%% uncalibrated, %+6.1f%% calibrated" % (full_time, relativeError(area_time, full_time), relativeError(area_time * time_factor, full_time)))
+        print("    material   %10.1fmm3: %+6.1f%% uncalibrated, %+6.1f%% calibrated" % (full_material, relativeError(area_material, full_material), relativeError(area_material * material_factor, full_material)))
+    print("--area-estimate-calibration %.4f,%.4f" % (time_factor, material_factor))
+
+    if args.save:
+        with open(args.save, "w") as f:
+            json.dump({"cases": results, "time_factor": time_factor, "material_factor": material_factor}, f, indent = 4, sort_keys = True)
+    if failed:
+        sys.exit(1)
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Fit the correction factors of the CuraEngine area estimate to the full estimate")
+    parser.add_argument("json", type=str, help="Machine JSON file to use")
+    parser.add_argument("engine", type=str, help="Engine executable")
+    parser.add_argument("--corpus", type=str, help="Directory in which to keep the generated models; a temporary directory by default")
+    parser.add_argument("--cases", type=str, nargs="+", help="Only estimate these models of the corpus")
+    parser.add_argument("--save", type=str, help="File to write the estimates and the fitted factors to")
+    main(parser.parse_args())
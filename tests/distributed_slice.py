@@ -0,0 +1,178 @@
+#!/usr/bin/python3
+
+## distributed_slice.py
+# The distributed_slice.py script plans a print with several engine processes, each writing the gcode of a range of layers
+# (CuraEngine slice --layer-range), and stitches their gcode together into one file.
+# The workers run on this machine, or on other machines through a command prefix such as "ssh {host}".
+# The engine, the machine json and the models have to be at the same paths on every worker. The gcode is read from the standard output of each worker.
+#
+# Each worker slices the whole model and generates all areas, so the skin, infill and support of its layers are exactly those
+# of a single process, and no overlap between the ranges is needed. Only the paths of its own layers are generated, planned and written.
+# Support is computed from the top down, so a worker can only skip the areas of the layers above its range in two phases:
+#   1. every worker computes the overhang of its range plus the skin distance above and below it, and sends the support areas
+#      which its range hands down to the range below to the coordinator;
+#   2. the coordinator passes those areas on to the worker of the range below, which continues the support downward from them.
+# That protocol isn't implemented yet; until it is, the area stages take as long on each worker as on a single machine.
+#
+# The gcode of the layers of a range is written between ;LAYER_RANGE_START and ;LAYER_RANGE_END comments.
+# A range which doesn't start at the first layer begins by heating and selecting the extruder it starts with,
+# and assumes that the range below it left the nozzle retracted at the end of its last layer.
+# The stitched gcode has the start gcode of the first range and the end gcode of the last range;
+# the print time and material in its header and its ;TIME_ELAPSED comments are those of the whole print.
+# Each range starts planning with the first extruder, so with several extruders the extruder order at the start of a range
+# may differ from a single process.
+
+import argparse
+import re
+import shlex
+import struct
+import subprocess
+import sys
+
+
+##  The height of the models given with -l in the engine arguments, in mm, to estimate the number of layers.
+def getModelHeight(engine_args):
+    height = 0
+    for i, arg in enumerate(engine_args[:-1]):
+        if arg != "-l":
+            continue
+        with open(engine_args[i + 1], "rb") as f:
+            data = f.read()
+        z = []
+        if data[:5] == b"solid" and b"facet" in data[:1000]:
+            for line in data.decode("utf-8", "replace").split("\n"):
+                words = line.split()
+                if len(words) == 4 and words[0] == "vertex":
+                    z.append(float(words[3]))
+        else:
+            triangle_count = struct.unpack_from("<I", data, 80)[0]
+            for n in range(triangle_count):
+                vertices = struct.unpack_from("<9f", data, 84 + n * 50 + 12)
+                z.extend(vertices[2::3])
+        if z:
+            height = max(height, max(z) - min(z))
+    return height
+
+
+##  The value of a setting given with -s in the engine arguments, or the default.
+def getSetting(engine_args, key, default):
+    value = default
+    for i, arg in enumerate(engine_args[:-1]):
+        if arg == "-s" and engine_args[i + 1].startswith(key + "="):
+            value = engine_args[i + 1][len(key) + 1:]
+    return value
+
+
+##  The layer ranges of the workers: consecutive ranges of about the same number of layers, of which the last one goes up to the top layer.
+def getLayerRanges(layer_count, chunk_count):
+    chunk_count = max(1, min(chunk_count, layer_count))
+    ranges = []
+    for chunk_idx in range(chunk_count):
+        first = chunk_idx * layer_count // chunk_count
+        last = (chunk_idx + 1) * layer_count // chunk_count - 1 if chunk_idx < chunk_count - 1 else -1
+        ranges.append((first, last))
+    return ranges
+
+
+##  A range of layers of the print as written by one worker.
+class Chunk:
+    def __init__(self, gcode):
+        lines = gcode.split("\n")
+        start = next(i for i, line in enumerate(lines) if line.startswith(";LAYER_RANGE_START:"))
+        end = next(i for i, line in enumerate(lines) if line.startswith(";LAYER_RANGE_END:"))
+        self.prefix = lines[:start]
+        self.body = lines[start + 1:end]
+        self.suffix = []
+        self.time = 0.0
+        self.material = {}
+        for line in lines[end + 1:]:
+            match = re.match(r";LAYER_RANGE_MATERIAL\.(\d+):(.*)", line)
+            if line.startswith(";LAYER_RANGE_TIME:"):
+                self.time = float(line.split(":")[1])
+            elif match:
+                self.material[int(match.group(1))] = float(match.group(2))
+            else:
+                self.suffix.append(line)
+        ## The elapsed time at the start of the body, as counted by the worker just before the start of the range
+        self.start_time = 0.0
+        if self.prefix and self.prefix[-1].startswith(";TIME_ELAPSED:"):
+            self.start_time = float(self.prefix.pop().split(":")[1])
+
+
+##  Replace the totals in the header or trailer lines with those of the whole print.
+def fixTotals(lines, print_time, material):
+    fixed = []
+    for line in lines:
+        match = re.match(r";EXTRUDER_TRAIN\.(\d+)\.MATERIAL\.VOLUME_USED:", line)
+        if line.startswith(";TIME:"):
+            line = ";TIME:%d" % print_time
+        elif line.startswith(";PRINT.TIME:"):
+            line = ";PRINT.TIME:%d" % print_time
+        elif match:
+            line = ";EXTRUDER_TRAIN.%s.MATERIAL.VOLUME_USED:%d" % (match.group(1), material.get(int(match.group(1)), 0))
+        elif line.startswith(";MATERIAL:"):
+            line = ";MATERIAL:%d" % material.get(0, 0)
+        elif line.startswith(";MATERIAL2:"):
+            line = ";MATERIAL2:%d" % material.get(1, 0)
+        fixed.append(line)
+    return fixed
+
+
+def stitch(chunks):
+    print_time = chunks[0].start_time + sum(chunk.time for chunk in chunks)
+    material = {}
+    for chunk in chunks:
+        for extruder_nr, volume in chunk.material.items():
+            material[extruder_nr] = material.get(extruder_nr, 0) + volume
+
+    lines = fixTotals(chunks[0].prefix, print_time, material)
+    elapsed = chunks[0].start_time
+    for chunk in chunks:
+        for line in chunk.body:
+            if line.startswith(";TIME_ELAPSED:"):
+                line = ";TIME_ELAPSED:%.3f" % (float(line.split(":")[1]) - chunk.start_time + elapsed)
+            lines.append(line)
+        elapsed += chunk.time
+    lines += fixTotals(chunks[-1].suffix, print_time, material)
+    return "\n".join(lines)
+
+
+def main(args):
+    engine_args = args.engine_args[1:] if args.engine_args[:1] == ["--"] else args.engine_args
+    layer_count = args.layers
+    if not layer_count:
+        layer_height = float(getSetting(engine_args, "layer_height", "0.1"))
+        layer_count = max(1, int(getModelHeight(engine_args) / layer_height))
+    hosts = args.workers if args.workers else [None] * args.chunks
+    ranges = getLayerRanges(layer_count, len(hosts))
+
+    processes = []
+    for (first, last), host in zip(ranges, hosts):
+        command = [args.engine] + engine_args + ["--layer-range", "%d,%d" % (first, last)]
+        if host is not None:
+            command = shlex.split(args.remote_command.format(host = host)) + [" ".join(shlex.quote(arg) for arg in command)]
+        processes.append(subprocess.Popen(command, stdin = subprocess.DEVNULL, stdout = subprocess.PIPE, stderr = subprocess.PIPE))
+
+    chunks = []
+    for (first, last), process in zip(ranges, processes):
+        gcode, log = process.communicate()
+        if process.returncode != 0:
+            print("Worker of layers %d to %d failed:" % (first, last))
+            print("\n".join(log.decode("utf-8", "replace").split("\n")[-5:]))
+            sys.exit(1)
+        chunks.append(Chunk(gcode.decode("utf-8")))
+
+    with open(args.output, "w") as f:
+        f.write(stitch(chunks))
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description = "Plan a print with several CuraEngine processes which each write a range of layers")
+    parser.add_argument("engine", type = str, help = "Engine executable")
+    parser.add_argument("output", type = str, help = "File to write the stitched gcode to")
+    parser.add_argument("engine_args", nargs = argparse.REMAINDER, help = "The arguments of the engine after --, e.g. -- slice -j machine.def.json -l model.stl")
+    parser.add_argument("--chunks", type = int, default = 2, help = "The number of local workers, if no --workers are given")
+    parser.add_argument("--workers", type = str, nargs = "+", help = "The hosts on which to run a worker each")
+    parser.add_argument("--remote-command", type = str, default = "ssh {host}", help = "The command prefix which runs a command on a host")
+    parser.add_argument("--layers", type = int, help = "The number of layers to divide; estimated from the height of the models by default")
+    main(parser.parse_args())
@@ -3,6 +3,8 @@
 
 #include "PolygonTest.h"
 
+#include <sstream>
+
 namespace cura
 {
     CPPUNIT_TEST_SUITE_REGISTRATION(PolygonTest);
@@ -91,6 +93,54 @@ void PolygonTest::isOutsideTest()
     CPPUNIT_ASSERT_MESSAGE("Below point is calculated as inside while it's outside!", !test_triangle.inside(Point(100, -100)));
 }
 
+void PolygonTest::offsetMultiTest()
+{
+    Polygons polys;
+    polys.add(pointy_square);
+    offsetMultiAssert(polys, {25, -10, -20, -30}); //The notches split it in two before it's gone.
+}
+
+void PolygonTest::offsetMultiHoleTest()
+{
+    Polygons polys;
+    PolygonRef outer = polys.newPoly();
+    outer.emplace_back(0, 0);
+    outer.emplace_back(1000, 0);
+    outer.emplace_back(1000, 1000);
+    outer.emplace_back(0, 1000);
+    PolygonRef hole = polys.newPoly();
+    hole.emplace_back(300, 300);
+    hole.emplace_back(300, 700);
+    hole.emplace_back(700, 700);
+    hole.emplace_back(700, 300);
+    offsetMultiAssert(polys, {100, -25, -50, -100, -200}); //The walls around the hole are 300 wide.
+}
+
+void PolygonTest::offsetMultiAssert(const Polygons& polys, const std::vector<int>& distances)
+{
+    std::vector<Polygons> results;
+    polys.offsetMulti(distances, results);
+
+    CPPUNIT_ASSERT_MESSAGE("offsetMulti didn't stop at the first empty offset!", results.size() == distances.size() - 1);
+    CPPUNIT_ASSERT_MESSAGE("The last offset should've left nothing of the polygons!", polys.offset(distances.back()).size() == 0);
+    for (unsigned int distance_idx = 0; distance_idx < results.size(); distance_idx++)
+    {
+        const Polygons expected = polys.offset(distances[distance_idx]);
+        const Polygons& result = results[distance_idx];
+        std::stringstream ss;
+        ss << "offsetMulti by " << distances[distance_idx] << " differs from offset by the same distance!";
+        CPPUNIT_ASSERT_MESSAGE(ss.str(), result.size() == expected.size());
+        for (unsigned int poly_idx = 0; poly_idx < result.size(); poly_idx++)
+        {
+            CPPUNIT_ASSERT_MESSAGE(ss.str(), result[poly_idx].size() == expected[poly_idx].size());
+            for (unsigned int point_idx = 0; point_idx < result[poly_idx].size(); point_idx++)
+            {
+                CPPUNIT_ASSERT_MESSAGE(ss.str(), result[poly_idx][point_idx] == expected[poly_idx][point_idx]);
+            }
+        }
+    }
+}
+
 
 
 
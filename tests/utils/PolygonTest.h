@@ -5,6 +5,7 @@
 #define POLYGON_TEST_H
 
 #include <functional> // function
+#include <vector>
 
 #include <cppunit/TestFixture.h>
 #include <cppunit/extensions/HelperMacros.h>
@@ -21,6 +22,8 @@ class PolygonTest : public CppUnit::TestFixture
     CPPUNIT_TEST(polygonOffsetTest);
     CPPUNIT_TEST(polygonOffsetBugTest);
     CPPUNIT_TEST(isOutsideTest);
+    CPPUNIT_TEST(offsetMultiTest);
+    CPPUNIT_TEST(offsetMultiHoleTest);
     CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -44,6 +47,8 @@ public:
     void polygonOffsetTest();
     void polygonOffsetBugTest();
     void isOutsideTest();
+    void offsetMultiTest();
+    void offsetMultiHoleTest();
 
 
 private:
@@ -51,6 +56,16 @@ private:
      * \brief The maximum allowed error in distance measurements.
      */
     static const int64_t maximum_error = 10;
+
+    /*!
+     * \brief Asserts that Polygons::offsetMulti gives the same polygons as
+     * calling Polygons::offset for each of the distances.
+     *
+     * \param polys The polygons to offset.
+     * \param distances The distances to offset by, of which only the last
+     * one leaves nothing of the polygons.
+     */
+    void offsetMultiAssert(const Polygons& polys, const std::vector<int>& distances);
     
     Polygon test_square;
     Polygon pointy_square;
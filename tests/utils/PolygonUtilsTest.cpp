@@ -242,6 +242,27 @@ void PolygonUtilsTest::middleEdgeFindCloseTest()
 }
 
 
+void PolygonUtilsTest::findClosestWithoutPenaltyTest()
+{ // without a penalty line segments are skipped by their bounding boxes, which shouldn't change the result
+    const std::function<int(Point)> zero_penalty_function([](Point) { return 0; });
+    for (const PolygonRef poly : { PolygonRef(test_square), PolygonRef(pointy_square) })
+    {
+        for (int x = -20; x <= 200; x += 7)
+        {
+            for (int y = -20; y <= 200; y += 7)
+            {
+                const Point from(x, y);
+                const ClosestPolygonPoint skipping = PolygonUtils::findClosest(from, poly);
+                const ClosestPolygonPoint exhaustive = PolygonUtils::findClosest(from, poly, zero_penalty_function);
+                std::stringstream ss;
+                ss << "Closest to " << from << " we found " << skipping.location << " at index " << skipping.point_idx
+                    << " rather than " << exhaustive.location << " at index " << exhaustive.point_idx << ".\n";
+                CPPUNIT_ASSERT_MESSAGE(ss.str(), skipping.location == exhaustive.location && skipping.point_idx == exhaustive.point_idx);
+            }
+        }
+    }
+}
+
 void PolygonUtilsTest::findCloseAssert(const PolygonRef poly, Point close_to, Point supposed, int cell_size, const std::function<int(Point)>* penalty_function)
 {
     Polygons polys;
@@ -38,6 +38,7 @@ class PolygonUtilsTest : public CppUnit::TestFixture
     CPPUNIT_TEST(cornerFindCloseTest);
     CPPUNIT_TEST(edgeFindCloseTest);
     CPPUNIT_TEST(middleEdgeFindCloseTest);
+    CPPUNIT_TEST(findClosestWithoutPenaltyTest);
     CPPUNIT_TEST(moveInsidePointyCornerTest);
     CPPUNIT_TEST(moveOutsidePointyCornerTest);
     CPPUNIT_TEST(moveInsidePointyCornerTestFail);
@@ -99,6 +100,8 @@ public:
     void edgeFindCloseTest();
     void middleEdgeFindCloseTest();
 
+    void findClosestWithoutPenaltyTest();
+
     void moveInsidePointyCornerTest();
     void moveOutsidePointyCornerTest();
     void moveInsidePointyCornerTestFail();
@@ -180,6 +180,141 @@ void SparseGridTest::getNearestSameTest()
     getNearestAssert(input, Point(100, 100), 10, new Point(100, 100));
 }
 
+void SparseGridTest::cellCollisionTest()
+{
+    //A new grid has 16 slots and holds 8 cells before it grows, so the cells
+    //of these rounds collide in the table and some are probed past its end.
+    const coord_t cell_size = 10;
+    const unsigned int cell_count = 8;
+    for (int round = 0; round < 64; round++)
+    {
+        SparseGrid<unsigned int> grid(cell_size);
+        std::vector<Point> cell_pts;
+        for (unsigned int cell_idx = 0; cell_idx < cell_count; cell_idx++)
+        {
+            cell_pts.push_back(Point(round * 8 + coord_t(cell_idx) - 100, coord_t(cell_idx % 3) - round) * cell_size);
+        }
+        for (unsigned int cell_idx = 0; cell_idx < cell_count; cell_idx++)
+        {
+            grid.insert(cell_pts[cell_idx], cell_idx);
+        }
+        for (unsigned int cell_idx = 0; cell_idx < cell_count; cell_idx++)
+        { //Second pass, so that the existing cells have to be found past the colliding ones.
+            grid.insert(cell_pts[cell_idx], cell_idx + cell_count);
+        }
+
+        CPPUNIT_ASSERT_EQUAL_MESSAGE("Colliding cells were merged or duplicated.", size_t(cell_count), grid.getOccupiedCellCount());
+        for (unsigned int cell_idx = 0; cell_idx < cell_count; cell_idx++)
+        {
+            cellValuesAssert(grid, cell_pts[cell_idx], {cell_idx, cell_idx + cell_count});
+        }
+    }
+}
+
+void SparseGridTest::growthTest()
+{
+    const coord_t cell_size = 10;
+    const coord_t grid_width = 100;
+    SparseGrid<unsigned int> grid(cell_size); //Nothing reserved, so the cell table grows many times.
+    std::vector<std::vector<unsigned int>> expected(grid_width * grid_width);
+    unsigned int elem_count = 0;
+    for (unsigned int pass = 0; pass < 2; pass++)
+    {
+        for (coord_t y = 0; y < grid_width; y++)
+        {
+            for (coord_t x = 0; x < grid_width; x++)
+            {
+                if (pass == 1 && (x + y) % 5 != 0)
+                {
+                    continue;
+                }
+                const Point cell_pt = Point(x - grid_width / 2, y - grid_width / 2) * cell_size;
+                grid.insert(cell_pt, elem_count);
+                expected[y * grid_width + x].push_back(elem_count);
+                elem_count++;
+            }
+        }
+    }
+
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("Elements were lost while the grid grew.", size_t(elem_count), grid.getElemCount());
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("Cells were lost while the grid grew.", size_t(grid_width * grid_width), grid.getOccupiedCellCount());
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("Elements were put in the wrong cell.", size_t(2), grid.getMaxCellElemCount());
+    for (coord_t y = 0; y < grid_width; y++)
+    {
+        for (coord_t x = 0; x < grid_width; x++)
+        {
+            const Point cell_pt = Point(x - grid_width / 2, y - grid_width / 2) * cell_size;
+            cellValuesAssert(grid, cell_pt, expected[y * grid_width + x]);
+        }
+    }
+}
+
+void SparseGridTest::insertAllOrderTest()
+{
+    const coord_t cell_size = 50;
+    std::vector<SparseGrid<unsigned int>::Elem> elems;
+    for (unsigned int elem_idx = 0; elem_idx < 2000; elem_idx++)
+    { //Scattered, with about 5 elements per cell and some in the same place.
+        const Point point((elem_idx * 7919) % 1000 - 500, (elem_idx * 104729 / 7) % 1000 - 500);
+        elems.emplace_back(point, elem_idx);
+    }
+
+    //Both grids already have some of the cells, which insertAll has to add to.
+    SparseGrid<unsigned int> inserted(cell_size);
+    SparseGrid<unsigned int> inserted_all(cell_size);
+    const unsigned int existing_count = 100;
+    for (unsigned int elem_idx = 0; elem_idx < existing_count; elem_idx++)
+    {
+        inserted.insert(elems[elem_idx].point, elems[elem_idx].val);
+        inserted_all.insert(elems[elem_idx].point, elems[elem_idx].val);
+    }
+    for (unsigned int elem_idx = existing_count; elem_idx < elems.size(); elem_idx++)
+    {
+        inserted.insert(elems[elem_idx].point, elems[elem_idx].val);
+    }
+    inserted_all.insertAll(std::vector<SparseGrid<unsigned int>::Elem>(elems.begin() + existing_count, elems.end()));
+
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("insertAll gave a different number of cells than insert.", inserted.getOccupiedCellCount(), inserted_all.getOccupiedCellCount());
+    const coord_t radius = 60;
+    for (coord_t y = -550; y <= 550; y += 37)
+    {
+        for (coord_t x = -550; x <= 550; x += 37)
+        {
+            const Point query_pt(x, y);
+            {
+                std::stringstream ss;
+                ss << "getNearby around " << query_pt << " gave different elements or a different order after insertAll than after insert.";
+                CPPUNIT_ASSERT_MESSAGE(ss.str(), inserted.getNearbyVals(query_pt, radius) == inserted_all.getNearbyVals(query_pt, radius));
+            }
+            //Of elements at the same distance, the first one processed is the nearest, so this depends on the order too.
+            SparseGrid<unsigned int>::Elem nearest;
+            SparseGrid<unsigned int>::Elem nearest_all;
+            const bool found = inserted.getNearest(query_pt, radius, nearest);
+            const bool found_all = inserted_all.getNearest(query_pt, radius, nearest_all);
+            {
+                std::stringstream ss;
+                ss << "getNearest around " << query_pt << " gave a different element after insertAll than after insert.";
+                CPPUNIT_ASSERT_MESSAGE(ss.str(), found == found_all && (!found || nearest.val == nearest_all.val));
+            }
+        }
+    }
+}
+
+void SparseGridTest::cellValuesAssert(
+    const SparseGrid<unsigned int>& grid,
+    Point cell_pt,
+    std::vector<unsigned int> expected)
+{
+    std::vector<unsigned int> result = grid.getNearbyVals(cell_pt, 0);
+    std::sort(result.begin(), result.end());
+    std::sort(expected.begin(), expected.end());
+    std::stringstream ss;
+    ss << "The cell of " << cell_pt << " has " << result.size() <<
+        " elements, but it should have the " << expected.size() <<
+        " inserted into it.";
+    CPPUNIT_ASSERT_MESSAGE(ss.str(), result == expected);
+}
+
 void SparseGridTest::getNearbyAssert(
     const std::vector<Point>& registered_points,
     Point target, const coord_t grid_size,
@@ -27,6 +27,9 @@ class SparseGridTest : public CppUnit::TestFixture
     CPPUNIT_TEST(getNearestFilterTest);
     CPPUNIT_TEST(getNearestNoneTest);
     CPPUNIT_TEST(getNearestSameTest);
+    CPPUNIT_TEST(cellCollisionTest);
+    CPPUNIT_TEST(growthTest);
+    CPPUNIT_TEST(insertAllOrderTest);
     CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -53,6 +56,9 @@ public:
     void getNearestFilterTest();
     void getNearestNoneTest();
     void getNearestSameTest();
+    void cellCollisionTest();
+    void growthTest();
+    void insertAllOrderTest();
 
 private:
     /*!
@@ -104,6 +110,19 @@ private:
         Point* expected,
         const std::function<bool(const typename SparseGrid<Point>::Elem& elem)> &precondition =
             SparseGrid<Point>::no_precondition);
+
+    /*!
+     * \brief Asserts that a cell of the grid contains exactly the expected
+     * values.
+     *
+     * \param grid The grid to look in.
+     * \param cell_pt A point in the cell, which is the only cell searched.
+     * \param expected The values expected in the cell, in any order.
+     */
+    void cellValuesAssert(
+        const SparseGrid<unsigned int>& grid,
+        Point cell_pt,
+        std::vector<unsigned int> expected);
 };
 
 }